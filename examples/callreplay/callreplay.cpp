@@ -0,0 +1,633 @@
+/*
+ *  callreplay.cpp
+ *  BEAGLE
+ *
+ *  Replays a trace of API calls recorded with BEAGLE_RECORD=<file> against any
+ *  resource and reports how long the calls took, by call, next to the times
+ *  recorded with the trace.
+ *
+ *  The trace is read into memory before the replay starts, so the timings hold
+ *  no file access. Every rep replays the whole trace, creating its instances
+ *  afresh; the timings are those of the fastest rep. Log likelihoods are
+ *  compared with the recorded ones and the largest relative difference is
+ *  printed.
+ *
+ *  Instances are created plainly on the recorded resource, or the one given
+ *  with --rsrc, with the recorded flags and the precision of the recorded
+ *  instance. Neither calibration nor sharding is reproduced.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/CallRecorder.h"
+
+struct field {
+    char tag;
+    int64_t integer; // 'i', 'l' and array ids for 'a'
+    double real;
+};
+
+struct call {
+    int type;
+    int instance;
+    int returnValue;
+    double seconds;
+    std::vector<field> fields;
+};
+
+struct trace {
+    std::map<int, std::vector<int> > intArrays;
+    std::map<int, std::vector<double> > doubleArrays;
+    std::vector<call> calls;
+};
+
+struct instanceShape {
+    int instance;
+    int stateCount;
+    int patternCount;
+    int categoryCount;
+};
+
+void abort(std::string msg) {
+    std::cerr << msg << "\nAborting..." << std::endl;
+    std::exit(1);
+}
+
+template <typename T>
+T readValue(const std::vector<char>& bytes,
+            size_t* offset) {
+    T value;
+    if (*offset + sizeof(T) > bytes.size())
+        abort("Trace is truncated");
+    memcpy(&value, &bytes[*offset], sizeof(T));
+    *offset += sizeof(T);
+    return value;
+}
+
+void readTrace(const char* path,
+               trace* calls) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        abort(std::string("Unable to open trace ") + path);
+    std::vector<char> bytes;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    fclose(file);
+
+    size_t magicLength = strlen(BEAGLE_RECORD_MAGIC);
+    if (bytes.size() < magicLength || memcmp(&bytes[0], BEAGLE_RECORD_MAGIC, magicLength) != 0)
+        abort(std::string(path) + " is not a BEAGLE call trace");
+
+    size_t offset = magicLength;
+    while (offset < bytes.size()) {
+        char kind = readValue<char>(bytes, &offset);
+        if (kind == 'A') {
+            int32_t id = readValue<int32_t>(bytes, &offset);
+            uint8_t type = readValue<uint8_t>(bytes, &offset);
+            int64_t length = readValue<int64_t>(bytes, &offset);
+            if (type == 'i') {
+                std::vector<int>& values = calls->intArrays[id];
+                values.resize(length);
+                for (int64_t i = 0; i < length; i++)
+                    values[i] = readValue<int32_t>(bytes, &offset);
+            } else if (type == 'd') {
+                std::vector<double>& values = calls->doubleArrays[id];
+                values.resize(length);
+                for (int64_t i = 0; i < length; i++)
+                    values[i] = readValue<double>(bytes, &offset);
+            } else {
+                abort("Unknown array type in trace");
+            }
+        } else if (kind == 'C') {
+            call c;
+            c.type = readValue<int32_t>(bytes, &offset);
+            c.instance = readValue<int32_t>(bytes, &offset);
+            c.returnValue = readValue<int32_t>(bytes, &offset);
+            c.seconds = readValue<double>(bytes, &offset);
+            int32_t fieldCount = readValue<int32_t>(bytes, &offset);
+            for (int32_t f = 0; f < fieldCount; f++) {
+                field value;
+                value.tag = readValue<char>(bytes, &offset);
+                value.integer = 0;
+                value.real = 0.0;
+                if (value.tag == 'i' || value.tag == 'a')
+                    value.integer = readValue<int32_t>(bytes, &offset);
+                else if (value.tag == 'l')
+                    value.integer = readValue<int64_t>(bytes, &offset);
+                else if (value.tag == 'd')
+                    value.real = readValue<double>(bytes, &offset);
+                else
+                    abort("Unknown field type in trace");
+                c.fields.push_back(value);
+            }
+            calls->calls.push_back(c);
+        } else {
+            abort("Unknown record in trace");
+        }
+    }
+}
+
+// Reads the fields of one call in the order they were recorded
+class fieldReader {
+public:
+    fieldReader(const trace& calls,
+                const call& c) : calls(calls), c(c), next(0) {}
+
+    int nextInt() { return (int) take('i').integer; }
+    long long nextLong() { return (long long) take('l').integer; }
+    double nextDouble() { return take('d').real; }
+
+    const int* nextInts() {
+        int id = (int) take('a').integer;
+        std::map<int, std::vector<int> >::const_iterator found = calls.intArrays.find(id);
+        if (found == calls.intArrays.end())
+            return NULL;
+        return (found->second.empty() ? &empty : &found->second[0]);
+    }
+
+    const double* nextDoubles() {
+        int id = (int) take('a').integer;
+        std::map<int, std::vector<double> >::const_iterator found = calls.doubleArrays.find(id);
+        if (found == calls.doubleArrays.end())
+            return NULL;
+        return (found->second.empty() ? &emptyReal : &found->second[0]);
+    }
+
+private:
+    const trace& calls;
+    const call& c;
+    size_t next;
+    int empty = 0;
+    double emptyReal = 0.0;
+
+    const field& take(char tag) {
+        if (next >= c.fields.size() || c.fields[next].tag != tag)
+            abort(std::string("Malformed ") + beagle::getRecordedCallName(c.type) + " call in trace");
+        return c.fields[next++];
+    }
+};
+
+struct replayResult {
+    double totalSeconds;
+    std::vector<double> seconds; // by call type
+    double maxRelativeDifference;
+    int mismatchedReturns;
+    int skippedCalls;
+};
+
+double relativeDifference(double value,
+                          double recorded) {
+    if (value == recorded)
+        return 0.0;
+    return std::fabs(value - recorded) / std::max(std::fabs(recorded), 1e-300);
+}
+
+// Creates the instance a recorded creation asks for and returns its number
+int createInstance(fieldReader& args,
+                   int rsrc,
+                   instanceShape* shape,
+                   bool verbose) {
+    int tipCount = args.nextInt();
+    int partialsBufferCount = args.nextInt();
+    int compactBufferCount = args.nextInt();
+    int stateCount = args.nextInt();
+    int patternCount = args.nextInt();
+    int eigenBufferCount = args.nextInt();
+    int matrixBufferCount = args.nextInt();
+    int categoryCount = args.nextInt();
+    int scaleBufferCount = args.nextInt();
+    int resource = args.nextInt();
+    long long preferenceFlags = args.nextLong();
+    long long requirementFlags = args.nextLong();
+    long long instanceFlags = args.nextLong();
+
+    if (rsrc >= 0)
+        resource = rsrc;
+    requirementFlags |= instanceFlags & (BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE);
+    preferenceFlags |= instanceFlags;
+
+    BeagleInstanceDetails details;
+    int instance = beagleCreateInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                        patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                        scaleBufferCount, (resource >= 0 ? &resource : NULL),
+                                        (resource >= 0 ? 1 : 0), preferenceFlags, requirementFlags,
+                                        &details);
+    if (instance < 0)
+        abort("Failed to create a recorded instance");
+    if (verbose)
+        fprintf(stdout, "Instance: %d states, %d patterns, %d categories on %s (%s)\n",
+                stateCount, patternCount, categoryCount, details.resourceName, details.implName);
+
+    shape->instance = instance;
+    shape->stateCount = stateCount;
+    shape->patternCount = patternCount;
+    shape->categoryCount = categoryCount;
+    return instance;
+}
+
+// Replays one call; returns its return value, and the log likelihood it computed in
+// *logL with the recorded one in *recordedLogL when it computes one
+int replayCall(const trace& calls,
+               const call& c,
+               const instanceShape& shape,
+               double* logL,
+               double* recordedLogL) {
+    fieldReader args(calls, c);
+    int instance = shape.instance;
+    const int patternValues = shape.patternCount * shape.stateCount * shape.categoryCount;
+    const int matrixValues = shape.stateCount * shape.stateCount * shape.categoryCount;
+
+    switch (c.type) {
+        case beagle::RECORD_FINALIZE_INSTANCE:
+            return beagleFinalizeInstance(instance);
+        case beagle::RECORD_SET_TIP_STATES: {
+            int tipIndex = args.nextInt();
+            return beagleSetTipStates(instance, tipIndex, args.nextInts());
+        }
+        case beagle::RECORD_SET_TIP_STATE_SETS: {
+            int tipIndex = args.nextInt();
+            return beagleSetTipStateSets(instance, tipIndex, args.nextInts());
+        }
+        case beagle::RECORD_SET_TIP_PARTIALS: {
+            int tipIndex = args.nextInt();
+            return beagleSetTipPartials(instance, tipIndex, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_TIP_STATES_BATCH: {
+            const int* tipIndices = args.nextInts();
+            const int* states = args.nextInts();
+            return beagleSetTipStatesBatch(instance, tipIndices, states, args.nextInt());
+        }
+        case beagle::RECORD_SET_TIP_PARTIALS_BATCH: {
+            const int* tipIndices = args.nextInts();
+            const double* partials = args.nextDoubles();
+            return beagleSetTipPartialsBatch(instance, tipIndices, partials, args.nextInt());
+        }
+        case beagle::RECORD_SET_PARTIALS: {
+            int bufferIndex = args.nextInt();
+            return beagleSetPartials(instance, bufferIndex, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_EIGEN_DECOMPOSITION: {
+            int eigenIndex = args.nextInt();
+            const double* vectors = args.nextDoubles();
+            const double* inverseVectors = args.nextDoubles();
+            return beagleSetEigenDecomposition(instance, eigenIndex, vectors, inverseVectors, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_STATE_FREQUENCIES: {
+            int index = args.nextInt();
+            return beagleSetStateFrequencies(instance, index, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_CATEGORY_WEIGHTS: {
+            int index = args.nextInt();
+            return beagleSetCategoryWeights(instance, index, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_CATEGORY_RATES:
+            return beagleSetCategoryRates(instance, args.nextDoubles());
+        case beagle::RECORD_SET_CATEGORY_RATES_WITH_INDEX: {
+            int index = args.nextInt();
+            return beagleSetCategoryRatesWithIndex(instance, index, args.nextDoubles());
+        }
+        case beagle::RECORD_SET_PATTERN_WEIGHTS:
+            return beagleSetPatternWeights(instance, args.nextDoubles());
+        case beagle::RECORD_SET_PATTERN_PARTITIONS: {
+            int partitionCount = args.nextInt();
+            return beagleSetPatternPartitions(instance, partitionCount, args.nextInts());
+        }
+        case beagle::RECORD_SET_TRANSITION_MATRIX: {
+            int matrixIndex = args.nextInt();
+            const double* matrix = args.nextDoubles();
+            return beagleSetTransitionMatrix(instance, matrixIndex, matrix, args.nextDouble());
+        }
+        case beagle::RECORD_SET_TRANSITION_MATRICES: {
+            const int* matrixIndices = args.nextInts();
+            const double* matrices = args.nextDoubles();
+            const double* paddedValues = args.nextDoubles();
+            return beagleSetTransitionMatrices(instance, matrixIndices, matrices, paddedValues, args.nextInt());
+        }
+        case beagle::RECORD_SET_CPU_THREAD_COUNT:
+            return beagleSetCPUThreadCount(instance, args.nextInt());
+        case beagle::RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE:
+            return beagleSetTransitionMatrixCacheSize(instance, args.nextInt());
+        case beagle::RECORD_SET_INCREMENTAL_UPDATES:
+            return beagleSetIncrementalUpdates(instance, args.nextInt());
+        case beagle::RECORD_SET_EXPONENT_SCALING:
+            return beagleSetExponentScaling(instance, args.nextInt());
+        case beagle::RECORD_SET_OPERATION_GRAPHS:
+            return beagleSetOperationGraphs(instance, args.nextInt());
+        case beagle::RECORD_SET_ADAPTIVE_RESCALING:
+            return beagleSetAdaptiveRescaling(instance, args.nextInt());
+        case beagle::RECORD_SET_SITE_REPEATS:
+            return beagleSetSiteRepeats(instance, args.nextInt());
+        case beagle::RECORD_UPDATE_TRANSITION_MATRICES: {
+            int eigenIndex = args.nextInt();
+            const int* probabilityIndices = args.nextInts();
+            const int* firstDerivativeIndices = args.nextInts();
+            const int* secondDerivativeIndices = args.nextInts();
+            const double* edgeLengths = args.nextDoubles();
+            return beagleUpdateTransitionMatrices(instance, eigenIndex, probabilityIndices,
+                                                  firstDerivativeIndices, secondDerivativeIndices,
+                                                  edgeLengths, args.nextInt());
+        }
+        case beagle::RECORD_UPDATE_TRANSITION_MATRICES_WITH_MULTIPLE_MODELS: {
+            const int* eigenIndices = args.nextInts();
+            const int* categoryRateIndices = args.nextInts();
+            const int* probabilityIndices = args.nextInts();
+            const int* firstDerivativeIndices = args.nextInts();
+            const int* secondDerivativeIndices = args.nextInts();
+            const double* edgeLengths = args.nextDoubles();
+            return beagleUpdateTransitionMatricesWithMultipleModels(instance, eigenIndices, categoryRateIndices,
+                                                                    probabilityIndices, firstDerivativeIndices,
+                                                                    secondDerivativeIndices, edgeLengths,
+                                                                    args.nextInt());
+        }
+        case beagle::RECORD_UPDATE_PARTIALS: {
+            const int* operations = args.nextInts();
+            int operationCount = args.nextInt();
+            return beagleUpdatePartials(instance, (const BeagleOperation*) operations, operationCount,
+                                        args.nextInt());
+        }
+        case beagle::RECORD_UPDATE_PARTIALS_BY_PARTITION: {
+            const int* operations = args.nextInts();
+            return beagleUpdatePartialsByPartition(instance, (const BeagleOperationByPartition*) operations,
+                                                   args.nextInt());
+        }
+        case beagle::RECORD_WAIT_FOR_PARTIALS: {
+            const int* destinationPartials = args.nextInts();
+            return beagleWaitForPartials(instance, destinationPartials, args.nextInt());
+        }
+        case beagle::RECORD_ACCUMULATE_SCALE_FACTORS:
+        case beagle::RECORD_REMOVE_SCALE_FACTORS: {
+            const int* scalingIndices = args.nextInts();
+            int count = args.nextInt();
+            int cumulativeScalingIndex = args.nextInt();
+            if (c.type == beagle::RECORD_ACCUMULATE_SCALE_FACTORS)
+                return beagleAccumulateScaleFactors(instance, scalingIndices, count, cumulativeScalingIndex);
+            return beagleRemoveScaleFactors(instance, scalingIndices, count, cumulativeScalingIndex);
+        }
+        case beagle::RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION:
+        case beagle::RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION: {
+            const int* scalingIndices = args.nextInts();
+            int count = args.nextInt();
+            int cumulativeScalingIndex = args.nextInt();
+            int partitionIndex = args.nextInt();
+            if (c.type == beagle::RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION)
+                return beagleAccumulateScaleFactorsByPartition(instance, scalingIndices, count,
+                                                               cumulativeScalingIndex, partitionIndex);
+            return beagleRemoveScaleFactorsByPartition(instance, scalingIndices, count,
+                                                       cumulativeScalingIndex, partitionIndex);
+        }
+        case beagle::RECORD_RESET_SCALE_FACTORS:
+            return beagleResetScaleFactors(instance, args.nextInt());
+        case beagle::RECORD_RESET_SCALE_FACTORS_BY_PARTITION: {
+            int cumulativeScalingIndex = args.nextInt();
+            return beagleResetScaleFactorsByPartition(instance, cumulativeScalingIndex, args.nextInt());
+        }
+        case beagle::RECORD_COPY_SCALE_FACTORS: {
+            int destScalingIndex = args.nextInt();
+            return beagleCopyScaleFactors(instance, destScalingIndex, args.nextInt());
+        }
+        case beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS: {
+            const int* bufferIndices = args.nextInts();
+            const int* categoryWeightsIndices = args.nextInts();
+            const int* stateFrequenciesIndices = args.nextInts();
+            const int* cumulativeScaleIndices = args.nextInts();
+            int count = args.nextInt();
+            int returnValue = beagleCalculateRootLogLikelihoods(instance, bufferIndices, categoryWeightsIndices,
+                                                                stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                count, logL);
+            *recordedLogL = args.nextDouble();
+            return returnValue;
+        }
+        case beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION: {
+            const int* bufferIndices = args.nextInts();
+            const int* categoryWeightsIndices = args.nextInts();
+            const int* stateFrequenciesIndices = args.nextInts();
+            const int* cumulativeScaleIndices = args.nextInts();
+            const int* partitionIndices = args.nextInts();
+            int partitionCount = args.nextInt();
+            int count = args.nextInt();
+            std::vector<double> logLByPartition(partitionCount);
+            int returnValue = beagleCalculateRootLogLikelihoodsByPartition(instance, bufferIndices,
+                                                                           categoryWeightsIndices,
+                                                                           stateFrequenciesIndices,
+                                                                           cumulativeScaleIndices,
+                                                                           partitionIndices, partitionCount,
+                                                                           count, &logLByPartition[0], logL);
+            *recordedLogL = args.nextDouble();
+            return returnValue;
+        }
+        case beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS: {
+            const int* parentBufferIndices = args.nextInts();
+            const int* childBufferIndices = args.nextInts();
+            const int* probabilityIndices = args.nextInts();
+            const int* firstDerivativeIndices = args.nextInts();
+            const int* secondDerivativeIndices = args.nextInts();
+            const int* categoryWeightsIndices = args.nextInts();
+            const int* stateFrequenciesIndices = args.nextInts();
+            const int* cumulativeScaleIndices = args.nextInts();
+            int count = args.nextInt();
+            double firstDerivative, secondDerivative;
+            int returnValue = beagleCalculateEdgeLogLikelihoods(instance, parentBufferIndices, childBufferIndices,
+                                                                probabilityIndices, firstDerivativeIndices,
+                                                                secondDerivativeIndices, categoryWeightsIndices,
+                                                                stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                count, logL, &firstDerivative, &secondDerivative);
+            *recordedLogL = args.nextDouble();
+            return returnValue;
+        }
+        case beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION: {
+            const int* parentBufferIndices = args.nextInts();
+            const int* childBufferIndices = args.nextInts();
+            const int* probabilityIndices = args.nextInts();
+            const int* firstDerivativeIndices = args.nextInts();
+            const int* secondDerivativeIndices = args.nextInts();
+            const int* categoryWeightsIndices = args.nextInts();
+            const int* stateFrequenciesIndices = args.nextInts();
+            const int* cumulativeScaleIndices = args.nextInts();
+            const int* partitionIndices = args.nextInts();
+            int partitionCount = args.nextInt();
+            int count = args.nextInt();
+            std::vector<double> byPartition(3 * partitionCount);
+            double firstDerivative, secondDerivative;
+            int returnValue = beagleCalculateEdgeLogLikelihoodsByPartition(instance, parentBufferIndices,
+                                                                           childBufferIndices, probabilityIndices,
+                                                                           firstDerivativeIndices,
+                                                                           secondDerivativeIndices,
+                                                                           categoryWeightsIndices,
+                                                                           stateFrequenciesIndices,
+                                                                           cumulativeScaleIndices,
+                                                                           partitionIndices, partitionCount, count,
+                                                                           &byPartition[0], logL,
+                                                                           &byPartition[partitionCount],
+                                                                           &firstDerivative,
+                                                                           &byPartition[2 * partitionCount],
+                                                                           &secondDerivative);
+            *recordedLogL = args.nextDouble();
+            return returnValue;
+        }
+        case beagle::RECORD_GET_PARTIALS: {
+            std::vector<double> partials(patternValues);
+            int bufferIndex = args.nextInt();
+            return beagleGetPartials(instance, bufferIndex, args.nextInt(), &partials[0]);
+        }
+        case beagle::RECORD_GET_TRANSITION_MATRIX: {
+            std::vector<double> matrix(matrixValues);
+            return beagleGetTransitionMatrix(instance, args.nextInt(), &matrix[0]);
+        }
+        case beagle::RECORD_GET_SITE_LOG_LIKELIHOODS: {
+            std::vector<double> siteLogLikelihoods(shape.patternCount);
+            return beagleGetSiteLogLikelihoods(instance, &siteLogLikelihoods[0]);
+        }
+        case beagle::RECORD_GET_SITE_DERIVATIVES: {
+            std::vector<double> siteDerivatives(2 * shape.patternCount);
+            return beagleGetSiteDerivatives(instance, &siteDerivatives[0], &siteDerivatives[shape.patternCount]);
+        }
+        case beagle::RECORD_GET_SCALE_FACTORS: {
+            std::vector<double> scaleFactors(shape.patternCount);
+            return beagleGetScaleFactors(instance, args.nextInt(), &scaleFactors[0]);
+        }
+    }
+    abort("Unknown call in trace");
+    return BEAGLE_ERROR_GENERAL;
+}
+
+void replay(const trace& calls,
+            int rsrc,
+            bool verbose,
+            replayResult* result) {
+    result->totalSeconds = 0.0;
+    result->seconds.assign(beagle::RECORD_CALL_COUNT, 0.0);
+    result->maxRelativeDifference = 0.0;
+    result->mismatchedReturns = 0;
+    result->skippedCalls = 0;
+
+    std::map<int, instanceShape> instances; // by recorded instance
+
+    for (size_t i = 0; i < calls.calls.size(); i++) {
+        const call& c = calls.calls[i];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int returnValue;
+        double logL = 0.0;
+        double recordedLogL = 0.0;
+        bool computesLogL = false;
+
+        if (c.type == beagle::RECORD_CREATE_INSTANCE) {
+            fieldReader args(calls, c);
+            createInstance(args, rsrc, &instances[c.instance], verbose);
+            returnValue = c.returnValue; // instance numbers are not compared
+        } else {
+            std::map<int, instanceShape>::iterator found = instances.find(c.instance);
+            if (found == instances.end()) {
+                result->skippedCalls++;
+                continue;
+            }
+            computesLogL = (c.type == beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS ||
+                            c.type == beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION ||
+                            c.type == beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS ||
+                            c.type == beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION);
+            returnValue = replayCall(calls, c, found->second, &logL, &recordedLogL);
+            if (c.type == beagle::RECORD_FINALIZE_INSTANCE)
+                instances.erase(found);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result->seconds[c.type] += seconds;
+        result->totalSeconds += seconds;
+
+        if (returnValue != c.returnValue)
+            result->mismatchedReturns++;
+        if (computesLogL && returnValue == BEAGLE_SUCCESS)
+            result->maxRelativeDifference = std::max(result->maxRelativeDifference,
+                                                     relativeDifference(logL, recordedLogL));
+    }
+
+    for (std::map<int, instanceShape>::iterator it = instances.begin(); it != instances.end(); ++it)
+        beagleFinalizeInstance(it->second.instance);
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "callreplay <trace> [--rsrc <integer>] [--reps <integer>]\n\n";
+    std::cerr << "Record a trace by running a client with BEAGLE_RECORD=<trace> set.\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    const char* path = NULL;
+    int rsrc = -1;
+    int reps = 3;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--rsrc" && i + 1 < argc) {
+            rsrc = atoi(argv[++i]);
+        } else if (option == "--reps" && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (option.compare(0, 2, "--") != 0 && path == NULL) {
+            path = argv[i];
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            helpMessage();
+        }
+    }
+    if (path == NULL)
+        helpMessage();
+    if (reps < 1)
+        abort("Invalid number of reps");
+
+    trace calls;
+    readTrace(path, &calls);
+
+    std::vector<int> callCounts(beagle::RECORD_CALL_COUNT, 0);
+    std::vector<double> recordedSeconds(beagle::RECORD_CALL_COUNT, 0.0);
+    double recordedTotal = 0.0;
+    for (size_t i = 0; i < calls.calls.size(); i++) {
+        const call& c = calls.calls[i];
+        if (c.type < 0 || c.type >= beagle::RECORD_CALL_COUNT)
+            abort("Unknown call in trace");
+        callCounts[c.type]++;
+        recordedSeconds[c.type] += c.seconds;
+        recordedTotal += c.seconds;
+    }
+    fprintf(stdout, "Trace: %s, %d calls, %d arrays\n", path, (int) calls.calls.size(),
+            (int) (calls.intArrays.size() + calls.doubleArrays.size()));
+
+    replayResult best;
+    for (int r = 0; r < reps; r++) {
+        replayResult result;
+        replay(calls, rsrc, r == 0, &result);
+        if (r == 0 || result.totalSeconds < best.totalSeconds)
+            best = result;
+    }
+
+    fprintf(stdout, "\n%-44s %8s %14s %14s\n", "call", "count", "recorded (ms)", "replay (ms)");
+    for (int t = 0; t < beagle::RECORD_CALL_COUNT; t++) {
+        if (callCounts[t] == 0)
+            continue;
+        fprintf(stdout, "%-44s %8d %14.3f %14.3f\n", beagle::getRecordedCallName(t), callCounts[t],
+                recordedSeconds[t] * 1000.0, best.seconds[t] * 1000.0);
+    }
+    fprintf(stdout, "%-44s %8d %14.3f %14.3f\n", "total", (int) calls.calls.size(),
+            recordedTotal * 1000.0, best.totalSeconds * 1000.0);
+
+    fprintf(stdout, "\nmax relative log likelihood difference: %.3e\n", best.maxRelativeDifference);
+    if (best.mismatchedReturns > 0)
+        fprintf(stdout, "calls returning differently than recorded: %d\n", best.mismatchedReturns);
+    if (best.skippedCalls > 0)
+        fprintf(stdout, "calls skipped for lack of a recorded instance: %d\n", best.skippedCalls);
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <algorithm>	// needed for copy and fill
 #include <numeric>	// needed for accumulate algorithm
 #include <cmath>
 #include <cstdlib>
@@ -99,6 +100,7 @@ FourTaxonExample::FourTaxonExample()
   , calculate_derivatives(0)
   , empirical_derivatives(false)
   , sse_vectorization(false)
+  , compress_patterns(false)
     {
 	data_file_name = "fourtaxon.dat";
 	}
@@ -276,6 +278,54 @@ void FourTaxonExample::initBeagleLib()
 	//      /      \
 	//    A(0)     D(3)
 	
+	// the library sees one weighted pattern per unique site column if --compress was given,
+	// otherwise one pattern per site
+	unsigned npatterns = nsites;
+	std::vector<CodedSequence> pattern_data(data);
+	std::vector<PartialVector> pattern_partial(partial);
+	std::vector<double> pattern_weights(nsites, 1.0);
+	if (compress_patterns)
+		{
+		std::vector<int> site_states(ntaxa*nsites);
+		for (unsigned i = 0; i < ntaxa; ++i)
+			std::copy(data[i].begin(), data[i].end(), site_states.begin() + i*nsites);
+
+		int pattern_count = 0;
+		std::vector<int> pattern_states(ntaxa*nsites);
+		code = beagleCompressPatterns(
+					ntaxa,					// taxonCount
+					nsites,					// siteCount
+					&site_states[0],		// inSiteStates
+					NULL,					// inSiteWeights
+					NULL,					// inSitePartitions
+					&pattern_count,			// outPatternCount
+					&pattern_states[0],		// outPatternStates
+					&pattern_weights[0],	// outPatternWeights
+					NULL,					// outPatternPartitions
+					NULL);					// outSitePatterns
+		if (code != 0)
+			abort("beagleCompressPatterns encountered a problem");
+
+		npatterns = pattern_count;
+		pattern_weights.resize(npatterns);
+		for (unsigned i = 0; i < ntaxa; ++i)
+			{
+			pattern_data[i].assign(pattern_states.begin() + i*npatterns,
+			                       pattern_states.begin() + (i + 1)*npatterns);
+			pattern_partial[i].assign(npatterns*4, 0.0);
+			for (unsigned j = 0; j < npatterns; ++j)
+				{
+				if (pattern_data[i][j] < 4)
+					pattern_partial[i][j*4 + pattern_data[i][j]] = 1.0;
+				else
+					std::fill(pattern_partial[i].begin() + j*4, pattern_partial[i].begin() + (j + 1)*4, 1.0);
+				}
+			}
+
+		if (!quiet)
+			std::cout << nsites << " sites compressed into " << npatterns << " patterns\n";
+		}
+
 	int* rsrcList = NULL;
 	int  rsrcCnt = 0;
 	if (rsrc_number != BEAGLE_OP_NONE) {
@@ -284,7 +334,7 @@ void FourTaxonExample::initBeagleLib()
 		rsrcCnt = 1;
 	}
         
-    long requirementFlags = 0;
+    long long requirementFlags = 0;
     if (single) {
         requirementFlags |= BEAGLE_FLAG_PRECISION_SINGLE;
     }
@@ -307,7 +357,7 @@ void FourTaxonExample::initBeagleLib()
 				ntaxa + 2,	// partialsBufferCount
 				(use_tip_partials ? 0 : ntaxa),			// compactBufferCount
 				4, 			// stateCount
-				nsites,		// patternCount
+				npatterns,	// patternCount
 				1,			// eigenBufferCount
 				mtrxCount,	// matrixBufferCount,
                 nrates,     // categoryCount
@@ -349,7 +399,7 @@ void FourTaxonExample::initBeagleLib()
 			code = beagleSetTipPartials(
 						instance_handle,			// instance
 						i,							// bufferIndex
-						&partial[i][0]);			// inPartials
+						&pattern_partial[i][0]);	// inPartials
 			if (code != 0)
 				abort("beagleSetTipPartials encountered a problem");
 			}
@@ -358,7 +408,7 @@ void FourTaxonExample::initBeagleLib()
 			code = beagleSetTipStates(
 						instance_handle,			// instance);
 						i,							// bufferIndex
-						(int*)&data[i][0]);
+						(int*)&pattern_data[i][0]);
 			if (code != 0)
 				abort("beagleSetTipStates encountered a problem");
 			}
@@ -396,17 +446,7 @@ void FourTaxonExample::initBeagleLib()
 #endif
 		);
 
-#ifdef _WIN32
-        std::vector<double> patternWeights(nsites);
-#else
-        double patternWeights[nsites];
-#endif
-        
-    for (int i = 0; i < nsites; i++) {
-        patternWeights[i] = 1.0;
-    }    
-        
-    beagleSetPatternWeights(instance_handle, &patternWeights[0]);
+    beagleSetPatternWeights(instance_handle, &pattern_weights[0]);
         
         
 	// JC69 model eigenvector matrix
@@ -804,7 +844,7 @@ void FourTaxonExample::helpMessage()
 	{
 	std::cerr << "Usage:\n\n";
 	std::cerr << "fourtaxon [--help] [--quiet] [--niters <integer>] [--datafile <string>]";
-	std::cerr << " [--rsrc <integer>] [--likeroot <integer>]  [--scaling <integer>] [--single] [--double] [--calcderivs] [--empiricalderivs] [--sse]\n\n";
+	std::cerr << " [--rsrc <integer>] [--likeroot <integer>]  [--scaling <integer>] [--single] [--double] [--calcderivs] [--empiricalderivs] [--sse] [--compress]\n\n";
 	std::cerr << "If --help is specified, this usage message is shown\n\n";
 	std::cerr << "If --quiet is specified, no progress reports will be issued (allowing for\n";
 	std::cerr << "        more accurate timing).\n\n";
@@ -832,7 +872,8 @@ void FourTaxonExample::helpMessage()
     std::cerr << "                              1 = calculate first order edge likelihood derivatives\n";
     std::cerr << "                              2 = calculate first and second order edge likelihood derivatives\n\n";
     std::cerr << "If --empiricalderivs is specified, then empirically calculate first and second order edge likelihood derivatives\n\n";
-    std::cerr << "If --sse is specified, then the SSE implementation is enabled\n\n";        
+    std::cerr << "If --sse is specified, then the SSE implementation is enabled\n\n";
+    std::cerr << "If --compress is specified, then identical site columns are collapsed into weighted patterns\n\n";
 	std::cerr << std::endl;
 	std::exit(0);
 	}
@@ -961,6 +1002,10 @@ void FourTaxonExample::interpretCommandLineParameters(
         else if (option == "--sse")
         {
             sse_vectorization = true;
+        }
+        else if (option == "--compress")
+        {
+            compress_patterns = true;
         }
 		else 
 			{
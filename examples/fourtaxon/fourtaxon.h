@@ -65,4 +65,5 @@ class FourTaxonExample
 		int                         calculate_derivatives;
         bool                        empirical_derivatives;
         bool                        sse_vectorization;
+        bool                        compress_patterns;
 	};
@@ -0,0 +1,560 @@
+/*
+ *  kernelbench.cpp
+ *  BEAGLE
+ *
+ *  Times single likelihood kernels through the API for every implementation that
+ *  can be created on each resource, across state counts and pattern counts.
+ *
+ *  Each kernel is timed twice. The cache column repeats the call on the same
+ *  buffers. The memory column rotates through enough buffers to fill the
+ *  requested footprint, so that every call streams its operands from memory.
+ *  The working set of both columns is printed next to the timings.
+ *
+ *  A roofline report follows. Each kernel's arithmetic intensity comes from a
+ *  count of its flops and the bytes it must move for the state, category and
+ *  pattern counts. Its throughput in the memory column, or the cache column
+ *  when it has no other, is compared with the lesser of the resource's peak
+ *  flop rate and its peak bandwidth times that intensity. The peaks are the
+ *  larger of what a host microbenchmark reaches, on CPU resources, and the
+ *  best any kernel reached on the resource, unless given with --peak-gflops
+ *  and --peak-gbs.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libhmsbeagle/beagle.h"
+
+struct variant {
+    const char* name;
+    long long preferenceFlags;
+    long long requirementFlags;
+};
+
+struct kernelTiming {
+    double cacheSeconds;
+    double memorySeconds;
+};
+
+struct kernelResult {
+    int resource;
+    std::string implName;
+    int stateCount;
+    int patternCount;
+    const char* kernelName;
+    const char* functionName; // the CPU method or KernelLauncher function that runs the kernel
+    double flops;
+    double bytes;
+    double seconds;
+};
+
+struct resourcePeaks {
+    double gflops;
+    double gbs;
+    const char* source;
+};
+
+void abort(std::string msg) {
+    std::cerr << msg << "\nAborting..." << std::endl;
+    std::exit(1);
+}
+
+void readIntegerList(const char* option,
+                     std::vector<int>* values) {
+    values->clear();
+    std::stringstream ss(option);
+    int j;
+    while (ss >> j) {
+        values->push_back(j);
+        if (ss.peek() == ',')
+            ss.ignore();
+    }
+}
+
+double getRandom() {
+    return 0.1 + 0.9 * (rand() / (double) RAND_MAX);
+}
+
+// Smallest time per call over the reps, each rep making calls calls to kernel(k) and
+// then waiting in finish(k) for the last one, as GPU implementations return early.
+// The call index runs on across reps so that rotations do not restart.
+template <typename F, typename G>
+double timeKernel(int reps,
+                  int calls,
+                  F kernel,
+                  G finish) {
+    kernel(0); // warm up
+    finish(0);
+    double best = 0.0;
+    for (int r = 0; r < reps; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int k = 0; k < calls; k++)
+            kernel(r * calls + k);
+        finish(r * calls + calls - 1);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / calls;
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// Prints the timings of a kernel and keeps the one the roofline report is based on
+void printTiming(std::vector<kernelResult>* results,
+                 kernelResult result,
+                 const char* kernelName,
+                 const char* cpuFunction,
+                 const char* gpuFunction,
+                 bool gpu,
+                 double flops,
+                 double bytes,
+                 kernelTiming timing,
+                 double cacheBytes,
+                 double memoryBytes) {
+    result.kernelName = kernelName;
+    result.functionName = (gpu ? gpuFunction : cpuFunction);
+    result.flops = flops;
+    result.bytes = bytes;
+    result.seconds = (timing.memorySeconds > 0.0 ? timing.memorySeconds : timing.cacheSeconds);
+    results->push_back(result);
+
+    fprintf(stdout, "%-28s %6d %8d  %-24s", result.implName.c_str(), result.stateCount, result.patternCount,
+            kernelName);
+    fprintf(stdout, " %10.2f %8.2f", timing.cacheSeconds * 1000000.0, bytes / timing.cacheSeconds / 1000000000.0);
+    if (timing.memorySeconds > 0.0)
+        fprintf(stdout, " %10.2f %8.2f", timing.memorySeconds * 1000000.0, bytes / timing.memorySeconds / 1000000000.0);
+    else
+        fprintf(stdout, " %10s %8s", "-", "-");
+    fprintf(stdout, "  %8.2f %8.2f\n", cacheBytes / 1048576.0, memoryBytes / 1048576.0);
+}
+
+void runKernels(int instance,
+                int resource,
+                const char* implName,
+                bool gpu,
+                int stateCount,
+                int patternCount,
+                int categoryCount,
+                int bufferCount,
+                int realSize,
+                int reps,
+                std::vector<kernelResult>* results) {
+    // buffer 0 holds tip states, then bufferCount sources that are only read and
+    // bufferCount destinations, so repeated products never drift towards underflow
+    const int tipBuffer = 0;
+    const int sourceBuffer = 1;
+    const int destinationBuffer = 1 + bufferCount;
+    const int calls = (bufferCount > 8 ? bufferCount : 8);
+
+    std::vector<int> tipStates(patternCount);
+    for (int i = 0; i < patternCount; i++)
+        tipStates[i] = rand() % stateCount;
+    beagleSetTipStates(instance, tipBuffer, &tipStates[0]);
+
+    std::vector<double> partials(patternCount * stateCount * categoryCount);
+    for (int b = 0; b < 2 * bufferCount; b++) {
+        for (size_t i = 0; i < partials.size(); i++)
+            partials[i] = getRandom();
+        beagleSetPartials(instance, sourceBuffer + b, &partials[0]);
+    }
+
+    // decaying modes on the identity basis keep the transition matrices valid for any state count
+    std::vector<double> eigenVectors(stateCount * stateCount, 0.0);
+    std::vector<double> eigenValues(stateCount, -1.0);
+    for (int s = 0; s < stateCount; s++)
+        eigenVectors[s * stateCount + s] = 1.0;
+    eigenValues[0] = 0.0;
+    beagleSetEigenDecomposition(instance, 0, &eigenVectors[0], &eigenVectors[0], &eigenValues[0]);
+
+    std::vector<double> frequencies(stateCount, 1.0 / stateCount);
+    beagleSetStateFrequencies(instance, 0, &frequencies[0]);
+    std::vector<double> rates(categoryCount), weights(categoryCount, 1.0 / categoryCount);
+    for (int c = 0; c < categoryCount; c++)
+        rates[c] = (c + 0.5) * 2.0 / categoryCount;
+    beagleSetCategoryRates(instance, &rates[0]);
+    beagleSetCategoryWeights(instance, 0, &weights[0]);
+    std::vector<double> patternWeights(patternCount, 1.0);
+    beagleSetPatternWeights(instance, &patternWeights[0]);
+
+    int matrixIndices[2] = {0, 1};
+    double edgeLengths[2] = {0.1, 0.2};
+    beagleUpdateTransitionMatrices(instance, 0, matrixIndices, NULL, NULL, edgeLengths, 2);
+
+    const double partialsBytes = (double) patternCount * stateCount * categoryCount * realSize;
+    const double matrixBytes = (double) stateCount * stateCount * categoryCount * realSize;
+    const double p = patternCount;
+    const double s = stateCount;
+    const double c = categoryCount;
+    kernelResult result;
+    result.resource = resource;
+    result.implName = implName;
+    result.stateCount = stateCount;
+    result.patternCount = patternCount;
+    std::vector<double> matrix(stateCount * stateCount * categoryCount);
+    int categoryWeightsIndex = 0;
+    int stateFrequencyIndex = 0;
+    int cumulativeScaleIndex = BEAGLE_OP_NONE;
+    double logL;
+
+    kernelTiming timing;
+
+    // there is no wait for matrices, so reading one back once per rep stands in for it
+    timing.cacheSeconds = timeKernel(reps, calls, [&] (int k) {
+        beagleUpdateTransitionMatrices(instance, 0, matrixIndices, NULL, NULL, edgeLengths, 1);
+    }, [&] (int k) {
+        beagleGetTransitionMatrix(instance, 0, &matrix[0]);
+    });
+    timing.memorySeconds = 0.0;
+    // exponentiated eigenvalues times the eigenvectors
+    printTiming(results, result, "updateTransitionMatrices", "updateTransitionMatrices", "kernelMatrixMulADB",
+                gpu, c * s * s * (2 * s + 1), matrixBytes, timing, matrixBytes, matrixBytes);
+
+    std::function<void (int)> waitForPartials[2];
+    for (int memory = 0; memory < 2; memory++) {
+        waitForPartials[memory] = [=] (int k) {
+            int destination = destinationBuffer + (memory ? k % bufferCount : 0);
+            beagleWaitForPartials(instance, &destination, 1);
+        };
+    }
+
+    const int scaleModes = 2;
+    double partialsSeconds[2][scaleModes];
+    for (int scaled = 0; scaled < scaleModes; scaled++) {
+        for (int memory = 0; memory < 2; memory++) {
+            partialsSeconds[memory][scaled] = timeKernel(reps, calls, [&] (int k) {
+                int b = (memory ? k % bufferCount : 0);
+                BeagleOperation operation = {destinationBuffer + b,
+                                             (scaled ? b : BEAGLE_OP_NONE), BEAGLE_OP_NONE,
+                                             sourceBuffer + b, 0,
+                                             sourceBuffer + (b + 1) % bufferCount, 1};
+                beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            }, waitForPartials[memory]);
+        }
+    }
+    timing.cacheSeconds = partialsSeconds[0][0];
+    timing.memorySeconds = partialsSeconds[1][0];
+    // two matrix-vector products and their product
+    printTiming(results, result, "calcPartialsPartials", "calcPartialsPartials", "kernelPartialsPartialsNoScale",
+                gpu, p * c * s * (4 * s + 1), 3 * partialsBytes + 2 * matrixBytes, timing,
+                3 * partialsBytes, (2 * bufferCount) * partialsBytes);
+
+    // rescaling only runs inside an update, so it is the extra time of a scaled update
+    timing.cacheSeconds = std::max(partialsSeconds[0][1] - partialsSeconds[0][0], 1e-9);
+    timing.memorySeconds = std::max(partialsSeconds[1][1] - partialsSeconds[1][0], 1e-9);
+    // a maximum over the states and categories of each pattern and a division by it
+    printTiming(results, result, "rescalePartials", "rescalePartials", "kernelPartialsDynamicScaling",
+                gpu, 2 * p * c * s, 2 * partialsBytes, timing, 3 * partialsBytes, (2 * bufferCount) * partialsBytes);
+
+    for (int memory = 0; memory < 2; memory++) {
+        double seconds = timeKernel(reps, calls, [&] (int k) {
+            int b = (memory ? k % bufferCount : 0);
+            BeagleOperation operation = {destinationBuffer + b, BEAGLE_OP_NONE, BEAGLE_OP_NONE,
+                                         tipBuffer, 0,
+                                         sourceBuffer + b, 1};
+            beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+        }, waitForPartials[memory]);
+        (memory ? timing.memorySeconds : timing.cacheSeconds) = seconds;
+    }
+    // one matrix-vector product and a product with the looked up tip column
+    printTiming(results, result, "calcStatesPartials", "calcStatesPartials", "kernelStatesPartialsNoScale",
+                gpu, p * c * s * (2 * s + 1), 2 * partialsBytes + 2 * matrixBytes, timing,
+                2 * partialsBytes, (2 * bufferCount) * partialsBytes);
+
+    for (int memory = 0; memory < 2; memory++) {
+        double seconds = timeKernel(reps, calls, [&] (int k) {
+            int b = sourceBuffer + (memory ? k % bufferCount : 0);
+            beagleCalculateRootLogLikelihoods(instance, &b, &categoryWeightsIndex, &stateFrequencyIndex,
+                                              &cumulativeScaleIndex, 1, &logL);
+        }, [] (int k) {});
+        (memory ? timing.memorySeconds : timing.cacheSeconds) = seconds;
+    }
+    // weighted sums over categories and states, a log and a weighted sum over patterns
+    printTiming(results, result, "calcRootLogLikelihoods", "calcRootLogLikelihoods", "kernelIntegrateLikelihoods",
+                gpu, 2 * p * c * s + 2 * p * s + 2 * p, partialsBytes, timing, partialsBytes,
+                bufferCount * partialsBytes);
+
+    for (int memory = 0; memory < 2; memory++) {
+        double seconds = timeKernel(reps, calls, [&] (int k) {
+            int b = (memory ? k % bufferCount : 0);
+            int parent = sourceBuffer + b;
+            int child = sourceBuffer + (b + 1) % bufferCount;
+            beagleCalculateEdgeLogLikelihoods(instance, &parent, &child, &matrixIndices[0], NULL, NULL,
+                                              &categoryWeightsIndex, &stateFrequencyIndex,
+                                              &cumulativeScaleIndex, 1, &logL, NULL, NULL);
+        }, [] (int k) {});
+        (memory ? timing.memorySeconds : timing.cacheSeconds) = seconds;
+    }
+    // a matrix-vector product and a dot product with the parent, then as at the root
+    printTiming(results, result, "calcEdgeLogLikelihoods", "calcEdgeLogLikelihoods",
+                "kernelPartialsPartialsEdgeLikelihoods", gpu, p * c * s * (2 * s + 2) + 2 * p * s + 2 * p,
+                2 * partialsBytes + matrixBytes, timing, 2 * partialsBytes, bufferCount * partialsBytes);
+
+    if (!std::isfinite(logL))
+        fprintf(stdout, "error: invalid lnL for %s with %d states and %d patterns\n",
+                implName, stateCount, patternCount);
+}
+
+// Triad bandwidth over all hardware threads in GB/s, best of the reps
+double measureHostBandwidth(int reps) {
+    const size_t n = 1 << 23; // 64 MB per array, past the caches
+    const int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<double> a(n, 0.0), b(n, 1.0), c(n, 2.0);
+    double best = 0.0;
+    for (int r = 0; r < reps; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.push_back(std::thread([&, t] {
+                for (size_t i = n * t / threadCount; i < n * (t + 1) / threadCount; i++)
+                    a[i] = b[i] + 3.0 * c[i];
+            }));
+        }
+        for (int t = 0; t < threadCount; t++)
+            threads[t].join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, 3.0 * n * sizeof(double) / seconds / 1000000000.0);
+    }
+    return best;
+}
+
+// Multiply-add rate over all hardware threads in GFLOPS, best of the reps; independent
+// chains keep the pipelines full and leave the compiler free to vectorize across them
+template <typename REAL>
+double measureHostFlops(int reps) {
+    const int chains = 64;
+    const long iterations = 1 << 20;
+    const int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<REAL> sums(threadCount);
+    double best = 0.0;
+    for (int r = 0; r < reps; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.push_back(std::thread([&, t] {
+                REAL values[chains];
+                for (int j = 0; j < chains; j++)
+                    values[j] = (REAL) (t + j);
+                for (long i = 0; i < iterations; i++) {
+                    for (int j = 0; j < chains; j++)
+                        values[j] = values[j] * (REAL) 0.999999 + (REAL) 0.000001;
+                }
+                REAL sum = 0;
+                for (int j = 0; j < chains; j++)
+                    sum += values[j];
+                sums[t] = sum;
+            }));
+        }
+        for (int t = 0; t < threadCount; t++)
+            threads[t].join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, 2.0 * chains * iterations * threadCount / seconds / 1000000000.0);
+    }
+    if (!std::isfinite((double) std::accumulate(sums.begin(), sums.end(), (REAL) 0)))
+        fprintf(stdout, "error: invalid result from the flops microbenchmark\n");
+    return best;
+}
+
+void printRoofline(const std::vector<kernelResult>& results,
+                   const std::map<int, resourcePeaks>& peaks,
+                   BeagleResourceList* rl) {
+    fprintf(stdout, "\nRoofline\n");
+    for (std::map<int, resourcePeaks>::const_iterator it = peaks.begin(); it != peaks.end(); ++it)
+        fprintf(stdout, "resource %d (%s): peak %.2f GFLOPS, %.2f GB/s (%s)\n", it->first,
+                rl->list[it->first].name, it->second.gflops, it->second.gbs, it->second.source);
+
+    fprintf(stdout, "\n%-28s %6s %8s  %-24s %-38s %8s %9s %8s %9s %7s  %s\n", "implementation", "states",
+            "patterns", "kernel", "function", "flop/B", "GFLOPS", "GB/s", "roof", "% roof", "bound");
+    for (size_t i = 0; i < results.size(); i++) {
+        const kernelResult& result = results[i];
+        const resourcePeaks& peak = peaks.find(result.resource)->second;
+        double intensity = result.flops / result.bytes;
+        double gflops = result.flops / result.seconds / 1000000000.0;
+        double gbs = result.bytes / result.seconds / 1000000000.0;
+        double bandwidthRoof = intensity * peak.gbs;
+        double roof = std::min(peak.gflops, bandwidthRoof);
+        fprintf(stdout, "%-28s %6d %8d  %-24s %-38s %8.2f %9.2f %8.2f %9.2f %7.1f  %s\n",
+                result.implName.c_str(), result.stateCount, result.patternCount, result.kernelName,
+                result.functionName, intensity, gflops, gbs, roof, 100.0 * gflops / roof,
+                (bandwidthRoof < peak.gflops ? "memory" : "compute"));
+    }
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "kernelbench [--help] [--rsrc <list>] [--states <list>] [--sites <list>] [--rates <integer>] [--reps <integer>] [--footprint <MB>] [--doubleprecision] [--peak-gflops <GFLOPS>] [--peak-gbs <GB/s>]\n\n";
+    std::cerr << "Times each kernel with its buffers in cache and with a rotation over --footprint MB (default 256)\n";
+    std::cerr << "for every implementation that can be created on the resources. Times are microseconds per call.\n";
+    std::cerr << "The roofline report compares each kernel with the peaks of its resource, which --peak-gflops\n";
+    std::cerr << "and --peak-gbs set instead of measuring them.\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    std::vector<int> rsrc;
+    std::vector<int> stateCounts;
+    std::vector<int> patternCounts;
+    stateCounts.push_back(4);
+    stateCounts.push_back(20);
+    stateCounts.push_back(61);
+    patternCounts.push_back(100);
+    patternCounts.push_back(1000);
+    patternCounts.push_back(10000);
+    int categoryCount = 4;
+    int reps = 5;
+    double footprint = 256.0;
+    bool doublePrecision = false;
+    double peakGflops = 0.0;
+    double peakGbs = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--rsrc" && hasValue) {
+            readIntegerList(argv[++i], &rsrc);
+        } else if (option == "--states" && hasValue) {
+            readIntegerList(argv[++i], &stateCounts);
+        } else if (option == "--sites" && hasValue) {
+            readIntegerList(argv[++i], &patternCounts);
+        } else if (option == "--rates" && hasValue) {
+            categoryCount = atoi(argv[++i]);
+        } else if (option == "--reps" && hasValue) {
+            reps = atoi(argv[++i]);
+        } else if (option == "--footprint" && hasValue) {
+            footprint = atof(argv[++i]);
+        } else if (option == "--doubleprecision") {
+            doublePrecision = true;
+        } else if (option == "--peak-gflops" && hasValue) {
+            peakGflops = atof(argv[++i]);
+        } else if (option == "--peak-gbs" && hasValue) {
+            peakGbs = atof(argv[++i]);
+        } else {
+            std::string msg("Unknown or incomplete command line parameter \"");
+            msg.append(option);
+            abort(msg.c_str());
+        }
+    }
+
+    if (stateCounts.empty() || patternCounts.empty() || categoryCount < 1 || reps < 1 || !(footprint > 0.0) ||
+        peakGflops < 0.0 || peakGbs < 0.0)
+        abort("invalid value supplied on the command line");
+    for (size_t i = 0; i < stateCounts.size(); i++) {
+        if (stateCounts[i] < 2)
+            abort("invalid number of states supplied on the command line");
+    }
+    for (size_t i = 0; i < patternCounts.size(); i++) {
+        if (patternCounts[i] < 1)
+            abort("invalid number of sites supplied on the command line");
+    }
+
+    BeagleResourceList* rl = beagleGetResourceList();
+    if (rl == NULL)
+        abort("no BEAGLE resources found");
+
+    // each variant asks for a different factory; the ones a resource lacks fail to create
+    const variant variants[] = {
+        {"default", 0, 0},
+        {"serial",  0, BEAGLE_FLAG_VECTOR_NONE | BEAGLE_FLAG_THREADING_NONE},
+        {"sse",     0, BEAGLE_FLAG_VECTOR_SSE},
+        {"avx",     0, BEAGLE_FLAG_VECTOR_AVX},
+        {"avx512",  0, BEAGLE_FLAG_VECTOR_AVX512},
+        {"neon",    0, BEAGLE_FLAG_VECTOR_NEON},
+        {"openmp",  0, BEAGLE_FLAG_THREADING_OPENMP},
+        {"threads", BEAGLE_FLAG_THREADING_CPP, 0}};
+    const int variantCount = sizeof(variants) / sizeof(variant);
+    const long long precisionFlag = (doublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE);
+    const int realSize = (doublePrecision ? 8 : 4);
+
+    fprintf(stdout, "%-28s %6s %8s  %-24s %10s %8s %10s %8s  %8s %8s\n", "implementation", "states", "patterns",
+            "kernel", "cache us", "GB/s", "memory us", "GB/s", "cache MB", "mem MB");
+
+    std::vector<kernelResult> results;
+    for (int r = 0; r < rl->length; r++) {
+        if (!rsrc.empty() && std::find(rsrc.begin(), rsrc.end(), r) == rsrc.end())
+            continue;
+        for (size_t si = 0; si < stateCounts.size(); si++) {
+            for (size_t pi = 0; pi < patternCounts.size(); pi++) {
+                int stateCount = stateCounts[si];
+                int patternCount = patternCounts[pi];
+                double bufferBytes = (double) patternCount * stateCount * categoryCount * realSize;
+                int bufferCount = (int) std::ceil(footprint * 1048576.0 / (2 * bufferBytes));
+                bufferCount = std::min(std::max(bufferCount, 2), 4096);
+
+                std::set<std::string> seen;
+                for (int v = 0; v < variantCount; v++) {
+                    BeagleInstanceDetails details;
+                    int instance = beagleCreateInstance(1, 2 * bufferCount, 1, stateCount, patternCount,
+                                                        1, 2, categoryCount, bufferCount,
+                                                        &r, 1,
+                                                        variants[v].preferenceFlags,
+                                                        variants[v].requirementFlags | precisionFlag |
+                                                        BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALERS_RAW,
+                                                        &details);
+                    if (instance < 0)
+                        continue;
+
+                    std::string implName = std::string(details.implName) +
+                        (details.flags & BEAGLE_FLAG_THREADING_CPP ? "-Threads" : "");
+                    if (seen.insert(implName).second)
+                        runKernels(instance, r, implName.c_str(), (details.flags & BEAGLE_FLAG_PROCESSOR_GPU) != 0,
+                                   stateCount, patternCount, categoryCount, bufferCount, realSize, reps,
+                                   &results);
+
+                    beagleFinalizeInstance(instance);
+                }
+            }
+        }
+    }
+
+    // the host peaks bound the CPU resources; every resource's peaks are at least what its kernels reached
+    std::map<int, resourcePeaks> peaks;
+    double hostGflops = -1.0;
+    double hostGbs = -1.0;
+    for (size_t i = 0; i < results.size(); i++) {
+        int r = results[i].resource;
+        if (peaks.find(r) == peaks.end()) {
+            resourcePeaks peak = {0.0, 0.0, "best kernel"};
+            if (rl->list[r].supportFlags & BEAGLE_FLAG_PROCESSOR_CPU) {
+                if (hostGflops < 0.0) {
+                    hostGflops = (doublePrecision ? measureHostFlops<double>(reps) : measureHostFlops<float>(reps));
+                    hostGbs = measureHostBandwidth(reps);
+                }
+                peak.gflops = hostGflops;
+                peak.gbs = hostGbs;
+                peak.source = "measured";
+            }
+            peaks[r] = peak;
+        }
+        resourcePeaks& peak = peaks[r];
+        double gflops = results[i].flops / results[i].seconds / 1000000000.0;
+        double gbs = results[i].bytes / results[i].seconds / 1000000000.0;
+        if ((gflops > peak.gflops || gbs > peak.gbs) && (rl->list[r].supportFlags & BEAGLE_FLAG_PROCESSOR_CPU))
+            peak.source = "measured, raised to the best kernel";
+        peak.gflops = std::max(peak.gflops, gflops);
+        peak.gbs = std::max(peak.gbs, gbs);
+    }
+    for (std::map<int, resourcePeaks>::iterator it = peaks.begin(); it != peaks.end(); ++it) {
+        if (peakGflops > 0.0)
+            it->second.gflops = peakGflops;
+        if (peakGbs > 0.0)
+            it->second.gbs = peakGbs;
+        if (peakGflops > 0.0 || peakGbs > 0.0)
+            it->second.source = "given";
+    }
+    if (!results.empty())
+        printRoofline(results, peaks, rl);
+
+    return 0;
+}
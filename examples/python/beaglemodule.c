@@ -0,0 +1,794 @@
+/*
+ *  beaglemodule.c
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @brief Python bindings that pass buffers to the library without copies
+ *
+ * Every array argument is any C-contiguous object exporting the buffer
+ * protocol, such as a NumPy array, an array.array or a memoryview, of C int
+ * ('i') or double ('d') items. The library reads and writes the memory of the
+ * object in place. Lengths are checked against the shape of the instance.
+ *
+ * The GIL is released while the library runs, so threads driving distinct
+ * instances run in parallel. Negative return codes raise BeagleError, whose
+ * code attribute holds the BEAGLE return code.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include "libhmsbeagle/beagle.h"
+
+static PyObject* BeagleError;
+
+/* Shape of each instance created through this module, to check buffer lengths */
+typedef struct {
+    int created;
+    int tipCount;
+    int stateCount;
+    int patternCount;
+    int categoryCount;
+} InstanceShape;
+
+static InstanceShape* shapes = NULL;
+static int shapeCount = 0;
+
+static InstanceShape* getShape(int instance) {
+    if (instance < 0 || instance >= shapeCount || !shapes[instance].created) {
+        PyErr_Format(BeagleError, "instance %d was not created by this module", instance);
+        return NULL;
+    }
+    return &shapes[instance];
+}
+
+static PyObject* raiseBeagleError(int code, const char* call) {
+    PyObject* value = Py_BuildValue("(si)", call, code);
+    if (value != NULL) {
+        PyObject* error = PyObject_Call(BeagleError, value, NULL);
+        Py_DECREF(value);
+        if (error != NULL) {
+            PyObject* codeObject = PyLong_FromLong(code);
+            PyObject_SetAttrString(error, "code", codeObject);
+            Py_XDECREF(codeObject);
+            PyErr_SetObject(BeagleError, error);
+            Py_DECREF(error);
+        }
+    }
+    return NULL;
+}
+
+/* Runs a library call with the GIL released; raises on a negative return code */
+#define BEAGLE_CALL(name, call)               \
+    do {                                      \
+        Py_BEGIN_ALLOW_THREADS                \
+        returnCode = (call);                  \
+        Py_END_ALLOW_THREADS                  \
+        if (returnCode < 0) {                 \
+            raiseBeagleError(returnCode, name); \
+            goto done;                        \
+        }                                     \
+    } while (0)
+
+/*
+ * Gets the buffer of object as items of type 'i' or 'd', at least minimum long;
+ * None gives a NULL buffer when allowed. Returns 0 and sets an exception on error.
+ */
+static int getBuffer(PyObject* object, Py_buffer* view, char type, Py_ssize_t minimum,
+                     int writable, int allowNone, const char* name) {
+    view->obj = NULL;
+    view->buf = NULL;
+    view->len = 0;
+    if (object == Py_None) {
+        if (allowNone)
+            return 1;
+        PyErr_Format(PyExc_TypeError, "%s must not be None", name);
+        return 0;
+    }
+
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    if (PyObject_GetBuffer(object, view, flags) != 0)
+        return 0;
+
+    /* a native type, optionally with a prefix naming the native byte order */
+    const unsigned int one = 1;
+    const char* nativeOrders = (*(const unsigned char*) &one == 1 ? "@=<" : "@=>!");
+    const char* format = (view->format != NULL ? view->format : "B");
+    size_t formatLength = strlen(format);
+    char code = (formatLength > 0 ? format[formatLength - 1] : 'B');
+    int matches = (type == 'd' ? (code == 'd' && view->itemsize == sizeof(double))
+                               : ((code == 'i' || code == 'l') && view->itemsize == sizeof(int)));
+    if (!matches || formatLength > 2 || (formatLength == 2 && strchr(nativeOrders, format[0]) == NULL)) {
+        PyErr_Format(PyExc_TypeError, "%s must hold %s items, not '%s'", name,
+                     (type == 'd' ? "double ('d')" : "int ('i')"), format);
+        PyBuffer_Release(view);
+        view->obj = NULL;
+        return 0;
+    }
+
+    if (view->len / view->itemsize < minimum) {
+        PyErr_Format(PyExc_ValueError, "%s holds %zd items, fewer than the %zd needed", name,
+                     view->len / view->itemsize, minimum);
+        PyBuffer_Release(view);
+        view->obj = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+static Py_ssize_t itemCount(const Py_buffer* view) {
+    return (view->obj != NULL ? view->len / view->itemsize : 0);
+}
+
+static void releaseBuffer(Py_buffer* view) {
+    if (view->obj != NULL)
+        PyBuffer_Release(view);
+}
+
+static PyObject* beagle_getVersion(PyObject* self, PyObject* args) {
+    return PyUnicode_FromString(beagleGetVersion());
+}
+
+static PyObject* beagle_getCitation(PyObject* self, PyObject* args) {
+    return PyUnicode_FromString(beagleGetCitation());
+}
+
+static PyObject* beagle_getResourceList(PyObject* self, PyObject* args) {
+    BeagleResourceList* resources;
+    Py_BEGIN_ALLOW_THREADS
+    resources = beagleGetResourceList();
+    Py_END_ALLOW_THREADS
+    if (resources == NULL)
+        return raiseBeagleError(BEAGLE_ERROR_NO_RESOURCE, "getResourceList");
+
+    PyObject* list = PyList_New(resources->length);
+    if (list == NULL)
+        return NULL;
+    for (int i = 0; i < resources->length; i++) {
+        PyObject* resource = Py_BuildValue("{s:i,s:s,s:s,s:L,s:L}",
+                                           "number", i,
+                                           "name", resources->list[i].name,
+                                           "description", resources->list[i].description,
+                                           "supportFlags", resources->list[i].supportFlags,
+                                           "requiredFlags", resources->list[i].requiredFlags);
+        if (resource == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, resource);
+    }
+    return list;
+}
+
+static PyObject* beagle_createInstance(PyObject* self, PyObject* args, PyObject* keywords) {
+    static char* names[] = {"tipCount", "partialsBufferCount", "compactBufferCount", "stateCount",
+                            "patternCount", "eigenBufferCount", "matrixBufferCount", "categoryCount",
+                            "scaleBufferCount", "resourceList", "preferenceFlags",
+                            "requirementFlags", NULL};
+    int tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount;
+    int eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount;
+    PyObject* resourceObject = Py_None;
+    long long preferenceFlags = 0;
+    long long requirementFlags = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "iiiiiiiii|OLL", names, &tipCount,
+                                     &partialsBufferCount, &compactBufferCount, &stateCount,
+                                     &patternCount, &eigenBufferCount, &matrixBufferCount,
+                                     &categoryCount, &scaleBufferCount, &resourceObject,
+                                     &preferenceFlags, &requirementFlags))
+        return NULL;
+
+    Py_buffer resources;
+    if (!getBuffer(resourceObject, &resources, 'i', 0, 0, 1, "resourceList"))
+        return NULL;
+
+    PyObject* result = NULL;
+    BeagleInstanceDetails details;
+    int returnCode;
+    BEAGLE_CALL("createInstance",
+                beagleCreateInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                     patternCount, eigenBufferCount, matrixBufferCount,
+                                     categoryCount, scaleBufferCount, (int*) resources.buf,
+                                     (int) itemCount(&resources), preferenceFlags,
+                                     requirementFlags, &details));
+
+    if (returnCode >= shapeCount) {
+        int count = (returnCode + 1 > 2 * shapeCount ? returnCode + 1 : 2 * shapeCount);
+        InstanceShape* grown = (InstanceShape*) PyMem_Realloc(shapes, count * sizeof(InstanceShape));
+        if (grown == NULL) {
+            beagleFinalizeInstance(returnCode);
+            PyErr_NoMemory();
+            goto done;
+        }
+        memset(grown + shapeCount, 0, (count - shapeCount) * sizeof(InstanceShape));
+        shapes = grown;
+        shapeCount = count;
+    }
+    InstanceShape shape = {1, tipCount, stateCount, patternCount, categoryCount};
+    shapes[returnCode] = shape;
+
+    result = Py_BuildValue("(i{s:i,s:s,s:s,s:l})", returnCode,
+                           "resourceNumber", details.resourceNumber,
+                           "resourceName", details.resourceName,
+                           "implName", details.implName,
+                           "flags", details.flags);
+
+done:
+    releaseBuffer(&resources);
+    return result;
+}
+
+static PyObject* beagle_finalizeInstance(PyObject* self, PyObject* args) {
+    int instance;
+    if (!PyArg_ParseTuple(args, "i", &instance))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("finalizeInstance", beagleFinalizeInstance(instance));
+    shapes[instance].created = 0;
+    result = PyLong_FromLong(returnCode);
+done:
+    return result;
+}
+
+/* Calls taking an instance, an index and one array of a size given by the shape */
+typedef enum {
+    SET_TIP_STATES,
+    SET_TIP_PARTIALS,
+    SET_PARTIALS,
+    GET_PARTIALS,
+    SET_STATE_FREQUENCIES,
+    SET_CATEGORY_WEIGHTS,
+    GET_TRANSITION_MATRIX
+} IndexedArrayCall;
+
+static PyObject* indexedArrayCall(PyObject* args, IndexedArrayCall call, const char* name) {
+    int instance, index;
+    PyObject* object;
+    if (!PyArg_ParseTuple(args, "iiO", &instance, &index, &object))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_ssize_t partialsLength = (Py_ssize_t) shape->stateCount * shape->patternCount;
+    Py_ssize_t minimum;
+    char type = 'd';
+    int writable = 0;
+    switch (call) {
+        case SET_TIP_STATES:        minimum = shape->patternCount; type = 'i'; break;
+        case SET_TIP_PARTIALS:      minimum = partialsLength; break;
+        case SET_PARTIALS:          minimum = partialsLength * shape->categoryCount; break;
+        case GET_PARTIALS:          minimum = partialsLength * shape->categoryCount; writable = 1; break;
+        case SET_STATE_FREQUENCIES: minimum = shape->stateCount; break;
+        case SET_CATEGORY_WEIGHTS:  minimum = shape->categoryCount; break;
+        default:
+            minimum = (Py_ssize_t) shape->stateCount * shape->stateCount * shape->categoryCount;
+            writable = 1;
+            break;
+    }
+
+    Py_buffer view;
+    if (!getBuffer(object, &view, type, minimum, writable, 0, name))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    switch (call) {
+        case SET_TIP_STATES:
+            BEAGLE_CALL(name, beagleSetTipStates(instance, index, (const int*) view.buf));
+            break;
+        case SET_TIP_PARTIALS:
+            BEAGLE_CALL(name, beagleSetTipPartials(instance, index, (const double*) view.buf));
+            break;
+        case SET_PARTIALS:
+            BEAGLE_CALL(name, beagleSetPartials(instance, index, (const double*) view.buf));
+            break;
+        case GET_PARTIALS:
+            BEAGLE_CALL(name, beagleGetPartials(instance, index, BEAGLE_OP_NONE, (double*) view.buf));
+            break;
+        case SET_STATE_FREQUENCIES:
+            BEAGLE_CALL(name, beagleSetStateFrequencies(instance, index, (const double*) view.buf));
+            break;
+        case SET_CATEGORY_WEIGHTS:
+            BEAGLE_CALL(name, beagleSetCategoryWeights(instance, index, (const double*) view.buf));
+            break;
+        default:
+            BEAGLE_CALL(name, beagleGetTransitionMatrix(instance, index, (double*) view.buf));
+            break;
+    }
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&view);
+    return result;
+}
+
+static PyObject* beagle_setTipStates(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, SET_TIP_STATES, "setTipStates");
+}
+
+static PyObject* beagle_setTipPartials(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, SET_TIP_PARTIALS, "setTipPartials");
+}
+
+static PyObject* beagle_setPartials(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, SET_PARTIALS, "setPartials");
+}
+
+static PyObject* beagle_getPartials(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, GET_PARTIALS, "getPartials");
+}
+
+static PyObject* beagle_setStateFrequencies(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, SET_STATE_FREQUENCIES, "setStateFrequencies");
+}
+
+static PyObject* beagle_setCategoryWeights(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, SET_CATEGORY_WEIGHTS, "setCategoryWeights");
+}
+
+static PyObject* beagle_getTransitionMatrix(PyObject* self, PyObject* args) {
+    return indexedArrayCall(args, GET_TRANSITION_MATRIX, "getTransitionMatrix");
+}
+
+static PyObject* beagle_setTransitionMatrix(PyObject* self, PyObject* args) {
+    int instance, matrixIndex;
+    PyObject* object;
+    double paddedValue = 1.0;
+    if (!PyArg_ParseTuple(args, "iiO|d", &instance, &matrixIndex, &object, &paddedValue))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_buffer matrix;
+    if (!getBuffer(object, &matrix, 'd',
+                   (Py_ssize_t) shape->stateCount * shape->stateCount * shape->categoryCount,
+                   0, 0, "inMatrix"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("setTransitionMatrix",
+                beagleSetTransitionMatrix(instance, matrixIndex, (const double*) matrix.buf,
+                                          paddedValue));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&matrix);
+    return result;
+}
+
+/* Calls taking an instance and one array of a size given by the shape */
+static PyObject* beagle_setPatternWeights(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject* object;
+    if (!PyArg_ParseTuple(args, "iO", &instance, &object))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_buffer weights;
+    if (!getBuffer(object, &weights, 'd', shape->patternCount, 0, 0, "inPatternWeights"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("setPatternWeights", beagleSetPatternWeights(instance, (const double*) weights.buf));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&weights);
+    return result;
+}
+
+static PyObject* beagle_setCategoryRates(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject* object;
+    if (!PyArg_ParseTuple(args, "iO", &instance, &object))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_buffer rates;
+    if (!getBuffer(object, &rates, 'd', shape->categoryCount, 0, 0, "inCategoryRates"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("setCategoryRates", beagleSetCategoryRates(instance, (const double*) rates.buf));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&rates);
+    return result;
+}
+
+static PyObject* beagle_getSiteLogLikelihoods(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject* object;
+    if (!PyArg_ParseTuple(args, "iO", &instance, &object))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_buffer siteLogLikelihoods;
+    if (!getBuffer(object, &siteLogLikelihoods, 'd', shape->patternCount, 1, 0,
+                   "outLogLikelihoods"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("getSiteLogLikelihoods",
+                beagleGetSiteLogLikelihoods(instance, (double*) siteLogLikelihoods.buf));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&siteLogLikelihoods);
+    return result;
+}
+
+static PyObject* beagle_setEigenDecomposition(PyObject* self, PyObject* args) {
+    int instance, eigenIndex;
+    PyObject *vectorsObject, *inverseObject, *valuesObject;
+    if (!PyArg_ParseTuple(args, "iiOOO", &instance, &eigenIndex, &vectorsObject, &inverseObject,
+                          &valuesObject))
+        return NULL;
+    InstanceShape* shape = getShape(instance);
+    if (shape == NULL)
+        return NULL;
+
+    Py_ssize_t matrixLength = (Py_ssize_t) shape->stateCount * shape->stateCount;
+    Py_buffer vectors, inverse, values;
+    inverse.obj = values.obj = NULL;
+    PyObject* result = NULL;
+    int returnCode;
+    if (!getBuffer(vectorsObject, &vectors, 'd', matrixLength, 0, 0, "inEigenVectors") ||
+        !getBuffer(inverseObject, &inverse, 'd', matrixLength, 0, 0, "inInverseEigenVectors") ||
+        !getBuffer(valuesObject, &values, 'd', shape->stateCount, 0, 0, "inEigenValues"))
+        goto done;
+
+    BEAGLE_CALL("setEigenDecomposition",
+                beagleSetEigenDecomposition(instance, eigenIndex, (const double*) vectors.buf,
+                                            (const double*) inverse.buf,
+                                            (const double*) values.buf));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&vectors);
+    releaseBuffer(&inverse);
+    releaseBuffer(&values);
+    return result;
+}
+
+static PyObject* beagle_updateTransitionMatrices(PyObject* self, PyObject* args) {
+    int instance, eigenIndex;
+    PyObject *probabilityObject, *firstObject, *secondObject, *lengthsObject;
+    if (!PyArg_ParseTuple(args, "iiOOOO", &instance, &eigenIndex, &probabilityObject,
+                          &firstObject, &secondObject, &lengthsObject))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    Py_buffer probability, first, second, lengths;
+    first.obj = second.obj = lengths.obj = NULL;
+    PyObject* result = NULL;
+    int returnCode;
+    if (!getBuffer(probabilityObject, &probability, 'i', 0, 0, 0, "probabilityIndices"))
+        return NULL;
+    Py_ssize_t count = itemCount(&probability);
+    if (!getBuffer(firstObject, &first, 'i', count, 0, 1, "firstDerivativeIndices") ||
+        !getBuffer(secondObject, &second, 'i', count, 0, 1, "secondDerivativeIndices") ||
+        !getBuffer(lengthsObject, &lengths, 'd', count, 0, 0, "edgeLengths"))
+        goto done;
+
+    BEAGLE_CALL("updateTransitionMatrices",
+                beagleUpdateTransitionMatrices(instance, eigenIndex, (const int*) probability.buf,
+                                               (const int*) first.buf, (const int*) second.buf,
+                                               (const double*) lengths.buf, (int) count));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&probability);
+    releaseBuffer(&first);
+    releaseBuffer(&second);
+    releaseBuffer(&lengths);
+    return result;
+}
+
+static PyObject* beagle_updatePartials(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject* object;
+    int cumulativeScaleIndex = BEAGLE_OP_NONE;
+    if (!PyArg_ParseTuple(args, "iO|i", &instance, &object, &cumulativeScaleIndex))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    Py_buffer operations;
+    if (!getBuffer(object, &operations, 'i', 0, 0, 0, "operations"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    Py_ssize_t count = itemCount(&operations);
+    if (count % BEAGLE_OP_COUNT != 0) {
+        PyErr_Format(PyExc_ValueError, "operations holds %zd items, not a multiple of %d",
+                     count, BEAGLE_OP_COUNT);
+        goto done;
+    }
+    BEAGLE_CALL("updatePartials",
+                beagleUpdatePartials(instance, (const BeagleOperation*) operations.buf,
+                                     (int) (count / BEAGLE_OP_COUNT), cumulativeScaleIndex));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&operations);
+    return result;
+}
+
+static PyObject* beagle_accumulateScaleFactors(PyObject* self, PyObject* args) {
+    int instance, cumulativeScaleIndex;
+    PyObject* object;
+    if (!PyArg_ParseTuple(args, "iOi", &instance, &object, &cumulativeScaleIndex))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    Py_buffer scaleIndices;
+    if (!getBuffer(object, &scaleIndices, 'i', 0, 0, 0, "scaleIndices"))
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("accumulateScaleFactors",
+                beagleAccumulateScaleFactors(instance, (const int*) scaleIndices.buf,
+                                             (int) itemCount(&scaleIndices),
+                                             cumulativeScaleIndex));
+    result = PyLong_FromLong(returnCode);
+done:
+    releaseBuffer(&scaleIndices);
+    return result;
+}
+
+static PyObject* beagle_resetScaleFactors(PyObject* self, PyObject* args) {
+    int instance, cumulativeScaleIndex;
+    if (!PyArg_ParseTuple(args, "ii", &instance, &cumulativeScaleIndex))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    PyObject* result = NULL;
+    int returnCode;
+    BEAGLE_CALL("resetScaleFactors", beagleResetScaleFactors(instance, cumulativeScaleIndex));
+    result = PyLong_FromLong(returnCode);
+done:
+    return result;
+}
+
+static PyObject* beagle_calculateRootLogLikelihoods(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject *bufferObject, *weightsObject, *frequenciesObject, *scaleObject;
+    if (!PyArg_ParseTuple(args, "iOOOO", &instance, &bufferObject, &weightsObject,
+                          &frequenciesObject, &scaleObject))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    Py_buffer buffers, weights, frequencies, scales;
+    weights.obj = frequencies.obj = scales.obj = NULL;
+    PyObject* result = NULL;
+    int returnCode;
+    double sumLogLikelihood = 0.0;
+    if (!getBuffer(bufferObject, &buffers, 'i', 0, 0, 0, "bufferIndices"))
+        return NULL;
+    Py_ssize_t count = itemCount(&buffers);
+    if (!getBuffer(weightsObject, &weights, 'i', count, 0, 0, "categoryWeightsIndices") ||
+        !getBuffer(frequenciesObject, &frequencies, 'i', count, 0, 0, "stateFrequenciesIndices") ||
+        !getBuffer(scaleObject, &scales, 'i', count, 0, 0, "cumulativeScaleIndices"))
+        goto done;
+
+    BEAGLE_CALL("calculateRootLogLikelihoods",
+                beagleCalculateRootLogLikelihoods(instance, (const int*) buffers.buf,
+                                                  (const int*) weights.buf,
+                                                  (const int*) frequencies.buf,
+                                                  (const int*) scales.buf, (int) count,
+                                                  &sumLogLikelihood));
+    result = PyFloat_FromDouble(sumLogLikelihood);
+done:
+    releaseBuffer(&buffers);
+    releaseBuffer(&weights);
+    releaseBuffer(&frequencies);
+    releaseBuffer(&scales);
+    return result;
+}
+
+static PyObject* beagle_calculateEdgeLogLikelihoods(PyObject* self, PyObject* args) {
+    int instance;
+    PyObject *parentObject, *childObject, *probabilityObject, *firstObject, *secondObject;
+    PyObject *weightsObject, *frequenciesObject, *scaleObject;
+    if (!PyArg_ParseTuple(args, "iOOOOOOOO", &instance, &parentObject, &childObject,
+                          &probabilityObject, &firstObject, &secondObject, &weightsObject,
+                          &frequenciesObject, &scaleObject))
+        return NULL;
+    if (getShape(instance) == NULL)
+        return NULL;
+
+    Py_buffer parents, children, probability, first, second, weights, frequencies, scales;
+    children.obj = probability.obj = first.obj = second.obj = NULL;
+    weights.obj = frequencies.obj = scales.obj = NULL;
+    PyObject* result = NULL;
+    int returnCode;
+    double sums[3] = {0.0, 0.0, 0.0};
+    if (!getBuffer(parentObject, &parents, 'i', 0, 0, 0, "parentBufferIndices"))
+        return NULL;
+    Py_ssize_t count = itemCount(&parents);
+    if (!getBuffer(childObject, &children, 'i', count, 0, 0, "childBufferIndices") ||
+        !getBuffer(probabilityObject, &probability, 'i', count, 0, 0, "probabilityIndices") ||
+        !getBuffer(firstObject, &first, 'i', count, 0, 1, "firstDerivativeIndices") ||
+        !getBuffer(secondObject, &second, 'i', count, 0, 1, "secondDerivativeIndices") ||
+        !getBuffer(weightsObject, &weights, 'i', count, 0, 0, "categoryWeightsIndices") ||
+        !getBuffer(frequenciesObject, &frequencies, 'i', count, 0, 0, "stateFrequenciesIndices") ||
+        !getBuffer(scaleObject, &scales, 'i', count, 0, 0, "cumulativeScaleIndices"))
+        goto done;
+
+    BEAGLE_CALL("calculateEdgeLogLikelihoods",
+                beagleCalculateEdgeLogLikelihoods(instance, (const int*) parents.buf,
+                                                  (const int*) children.buf,
+                                                  (const int*) probability.buf,
+                                                  (const int*) first.buf, (const int*) second.buf,
+                                                  (const int*) weights.buf,
+                                                  (const int*) frequencies.buf,
+                                                  (const int*) scales.buf, (int) count, &sums[0],
+                                                  (first.buf != NULL ? &sums[1] : NULL),
+                                                  (second.buf != NULL ? &sums[2] : NULL)));
+    if (first.buf == NULL && second.buf == NULL)
+        result = PyFloat_FromDouble(sums[0]);
+    else
+        result = Py_BuildValue("(ddd)", sums[0], sums[1], sums[2]);
+done:
+    releaseBuffer(&parents);
+    releaseBuffer(&children);
+    releaseBuffer(&probability);
+    releaseBuffer(&first);
+    releaseBuffer(&second);
+    releaseBuffer(&weights);
+    releaseBuffer(&frequencies);
+    releaseBuffer(&scales);
+    return result;
+}
+
+static PyMethodDef beagleMethods[] = {
+    {"getVersion", beagle_getVersion, METH_NOARGS, "Version of the library"},
+    {"getCitation", beagle_getCitation, METH_NOARGS, "How to cite the library"},
+    {"getResourceList", beagle_getResourceList, METH_NOARGS,
+     "List of dicts describing the available resources"},
+    {"createInstance", (PyCFunction) (void (*)(void)) beagle_createInstance,
+     METH_VARARGS | METH_KEYWORDS,
+     "createInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount, "
+     "eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount, resourceList=None, "
+     "preferenceFlags=0, requirementFlags=0) -> (instance, details)"},
+    {"finalizeInstance", beagle_finalizeInstance, METH_VARARGS, "finalizeInstance(instance)"},
+    {"setTipStates", beagle_setTipStates, METH_VARARGS,
+     "setTipStates(instance, tipIndex, inStates)"},
+    {"setTipPartials", beagle_setTipPartials, METH_VARARGS,
+     "setTipPartials(instance, tipIndex, inPartials)"},
+    {"setPartials", beagle_setPartials, METH_VARARGS,
+     "setPartials(instance, bufferIndex, inPartials)"},
+    {"getPartials", beagle_getPartials, METH_VARARGS,
+     "getPartials(instance, bufferIndex, outPartials)"},
+    {"setEigenDecomposition", beagle_setEigenDecomposition, METH_VARARGS,
+     "setEigenDecomposition(instance, eigenIndex, inEigenVectors, inInverseEigenVectors, "
+     "inEigenValues)"},
+    {"setStateFrequencies", beagle_setStateFrequencies, METH_VARARGS,
+     "setStateFrequencies(instance, stateFrequenciesIndex, inStateFrequencies)"},
+    {"setCategoryWeights", beagle_setCategoryWeights, METH_VARARGS,
+     "setCategoryWeights(instance, categoryWeightsIndex, inCategoryWeights)"},
+    {"setCategoryRates", beagle_setCategoryRates, METH_VARARGS,
+     "setCategoryRates(instance, inCategoryRates)"},
+    {"setPatternWeights", beagle_setPatternWeights, METH_VARARGS,
+     "setPatternWeights(instance, inPatternWeights)"},
+    {"setTransitionMatrix", beagle_setTransitionMatrix, METH_VARARGS,
+     "setTransitionMatrix(instance, matrixIndex, inMatrix, paddedValue=1.0)"},
+    {"getTransitionMatrix", beagle_getTransitionMatrix, METH_VARARGS,
+     "getTransitionMatrix(instance, matrixIndex, outMatrix)"},
+    {"updateTransitionMatrices", beagle_updateTransitionMatrices, METH_VARARGS,
+     "updateTransitionMatrices(instance, eigenIndex, probabilityIndices, firstDerivativeIndices, "
+     "secondDerivativeIndices, edgeLengths)"},
+    {"updatePartials", beagle_updatePartials, METH_VARARGS,
+     "updatePartials(instance, operations, cumulativeScaleIndex=BEAGLE_OP_NONE), operations "
+     "holding BEAGLE_OP_COUNT integers per operation"},
+    {"accumulateScaleFactors", beagle_accumulateScaleFactors, METH_VARARGS,
+     "accumulateScaleFactors(instance, scaleIndices, cumulativeScaleIndex)"},
+    {"resetScaleFactors", beagle_resetScaleFactors, METH_VARARGS,
+     "resetScaleFactors(instance, cumulativeScaleIndex)"},
+    {"calculateRootLogLikelihoods", beagle_calculateRootLogLikelihoods, METH_VARARGS,
+     "calculateRootLogLikelihoods(instance, bufferIndices, categoryWeightsIndices, "
+     "stateFrequenciesIndices, cumulativeScaleIndices) -> sum of log likelihoods"},
+    {"calculateEdgeLogLikelihoods", beagle_calculateEdgeLogLikelihoods, METH_VARARGS,
+     "calculateEdgeLogLikelihoods(instance, parentBufferIndices, childBufferIndices, "
+     "probabilityIndices, firstDerivativeIndices, secondDerivativeIndices, "
+     "categoryWeightsIndices, stateFrequenciesIndices, cumulativeScaleIndices) -> sum of log "
+     "likelihoods, or (sum, first derivative, second derivative) when derivative indices are given"},
+    {"getSiteLogLikelihoods", beagle_getSiteLogLikelihoods, METH_VARARGS,
+     "getSiteLogLikelihoods(instance, outLogLikelihoods)"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef beagleModule = {
+    PyModuleDef_HEAD_INIT,
+    "hmsbeagle",
+    "Bindings to libhmsbeagle that read and write buffer-protocol arrays in place",
+    -1,
+    beagleMethods
+};
+
+#define BEAGLE_ADD_CONSTANT(module, name) PyModule_AddObject(module, #name, PyLong_FromLong(name))
+
+PyMODINIT_FUNC PyInit_hmsbeagle(void) {
+    PyObject* module = PyModule_Create(&beagleModule);
+    if (module == NULL)
+        return NULL;
+
+    BeagleError = PyErr_NewException("hmsbeagle.BeagleError", NULL, NULL);
+    Py_XINCREF(BeagleError);
+    if (PyModule_AddObject(module, "BeagleError", BeagleError) < 0) {
+        Py_XDECREF(BeagleError);
+        Py_CLEAR(BeagleError);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_OP_COUNT);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_OP_NONE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_RESULT_SLOT_COUNT);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_PRECISION_SINGLE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_PRECISION_DOUBLE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_COMPUTATION_SYNCH);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_COMPUTATION_ASYNCH);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_EIGEN_REAL);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_EIGEN_COMPLEX);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALING_MANUAL);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALING_AUTO);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALING_ALWAYS);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALING_DYNAMIC);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALERS_RAW);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_SCALERS_LOG);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_VECTOR_NONE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_VECTOR_SSE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_VECTOR_AVX);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_VECTOR_AVX512);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_VECTOR_NEON);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_MEMORY_ARENA);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_KERNEL_TUNING);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_CALIBRATE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_PREORDER);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_MULTI_EDGE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_THREADING_NONE);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_THREADING_CPP);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_THREADING_OPENMP);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_PROCESSOR_CPU);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_PROCESSOR_GPU);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_FRAMEWORK_CPU);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_FRAMEWORK_CUDA);
+    BEAGLE_ADD_CONSTANT(module, BEAGLE_FLAG_FRAMEWORK_OPENCL);
+
+    return module;
+}
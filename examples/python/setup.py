@@ -0,0 +1,20 @@
+import subprocess
+
+from setuptools import Extension, setup
+
+
+def pkgconfig(*packages, **kw):
+    flag_map = {'-I': 'include_dirs', '-L': 'library_dirs', '-l': 'libraries'}
+    output = subprocess.check_output(["pkg-config", "--libs", "--cflags"] + list(packages))
+    for token in output.decode().split():
+        kw.setdefault(flag_map.get(token[:2]), []).append(token[2:])
+    return kw
+
+
+beagle_module = Extension("hmsbeagle", sources=["beaglemodule.c"], **pkgconfig("hmsbeagle-1"))
+
+setup(name="hmsbeagle",
+      version="0.1",
+      description="""BEAGLE bindings passing buffer-protocol arrays without copies""",
+      ext_modules=[beagle_module],
+      )
@@ -0,0 +1,77 @@
+# hellobeagle through the buffer bindings: arrays are passed in place, and
+# NumPy arrays of int32 and float64 work the same way as array.array
+import sys
+import threading
+from array import array
+
+import hmsbeagle
+
+
+def getTable():
+    return {'A': 0, 'C': 1, 'G': 2, 'T': 3, 'a': 0, 'c': 1, 'g': 2, 't': 3, '-': 4}
+
+
+mars = "CCGAG-AGCAGCAATGGAT-GAGGCATGGCG"
+saturn = "GCGCGCAGCTGCTGTAGATGGAGGCATGACG"
+jupiter = "GCGCGCAGCAGCTGTGGATGGAAGGATGACG"
+
+nPatterns = len(mars)
+
+
+def logLikelihood():
+    instance, details = hmsbeagle.createInstance(3, 2, 3, 4, nPatterns, 1, 4, 1, 0)
+
+    table = getTable()
+    for tip, sequence in enumerate([mars, saturn, jupiter]):
+        hmsbeagle.setTipStates(instance, tip, array('i', [table[c] for c in sequence]))
+
+    hmsbeagle.setPatternWeights(instance, array('d', [1.0] * nPatterns))
+    hmsbeagle.setStateFrequencies(instance, 0, array('d', [0.25] * 4))
+    hmsbeagle.setCategoryWeights(instance, 0, array('d', [1.0]))
+    hmsbeagle.setCategoryRates(instance, array('d', [1.0]))
+
+    evec = array('d', [1.0, 2.0, 0.0, 0.5,
+                       1.0, -2.0, 0.5, 0.0,
+                       1.0, 2.0, 0.0, -0.5,
+                       1.0, -2.0, -0.5, 0.0])
+    ivec = array('d', [0.25, 0.25, 0.25, 0.25,
+                       0.125, -0.125, 0.125, -0.125,
+                       0.0, 1.0, 0.0, -1.0,
+                       1.0, 0.0, -1.0, 0.0])
+    eval = array('d', [0.0, -1.3333333333333333, -1.3333333333333333, -1.3333333333333333])
+    hmsbeagle.setEigenDecomposition(instance, 0, evec, ivec, eval)
+
+    hmsbeagle.updateTransitionMatrices(instance, 0, array('i', [0, 1, 2, 3]), None, None,
+                                       array('d', [0.1, 0.1, 0.2, 0.1]))
+
+    none = hmsbeagle.BEAGLE_OP_NONE
+    operations = array('i', [3, none, none, 0, 0, 1, 1,
+                             4, none, none, 2, 2, 3, 3])
+    hmsbeagle.updatePartials(instance, operations)
+
+    logL = hmsbeagle.calculateRootLogLikelihoods(instance, array('i', [4]), array('i', [0]),
+                                                 array('i', [0]), array('i', [none]))
+
+    siteLogLikelihoods = array('d', [0.0] * nPatterns)
+    hmsbeagle.getSiteLogLikelihoods(instance, siteLogLikelihoods)
+    assert abs(sum(siteLogLikelihoods) - logL) < 1e-8
+
+    hmsbeagle.finalizeInstance(instance)
+    return logL
+
+
+logL = logLikelihood()
+print(logL)
+
+# several threads, each driving its own instance
+results = []
+threads = [threading.Thread(target=lambda: results.append(logLikelihood())) for i in range(4)]
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join()
+if any(abs(result - logL) > 1e-8 for result in results):
+    print("threaded results differ: %s" % results)
+    sys.exit(1)
+
+print("Woof!")
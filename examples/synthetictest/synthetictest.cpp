@@ -8,6 +8,7 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdarg>
 #include <iostream>
 #include <iomanip>
 #include <vector>
@@ -16,6 +17,7 @@
 #include <cmath>
 #include <stack>
 #include <queue>
+#include <string>
 
 #ifdef _WIN32
     #include <winsock.h>
@@ -54,6 +56,21 @@ double cpuTimeSetPartitions, cpuTimeUpdateTransitionMatrices, cpuTimeUpdateParti
 
 bool useStdlibRand;
 
+// self-checks that failed, over all runs; any makes the exit status non-zero
+int checkFailureCount = 0;
+
+void reportCheckFailure(const char* message)
+{
+    fprintf(stdout, "error: %s\n", message);
+    checkFailureCount++;
+}
+
+// instances created over all runs; none means nothing was tested
+int instancesObtained = 0;
+
+// number of the instance the previous run finalized, which no later instance may answer to
+int finalizedInstance = -1;
+
 static unsigned int rand_state = 1;
 
 int gt_rand_r(unsigned int *seed)
@@ -85,29 +102,46 @@ void abort(std::string msg) {
     std::exit(1);
 }
 
-double* getRandomTipPartials( int nsites, int stateCount )
+// the first constantSiteCount sites show the same state at every tip
+double* getRandomTipPartials( int nsites, int stateCount, int constantSiteCount )
 {
     double *partials = (double*) calloc(sizeof(double), nsites * stateCount); // 'malloc' was a bug
     for( int i=0; i<nsites*stateCount; i+=stateCount )
     {
         int s = gt_rand()%stateCount;
+        if (i/stateCount < constantSiteCount)
+            s = (i/stateCount) % stateCount;
         // printf("%d ", s);
         partials[i+s]=1.0;
     }
     return partials;
 }
 
-int* getRandomTipStates( int nsites, int stateCount )
+int* getRandomTipStates( int nsites, int stateCount, int constantSiteCount )
 {
     int *states = (int*) calloc(sizeof(int), nsites); 
     for( int i=0; i<nsites; i++ )
     {
         int s = gt_rand()%stateCount;
+        if (i < constantSiteCount)
+            s = i % stateCount;
         states[i]=s;
     }
     return states;
 }
 
+// sets a tip's states as one-state sets, which give the same likelihood as the states
+void setTipStateSets(int instance, int tipIndex, const int* states, int nsites, int stateCount)
+{
+    std::vector<int> stateSets(nsites);
+    for (int i = 0; i < nsites; i++)
+        stateSets[i] = (states[i] < stateCount && states[i] < 31 ? 1 << states[i] : 0);
+    if (stateCount > 31 || beagleSetTipStateSets(instance, tipIndex, &stateSets[0]) != BEAGLE_SUCCESS) {
+        printf("ERROR: No BEAGLE implementation for state-set tips\n");
+        exit(-1);
+    }
+}
+
 void printTiming(double timingValue,
                  int timePrecision,
                  bool printSpeedup,
@@ -127,6 +161,72 @@ double getTimeDiff(struct timeval t1,
     return ((t2.tv_sec - t1.tv_sec) + (double)(t2.tv_usec-t1.tv_usec)/1000000.0);
 }
 
+struct resultField {
+    std::string name;
+    std::string value;
+    bool text;
+};
+
+void addResultField(std::vector<resultField>& fields,
+                    const char* name,
+                    const char* format,
+                    ...) {
+    char value[256];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(value, sizeof(value), format, arguments);
+    va_end(arguments);
+    resultField field = {name, value, (format[1] == 's')};
+    fields.push_back(field);
+}
+
+// Appends one run as a CSV row, with a header if the file is empty, and as one line of JSON
+void writeResults(FILE* csvFile,
+                  FILE* jsonFile,
+                  const std::vector<resultField>& fields) {
+    if (csvFile != NULL) {
+        fseek(csvFile, 0, SEEK_END);
+        if (ftell(csvFile) == 0) {
+            for (size_t i = 0; i < fields.size(); i++)
+                fprintf(csvFile, "%s%s", (i > 0 ? "," : ""), fields[i].name.c_str());
+            fprintf(csvFile, "\n");
+        }
+        for (size_t i = 0; i < fields.size(); i++) {
+            std::string value = fields[i].value;
+            if (fields[i].text) {
+                for (size_t c = value.find('"'); c != std::string::npos; c = value.find('"', c + 2))
+                    value.insert(c, 1, '"');
+                value = "\"" + value + "\"";
+            }
+            fprintf(csvFile, "%s%s", (i > 0 ? "," : ""), value.c_str());
+        }
+        fprintf(csvFile, "\n");
+        fflush(csvFile);
+    }
+
+    if (jsonFile != NULL) {
+        fprintf(jsonFile, "{");
+        for (size_t i = 0; i < fields.size(); i++) {
+            std::string value = fields[i].value;
+            if (fields[i].text) {
+                std::string escaped;
+                for (size_t c = 0; c < value.size(); c++) {
+                    if (value[c] == '"' || value[c] == '\\')
+                        escaped += '\\';
+                    if ((unsigned char) value[c] >= ' ')
+                        escaped += value[c];
+                }
+                value = "\"" + escaped + "\"";
+            } else if (value == "nan" || value == "-nan" || value == "inf" || value == "-inf") {
+                value = "null";
+            }
+            fprintf(jsonFile, "%s\"%s\":%s", (i > 0 ? "," : ""), fields[i].name.c_str(), value.c_str());
+        }
+        fprintf(jsonFile, "}\n");
+        fflush(jsonFile);
+    }
+}
+
 struct node
 {
     int data;
@@ -335,7 +435,7 @@ node* reroot(node* rerootNode, node* root, std::vector<node*> newNodes)
 
 
 
-void printFlags(long inFlags) {
+void printFlags(long long inFlags) {
     if (inFlags & BEAGLE_FLAG_PROCESSOR_CPU)      fprintf(stdout, " PROCESSOR_CPU");
     if (inFlags & BEAGLE_FLAG_PROCESSOR_GPU)      fprintf(stdout, " PROCESSOR_GPU");
     if (inFlags & BEAGLE_FLAG_PROCESSOR_FPGA)     fprintf(stdout, " PROCESSOR_FPGA");
@@ -355,17 +455,70 @@ void printFlags(long inFlags) {
     if (inFlags & BEAGLE_FLAG_VECTOR_NONE)        fprintf(stdout, " VECTOR_NONE");
     if (inFlags & BEAGLE_FLAG_VECTOR_SSE)         fprintf(stdout, " VECTOR_SSE");
     if (inFlags & BEAGLE_FLAG_VECTOR_AVX)         fprintf(stdout, " VECTOR_AVX");
+    if (inFlags & BEAGLE_FLAG_VECTOR_AVX512)      fprintf(stdout, " VECTOR_AVX512");
+    if (inFlags & BEAGLE_FLAG_VECTOR_NEON)        fprintf(stdout, " VECTOR_NEON");
     if (inFlags & BEAGLE_FLAG_THREADING_NONE)     fprintf(stdout, " THREADING_NONE");
     if (inFlags & BEAGLE_FLAG_THREADING_OPENMP)   fprintf(stdout, " THREADING_OPENMP");
     if (inFlags & BEAGLE_FLAG_THREADING_CPP)      fprintf(stdout, " THREADING_CPP");
+    if (inFlags & BEAGLE_FLAG_THREADING_NUMA)     fprintf(stdout, " THREADING_NUMA");
+    if (inFlags & BEAGLE_FLAG_MEMORY_ARENA)       fprintf(stdout, " MEMORY_ARENA");
+    if (inFlags & BEAGLE_FLAG_KERNEL_TUNING)      fprintf(stdout, " KERNEL_TUNING");
+    if (inFlags & BEAGLE_FLAG_PREORDER)           fprintf(stdout, " PREORDER");
+    if (inFlags & BEAGLE_FLAG_MULTI_EDGE)         fprintf(stdout, " MULTI_EDGE");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CPU)      fprintf(stdout, " FRAMEWORK_CPU");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CUDA)     fprintf(stdout, " FRAMEWORK_CUDA");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_OPENCL)   fprintf(stdout, " FRAMEWORK_OPENCL");
+    if (inFlags & BEAGLE_FLAG_PARALLELOPS_STREAMS) fprintf(stdout, " PARALLELOPS_STREAMS");
+    if (inFlags & BEAGLE_FLAG_PARALLELOPS_GRID)   fprintf(stdout, " PARALLELOPS_GRID");
+}
+
+const char* getParallelOpsName(long long flags) {
+    if (flags & BEAGLE_FLAG_PARALLELOPS_STREAMS)
+        return "streams";
+    if (flags & BEAGLE_FLAG_PARALLELOPS_GRID)
+        return "grid";
+    return "none";
 }
 
+struct scalingRun {
+    int threadCount;
+    int partitionCount;
+    long long parallelOpsFlags;
+    double seconds; // 0 when no instance could be created
+};
+
+// Speedup of each run over the first and, where both set a thread count, the parallel
+// efficiency: the speedup over the factor by which the run has more threads
+void printScaling(const std::vector<scalingRun>& runs) {
+    const scalingRun& base = runs[0];
+    fprintf(stdout, "scaling:\n");
+    fprintf(stdout, "  %8s %10s %11s %12s %8s %10s\n", "threads", "partitions", "parallelops",
+            "time", "speedup", "efficiency");
+    for (size_t i = 0; i < runs.size(); i++) {
+        const scalingRun& run = runs[i];
+        char threads[16];
+        if (run.threadCount > 0)
+            snprintf(threads, sizeof(threads), "%d", run.threadCount);
+        else
+            snprintf(threads, sizeof(threads), "default");
+        fprintf(stdout, "  %8s %10d %11s", threads, run.partitionCount, getParallelOpsName(run.parallelOpsFlags));
+        if (run.seconds > 0.0 && base.seconds > 0.0) {
+            double speedup = base.seconds / run.seconds;
+            fprintf(stdout, " %12.6f %8.2f", run.seconds, speedup);
+            if (run.threadCount > 0 && base.threadCount > 0)
+                fprintf(stdout, " %9.1f%%\n", 100.0 * speedup * base.threadCount / run.threadCount);
+            else
+                fprintf(stdout, " %10s\n", "-");
+        } else {
+            fprintf(stdout, " %12s %8s %10s\n", "-", "-", "-");
+        }
+    }
+    fprintf(stdout, "\n");
+}
 
 
-void runBeagle(int resource, 
+
+double runBeagle(int resource, 
                int stateCount, 
                int ntaxa, 
                int nsites, 
@@ -378,6 +531,8 @@ void runBeagle(int resource,
                bool requireDoublePrecision,
                bool requireSSE,
                bool requireAVX,
+               bool requireAVX512,
+               bool requireNEON,
                int compactTipCount,
                int randomSeed,
                int rescaleFrequency,
@@ -394,46 +549,136 @@ void runBeagle(int resource,
                bool newDataPerRep,
                bool randomTree,
                bool rerootTrees,
-               bool pectinate)
+               bool pectinate,
+               bool enableThreads,
+               bool enableNuma,
+               bool enableArena,
+               bool kernelTuning,
+               const std::string& partialsDir,
+               int threadCount,
+               int matrixCacheSize,
+               bool incremental,
+               bool exponentScaling,
+               bool adaptiveScaling,
+               bool siteRepeats,
+               bool operationGraphs,
+               int shardCount,
+               const std::vector<double>& shardWeights,
+               bool asyncRoot,
+               bool batchTips,
+               bool stateSets,
+               bool evaluate,
+               bool checkpoint,
+               bool multitree,
+               bool calibrate,
+               bool gradient,
+               bool multiedge,
+               bool asynch,
+               bool memoryBudget,
+               bool statistics,
+               int constantSiteCount,
+               long long parallelOpsFlags,
+               FILE* csvFile,
+               FILE* jsonFile)
 {
     
     int edgeCount = ntaxa*2-2;
     int internalCount = ntaxa-1;
     int partialCount = ((ntaxa+internalCount)-compactTipCount)*eigenCount;
+    if (gradient)
+        partialCount += ntaxa+internalCount; // pre-order partials, one per node
     int scaleCount = ((manualScaling || dynamicScaling) ? ntaxa : 0);
 
     int modelCount = eigenCount * partitionCount;
     
     BeagleInstanceDetails instDetails;
     
+    // one resource per block of patterns when sharding, sized by weight if any are given
+    std::vector<int> shardResources(shardCount > 1 ? shardCount : 1, resource);
+
+    long long preferenceFlags = (enableThreads ? BEAGLE_FLAG_THREADING_CPP : 0) |
+                           (enableNuma ? BEAGLE_FLAG_THREADING_NUMA : 0) |
+                           (enableArena ? BEAGLE_FLAG_MEMORY_ARENA : 0) |
+                           (kernelTuning ? BEAGLE_FLAG_KERNEL_TUNING : 0) |
+                           (calibrate ? BEAGLE_FLAG_CALIBRATE : 0) |
+                           (asynch ? BEAGLE_FLAG_COMPUTATION_ASYNCH : 0) |
+                           parallelOpsFlags;
+    long long requirementFlags = // BEAGLE_FLAG_PARALLELOPS_STREAMS |
+                            (gradient ? BEAGLE_FLAG_PREORDER : 0) |
+                            (opencl ? BEAGLE_FLAG_FRAMEWORK_OPENCL : 0) |
+                            (ievectrans ? BEAGLE_FLAG_INVEVEC_TRANSPOSED : BEAGLE_FLAG_INVEVEC_STANDARD) |
+                            (logscalers ? BEAGLE_FLAG_SCALERS_LOG : BEAGLE_FLAG_SCALERS_RAW) |
+                            (eigencomplex ? BEAGLE_FLAG_EIGEN_COMPLEX : BEAGLE_FLAG_EIGEN_REAL) |
+                            (dynamicScaling ? BEAGLE_FLAG_SCALING_DYNAMIC : 0) |
+                            (autoScaling ? BEAGLE_FLAG_SCALING_AUTO : 0) |
+                            (requireDoublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE) |
+                            (requireSSE ? BEAGLE_FLAG_VECTOR_SSE :
+                             (requireAVX ? BEAGLE_FLAG_VECTOR_AVX :
+                             (requireAVX512 ? BEAGLE_FLAG_VECTOR_AVX512 :
+                             (requireNEON ? BEAGLE_FLAG_VECTOR_NEON :
+                              // calibration chooses the vector engine unless one is asked for
+                              (calibrate ? 0 : BEAGLE_FLAG_VECTOR_NONE)))));
+
     // create an instance of the BEAGLE library
-    int instance = beagleCreateInstance(
+    int instance;
+    if (memoryBudget) {
+        size_t footprint;
+        if (beagleGetInstanceMemoryFootprint(ntaxa, partialCount, compactTipCount, stateCount, nsites,
+                                             modelCount,
+                                             ((calcderivs || gradient) ? (3*edgeCount*modelCount) : edgeCount*modelCount),
+                                             rateCategoryCount, scaleCount*eigenCount,
+                                             &shardResources[0], shardResources.size(),
+                                             preferenceFlags, requirementFlags, &footprint) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleGetInstanceMemoryFootprint\n");
+            exit(-1);
+        }
+        fprintf(stdout, "Memory footprint: %lu bytes\n", (unsigned long) footprint);
+
+        // one byte short of the footprint must leave no candidate on the resource
+        int tooSmall = beagleCreateInstanceWithMemoryBudget(ntaxa, partialCount, compactTipCount, stateCount, nsites,
+                                                            modelCount,
+                                                            ((calcderivs || gradient) ? (3*edgeCount*modelCount) : edgeCount*modelCount),
+                                                            rateCategoryCount, scaleCount*eigenCount,
+                                                            &shardResources[0], shardResources.size(),
+                                                            preferenceFlags, requirementFlags, footprint - 1, &instDetails);
+        if (tooSmall >= 0) {
+            reportCheckFailure("instance created over its memory budget");
+            beagleFinalizeInstance(tooSmall);
+        }
+
+        instance = beagleCreateInstanceWithMemoryBudget(ntaxa, partialCount, compactTipCount, stateCount, nsites,
+                                                        modelCount,
+                                                        ((calcderivs || gradient) ? (3*edgeCount*modelCount) : edgeCount*modelCount),
+                                                        rateCategoryCount, scaleCount*eigenCount,
+                                                        &shardResources[0], shardResources.size(),
+                                                        preferenceFlags, requirementFlags, footprint, &instDetails);
+    } else
+        instance = beagleCreateShardedInstanceWithWeights(
                 ntaxa,            /**< Number of tip data elements (input) */
                 partialCount, /**< Number of partials buffers to create (input) */
                 compactTipCount,    /**< Number of compact state representation buffers to create (input) */
                 stateCount,       /**< Number of states in the continuous-time Markov chain (input) */
                 nsites,           /**< Number of site patterns to be handled by the instance (input) */
                 modelCount,               /**< Number of rate matrix eigen-decomposition buffers to allocate (input) */
-                (calcderivs ? (3*edgeCount*modelCount) : edgeCount*modelCount),/**< Number of rate matrix buffers (input) */
+                ((calcderivs || gradient) ? (3*edgeCount*modelCount) : edgeCount*modelCount),/**< Number of rate matrix buffers (input) */
                 rateCategoryCount,/**< Number of rate categories */
                 scaleCount*eigenCount,          /**< scaling buffers */
-                &resource,        /**< List of potential resource on which this instance is allowed (input, NULL implies no restriction */
-                1,                /**< Length of resourceList list (input) */
-                0,         /**< Bit-flags indicating preferred implementation charactertistics, see BeagleFlags (input) */
-                // BEAGLE_FLAG_PARALLELOPS_STREAMS |
-                (opencl ? BEAGLE_FLAG_FRAMEWORK_OPENCL : 0) |
-                (ievectrans ? BEAGLE_FLAG_INVEVEC_TRANSPOSED : BEAGLE_FLAG_INVEVEC_STANDARD) |
-                (logscalers ? BEAGLE_FLAG_SCALERS_LOG : BEAGLE_FLAG_SCALERS_RAW) |
-                (eigencomplex ? BEAGLE_FLAG_EIGEN_COMPLEX : BEAGLE_FLAG_EIGEN_REAL) |
-                (dynamicScaling ? BEAGLE_FLAG_SCALING_DYNAMIC : 0) |
-                (autoScaling ? BEAGLE_FLAG_SCALING_AUTO : 0) |
-                (requireDoublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE) |
-                (requireSSE ? BEAGLE_FLAG_VECTOR_SSE :
-                          (requireAVX ? BEAGLE_FLAG_VECTOR_AVX : BEAGLE_FLAG_VECTOR_NONE)),   /**< Bit-flags indicating required implementation characteristics, see BeagleFlags (input) */
+                &shardResources[0], /**< List of potential resource on which this instance is allowed (input, NULL implies no restriction */
+                shardResources.size(), /**< Length of resourceList list (input) */
+                (shardWeights.empty() ? NULL : &shardWeights[0]), /**< Relative weight of each resource (input) */
+                preferenceFlags,  /**< Bit-flags indicating preferred implementation charactertistics, see BeagleFlags (input) */
+                requirementFlags, /**< Bit-flags indicating required implementation characteristics, see BeagleFlags (input) */
                 &instDetails);
     if (instance < 0) {
         fprintf(stderr, "Failed to obtain BEAGLE instance\n\n");
-        return;
+        return 0.0;
+    }
+    instancesObtained++;
+
+    if (finalizedInstance >= 0) {
+        double unitWeight = 1.0;
+        if (beagleSetCategoryWeights(finalizedInstance, 0, &unitWeight) != BEAGLE_ERROR_UNINITIALIZED_INSTANCE)
+            reportCheckFailure("finalized instance number reached a new instance");
     }
         
     int rNumber = instDetails.resourceNumber;
@@ -443,6 +688,62 @@ void runBeagle(int resource,
     fprintf(stdout, "\tFlags:");
     printFlags(instDetails.flags);
     fprintf(stdout, "\n\n");
+
+    if (threadCount > 0) {
+        if (beagleSetCPUThreadCount(instance, threadCount) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetCPUThreadCount\n");
+            exit(-1);
+        }
+    }
+
+    if (matrixCacheSize > 0) {
+        if (beagleSetTransitionMatrixCacheSize(instance, matrixCacheSize) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetTransitionMatrixCacheSize\n");
+            exit(-1);
+        }
+    }
+
+    if (incremental) {
+        if (beagleSetIncrementalUpdates(instance, 1) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetIncrementalUpdates\n");
+            exit(-1);
+        }
+    }
+
+    if (exponentScaling) {
+        if (beagleSetExponentScaling(instance, 1) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetExponentScaling\n");
+            exit(-1);
+        }
+    }
+
+    if (adaptiveScaling) {
+        if (beagleSetAdaptiveRescaling(instance, 1) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetAdaptiveRescaling\n");
+            exit(-1);
+        }
+    }
+
+    if (siteRepeats) {
+        if (beagleSetSiteRepeats(instance, 1) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetSiteRepeats\n");
+            exit(-1);
+        }
+    }
+
+    if (!partialsDir.empty()) {
+        if (beagleSetPartialsBackingDirectory(instance, partialsDir.c_str()) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetPartialsBackingDirectory\n");
+            exit(-1);
+        }
+    }
+
+    if (operationGraphs) {
+        if (beagleSetOperationGraphs(instance, 1) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleSetOperationGraphs\n");
+            exit(-1);
+        }
+    }
     
 
     if (!(instDetails.flags & BEAGLE_FLAG_SCALING_AUTO))
@@ -450,18 +751,51 @@ void runBeagle(int resource,
     
     // set the sequences for each tip using partial likelihood arrays
     gt_srand(randomSeed);   // fix the random seed...
+    std::vector<int> batchPartialsTips, batchStatesTips;
+    std::vector<double> batchPartials;
+    std::vector<int> batchStates;
+    // the first compact tip, kept to prune again with it as partials
+    int constantCheckTip = -1;
+    std::vector<int> constantCheckStates;
     for(int i=0; i<ntaxa; i++)
     {
         if (compactTipCount == 0 || (i >= (compactTipCount-1) && i != (ntaxa-1))) {
-            double* tmpPartials = getRandomTipPartials(nsites, stateCount);
-            beagleSetTipPartials(instance, i, tmpPartials);
+            double* tmpPartials = getRandomTipPartials(nsites, stateCount, constantSiteCount);
+            if (batchTips) {
+                batchPartialsTips.push_back(i);
+                batchPartials.insert(batchPartials.end(), tmpPartials, tmpPartials + nsites * stateCount);
+            } else {
+                beagleSetTipPartials(instance, i, tmpPartials);
+            }
             free(tmpPartials);
         } else {
-            int* tmpStates = getRandomTipStates(nsites, stateCount);
-            beagleSetTipStates(instance, i, tmpStates);
+            int* tmpStates = getRandomTipStates(nsites, stateCount, constantSiteCount);
+            if (constantCheckTip < 0) {
+                constantCheckTip = i;
+                constantCheckStates.assign(tmpStates, tmpStates + nsites);
+            }
+            if (stateSets) {
+                setTipStateSets(instance, i, tmpStates, nsites, stateCount);
+            } else if (batchTips) {
+                batchStatesTips.push_back(i);
+                batchStates.insert(batchStates.end(), tmpStates, tmpStates + nsites);
+            } else {
+                beagleSetTipStates(instance, i, tmpStates);
+            }
             free(tmpStates);                
         }
     }
+    if (batchTips) {
+        if ((!batchPartialsTips.empty() &&
+             beagleSetTipPartialsBatch(instance, &batchPartialsTips[0], &batchPartials[0],
+                                       (int) batchPartialsTips.size()) != BEAGLE_SUCCESS) ||
+            (!batchStatesTips.empty() &&
+             beagleSetTipStatesBatch(instance, &batchStatesTips[0], &batchStates[0],
+                                     (int) batchStatesTips.size()) != BEAGLE_SUCCESS)) {
+            printf("ERROR: No BEAGLE implementation for batched tip uploads\n");
+            exit(-1);
+        }
+    }
 
 #ifdef _WIN32
     std::vector<double> rates(rateCategoryCount);
@@ -790,6 +1124,10 @@ void runBeagle(int resource,
             beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[eigenIndex]);
     }
 
+    // the fused call covers a single rooted, unpartitioned evaluation
+    bool fusedEvaluate = (evaluate && partitionCount == 1 && eigenCount == 1 && !unrooted &&
+                          !setmatrix && !calcderivs && !autoScaling);
+
     // start timing!
     struct timeval time0, time1, time2, time3, time4, time5;
     double bestTimeSetPartitions, bestTimeUpdateTransitionMatrices, bestTimeUpdatePartials, bestTimeAccumulateScaleFactors, bestTimeCalculateRootLogLikelihoods, bestTimeTotal;
@@ -951,12 +1289,17 @@ void runBeagle(int resource,
             for(int ii=0; ii<ntaxa; ii++)
             {
                 if (compactTipCount == 0 || (ii >= (compactTipCount-1) && ii != (ntaxa-1))) {
-                    double* tmpPartials = getRandomTipPartials(nsites, stateCount);
+                    double* tmpPartials = getRandomTipPartials(nsites, stateCount, constantSiteCount);
                     beagleSetTipPartials(instance, ii, tmpPartials);
                     free(tmpPartials);
                 } else {
-                    int* tmpStates = getRandomTipStates(nsites, stateCount);
-                    beagleSetTipStates(instance, ii, tmpStates);
+                    int* tmpStates = getRandomTipStates(nsites, stateCount, constantSiteCount);
+                    if (ii == constantCheckTip)
+                        constantCheckStates.assign(tmpStates, tmpStates + nsites);
+                    if (stateSets)
+                        setTipStateSets(instance, ii, tmpStates, nsites, stateCount);
+                    else
+                        beagleSetTipStates(instance, ii, tmpStates);
                     free(tmpStates);                
                 }
             }
@@ -992,7 +1335,7 @@ void runBeagle(int resource,
                                            (calcderivs ? edgeIndicesD2 : NULL), // secondDerivativeIndices
                                            edgeLengths,   // edgeLengths
                                            totalEdgeCount);            // count
-        } else {
+        } else if (!fusedEvaluate) {
             for (int eigenIndex=0; eigenIndex < modelCount; eigenIndex++) {
                 if (!setmatrix) {
                     // tell BEAGLE to populate the transition matrices for the above edge lengths
@@ -1043,11 +1386,14 @@ void runBeagle(int resource,
                 beagleUpdatePartialsByPartition( instance,                   // instance
                                 (BeagleOperationByPartition*)operations,     // operations
                                 internalCount*eigenCount*partitionCount);    // operationCount
-            } else {
+            } else if (!fusedEvaluate) {
                 beagleUpdatePartials( instance,      // instance
                                 (BeagleOperation*)operations,     // operations
                                 internalCount*eigenCount,              // operationCount
                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));             // cumulative scaling index
+                // asynchronous instances return at once; wait for the roots only
+                if (asynch && beagleWaitForPartials(instance, rootIndices, eigenCount) != BEAGLE_SUCCESS)
+                    reportCheckFailure("queued partials update failed");
             }
 
             gettimeofday(&time3, NULL);
@@ -1067,7 +1413,7 @@ void runBeagle(int resource,
         int scalingFactorsCount = internalCount;
                 
         for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
-            if (manualScaling && !(i % rescaleFrequency)) {
+            if (manualScaling && !(i % rescaleFrequency) && !fusedEvaluate) {
                 beagleResetScaleFactors(instance,
                                         cumulativeScalingFactorIndices[eigenIndex]);
                 
@@ -1083,9 +1429,10 @@ void runBeagle(int resource,
         gettimeofday(&time4, NULL);
 
         // calculate the site likelihoods at the root node
+        int likelihoodCode = BEAGLE_SUCCESS;
         if (!unrooted) {
             if (partitionCount > 1) {
-                beagleCalculateRootLogLikelihoodsByPartition(
+                likelihoodCode = beagleCalculateRootLogLikelihoodsByPartition(
                                             instance,               // instance
                                             rootIndices,// bufferIndices
                                             categoryWeightsIndices,                // weights
@@ -1096,8 +1443,44 @@ void runBeagle(int resource,
                                             eigenCount,                      // count
                                             partitionLogLs,
                                             &logL);         // outLogLikelihoods
+            } else if (fusedEvaluate) {
+                // matrices, pruning and scale factors all happen inside this one call
+                likelihoodCode = beagleEvaluateTree(instance,
+                                   0,
+                                   edgeIndices,
+                                   edgeLengths,
+                                   edgeCount,
+                                   (BeagleOperation*)operations,
+                                   internalCount,
+                                   scalingFactorsIndices,
+                                   ((manualScaling && !(i % rescaleFrequency)) ? scalingFactorsCount : 0),
+                                   cumulativeScalingFactorIndices[0],
+                                   rootIndices[0],
+                                   categoryWeightsIndices[0],
+                                   stateFrequencyIndices[0],
+                                   &logL);
+            } else if (asyncRoot) {
+                int resultIndex = 0;
+                likelihoodCode = beagleCalculateRootLogLikelihoodsAsync(instance,
+                                            rootIndices,
+                                            categoryWeightsIndices,
+                                            stateFrequencyIndices,
+                                            cumulativeScalingFactorIndices,
+                                            eigenCount,
+                                            resultIndex);
+                if (likelihoodCode == BEAGLE_SUCCESS)
+                    likelihoodCode = beagleGetLogLikelihoodResults(instance, &resultIndex, 1, &logL);
+
+                // the last slot is never written and the one past it does not exist
+                int unwrittenIndex = BEAGLE_RESULT_SLOT_COUNT - 1;
+                double unwrittenLogL;
+                if (beagleGetLogLikelihoodResults(instance, &unwrittenIndex, 1, &unwrittenLogL) != BEAGLE_ERROR_OUT_OF_RANGE ||
+                    beagleCalculateRootLogLikelihoodsAsync(instance, rootIndices, categoryWeightsIndices,
+                                                           stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                           eigenCount, BEAGLE_RESULT_SLOT_COUNT) != BEAGLE_ERROR_OUT_OF_RANGE)
+                    reportCheckFailure("result slot outside the written slots was accepted");
             } else {
-                beagleCalculateRootLogLikelihoods(instance,               // instance
+                likelihoodCode = beagleCalculateRootLogLikelihoods(instance,               // instance
                                             rootIndices,// bufferIndices
                                             categoryWeightsIndices,                // weights
                                             stateFrequencyIndices,                 // stateFrequencies
@@ -1107,7 +1490,7 @@ void runBeagle(int resource,
             }
         } else {
             if (partitionCount > 1) {
-                beagleCalculateEdgeLogLikelihoodsByPartition(
+                likelihoodCode = beagleCalculateEdgeLogLikelihoodsByPartition(
                                                   instance,
                                                   rootIndices,
                                                   lastTipIndices,
@@ -1127,7 +1510,7 @@ void runBeagle(int resource,
                                                   (calcderivs ? partitionD2 : NULL),
                                                   (calcderivs ? &deriv2 : NULL));
             } else {            
-                beagleCalculateEdgeLogLikelihoods(instance,               // instance
+                likelihoodCode = beagleCalculateEdgeLogLikelihoods(instance,               // instance
                                                   rootIndices,// bufferIndices
                                                   lastTipIndices,
                                                   lastTipIndices,
@@ -1143,6 +1526,9 @@ void runBeagle(int resource,
             }
 
         }
+        if (likelihoodCode != BEAGLE_SUCCESS)
+            reportCheckFailure("likelihood calculation failed");
+
         // end timing!
         gettimeofday(&time5,NULL);
         
@@ -1172,19 +1558,276 @@ void runBeagle(int resource,
         }
         
         if (!(logL - logL == 0.0))
-            fprintf(stdout, "error: invalid lnL\n");
+            reportCheckFailure("invalid lnL");
+
+        if (checkpoint && partitionCount == 1 && eigenCount == 1 && !unrooted && !setmatrix) {
+            // prune a rejected proposal with every edge twice as long, then return to this state
+            beagleSaveState(instance);
+
+            double* proposalLengths = new double[edgeCount];
+            for (int j = 0; j < edgeCount; j++)
+                proposalLengths[j] = 2.0 * edgeLengths[j];
+            beagleUpdateTransitionMatrices(instance, 0, edgeIndices, NULL, NULL, proposalLengths, edgeCount);
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount,
+                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+            if (manualScaling && !(i % rescaleFrequency)) {
+                beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                             cumulativeScalingFactorIndices[0]);
+            }
+            delete[] proposalLengths;
+
+            if (beagleRestoreState(instance) != BEAGLE_SUCCESS) {
+                printf("ERROR: No BEAGLE implementation for beagleRestoreState\n");
+                exit(-1);
+            }
+
+            if (autoScaling)
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount, BEAGLE_OP_NONE);
+            double restoredLogL = 0.0;
+            beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                              stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                              1, &restoredLogL);
+            if (std::abs(restoredLogL - logL) > MAX_DIFF)
+                reportCheckFailure("restored lnL differs");
+
+            // transition matrices are not part of the checkpoint
+            beagleUpdateTransitionMatrices(instance, 0, edgeIndices, NULL, NULL, edgeLengths, edgeCount);
+        }
+
+        if (constantSiteCount > 0 && constantCheckTip >= 0 && !stateSets && partitionCount == 1 &&
+            eigenCount == 1 && !unrooted && !fusedEvaluate && !asyncRoot && !autoScaling) {
+            // a tip held as partials keeps constant patterns from being copied, so pruning
+            // again that way must give the root partials computed with the copies; the lnL
+            // alone would miss a copy from another state under a symmetric model
+            const size_t rootPartialsSize = (size_t) nsites * stateCount * rateCategoryCount;
+            std::vector<double> copiedPartials(rootPartialsSize), uncopiedPartials(rootPartialsSize);
+            beagleGetPartials(instance, rootIndices[0], BEAGLE_OP_NONE, &copiedPartials[0]);
+
+            std::vector<double> tipPartials((size_t) nsites * stateCount, 0.0);
+            for (int j = 0; j < nsites; j++)
+                tipPartials[(size_t) j * stateCount + constantCheckStates[j]] = 1.0;
+            beagleSetTipPartials(instance, constantCheckTip, &tipPartials[0]);
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount,
+                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+            if (manualScaling && !(i % rescaleFrequency)) {
+                beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                             cumulativeScalingFactorIndices[0]);
+            }
+            double uncopiedLogL = 0.0;
+            beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                              stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                              1, &uncopiedLogL);
+            beagleGetPartials(instance, rootIndices[0], BEAGLE_OP_NONE, &uncopiedPartials[0]);
+            bool partialsDiffer = false;
+            for (size_t j = 0; j < rootPartialsSize; j++) {
+                if (std::abs(uncopiedPartials[j] - copiedPartials[j]) > 1E-5 * std::abs(uncopiedPartials[j]))
+                    partialsDiffer = true;
+            }
+            if (std::abs(uncopiedLogL - logL) > MAX_DIFF || partialsDiffer)
+                reportCheckFailure("lnL or root partials with constant patterns copied differ");
+
+            // back to compact states, with the partials pruned from them again
+            beagleSetTipStates(instance, constantCheckTip, &constantCheckStates[0]);
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount,
+                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+        }
+
+        if (multitree && partitionCount == 1 && eigenCount == 1 && !unrooted && !setmatrix) {
+            // prune again through the multi-tree entry point and read the root back as two trees
+            int dynamicCumulativeIndex = internalCount;
+            if (beagleUpdatePartialsForTrees(instance, (BeagleOperation*)operations, &internalCount, 1,
+                                             (dynamicScaling ? &dynamicCumulativeIndex : NULL)) != BEAGLE_SUCCESS) {
+                printf("ERROR: No BEAGLE implementation for beagleUpdatePartialsForTrees\n");
+                exit(-1);
+            }
+            if (autoScaling)
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount, BEAGLE_OP_NONE);
+
+            int treeRootIndices[2] = {rootIndices[0], rootIndices[0]};
+            int treeWeightsIndices[2] = {categoryWeightsIndices[0], categoryWeightsIndices[0]};
+            int treeFrequencyIndices[2] = {stateFrequencyIndices[0], stateFrequencyIndices[0]};
+            int treeScalingIndices[2] = {cumulativeScalingFactorIndices[0], cumulativeScalingFactorIndices[0]};
+            double treeLogL[2] = {0.0, 0.0};
+            beagleCalculateRootLogLikelihoodsForTrees(instance, treeRootIndices, treeWeightsIndices,
+                                                      treeFrequencyIndices, treeScalingIndices, 2, treeLogL);
+            if (std::abs(treeLogL[0] - logL) > MAX_DIFF || std::abs(treeLogL[1] - logL) > MAX_DIFF)
+                reportCheckFailure("multi-tree lnL differs");
+        }
+
+        if (asynch && partitionCount == 1 && eigenCount == 1 && !unrooted && !setmatrix && edgeCount >= 3) {
+            // queue the pruning again, then convolve the matrices of two edges into that of a third,
+            // as for a branch crossing an epoch boundary; the queued operations must still read the
+            // third edge's own matrix
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount,
+                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+            if (beagleConvolveTransitionMatrices(instance, &edgeIndices[0], &edgeIndices[1],
+                                                 &edgeIndices[2], 1) != BEAGLE_SUCCESS) {
+                printf("ERROR: No BEAGLE implementation for beagleConvolveTransitionMatrices\n");
+                exit(-1);
+            }
+            if (manualScaling && !(i % rescaleFrequency)) {
+                beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                             cumulativeScalingFactorIndices[0]);
+            } else if (autoScaling) {
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount, BEAGLE_OP_NONE);
+            }
+            double queuedLogL = 0.0;
+            beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                              stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                              1, &queuedLogL);
+            if (std::abs(queuedLogL - logL) > MAX_DIFF)
+                reportCheckFailure("queued partials update read a matrix convolved after it");
+
+            // the product of the two edges' matrices is the matrix of their summed length
+            int epochMatrixSize = stateCount * stateCount * rateCategoryCount;
+            double* convolvedMatrix = new double[epochMatrixSize];
+            double* epochMatrix = new double[epochMatrixSize];
+            double epochLength = edgeLengths[0] + edgeLengths[1];
+            beagleGetTransitionMatrix(instance, edgeIndices[2], convolvedMatrix);
+            beagleUpdateTransitionMatrices(instance, 0, &edgeIndices[2], NULL, NULL, &epochLength, 1);
+            beagleGetTransitionMatrix(instance, edgeIndices[2], epochMatrix);
+            for (int j = 0; j < epochMatrixSize; j++) {
+                if (std::abs(convolvedMatrix[j] - epochMatrix[j]) > (requireDoublePrecision ? 1E-10 : 1E-5)) {
+                    reportCheckFailure("convolved epoch matrix differs");
+                    break;
+                }
+            }
+            delete[] convolvedMatrix;
+            delete[] epochMatrix;
+
+            beagleUpdateTransitionMatrices(instance, 0, &edgeIndices[2], NULL, NULL, &edgeLengths[2], 1);
+        }
+
+        if (gradient && partitionCount == 1 && eigenCount == 1 && !unrooted && !setmatrix &&
+            !autoScaling && !dynamicScaling) {
+            // every branch at once from one pre-order traversal, checked against central differences
+            int nodeCount = ntaxa + internalCount;
+            int rootPreIndex = nodeCount + rootIndices[0];
+            int* preOperations = new int[BEAGLE_OP_COUNT*edgeCount];
+            int* postIndices = new int[edgeCount];
+            int* preIndices = new int[edgeCount];
+            int* derivIndices = new int[edgeCount];
+            int* weightsIndices = new int[edgeCount];
+            double* gradientValues = new double[edgeCount];
+
+            beagleUpdateTransitionMatrices(instance, 0, edgeIndices, edgeIndicesD1, NULL, edgeLengths, edgeCount);
+            beagleSetRootPrePartials(instance, &rootPreIndex, stateFrequencyIndices, 1);
+
+            // post-order run backwards visits every parent before its children
+            int edge = 0;
+            for (int j = internalCount - 1; j >= 0; j--) {
+                int parentIndex = operations[j*beagleOpCount+0];
+                for (int c = 0; c < 2; c++) {
+                    int childIndex = operations[j*beagleOpCount+3+2*c];
+                    int siblingIndex = operations[j*beagleOpCount+5-2*c];
+                    int* preOp = &preOperations[edge*BEAGLE_OP_COUNT];
+                    preOp[0] = nodeCount + childIndex;
+                    preOp[1] = BEAGLE_OP_NONE;
+                    preOp[2] = BEAGLE_OP_NONE;
+                    preOp[3] = nodeCount + parentIndex;
+                    preOp[4] = (parentIndex == rootIndices[0] ? BEAGLE_OP_NONE : parentIndex);
+                    preOp[5] = siblingIndex;
+                    preOp[6] = siblingIndex;
+                    postIndices[edge] = childIndex;
+                    preIndices[edge] = nodeCount + childIndex;
+                    derivIndices[edge] = edgeIndicesD1[childIndex];
+                    weightsIndices[edge] = categoryWeightsIndices[0];
+                    edge++;
+                }
+            }
+
+            if (beagleUpdatePrePartials(instance, (BeagleOperation*)preOperations, edgeCount) != BEAGLE_SUCCESS ||
+                beagleCalculateEdgeDerivatives(instance, postIndices, preIndices, postIndices, derivIndices,
+                                               weightsIndices, edgeCount, NULL, gradientValues) != BEAGLE_SUCCESS) {
+                printf("ERROR: No BEAGLE implementation for pre-order gradients\n");
+                exit(-1);
+            }
+
+            double h = (requireDoublePrecision ? 1E-5 : 1E-3);
+            double tolerance = (requireDoublePrecision ? 1E-4 : 1E-1);
+            for (int e = 0; e < edgeCount; e++) {
+                int childIndex = postIndices[e];
+                double shiftedLogL[2];
+                for (int side = 0; side < 2; side++) {
+                    double shiftedLength = edgeLengths[childIndex] + (side == 0 ? h : -h);
+                    beagleUpdateTransitionMatrices(instance, 0, &edgeIndices[childIndex], NULL, NULL,
+                                                   &shiftedLength, 1);
+                    beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount, BEAGLE_OP_NONE);
+                    if (manualScaling && !(i % rescaleFrequency)) {
+                        beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+                        beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                                     cumulativeScalingFactorIndices[0]);
+                    }
+                    beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                                      stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                      1, &shiftedLogL[side]);
+                }
+                beagleUpdateTransitionMatrices(instance, 0, &edgeIndices[childIndex], NULL, NULL,
+                                               &edgeLengths[childIndex], 1);
+                double difference = (shiftedLogL[0] - shiftedLogL[1]) / (2.0 * h);
+                if (!(std::abs(gradientValues[e] - difference) <= tolerance * std::max(1.0, std::abs(difference))))
+                    reportCheckFailure("branch gradient differs");
+            }
+
+            // leave the partials of the unshifted tree behind
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount, BEAGLE_OP_NONE);
+            if (manualScaling && !(i % rescaleFrequency)) {
+                beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+                beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                             cumulativeScalingFactorIndices[0]);
+            }
+
+            delete[] preOperations;
+            delete[] postIndices;
+            delete[] preIndices;
+            delete[] derivIndices;
+            delete[] weightsIndices;
+            delete[] gradientValues;
+        }
+
+        if (multiedge && unrooted && calcderivs && partitionCount == 1 && eigenCount == 1) {
+            // the same edge three times in one batch, each should match the single-edge result
+            const int batchCount = 3;
+            int batchRoot[batchCount], batchTip[batchCount], batchD1[batchCount], batchD2[batchCount];
+            int batchWeights[batchCount], batchFrequencies[batchCount], batchScaling[batchCount];
+            double batchLogL[batchCount], batchDeriv1[batchCount], batchDeriv2[batchCount];
+            for (int b = 0; b < batchCount; b++) {
+                batchRoot[b] = rootIndices[0];
+                batchTip[b] = lastTipIndices[0];
+                batchD1[b] = lastTipIndicesD1[0];
+                batchD2[b] = lastTipIndicesD2[0];
+                batchWeights[b] = categoryWeightsIndices[0];
+                batchFrequencies[b] = stateFrequencyIndices[0];
+                batchScaling[b] = cumulativeScalingFactorIndices[0];
+            }
+            if (beagleCalculateMultiEdgeLogLikelihoods(instance, batchRoot, batchTip, batchTip, batchD1, batchD2,
+                                                       batchWeights, batchFrequencies, batchScaling, batchCount,
+                                                       batchLogL, batchDeriv1, batchDeriv2) != BEAGLE_SUCCESS) {
+                printf("ERROR: No BEAGLE implementation for beagleCalculateMultiEdgeLogLikelihoods\n");
+                exit(-1);
+            }
+            for (int b = 0; b < batchCount; b++) {
+                if (std::abs(batchLogL[b] - logL) > MAX_DIFF ||
+                    std::abs(batchDeriv1[b] - deriv1) > MAX_DIFF ||
+                    std::abs(batchDeriv2[b] - deriv2) > MAX_DIFF)
+                    reportCheckFailure("multi-edge lnL or derivatives differ");
+            }
+        }
 
         if (!newDataPerRep) {        
             if (i > 0 && std::abs(logL - previousLogL) > MAX_DIFF)
-                fprintf(stdout, "error: large lnL difference between reps\n");
+                reportCheckFailure("large lnL difference between reps");
         }
         
         if (calcderivs) {
             if (!(deriv1 - deriv1 == 0.0) || !(deriv2 - deriv2 == 0.0))
-                fprintf(stdout, "error: invalid deriv\n");
+                reportCheckFailure("invalid deriv");
             
             if (i > 0 && ((std::abs(deriv1 - previousDeriv1) > MAX_DIFF) || (std::abs(deriv2 - previousDeriv2) > MAX_DIFF)) )
-                fprintf(stdout, "error: large deriv difference between reps\n");
+                reportCheckFailure("large deriv difference between reps");
         }
 
         previousLogL = logL;
@@ -1280,6 +1923,18 @@ void runBeagle(int resource,
     int timePrecision = 6;
     int speedupPrecision = 2;
     int percentPrecision = 2;
+    unsigned int partialsOps = internalCount * eigenCount;
+    unsigned int flopsPerPartial = (stateCount * 4) - 2 + 1;
+    unsigned int bytesPerPartial = 3 * (requireDoublePrecision ? 8 : 4);
+    if (manualScaling) {
+        flopsPerPartial++;
+        bytesPerPartial += (requireDoublePrecision ? 8 : 4);
+    }
+    unsigned int matrixBytes = partialsOps * 2 * stateCount*stateCount*rateCategoryCount * (requireDoublePrecision ? 8 : 4);
+    unsigned long long partialsSize = stateCount * nsites * rateCategoryCount;
+    unsigned long long partialsTotal = partialsSize * partialsOps;
+    unsigned long long flopsTotal = partialsTotal * flopsPerPartial;
+
     std::cout << "best run: ";
     printTiming(bestTimeTotal, timePrecision, resource, cpuTimeTotal, speedupPrecision, 0, 0, 0);
     if (fullTiming) {
@@ -1289,17 +1944,6 @@ void runBeagle(int resource,
         printTiming(bestTimeUpdateTransitionMatrices, timePrecision, resource, cpuTimeUpdateTransitionMatrices, speedupPrecision, 1, bestTimeTotal, percentPrecision);
         std::cout << " partials:   ";
         printTiming(bestTimeUpdatePartials, timePrecision, resource, cpuTimeUpdatePartials, speedupPrecision, 1, bestTimeTotal, percentPrecision);
-        unsigned int partialsOps = internalCount * eigenCount;
-        unsigned int flopsPerPartial = (stateCount * 4) - 2 + 1;
-        unsigned int bytesPerPartial = 3 * (requireDoublePrecision ? 8 : 4);
-        if (manualScaling) {
-            flopsPerPartial++;
-            bytesPerPartial += (requireDoublePrecision ? 8 : 4);
-        }
-        unsigned int matrixBytes = partialsOps * 2 * stateCount*stateCount*rateCategoryCount * (requireDoublePrecision ? 8 : 4);
-        unsigned long long partialsSize = stateCount * nsites * rateCategoryCount;
-        unsigned long long partialsTotal = partialsSize * partialsOps;
-        unsigned long long flopsTotal = partialsTotal * flopsPerPartial;
         std::cout << " partials throughput:   " << (partialsTotal/bestTimeUpdatePartials)/1000000.0 << " M partials/second " << std::endl;
         std::cout << " compute throughput:   " << (flopsTotal/bestTimeUpdatePartials)/1000000000.0 << " GFLOPS " << std::endl;
         std::cout << " memory bandwidth:   " << (((partialsTotal * bytesPerPartial + matrixBytes)/bestTimeUpdatePartials))/1000000000.0 << " GB/s " << std::endl;
@@ -1313,9 +1957,81 @@ void runBeagle(int resource,
         std::cout << " tree throughput total:   " << (partialsTotal/bestTimeTotal)/1000000.0 << " M partials/second " << std::endl;
 
     }
+
+    if (statistics) {
+        BeagleCallStatistics callStatistics[BEAGLE_STATISTIC_COUNT];
+        if (beagleGetInstanceStatistics(instance, callStatistics) != BEAGLE_SUCCESS) {
+            printf("ERROR: No BEAGLE implementation for beagleGetInstanceStatistics\n");
+            exit(-1);
+        }
+        const char* classNames[BEAGLE_STATISTIC_COUNT] = {"partials", "matrices", "scaling",
+                                                          "root", "edge", "transfer"};
+        std::cout << " statistics:\n";
+        for (int i = 0; i < BEAGLE_STATISTIC_COUNT; i++) {
+            std::cout << "  " << classNames[i] << ": " << callStatistics[i].callCount << " calls, "
+                      << std::setprecision(timePrecision) << callStatistics[i].seconds << " s, "
+                      << std::setprecision(3) << callStatistics[i].flops / 1000000000.0 << " GFLOP, "
+                      << callStatistics[i].bytes / 1000000000.0 << " GB" << std::endl;
+        }
+        if (callStatistics[BEAGLE_STATISTIC_PARTIALS].callCount == 0 ||
+            callStatistics[BEAGLE_STATISTIC_MATRICES].callCount == 0 ||
+            callStatistics[BEAGLE_STATISTIC_ROOT].callCount + callStatistics[BEAGLE_STATISTIC_EDGE].callCount == 0)
+            reportCheckFailure("statistics are missing calls");
+
+        BeagleScalingStatistics scalingStatistics;
+        if (beagleGetScalingStatistics(instance, &scalingStatistics) == BEAGLE_SUCCESS &&
+            scalingStatistics.passCount > 0) {
+            std::cout << "  rescaling: " << scalingStatistics.passCount << " passes ("
+                      << scalingStatistics.unchangedPassCount << " unchanged), "
+                      << scalingStatistics.rescaledPatternCount << " of " << scalingStatistics.patternCount
+                      << " patterns rescaled, " << scalingStatistics.nearUnderflowPatternCount
+                      << " near underflow";
+            if (scalingStatistics.patternCount > 0 && scalingStatistics.minExponent <= scalingStatistics.maxExponent)
+                std::cout << ", exponents " << scalingStatistics.minExponent << " to " << scalingStatistics.maxExponent
+                          << " (mean " << std::setprecision(3)
+                          << scalingStatistics.exponentSum / scalingStatistics.patternCount << ")";
+            std::cout << std::endl;
+        }
+    }
+
+    if (csvFile != NULL || jsonFile != NULL) {
+        // the root phase includes the edge derivatives when they are computed
+        std::vector<resultField> fields;
+        addResultField(fields, "states", "%d", stateCount);
+        addResultField(fields, "taxa", "%d", ntaxa);
+        addResultField(fields, "sites", "%d", nsites);
+        addResultField(fields, "rates", "%d", rateCategoryCount);
+        addResultField(fields, "reps", "%d", nreps);
+        addResultField(fields, "partitions", "%d", partitionCount);
+        addResultField(fields, "threads", "%d", threadCount);
+        addResultField(fields, "parallelops", "%s", getParallelOpsName(parallelOpsFlags));
+        addResultField(fields, "eigencount", "%d", eigenCount);
+        addResultField(fields, "precision", "%s", (instDetails.flags & BEAGLE_FLAG_PRECISION_DOUBLE ? "double" : "single"));
+        addResultField(fields, "rescaling", "%s", (manualScaling ? "manual" : (autoScaling ? "auto" : (dynamicScaling ? "dynamic" : "none"))));
+        addResultField(fields, "derivs", "%s", (calcderivs ? "yes" : "no"));
+        addResultField(fields, "rsrc", "%d", rNumber);
+        addResultField(fields, "rsrc_name", "%s", instDetails.resourceName);
+        addResultField(fields, "impl_name", "%s", instDetails.implName);
+        addResultField(fields, "lnl", "%.5f", logL);
+        addResultField(fields, "d1", "%.5f", (calcderivs ? deriv1 : 0.0));
+        addResultField(fields, "d2", "%.5f", (calcderivs ? deriv2 : 0.0));
+        addResultField(fields, "time_total", "%.6f", bestTimeTotal);
+        addResultField(fields, "time_partitions", "%.6f", bestTimeSetPartitions);
+        addResultField(fields, "time_matrices", "%.6f", bestTimeUpdateTransitionMatrices);
+        addResultField(fields, "time_partials", "%.6f", bestTimeUpdatePartials);
+        addResultField(fields, "time_scaling", "%.6f", bestTimeAccumulateScaleFactors);
+        addResultField(fields, "time_root", "%.6f", bestTimeCalculateRootLogLikelihoods);
+        addResultField(fields, "partials_per_second", "%.1f", partialsTotal/bestTimeUpdatePartials);
+        addResultField(fields, "gflops", "%.3f", (flopsTotal/bestTimeUpdatePartials)/1000000000.0);
+        addResultField(fields, "gbs", "%.3f", ((partialsTotal * bytesPerPartial + matrixBytes)/bestTimeUpdatePartials)/1000000000.0);
+        writeResults(csvFile, jsonFile, fields);
+    }
     std::cout << "\n";
     
     beagleFinalizeInstance(instance);
+    finalizedInstance = instance;
+
+    return bestTimeTotal;
 }
 
 void printResourceList() {
@@ -1340,27 +2056,48 @@ void printResourceList() {
 
 void helpMessage() {
     std::cerr << "Usage:\n\n";
-    std::cerr << "synthetictest [--help] [--resourcelist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--SSE] [--AVX] [--compact-tips <integer>] [--seed <integer>] [--rescale-frequency <integer>] [--full-timing] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl] [--partitions <integer>] [--sitelikes] [--newdata] [--randomtree] [--reroot] [--stdrand] [--pectinate]\n\n";
+    std::cerr << "synthetictest [--help] [--resourcelist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--SSE] [--AVX] [--AVX512] [--NEON] [--compact-tips <integer>] [--constant-sites <integer>] [--seed <integer>] [--rescale-frequency <integer>] [--full-timing] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl] [--partitions <list>] [--sitelikes] [--newdata] [--randomtree] [--reroot] [--stdrand] [--pectinate] [--enablethreads] [--numa] [--arena] [--partialsdir <directory>] [--kerneltuning] [--threadcount <list>] [--matrixcache <integer>] [--incremental] [--exponentscaling] [--adaptivescale] [--siterepeats] [--graphs] [--shards <integer>] [--shardweights <list>] [--asyncroot] [--batchtips] [--statesets] [--evaluate] [--checkpoint] [--multitree] [--calibrate] [--gradient] [--multiedge] [--asynch] [--memorybudget] [--statistics] [--csv <file>] [--json <file>] [--parallelops <list>] [--scaling]\n\n";
     std::cerr << "If --help is specified, this usage message is shown\n\n";
     std::cerr << "If --manualscale, --autoscale, or --dynamicscale is specified, BEAGLE will rescale the partials during computation\n\n";
     std::cerr << "If --full-timing is specified, you will see more detailed timing results (requires BEAGLE_DEBUG_SYNCH defined to report accurate values)\n\n";
+    std::cerr << "--states, --taxa, --sites, --rates and --rsrc take comma separated lists; every combination is run in one process\n\n";
+    std::cerr << "If --csv or --json is specified, each run is appended to the file as a CSV row or a line of JSON\n\n";
+    std::cerr << "--threadcount, --partitions and --parallelops (none, streams or grid) take comma separated lists; each\n";
+    std::cerr << "problem is run on each resource with every combination, and --scaling reports the speedup and parallel\n";
+    std::cerr << "efficiency of every combination over the first\n\n";
     std::exit(0);
 }
 
+void readIntegerList(const std::string& option,
+                     std::vector<int>* values) {
+    values->clear();
+    std::stringstream ss(option);
+    int j;
+    while (ss >> j) {
+        values->push_back(j);
+        if (ss.peek() == ',')
+            ss.ignore();
+    }
+    if (values->empty())
+        values->push_back(0);
+}
+
 void interpretCommandLineParameters(int argc, const char* argv[],
-                                    int* stateCount,
-                                    int* ntaxa,
-                                    int* nsites,
+                                    std::vector<int>* stateCount,
+                                    std::vector<int>* ntaxa,
+                                    std::vector<int>* nsites,
                                     bool* manualScaling,
                                     bool* autoScaling,
                                     bool* dynamicScaling,
-                                    int* rateCategoryCount,
+                                    std::vector<int>* rateCategoryCount,
                                     std::vector<int>* rsrc,
                                     int* nreps,
                                     bool* fullTiming,
                                     bool* requireDoublePrecision,
                                     bool* requireSSE,
                                     bool* requireAVX,
+                                    bool* requireAVX512,
+                                    bool* requireNEON,
                                     int* compactTipCount,
                                     int* randomSeed,
                                     int* rescaleFrequency,
@@ -1372,12 +2109,43 @@ void interpretCommandLineParameters(int argc, const char* argv[],
                                     bool* ievectrans,
                                     bool* setmatrix,
                                     bool* opencl,
-                                    int*  partitions,
+                                    std::vector<int>* partitions,
                                     bool* sitelikes,
                                     bool* newDataPerRep,
                                     bool* randomTree,
                                     bool* rerootTrees,
-                                    bool* pectinate)    {
+                                    bool* pectinate,
+                                    bool* enableThreads,
+                                    bool* enableNuma,
+                                    bool* enableArena,
+                                    bool* kernelTuning,
+                                    std::string* partialsDir,
+                                    std::vector<int>* threadCount,
+                                    int* matrixCacheSize,
+                                    bool* incremental,
+                                    bool* exponentScaling,
+                                    bool* adaptiveScaling,
+                                    bool* siteRepeats,
+                                    bool* operationGraphs,
+                                    int* shardCount,
+                                    std::vector<double>* shardWeights,
+                                    bool* asyncRoot,
+                                    bool* batchTips,
+                                    bool* stateSets,
+                                    bool* evaluate,
+                                    bool* checkpoint,
+                                    bool* multitree,
+                                    bool* calibrate,
+                                    bool* gradient,
+                                    bool* multiedge,
+                                    bool* asynch,
+                                    bool* memoryBudget,
+                                    bool* statistics,
+                                    int* constantSiteCount,
+                                    std::vector<long>* parallelOps,
+                                    bool* scaling,
+                                    std::string* csvPath,
+                                    std::string* jsonPath)    {
     bool expecting_stateCount = false;
     bool expecting_ntaxa = false;
     bool expecting_nsites = false;
@@ -1385,26 +2153,44 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     bool expecting_nreps = false;
     bool expecting_rsrc = false;
     bool expecting_compactTipCount = false;
+    bool expecting_constantSiteCount = false;
     bool expecting_seed = false;
     bool expecting_rescaleFrequency = false;
     bool expecting_eigenCount = false;
     bool expecting_partitions = false;
+    bool expecting_threadCount = false;
+    bool expecting_matrixCacheSize = false;
+    bool expecting_shardCount = false;
+    bool expecting_shardWeights = false;
+    bool expecting_csvPath = false;
+    bool expecting_jsonPath = false;
+    bool expecting_partialsDir = false;
+    bool expecting_parallelOps = false;
     
     for (unsigned i = 1; i < argc; ++i) {
         std::string option = argv[i];
         
         if (expecting_stateCount) {
-            *stateCount = (unsigned)atoi(option.c_str());
+            readIntegerList(option, stateCount);
             expecting_stateCount = false;
         } else if (expecting_ntaxa) {
-            *ntaxa = (unsigned)atoi(option.c_str());
+            readIntegerList(option, ntaxa);
             expecting_ntaxa = false;
         } else if (expecting_nsites) {
-            *nsites = (unsigned)atoi(option.c_str());
+            readIntegerList(option, nsites);
             expecting_nsites = false;
         } else if (expecting_rateCategoryCount) {
-            *rateCategoryCount = (unsigned)atoi(option.c_str());
+            readIntegerList(option, rateCategoryCount);
             expecting_rateCategoryCount = false;
+        } else if (expecting_csvPath) {
+            *csvPath = option;
+            expecting_csvPath = false;
+        } else if (expecting_jsonPath) {
+            *jsonPath = option;
+            expecting_jsonPath = false;
+        } else if (expecting_partialsDir) {
+            *partialsDir = option;
+            expecting_partialsDir = false;
         } else if (expecting_rsrc) {
             std::stringstream ss(option);
             int j;
@@ -1414,6 +2200,19 @@ void interpretCommandLineParameters(int argc, const char* argv[],
                     ss.ignore();
             }
             expecting_rsrc = false;            
+        } else if (expecting_shardWeights) {
+            std::stringstream ss(option);
+            double w;
+            while (ss >> w) {
+                shardWeights->push_back(w);
+                if (ss.peek() == ',')
+                    ss.ignore();
+            }
+            *shardCount = shardWeights->size();
+            expecting_shardWeights = false;
+        } else if (expecting_constantSiteCount) {
+            *constantSiteCount = atoi(option.c_str());
+            expecting_constantSiteCount = false;
         } else if (expecting_nreps) {
             *nreps = (unsigned)atoi(option.c_str());
             expecting_nreps = false;
@@ -1430,8 +2229,34 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *eigenCount = (unsigned)atoi(option.c_str());
             expecting_eigenCount = false;
         } else if (expecting_partitions) {
-            *partitions = (unsigned)atoi(option.c_str());
+            readIntegerList(option, partitions);
             expecting_partitions = false;
+        } else if (expecting_threadCount) {
+            readIntegerList(option, threadCount);
+            expecting_threadCount = false;
+        } else if (expecting_parallelOps) {
+            parallelOps->clear();
+            std::stringstream ss(option);
+            std::string mode;
+            while (std::getline(ss, mode, ',')) {
+                if (mode == "none")
+                    parallelOps->push_back(0);
+                else if (mode == "streams")
+                    parallelOps->push_back(BEAGLE_FLAG_PARALLELOPS_STREAMS);
+                else if (mode == "grid")
+                    parallelOps->push_back(BEAGLE_FLAG_PARALLELOPS_GRID);
+                else
+                    abort("invalid mode for parallelops supplied on the command line");
+            }
+            if (parallelOps->empty())
+                abort("invalid mode for parallelops supplied on the command line");
+            expecting_parallelOps = false;
+        } else if (expecting_matrixCacheSize) {
+            *matrixCacheSize = (unsigned)atoi(option.c_str());
+            expecting_matrixCacheSize = false;
+        } else if (expecting_shardCount) {
+            *shardCount = (unsigned)atoi(option.c_str());
+            expecting_shardCount = false;
         } else if (option == "--help") {
             helpMessage();
         } else if (option == "--resourcelist") {
@@ -1456,6 +2281,8 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             expecting_rsrc = true;
         } else if (option == "--reps") {
             expecting_nreps = true;
+        } else if (option == "--constant-sites") {
+            expecting_constantSiteCount = true;
         } else if (option == "--compact-tips") {
             expecting_compactTipCount = true;
         } else if (option == "--rescale-frequency") {
@@ -1468,6 +2295,10 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *requireSSE = true;
         } else if (option == "--AVX") {
             *requireAVX = true;
+        } else if (option == "--AVX512") {
+            *requireAVX512 = true;
+        } else if (option == "--NEON") {
+            *requireNEON = true;
         } else if (option == "--unrooted") {
             *unrooted = true;
         } else if (option == "--calcderivs") {
@@ -1498,6 +2329,69 @@ void interpretCommandLineParameters(int argc, const char* argv[],
             *rerootTrees = true;
         } else if (option == "--pectinate") {
             *pectinate = true;
+        } else if (option == "--enablethreads") {
+            *enableThreads = true;
+        } else if (option == "--numa") {
+            *enableThreads = true;
+            *enableNuma = true;
+        } else if (option == "--arena") {
+            *enableArena = true;
+        } else if (option == "--partialsdir") {
+            *enableArena = true;
+            expecting_partialsDir = true;
+        } else if (option == "--kerneltuning") {
+            *kernelTuning = true;
+        } else if (option == "--threadcount") {
+            *enableThreads = true;
+            expecting_threadCount = true;
+        } else if (option == "--matrixcache") {
+            expecting_matrixCacheSize = true;
+        } else if (option == "--incremental") {
+            *incremental = true;
+        } else if (option == "--exponentscaling") {
+            *exponentScaling = true;
+        } else if (option == "--adaptivescale") {
+            *adaptiveScaling = true;
+        } else if (option == "--siterepeats") {
+            *siteRepeats = true;
+        } else if (option == "--graphs") {
+            *operationGraphs = true;
+        } else if (option == "--shards") {
+            expecting_shardCount = true;
+        } else if (option == "--shardweights") {
+            expecting_shardWeights = true;
+        } else if (option == "--asyncroot") {
+            *asyncRoot = true;
+        } else if (option == "--batchtips") {
+            *batchTips = true;
+        } else if (option == "--statesets") {
+            *stateSets = true;
+        } else if (option == "--evaluate") {
+            *evaluate = true;
+        } else if (option == "--checkpoint") {
+            *checkpoint = true;
+        } else if (option == "--multitree") {
+            *multitree = true;
+        } else if (option == "--calibrate") {
+            *calibrate = true;
+        } else if (option == "--gradient") {
+            *gradient = true;
+        } else if (option == "--multiedge") {
+            *multiedge = true;
+        } else if (option == "--asynch") {
+            *asynch = true;
+        } else if (option == "--memorybudget") {
+            *memoryBudget = true;
+        } else if (option == "--statistics") {
+            *statistics = true;
+        } else if (option == "--csv") {
+            expecting_csvPath = true;
+        } else if (option == "--json") {
+            expecting_jsonPath = true;
+        } else if (option == "--parallelops") {
+            expecting_parallelOps = true;
+        } else if (option == "--scaling") {
+            *scaling = true;
         } else {
             std::string msg("Unknown command line parameter \"");
             msg.append(option);         
@@ -1532,22 +2426,55 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     if (expecting_compactTipCount)
         abort("read last command line option without finding value associated with --compact-tips");
 
+    if (expecting_constantSiteCount)
+        abort("read last command line option without finding value associated with --constant-sites");
+
     if (expecting_eigenCount)
         abort("read last command line option without finding value associated with --eigencount");
 
     if (expecting_partitions)
         abort("read last command line option without finding value associated with --partitions");
 
-    if (*stateCount < 2)
+    if (expecting_threadCount)
+        abort("read last command line option without finding value associated with --threadcount");
+
+    if (expecting_parallelOps)
+        abort("read last command line option without finding value associated with --parallelops");
+
+    if (expecting_matrixCacheSize)
+        abort("read last command line option without finding value associated with --matrixcache");
+
+    if (expecting_shardCount)
+        abort("read last command line option without finding value associated with --shards");
+
+    if (expecting_shardWeights)
+        abort("read last command line option without finding value associated with --shardweights");
+
+    if (expecting_csvPath)
+        abort("read last command line option without finding value associated with --csv");
+
+    if (expecting_jsonPath)
+        abort("read last command line option without finding value associated with --json");
+
+    if (expecting_partialsDir)
+        abort("read last command line option without finding value associated with --partialsdir");
+
+    // checks against the taxa or sites hold for every point of a sweep if they hold for the smallest
+    int minStateCount = *std::min_element(stateCount->begin(), stateCount->end());
+    int maxStateCount = *std::max_element(stateCount->begin(), stateCount->end());
+    int minTaxa = *std::min_element(ntaxa->begin(), ntaxa->end());
+    int minSites = *std::min_element(nsites->begin(), nsites->end());
+
+    if (minStateCount < 2)
         abort("invalid number of states supplied on the command line");
         
-    if (*ntaxa < 2)
+    if (minTaxa < 2)
         abort("invalid number of taxa supplied on the command line");
       
-    if (*nsites < 1)
+    if (minSites < 1)
         abort("invalid number of sites supplied on the command line");
     
-    if (*rateCategoryCount < 1)
+    if (*std::min_element(rateCategoryCount->begin(), rateCategoryCount->end()) < 1)
         abort("invalid number of rates supplied on the command line");
         
     if (*nreps < 1)
@@ -1559,7 +2486,7 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     if (*manualScaling && *rescaleFrequency < 1)
         abort("invalid number for rescale-frequency supplied on the command line");   
     
-    if (*compactTipCount < 0 || *compactTipCount > *ntaxa)
+    if (*compactTipCount < 0 || *compactTipCount > minTaxa)
         abort("invalid number for compact-tips supplied on the command line");
     
     if (*calcderivs && !(*unrooted))
@@ -1568,28 +2495,54 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     if (*eigenCount < 1)
         abort("invalid number for eigencount supplied on the command line");
     
-    if (*eigencomplex && (*stateCount != 4 || *eigenCount != 1))
+    if (*eigencomplex && (minStateCount != 4 || maxStateCount != 4 || *eigenCount != 1))
         abort("eigencomplex option only works with stateCount=4 and eigenCount=1");
 
-    if (*partitions < 1 || *partitions > *nsites)
+    if (*std::min_element(partitions->begin(), partitions->end()) < 1 ||
+        *std::max_element(partitions->begin(), partitions->end()) > minSites)
         abort("invalid number for partitions supplied on the command line");
 
+    if (*std::min_element(threadCount->begin(), threadCount->end()) < 0)
+        abort("invalid number for threadcount supplied on the command line");
+
+    if (*matrixCacheSize < 0)
+        abort("invalid number for matrixcache supplied on the command line");
+
+    if (*constantSiteCount < 0)
+        abort("invalid number for constant-sites supplied on the command line");
+
+    if (*shardCount < 1 || *shardCount > minSites)
+        abort("invalid number for shards supplied on the command line");
+
+    if (*calibrate && *shardCount > 1)
+        abort("calibration can not be combined with shards");
+
+    if (*memoryBudget && *shardCount > 1)
+        abort("memory budget can not be combined with shards");
+
+    for (size_t s = 0; s < shardWeights->size(); s++) {
+        if (!((*shardWeights)[s] > 0.0))
+            abort("invalid shard weights supplied on the command line");
+    }
+
     if (*randomTree && (*eigenCount!=1 || *unrooted))
         abort("random tree topology can only be used with eigencount=1 and unrooted trees");
 }
 
 int main( int argc, const char* argv[] )
 {
-    // Default values
-    int stateCount = 4;
-    int ntaxa = 16;
-    int nsites = 10000;
+    // Default values, a single point unless lists are given
+    std::vector<int> stateCounts(1, 4);
+    std::vector<int> taxaCounts(1, 16);
+    std::vector<int> siteCounts(1, 10000);
     bool manualScaling = false;
     bool autoScaling = false;
     bool dynamicScaling = false;
     bool requireDoublePrecision = false;
     bool requireSSE = false;
     bool requireAVX = false;
+    bool requireAVX512 = false;
+    bool requireNEON = false;
     bool unrooted = false;
     bool calcderivs = false;
     int compactTipCount = 0;
@@ -1602,11 +2555,42 @@ int main( int argc, const char* argv[] )
     bool setmatrix = false;
     bool opencl = false;
     bool sitelikes = false;
-    int partitions = 1;
+    std::vector<int> partitions(1, 1);
     bool newDataPerRep = false;
     bool randomTree = false;
     bool rerootTrees = false;
     bool pectinate = false;
+    bool enableThreads = false;
+    bool enableNuma = false;
+    bool enableArena = false;
+    bool kernelTuning = false;
+    std::string partialsDir;
+    std::vector<int> threadCounts(1, 0);
+    int matrixCacheSize = 0;
+    bool incremental = false;
+    bool exponentScaling = false;
+    bool adaptiveScaling = false;
+    bool siteRepeats = false;
+    bool operationGraphs = false;
+    int shardCount = 1;
+    std::vector<double> shardWeights;
+    bool asyncRoot = false;
+    bool batchTips = false;
+    bool stateSets = false;
+    bool evaluate = false;
+    bool checkpoint = false;
+    bool multitree = false;
+    bool calibrate = false;
+    bool gradient = false;
+    bool multiedge = false;
+    bool asynch = false;
+    bool memoryBudget = false;
+    bool statistics = false;
+    int constantSiteCount = 0;
+    std::vector<long> parallelOps(1, 0);
+    bool scaling = false;
+    std::string csvPath;
+    std::string jsonPath;
     useStdlibRand = false;
 
     std::vector<int> rsrc;
@@ -1615,72 +2599,153 @@ int main( int argc, const char* argv[] )
     int nreps = 5;
     bool fullTiming = false;
     
-    int rateCategoryCount = 4;
+    std::vector<int> rateCategoryCounts(1, 4);
     
-    interpretCommandLineParameters(argc, argv, &stateCount, &ntaxa, &nsites, &manualScaling, &autoScaling,
-                                   &dynamicScaling, &rateCategoryCount, &rsrc, &nreps, &fullTiming,
-                                   &requireDoublePrecision, &requireSSE, &requireAVX, &compactTipCount, &randomSeed,
+    interpretCommandLineParameters(argc, argv, &stateCounts, &taxaCounts, &siteCounts, &manualScaling, &autoScaling,
+                                   &dynamicScaling, &rateCategoryCounts, &rsrc, &nreps, &fullTiming,
+                                   &requireDoublePrecision, &requireSSE, &requireAVX, &requireAVX512, &requireNEON, &compactTipCount, &randomSeed,
                                    &rescaleFrequency, &unrooted, &calcderivs, &logscalers,
                                    &eigenCount, &eigencomplex, &ievectrans, &setmatrix, &opencl,
-                                   &partitions, &sitelikes, &newDataPerRep, &randomTree, &rerootTrees, &pectinate);
-    
-    std::cout << "\nSimulating genomic ";
-    if (stateCount == 4)
-        std::cout << "DNA";
-    else
-        std::cout << stateCount << "-state data";
-    if (partitions > 1) {
-        std::cout << " with " << ntaxa << " taxa, " << nsites << " site patterns, and " << partitions << " partitions (" << nreps << " rep" << (nreps > 1 ? "s" : "");
-    } else {
-        std::cout << " with " << ntaxa << " taxa and " << nsites << " site patterns (" << nreps << " rep" << (nreps > 1 ? "s" : "");
-    }
-    std::cout << (manualScaling ? ", manual scaling":(autoScaling ? ", auto scaling":(dynamicScaling ? ", dynamic scaling":""))) << ", random seed " << randomSeed << ")\n\n";
-
+                                   &partitions, &sitelikes, &newDataPerRep, &randomTree, &rerootTrees, &pectinate,
+                                   &enableThreads, &enableNuma, &enableArena, &kernelTuning, &partialsDir, &threadCounts,
+                                   &matrixCacheSize, &incremental, &exponentScaling, &adaptiveScaling, &siteRepeats, &operationGraphs, &shardCount,
+                                   &shardWeights, &asyncRoot, &batchTips, &stateSets, &evaluate, &checkpoint, &multitree,
+                                   &calibrate, &gradient, &multiedge, &asynch, &memoryBudget, &statistics,
+                                   &constantSiteCount, &parallelOps, &scaling, &csvPath, &jsonPath);
+
+    FILE* csvFile = NULL;
+    FILE* jsonFile = NULL;
+    if (!csvPath.empty() && (csvFile = fopen(csvPath.c_str(), "a")) == NULL)
+        abort("unable to open the --csv file");
+    if (!jsonPath.empty() && (jsonFile = fopen(jsonPath.c_str(), "a")) == NULL)
+        abort("unable to open the --json file");
 
     BeagleResourceList* rl = beagleGetResourceList();
-    if(rl != NULL){
+    if (rl == NULL)
+        abort("no BEAGLE resources found");
+
+    // the resources are initialized once for the whole sweep
+    size_t pointCount = stateCounts.size() * taxaCounts.size() * siteCounts.size() * rateCategoryCounts.size();
+    for (size_t point = 0; point < pointCount; point++) {
+        size_t index = point;
+        int rateCategoryCount = rateCategoryCounts[index % rateCategoryCounts.size()];
+        index /= rateCategoryCounts.size();
+        int nsites = siteCounts[index % siteCounts.size()];
+        index /= siteCounts.size();
+        int ntaxa = taxaCounts[index % taxaCounts.size()];
+        index /= taxaCounts.size();
+        int stateCount = stateCounts[index];
+
+        std::cout << "\nSimulating genomic ";
+        if (stateCount == 4)
+            std::cout << "DNA";
+        else
+            std::cout << stateCount << "-state data";
+        if (partitions.size() > 1 || partitions[0] > 1) {
+            std::cout << " with " << ntaxa << " taxa, " << nsites << " site patterns, and ";
+            for (size_t pa = 0; pa < partitions.size(); pa++)
+                std::cout << (pa > 0 ? "," : "") << partitions[pa];
+            std::cout << " partitions (" << nreps << " rep" << (nreps > 1 ? "s" : "");
+        } else {
+            std::cout << " with " << ntaxa << " taxa and " << nsites << " site patterns (" << nreps << " rep" << (nreps > 1 ? "s" : "");
+        }
+        std::cout << (manualScaling ? ", manual scaling":(autoScaling ? ", auto scaling":(dynamicScaling ? ", dynamic scaling":""))) << ", random seed " << randomSeed << ")\n\n";
+
+
         for(int i=0; i<rl->length; i++){
             if (rsrc.size() == 1 || std::find(rsrc.begin(), rsrc.end(), i)!=rsrc.end()) {
-                runBeagle(i,
-                          stateCount,
-                          ntaxa,
-                          nsites,
-                          manualScaling,
-                          autoScaling,
-                          dynamicScaling,
-                          rateCategoryCount,
-                          nreps,
-                          fullTiming,
-                          requireDoublePrecision,
-                          requireSSE,
-                          requireAVX,
-                          compactTipCount,
-                          randomSeed,
-                          rescaleFrequency,
-                          unrooted,
-                          calcderivs,
-                          logscalers,
-                          eigenCount,
-                          eigencomplex,
-                          ievectrans,
-                          setmatrix,
-                          opencl,
-                          partitions,
-                          sitelikes,
-                          newDataPerRep,
-                          randomTree,
-                          rerootTrees,
-                          pectinate);
+                // every combination of the parallel settings, the first being the baseline
+                std::vector<scalingRun> runs;
+                for (size_t o = 0; o < parallelOps.size(); o++) {
+                    for (size_t pa = 0; pa < partitions.size(); pa++) {
+                        for (size_t t = 0; t < threadCounts.size(); t++) {
+                            scalingRun run = {threadCounts[t], partitions[pa], parallelOps[o], 0.0};
+                            run.seconds = runBeagle(i,
+                                      stateCount,
+                                      ntaxa,
+                                      nsites,
+                                      manualScaling,
+                                      autoScaling,
+                                      dynamicScaling,
+                                      rateCategoryCount,
+                                      nreps,
+                                      fullTiming,
+                                      requireDoublePrecision,
+                                      requireSSE,
+                                      requireAVX,
+                                      requireAVX512,
+                                      requireNEON,
+                                      compactTipCount,
+                                      randomSeed,
+                                      rescaleFrequency,
+                                      unrooted,
+                                      calcderivs,
+                                      logscalers,
+                                      eigenCount,
+                                      eigencomplex,
+                                      ievectrans,
+                                      setmatrix,
+                                      opencl,
+                                      run.partitionCount,
+                                      sitelikes,
+                                      newDataPerRep,
+                                      randomTree,
+                                      rerootTrees,
+                                      pectinate,
+                                      enableThreads,
+                                      enableNuma,
+                                      enableArena,
+                                      kernelTuning,
+                                      partialsDir,
+                                      run.threadCount,
+                                      matrixCacheSize,
+                                      incremental,
+                                      exponentScaling,
+                                      adaptiveScaling,
+                                      siteRepeats,
+                                      operationGraphs,
+                                      shardCount,
+                                      shardWeights,
+                                      asyncRoot,
+                                      batchTips,
+                                      stateSets,
+                                      evaluate,
+                                      checkpoint,
+                                      multitree,
+                                      calibrate,
+                                      gradient,
+                                      multiedge,
+                                      asynch,
+                                      memoryBudget,
+                                      statistics,
+                                      constantSiteCount,
+                                      run.parallelOpsFlags,
+                                      csvFile,
+                                      jsonFile);
+                            runs.push_back(run);
+                        }
+                    }
+                }
+                if (scaling)
+                    printScaling(runs);
             }
         }
-    } else {
-        abort("no BEAGLE resources found");
     }
 
+    if (csvFile != NULL)
+        fclose(csvFile);
+    if (jsonFile != NULL)
+        fclose(jsonFile);
+
 //#ifdef _WIN32
 //    std::cout << "\nPress ENTER to exit...\n";
 //    fflush( stdout);
 //    fflush( stderr);
 //    getchar();
 //#endif
+
+    if (instancesObtained == 0)
+        reportCheckFailure("no BEAGLE instance could be created");
+
+    return (checkFailureCount > 0 ? 1 : 0);
 }
@@ -108,6 +108,8 @@
 package beagle;
 
 import java.io.Serializable;
+import java.nio.DoubleBuffer;
+import java.nio.IntBuffer;
 
 /**
  * Beagle - An interface exposing the BEAGLE likelihood evaluation library.
@@ -128,6 +130,14 @@ public interface Beagle extends Serializable {
     public static int PARTITION_OPERATION_TUPLE_SIZE = 9;
     public static int NONE = -1;
 
+    // Command codes of executeCommands
+    public static int COMMAND_UPDATE_TRANSITION_MATRICES = 0;
+    public static int COMMAND_UPDATE_PARTIALS = 1;
+    public static int COMMAND_RESET_SCALE_FACTORS = 2;
+    public static int COMMAND_ACCUMULATE_SCALE_FACTORS = 3;
+    public static int COMMAND_REMOVE_SCALE_FACTORS = 4;
+    public static int COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS = 5;
+
 
     /**
      * Finalize this instance
@@ -154,6 +164,88 @@ public interface Beagle extends Serializable {
      */
     void setPatternPartitions(int partitionCount, final int[] patternPartitions);
 
+    /**
+     * Set the number of CPU threads
+     *
+     * This function sets the number of threads, the calling thread included, that an instance
+     * created with THREADING_CPP may use for each call.
+     *
+     * @param threadCount           Number of threads
+     */
+    void setCPUThreadCount(int threadCount);
+
+    /**
+     * Set the size of the transition matrix cache
+     *
+     * This function lets updateTransitionMatrices reuse matrices already computed for the same
+     * eigen decomposition, category rates and edge length. A size of 0, the default, turns the
+     * cache off.
+     *
+     * @param cacheSize             Number of transition matrices to keep
+     */
+    void setTransitionMatrixCacheSize(int cacheSize);
+
+    /**
+     * Turn incremental partials updates on or off
+     *
+     * When on, updatePartials skips any operation whose destination already holds the partials
+     * computed from the same children, transition matrices and scale buffers, so a full
+     * traversal can be resubmitted after a local change. Off by default.
+     *
+     * @param enabled               Whether operations with a current destination are skipped
+     */
+    void setIncrementalUpdates(boolean enabled);
+
+    /**
+     * Turn power-of-two rescaling on or off
+     *
+     * When on, partials are rescaled by a power of two, so rescaling needs no division or
+     * logarithm and the scale factors are multiples of log(2). Off by default.
+     *
+     * @param enabled               Whether partials are rescaled by powers of two
+     */
+    void setExponentScaling(boolean enabled);
+
+    /**
+     * Turn adaptive rescaling on or off
+     *
+     * When on, an operation that writes scale factors rescales only the patterns whose partials
+     * are drifting towards underflow and gives the others a scale factor of one. Off by default.
+     *
+     * @param enabled               Whether only patterns near underflow are rescaled
+     */
+    void setAdaptiveRescaling(boolean enabled);
+
+    /**
+     * Turn site repeats on or off
+     *
+     * When on, a CPU instance computes the partials of patterns whose subtree shows the same tip
+     * states only once per operation and copies them to the others. Off by default.
+     *
+     * @param enabled               Whether repeated patterns are computed once
+     */
+    void setSiteRepeats(boolean enabled);
+
+    /**
+     * Page the internal buffers to a file
+     *
+     * Moves the buffers of an instance created with MEMORY_ARENA onto a file in the directory,
+     * so partials that do not fit in memory are paged to that disk.
+     *
+     * @param directory             Directory in which to create the file
+     */
+    void setPartialsBackingDirectory(String directory);
+
+    /**
+     * Turn replay of captured operation lists on or off
+     *
+     * When on, a CUDA instance replays the kernel launches of a repeated operation list from a
+     * captured graph. Off by default.
+     *
+     * @param enabled               Whether repeated operation lists are replayed
+     */
+    void setOperationGraphs(boolean enabled);
+
     /**
      * Set the compressed state representation for tip node
      *
@@ -169,6 +261,21 @@ public interface Beagle extends Serializable {
             int tipIndex,
             final int[] inStates);
 
+    /**
+     * Set the possible states of each pattern for a tip node
+     *
+     * This function copies a compact state-set representation into an instance buffer, for tips
+     * with ambiguous observations. The inStateSets array holds one bitmask per pattern, with bit s
+     * set when state s is possible (no bits below stateCount = missing), and should be patternCount
+     * in length.
+     *
+     * @param tipIndex      Index of destination partialsBuffer (input)
+     * @param inStateSets   State bitmasks (input)
+     */
+    void setTipStateSets(
+            int tipIndex,
+            final int[] inStateSets);
+
     /**
      * Get the compressed state representation for tip node
      *
@@ -199,6 +306,36 @@ public interface Beagle extends Serializable {
             int tipIndex,
             final double[] inPartials);
 
+    /**
+     * Set the compressed state representations for several tip nodes
+     *
+     * The inStates array holds the patternCount states of each tip one after another, in the
+     * order of tipIndices.
+     *
+     * @param tipIndices   Indices of destination partialsBuffers (input)
+     * @param inStates     Compressed states of all listed tips (input)
+     * @param count        Number of tips (input)
+     */
+    void setTipStatesBatch(
+            final int[] tipIndices,
+            final int[] inStates,
+            int count);
+
+    /**
+     * Set the partials buffers of several tip nodes
+     *
+     * The inPartials array holds the stateCount * patternCount partials of each tip one after
+     * another, in the order of tipIndices.
+     *
+     * @param tipIndices   Indices of destination partialsBuffers (input)
+     * @param inPartials   Partials values of all listed tips (input)
+     * @param count        Number of tips (input)
+     */
+    void setTipPartialsBatch(
+            final int[] tipIndices,
+            final double[] inPartials,
+            int count);
+
     /**
      * Set an instance partials buffer
      *
@@ -212,6 +349,20 @@ public interface Beagle extends Serializable {
             int bufferIndex,
             final double[] inPartials);
 
+    /**
+     * Set an instance partials buffer from a direct buffer
+     *
+     * As setPartials, but the library reads the values in place from a direct buffer in native
+     * byte order, from its first element on, so that the JVM makes no copy. The buffer can be
+     * reused across calls.
+     *
+     * @param bufferIndex   Index of destination partialsBuffer (input)
+     * @param inPartials    Direct buffer of partials values to set (input)
+     */
+    void setPartials(
+            int bufferIndex,
+            final DoubleBuffer inPartials);
+
     /**
      * Get partials from an instance buffer
      *
@@ -226,6 +377,43 @@ public interface Beagle extends Serializable {
             int bufferIndex,
             int scaleIndex,
             final double[] outPartials);
+
+    /**
+     * Get partials from an instance buffer into a direct buffer
+     *
+     * As getPartials, but the library writes the values in place into a direct buffer in native
+     * byte order, from its first element on.
+     *
+     * @param bufferIndex   Index of destination partialsBuffer (input)
+     * @param scaleIndex    Index of scaleBuffer to apply to partials (input)
+     * @param outPartials   Direct buffer to receive the partials (output)
+     */
+    void getPartials(
+            int bufferIndex,
+            int scaleIndex,
+            final DoubleBuffer outPartials);
+
+    /**
+     * Release the memory of an instance buffer
+     *
+     * A released partials buffer must be written again before it is read.
+     *
+     * @param bufferIndex   Index of partialsBuffer to release (input)
+     */
+    void releasePartials(int bufferIndex);
+
+    /**
+     * Checkpoint the partials and scale buffers
+     *
+     * Buffers written after the checkpoint move to fresh storage, so restoreState can return to it
+     * without the caller keeping a second set of buffer indices.
+     */
+    void saveState();
+
+    /**
+     * Return the partials and scale buffers to the last checkpoint
+     */
+    void restoreState();
                         
     /**
      * Get scale factors from instance buffer on log-scale
@@ -372,6 +560,21 @@ public interface Beagle extends Serializable {
             final double[] inMatrix, 	/**< Pointer to source transition probability matrix (input) */
             double paddedValue);
 
+    /**
+     * Set a finite-time transition probability matrix from a direct buffer
+     *
+     * As setTransitionMatrix, but the library reads the matrix in place from a direct buffer in
+     * native byte order, from its first element on.
+     *
+     * @param matrixIndex   Index of matrix buffer (input)
+     * @param inMatrix      Direct buffer of the transition probability matrix (input)
+     * @param paddedValue   Value to be used for padding for ambiguous states (input)
+     */
+    void setTransitionMatrix(
+            int matrixIndex,
+            final DoubleBuffer inMatrix,
+            double paddedValue);
+
     /**
      * Get a finite-time transition probability matrix
      *
@@ -386,6 +589,18 @@ public interface Beagle extends Serializable {
     void getTransitionMatrix(int matrixIndex,
                              double[] outMatrix);
 
+    /**
+     * Get a finite-time transition probability matrix into a direct buffer
+     *
+     * As getTransitionMatrix, but the library writes the matrix in place into a direct buffer in
+     * native byte order, from its first element on.
+     *
+     * @param matrixIndex  Index of matrix buffer (input)
+     * @param outMatrix    Direct buffer to receive the transition probability matrix (output)
+     */
+    void getTransitionMatrix(int matrixIndex,
+                             DoubleBuffer outMatrix);
+
     /**
      * Calculate or queue for calculation partials using a list of operations
      *
@@ -415,6 +630,65 @@ public interface Beagle extends Serializable {
             int operationCount,
             int cumulativeScaleIndex);
 
+    /**
+     * Calculate or queue for calculation partials using a list of operations in a direct buffer
+     *
+     * As updatePartials, but the library reads the 7-tuples in place from a direct buffer in
+     * native byte order, from its first element on.
+     *
+     * @param operations            Direct buffer of 7-tuples specifying operations (input)
+     * @param operationCount        Number of operations (input)
+     * @param cumulativeScaleIndex  Index number of scaleBuffer to store accumulated factors (input)
+     */
+    void updatePartials(
+            final IntBuffer operations,
+            int operationCount,
+            int cumulativeScaleIndex);
+
+    /**
+     * Calculate or queue for calculating the partials of several trees
+     *
+     * The operations of each tree follow those of the tree before it. The trees share the
+     * instance's tips, eigen-decompositions and matrices but write distinct partials buffers, and
+     * are run interleaved by depth so that their independent operations are batched together.
+     *
+     * @param operations                List of 7-tuples of all trees, one tree after another (input)
+     * @param operationCounts           Number of operations of each tree (input)
+     * @param treeCount                 Number of trees (input)
+     * @param cumulativeScaleIndices    Index of the scaleBuffer to accumulate each tree's factors into,
+     *                                      or null (input)
+     */
+    void updatePartialsForTrees(
+            final int[] operations,
+            final int[] operationCounts,
+            int treeCount,
+            final int[] cumulativeScaleIndices);
+
+    /**
+     * Fill the pre-order partials of the root with the state frequencies
+     *
+     * @param bufferIndices             List of partialsBuffer indices to fill (input)
+     * @param stateFrequenciesIndices   List of indices of state frequencies for each buffer (input)
+     * @param count                     Number of buffers (input)
+     */
+    void setRootPrePartials(final int[] bufferIndices,
+                            final int[] stateFrequenciesIndices,
+                            int count);
+
+    /**
+     * Calculate pre-order partials, root to tips, using a list of operations
+     *
+     * Each 7-tuple reads: {destination pre-order partials, destinationScaleWrite, (unused),
+     *                      parent's pre-order partials, parent's transition matrix or NONE at the root,
+     *                      sibling's partials or tip, sibling's transition matrix}
+     * A parent's operation must come before those of its children.
+     *
+     * @param operations        List of 7-tuples specifying operations (input)
+     * @param operationCount    Number of operations (input)
+     */
+    void updatePrePartials(final int[] operations,
+                           int operationCount);
+
     /**
      * Calculate or queue for calculating partials by partition using a list of operations
      *
@@ -569,6 +843,95 @@ public interface Beagle extends Serializable {
                                      int count,
                                      double[] outSumLogLikelihood);
 
+    /**
+     * Calculate the log likelihood at a root node into a result slot
+     *
+     * This function integrates like calculateRootLogLikelihoods but leaves the sum in a result slot
+     * and returns without waiting for it, so that several sums can be fetched together with
+     * getLogLikelihoodResults. Every instance holds 256 slots, numbered from 0
+     *
+     * @param bufferIndices             List of partialsBuffer indices to integrate (input)
+     * @param categoryWeightsIndices    List of indices of category weights to apply to each partialsBuffer (input)
+     * @param stateFrequenciesIndices   List of indices of state frequencies for each partialsBuffer (input)
+     * @param cumulativeScaleIndices    List of scalingFactors indices to accumulate over (input)
+     * @param count                     Number of partialsBuffer to integrate (input)
+     * @param resultIndex               Index of the result slot to write (input)
+     */
+    void calculateRootLogLikelihoodsAsync(int[] bufferIndices,
+                                          int[] categoryWeightsIndices,
+                                          int[] stateFrequenciesIndices,
+                                          int[] cumulativeScaleIndices,
+                                          int count,
+                                          int resultIndex);
+
+    /**
+     * Get log likelihoods left in result slots
+     *
+     * A slot outside 0..255, or one that calculateRootLogLikelihoodsAsync has not written, is an error
+     *
+     * @param resultIndices             List of result slot indices (input)
+     * @param count                     Number of result slots (input)
+     * @param outSumLogLikelihoods      Destination for count sums of log likelihoods (output)
+     */
+    void getLogLikelihoodResults(int[] resultIndices,
+                                 int count,
+                                 double[] outSumLogLikelihoods);
+
+    /**
+     * Calculate the log likelihood of several trees at once
+     *
+     * Each root is integrated on its own, giving one sum of log likelihoods per tree. The sums
+     * pass through the result slots of calculateRootLogLikelihoodsAsync, overwriting them.
+     *
+     * @param bufferIndices             Root partialsBuffer index of each tree (input)
+     * @param categoryWeightsIndices    Index of the category weights for each tree (input)
+     * @param stateFrequenciesIndices   Index of the state frequencies for each tree (input)
+     * @param cumulativeScaleIndices    Index of the scalingFactors for each tree (input)
+     * @param treeCount                 Number of trees (input)
+     * @param outSumLogLikelihoods      Destination for treeCount sums of log likelihoods (output)
+     */
+    void calculateRootLogLikelihoodsForTrees(int[] bufferIndices,
+                                             int[] categoryWeightsIndices,
+                                             int[] stateFrequenciesIndices,
+                                             int[] cumulativeScaleIndices,
+                                             int treeCount,
+                                             double[] outSumLogLikelihoods);
+
+    /**
+     * Run a packed list of commands, on this and other instances, in one call
+     *
+     * Evaluating a likelihood takes several calls, and with many small partitions the cost of each
+     * call crossing into the library adds up. This function runs a whole evaluation, possibly across
+     * the instances of several partitions, in a single crossing. The commands are run in order, and
+     * the first error stops the list, except a floating-point error in a root likelihood.
+     *
+     * Each command starts with its code and the position of its instance in instances, followed by:
+     *   COMMAND_UPDATE_TRANSITION_MATRICES      eigenIndex, count, probabilityIndices[count]; the
+     *                                           next count values are the edge lengths
+     *   COMMAND_UPDATE_PARTIALS                 operationCount, cumulativeScaleIndex,
+     *                                           operations[operationCount * OPERATION_TUPLE_SIZE]
+     *   COMMAND_RESET_SCALE_FACTORS             cumulativeScaleIndex
+     *   COMMAND_ACCUMULATE_SCALE_FACTORS        count, cumulativeScaleIndex, scaleIndices[count]
+     *   COMMAND_REMOVE_SCALE_FACTORS            count, cumulativeScaleIndex, scaleIndices[count]
+     *   COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS  count, bufferIndices[count],
+     *                                           categoryWeightsIndices[count],
+     *                                           stateFrequenciesIndices[count],
+     *                                           cumulativeScaleIndices[count]; the sum of log
+     *                                           likelihoods goes to the next outSumLogLikelihoods
+     *
+     * @param instances                 Instances the commands refer to, of the same implementation (input)
+     * @param commands                  Packed commands (input)
+     * @param commandLength             Number of integers of commands in use (input)
+     * @param values                    Edge lengths of the transition matrix commands, in order (input)
+     * @param outSumLogLikelihoods      Destination for the sum of log likelihoods of each root
+     *                                  likelihood command, in order (output)
+     */
+    void executeCommands(final Beagle[] instances,
+                         final int[] commands,
+                         int commandLength,
+                         final double[] values,
+                         final double[] outSumLogLikelihoods);
+
     /**
      * Calculate site log likelihoods at a root node by partition
      *
@@ -645,6 +1008,39 @@ public interface Beagle extends Serializable {
      */
     void getSiteLogLikelihoods(double[] outLogLikelihoods);
 
+    /**
+     * Return the individual log likelihoods for each site pattern into a direct buffer
+     *
+     * As getSiteLogLikelihoods, but the library writes the values in place into a direct buffer
+     * in native byte order, from its first element on.
+     *
+     * @param outLogLikelihoods a direct buffer in which the likelihoods will be put
+     */
+    void getSiteLogLikelihoods(DoubleBuffer outLogLikelihoods);
+
+    /**
+     * Calculate the derivative of the log likelihood with respect to the length of many branches
+     *
+     * One post-order and one pre-order traversal give the gradient over all branches.
+     *
+     * @param postBufferIndices         List of post-order partialsBuffer or tip indices (input)
+     * @param preBufferIndices          List of pre-order partialsBuffer indices (input)
+     * @param probabilityIndices        List of transition matrix indices of the branches (input)
+     * @param derivativeMatrixIndices   List of first derivative matrix indices of the branches (input)
+     * @param categoryWeightsIndices    List of indices of category weights for each branch (input)
+     * @param count                     Number of branches (input)
+     * @param outDerivatives            Destination for count * patternCount site derivatives, or null (output)
+     * @param outSumDerivatives         Destination for the derivative of each branch (output)
+     */
+    void calculateEdgeDerivatives(int[] postBufferIndices,
+                                  int[] preBufferIndices,
+                                  int[] probabilityIndices,
+                                  int[] derivativeMatrixIndices,
+                                  int[] categoryWeightsIndices,
+                                  int count,
+                                  double[] outDerivatives,
+                                  double[] outSumDerivatives);
+
     /**
      * Get a details class for this instance
      * @return
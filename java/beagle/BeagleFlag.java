@@ -25,10 +25,19 @@ public enum BeagleFlag {
 
     VECTOR_SSE(1 << 11, "SSE vector computation"),
     VECTOR_NONE(1 << 12, "no vector computation"),
+    VECTOR_AVX512(1L << 32, "AVX-512 vector computation"),
+    VECTOR_NEON(1L << 33, "NEON vector computation"),
 
     THREADING_CPP(1 << 30, "C++11 threading"),
     THREADING_OPENMP(1 << 13, "OpenMP threading"),
     THREADING_NONE(1 << 14, "no threading"),
+    THREADING_NUMA(1L << 31, "C++11 threading with NUMA-aware placement"),
+
+    MEMORY_ARENA(1L << 34, "allocate instance buffers from one huge-page backed slab"),
+    KERNEL_TUNING(1L << 35, "tune runtime-compiled GPU kernels for the device"),
+    CALIBRATE(1L << 36, "create the instance on the implementation timed fastest"),
+    PREORDER(1L << 37, "pre-order partials and all-branch edge derivatives"),
+    MULTI_EDGE(1L << 38, "multi-edge likelihoods evaluated together rather than per edge"),
 
     PROCESSOR_CPU(1 << 15, "use CPU as main processor"),
     PROCESSOR_GPU(1 << 16, "use GPU as main processor"),
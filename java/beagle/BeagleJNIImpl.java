@@ -5,6 +5,9 @@
 
 package beagle;
 
+import java.nio.DoubleBuffer;
+import java.nio.IntBuffer;
+
 /*
  * BeagleJNIjava
  *
@@ -75,6 +78,62 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setCPUThreadCount(int threadCount) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setCPUThreadCount(instance, threadCount);
+        if (errCode != 0) {
+            throw new BeagleException("setCPUThreadCount", errCode);
+        }
+    }
+
+    public void setTransitionMatrixCacheSize(int cacheSize) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTransitionMatrixCacheSize(instance, cacheSize);
+        if (errCode != 0) {
+            throw new BeagleException("setTransitionMatrixCacheSize", errCode);
+        }
+    }
+
+    public void setIncrementalUpdates(boolean enabled) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setIncrementalUpdates(instance, enabled ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setIncrementalUpdates", errCode);
+        }
+    }
+
+    public void setExponentScaling(boolean enabled) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setExponentScaling(instance, enabled ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setExponentScaling", errCode);
+        }
+    }
+
+    public void setAdaptiveRescaling(boolean enabled) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setAdaptiveRescaling(instance, enabled ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setAdaptiveRescaling", errCode);
+        }
+    }
+
+    public void setSiteRepeats(boolean enabled) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setSiteRepeats(instance, enabled ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setSiteRepeats", errCode);
+        }
+    }
+
+    public void setPartialsBackingDirectory(String directory) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setPartialsBackingDirectory(instance, directory);
+        if (errCode != 0) {
+            throw new BeagleException("setPartialsBackingDirectory", errCode);
+        }
+    }
+
+    public void setOperationGraphs(boolean enabled) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setOperationGraphs(instance, enabled ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setOperationGraphs", errCode);
+        }
+    }
+
     public void setTipStates(int tipIndex, final int[] states) {
         int errCode = BeagleJNIWrapper.INSTANCE.setTipStates(instance, tipIndex, states);
         if (errCode != 0) {
@@ -82,6 +141,13 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setTipStateSets(int tipIndex, final int[] stateSets) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipStateSets(instance, tipIndex, stateSets);
+        if (errCode != 0) {
+            throw new BeagleException("setTipStateSets", errCode);
+        }
+    }
+
     public void getTipStates(int tipIndex, final int[] states) {
         int errCode = BeagleJNIWrapper.INSTANCE.getTipStates(instance, tipIndex, states);
         if (errCode != 0) {
@@ -96,6 +162,20 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setTipStatesBatch(final int[] tipIndices, final int[] states, int count) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipStatesBatch(instance, tipIndices, states, count);
+        if (errCode != 0) {
+            throw new BeagleException("setTipStatesBatch", errCode);
+        }
+    }
+
+    public void setTipPartialsBatch(final int[] tipIndices, final double[] partials, int count) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipPartialsBatch(instance, tipIndices, partials, count);
+        if (errCode != 0) {
+            throw new BeagleException("setTipPartialsBatch", errCode);
+        }
+    }
+
     public void setPartials(int bufferIndex, final double[] partials) {
         int errCode = BeagleJNIWrapper.INSTANCE.setPartials(instance, bufferIndex, partials);
         if (errCode != 0) {
@@ -103,12 +183,47 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setPartials(int bufferIndex, final DoubleBuffer partials) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setPartialsDirect(instance, bufferIndex, partials);
+        if (errCode != 0) {
+            throw new BeagleException("setPartials", errCode);
+        }
+    }
+
     public void getPartials(int bufferIndex, int scaleIndex, final double []outPartials) {
         int errCode = BeagleJNIWrapper.INSTANCE.getPartials(instance, bufferIndex, scaleIndex, outPartials);
         if (errCode != 0) {
             throw new BeagleException("getPartials", errCode);
         }
     }
+
+    public void getPartials(int bufferIndex, int scaleIndex, final DoubleBuffer outPartials) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getPartialsDirect(instance, bufferIndex, scaleIndex, outPartials);
+        if (errCode != 0) {
+            throw new BeagleException("getPartials", errCode);
+        }
+    }
+
+    public void releasePartials(int bufferIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.releasePartials(instance, bufferIndex);
+        if (errCode != 0) {
+            throw new BeagleException("releasePartials", errCode);
+        }
+    }
+
+    public void saveState() {
+        int errCode = BeagleJNIWrapper.INSTANCE.saveState(instance);
+        if (errCode != 0) {
+            throw new BeagleException("saveState", errCode);
+        }
+    }
+
+    public void restoreState() {
+        int errCode = BeagleJNIWrapper.INSTANCE.restoreState(instance);
+        if (errCode != 0) {
+            throw new BeagleException("restoreState", errCode);
+        }
+    }
     
     public void getLogScaleFactors(int scaleIndex, final double[] outFactors) {
         int errCode = BeagleJNIWrapper.INSTANCE.getLogScaleFactors(instance, scaleIndex, outFactors);
@@ -169,6 +284,13 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setTransitionMatrix(int matrixIndex, final DoubleBuffer inMatrix, double paddedValue) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTransitionMatrixDirect(instance, matrixIndex, inMatrix, paddedValue);
+        if (errCode != 0) {
+            throw new BeagleException("setTransitionMatrix", errCode);
+        }
+    }
+
     public void getTransitionMatrix(int matrixIndex, final double[] outMatrix) {
         int errCode = BeagleJNIWrapper.INSTANCE.getTransitionMatrix(instance, matrixIndex, outMatrix);
         if (errCode != 0) {
@@ -176,6 +298,13 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void getTransitionMatrix(int matrixIndex, final DoubleBuffer outMatrix) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getTransitionMatrixDirect(instance, matrixIndex, outMatrix);
+        if (errCode != 0) {
+            throw new BeagleException("getTransitionMatrix", errCode);
+        }
+    }
+
 	// /////////////////////////
 	// ---TODO: Epoch model---//
 	// /////////////////////////
@@ -241,6 +370,37 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void updatePartials(final IntBuffer operations, final int operationCount, final int cumulativeScaleIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.updatePartialsDirect(instance, operations, operationCount, cumulativeScaleIndex);
+        if (errCode != 0) {
+            throw new BeagleException("updatePartials", errCode);
+        }
+    }
+
+    public void updatePartialsForTrees(final int[] operations, final int[] operationCounts, final int treeCount,
+                                       final int[] cumulativeScaleIndices) {
+        int errCode = BeagleJNIWrapper.INSTANCE.updatePartialsForTrees(instance, operations, operationCounts,
+                treeCount, cumulativeScaleIndices);
+        if (errCode != 0) {
+            throw new BeagleException("updatePartialsForTrees", errCode);
+        }
+    }
+
+    public void setRootPrePartials(final int[] bufferIndices, final int[] stateFrequenciesIndices, final int count) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setRootPrePartials(instance, bufferIndices, stateFrequenciesIndices,
+                count);
+        if (errCode != 0) {
+            throw new BeagleException("setRootPrePartials", errCode);
+        }
+    }
+
+    public void updatePrePartials(final int[] operations, final int operationCount) {
+        int errCode = BeagleJNIWrapper.INSTANCE.updatePrePartials(instance, operations, operationCount);
+        if (errCode != 0) {
+            throw new BeagleException("updatePrePartials", errCode);
+        }
+    }
+
     public void updatePartialsByPartition(final int[] operations, final int operationCount) {
         int errCode = BeagleJNIWrapper.INSTANCE.updatePartialsByPartition(instance, operations, operationCount);
         if (errCode != 0) {
@@ -316,6 +476,77 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void calculateRootLogLikelihoodsAsync(int[] bufferIndices,
+                                                 final int[] categoryWeightsIndices,
+                                                 final int[] stateFrequenciesIndices,
+                                                 final int[] cumulativeScaleIndices,
+                                                 int count,
+                                                 int resultIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateRootLogLikelihoodsAsync(instance,
+                bufferIndices,
+                categoryWeightsIndices,
+                stateFrequenciesIndices,
+                cumulativeScaleIndices,
+                count,
+                resultIndex);
+        if (errCode != 0) {
+            throw new BeagleException("calculateRootLogLikelihoodsAsync", errCode);
+        }
+    }
+
+    public void getLogLikelihoodResults(final int[] resultIndices,
+                                        int count,
+                                        final double[] outSumLogLikelihoods) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getLogLikelihoodResults(instance,
+                resultIndices,
+                count,
+                outSumLogLikelihoods);
+        // as with calculateRootLogLikelihoods, a NaN sum is not an exception
+        if (errCode != 0 && errCode != BeagleErrorCode.FLOATING_POINT_ERROR.getErrCode()) {
+            throw new BeagleException("getLogLikelihoodResults", errCode);
+        }
+    }
+
+    public void calculateRootLogLikelihoodsForTrees(int[] bufferIndices,
+                                                    final int[] categoryWeightsIndices,
+                                                    final int[] stateFrequenciesIndices,
+                                                    final int[] cumulativeScaleIndices,
+                                                    int treeCount,
+                                                    final double[] outSumLogLikelihoods) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateRootLogLikelihoodsForTrees(instance,
+                bufferIndices,
+                categoryWeightsIndices,
+                stateFrequenciesIndices,
+                cumulativeScaleIndices,
+                treeCount,
+                outSumLogLikelihoods);
+        if (errCode != 0 && errCode != BeagleErrorCode.FLOATING_POINT_ERROR.getErrCode()) {
+            throw new BeagleException("calculateRootLogLikelihoodsForTrees", errCode);
+        }
+    }
+
+    public void executeCommands(final Beagle[] instances,
+                                final int[] commands,
+                                int commandLength,
+                                final double[] values,
+                                final double[] outSumLogLikelihoods) {
+        int[] instanceNumbers = new int[instances.length];
+        for (int i = 0; i < instances.length; i++) {
+            if (!(instances[i] instanceof BeagleJNIImpl)) {
+                throw new IllegalArgumentException("executeCommands needs instances of the native library");
+            }
+            instanceNumbers[i] = ((BeagleJNIImpl) instances[i]).instance;
+        }
+        int errCode = BeagleJNIWrapper.INSTANCE.executeCommands(instanceNumbers,
+                commands,
+                commandLength,
+                values,
+                outSumLogLikelihoods);
+        if (errCode != 0 && errCode != BeagleErrorCode.FLOATING_POINT_ERROR.getErrCode()) {
+            throw new BeagleException("executeCommands", errCode);
+        }
+    }
+
     public void calculateRootLogLikelihoodsByPartition(int[] bufferIndices,
                                             final int[] categoryWeightsIndices,
                                             final int[] stateFrequenciesIndices,
@@ -379,6 +610,35 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void getSiteLogLikelihoods(final DoubleBuffer outLogLikelihoods) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getSiteLogLikelihoodsDirect(instance, outLogLikelihoods);
+        if (errCode != 0) {
+            throw new BeagleException("getSiteLogLikelihoods", errCode);
+        }
+    }
+
+    public void calculateEdgeDerivatives(int[] postBufferIndices,
+                                         int[] preBufferIndices,
+                                         int[] probabilityIndices,
+                                         int[] derivativeMatrixIndices,
+                                         int[] categoryWeightsIndices,
+                                         int count,
+                                         double[] outDerivatives,
+                                         double[] outSumDerivatives) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateEdgeDerivatives(instance,
+                postBufferIndices,
+                preBufferIndices,
+                probabilityIndices,
+                derivativeMatrixIndices,
+                categoryWeightsIndices,
+                count,
+                outDerivatives,
+                outSumDerivatives);
+        if (errCode != 0) {
+            throw new BeagleException("calculateEdgeDerivatives", errCode);
+        }
+    }
+
     public InstanceDetails getDetails() {
         return details;
     }
@@ -5,6 +5,8 @@
 
 package beagle;
 
+import java.nio.DoubleBuffer;
+import java.nio.IntBuffer;
 
 /*
  * BeagleJNIjava
@@ -30,6 +32,17 @@ public class BeagleJNIWrapper {
 
     public native ResourceDetails[] getResourceList();
 
+    public native int compressPatterns(int taxonCount,
+                                       int siteCount,
+                                       final int[] inSiteStates,
+                                       final double[] inSiteWeights,
+                                       final int[] inSitePartitions,
+                                       int[] outPatternCount,
+                                       int[] outPatternStates,
+                                       double[] outPatternWeights,
+                                       int[] outPatternPartitions,
+                                       int[] outSitePatterns);
+
     public native int createInstance(
             int tipCount,
             int partialsBufferCount,
@@ -52,16 +65,49 @@ public class BeagleJNIWrapper {
 
     public native int setPatternPartitions(int instance, int partitionCount, final int[] patternPartitions);
 
+    public native int setCPUThreadCount(int instance, int threadCount);
+
+    public native int setTransitionMatrixCacheSize(int instance, int cacheSize);
+
+    public native int setIncrementalUpdates(int instance, int enabled);
+
+    public native int setExponentScaling(int instance, int enabled);
+
+    public native int setAdaptiveRescaling(int instance, int enabled);
+
+    public native int setSiteRepeats(int instance, int enabled);
+
+    public native int setPartialsBackingDirectory(int instance, String directory);
+
+    public native int setOperationGraphs(int instance, int enabled);
+
     public native int setTipStates(int instance, int tipIndex, final int[] inStates);
 
+    public native int setTipStateSets(int instance, int tipIndex, final int[] inStateSets);
+
     public native int getTipStates(int instance, int tipIndex, final int[] inStates);
 
     public native int setTipPartials(int instance, int tipIndex, final double[] inPartials);
 
+    public native int setTipStatesBatch(int instance, final int[] tipIndices, final int[] inStates, int count);
+
+    public native int setTipPartialsBatch(int instance, final int[] tipIndices, final double[] inPartials, int count);
+
     public native int setPartials(int instance, int bufferIndex, final double[] inPartials);
 
+    public native int setPartialsDirect(int instance, int bufferIndex, final DoubleBuffer inPartials);
+
     public native int getPartials(int instance, int bufferIndex, int scaleIndex,
                                   final double[] outPartials);
+
+    public native int getPartialsDirect(int instance, int bufferIndex, int scaleIndex,
+                                        final DoubleBuffer outPartials);
+
+    public native int releasePartials(int instance, int bufferIndex);
+
+    public native int saveState(int instance);
+
+    public native int restoreState(int instance);
     
     public native int getLogScaleFactors(int stance, int scaleIndex, final double[] outFactors);
 
@@ -88,8 +134,13 @@ public class BeagleJNIWrapper {
 
     public native int setTransitionMatrix(int instance, int matrixIndex, final double[] inMatrix, double paddedValue);
 
+    public native int setTransitionMatrixDirect(int instance, int matrixIndex, final DoubleBuffer inMatrix,
+                                                double paddedValue);
+
     public native int getTransitionMatrix(int instance, int matrixIndex, final double[] outMatrix);
 
+    public native int getTransitionMatrixDirect(int instance, int matrixIndex, final DoubleBuffer outMatrix);
+
 	public native int convolveTransitionMatrices(int instance,
 			                                     final int[] firstIndices, 
 			                                     final int[] secondIndices,
@@ -118,6 +169,26 @@ public class BeagleJNIWrapper {
                                      int operationCount,
                                      int cumulativeScalingIndex);
 
+    public native int updatePartialsDirect(final int instance,
+                                           final IntBuffer operations,
+                                           int operationCount,
+                                           int cumulativeScalingIndex);
+
+    public native int updatePartialsForTrees(final int instance,
+                                             final int[] operations,
+                                             final int[] operationCounts,
+                                             int treeCount,
+                                             final int[] cumulativeScaleIndices);
+
+    public native int setRootPrePartials(final int instance,
+                                         final int[] bufferIndices,
+                                         final int[] stateFrequenciesIndices,
+                                         int count);
+
+    public native int updatePrePartials(final int instance,
+                                        final int[] operations,
+                                        int operationCount);
+
     public native int updatePartialsByPartition(final int instance,
                                                 final int[] operations,
                                                 int operationCount);
@@ -167,6 +238,33 @@ public class BeagleJNIWrapper {
                                                   int count,
                                                   final double[] outSumLogLikelihood);
 
+    public native int calculateRootLogLikelihoodsAsync(int instance,
+                                                       final int[] bufferIndices,
+                                                       final int[] categoryWeightsIndices,
+                                                       final int[] stateFrequenciesIndices,
+                                                       final int[] cumulativeScaleIndices,
+                                                       int count,
+                                                       int resultIndex);
+
+    public native int getLogLikelihoodResults(int instance,
+                                              final int[] resultIndices,
+                                              int count,
+                                              final double[] outSumLogLikelihoods);
+
+    public native int calculateRootLogLikelihoodsForTrees(int instance,
+                                                          final int[] bufferIndices,
+                                                          final int[] categoryWeightsIndices,
+                                                          final int[] stateFrequenciesIndices,
+                                                          final int[] cumulativeScaleIndices,
+                                                          int treeCount,
+                                                          final double[] outSumLogLikelihoods);
+
+    public native int executeCommands(final int[] instances,
+                                      final int[] commands,
+                                      int commandLength,
+                                      final double[] values,
+                                      final double[] outSumLogLikelihoods);
+
     public native int calculateRootLogLikelihoodsByPartition(int instance,
                                                   final int[] bufferIndices,
                                                   final int[] categoryWeightsIndices,
@@ -195,6 +293,19 @@ public class BeagleJNIWrapper {
     public native int getSiteLogLikelihoods(final int instance,
                                             final double[] outLogLikelihoods);
 
+    public native int getSiteLogLikelihoodsDirect(final int instance,
+                                                  final DoubleBuffer outLogLikelihoods);
+
+    public native int calculateEdgeDerivatives(final int instance,
+                                               final int[] postBufferIndices,
+                                               final int[] preBufferIndices,
+                                               final int[] probabilityIndices,
+                                               final int[] derivativeMatrixIndices,
+                                               final int[] categoryWeightsIndices,
+                                               int count,
+                                               final double[] outDerivatives,
+                                               final double[] outSumDerivatives);
+
     /* Library loading routines */
 
     private static String getPlatformSpecificLibraryName()
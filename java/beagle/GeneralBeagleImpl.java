@@ -1,5 +1,8 @@
 package beagle;
 
+import java.nio.DoubleBuffer;
+import java.nio.IntBuffer;
+
 public class GeneralBeagleImpl implements Beagle {
 
     public static final boolean DEBUG = false;
@@ -34,6 +37,8 @@ public class GeneralBeagleImpl implements Beagle {
     protected double[] patternWeights;
     protected double[][] partials;
     protected int[][] scalingFactorCounts;
+    protected double[][] savedPartials;
+    protected int[][] savedScalingFactorCounts;
 
     protected int[][] tipStates;
 
@@ -137,6 +142,46 @@ public class GeneralBeagleImpl implements Beagle {
     public void setPatternPartitions(int partitionCount, int[] patternPartitions) {
         throw new UnsupportedOperationException("Not implemented yet");
     }
+
+    @Override
+    public void setCPUThreadCount(int threadCount) {
+        // this implementation is single threaded
+    }
+
+    @Override
+    public void setTransitionMatrixCacheSize(int cacheSize) {
+        // this implementation does not cache transition matrices
+    }
+
+    @Override
+    public void setIncrementalUpdates(boolean enabled) {
+        // this implementation always computes every operation
+    }
+
+    @Override
+    public void setExponentScaling(boolean enabled) {
+        // this implementation always rescales by powers of two
+    }
+
+    @Override
+    public void setAdaptiveRescaling(boolean enabled) {
+        // this implementation always rescales every pattern
+    }
+
+    @Override
+    public void setSiteRepeats(boolean enabled) {
+        // this implementation always computes every pattern
+    }
+
+    @Override
+    public void setPartialsBackingDirectory(String directory) {
+        // this implementation keeps its buffers in the Java heap
+    }
+
+    @Override
+    public void setOperationGraphs(boolean enabled) {
+        // this implementation has no kernel launches to replay
+    }
     /**
      * Sets partials for a tip - these are numbered from 0 and remain
      * constant throughout the run.
@@ -157,6 +202,21 @@ public class GeneralBeagleImpl implements Beagle {
 
     }
 
+    public void setTipStateSets(int tipIndex, int[] stateSets) {
+        assert(tipIndex >= 0 && tipIndex < tipCount);
+        // this implementation keeps ambiguous tips as partials
+        final int allStates = (stateCount < 31 ? (1 << stateCount) - 1 : 0x7fffffff);
+        double[] tipPartials = new double[patternCount * stateCount];
+        for (int k = 0; k < patternCount; k++) {
+            int stateSet = stateSets[k] & allStates;
+            for (int s = 0; s < stateCount; s++) {
+                tipPartials[k * stateCount + s] = (stateSet == 0 || ((stateSet >> s) & 1) != 0 ? 1.0 : 0.0);
+            }
+        }
+        tipStates[tipIndex] = null;
+        setTipPartials(tipIndex, tipPartials);
+    }
+
     public void getTipStates(int tipIndex, int[] states) {
         assert(tipIndex >= 0 && tipIndex < tipCount);
         if (this.tipStates[tipIndex] == null) {
@@ -177,15 +237,81 @@ public class GeneralBeagleImpl implements Beagle {
         }
     }
 
+    public void setTipStatesBatch(final int[] tipIndices, final int[] inStates, final int count) {
+        for (int i = 0; i < count; i++) {
+            setTipStates(tipIndices[i], java.util.Arrays.copyOfRange(inStates, i * patternCount, (i + 1) * patternCount));
+        }
+    }
+
+    public void setTipPartialsBatch(final int[] tipIndices, final double[] inPartials, final int count) {
+        final int tipSize = patternCount * stateCount;
+        for (int i = 0; i < count; i++) {
+            setTipPartials(tipIndices[i], java.util.Arrays.copyOfRange(inPartials, i * tipSize, (i + 1) * tipSize));
+        }
+    }
+
     public void setPartials(final int bufferIndex, final double[] partials) {
         assert(this.partials[bufferIndex] != null);
         System.arraycopy(partials, 0, this.partials[bufferIndex], 0, partialsSize);
     }
 
+    public void setPartials(final int bufferIndex, final DoubleBuffer partials) {
+        assert(this.partials[bufferIndex] != null);
+        final DoubleBuffer source = partials.duplicate();
+        source.clear();
+        source.get(this.partials[bufferIndex], 0, partialsSize);
+    }
+
     public void getPartials(final int bufferIndex, final int scaleIndex, final double[] partials) {
         System.arraycopy(this.partials[bufferIndex], 0, partials, 0, partialsSize);
     }
 
+    public void getPartials(final int bufferIndex, final int scaleIndex, final DoubleBuffer partials) {
+        final DoubleBuffer destination = partials.duplicate();
+        destination.clear();
+        destination.put(this.partials[bufferIndex], 0, partialsSize);
+    }
+
+    @Override
+    public void releasePartials(final int bufferIndex) {
+        // partials buffers are allocated up front by this implementation
+    }
+
+    @Override
+    public void saveState() {
+        // this implementation keeps a full copy of the buffers
+        savedPartials = copyOf(partials);
+        if (scalingFactorCounts != null) {
+            savedScalingFactorCounts = new int[scalingFactorCounts.length][];
+            for (int i = 0; i < scalingFactorCounts.length; i++) {
+                savedScalingFactorCounts[i] = scalingFactorCounts[i].clone();
+            }
+        }
+    }
+
+    @Override
+    public void restoreState() {
+        if (savedPartials == null) {
+            throw new IllegalStateException("restoreState called before saveState");
+        }
+        partials = copyOf(savedPartials);
+        if (scalingFactorCounts != null) {
+            for (int i = 0; i < scalingFactorCounts.length; i++) {
+                scalingFactorCounts[i] = savedScalingFactorCounts[i].clone();
+            }
+        }
+    }
+
+    private static double[][] copyOf(double[][] buffers) {
+        double[][] copy = new double[buffers.length][];
+        for (int i = 0; i < buffers.length; i++) {
+            if (buffers[i] != null) {
+                copy[i] = buffers[i].clone();
+            }
+        }
+        return copy;
+    }
+
     @Override
     public void getLogScaleFactors(int scaleIndex, double[] outFactors) {
         throw new UnsupportedOperationException("Not implemented. Email Marc Suchard if required (offer coauthorship for enhanced service)");
@@ -228,10 +354,22 @@ public class GeneralBeagleImpl implements Beagle {
         System.arraycopy(inMatrix, 0, this.matrices[matrixIndex], 0, this.matrixSize);
     }
 
+    public void setTransitionMatrix(final int matrixIndex, final DoubleBuffer inMatrix, final double paddedValue) {
+        final DoubleBuffer source = inMatrix.duplicate();
+        source.clear();
+        source.get(this.matrices[matrixIndex], 0, this.matrixSize);
+    }
+
     public void getTransitionMatrix(final int matrixIndex, final double[] outMatrix) {
         System.arraycopy(this.matrices[matrixIndex],0,outMatrix,0,outMatrix.length);
     }
 
+    public void getTransitionMatrix(final int matrixIndex, final DoubleBuffer outMatrix) {
+        final DoubleBuffer destination = outMatrix.duplicate();
+        destination.clear();
+        destination.put(this.matrices[matrixIndex], 0, destination.capacity());
+    }
+
     
 	// /////////////////////////
 	// ---TODO: Epoch model---//
@@ -385,6 +523,24 @@ public class GeneralBeagleImpl implements Beagle {
         }
     }
 
+    public void updatePartials(final IntBuffer operations, final int operationCount, final int cumulativeScaleIndex) {
+        final int[] operationArray = new int[operationCount * Beagle.OPERATION_TUPLE_SIZE];
+        final IntBuffer source = operations.duplicate();
+        source.clear();
+        source.get(operationArray);
+        updatePartials(operationArray, operationCount, cumulativeScaleIndex);
+    }
+
+    public void updatePartialsForTrees(final int[] operations, final int[] operationCounts, final int treeCount, final int[] cumulativeScaleIndices) {
+        int offset = 0;
+        for (int t = 0; t < treeCount; t++) {
+            int length = operationCounts[t] * Beagle.OPERATION_TUPLE_SIZE;
+            updatePartials(java.util.Arrays.copyOfRange(operations, offset, offset + length), operationCounts[t],
+                    cumulativeScaleIndices == null ? Beagle.NONE : cumulativeScaleIndices[t]);
+            offset += length;
+        }
+    }
+
     /**
      * Operations list is a list of 9-tuple integer indices, with one 7-tuple per operation.
      * Format of 9-tuple operation: {destinationPartials,
@@ -774,6 +930,70 @@ public class GeneralBeagleImpl implements Beagle {
 
     }
 
+    public void calculateRootLogLikelihoodsAsync(final int[] bufferIndices, final int[] categoryWeightsIndices, final int[] stateFrequenciesIndices, final int[] cumulativeScaleIndices, final int count, final int resultIndex) {
+        throw new UnsupportedOperationException("calculateRootLogLikelihoodsAsync not implemented in GeneralBeagleImpl");
+    }
+
+    public void getLogLikelihoodResults(final int[] resultIndices, final int count, final double[] outSumLogLikelihoods) {
+        throw new UnsupportedOperationException("getLogLikelihoodResults not implemented in GeneralBeagleImpl");
+    }
+
+    public void calculateRootLogLikelihoodsForTrees(final int[] bufferIndices, final int[] categoryWeightsIndices, final int[] stateFrequenciesIndices, final int[] cumulativeScaleIndices, final int treeCount, final double[] outSumLogLikelihoods) {
+        double[] sumLogLikelihood = new double[1];
+        for (int t = 0; t < treeCount; t++) {
+            calculateRootLogLikelihoods(new int[] { bufferIndices[t] }, new int[] { categoryWeightsIndices[t] },
+                    new int[] { stateFrequenciesIndices[t] }, new int[] { cumulativeScaleIndices[t] }, 1, sumLogLikelihood);
+            outSumLogLikelihoods[t] = sumLogLikelihood[0];
+        }
+    }
+
+    public void executeCommands(final Beagle[] instances, final int[] commands, final int commandLength, final double[] values, final double[] outSumLogLikelihoods) {
+        // there is no native crossing to save here, so the commands are run one call at a time
+        int c = 0;
+        int v = 0;
+        int r = 0;
+        double[] sumLogLikelihood = new double[1];
+        while (c < commandLength) {
+            final int code = commands[c];
+            final Beagle instance = instances[commands[c + 1]];
+            final int a = c + 2;
+            if (code == Beagle.COMMAND_UPDATE_TRANSITION_MATRICES) {
+                final int count = commands[a + 1];
+                instance.updateTransitionMatrices(commands[a], java.util.Arrays.copyOfRange(commands, a + 2, a + 2 + count),
+                        null, null, java.util.Arrays.copyOfRange(values, v, v + count), count);
+                v += count;
+                c = a + 2 + count;
+            } else if (code == Beagle.COMMAND_UPDATE_PARTIALS) {
+                final int length = commands[a] * Beagle.OPERATION_TUPLE_SIZE;
+                instance.updatePartials(java.util.Arrays.copyOfRange(commands, a + 2, a + 2 + length), commands[a], commands[a + 1]);
+                c = a + 2 + length;
+            } else if (code == Beagle.COMMAND_RESET_SCALE_FACTORS) {
+                instance.resetScaleFactors(commands[a]);
+                c = a + 1;
+            } else if (code == Beagle.COMMAND_ACCUMULATE_SCALE_FACTORS || code == Beagle.COMMAND_REMOVE_SCALE_FACTORS) {
+                final int count = commands[a];
+                final int[] scaleIndices = java.util.Arrays.copyOfRange(commands, a + 2, a + 2 + count);
+                if (code == Beagle.COMMAND_ACCUMULATE_SCALE_FACTORS) {
+                    instance.accumulateScaleFactors(scaleIndices, count, commands[a + 1]);
+                } else {
+                    instance.removeScaleFactors(scaleIndices, count, commands[a + 1]);
+                }
+                c = a + 2 + count;
+            } else if (code == Beagle.COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS) {
+                final int count = commands[a];
+                final int b = a + 1;
+                instance.calculateRootLogLikelihoods(java.util.Arrays.copyOfRange(commands, b, b + count),
+                        java.util.Arrays.copyOfRange(commands, b + count, b + 2 * count),
+                        java.util.Arrays.copyOfRange(commands, b + 2 * count, b + 3 * count),
+                        java.util.Arrays.copyOfRange(commands, b + 3 * count, b + 4 * count), count, sumLogLikelihood);
+                outSumLogLikelihoods[r++] = sumLogLikelihood[0];
+                c = b + 4 * count;
+            } else {
+                throw new IllegalArgumentException("Unknown command " + code);
+            }
+        }
+    }
+
     public void calculateRootLogLikelihoodsByPartition(final int[] bufferIndices, final int[] categoryWeightsIndices, final int[] stateFrequenciesIndices, final int[] cumulativeScaleIndices, final int[] partitionIndices, final int partitionCount, final int count, final double[] outSumLogLikelihoodByPartition, final double[] outSumLogLikelihood) {
         throw new UnsupportedOperationException("calculateRootLogLikelihoodsByPartition not implemented in GeneralBeagleImpl");
     }
@@ -786,6 +1006,24 @@ public class GeneralBeagleImpl implements Beagle {
         throw new UnsupportedOperationException("getSiteLogLikelihoods not implemented in GeneralBeagleImpl");
     }
 
+    public void getSiteLogLikelihoods(final DoubleBuffer outLogLikelihoods) {
+        throw new UnsupportedOperationException("getSiteLogLikelihoods not implemented in GeneralBeagleImpl");
+    }
+
+    public void setRootPrePartials(final int[] bufferIndices, final int[] stateFrequenciesIndices, final int count) {
+        throw new UnsupportedOperationException("setRootPrePartials not implemented in GeneralBeagleImpl");
+    }
+
+    public void updatePrePartials(final int[] operations, final int operationCount) {
+        throw new UnsupportedOperationException("updatePrePartials not implemented in GeneralBeagleImpl");
+    }
+
+    public void calculateEdgeDerivatives(int[] postBufferIndices, int[] preBufferIndices, int[] probabilityIndices,
+                                         int[] derivativeMatrixIndices, int[] categoryWeightsIndices, int count,
+                                         double[] outDerivatives, double[] outSumDerivatives) {
+        throw new UnsupportedOperationException("calculateEdgeDerivatives not implemented in GeneralBeagleImpl");
+    }
+
 
     public InstanceDetails getDetails() {
         InstanceDetails details = new InstanceDetails();
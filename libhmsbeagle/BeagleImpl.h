@@ -28,6 +28,9 @@
 #ifndef __beagle_impl__
 #define __beagle_impl__
 
+#include <algorithm>
+#include <vector>
+
 #include "libhmsbeagle/beagle.h"
 
 #ifdef DOUBLE_PRECISION
@@ -38,6 +41,19 @@
 
 namespace beagle {
 
+// Shape of an instance and the work counted against it by the API in beagle.cpp
+struct InstanceStatistics {
+    int stateCount;
+    int patternCount;
+    int categoryCount;
+    int realSize; // bytes per value at the instance's precision
+    BeagleCallStatistics calls[BEAGLE_STATISTIC_COUNT];
+
+    double tipPartialsSize() const { return (double) patternCount * stateCount; }
+    double partialsSize() const { return (double) patternCount * stateCount * categoryCount; }
+    double matrixSize() const { return (double) stateCount * stateCount * categoryCount; }
+};
+
 class BeagleImpl
 {
 public:
@@ -54,8 +70,8 @@ public:
                                int scaleBufferCount,
                                int resourceNumber,
                                int pluginResourceNumber,
-                               long preferenceFlags,
-                               long requirementFlags) = 0;
+                               long long preferenceFlags,
+                               long long requirementFlags) = 0;
     
     virtual int getInstanceDetails(BeagleInstanceDetails* returnInfo) = 0;
     
@@ -64,6 +80,23 @@ public:
 
     virtual int setTipPartials(int tipIndex,
                                const double* inPartials) = 0;
+
+    virtual int setTipStateSets(int tipIndex,
+                                const int* inStateSets) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setTipStatesBatch(const int* tipIndices,
+                                  const int* inStates,
+                                  int count) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setTipPartialsBatch(const int* tipIndices,
+                                    const double* inPartials,
+                                    int count) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
     
     virtual int setPartials(int bufferIndex,
                             const double* inPartials) = 0;
@@ -71,6 +104,47 @@ public:
     virtual int getPartials(int bufferIndex,
 							int scaleIndex,
                             double* outPartials) = 0;
+
+    virtual int releasePartials(int bufferIndex) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    // buffers already in the instance's precision and padded layout, and views of its own
+    virtual int getBufferLayout(BeagleBufferLayout* outLayout) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setTipPartialsNative(int tipIndex,
+                                     const void* inPartials) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setPartialsNative(int bufferIndex,
+                                  const void* inPartials) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int getPartialsView(int bufferIndex,
+                                const void** outPartials) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setTransitionMatrixNative(int matrixIndex,
+                                          const void* inMatrix) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int getSiteLogLikelihoodsView(const void** outLogLikelihoods) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int saveState() {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int restoreState() {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
     
     virtual int setEigenDecomposition(int eigenIndex,
                                       const double* inEigenVectors,
@@ -87,6 +161,46 @@ public:
 
     virtual int setPatternPartitions(int partitionCount,
                                      const int* inPatternPartitions) = 0;
+
+    virtual int setCPUThreadCount(int threadCount) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setTransitionMatrixCacheSize(int cacheSize) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setIncrementalUpdates(int enabled) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setExponentScaling(int enabled) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setAdaptiveRescaling(int enabled) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setSiteRepeats(int enabled) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setPartialsBackingDirectory(const char* directory) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int getScalingStatistics(BeagleScalingStatistics* outStatistics) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int resetScalingStatistics() {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int setOperationGraphs(int enabled) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
     
     virtual int setCategoryRates(const double* inCategoryRates) = 0;
 
@@ -135,7 +249,101 @@ public:
 
     virtual int updatePartialsByPartition(const int* operations,
                                           int operationCount) = 0;
+
+    // the operations of independent trees, back to back; the default sorts them by depth so the
+    // trees run interleaved in one updatePartials call
+    virtual int updatePartialsForTrees(const int* operations,
+                                       const int* operationCounts,
+                                       int treeCount,
+                                       const int* cumulativeScaleIndices) {
+        const int numOps = BEAGLE_OP_COUNT;
+
+        int operationCount = 0;
+        for (int t = 0; t < treeCount; t++)
+            operationCount += operationCounts[t];
+
+        BeagleInstanceDetails details;
+        int returnCode = getInstanceDetails(&details);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+
+        // dynamic and always-scaling edit the cumulative buffer during pruning, so trees that
+        // accumulate factors are updated one after another
+        if (cumulativeScaleIndices != NULL &&
+            (details.flags & (BEAGLE_FLAG_SCALING_DYNAMIC | BEAGLE_FLAG_SCALING_ALWAYS))) {
+            const int* treeOperations = operations;
+            for (int t = 0; t < treeCount && returnCode == BEAGLE_SUCCESS; t++) {
+                returnCode = updatePartials(treeOperations, operationCounts[t], cumulativeScaleIndices[t]);
+                treeOperations += operationCounts[t] * numOps;
+            }
+            return returnCode;
+        }
+
+        if (operationCount == 0)
+            return BEAGLE_SUCCESS;
+
+        int bufferCount = 0;
+        for (int op = 0; op < operationCount; op++) {
+            const int* o = &operations[op * numOps];
+            bufferCount = (std::max)(bufferCount, (std::max)(o[0], (std::max)(o[3], o[5])) + 1);
+        }
+
+        // an operation comes one level after those writing its children, and after any that
+        // read or wrote its destination before it; ties put operations of the same kind together
+        std::vector<int> writeLevels(bufferCount, -1);
+        std::vector<int> readLevels(bufferCount, -1);
+        std::vector<std::pair<std::pair<int, int>, int> > order(operationCount);
+        for (int op = 0; op < operationCount; op++) {
+            const int* o = &operations[op * numOps];
+            int level = (std::max)(writeLevels[o[0]], readLevels[o[0]]);
+            level = (std::max)(level, (std::max)(writeLevels[o[3]], writeLevels[o[5]])) + 1;
+            const int inputChildren = (writeLevels[o[3]] < 0) + (writeLevels[o[5]] < 0);
+            writeLevels[o[0]] = level;
+            readLevels[o[3]] = (std::max)(readLevels[o[3]], level);
+            readLevels[o[5]] = (std::max)(readLevels[o[5]], level);
+            order[op] = std::make_pair(std::make_pair(level, -inputChildren), op);
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<int> interleaved(operationCount * numOps);
+        for (int op = 0; op < operationCount; op++)
+            std::copy(&operations[order[op].second * numOps], &operations[(order[op].second + 1) * numOps],
+                      &interleaved[op * numOps]);
+
+        returnCode = updatePartials(&interleaved[0], operationCount, BEAGLE_OP_NONE);
+
+        // auto-scaling keeps its own factors
+        if (returnCode == BEAGLE_SUCCESS && cumulativeScaleIndices != NULL &&
+            !(details.flags & BEAGLE_FLAG_SCALING_AUTO)) {
+            std::vector<int> scaleIndices;
+            const int* treeOperations = operations;
+            for (int t = 0; t < treeCount && returnCode == BEAGLE_SUCCESS; t++) {
+                scaleIndices.clear();
+                for (int op = 0; op < operationCounts[t]; op++) {
+                    if (treeOperations[op * numOps + 1] >= 0)
+                        scaleIndices.push_back(treeOperations[op * numOps + 1]);
+                }
+                if (cumulativeScaleIndices[t] != BEAGLE_OP_NONE && !scaleIndices.empty())
+                    returnCode = accumulateScaleFactors(&scaleIndices[0], (int) scaleIndices.size(),
+                                                        cumulativeScaleIndices[t]);
+                treeOperations += operationCounts[t] * numOps;
+            }
+        }
+
+        return returnCode;
+    }
     
+    virtual int setRootPrePartials(const int* bufferIndices,
+                                   const int* stateFrequenciesIndices,
+                                   int count) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int updatePrePartials(const int* operations,
+                                  int operationCount) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
     virtual int waitForPartials(const int* destinationPartials,
                                 int destinationPartialsCount) = 0;
     
@@ -175,6 +383,114 @@ public:
                                             int count,
                                             double* outSumLogLikelihood) = 0;
 
+    virtual int calculateRootLogLikelihoodsAsync(const int* bufferIndices,
+                                                 const int* categoryWeightsIndices,
+                                                 const int* stateFrequenciesIndices,
+                                                 const int* cumulativeScaleIndices,
+                                                 int count,
+                                                 int resultIndex) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    virtual int getLogLikelihoodResults(const int* resultIndices,
+                                        int count,
+                                        double* outSumLogLikelihoods) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
+
+    // one log likelihood per root; goes through the result slots where there are any, in
+    // batches of BEAGLE_RESULT_SLOT_COUNT
+    virtual int calculateRootLogLikelihoodsForTrees(const int* bufferIndices,
+                                                    const int* categoryWeightsIndices,
+                                                    const int* stateFrequenciesIndices,
+                                                    const int* cumulativeScaleIndices,
+                                                    int treeCount,
+                                                    double* outSumLogLikelihoods) {
+        if (treeCount <= 0)
+            return BEAGLE_SUCCESS;
+
+        bool floatingPoint = false;
+
+        int returnCode = calculateRootLogLikelihoodsAsync(&bufferIndices[0], &categoryWeightsIndices[0],
+                                                          &stateFrequenciesIndices[0],
+                                                          &cumulativeScaleIndices[0], 1, 0);
+        if (returnCode == BEAGLE_ERROR_NO_IMPLEMENTATION) {
+            for (int t = 0; t < treeCount; t++) {
+                returnCode = calculateRootLogLikelihoods(&bufferIndices[t], &categoryWeightsIndices[t],
+                                                         &stateFrequenciesIndices[t],
+                                                         &cumulativeScaleIndices[t], 1,
+                                                         &outSumLogLikelihoods[t]);
+                if (returnCode == BEAGLE_ERROR_FLOATING_POINT)
+                    floatingPoint = true;
+                else if (returnCode != BEAGLE_SUCCESS)
+                    return returnCode;
+            }
+            return (floatingPoint ? BEAGLE_ERROR_FLOATING_POINT : BEAGLE_SUCCESS);
+        }
+
+        const int slotCount = BEAGLE_RESULT_SLOT_COUNT;
+        std::vector<int> resultIndices((std::min)(slotCount, treeCount));
+        for (size_t i = 0; i < resultIndices.size(); i++)
+            resultIndices[i] = (int) i;
+
+        for (int start = 0; start < treeCount && returnCode == BEAGLE_SUCCESS; start += slotCount) {
+            const int count = (std::min)(slotCount, treeCount - start);
+            for (int t = (start == 0 ? 1 : 0); t < count && returnCode == BEAGLE_SUCCESS; t++)
+                returnCode = calculateRootLogLikelihoodsAsync(&bufferIndices[start + t],
+                                                              &categoryWeightsIndices[start + t],
+                                                              &stateFrequenciesIndices[start + t],
+                                                              &cumulativeScaleIndices[start + t], 1, t);
+            if (returnCode == BEAGLE_SUCCESS)
+                returnCode = getLogLikelihoodResults(&resultIndices[0], count, &outSumLogLikelihoods[start]);
+            if (returnCode == BEAGLE_ERROR_FLOATING_POINT) {
+                floatingPoint = true;
+                returnCode = BEAGLE_SUCCESS;
+            }
+        }
+
+        if (returnCode == BEAGLE_SUCCESS && floatingPoint)
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
+        return returnCode;
+    }
+
+    // one whole evaluation; implementations may override to fuse the steps
+    virtual int evaluateTree(int eigenIndex,
+                             const int* probabilityIndices,
+                             const double* edgeLengths,
+                             int edgeCount,
+                             const int* operations,
+                             int operationCount,
+                             const int* scaleIndices,
+                             int scaleCount,
+                             int cumulativeScaleIndex,
+                             int rootBufferIndex,
+                             int categoryWeightsIndex,
+                             int stateFrequenciesIndex,
+                             double* outSumLogLikelihood) {
+        int returnCode = BEAGLE_SUCCESS;
+        if (edgeCount > 0)
+            returnCode = updateTransitionMatrices(eigenIndex, probabilityIndices, 0, 0,
+                                                  edgeLengths, edgeCount);
+
+        // listed scale buffers are summed after pruning, otherwise pruning
+        // accumulates into the cumulative buffer itself
+        if (returnCode == BEAGLE_SUCCESS)
+            returnCode = updatePartials(operations, operationCount,
+                                        (scaleCount > 0 ? BEAGLE_OP_NONE : cumulativeScaleIndex));
+        if (returnCode == BEAGLE_SUCCESS && scaleCount > 0) {
+            if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+                returnCode = resetScaleFactors(cumulativeScaleIndex);
+            if (returnCode == BEAGLE_SUCCESS)
+                returnCode = accumulateScaleFactors(scaleIndices, scaleCount, cumulativeScaleIndex);
+        }
+
+        if (returnCode == BEAGLE_SUCCESS)
+            returnCode = calculateRootLogLikelihoods(&rootBufferIndex, &categoryWeightsIndex,
+                                                     &stateFrequenciesIndex, &cumulativeScaleIndex,
+                                                     1, outSumLogLikelihood);
+        return returnCode;
+    }
+
     virtual int calculateRootLogLikelihoodsByPartition(const int* bufferIndices,
                                                        const int* categoryWeightsIndices,
                                                        const int* stateFrequenciesIndices,
@@ -216,12 +532,61 @@ public:
                                                        double* outSumSecondDerivativeByPartition,
                                                        double* outSumSecondDerivative) = 0;
     
+    // one log likelihood and derivatives per edge, rather than their sum; the default, which GPU
+    // instances and any without BEAGLE_FLAG_MULTI_EDGE use, evaluates the edges one at a time
+    virtual int calculateMultiEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                 const int* childBufferIndices,
+                                                 const int* probabilityIndices,
+                                                 const int* firstDerivativeIndices,
+                                                 const int* secondDerivativeIndices,
+                                                 const int* categoryWeightsIndices,
+                                                 const int* stateFrequenciesIndices,
+                                                 const int* cumulativeScaleIndices,
+                                                 int count,
+                                                 double* outLogLikelihoods,
+                                                 double* outFirstDerivatives,
+                                                 double* outSecondDerivatives) {
+        bool floatingPoint = false;
+        for (int e = 0; e < count; e++) {
+            const bool firstDerivative = (firstDerivativeIndices != NULL && outFirstDerivatives != NULL);
+            const bool secondDerivative = (firstDerivative && secondDerivativeIndices != NULL &&
+                                           outSecondDerivatives != NULL);
+            int returnCode = calculateEdgeLogLikelihoods(&parentBufferIndices[e], &childBufferIndices[e],
+                                                         &probabilityIndices[e],
+                                                         (firstDerivative ? &firstDerivativeIndices[e] : NULL),
+                                                         (secondDerivative ? &secondDerivativeIndices[e] : NULL),
+                                                         &categoryWeightsIndices[e], &stateFrequenciesIndices[e],
+                                                         &cumulativeScaleIndices[e], 1, &outLogLikelihoods[e],
+                                                         (firstDerivative ? &outFirstDerivatives[e] : NULL),
+                                                         (secondDerivative ? &outSecondDerivatives[e] : NULL));
+            if (returnCode == BEAGLE_ERROR_FLOATING_POINT)
+                floatingPoint = true;
+            else if (returnCode != BEAGLE_SUCCESS)
+                return returnCode;
+        }
+        return (floatingPoint ? BEAGLE_ERROR_FLOATING_POINT : BEAGLE_SUCCESS);
+    }
+
     virtual int getSiteLogLikelihoods(double* outLogLikelihoods) = 0;
     
     virtual int getSiteDerivatives(double* outFirstDerivatives,
                                    double* outSecondDerivatives) = 0;
+
+    virtual int calculateEdgeDerivatives(const int* postBufferIndices,
+                                         const int* preBufferIndices,
+                                         const int* probabilityIndices,
+                                         const int* derivativeMatrixIndices,
+                                         const int* categoryWeightsIndices,
+                                         int count,
+                                         double* outDerivatives,
+                                         double* outSumDerivatives) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
 //protected:
     int resourceNumber;
+    int instanceNumber;
+
+    InstanceStatistics statistics;
 };
 
 class BeagleImplFactory {
@@ -237,13 +602,31 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode) = 0; // pure virtual
     
     virtual const char* getName() = 0; // pure virtual
-    
-    virtual const long getFlags() = 0; // pure virtual
+
+    virtual const long long getFlags() = 0; // pure virtual
+
+    // bytes an instance created by createImpl with the same arguments would hold, without creating it
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes) {
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
 };
 
 } // end namespace beagle
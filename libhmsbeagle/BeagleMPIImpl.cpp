@@ -0,0 +1,156 @@
+/*
+ *  BeagleMPIImpl.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#ifdef HAVE_MPI
+
+#include <climits>
+
+#include "libhmsbeagle/BeagleMPIImpl.h"
+
+namespace beagle {
+
+namespace {
+
+int getRank(MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+}
+
+}   // namespace
+
+BeagleMPIImpl::BeagleMPIImpl(BeagleImpl* localShard,
+                             const std::vector<int>& inPatternOffsets,
+                             int stateCount,
+                             int categoryCount,
+                             MPI_Comm jobComm) :
+    BeagleShardedImpl(std::vector<BeagleImpl*>(1, localShard), inPatternOffsets,
+                      stateCount, categoryCount, getRank(jobComm)) {
+    MPI_Comm_dup(jobComm, &comm);
+
+    const int processCount = (int) patternOffsets.size() - 1;
+    hGatherCounts.resize(processCount);
+    hGatherOffsets.resize(processCount);
+}
+
+BeagleMPIImpl::~BeagleMPIImpl() {
+    // the client may have shut MPI down before finalizing the instance
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+        MPI_Comm_free(&comm);
+}
+
+int BeagleMPIImpl::reduceSums(double** sums,
+                              const int* sizes,
+                              int count,
+                              int returnCode) {
+    hReduceSums.clear();
+    for (int i = 0; i < count; i++) {
+        if (sums[i] != NULL)
+            hReduceSums.insert(hReduceSums.end(), sums[i], sums[i] + sizes[i]);
+    }
+
+    // the return codes travel beside the sums; the most negative error is kept
+    int jobReturnCode;
+    MPI_Request requests[2];
+    MPI_Iallreduce(&returnCode, &jobReturnCode, 1, MPI_INT, MPI_MIN, comm, &requests[0]);
+    MPI_Iallreduce(MPI_IN_PLACE, (hReduceSums.empty() ? NULL : &hReduceSums[0]), (int) hReduceSums.size(),
+                   MPI_DOUBLE, MPI_SUM, comm, &requests[1]);
+    MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        if (sums[i] != NULL) {
+            std::copy(&hReduceSums[offset], &hReduceSums[offset] + sizes[i], sums[i]);
+            offset += sizes[i];
+        }
+    }
+    return jobReturnCode;
+}
+
+int BeagleMPIImpl::gatherPatterns(double* values,
+                                  int blockCount,
+                                  int valuesPerPattern,
+                                  int returnCode) {
+    const int processCount = (int) hGatherCounts.size();
+    for (int p = 0; p < processCount; p++) {
+        hGatherCounts[p] = (patternOffsets[p + 1] - patternOffsets[p]) * valuesPerPattern;
+        hGatherOffsets[p] = patternOffsets[p] * valuesPerPattern;
+    }
+
+    const size_t blockSize = (size_t) patternOffsets.back() * valuesPerPattern;
+    for (int b = 0; b < blockCount; b++)
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, values + b * blockSize,
+                       &hGatherCounts[0], &hGatherOffsets[0], MPI_DOUBLE, comm);
+
+    int jobReturnCode;
+    MPI_Allreduce(&returnCode, &jobReturnCode, 1, MPI_INT, MPI_MIN, comm);
+    return jobReturnCode;
+}
+
+int BeagleMPIImpl::getScalingStatistics(BeagleScalingStatistics* outStatistics) {
+    BeagleScalingStatistics local;
+    int returnCode = BeagleShardedImpl::getScalingStatistics(&local);
+
+    int jobReturnCode;
+    MPI_Allreduce(&returnCode, &jobReturnCode, 1, MPI_INT, MPI_MIN, comm);
+    if (jobReturnCode != BEAGLE_SUCCESS)
+        return jobReturnCode;
+
+    // combined as BeagleShardedImpl combines its shards, minima as maxima of negatives
+    const bool examined = (local.patternCount > 0);
+    long long maxima[4] = {local.passCount,
+                           -local.unchangedPassCount,
+                           (examined ? local.maxExponent : LLONG_MIN),
+                           (examined ? -local.minExponent : LLONG_MIN)};
+    long long counts[3] = {local.patternCount,
+                           local.rescaledPatternCount,
+                           local.nearUnderflowPatternCount};
+    double exponentSum = local.exponentSum;
+    MPI_Allreduce(MPI_IN_PLACE, maxima, 4, MPI_LONG_LONG, MPI_MAX, comm);
+    MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_LONG_LONG, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &exponentSum, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+    BeagleScalingStatistics total = BeagleScalingStatistics();
+    total.passCount = maxima[0];
+    total.unchangedPassCount = -maxima[1];
+    total.patternCount = counts[0];
+    total.rescaledPatternCount = counts[1];
+    total.nearUnderflowPatternCount = counts[2];
+    if (total.patternCount > 0) {
+        total.maxExponent = (int) maxima[2];
+        total.minExponent = (int) -maxima[3];
+    }
+    total.exponentSum = exponentSum;
+    *outStatistics = total;
+    return BEAGLE_SUCCESS;
+}
+
+} // end namespace beagle
+
+#endif // HAVE_MPI
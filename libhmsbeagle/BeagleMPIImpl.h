@@ -0,0 +1,89 @@
+/*
+ *  BeagleMPIImpl.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @brief Instance that spreads its patterns over the processes of an MPI job
+ *
+ * Every process runs the same client, making the same calls with the same
+ * arguments, and holds one contiguous block of patterns in a local instance on
+ * its own resource. Pattern-indexed inputs are sliced where they are given and
+ * everything else is already replicated, so only results travel: likelihood
+ * sums are added with MPI_Allreduce and pattern values are gathered with
+ * MPI_Allgatherv, so that every process returns the whole result.
+ */
+
+#ifndef __beagle_mpi_impl__
+#define __beagle_mpi_impl__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#ifdef HAVE_MPI
+
+// the C interface only; the C++ bindings declare a REAL, which BeagleImpl.h defines
+#define OMPI_SKIP_MPICXX 1
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+#include <vector>
+
+#include "libhmsbeagle/BeagleShardedImpl.h"
+
+namespace beagle {
+
+class BeagleMPIImpl : public BeagleShardedImpl
+{
+private:
+    MPI_Comm comm;                  // a duplicate of the job's, so the instance's messages stay apart
+
+    std::vector<double> hReduceSums;    // staging for the outputs of one reduction
+    std::vector<int> hGatherCounts;
+    std::vector<int> hGatherOffsets;
+
+public:
+    // patternOffsets holds the first pattern of every process, plus the total
+    BeagleMPIImpl(BeagleImpl* localShard,
+                  const std::vector<int>& inPatternOffsets,
+                  int stateCount,
+                  int categoryCount,
+                  MPI_Comm jobComm);
+
+    virtual ~BeagleMPIImpl();
+
+    int getScalingStatistics(BeagleScalingStatistics* outStatistics);
+
+protected:
+    int reduceSums(double** sums,
+                   const int* sizes,
+                   int count,
+                   int returnCode);
+
+    int gatherPatterns(double* values,
+                       int blockCount,
+                       int valuesPerPattern,
+                       int returnCode);
+};
+
+} // end namespace beagle
+
+#endif // HAVE_MPI
+
+#endif // __beagle_mpi_impl__
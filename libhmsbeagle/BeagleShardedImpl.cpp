@@ -0,0 +1,798 @@
+/*
+ *  BeagleShardedImpl.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstring>
+#include <algorithm>
+
+#include "libhmsbeagle/BeagleShardedImpl.h"
+
+namespace beagle {
+
+BeagleShardedImpl::BeagleShardedImpl(const std::vector<BeagleImpl*>& inShards,
+                                     const std::vector<int>& inPatternOffsets,
+                                     int stateCount,
+                                     int categoryCount,
+                                     int inFirstShard) :
+    shards(inShards),
+    patternOffsets(inPatternOffsets),
+    firstShard(inFirstShard),
+    kStateCount(stateCount),
+    kCategoryCount(categoryCount) {
+
+    int maxShardPatternCount = 0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        if (shardPatternCount(s) > maxShardPatternCount)
+            maxShardPatternCount = shardPatternCount(s);
+    }
+    hShardPartials.resize((size_t) maxShardPatternCount * kStateCount * kCategoryCount);
+
+    resourceNumber = shards[0]->resourceNumber;
+}
+
+BeagleShardedImpl::~BeagleShardedImpl() {
+    for (size_t s = 0; s < shards.size(); s++)
+        delete shards[s];
+}
+
+int BeagleShardedImpl::shardPatternCount(int shard) {
+    return patternOffsets[firstShard + shard + 1] - patternOffsets[firstShard + shard];
+}
+
+void BeagleShardedImpl::addPartitionSums(double* outSums,
+                                         const double* shardSums,
+                                         int partitionCount) {
+    for (int i = 0; i < partitionCount; i++)
+        outSums[i] += shardSums[i];
+}
+
+int BeagleShardedImpl::createInstance(int tipCount,
+                                      int partialsBufferCount,
+                                      int compactBufferCount,
+                                      int stateCount,
+                                      int patternCount,
+                                      int eigenBufferCount,
+                                      int matrixBufferCount,
+                                      int categoryCount,
+                                      int scaleBufferCount,
+                                      int resourceNumber,
+                                      int pluginResourceNumber,
+                                      long long preferenceFlags,
+                                      long long requirementFlags) {
+    // shards are created by beagleCreateShardedInstance
+    return BEAGLE_ERROR_GENERAL;
+}
+
+int BeagleShardedImpl::getInstanceDetails(BeagleInstanceDetails* returnInfo) {
+    return shards[0]->getInstanceDetails(returnInfo);
+}
+
+int BeagleShardedImpl::setTipStates(int tipIndex,
+                                    const int* inStates) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTipStates(tipIndex, inStates + patternOffsets[firstShard + s]);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTipPartials(int tipIndex,
+                                      const double* inPartials) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTipPartials(tipIndex, inPartials + (size_t) patternOffsets[firstShard + s] * kStateCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTipStateSets(int tipIndex,
+                                       const int* inStateSets) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTipStateSets(tipIndex, inStateSets + patternOffsets[firstShard + s]);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTipStatesBatch(const int* tipIndices,
+                                         const int* inStates,
+                                         int count) {
+    // each shard takes its own slice of every tip, so tips go one at a time
+    const int patternCount = patternOffsets.back();
+    int returnCode = BEAGLE_SUCCESS;
+    for (int i = 0; i < count && returnCode == BEAGLE_SUCCESS; i++)
+        returnCode = setTipStates(tipIndices[i], inStates + (size_t) i * patternCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTipPartialsBatch(const int* tipIndices,
+                                           const double* inPartials,
+                                           int count) {
+    const int patternCount = patternOffsets.back();
+    int returnCode = BEAGLE_SUCCESS;
+    for (int i = 0; i < count && returnCode == BEAGLE_SUCCESS; i++)
+        returnCode = setTipPartials(tipIndices[i], inPartials + (size_t) i * patternCount * kStateCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setPartials(int bufferIndex,
+                                   const double* inPartials) {
+    const int patternCount = patternOffsets.back();
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++) {
+        // partials are laid out by category, so each category is sliced
+        const size_t shardSize = (size_t) shardPatternCount(s) * kStateCount;
+        for (int l = 0; l < kCategoryCount; l++) {
+            memcpy(&hShardPartials[l * shardSize],
+                   inPartials + ((size_t) l * patternCount + patternOffsets[firstShard + s]) * kStateCount,
+                   sizeof(double) * shardSize);
+        }
+        returnCode = shards[s]->setPartials(bufferIndex, &hShardPartials[0]);
+    }
+    return returnCode;
+}
+
+int BeagleShardedImpl::getPartials(int bufferIndex,
+                                   int scaleIndex,
+                                   double* outPartials) {
+    const int patternCount = patternOffsets.back();
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++) {
+        returnCode = shards[s]->getPartials(bufferIndex, scaleIndex, &hShardPartials[0]);
+        const size_t shardSize = (size_t) shardPatternCount(s) * kStateCount;
+        for (int l = 0; l < kCategoryCount; l++) {
+            memcpy(outPartials + ((size_t) l * patternCount + patternOffsets[firstShard + s]) * kStateCount,
+                   &hShardPartials[l * shardSize],
+                   sizeof(double) * shardSize);
+        }
+    }
+    return gatherPatterns(outPartials, kCategoryCount, kStateCount, returnCode);
+}
+
+int BeagleShardedImpl::setPatternWeights(const double* inPatternWeights) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setPatternWeights(inPatternWeights + patternOffsets[firstShard + s]);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setPatternPartitions(int partitionCount,
+                                            const int* inPatternPartitions) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setPatternPartitions(partitionCount, inPatternPartitions + patternOffsets[firstShard + s]);
+    return returnCode;
+}
+
+int BeagleShardedImpl::getTransitionMatrix(int matrixIndex,
+                                           double* outMatrix) {
+    // matrices are replicated, so any shard holds them
+    return shards[0]->getTransitionMatrix(matrixIndex, outMatrix);
+}
+
+int BeagleShardedImpl::releasePartials(int bufferIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->releasePartials(bufferIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::saveState() {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->saveState();
+    return returnCode;
+}
+
+int BeagleShardedImpl::restoreState() {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->restoreState();
+    return returnCode;
+}
+
+int BeagleShardedImpl::setEigenDecomposition(int eigenIndex,
+                                             const double* inEigenVectors,
+                                             const double* inInverseEigenVectors,
+                                             const double* inEigenValues) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setEigenDecomposition(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setStateFrequencies(int stateFrequenciesIndex,
+                                           const double* inStateFrequencies) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setStateFrequencies(stateFrequenciesIndex, inStateFrequencies);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setCategoryWeights(int categoryWeightsIndex,
+                                          const double* inCategoryWeights) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setCategoryWeights(categoryWeightsIndex, inCategoryWeights);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setCPUThreadCount(int threadCount) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setCPUThreadCount(threadCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTransitionMatrixCacheSize(int cacheSize) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTransitionMatrixCacheSize(cacheSize);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setIncrementalUpdates(int enabled) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setIncrementalUpdates(enabled);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setExponentScaling(int enabled) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setExponentScaling(enabled);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setAdaptiveRescaling(int enabled) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setAdaptiveRescaling(enabled);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setSiteRepeats(int enabled) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setSiteRepeats(enabled);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setPartialsBackingDirectory(const char* directory) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setPartialsBackingDirectory(directory);
+    return returnCode;
+}
+
+int BeagleShardedImpl::getScalingStatistics(BeagleScalingStatistics* outStatistics) {
+    BeagleScalingStatistics total = BeagleScalingStatistics();
+    for (size_t s = 0; s < shards.size(); s++) {
+        BeagleScalingStatistics shard;
+        int returnCode = shards[s]->getScalingStatistics(&shard);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+        // the shards each run a part of the same passes, which are unchanged where no part changed
+        total.passCount = std::max(total.passCount, shard.passCount);
+        total.unchangedPassCount = (s > 0 ? std::min(total.unchangedPassCount, shard.unchangedPassCount) : shard.unchangedPassCount);
+        if (shard.patternCount > 0) {
+            total.minExponent = (total.patternCount > 0 ? std::min(total.minExponent, shard.minExponent) : shard.minExponent);
+            total.maxExponent = (total.patternCount > 0 ? std::max(total.maxExponent, shard.maxExponent) : shard.maxExponent);
+        }
+        total.patternCount += shard.patternCount;
+        total.rescaledPatternCount += shard.rescaledPatternCount;
+        total.nearUnderflowPatternCount += shard.nearUnderflowPatternCount;
+        total.exponentSum += shard.exponentSum;
+    }
+    *outStatistics = total;
+    return BEAGLE_SUCCESS;
+}
+
+int BeagleShardedImpl::resetScalingStatistics() {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->resetScalingStatistics();
+    return returnCode;
+}
+
+int BeagleShardedImpl::setOperationGraphs(int enabled) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setOperationGraphs(enabled);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setCategoryRates(const double* inCategoryRates) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setCategoryRates(inCategoryRates);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setCategoryRatesWithIndex(int categoryRatesIndex,
+                                                 const double* inCategoryRates) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setCategoryRatesWithIndex(categoryRatesIndex, inCategoryRates);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTransitionMatrix(int matrixIndex,
+                                           const double* inMatrix,
+                                           double paddedValue) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTransitionMatrix(matrixIndex, inMatrix, paddedValue);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setTransitionMatrices(const int* matrixIndices,
+                                             const double* inMatrices,
+                                             const double* paddedValues,
+                                             int count) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setTransitionMatrices(matrixIndices, inMatrices, paddedValues, count);
+    return returnCode;
+}
+
+int BeagleShardedImpl::convolveTransitionMatrices(const int* firstIndices,
+                                                  const int* secondIndices,
+                                                  const int* resultIndices,
+                                                  int matrixCount) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->convolveTransitionMatrices(firstIndices, secondIndices, resultIndices, matrixCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::updateTransitionMatrices(int eigenIndex,
+                                                const int* probabilityIndices,
+                                                const int* firstDerivativeIndices,
+                                                const int* secondDerivativeIndices,
+                                                const double* edgeLengths,
+                                                int count) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->updateTransitionMatrices(eigenIndex, probabilityIndices, firstDerivativeIndices, secondDerivativeIndices, edgeLengths, count);
+    return returnCode;
+}
+
+int BeagleShardedImpl::updateTransitionMatricesWithMultipleModels(const int* eigenIndices,
+                                                                  const int* categoryRateIndices,
+                                                                  const int* probabilityIndices,
+                                                                  const int* firstDerivativeIndices,
+                                                                  const int* secondDerivativeIndices,
+                                                                  const double* edgeLengths,
+                                                                  int count) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->updateTransitionMatricesWithMultipleModels(eigenIndices, categoryRateIndices, probabilityIndices, firstDerivativeIndices, secondDerivativeIndices, edgeLengths, count);
+    return returnCode;
+}
+
+int BeagleShardedImpl::updatePartials(const int* operations,
+                                      int operationCount,
+                                      int cumulativeScalingIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->updatePartials(operations, operationCount, cumulativeScalingIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::updatePartialsByPartition(const int* operations,
+                                                 int operationCount) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->updatePartialsByPartition(operations, operationCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::waitForPartials(const int* destinationPartials,
+                                       int destinationPartialsCount) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->waitForPartials(destinationPartials, destinationPartialsCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::accumulateScaleFactors(const int* scalingIndices,
+                                              int count,
+                                              int cumulativeScalingIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->accumulateScaleFactors(scalingIndices, count, cumulativeScalingIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::accumulateScaleFactorsByPartition(const int* scaleIndices,
+                                                         int count,
+                                                         int cumulativeScaleIndex,
+                                                         int partitionIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->accumulateScaleFactorsByPartition(scaleIndices, count, cumulativeScaleIndex, partitionIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::removeScaleFactors(const int* scalingIndices,
+                                          int count,
+                                          int cumulativeScalingIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->removeScaleFactors(scalingIndices, count, cumulativeScalingIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::removeScaleFactorsByPartition(const int* scaleIndices,
+                                                     int count,
+                                                     int cumulativeScaleIndex,
+                                                     int partitionIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->removeScaleFactorsByPartition(scaleIndices, count, cumulativeScaleIndex, partitionIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::resetScaleFactors(int cumulativeScalingIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->resetScaleFactors(cumulativeScalingIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::resetScaleFactorsByPartition(int cumulativeScaleIndex,
+                                                    int partitionIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->resetScaleFactorsByPartition(cumulativeScaleIndex, partitionIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::copyScaleFactors(int destScalingIndex,
+                                        int srcScalingIndex) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->copyScaleFactors(destScalingIndex, srcScalingIndex);
+    return returnCode;
+}
+
+int BeagleShardedImpl::getScaleFactors(int srcScalingIndex,
+                                       double* scaleFactors) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->getScaleFactors(srcScalingIndex, scaleFactors + patternOffsets[firstShard + s]);
+    return gatherPatterns(scaleFactors, 1, 1, returnCode);
+}
+
+// Every shard computes its own sums, so the cross-shard reduction is a few
+// host-side additions after each shard's transfer, and reduceSums adds those
+// of shards held elsewhere. All shards are evaluated even if one reports an
+// error, and the first error is returned.
+
+int BeagleShardedImpl::calculateRootLogLikelihoods(const int* bufferIndices,
+                                                   const int* categoryWeightsIndices,
+                                                   const int* stateFrequenciesIndices,
+                                                   const int* scalingFactorsIndices,
+                                                   int count,
+                                                   double* outSumLogLikelihood) {
+    int returnCode = BEAGLE_SUCCESS;
+    *outSumLogLikelihood = 0.0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        double shardLogLikelihood;
+        int shardCode = shards[s]->calculateRootLogLikelihoods(bufferIndices, categoryWeightsIndices,
+                                                               stateFrequenciesIndices, scalingFactorsIndices,
+                                                               count, &shardLogLikelihood);
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        *outSumLogLikelihood += shardLogLikelihood;
+    }
+    double* sums[] = {outSumLogLikelihood};
+    int sizes[] = {1};
+    return reduceSums(sums, sizes, 1, returnCode);
+}
+
+int BeagleShardedImpl::calculateRootLogLikelihoodsByPartition(const int* bufferIndices,
+                                                              const int* categoryWeightsIndices,
+                                                              const int* stateFrequenciesIndices,
+                                                              const int* cumulativeScaleIndices,
+                                                              const int* partitionIndices,
+                                                              int partitionCount,
+                                                              int count,
+                                                              double* outSumLogLikelihoodByPartition,
+                                                              double* outSumLogLikelihood) {
+    int returnCode = BEAGLE_SUCCESS;
+    hShardSums.resize(partitionCount);
+    *outSumLogLikelihood = 0.0;
+    for (int i = 0; i < partitionCount; i++)
+        outSumLogLikelihoodByPartition[i] = 0.0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        double shardLogLikelihood;
+        int shardCode = shards[s]->calculateRootLogLikelihoodsByPartition(bufferIndices, categoryWeightsIndices,
+                                                                          stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                          partitionIndices, partitionCount, count,
+                                                                          &hShardSums[0], &shardLogLikelihood);
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        addPartitionSums(outSumLogLikelihoodByPartition, &hShardSums[0], partitionCount);
+        *outSumLogLikelihood += shardLogLikelihood;
+    }
+    double* sums[] = {outSumLogLikelihoodByPartition, outSumLogLikelihood};
+    int sizes[] = {partitionCount, 1};
+    return reduceSums(sums, sizes, 2, returnCode);
+}
+
+int BeagleShardedImpl::calculateEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                   const int* childBufferIndices,
+                                                   const int* probabilityIndices,
+                                                   const int* firstDerivativeIndices,
+                                                   const int* secondDerivativeIndices,
+                                                   const int* categoryWeightsIndices,
+                                                   const int* stateFrequenciesIndices,
+                                                   const int* scalingFactorsIndices,
+                                                   int count,
+                                                   double* outSumLogLikelihood,
+                                                   double* outSumFirstDerivative,
+                                                   double* outSumSecondDerivative) {
+    const bool firstDerivatives  = (firstDerivativeIndices != NULL && outSumFirstDerivative != NULL);
+    const bool secondDerivatives = (secondDerivativeIndices != NULL && outSumSecondDerivative != NULL);
+    int returnCode = BEAGLE_SUCCESS;
+    *outSumLogLikelihood = 0.0;
+    if (firstDerivatives)
+        *outSumFirstDerivative = 0.0;
+    if (secondDerivatives)
+        *outSumSecondDerivative = 0.0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        double shardLogLikelihood;
+        double shardFirstDerivative = 0.0;
+        double shardSecondDerivative = 0.0;
+        int shardCode = shards[s]->calculateEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
+                                                               probabilityIndices, firstDerivativeIndices,
+                                                               secondDerivativeIndices, categoryWeightsIndices,
+                                                               stateFrequenciesIndices, scalingFactorsIndices,
+                                                               count, &shardLogLikelihood,
+                                                               &shardFirstDerivative, &shardSecondDerivative);
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        *outSumLogLikelihood += shardLogLikelihood;
+        if (firstDerivatives)
+            *outSumFirstDerivative += shardFirstDerivative;
+        if (secondDerivatives)
+            *outSumSecondDerivative += shardSecondDerivative;
+    }
+    double* sums[] = {outSumLogLikelihood,
+                      (firstDerivatives ? outSumFirstDerivative : NULL),
+                      (secondDerivatives ? outSumSecondDerivative : NULL)};
+    int sizes[] = {1, 1, 1};
+    return reduceSums(sums, sizes, 3, returnCode);
+}
+
+int BeagleShardedImpl::calculateEdgeLogLikelihoodsByPartition(const int* parentBufferIndices,
+                                                              const int* childBufferIndices,
+                                                              const int* probabilityIndices,
+                                                              const int* firstDerivativeIndices,
+                                                              const int* secondDerivativeIndices,
+                                                              const int* categoryWeightsIndices,
+                                                              const int* stateFrequenciesIndices,
+                                                              const int* cumulativeScaleIndices,
+                                                              const int* partitionIndices,
+                                                              int partitionCount,
+                                                              int count,
+                                                              double* outSumLogLikelihoodByPartition,
+                                                              double* outSumLogLikelihood,
+                                                              double* outSumFirstDerivativeByPartition,
+                                                              double* outSumFirstDerivative,
+                                                              double* outSumSecondDerivativeByPartition,
+                                                              double* outSumSecondDerivative) {
+    const bool firstDerivatives  = (firstDerivativeIndices != NULL && outSumFirstDerivative != NULL);
+    const bool secondDerivatives = (secondDerivativeIndices != NULL && outSumSecondDerivative != NULL);
+    int returnCode = BEAGLE_SUCCESS;
+    hShardSums.resize(partitionCount * 3);
+    double* shardLogLikelihoodByPartition    = &hShardSums[0];
+    double* shardFirstDerivativeByPartition  = &hShardSums[partitionCount];
+    double* shardSecondDerivativeByPartition = &hShardSums[partitionCount * 2];
+    *outSumLogLikelihood = 0.0;
+    for (int i = 0; i < partitionCount; i++)
+        outSumLogLikelihoodByPartition[i] = 0.0;
+    if (firstDerivatives) {
+        *outSumFirstDerivative = 0.0;
+        for (int i = 0; i < partitionCount; i++)
+            outSumFirstDerivativeByPartition[i] = 0.0;
+    }
+    if (secondDerivatives) {
+        *outSumSecondDerivative = 0.0;
+        for (int i = 0; i < partitionCount; i++)
+            outSumSecondDerivativeByPartition[i] = 0.0;
+    }
+    for (size_t s = 0; s < shards.size(); s++) {
+        double shardLogLikelihood;
+        double shardFirstDerivative = 0.0;
+        double shardSecondDerivative = 0.0;
+        int shardCode = shards[s]->calculateEdgeLogLikelihoodsByPartition(parentBufferIndices, childBufferIndices,
+                                                                          probabilityIndices, firstDerivativeIndices,
+                                                                          secondDerivativeIndices, categoryWeightsIndices,
+                                                                          stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                          partitionIndices, partitionCount, count,
+                                                                          shardLogLikelihoodByPartition, &shardLogLikelihood,
+                                                                          shardFirstDerivativeByPartition, &shardFirstDerivative,
+                                                                          shardSecondDerivativeByPartition, &shardSecondDerivative);
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        addPartitionSums(outSumLogLikelihoodByPartition, shardLogLikelihoodByPartition, partitionCount);
+        *outSumLogLikelihood += shardLogLikelihood;
+        if (firstDerivatives) {
+            addPartitionSums(outSumFirstDerivativeByPartition, shardFirstDerivativeByPartition, partitionCount);
+            *outSumFirstDerivative += shardFirstDerivative;
+        }
+        if (secondDerivatives) {
+            addPartitionSums(outSumSecondDerivativeByPartition, shardSecondDerivativeByPartition, partitionCount);
+            *outSumSecondDerivative += shardSecondDerivative;
+        }
+    }
+    double* sums[] = {outSumLogLikelihoodByPartition, outSumLogLikelihood,
+                      (firstDerivatives ? outSumFirstDerivativeByPartition : NULL),
+                      (firstDerivatives ? outSumFirstDerivative : NULL),
+                      (secondDerivatives ? outSumSecondDerivativeByPartition : NULL),
+                      (secondDerivatives ? outSumSecondDerivative : NULL)};
+    int sizes[] = {partitionCount, 1, partitionCount, 1, partitionCount, 1};
+    return reduceSums(sums, sizes, 6, returnCode);
+}
+
+int BeagleShardedImpl::calculateMultiEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                        const int* childBufferIndices,
+                                                        const int* probabilityIndices,
+                                                        const int* firstDerivativeIndices,
+                                                        const int* secondDerivativeIndices,
+                                                        const int* categoryWeightsIndices,
+                                                        const int* stateFrequenciesIndices,
+                                                        const int* cumulativeScaleIndices,
+                                                        int count,
+                                                        double* outLogLikelihoods,
+                                                        double* outFirstDerivatives,
+                                                        double* outSecondDerivatives) {
+    if (count <= 0)
+        return BEAGLE_SUCCESS;
+
+    const bool firstDerivatives  = (firstDerivativeIndices != NULL && outFirstDerivatives != NULL);
+    const bool secondDerivatives = (firstDerivatives && secondDerivativeIndices != NULL &&
+                                    outSecondDerivatives != NULL);
+    int returnCode = BEAGLE_SUCCESS;
+    hShardSums.resize(count * 3);
+    double* shardLogLikelihoods    = &hShardSums[0];
+    double* shardFirstDerivatives  = &hShardSums[count];
+    double* shardSecondDerivatives = &hShardSums[count * 2];
+    for (int n = 0; n < count; n++) {
+        outLogLikelihoods[n] = 0.0;
+        if (firstDerivatives)
+            outFirstDerivatives[n] = 0.0;
+        if (secondDerivatives)
+            outSecondDerivatives[n] = 0.0;
+    }
+    for (size_t s = 0; s < shards.size(); s++) {
+        int shardCode = shards[s]->calculateMultiEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
+                                                                    probabilityIndices, firstDerivativeIndices,
+                                                                    secondDerivativeIndices, categoryWeightsIndices,
+                                                                    stateFrequenciesIndices, cumulativeScaleIndices,
+                                                                    count, shardLogLikelihoods,
+                                                                    (firstDerivatives ? shardFirstDerivatives : NULL),
+                                                                    (secondDerivatives ? shardSecondDerivatives : NULL));
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        if (shardCode != BEAGLE_SUCCESS && shardCode != BEAGLE_ERROR_FLOATING_POINT)
+            break;
+        addPartitionSums(outLogLikelihoods, shardLogLikelihoods, count);
+        if (firstDerivatives)
+            addPartitionSums(outFirstDerivatives, shardFirstDerivatives, count);
+        if (secondDerivatives)
+            addPartitionSums(outSecondDerivatives, shardSecondDerivatives, count);
+    }
+    double* sums[] = {outLogLikelihoods,
+                      (firstDerivatives ? outFirstDerivatives : NULL),
+                      (secondDerivatives ? outSecondDerivatives : NULL)};
+    int sizes[] = {count, count, count};
+    return reduceSums(sums, sizes, 3, returnCode);
+}
+
+int BeagleShardedImpl::getSiteLogLikelihoods(double* outLogLikelihoods) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->getSiteLogLikelihoods(outLogLikelihoods + patternOffsets[firstShard + s]);
+    return gatherPatterns(outLogLikelihoods, 1, 1, returnCode);
+}
+
+int BeagleShardedImpl::getSiteDerivatives(double* outFirstDerivatives,
+                                          double* outSecondDerivatives) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->getSiteDerivatives(outFirstDerivatives + patternOffsets[firstShard + s],
+                                                   (outSecondDerivatives != NULL ?
+                                                    outSecondDerivatives + patternOffsets[firstShard + s] : NULL));
+    returnCode = gatherPatterns(outFirstDerivatives, 1, 1, returnCode);
+    if (outSecondDerivatives != NULL)
+        returnCode = gatherPatterns(outSecondDerivatives, 1, 1, returnCode);
+    return returnCode;
+}
+
+int BeagleShardedImpl::setRootPrePartials(const int* bufferIndices,
+                                          const int* stateFrequenciesIndices,
+                                          int count) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->setRootPrePartials(bufferIndices, stateFrequenciesIndices, count);
+    return returnCode;
+}
+
+int BeagleShardedImpl::updatePrePartials(const int* operations,
+                                         int operationCount) {
+    int returnCode = BEAGLE_SUCCESS;
+    for (size_t s = 0; s < shards.size() && returnCode == BEAGLE_SUCCESS; s++)
+        returnCode = shards[s]->updatePrePartials(operations, operationCount);
+    return returnCode;
+}
+
+int BeagleShardedImpl::calculateEdgeDerivatives(const int* postBufferIndices,
+                                                const int* preBufferIndices,
+                                                const int* probabilityIndices,
+                                                const int* derivativeMatrixIndices,
+                                                const int* categoryWeightsIndices,
+                                                int count,
+                                                double* outDerivatives,
+                                                double* outSumDerivatives) {
+    if (count <= 0)
+        return BEAGLE_SUCCESS;
+
+    int returnCode = BEAGLE_SUCCESS;
+    const int patternCount = patternOffsets.back();
+    std::vector<double> shardDerivatives;
+    std::vector<double> shardSums(count);
+    for (int n = 0; n < count; n++)
+        outSumDerivatives[n] = 0.0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        const int shardPatterns = shardPatternCount((int) s);
+        if (outDerivatives != NULL)
+            shardDerivatives.resize(count * shardPatterns);
+        int shardCode = shards[s]->calculateEdgeDerivatives(postBufferIndices, preBufferIndices,
+                                                            probabilityIndices, derivativeMatrixIndices,
+                                                            categoryWeightsIndices, count,
+                                                            (outDerivatives != NULL ? &shardDerivatives[0] : NULL),
+                                                            &shardSums[0]);
+        if (shardCode != BEAGLE_SUCCESS && returnCode == BEAGLE_SUCCESS)
+            returnCode = shardCode;
+        if (shardCode != BEAGLE_SUCCESS && shardCode != BEAGLE_ERROR_FLOATING_POINT)
+            break;
+        for (int n = 0; n < count; n++) {
+            outSumDerivatives[n] += shardSums[n];
+            if (outDerivatives != NULL)
+                memcpy(outDerivatives + n * patternCount + patternOffsets[firstShard + s],
+                       &shardDerivatives[n * shardPatterns], sizeof(double) * shardPatterns);
+        }
+    }
+    if (outDerivatives != NULL)
+        returnCode = gatherPatterns(outDerivatives, count, 1, returnCode);
+    double* sums[] = {outSumDerivatives};
+    int sizes[] = {count};
+    return reduceSums(sums, sizes, 1, returnCode);
+}
+
+} // end namespace beagle
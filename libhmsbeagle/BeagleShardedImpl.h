@@ -0,0 +1,332 @@
+/*
+ *  BeagleShardedImpl.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @brief Instance that spreads its patterns over several resources
+ *
+ * Each shard is a complete instance holding a contiguous block of patterns.
+ * Pattern-indexed data is sliced between the shards, everything else is
+ * replicated on every shard, and likelihood sums are added across shards.
+ * The shards may be a block of those of an instance spread over processes,
+ * which fills in the sums and pattern values of the others.
+ */
+
+#ifndef __beagle_sharded_impl__
+#define __beagle_sharded_impl__
+
+#include <vector>
+
+#include "libhmsbeagle/BeagleImpl.h"
+
+namespace beagle {
+
+class BeagleShardedImpl : public BeagleImpl
+{
+protected:
+    std::vector<BeagleImpl*> shards;
+    std::vector<int> patternOffsets;    // first pattern of each shard, plus the total
+    int firstShard;                     // shard in patternOffsets of shards[0]
+
+    int kStateCount;
+    int kCategoryCount;
+
+    std::vector<double> hShardPartials; // staging for per-shard partials
+    std::vector<double> hShardSums;     // staging for per-shard partition sums
+
+public:
+    BeagleShardedImpl(const std::vector<BeagleImpl*>& inShards,
+                      const std::vector<int>& inPatternOffsets,
+                      int stateCount,
+                      int categoryCount,
+                      int inFirstShard = 0);
+
+    virtual ~BeagleShardedImpl();
+
+    int createInstance(int tipCount,
+                       int partialsBufferCount,
+                       int compactBufferCount,
+                       int stateCount,
+                       int patternCount,
+                       int eigenBufferCount,
+                       int matrixBufferCount,
+                       int categoryCount,
+                       int scaleBufferCount,
+                       int resourceNumber,
+                       int pluginResourceNumber,
+                       long long preferenceFlags,
+                       long long requirementFlags);
+
+    int getInstanceDetails(BeagleInstanceDetails* returnInfo);
+
+    int setTipStates(int tipIndex,
+                     const int* inStates);
+
+    int setTipPartials(int tipIndex,
+                       const double* inPartials);
+
+    int setTipStateSets(int tipIndex,
+                        const int* inStateSets);
+
+    int setTipStatesBatch(const int* tipIndices,
+                          const int* inStates,
+                          int count);
+
+    int setTipPartialsBatch(const int* tipIndices,
+                            const double* inPartials,
+                            int count);
+
+    int setPartials(int bufferIndex,
+                    const double* inPartials);
+
+    int getPartials(int bufferIndex,
+                    int scaleIndex,
+                    double* outPartials);
+
+    int releasePartials(int bufferIndex);
+
+    int saveState();
+
+    int restoreState();
+
+    int setEigenDecomposition(int eigenIndex,
+                              const double* inEigenVectors,
+                              const double* inInverseEigenVectors,
+                              const double* inEigenValues);
+
+    int setStateFrequencies(int stateFrequenciesIndex,
+                            const double* inStateFrequencies);
+
+    int setCategoryWeights(int categoryWeightsIndex,
+                           const double* inCategoryWeights);
+
+    int setPatternWeights(const double* inPatternWeights);
+
+    int setPatternPartitions(int partitionCount,
+                             const int* inPatternPartitions);
+
+    int setCPUThreadCount(int threadCount);
+
+    int setTransitionMatrixCacheSize(int cacheSize);
+
+    int setIncrementalUpdates(int enabled);
+
+    int setExponentScaling(int enabled);
+
+    int setAdaptiveRescaling(int enabled);
+
+    int setSiteRepeats(int enabled);
+
+    int setPartialsBackingDirectory(const char* directory);
+
+    int getScalingStatistics(BeagleScalingStatistics* outStatistics);
+
+    int resetScalingStatistics();
+
+    int setOperationGraphs(int enabled);
+
+    int setCategoryRates(const double* inCategoryRates);
+
+    int setCategoryRatesWithIndex(int categoryRatesIndex,
+                                  const double* inCategoryRates);
+
+    int setTransitionMatrix(int matrixIndex,
+                            const double* inMatrix,
+                            double paddedValue);
+
+    int setTransitionMatrices(const int* matrixIndices,
+                              const double* inMatrices,
+                              const double* paddedValues,
+                              int count);
+
+    int getTransitionMatrix(int matrixIndex,
+                            double* outMatrix);
+
+    int convolveTransitionMatrices(const int* firstIndices,
+                                   const int* secondIndices,
+                                   const int* resultIndices,
+                                   int matrixCount);
+
+    int updateTransitionMatrices(int eigenIndex,
+                                 const int* probabilityIndices,
+                                 const int* firstDerivativeIndices,
+                                 const int* secondDerivativeIndices,
+                                 const double* edgeLengths,
+                                 int count);
+
+    int updateTransitionMatricesWithMultipleModels(const int* eigenIndices,
+                                                   const int* categoryRateIndices,
+                                                   const int* probabilityIndices,
+                                                   const int* firstDerivativeIndices,
+                                                   const int* secondDerivativeIndices,
+                                                   const double* edgeLengths,
+                                                   int count);
+
+    int updatePartials(const int* operations,
+                       int operationCount,
+                       int cumulativeScalingIndex);
+
+    int updatePartialsByPartition(const int* operations,
+                                  int operationCount);
+
+    int waitForPartials(const int* destinationPartials,
+                        int destinationPartialsCount);
+
+    int accumulateScaleFactors(const int* scalingIndices,
+                               int count,
+                               int cumulativeScalingIndex);
+
+    int accumulateScaleFactorsByPartition(const int* scaleIndices,
+                                          int count,
+                                          int cumulativeScaleIndex,
+                                          int partitionIndex);
+
+    int removeScaleFactors(const int* scalingIndices,
+                           int count,
+                           int cumulativeScalingIndex);
+
+    int removeScaleFactorsByPartition(const int* scaleIndices,
+                                      int count,
+                                      int cumulativeScaleIndex,
+                                      int partitionIndex);
+
+    int resetScaleFactors(int cumulativeScalingIndex);
+
+    int resetScaleFactorsByPartition(int cumulativeScaleIndex,
+                                     int partitionIndex);
+
+    int copyScaleFactors(int destScalingIndex,
+                         int srcScalingIndex);
+
+    int getScaleFactors(int srcScalingIndex,
+                        double* scaleFactors);
+
+    int calculateRootLogLikelihoods(const int* bufferIndices,
+                                    const int* categoryWeightsIndices,
+                                    const int* stateFrequenciesIndices,
+                                    const int* scalingFactorsIndices,
+                                    int count,
+                                    double* outSumLogLikelihood);
+
+    int calculateRootLogLikelihoodsByPartition(const int* bufferIndices,
+                                               const int* categoryWeightsIndices,
+                                               const int* stateFrequenciesIndices,
+                                               const int* cumulativeScaleIndices,
+                                               const int* partitionIndices,
+                                               int partitionCount,
+                                               int count,
+                                               double* outSumLogLikelihoodByPartition,
+                                               double* outSumLogLikelihood);
+
+    int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
+                                    const int* childBufferIndices,
+                                    const int* probabilityIndices,
+                                    const int* firstDerivativeIndices,
+                                    const int* secondDerivativeIndices,
+                                    const int* categoryWeightsIndices,
+                                    const int* stateFrequenciesIndices,
+                                    const int* scalingFactorsIndices,
+                                    int count,
+                                    double* outSumLogLikelihood,
+                                    double* outSumFirstDerivative,
+                                    double* outSumSecondDerivative);
+
+    int calculateEdgeLogLikelihoodsByPartition(const int* parentBufferIndices,
+                                               const int* childBufferIndices,
+                                               const int* probabilityIndices,
+                                               const int* firstDerivativeIndices,
+                                               const int* secondDerivativeIndices,
+                                               const int* categoryWeightsIndices,
+                                               const int* stateFrequenciesIndices,
+                                               const int* cumulativeScaleIndices,
+                                               const int* partitionIndices,
+                                               int partitionCount,
+                                               int count,
+                                               double* outSumLogLikelihoodByPartition,
+                                               double* outSumLogLikelihood,
+                                               double* outSumFirstDerivativeByPartition,
+                                               double* outSumFirstDerivative,
+                                               double* outSumSecondDerivativeByPartition,
+                                               double* outSumSecondDerivative);
+
+    int calculateMultiEdgeLogLikelihoods(const int* parentBufferIndices,
+                                         const int* childBufferIndices,
+                                         const int* probabilityIndices,
+                                         const int* firstDerivativeIndices,
+                                         const int* secondDerivativeIndices,
+                                         const int* categoryWeightsIndices,
+                                         const int* stateFrequenciesIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         double* outLogLikelihoods,
+                                         double* outFirstDerivatives,
+                                         double* outSecondDerivatives);
+
+    int getSiteLogLikelihoods(double* outLogLikelihoods);
+
+    int getSiteDerivatives(double* outFirstDerivatives,
+                           double* outSecondDerivatives);
+
+    int setRootPrePartials(const int* bufferIndices,
+                           const int* stateFrequenciesIndices,
+                           int count);
+
+    int updatePrePartials(const int* operations,
+                          int operationCount);
+
+    int calculateEdgeDerivatives(const int* postBufferIndices,
+                                 const int* preBufferIndices,
+                                 const int* probabilityIndices,
+                                 const int* derivativeMatrixIndices,
+                                 const int* categoryWeightsIndices,
+                                 int count,
+                                 double* outDerivatives,
+                                 double* outSumDerivatives);
+
+protected:
+    // Adds the sums of the shards held elsewhere to each of the count outputs, of
+    // sizes[i] values or NULL, and returns an error of any shard; here every shard is held
+    virtual int reduceSums(double** sums,
+                           const int* sizes,
+                           int count,
+                           int returnCode) {
+        return returnCode;
+    }
+
+    // Fills in the patterns of the shards held elsewhere in blockCount blocks of
+    // valuesPerPattern values for each pattern, and returns an error of any shard
+    virtual int gatherPatterns(double* values,
+                               int blockCount,
+                               int valuesPerPattern,
+                               int returnCode) {
+        return returnCode;
+    }
+
+private:
+    int shardPatternCount(int shard);
+
+    void addPartitionSums(double* outSums,
+                          const double* shardSums,
+                          int partitionCount);
+};
+
+} // end namespace beagle
+
+#endif // __beagle_sharded_impl__
@@ -0,0 +1,270 @@
+/*
+ *  BeagleTrace.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @brief Named trace ranges for external profilers
+ *
+ * Ranges are compiled into every build and cost one branch unless the
+ * BEAGLE_TRACE environment variable is set when the first range is opened.
+ * Its value is a comma separated list of sinks:
+ *
+ *   nvtx          push ranges to Nsight (builds configured --with-nvtx)
+ *   itt           begin tasks for VTune (builds configured --with-itt)
+ *   json:PREFIX   write Chrome trace events, which Perfetto opens, to
+ *                 PREFIX-<pid>-<module>.json
+ *
+ * Where the loader keeps the sink state of the core library and of each plugin
+ * apart, the json sink writes one file per loaded module.
+ */
+
+#ifndef __beagle_trace__
+#define __beagle_trace__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef BEAGLE_TRACE_NVTX
+#include <nvtx3/nvToolsExt.h>
+#endif
+
+#ifdef BEAGLE_TRACE_ITT
+#include <ittnotify.h>
+#endif
+
+namespace beagle {
+
+class TraceSinks {
+public:
+    bool enabled;
+    bool nvtx;
+    bool itt;
+    FILE* json;
+    bool jsonEmpty;
+    std::mutex jsonMutex;
+    std::chrono::steady_clock::time_point origin;
+#ifdef BEAGLE_TRACE_ITT
+    __itt_domain* ittDomain;
+    __itt_string_handle* ittKeys[3];
+#endif
+
+    TraceSinks() : enabled(false), nvtx(false), itt(false), json(NULL),
+                   jsonEmpty(true), origin(std::chrono::steady_clock::now()) {
+        const char* value = getenv("BEAGLE_TRACE");
+        if (value == NULL || value[0] == '\0')
+            return;
+
+        std::string sinks(value);
+        size_t start = 0;
+        while (start <= sinks.size()) {
+            size_t end = sinks.find(',', start);
+            if (end == std::string::npos)
+                end = sinks.size();
+            std::string sink = sinks.substr(start, end - start);
+            if (sink == "nvtx") {
+#ifdef BEAGLE_TRACE_NVTX
+                nvtx = true;
+#endif
+            } else if (sink == "itt") {
+#ifdef BEAGLE_TRACE_ITT
+                itt = true;
+                ittDomain = __itt_domain_create("BEAGLE");
+                ittKeys[0] = __itt_string_handle_create("instance");
+                ittKeys[1] = __itt_string_handle_create("count");
+                ittKeys[2] = __itt_string_handle_create("partition");
+#endif
+            } else if (sink.compare(0, 5, "json:") == 0 && json == NULL) {
+                openJson(sink.substr(5));
+            }
+            start = end + 1;
+        }
+
+        enabled = nvtx || itt || json != NULL;
+    }
+
+    ~TraceSinks() {
+        if (json != NULL) {
+            fprintf(json, "\n]\n");
+            fclose(json);
+        }
+    }
+
+    double microseconds(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration<double, std::micro>(time - origin).count();
+    }
+
+private:
+    void openJson(const std::string& prefix) {
+#ifdef _WIN32
+        int pid = _getpid();
+#else
+        int pid = getpid();
+#endif
+        // the address of this object tells the modules of one process apart
+        char name[64];
+        snprintf(name, sizeof(name), "-%d-%lx.json", pid,
+                 (unsigned long) (((size_t) this >> 4) & 0xffffff));
+        json = fopen((prefix + name).c_str(), "w");
+        if (json == NULL) {
+            fprintf(stderr, "BEAGLE: unable to open trace file %s%s\n", prefix.c_str(), name);
+            return;
+        }
+        fprintf(json, "[");
+    }
+};
+
+inline TraceSinks& getTraceSinks() {
+    static TraceSinks sinks;
+    return sinks;
+}
+
+inline int getTraceThread() {
+    static std::atomic<int> threadCount(0);
+    static thread_local int thread = threadCount++;
+    return thread;
+}
+
+/**
+ * @brief Names the enclosing scope in the enabled trace sinks
+ *
+ * The instance, operation count and partition are attached to the range when
+ * they are not negative. The name must outlive the range.
+ */
+class TraceRange {
+public:
+    TraceRange(const char* name,
+               int instance = -1,
+               int count = -1,
+               int partition = -1)
+        : sinks(getTraceSinks()),
+          name(name),
+          instance(instance),
+          count(count),
+          partition(partition) {
+        if (!sinks.enabled)
+            return;
+#ifdef BEAGLE_TRACE_NVTX
+        if (sinks.nvtx) {
+            char label[128];
+            formatLabel(label, sizeof(label));
+            nvtxEventAttributes_t attributes;
+            memset(&attributes, 0, sizeof(attributes));
+            attributes.version = NVTX_VERSION;
+            attributes.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+            attributes.messageType = NVTX_MESSAGE_TYPE_ASCII;
+            attributes.message.ascii = label;
+            nvtxRangePushEx(&attributes);
+        }
+#endif
+#ifdef BEAGLE_TRACE_ITT
+        if (sinks.itt) {
+            __itt_task_begin(sinks.ittDomain, __itt_null, __itt_null,
+                             __itt_string_handle_create(name));
+            const int values[3] = {instance, count, partition};
+            for (int i = 0; i < 3; i++) {
+                if (values[i] >= 0) {
+                    long long value = values[i];
+                    __itt_metadata_add(sinks.ittDomain, __itt_null, sinks.ittKeys[i],
+                                       __itt_metadata_s64, 1, &value);
+                }
+            }
+        }
+#endif
+        if (sinks.json != NULL)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~TraceRange() {
+        if (!sinks.enabled)
+            return;
+#ifdef BEAGLE_TRACE_NVTX
+        if (sinks.nvtx)
+            nvtxRangePop();
+#endif
+#ifdef BEAGLE_TRACE_ITT
+        if (sinks.itt)
+            __itt_task_end(sinks.ittDomain);
+#endif
+        if (sinks.json != NULL) {
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            char arguments[96];
+            formatArguments(arguments, sizeof(arguments));
+            std::lock_guard<std::mutex> lock(sinks.jsonMutex);
+            fprintf(sinks.json,
+                    "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}}",
+                    (sinks.jsonEmpty ? "" : ","), name, getTraceThread(), sinks.microseconds(start),
+                    std::chrono::duration<double, std::micro>(end - start).count(), arguments);
+            sinks.jsonEmpty = false;
+        }
+    }
+
+private:
+    TraceSinks& sinks;
+    const char* name;
+    int instance;
+    int count;
+    int partition;
+    std::chrono::steady_clock::time_point start;
+
+    TraceRange(const TraceRange&);
+    TraceRange& operator=(const TraceRange&);
+
+    void formatArguments(char* buffer, size_t size) const {
+        const char* keys[3] = {"instance", "count", "partition"};
+        const int values[3] = {instance, count, partition};
+        size_t length = 0;
+        buffer[0] = '\0';
+        for (int i = 0; i < 3; i++) {
+            if (values[i] >= 0 && length < size) {
+                length += snprintf(buffer + length, size - length, "%s\"%s\":%d",
+                                   (length > 0 ? "," : ""), keys[i], values[i]);
+            }
+        }
+    }
+
+    void formatLabel(char* buffer, size_t size) const {
+        const char* keys[3] = {"instance", "count", "partition"};
+        const int values[3] = {instance, count, partition};
+        size_t length = snprintf(buffer, size, "%s", name);
+        for (int i = 0; i < 3; i++) {
+            if (values[i] >= 0 && length < size)
+                length += snprintf(buffer + length, size - length, " %s=%d", keys[i], values[i]);
+        }
+    }
+};
+
+}   // namespace beagle
+
+#endif // __beagle_trace__
@@ -0,0 +1,60 @@
+/*
+ *  AVX512Definitions.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __AVX512Definitions__
+#define __AVX512Definitions__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#define ALIGN64 __attribute__((aligned(64)))
+#else
+#define ALIGN64 __declspec(align(64))
+#endif
+
+#define AVX512_DOUBLES_PER_VEC  8   /* number of doubles in a 512-bit vector */
+
+/* Broadcast state j of each of the two 4-state patterns held in a 512-bit vector */
+#define AVX512_SPLAT_STATE_0(p)     _mm512_permutex_pd((p), 0x00)
+#define AVX512_SPLAT_STATE_1(p)     _mm512_permutex_pd((p), 0x55)
+#define AVX512_SPLAT_STATE_2(p)     _mm512_permutex_pd((p), 0xAA)
+#define AVX512_SPLAT_STATE_3(p)     _mm512_permutex_pd((p), 0xFF)
+
+/* Two 4-state vectors side by side, lo in the lower 256 bits */
+#define AVX512_PAIR(lo, hi)         _mm512_insertf64x4(_mm512_castpd256_pd512(lo), (hi), 1)
+
+inline int CPUSupportsAVX512() {
+#if defined(__GNUC__) && !defined(_WIN32)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+#else
+    return 1;
+#endif
+}
+
+#endif // __AVX512Definitions__
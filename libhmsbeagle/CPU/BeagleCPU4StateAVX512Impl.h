@@ -0,0 +1,231 @@
+/*
+ *  BeagleCPU4StateAVX512Impl.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BeagleCPU4StateAVX512Impl__
+#define __BeagleCPU4StateAVX512Impl__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include "libhmsbeagle/CPU/BeagleCPU4StateImpl.h"
+
+#include <vector>
+
+#define T_PAD_4_AVX512_DEFAULT 1 // Pad transition matrix with 1 column for the ambiguous state
+#define P_PAD_4_AVX512_DEFAULT 0 // Partials padding not needed for 4 states AVX-512
+
+#define BEAGLE_CPU_4_AVX512_DOUBLE      double, T_PAD, P_PAD
+#define BEAGLE_CPU_4_AVX512_TEMPLATE    template <int T_PAD, int P_PAD>
+
+namespace beagle {
+namespace cpu {
+
+BEAGLE_CPU_TEMPLATE
+class BeagleCPU4StateAVX512Impl : public BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC> {};
+
+/*
+ * Double-precision 4-state kernels on 512-bit vectors. Each vector holds the four
+ * partials of two consecutive patterns, so every fused multiply-add updates two
+ * patterns at once; an odd pattern at the end of a range falls back to 256-bit FMA.
+ */
+BEAGLE_CPU_4_AVX512_TEMPLATE
+class BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE> : public BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX512_DOUBLE> {
+
+protected:
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kTipCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gPartials;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::integrationTmp;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gTransitionMatrices;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kPatternCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kPaddedPatternCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kExtraPatterns;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kStateCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gTipStates;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::kCategoryCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gScaleBuffers;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gCategoryWeights;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gStateFrequencies;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::realtypeMin;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::outLogLikelihoodsTmp;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gPatternWeights;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::gPatternPartitionsStartPatterns;
+    using BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::integrateOutStatesAndScale;
+    using BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX512_DOUBLE>::integrateOutStatesAndScaleByPartition;
+
+public:
+    virtual const char* getName();
+
+	virtual const long long getFlags();
+
+protected:
+    virtual int getPaddedPatternsModulus();
+
+private:
+
+    virtual void calcStatesStates(double* destP,
+                                  const TipState* states1,
+                                  const double* matrices1,
+                                  const TipState* states2,
+                                  const double* matrices2,
+                                  int startPattern,
+                                  int endPattern);
+
+    virtual void calcStatesStatesFixedScaling(double* destP,
+                                              const TipState* states1,
+                                              const double* matrices1,
+                                              const TipState* states2,
+                                              const double* matrices2,
+                                              const double* scaleFactors,
+                                              int startPattern,
+                                              int endPattern);
+
+    virtual void calcStatesPartials(double* destP,
+                                    const TipState* states1,
+                                    const double* __restrict matrices1,
+                                    const double* __restrict partials2,
+                                    const double* __restrict matrices2,
+                                    int startPattern,
+                                    int endPattern);
+
+    virtual void calcStatesPartialsFixedScaling(double* destP,
+                                                const TipState* states1,
+                                                const double* __restrict matrices1,
+                                                const double* __restrict partials2,
+                                                const double* __restrict matrices2,
+                                                const double* __restrict scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
+
+    virtual void calcPartialsPartials(double* __restrict destP,
+                                      const double* __restrict partials1,
+                                      const double* __restrict matrices1,
+                                      const double* __restrict partials2,
+                                      const double* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
+
+    virtual void calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                  const double* __restrict child0Partials,
+                                                  const double* __restrict child0TransMat,
+                                                  const double* __restrict child1Partials,
+                                                  const double* __restrict child1TransMat,
+                                                  const double* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
+
+    virtual int calcRootLogLikelihoods(const int bufferIndex,
+                                       const int categoryWeightsIndex,
+                                       const int stateFrequenciesIndex,
+                                       const int scalingFactorsIndex,
+                                       double* outSumLogLikelihood);
+
+    virtual void calcRootLogLikelihoodsByPartition(const int* bufferIndices,
+                                                   const int* categoryWeightsIndices,
+                                                   const int* stateFrequenciesIndices,
+                                                   const int* cumulativeScaleIndices,
+                                                   const int* partitionIndices,
+                                                   int partitionCount,
+                                                   double* outSumLogLikelihoodByPartition);
+
+    virtual int calcEdgeLogLikelihoods(const int parentBufferIndex,
+                                       const int childBufferIndex,
+                                       const int probabilityIndex,
+                                       const int categoryWeightsIndex,
+                                       const int stateFrequenciesIndex,
+                                       const int scalingFactorsIndex,
+                                       double* outSumLogLikelihood);
+
+    virtual void calcEdgeLogLikelihoodsByPartition(const int* parentBufferIndices,
+                                                   const int* childBufferIndices,
+                                                   const int* probabilityIndices,
+                                                   const int* categoryWeightsIndices,
+                                                   const int* stateFrequenciesIndices,
+                                                   const int* cumulativeScaleIndices,
+                                                   const int* partitionIndices,
+                                                   int partitionCount,
+                                                   double* outSumLogLikelihoodByPartition);
+
+    // Sum root partials over rate categories into integrationTmp for patterns [start, end)
+    void integrateRootByPatternRange(const double* rootPartials,
+                                     const double* wt,
+                                     int startPattern,
+                                     int endPattern);
+
+    // Accumulate the category-weighted edge product into integrationTmp for patterns [start, end)
+    void integrateEdgeByPatternRange(const double* partialsParent,
+                                     const int childIndex,
+                                     const double* transMatrix,
+                                     const double* wt,
+                                     int startPattern,
+                                     int endPattern);
+
+};
+
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+class BeagleCPU4StateAVX512ImplFactory : public BeagleImplFactory {
+public:
+    virtual BeagleImpl* createImpl(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   int* errorCode);
+
+    virtual const char* getName();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
+};
+
+}	// namespace cpu
+}	// namespace beagle
+
+// now include the file containing template function implementations
+#include "libhmsbeagle/CPU/BeagleCPU4StateAVX512Impl.hpp"
+
+
+#endif // __BeagleCPU4StateAVX512Impl__
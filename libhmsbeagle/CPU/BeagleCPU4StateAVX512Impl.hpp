@@ -0,0 +1,628 @@
+/*
+ *  BeagleCPU4StateAVX512Impl.hpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BEAGLE_CPU_4STATE_AVX512_IMPL_HPP
+#define BEAGLE_CPU_4STATE_AVX512_IMPL_HPP
+
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/CPU/BeagleCPU4StateAVX512Impl.h"
+#include "libhmsbeagle/CPU/AVX512Definitions.h"
+
+/* Loads the columns of a transition matrix, column j holding P(i -> j) for i = 0..3;
+   the four state columns are also duplicated into both halves of a 512-bit vector */
+#define AVX512_PREFETCH_MATRIX(src_m, dest_vm4, dest_vm) \
+	for (int j = 0; j < OFFSET; j++) { \
+		dest_vm4[j] = _mm256_set_pd((src_m)[3*OFFSET + j], (src_m)[2*OFFSET + j], \
+		                            (src_m)[1*OFFSET + j], (src_m)[0*OFFSET + j]); \
+	} \
+	for (int j = 0; j < 4; j++) { \
+		dest_vm[j] = _mm512_broadcast_f64x4(dest_vm4[j]); \
+	}
+
+/* Reciprocal scale factors of patterns k and k + 1, one per 256-bit half */
+#define AVX512_SCALE_PAIR(scaleFactors, k) \
+		AVX512_PAIR(_mm256_set1_pd(1.0/(scaleFactors)[k]), _mm256_set1_pd(1.0/(scaleFactors)[(k) + 1]))
+
+namespace beagle {
+namespace cpu {
+
+/* Matrix-times-partials for two patterns; two accumulation chains hide FMA latency */
+static inline __m512d avx512TransformPartials(const __m512d p, const __m512d* vm) {
+    __m512d a = _mm512_mul_pd(AVX512_SPLAT_STATE_0(p), vm[0]);
+    __m512d b = _mm512_mul_pd(AVX512_SPLAT_STATE_1(p), vm[1]);
+    a = _mm512_fmadd_pd(AVX512_SPLAT_STATE_2(p), vm[2], a);
+    b = _mm512_fmadd_pd(AVX512_SPLAT_STATE_3(p), vm[3], b);
+    return _mm512_add_pd(a, b);
+}
+
+/* Matrix-times-partials for a single pattern */
+static inline __m256d avx512TransformPartials(const __m256d p, const __m256d* vm4) {
+    __m256d a = _mm256_mul_pd(_mm256_permute4x64_pd(p, 0x00), vm4[0]);
+    __m256d b = _mm256_mul_pd(_mm256_permute4x64_pd(p, 0x55), vm4[1]);
+    a = _mm256_fmadd_pd(_mm256_permute4x64_pd(p, 0xAA), vm4[2], a);
+    b = _mm256_fmadd_pd(_mm256_permute4x64_pd(p, 0xFF), vm4[3], b);
+    return _mm256_add_pd(a, b);
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+inline const char* getBeagleCPU4StateAVX512Name(){ return "CPU-4State-AVX512-Unknown"; };
+
+template<>
+inline const char* getBeagleCPU4StateAVX512Name<double>(){ return "CPU-4State-AVX512-Double"; };
+
+/*
+ * Calculates partial likelihoods at a node when both children have states.
+ */
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcStatesStates(double* destP,
+                                                                             const TipState* states_q,
+                                                                             const double* matrices_q,
+                                                                             const TipState* states_r,
+                                                                             const double* matrices_r,
+                                                                             int startPattern,
+                                                                             int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+            _mm512_storeu_pd(destP + v,
+                             _mm512_mul_pd(AVX512_PAIR(vmq4[states_q[k]], vmq4[states_q[k + 1]]),
+                                           AVX512_PAIR(vmr4[states_r[k]], vmr4[states_r[k + 1]])));
+            v += 8;
+        }
+        if (k < endPattern) {
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(vmq4[states_q[k]], vmr4[states_r[k]]));
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcStatesStatesFixedScaling(double* destP,
+                                                                                         const TipState* states_q,
+                                                                                         const double* matrices_q,
+                                                                                         const TipState* states_r,
+                                                                                         const double* matrices_r,
+                                                                                         const double* scaleFactors,
+                                                                                         int startPattern,
+                                                                                         int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+            __m512d product = _mm512_mul_pd(AVX512_PAIR(vmq4[states_q[k]], vmq4[states_q[k + 1]]),
+                                            AVX512_PAIR(vmr4[states_r[k]], vmr4[states_r[k + 1]]));
+            _mm512_storeu_pd(destP + v, _mm512_mul_pd(product, AVX512_SCALE_PAIR(scaleFactors, k)));
+            v += 8;
+        }
+        if (k < endPattern) {
+            __m256d product = _mm256_mul_pd(vmq4[states_q[k]], vmr4[states_r[k]]);
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(product, _mm256_set1_pd(1.0/scaleFactors[k])));
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has states and one has partials.
+ */
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcStatesPartials(double* destP,
+                                                                               const TipState* states_q,
+                                                                               const double* matrices_q,
+                                                                               const double* partials_r,
+                                                                               const double* matrices_r,
+                                                                               int startPattern,
+                                                                               int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+            __m512d destr = avx512TransformPartials(_mm512_loadu_pd(partials_r + v), vmr);
+            _mm512_storeu_pd(destP + v,
+                             _mm512_mul_pd(AVX512_PAIR(vmq4[states_q[k]], vmq4[states_q[k + 1]]), destr));
+            v += 8;
+        }
+        if (k < endPattern) {
+            __m256d destr = avx512TransformPartials(_mm256_loadu_pd(partials_r + v), vmr4);
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(vmq4[states_q[k]], destr));
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
+                                                                                           const TipState* states_q,
+                                                                                           const double* __restrict matrices_q,
+                                                                                           const double* __restrict partials_r,
+                                                                                           const double* __restrict matrices_r,
+                                                                                           const double* __restrict scaleFactors,
+                                                                                           int startPattern,
+                                                                                           int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+            __m512d destr = avx512TransformPartials(_mm512_loadu_pd(partials_r + v), vmr);
+            __m512d product = _mm512_mul_pd(AVX512_PAIR(vmq4[states_q[k]], vmq4[states_q[k + 1]]), destr);
+            _mm512_storeu_pd(destP + v, _mm512_mul_pd(product, AVX512_SCALE_PAIR(scaleFactors, k)));
+            v += 8;
+        }
+        if (k < endPattern) {
+            __m256d destr = avx512TransformPartials(_mm256_loadu_pd(partials_r + v), vmr4);
+            __m256d product = _mm256_mul_pd(vmq4[states_q[k]], destr);
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(product, _mm256_set1_pd(1.0/scaleFactors[k])));
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when both children have partials.
+ */
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcPartialsPartials(double* __restrict destP,
+                                                                                 const double* __restrict partials_q,
+                                                                                 const double* __restrict matrices_q,
+                                                                                 const double* __restrict partials_r,
+                                                                                 const double* __restrict matrices_r,
+                                                                                 int startPattern,
+                                                                                 int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        /* Load transition-probability matrices into vectors */
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+
+#           if !defined(_WIN32)
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+#           endif
+
+            __m512d destq = avx512TransformPartials(_mm512_loadu_pd(partials_q + v), vmq);
+            __m512d destr = avx512TransformPartials(_mm512_loadu_pd(partials_r + v), vmr);
+            _mm512_storeu_pd(destP + v, _mm512_mul_pd(destq, destr));
+            v += 8;
+        }
+        if (k < endPattern) {
+            __m256d destq = avx512TransformPartials(_mm256_loadu_pd(partials_q + v), vmq4);
+            __m256d destr = avx512TransformPartials(_mm256_loadu_pd(partials_r + v), vmr4);
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(destq, destr));
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                                                             const double* __restrict partials_q,
+                                                                                             const double* __restrict matrices_q,
+                                                                                             const double* __restrict partials_r,
+                                                                                             const double* __restrict matrices_r,
+                                                                                             const double* __restrict scaleFactors,
+                                                                                             int startPattern,
+                                                                                             int endPattern) {
+
+    __m256d vmq4[OFFSET], vmr4[OFFSET];
+    __m512d vmq[4], vmr[4];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        /* Load transition-probability matrices into vectors */
+        AVX512_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vmq4, vmq);
+        AVX512_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vmr4, vmr);
+
+        int k = startPattern;
+        for (; k < endPattern - 1; k += 2) {
+
+#           if !defined(_WIN32)
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+#           endif
+
+            __m512d destq = avx512TransformPartials(_mm512_loadu_pd(partials_q + v), vmq);
+            __m512d destr = avx512TransformPartials(_mm512_loadu_pd(partials_r + v), vmr);
+            _mm512_storeu_pd(destP + v, _mm512_mul_pd(_mm512_mul_pd(destq, destr),
+                                                      AVX512_SCALE_PAIR(scaleFactors, k)));
+            v += 8;
+        }
+        if (k < endPattern) {
+            __m256d destq = avx512TransformPartials(_mm256_loadu_pd(partials_q + v), vmq4);
+            __m256d destr = avx512TransformPartials(_mm256_loadu_pd(partials_r + v), vmr4);
+            _mm256_storeu_pd(destP + v, _mm256_mul_pd(_mm256_mul_pd(destq, destr),
+                                                      _mm256_set1_pd(1.0/scaleFactors[k])));
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::integrateRootByPatternRange(const double* rootPartials,
+                                                                                        const double* wt,
+                                                                                        int startPattern,
+                                                                                        int endPattern) {
+
+    // Patterns are contiguous within a category, so the range is a flat run of doubles
+    const int start = startPattern * 4;
+    const int end = endPattern * 4;
+    const int endVector = start + ((end - start) / AVX512_DOUBLES_PER_VEC) * AVX512_DOUBLES_PER_VEC;
+
+    const __m512d vwt0 = _mm512_set1_pd(wt[0]);
+    int u = start;
+    for (; u < endVector; u += AVX512_DOUBLES_PER_VEC) {
+        _mm512_storeu_pd(integrationTmp + u, _mm512_mul_pd(_mm512_loadu_pd(rootPartials + u), vwt0));
+    }
+    if (u < end) {
+        _mm256_storeu_pd(integrationTmp + u, _mm256_mul_pd(_mm256_loadu_pd(rootPartials + u),
+                                                           _mm512_castpd512_pd256(vwt0)));
+    }
+
+    for (int l = 1; l < kCategoryCount; l++) {
+        const double* rootPartialsL = rootPartials + l * kPaddedPatternCount * 4;
+        const __m512d vwtl = _mm512_set1_pd(wt[l]);
+        u = start;
+        for (; u < endVector; u += AVX512_DOUBLES_PER_VEC) {
+            _mm512_storeu_pd(integrationTmp + u, _mm512_fmadd_pd(_mm512_loadu_pd(rootPartialsL + u), vwtl,
+                                                                 _mm512_loadu_pd(integrationTmp + u)));
+        }
+        if (u < end) {
+            _mm256_storeu_pd(integrationTmp + u, _mm256_fmadd_pd(_mm256_loadu_pd(rootPartialsL + u),
+                                                                 _mm512_castpd512_pd256(vwtl),
+                                                                 _mm256_loadu_pd(integrationTmp + u)));
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+int BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcRootLogLikelihoods(const int bufferIndex,
+                                                                                  const int categoryWeightsIndex,
+                                                                                  const int stateFrequenciesIndex,
+                                                                                  const int scalingFactorsIndex,
+                                                                                  double* outSumLogLikelihood) {
+
+    const double* rootPartials = gPartials[bufferIndex];
+    assert(rootPartials);
+
+    integrateRootByPatternRange(rootPartials, gCategoryWeights[categoryWeightsIndex], 0, kPatternCount);
+
+    return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcRootLogLikelihoodsByPartition(
+                                                                    const int* bufferIndices,
+                                                                    const int* categoryWeightsIndices,
+                                                                    const int* stateFrequenciesIndices,
+                                                                    const int* cumulativeScaleIndices,
+                                                                    const int* partitionIndices,
+                                                                    int partitionCount,
+                                                                    double* outSumLogLikelihoodByPartition) {
+
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        const double* rootPartials = gPartials[bufferIndices[p]];
+        assert(rootPartials);
+
+        integrateRootByPatternRange(rootPartials, gCategoryWeights[categoryWeightsIndices[p]],
+                                    startPattern, endPattern);
+    }
+
+    integrateOutStatesAndScaleByPartition(integrationTmp, stateFrequenciesIndices, cumulativeScaleIndices,
+                                          partitionIndices, partitionCount, outSumLogLikelihoodByPartition);
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::integrateEdgeByPatternRange(const double* cl_r,
+                                                                                        const int childIndex,
+                                                                                        const double* transMatrix,
+                                                                                        const double* wt,
+                                                                                        int startPattern,
+                                                                                        int endPattern) {
+
+    double* cl_p = integrationTmp;
+
+    __m256d vm4[OFFSET];
+    __m512d vm[4];
+
+    if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
+
+        const TipState* statesChild = gTipStates[childIndex];
+
+        for(int l = 0; l < kCategoryCount; l++) {
+            int v = (l*kPaddedPatternCount + startPattern)*4;
+            int u = startPattern*4;
+            AVX512_PREFETCH_MATRIX(transMatrix + l*4*OFFSET, vm4, vm);
+            const __m512d vwt = _mm512_set1_pd(wt[l]);
+
+            int k = startPattern;
+            for(; k < endPattern - 1; k += 2) {
+                __m512d wtdPartials = _mm512_mul_pd(_mm512_loadu_pd(cl_r + v), vwt);
+                _mm512_storeu_pd(cl_p + u,
+                                 _mm512_fmadd_pd(AVX512_PAIR(vm4[statesChild[k]], vm4[statesChild[k + 1]]),
+                                                 wtdPartials, _mm512_loadu_pd(cl_p + u)));
+                u += 8;
+                v += 8;
+            }
+            if (k < endPattern) {
+                __m256d wtdPartials = _mm256_mul_pd(_mm256_loadu_pd(cl_r + v), _mm512_castpd512_pd256(vwt));
+                _mm256_storeu_pd(cl_p + u,
+                                 _mm256_fmadd_pd(vm4[statesChild[k]], wtdPartials, _mm256_loadu_pd(cl_p + u)));
+            }
+        }
+    } else { // Integrate against a partial at the child
+
+        const double* cl_q = gPartials[childIndex];
+
+        for(int l = 0; l < kCategoryCount; l++) {
+            int v = (l*kPaddedPatternCount + startPattern)*4;
+            int u = startPattern*4;
+            AVX512_PREFETCH_MATRIX(transMatrix + l*4*OFFSET, vm4, vm);
+            const __m512d vwt = _mm512_set1_pd(wt[l]);
+
+            int k = startPattern;
+            for(; k < endPattern - 1; k += 2) {
+                __m512d vclp = _mm512_mul_pd(avx512TransformPartials(_mm512_loadu_pd(cl_q + v), vm), vwt);
+                _mm512_storeu_pd(cl_p + u, _mm512_fmadd_pd(vclp, _mm512_loadu_pd(cl_r + v),
+                                                           _mm512_loadu_pd(cl_p + u)));
+                u += 8;
+                v += 8;
+            }
+            if (k < endPattern) {
+                __m256d vclp = _mm256_mul_pd(avx512TransformPartials(_mm256_loadu_pd(cl_q + v), vm4),
+                                             _mm512_castpd512_pd256(vwt));
+                _mm256_storeu_pd(cl_p + u, _mm256_fmadd_pd(vclp, _mm256_loadu_pd(cl_r + v),
+                                                           _mm256_loadu_pd(cl_p + u)));
+            }
+        }
+    }
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+int BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcEdgeLogLikelihoods(const int parIndex,
+                                                                                  const int childIndex,
+                                                                                  const int probIndex,
+                                                                                  const int categoryWeightsIndex,
+                                                                                  const int stateFrequenciesIndex,
+                                                                                  const int scalingFactorsIndex,
+                                                                                  double* outSumLogLikelihood) {
+    // only the log likelihood is vectorized; with derivative matrices, calculateEdgeLogLikelihoods
+    // goes to calcEdgeLogLikelihoodsFirstDeriv and calcEdgeLogLikelihoodsSecondDeriv of
+    // BeagleCPUImpl, which read the same padded buffers
+    assert(parIndex >= kTipCount);
+
+    memset(integrationTmp, 0, (kPatternCount * kStateCount)*sizeof(double));
+
+    integrateEdgeByPatternRange(gPartials[parIndex], childIndex, gTransitionMatrices[probIndex],
+                                gCategoryWeights[categoryWeightsIndex], 0, kPatternCount);
+
+    return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+void BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::calcEdgeLogLikelihoodsByPartition(
+                                                  const int* parentBufferIndices,
+                                                  const int* childBufferIndices,
+                                                  const int* probabilityIndices,
+                                                  const int* categoryWeightsIndices,
+                                                  const int* stateFrequenciesIndices,
+                                                  const int* cumulativeScaleIndices,
+                                                  const int* partitionIndices,
+                                                  int partitionCount,
+                                                  double* outSumLogLikelihoodByPartition) {
+
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        memset(&integrationTmp[startPattern*kStateCount], 0, ((endPattern - startPattern) * kStateCount)*sizeof(double));
+
+        const int parIndex = parentBufferIndices[p];
+        assert(parIndex >= kTipCount);
+
+        integrateEdgeByPatternRange(gPartials[parIndex], childBufferIndices[p],
+                                    gTransitionMatrices[probabilityIndices[p]],
+                                    gCategoryWeights[categoryWeightsIndices[p]],
+                                    startPattern, endPattern);
+    }
+
+    integrateOutStatesAndScaleByPartition(integrationTmp, stateFrequenciesIndices, cumulativeScaleIndices,
+                                          partitionIndices, partitionCount, outSumLogLikelihoodByPartition);
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+int BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::getPaddedPatternsModulus() {
+	return 1;  // Odd pattern counts are handled by a 256-bit tail
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+const char* BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::getName() {
+    return  getBeagleCPU4StateAVX512Name<double>();
+}
+
+BEAGLE_CPU_4_AVX512_TEMPLATE
+const long long BeagleCPU4StateAVX512Impl<BEAGLE_CPU_4_AVX512_DOUBLE>::getFlags() {
+    return  BEAGLE_FLAG_COMPUTATION_SYNCH |
+            BEAGLE_FLAG_PROCESSOR_CPU |
+            BEAGLE_FLAG_PRECISION_DOUBLE |
+            BEAGLE_FLAG_VECTOR_AVX512 |
+            BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeagleImplFactory public methods
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+BeagleImpl* BeagleCPU4StateAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             int resourceNumber,
+                                             int pluginResourceNumber,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
+                                             int* errorCode) {
+
+    if (stateCount != 4) {
+        return NULL;
+    }
+
+    if (!CPUSupportsAVX512()) {
+        return NULL;
+    }
+
+    BeagleCPU4StateAVX512Impl<REALTYPE, T_PAD_4_AVX512_DEFAULT, P_PAD_4_AVX512_DEFAULT>* impl =
+    		new BeagleCPU4StateAVX512Impl<REALTYPE, T_PAD_4_AVX512_DEFAULT, P_PAD_4_AVX512_DEFAULT>();
+
+    try {
+        if (impl->createInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                 patternCount, eigenBufferCount, matrixBufferCount,
+                                 categoryCount,scaleBufferCount, resourceNumber,
+                                 pluginResourceNumber,
+                                 preferenceFlags, requirementFlags) == 0)
+            return impl;
+    }
+    catch(...) {
+        if (DEBUGGING_OUTPUT)
+            std::cerr << "exception in initialize\n";
+        delete impl;
+        throw;
+    }
+
+    delete impl;
+
+    return NULL;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                                     int partialsBufferCount,
+                                                                                     int compactBufferCount,
+                                                                                     int stateCount,
+                                                                                     int patternCount,
+                                                                                     int eigenBufferCount,
+                                                                                     int matrixBufferCount,
+                                                                                     int categoryCount,
+                                                                                     int scaleBufferCount,
+                                                                                     int resourceNumber,
+                                                                                     int pluginResourceNumber,
+                                                                                     long long preferenceFlags,
+                                                                                     long long requirementFlags,
+                                                                                     size_t* outBytes) {
+    if (stateCount != 4)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsAVX512())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPU4StateAVX512Impl<REALTYPE, T_PAD_4_AVX512_DEFAULT, P_PAD_4_AVX512_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+const char* BeagleCPU4StateAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
+	return getBeagleCPU4StateAVX512Name<BEAGLE_CPU_FACTORY_GENERIC>();
+}
+
+template <>
+const long long BeagleCPU4StateAVX512ImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
+           BEAGLE_FLAG_PROCESSOR_CPU |
+           BEAGLE_FLAG_VECTOR_AVX512 |
+           BEAGLE_FLAG_PRECISION_DOUBLE |
+           BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
+           BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL|
+           BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+}
+}
+
+#endif //BEAGLE_CPU_4STATE_AVX512_IMPL_HPP
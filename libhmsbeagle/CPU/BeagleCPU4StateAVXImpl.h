@@ -74,7 +74,7 @@ protected:
 public:    
     virtual const char* getName();
     
-	virtual const long getFlags();
+	virtual const long long getFlags();
     
 protected:
     virtual int getPaddedPatternsModulus();  
@@ -82,19 +82,19 @@ protected:
 private:
     
 	virtual void calcStatesStates(float* destP,
-                                  const int* states1,
+                                  const TipState* states1,
                                   const float* matrices1,
-                                  const int* states2,
+                                  const TipState* states2,
                                   const float* matrices2);
     
     virtual void calcStatesPartials(float* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const float* __restrict matrices1,
                                     const float* __restrict partials2,
                                     const float* __restrict matrices2);
     
     virtual void calcStatesPartialsFixedScaling(float* destP,
-                                                const int* states1,
+                                                const TipState* states1,
                                                 const float* __restrict matrices1,
                                                 const float* __restrict partials2,
                                                 const float* __restrict matrices2,
@@ -151,11 +151,12 @@ protected:
     using BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>::realtypeMin;
     using BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>::outLogLikelihoodsTmp;
     using BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>::gPatternWeights;
+    using BeagleCPUImpl<BEAGLE_CPU_4_AVX_DOUBLE>::sumOverPatterns;
     
 public:
     virtual const char* getName();
     
-	virtual const long getFlags();
+	virtual const long long getFlags();
     
 protected:
     virtual int getPaddedPatternsModulus();
@@ -163,19 +164,19 @@ protected:
 private:
     
     virtual void calcStatesStates(double* destP,
-                                  const int* states1,
+                                  const TipState* states1,
                                   const double* matrices1,
-                                  const int* states2,
+                                  const TipState* states2,
                                   const double* matrices2);
     
     virtual void calcStatesPartials(double* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const double* __restrict matrices1,
                                     const double* __restrict partials2,
                                     const double* __restrict matrices2);
     
     virtual void calcStatesPartialsFixedScaling(double* destP,
-                                                const int* states1,
+                                                const TipState* states1,
                                                 const double* __restrict matrices1,
                                                 const double* __restrict partials2,
                                                 const double* __restrict matrices2,
@@ -226,12 +227,27 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 }	// namespace cpu
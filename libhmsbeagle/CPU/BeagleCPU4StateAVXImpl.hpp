@@ -116,9 +116,9 @@ inline const char* getBeagleCPU4StateAVXName<float>(){ return "CPU-4State-AVX-Si
 
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesStates(float* destP,
-                                     const int* states_q,
+                                     const TipState* states_q,
                                      const float* matrices_q,
-                                     const int* states_r,
+                                     const TipState* states_r,
                                      const float* matrices_r) {
 
 									 BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesStates(destP,
@@ -132,9 +132,9 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesStates(float* des
 
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesStates(double* destP,
-                                     const int* states_q,
+                                     const TipState* states_q,
                                      const double* matrices_q,
-                                     const int* states_r,
+                                     const TipState* states_r,
                                      const double* matrices_r) {
 
 	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
@@ -168,7 +168,7 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesStates(double* d
  */
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartials(float* destP,
-                                       const int* states_q,
+                                       const TipState* states_q,
                                        const float* matrices_q,
                                        const float* partials_r,
                                        const float* matrices_r) {
@@ -184,7 +184,7 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartials(float* d
 
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartials(double* destP,
-                                       const int* states_q,
+                                       const TipState* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
                                        const double* matrices_r) {
@@ -233,7 +233,7 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartials(double*
 
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartialsFixedScaling(float* destP,
-                                const int* states1,
+                                const TipState* states1,
                                 const float* __restrict matrices1,
                                 const float* __restrict partials2,
                                 const float* __restrict matrices2,
@@ -249,7 +249,7 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartialsFixedScal
 
 BEAGLE_CPU_4_AVX_TEMPLATE
 void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
-                                const int* states_q,
+                                const TipState* states_q,
                                 const double* __restrict matrices_q,
                                 const double* __restrict partials_r,
                                 const double* __restrict matrices_r,
@@ -581,7 +581,7 @@ int BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcEdgeLogLikelihoods(cons
 
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-        const int* statesChild = gTipStates[childIndex];
+        const TipState* statesChild = gTipStates[childIndex];
 
         int w = 0;
         V_Real *vcl_r = (V_Real *)cl_r;
@@ -670,10 +670,7 @@ int BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcEdgeLogLikelihoods(cons
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -707,7 +704,7 @@ const char* BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::getName() {
 
     
 BEAGLE_CPU_4_AVX_TEMPLATE
-const long BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::getFlags() {
+const long long BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::getFlags() {
 	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_THREADING_NONE |
             BEAGLE_FLAG_PROCESSOR_CPU |
@@ -716,7 +713,7 @@ const long BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::getFlags() {
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
-const long BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::getFlags() {
+const long long BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::getFlags() {
     return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_THREADING_NONE |
             BEAGLE_FLAG_PROCESSOR_CPU |
@@ -741,8 +738,8 @@ BeagleImpl* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,                                             
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     if (stateCount != 4) {
@@ -775,16 +772,47 @@ BeagleImpl* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                                  int partialsBufferCount,
+                                                                                  int compactBufferCount,
+                                                                                  int stateCount,
+                                                                                  int patternCount,
+                                                                                  int eigenBufferCount,
+                                                                                  int matrixBufferCount,
+                                                                                  int categoryCount,
+                                                                                  int scaleBufferCount,
+                                                                                  int resourceNumber,
+                                                                                  int pluginResourceNumber,
+                                                                                  long long preferenceFlags,
+                                                                                  long long requirementFlags,
+                                                                                  size_t* outBytes) {
+    if (stateCount != 4)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsAVX())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPU4StateAVXImpl<REALTYPE, T_PAD_4_AVX_DEFAULT, P_PAD_4_AVX_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateAVXName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 template <>
-const long BeagleCPU4StateAVXImplFactory<double>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPU4StateAVXImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
            BEAGLE_FLAG_THREADING_NONE |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
            BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -795,10 +823,12 @@ const long BeagleCPU4StateAVXImplFactory<double>::getFlags() {
 }
 
 template <>
-const long BeagleCPU4StateAVXImplFactory<float>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPU4StateAVXImplFactory<float>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
            BEAGLE_FLAG_THREADING_NONE |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
            BEAGLE_FLAG_PRECISION_SINGLE |
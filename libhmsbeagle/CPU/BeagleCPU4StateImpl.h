@@ -57,14 +57,19 @@ protected:
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kStateCount;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gTipStates;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kOpenMPThreadCount;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gScaleBuffers;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gStateFrequencies;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gCategoryWeights;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gPatternWeights;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::sumOverPatterns;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::outLogLikelihoodsTmp;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::realtypeMin;
   using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::scalingExponentThreshhold;
   using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gPatternPartitionsStartPatterns;
+  using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::storeScaleFactor;
+  using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::addScalingTally;
+  typedef typename BeagleCPUImpl<BEAGLE_CPU_GENERIC>::ScalingTally ScalingTally;
 
 public:
     virtual ~BeagleCPU4StateImpl();
@@ -72,15 +77,15 @@ public:
 
 
     virtual void calcStatesStates(REALTYPE* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const REALTYPE* matrices1,
-                                    const int* states2,
+                                    const TipState* states2,
                                     const REALTYPE* matrices2,
                                     int startPattern,
                                     int endPattern);
     
     virtual void calcStatesPartials(REALTYPE* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const REALTYPE* matrices1,
                                     const REALTYPE* partials2,
                                     const REALTYPE* matrices2,
@@ -135,16 +140,16 @@ public:
                                                   double* outSumLogLikelihoodByPartition);
     
     virtual void calcStatesStatesFixedScaling(REALTYPE *destP,
-                                              const int *child0States,
+                                              const TipState *child0States,
                                               const REALTYPE *child0TransMat,
-                                              const int *child1States,
+                                              const TipState *child1States,
                                               const REALTYPE *child1TransMat,
                                               const REALTYPE *scaleFactors,
                                               int startPattern,
                                               int endPattern);
 
     virtual void calcStatesPartialsFixedScaling(REALTYPE *destP,
-                                                const int *child0States,
+                                                const TipState *child0States,
                                                 const REALTYPE *child0TransMat,
                                                 const REALTYPE *child1Partials,
                                                 const REALTYPE *child1TransMat,
@@ -186,11 +191,12 @@ public:
                                  REALTYPE *cumulativeScaleFactors,
                                  const int  fillWithOnes);
 
-    virtual void rescalePartialsByPartition(REALTYPE *destP,
-                                            REALTYPE *scaleFactors,
-                                            REALTYPE *cumulativeScaleFactors,
-                                            const int fillWithOnes,
-                                            const int partitionIndex);
+    virtual void rescalePartialsByPatternRange(REALTYPE *destP,
+                                               REALTYPE *scaleFactors,
+                                               REALTYPE *cumulativeScaleFactors,
+                                               const int fillWithOnes,
+                                               int startPattern,
+                                               int endPattern);
 
 
 };
@@ -209,12 +215,27 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 }	// namespace cpu
@@ -152,14 +152,14 @@ BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::~BeagleCPU4StateImpl() {
  */
 BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
-                                                               const int* states1,
+                                                               const TipState* states1,
                                                                const REALTYPE* matrices1,
-                                                               const int* states2,
+                                                               const TipState* states2,
                                                                const REALTYPE* matrices2,
                                                                int startPattern,
                                                                int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int v = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -184,15 +184,15 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
 
 BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALTYPE* destP,
-                                                                           const int* states1,
+                                                                           const TipState* states1,
                                                                            const REALTYPE* matrices1,
-                                                                           const int* states2,
+                                                                           const TipState* states2,
                                                                            const REALTYPE* matrices2,
                                                                            const REALTYPE* scaleFactors,
                                                                            int startPattern,
                                                                            int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int v = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -221,14 +221,14 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALT
  */
 BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP,
-                                                                 const int* states1,
+                                                                 const TipState* states1,
                                                                  const REALTYPE* matrices1,
                                                                  const REALTYPE* partials2,
                                                                  const REALTYPE* matrices2,
                                                                  int startPattern,
                                                                  int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int u = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -255,7 +255,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP
 
 BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REALTYPE* destP,
-                                                                             const int* states1,
+                                                                             const TipState* states1,
                                                                              const REALTYPE* matrices1,
                                                                              const REALTYPE* partials2,
                                                                              const REALTYPE* matrices2,
@@ -263,7 +263,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REA
                                                                              int startPattern,
                                                                              int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int u = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -299,7 +299,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* des
                                                                    int endPattern) {
     
  
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int u = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -390,7 +390,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(R
                                                                                int startPattern,
                                                                                int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int u = l*4*kPaddedPatternCount + 4*startPattern;
         int w = l*4*OFFSET;
@@ -454,10 +454,7 @@ int inline BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::integrateOutStatesAndScale(c
         }
     }
     
-    *outSumLogLikelihood = 0.0;    
-    for(int k=0; k < kPatternCount; k++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[k] * gPatternWeights[k];
-    }    
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -509,10 +506,7 @@ void inline BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::integrateOutStatesAndScaleB
           }
       }
          
-      outSumLogLikelihoodByPartition[p] = 0.0;
-      for(int k=startPattern; k < endPattern; k++) {
-          outSumLogLikelihoodByPartition[p] += outLogLikelihoodsTmp[k] * gPatternWeights[k];
-      }
+      outSumLogLikelihoodByPartition[p] = sumOverPatterns(outLogLikelihoodsTmp, startPattern, endPattern);
     }
     
 }
@@ -528,8 +522,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
 		REALTYPE* cumulativeScaleFactors,
         const int  fillWithOnes) {
 
-	bool useLogScalars = kFlags & BEAGLE_FLAG_SCALERS_LOG;
-
+    ScalingTally tally;
     for (int k = 0; k < kPatternCount; k++) {
     	REALTYPE max = 0;    	
         const int patternOffset = k * 4;
@@ -554,40 +547,29 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
         if (max == 0)
             max = REALTYPE(1.0);
 
-        REALTYPE oneOverMax = REALTYPE(1.0) / max;
+        REALTYPE oneOverMax = storeScaleFactor(max, scaleFactors, cumulativeScaleFactors, k, tally);
+        if (oneOverMax == REALTYPE(1.0))
+            continue;
         for (int l = 0; l < kCategoryCount; l++) {
             int offset = l * kPaddedPatternCount * 4 + patternOffset;
 			#pragma unroll
             for (int i = 0; i < 4; i++)
                 destP[offset++] *= oneOverMax;
         }
-
-        if (useLogScalars) {
-            REALTYPE logMax = log(max);
-            scaleFactors[k] = logMax;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += logMax;
-        } else {
-            scaleFactors[k] = max;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += log(max);
-        }
     }
+    addScalingTally(tally);
 }
 
 BEAGLE_CPU_TEMPLATE
-void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPartition(
+void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPatternRange(
                                                                     REALTYPE* destP,
                                                                     REALTYPE* scaleFactors,
                                                                     REALTYPE* cumulativeScaleFactors,
                                                                     const int fillWithOnes,
-                                                                    const int partitionIndex) {
-
-    bool useLogScalars = kFlags & BEAGLE_FLAG_SCALERS_LOG;
-
-    int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
-    int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
+                                                                    int startPattern,
+                                                                    int endPattern) {
 
+    ScalingTally tally;
     for (int k = startPattern; k < endPattern; k++) {
       REALTYPE max = 0;     
         const int patternOffset = k * 4;
@@ -612,25 +594,17 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPartition(
         if (max == 0)
             max = REALTYPE(1.0);
 
-        REALTYPE oneOverMax = REALTYPE(1.0) / max;
+        REALTYPE oneOverMax = storeScaleFactor(max, scaleFactors, cumulativeScaleFactors, k, tally);
+        if (oneOverMax == REALTYPE(1.0))
+            continue;
         for (int l = 0; l < kCategoryCount; l++) {
             int offset = l * kPaddedPatternCount * 4 + patternOffset;
       #pragma unroll
             for (int i = 0; i < 4; i++)
                 destP[offset++] *= oneOverMax;
         }
-
-        if (useLogScalars) {
-            REALTYPE logMax = log(max);
-            scaleFactors[k] = logMax;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += logMax;
-        } else {
-            scaleFactors[k] = max;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += log(max);
-        }
     }
+    addScalingTally(tally);
 }
 
 
@@ -655,7 +629,7 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int pa
     
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
       
-        const int* statesChild = gTipStates[childIndex];    
+        const TipState* statesChild = gTipStates[childIndex];    
         int v = 0; // Index for parent partials
         int w = 0;
         for(int l = 0; l < kCategoryCount; l++) {
@@ -754,7 +728,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition(
         
         if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
           
-            const int* statesChild = gTipStates[childIndex];    
+            const TipState* statesChild = gTipStates[childIndex];    
             int v = startPattern * 4; // Index for parent partials
             int w = 0;
             for(int l = 0; l < kCategoryCount; l++) {
@@ -1017,10 +991,7 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
             outLogLikelihoodsTmp[i] += maxScaleFactor[i];
     }
     
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1049,8 +1020,8 @@ BeagleImpl* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(i
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     if (stateCount != 4) {
@@ -1079,16 +1050,44 @@ BeagleImpl* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(i
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                               int partialsBufferCount,
+                                                                               int compactBufferCount,
+                                                                               int stateCount,
+                                                                               int patternCount,
+                                                                               int eigenBufferCount,
+                                                                               int matrixBufferCount,
+                                                                               int categoryCount,
+                                                                               int scaleBufferCount,
+                                                                               int resourceNumber,
+                                                                               int pluginResourceNumber,
+                                                                               long long preferenceFlags,
+                                                                               long long requirementFlags,
+                                                                               size_t* outBytes) {
+    if (stateCount != 4)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPU4StateImpl<REALTYPE, T_PAD_DEFAULT, P_PAD_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 BEAGLE_CPU_FACTORY_TEMPLATE
-const long BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
-    long flags =  BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
+    long long flags =  BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
                   BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
-                  BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+                  BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+                  BEAGLE_CPU_ARENA_FLAGS |
+                  BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
                   BEAGLE_FLAG_PROCESSOR_CPU |
                   BEAGLE_FLAG_VECTOR_NONE |
                   BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
@@ -0,0 +1,584 @@
+/*
+ *  BeagleCPU4StateNEONImpl.hpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BEAGLE_CPU_4STATE_NEON_IMPL_HPP
+#define BEAGLE_CPU_4STATE_NEON_IMPL_HPP
+
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/CPU/BeagleCPU4StateNEONImpl.h"
+#include "libhmsbeagle/CPU/NEONDefinitions.h"
+
+/* Loads (transposed) finite-time transition matrices into NEON vectors; entry [j][0]
+   holds P(0 -> j), P(1 -> j) and entry [j][1] holds P(2 -> j), P(3 -> j) */
+#define NEON_PREFETCH_MATRIX(src_m, dest_vm) \
+	for (int j = 0; j < OFFSET; j++) { \
+		dest_vm[j][0].x[0] = (src_m)[0*OFFSET + j]; \
+		dest_vm[j][0].x[1] = (src_m)[1*OFFSET + j]; \
+		dest_vm[j][1].x[0] = (src_m)[2*OFFSET + j]; \
+		dest_vm[j][1].x[1] = (src_m)[3*OFFSET + j]; \
+	}
+
+namespace beagle {
+namespace cpu {
+
+/* Matrix-times-partials for one pattern; two accumulation chains per half hide FMA latency */
+static inline void neonTransformPartials(const double* partials,
+                                         const NEONVecUnion vm[][2],
+                                         float64x2_t& out01,
+                                         float64x2_t& out23) {
+    const float64x2_t p01 = vld1q_f64(partials);
+    const float64x2_t p23 = vld1q_f64(partials + 2);
+
+    float64x2_t a01 = vmulq_laneq_f64(vm[0][0].vx, p01, 0);
+    float64x2_t a23 = vmulq_laneq_f64(vm[0][1].vx, p01, 0);
+    float64x2_t b01 = vmulq_laneq_f64(vm[1][0].vx, p01, 1);
+    float64x2_t b23 = vmulq_laneq_f64(vm[1][1].vx, p01, 1);
+    a01 = vfmaq_laneq_f64(a01, vm[2][0].vx, p23, 0);
+    a23 = vfmaq_laneq_f64(a23, vm[2][1].vx, p23, 0);
+    b01 = vfmaq_laneq_f64(b01, vm[3][0].vx, p23, 1);
+    b23 = vfmaq_laneq_f64(b23, vm[3][1].vx, p23, 1);
+
+    out01 = vaddq_f64(a01, b01);
+    out23 = vaddq_f64(a23, b23);
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+inline const char* getBeagleCPU4StateNEONName(){ return "CPU-4State-NEON-Unknown"; };
+
+template<>
+inline const char* getBeagleCPU4StateNEONName<double>(){ return "CPU-4State-NEON-Double"; };
+
+/*
+ * Calculates partial likelihoods at a node when both children have states.
+ */
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcStatesStates(double* destP,
+                                                                         const TipState* states_q,
+                                                                         const double* matrices_q,
+                                                                         const TipState* states_r,
+                                                                         const double* matrices_r,
+                                                                         int startPattern,
+                                                                         int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state_q = states_q[k];
+            const int state_r = states_r[k];
+
+            vst1q_f64(destP + v,     vmulq_f64(vu_mq[state_q][0].vx, vu_mr[state_r][0].vx));
+            vst1q_f64(destP + v + 2, vmulq_f64(vu_mq[state_q][1].vx, vu_mr[state_r][1].vx));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcStatesStatesFixedScaling(double* destP,
+                                                                                     const TipState* states_q,
+                                                                                     const double* matrices_q,
+                                                                                     const TipState* states_r,
+                                                                                     const double* matrices_r,
+                                                                                     const double* scaleFactors,
+                                                                                     int startPattern,
+                                                                                     int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state_q = states_q[k];
+            const int state_r = states_r[k];
+            const float64x2_t scaleFactor = vdupq_n_f64(1.0/scaleFactors[k]);
+
+            vst1q_f64(destP + v,     vmulq_f64(vmulq_f64(vu_mq[state_q][0].vx, vu_mr[state_r][0].vx), scaleFactor));
+            vst1q_f64(destP + v + 2, vmulq_f64(vmulq_f64(vu_mq[state_q][1].vx, vu_mr[state_r][1].vx), scaleFactor));
+            v += 4;
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has states and one has partials.
+ */
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcStatesPartials(double* destP,
+                                                                           const TipState* states_q,
+                                                                           const double* matrices_q,
+                                                                           const double* partials_r,
+                                                                           const double* matrices_r,
+                                                                           int startPattern,
+                                                                           int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state_q = states_q[k];
+            float64x2_t destr_01, destr_23;
+            neonTransformPartials(partials_r + v, vu_mr, destr_01, destr_23);
+
+            vst1q_f64(destP + v,     vmulq_f64(vu_mq[state_q][0].vx, destr_01));
+            vst1q_f64(destP + v + 2, vmulq_f64(vu_mq[state_q][1].vx, destr_23));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
+                                                                                       const TipState* states_q,
+                                                                                       const double* __restrict matrices_q,
+                                                                                       const double* __restrict partials_r,
+                                                                                       const double* __restrict matrices_r,
+                                                                                       const double* __restrict scaleFactors,
+                                                                                       int startPattern,
+                                                                                       int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const int state_q = states_q[k];
+            const float64x2_t scaleFactor = vdupq_n_f64(1.0/scaleFactors[k]);
+            float64x2_t destr_01, destr_23;
+            neonTransformPartials(partials_r + v, vu_mr, destr_01, destr_23);
+
+            vst1q_f64(destP + v,     vmulq_f64(vmulq_f64(vu_mq[state_q][0].vx, destr_01), scaleFactor));
+            vst1q_f64(destP + v + 2, vmulq_f64(vmulq_f64(vu_mq[state_q][1].vx, destr_23), scaleFactor));
+            v += 4;
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when both children have partials.
+ */
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcPartialsPartials(double* __restrict destP,
+                                                                             const double* __restrict partials_q,
+                                                                             const double* __restrict matrices_q,
+                                                                             const double* __restrict partials_r,
+                                                                             const double* __restrict matrices_r,
+                                                                             int startPattern,
+                                                                             int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        /* Load transition-probability matrices into vectors */
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+
+            float64x2_t destq_01, destq_23, destr_01, destr_23;
+            neonTransformPartials(partials_q + v, vu_mq, destq_01, destq_23);
+            neonTransformPartials(partials_r + v, vu_mr, destr_01, destr_23);
+
+            vst1q_f64(destP + v,     vmulq_f64(destq_01, destr_01));
+            vst1q_f64(destP + v + 2, vmulq_f64(destq_23, destr_23));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                                                         const double* __restrict partials_q,
+                                                                                         const double* __restrict matrices_q,
+                                                                                         const double* __restrict partials_r,
+                                                                                         const double* __restrict matrices_r,
+                                                                                         const double* __restrict scaleFactors,
+                                                                                         int startPattern,
+                                                                                         int endPattern) {
+
+    NEONVecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        /* Load transition-probability matrices into vectors */
+        NEON_PREFETCH_MATRIX(matrices_q + l*4*OFFSET, vu_mq);
+        NEON_PREFETCH_MATRIX(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+
+            const float64x2_t scaleFactor = vdupq_n_f64(1.0/scaleFactors[k]);
+
+            float64x2_t destq_01, destq_23, destr_01, destr_23;
+            neonTransformPartials(partials_q + v, vu_mq, destq_01, destq_23);
+            neonTransformPartials(partials_r + v, vu_mr, destr_01, destr_23);
+
+            vst1q_f64(destP + v,     vmulq_f64(vmulq_f64(destq_01, destr_01), scaleFactor));
+            vst1q_f64(destP + v + 2, vmulq_f64(vmulq_f64(destq_23, destr_23), scaleFactor));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::integrateRootByPatternRange(const double* rootPartials,
+                                                                                    const double* wt,
+                                                                                    int startPattern,
+                                                                                    int endPattern) {
+
+    // Patterns are contiguous within a category, so the range is a flat run of doubles
+    const int start = startPattern * 4;
+    const int end = endPattern * 4;
+
+    const float64x2_t vwt0 = vdupq_n_f64(wt[0]);
+    for (int u = start; u < end; u += NEON_DOUBLES_PER_VEC) {
+        vst1q_f64(integrationTmp + u, vmulq_f64(vld1q_f64(rootPartials + u), vwt0));
+    }
+
+    for (int l = 1; l < kCategoryCount; l++) {
+        const double* rootPartialsL = rootPartials + l * kPaddedPatternCount * 4;
+        const float64x2_t vwtl = vdupq_n_f64(wt[l]);
+        for (int u = start; u < end; u += NEON_DOUBLES_PER_VEC) {
+            vst1q_f64(integrationTmp + u, vfmaq_f64(vld1q_f64(integrationTmp + u),
+                                                    vld1q_f64(rootPartialsL + u), vwtl));
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+int BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcRootLogLikelihoods(const int bufferIndex,
+                                                                              const int categoryWeightsIndex,
+                                                                              const int stateFrequenciesIndex,
+                                                                              const int scalingFactorsIndex,
+                                                                              double* outSumLogLikelihood) {
+
+    const double* rootPartials = gPartials[bufferIndex];
+    assert(rootPartials);
+
+    integrateRootByPatternRange(rootPartials, gCategoryWeights[categoryWeightsIndex], 0, kPatternCount);
+
+    return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcRootLogLikelihoodsByPartition(
+                                                                    const int* bufferIndices,
+                                                                    const int* categoryWeightsIndices,
+                                                                    const int* stateFrequenciesIndices,
+                                                                    const int* cumulativeScaleIndices,
+                                                                    const int* partitionIndices,
+                                                                    int partitionCount,
+                                                                    double* outSumLogLikelihoodByPartition) {
+
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        const double* rootPartials = gPartials[bufferIndices[p]];
+        assert(rootPartials);
+
+        integrateRootByPatternRange(rootPartials, gCategoryWeights[categoryWeightsIndices[p]],
+                                    startPattern, endPattern);
+    }
+
+    integrateOutStatesAndScaleByPartition(integrationTmp, stateFrequenciesIndices, cumulativeScaleIndices,
+                                          partitionIndices, partitionCount, outSumLogLikelihoodByPartition);
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::integrateEdgeByPatternRange(const double* cl_r,
+                                                                                    const int childIndex,
+                                                                                    const double* transMatrix,
+                                                                                    const double* wt,
+                                                                                    int startPattern,
+                                                                                    int endPattern) {
+
+    double* cl_p = integrationTmp;
+
+    NEONVecUnion vu_m[OFFSET][2];
+
+    if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
+
+        const TipState* statesChild = gTipStates[childIndex];
+
+        for(int l = 0; l < kCategoryCount; l++) {
+            int v = (l*kPaddedPatternCount + startPattern)*4;
+            int u = startPattern*4;
+            NEON_PREFETCH_MATRIX(transMatrix + l*4*OFFSET, vu_m);
+            const float64x2_t vwt = vdupq_n_f64(wt[l]);
+
+            for(int k = startPattern; k < endPattern; k++) {
+                const int stateChild = statesChild[k];
+
+                float64x2_t wtdPartials = vmulq_f64(vld1q_f64(cl_r + v), vwt);
+                vst1q_f64(cl_p + u, vfmaq_f64(vld1q_f64(cl_p + u), vu_m[stateChild][0].vx, wtdPartials));
+
+                wtdPartials = vmulq_f64(vld1q_f64(cl_r + v + 2), vwt);
+                vst1q_f64(cl_p + u + 2, vfmaq_f64(vld1q_f64(cl_p + u + 2), vu_m[stateChild][1].vx, wtdPartials));
+
+                u += 4;
+                v += 4;
+            }
+        }
+    } else { // Integrate against a partial at the child
+
+        const double* cl_q = gPartials[childIndex];
+
+        for(int l = 0; l < kCategoryCount; l++) {
+            int v = (l*kPaddedPatternCount + startPattern)*4;
+            int u = startPattern*4;
+            NEON_PREFETCH_MATRIX(transMatrix + l*4*OFFSET, vu_m);
+            const float64x2_t vwt = vdupq_n_f64(wt[l]);
+
+            for(int k = startPattern; k < endPattern; k++) {
+                float64x2_t vclp_01, vclp_23;
+                neonTransformPartials(cl_q + v, vu_m, vclp_01, vclp_23);
+                vclp_01 = vmulq_f64(vclp_01, vwt);
+                vclp_23 = vmulq_f64(vclp_23, vwt);
+
+                vst1q_f64(cl_p + u,     vfmaq_f64(vld1q_f64(cl_p + u),     vclp_01, vld1q_f64(cl_r + v)));
+                vst1q_f64(cl_p + u + 2, vfmaq_f64(vld1q_f64(cl_p + u + 2), vclp_23, vld1q_f64(cl_r + v + 2)));
+
+                u += 4;
+                v += 4;
+            }
+        }
+    }
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+int BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcEdgeLogLikelihoods(const int parIndex,
+                                                                              const int childIndex,
+                                                                              const int probIndex,
+                                                                              const int categoryWeightsIndex,
+                                                                              const int stateFrequenciesIndex,
+                                                                              const int scalingFactorsIndex,
+                                                                              double* outSumLogLikelihood) {
+    // TODO: implement derivatives for calculateEdgeLnL
+
+    assert(parIndex >= kTipCount);
+
+    memset(integrationTmp, 0, (kPatternCount * kStateCount)*sizeof(double));
+
+    integrateEdgeByPatternRange(gPartials[parIndex], childIndex, gTransitionMatrices[probIndex],
+                                gCategoryWeights[categoryWeightsIndex], 0, kPatternCount);
+
+    return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+void BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::calcEdgeLogLikelihoodsByPartition(
+                                                  const int* parentBufferIndices,
+                                                  const int* childBufferIndices,
+                                                  const int* probabilityIndices,
+                                                  const int* categoryWeightsIndices,
+                                                  const int* stateFrequenciesIndices,
+                                                  const int* cumulativeScaleIndices,
+                                                  const int* partitionIndices,
+                                                  int partitionCount,
+                                                  double* outSumLogLikelihoodByPartition) {
+
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        memset(&integrationTmp[startPattern*kStateCount], 0, ((endPattern - startPattern) * kStateCount)*sizeof(double));
+
+        const int parIndex = parentBufferIndices[p];
+        assert(parIndex >= kTipCount);
+
+        integrateEdgeByPatternRange(gPartials[parIndex], childBufferIndices[p],
+                                    gTransitionMatrices[probabilityIndices[p]],
+                                    gCategoryWeights[categoryWeightsIndices[p]],
+                                    startPattern, endPattern);
+    }
+
+    integrateOutStatesAndScaleByPartition(integrationTmp, stateFrequenciesIndices, cumulativeScaleIndices,
+                                          partitionIndices, partitionCount, outSumLogLikelihoodByPartition);
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+int BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::getPaddedPatternsModulus() {
+	return 1;  // We currently do not vectorize across patterns
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+const char* BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::getName() {
+    return  getBeagleCPU4StateNEONName<double>();
+}
+
+BEAGLE_CPU_4_NEON_TEMPLATE
+const long long BeagleCPU4StateNEONImpl<BEAGLE_CPU_4_NEON_DOUBLE>::getFlags() {
+    return  BEAGLE_FLAG_COMPUTATION_SYNCH |
+            BEAGLE_FLAG_PROCESSOR_CPU |
+            BEAGLE_FLAG_PRECISION_DOUBLE |
+            BEAGLE_FLAG_VECTOR_NEON |
+            BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeagleImplFactory public methods
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+BeagleImpl* BeagleCPU4StateNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             int resourceNumber,
+                                             int pluginResourceNumber,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
+                                             int* errorCode) {
+
+    if (stateCount != 4) {
+        return NULL;
+    }
+
+    if (!CPUSupportsNEON()) {
+        return NULL;
+    }
+
+    BeagleCPU4StateNEONImpl<REALTYPE, T_PAD_4_NEON_DEFAULT, P_PAD_4_NEON_DEFAULT>* impl =
+    		new BeagleCPU4StateNEONImpl<REALTYPE, T_PAD_4_NEON_DEFAULT, P_PAD_4_NEON_DEFAULT>();
+
+    try {
+        if (impl->createInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                 patternCount, eigenBufferCount, matrixBufferCount,
+                                 categoryCount,scaleBufferCount, resourceNumber,
+                                 pluginResourceNumber,
+                                 preferenceFlags, requirementFlags) == 0)
+            return impl;
+    }
+    catch(...) {
+        if (DEBUGGING_OUTPUT)
+            std::cerr << "exception in initialize\n";
+        delete impl;
+        throw;
+    }
+
+    delete impl;
+
+    return NULL;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                                   int partialsBufferCount,
+                                                                                   int compactBufferCount,
+                                                                                   int stateCount,
+                                                                                   int patternCount,
+                                                                                   int eigenBufferCount,
+                                                                                   int matrixBufferCount,
+                                                                                   int categoryCount,
+                                                                                   int scaleBufferCount,
+                                                                                   int resourceNumber,
+                                                                                   int pluginResourceNumber,
+                                                                                   long long preferenceFlags,
+                                                                                   long long requirementFlags,
+                                                                                   size_t* outBytes) {
+    if (stateCount != 4)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsNEON())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPU4StateNEONImpl<REALTYPE, T_PAD_4_NEON_DEFAULT, P_PAD_4_NEON_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+const char* BeagleCPU4StateNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
+	return getBeagleCPU4StateNEONName<BEAGLE_CPU_FACTORY_GENERIC>();
+}
+
+template <>
+const long long BeagleCPU4StateNEONImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
+           BEAGLE_FLAG_PROCESSOR_CPU |
+           BEAGLE_FLAG_VECTOR_NEON |
+           BEAGLE_FLAG_PRECISION_DOUBLE |
+           BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
+           BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL|
+           BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+}
+}
+
+#endif //BEAGLE_CPU_4STATE_NEON_IMPL_HPP
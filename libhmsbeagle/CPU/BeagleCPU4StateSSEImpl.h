@@ -39,6 +39,8 @@
 #define T_PAD_4_SSE_DEFAULT 2 // Pad transition matrix with 2 rows for SSE
 #define P_PAD_4_SSE_DEFAULT 0 // Partials padding not needed for 4 states SSE
 
+#define SSE_FLOAT_INTEGRATION_BLOCK 256 // Patterns whose double-precision state sums live on the stack at once
+
 #define BEAGLE_CPU_4_SSE_FLOAT       float, T_PAD, P_PAD
 #define BEAGLE_CPU_4_SSE_DOUBLE      double, T_PAD, P_PAD
 #define BEAGLE_CPU_4_SSE_TEMPLATE    template <int T_PAD, int P_PAD>
@@ -50,6 +52,11 @@ BEAGLE_CPU_TEMPLATE
 class BeagleCPU4StateSSEImpl : public BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC> {};
     
 
+/*
+ * Single-precision 4-state kernels. The four partials of a pattern fill one 128-bit
+ * vector; root and edge likelihoods are summed over rate categories and patterns in
+ * double precision so that long alignments keep their accuracy.
+ */
 BEAGLE_CPU_4_SSE_TEMPLATE
 class BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT> : public BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT> {
     
@@ -75,7 +82,7 @@ protected:
 public:    
     virtual const char* getName();
     
-	virtual const long getFlags();
+	virtual const long long getFlags();
     
 protected:
     virtual int getPaddedPatternsModulus();  
@@ -83,36 +90,46 @@ protected:
 private:
     
 	virtual void calcStatesStates(float* destP,
-                                  const int* states1,
+                                  const TipState* states1,
                                   const float* matrices1,
-                                  const int* states2,
-                                  const float* matrices2);
+                                  const TipState* states2,
+                                  const float* matrices2,
+                                  int startPattern,
+                                  int endPattern);
     
     virtual void calcStatesPartials(float* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const float* __restrict matrices1,
                                     const float* __restrict partials2,
-                                    const float* __restrict matrices2);
+                                    const float* __restrict matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual void calcStatesPartialsFixedScaling(float* destP,
-                                                const int* states1,
+                                                const TipState* states1,
                                                 const float* __restrict matrices1,
                                                 const float* __restrict partials2,
                                                 const float* __restrict matrices2,
-                                                const float* __restrict scaleFactors);
+                                                const float* __restrict scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
     
     virtual void calcPartialsPartials(float* __restrict destP,
                                       const float* __restrict partials1,
                                       const float* __restrict matrices1,
                                       const float* __restrict partials2,
-                                      const float* __restrict matrices2);
+                                      const float* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
     
     virtual void calcPartialsPartialsFixedScaling(float* __restrict destP,
                                                   const float* __restrict child0Partials,
                                                   const float* __restrict child0TransMat,
                                                   const float* __restrict child1Partials,
                                                   const float* __restrict child1TransMat,
-                                                  const float* __restrict scaleFactors);
+                                                  const float* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
     
     virtual void calcPartialsPartialsAutoScaling(float* __restrict destP,
                                                  const float* __restrict partials1,
@@ -121,6 +138,20 @@ private:
                                                  const float* __restrict matrices2,
                                                  int* activateScaling);
     
+    virtual int calcRootLogLikelihoods(const int bufferIndex,
+                                       const int categoryWeightsIndex,
+                                       const int stateFrequenciesIndex,
+                                       const int scalingFactorsIndex,
+                                       double* outSumLogLikelihood);
+
+    virtual void calcRootLogLikelihoodsByPartition(const int* bufferIndices,
+                                                   const int* categoryWeightsIndices,
+                                                   const int* stateFrequenciesIndices,
+                                                   const int* cumulativeScaleIndices,
+                                                   const int* partitionIndices,
+                                                   int partitionCount,
+                                                   double* outSumLogLikelihoodByPartition);
+
     virtual int calcEdgeLogLikelihoods(const int parentBufferIndex,
                                        const int childBufferIndex,
                                        const int probabilityIndex,
@@ -138,6 +169,32 @@ private:
                                                   const int* partitionIndices,
                                                   int partitionCount,
                                                   double* outSumLogLikelihoodByPartition);
+
+    // Log likelihood of the root over patterns [start, end), accumulated in double
+    double integrateRootByPatternRange(const float* rootPartials,
+                                       const float* wt,
+                                       const float* freqs,
+                                       const float* scalingFactors,
+                                       int startPattern,
+                                       int endPattern);
+
+    // Log likelihood across an edge over patterns [start, end), accumulated in double
+    double integrateEdgeByPatternRange(const float* partialsParent,
+                                       const int childIndex,
+                                       const float* transMatrix,
+                                       const float* wt,
+                                       const float* freqs,
+                                       const float* scalingFactors,
+                                       int startPattern,
+                                       int endPattern);
+
+    // Weights per-state sums by the state frequencies, takes logs and writes site log
+    // likelihoods for patterns [start, end); returns their pattern-weighted sum
+    double integrateOutStatesByPatternRange(const double* stateSums,
+                                            const float* freqs,
+                                            const float* scalingFactors,
+                                            int startPattern,
+                                            int endPattern);
     
 };
     
@@ -162,12 +219,13 @@ protected:
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::realtypeMin;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::outLogLikelihoodsTmp;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gPatternWeights;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::sumOverPatterns;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gPatternPartitionsStartPatterns;
     
 public:
     virtual const char* getName();
     
-	virtual const long getFlags();
+	virtual const long long getFlags();
     
 protected:
     virtual int getPaddedPatternsModulus();
@@ -175,15 +233,15 @@ protected:
 private:
     
     virtual void calcStatesStates(double* destP,
-                                  const int* states1,
+                                  const TipState* states1,
                                   const double* matrices1,
-                                  const int* states2,
+                                  const TipState* states2,
                                   const double* matrices2,
                                   int startPattern,
                                   int endPattern);
     
     virtual void calcStatesPartials(double* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const double* __restrict matrices1,
                                     const double* __restrict partials2,
                                     const double* __restrict matrices2,
@@ -191,7 +249,7 @@ private:
                                     int endPattern);
     
     virtual void calcStatesPartialsFixedScaling(double* destP,
-                                                const int* states1,
+                                                const TipState* states1,
                                                 const double* __restrict matrices1,
                                                 const double* __restrict partials2,
                                                 const double* __restrict matrices2,
@@ -258,12 +316,27 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 }	// namespace cpu
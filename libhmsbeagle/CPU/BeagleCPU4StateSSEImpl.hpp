@@ -85,6 +85,34 @@
 		dest_vu_m1[i][1].x[1] = m1[3*OFFSET]; \
 	}
 
+/* Loads a (transposed) single-precision transition matrix; vector i holds P(0..3 -> i) */
+#define SSE_PREFETCH_MATRIX_FLOAT(src_m, dest_vu_m) \
+	for (int i = 0; i < OFFSET; i++) { \
+		dest_vu_m[i].x[0] = (src_m)[0*OFFSET + i]; \
+		dest_vu_m[i].x[1] = (src_m)[1*OFFSET + i]; \
+		dest_vu_m[i].x[2] = (src_m)[2*OFFSET + i]; \
+		dest_vu_m[i].x[3] = (src_m)[3*OFFSET + i]; \
+	}
+
+/* Single-precision matrix-times-partials for the four states of one pattern */
+static inline __m128 sseTransformPartialsFloat(const float* partials,
+                                               const VecUnionFloat* vu_m) {
+    const __m128 p = _mm_load_ps(partials);
+    __m128 a = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0,0,0,0)), vu_m[0].vx);
+    __m128 b = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1,1,1,1)), vu_m[1].vx);
+    a = _mm_add_ps(a, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2,2,2,2)), vu_m[2].vx));
+    b = _mm_add_ps(b, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3,3,3,3)), vu_m[3].vx));
+    return _mm_add_ps(a, b);
+}
+
+/* Adds wt * x, widened to double, to the double-precision state sums at dest */
+static inline void sseAccumulateFloatAsDouble(double* dest,
+                                              const __m128 x,
+                                              const __m128d wt) {
+    _mm_store_pd(dest,     _mm_add_pd(_mm_load_pd(dest),     _mm_mul_pd(_mm_cvtps_pd(x), wt)));
+    _mm_store_pd(dest + 2, _mm_add_pd(_mm_load_pd(dest + 2), _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), wt)));
+}
+
 namespace beagle {
 namespace cpu {
 
@@ -104,9 +132,9 @@ inline const char* getBeagleCPU4StateSSEName<float>(){ return "CPU-4State-SSE-Si
 
 BEAGLE_CPU_4_SSE_TEMPLATE
 void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesStates(double* destP,
-                                                                       const int* states_q,
+                                                                       const TipState* states_q,
                                                                        const double* matrices_q,
-                                                                       const int* states_r,
+                                                                       const TipState* states_r,
                                                                        const double* matrices_r,
                                                                        int startPattern,
                                                                        int endPattern) {
@@ -147,7 +175,7 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesStates(double* d
 
 BEAGLE_CPU_4_SSE_TEMPLATE
 void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartials(double* destP,
-                                                                         const int* states_q,
+                                                                         const TipState* states_q,
                                                                          const double* matrices_q,
                                                                          const double* partials_r,
                                                                          const double* matrices_r,
@@ -200,7 +228,7 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartials(double*
 
 BEAGLE_CPU_4_SSE_TEMPLATE
 void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
-                                                                                     const int* states_q,
+                                                                                     const TipState* states_q,
                                                                                      const double* __restrict matrices_q,
                                                                                      const double* __restrict partials_r,
                                                                                      const double* __restrict matrices_r,
@@ -449,6 +477,308 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartialsFixedS
 }
 
     
+/*
+ * Single-precision kernels
+ */
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesStates(float* destP,
+                                                                      const TipState* states_q,
+                                                                      const float* matrices_q,
+                                                                      const TipState* states_r,
+                                                                      const float* matrices_r,
+                                                                      int startPattern,
+                                                                      int endPattern) {
+
+    VecUnionFloat vu_mq[OFFSET], vu_mr[OFFSET];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_q + l*4*OFFSET, vu_mq);
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            _mm_store_ps(destP + v, _mm_mul_ps(vu_mq[states_q[k]].vx, vu_mr[states_r[k]].vx));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartials(float* destP,
+                                                                        const TipState* states_q,
+                                                                        const float* __restrict matrices_q,
+                                                                        const float* __restrict partials_r,
+                                                                        const float* __restrict matrices_r,
+                                                                        int startPattern,
+                                                                        int endPattern) {
+
+    VecUnionFloat vu_mq[OFFSET], vu_mr[OFFSET];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_q + l*4*OFFSET, vu_mq);
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const __m128 destr = sseTransformPartialsFloat(partials_r + v, vu_mr);
+            _mm_store_ps(destP + v, _mm_mul_ps(vu_mq[states_q[k]].vx, destr));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartialsFixedScaling(float* destP,
+                                                                                    const TipState* states_q,
+                                                                                    const float* __restrict matrices_q,
+                                                                                    const float* __restrict partials_r,
+                                                                                    const float* __restrict matrices_r,
+                                                                                    const float* __restrict scaleFactors,
+                                                                                    int startPattern,
+                                                                                    int endPattern) {
+
+    VecUnionFloat vu_mq[OFFSET], vu_mr[OFFSET];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_q + l*4*OFFSET, vu_mq);
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+            const __m128 scaleFactor = _mm_set1_ps(1.0f / scaleFactors[k]);
+            const __m128 destr = sseTransformPartialsFloat(partials_r + v, vu_mr);
+            _mm_store_ps(destP + v, _mm_mul_ps(_mm_mul_ps(vu_mq[states_q[k]].vx, destr), scaleFactor));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartials(float* __restrict destP,
+                                                                          const float* __restrict partials_q,
+                                                                          const float* __restrict matrices_q,
+                                                                          const float* __restrict partials_r,
+                                                                          const float* __restrict matrices_r,
+                                                                          int startPattern,
+                                                                          int endPattern) {
+
+    VecUnionFloat vu_mq[OFFSET], vu_mr[OFFSET];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_q + l*4*OFFSET, vu_mq);
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+
+            const __m128 destq = sseTransformPartialsFloat(partials_q + v, vu_mq);
+            const __m128 destr = sseTransformPartialsFloat(partials_r + v, vu_mr);
+            _mm_store_ps(destP + v, _mm_mul_ps(destq, destr));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartialsFixedScaling(float* __restrict destP,
+                                                                                      const float* __restrict partials_q,
+                                                                                      const float* __restrict matrices_q,
+                                                                                      const float* __restrict partials_r,
+                                                                                      const float* __restrict matrices_r,
+                                                                                      const float* __restrict scaleFactors,
+                                                                                      int startPattern,
+                                                                                      int endPattern) {
+
+    VecUnionFloat vu_mq[OFFSET], vu_mr[OFFSET];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*4;
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_q + l*4*OFFSET, vu_mq);
+        SSE_PREFETCH_MATRIX_FLOAT(matrices_r + l*4*OFFSET, vu_mr);
+
+        for (int k = startPattern; k < endPattern; k++) {
+
+            __builtin_prefetch (&partials_q[v+64]);
+            __builtin_prefetch (&partials_r[v+64]);
+
+            const __m128 scaleFactor = _mm_set1_ps(1.0f / scaleFactors[k]);
+            const __m128 destq = sseTransformPartialsFloat(partials_q + v, vu_mq);
+            const __m128 destr = sseTransformPartialsFloat(partials_r + v, vu_mr);
+            _mm_store_ps(destP + v, _mm_mul_ps(_mm_mul_ps(destq, destr), scaleFactor));
+            v += 4;
+        }
+    }
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+double BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::integrateOutStatesByPatternRange(const double* stateSums,
+                                                                                        const float* freqs,
+                                                                                        const float* scalingFactors,
+                                                                                        int startPattern,
+                                                                                        int endPattern) {
+
+    const __m128d freq01 = _mm_set_pd(freqs[1], freqs[0]);
+    const __m128d freq23 = _mm_set_pd(freqs[3], freqs[2]);
+
+    double sumLogLikelihood = 0.0;
+    int u = 0;
+    for (int k = startPattern; k < endPattern; k++) {
+        __m128d sumOverI = _mm_add_pd(_mm_mul_pd(_mm_load_pd(stateSums + u), freq01),
+                                      _mm_mul_pd(_mm_load_pd(stateSums + u + 2), freq23));
+        sumOverI = _mm_add_sd(sumOverI, _mm_unpackhi_pd(sumOverI, sumOverI));
+
+        double logLikelihood = log(_mm_cvtsd_f64(sumOverI));
+        if (scalingFactors != NULL)
+            logLikelihood += scalingFactors[k];
+
+        outLogLikelihoodsTmp[k] = (float) logLikelihood;
+        sumLogLikelihood += logLikelihood * gPatternWeights[k];
+        u += 4;
+    }
+
+    return sumLogLikelihood;
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+double BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::integrateRootByPatternRange(const float* rootPartials,
+                                                                                   const float* wt,
+                                                                                   const float* freqs,
+                                                                                   const float* scalingFactors,
+                                                                                   int startPattern,
+                                                                                   int endPattern) {
+
+    double ALIGN16 stateSums[SSE_FLOAT_INTEGRATION_BLOCK * 4];
+    double sumLogLikelihood = 0.0;
+
+    for (int blockStart = startPattern; blockStart < endPattern; blockStart += SSE_FLOAT_INTEGRATION_BLOCK) {
+        const int blockEnd = (blockStart + SSE_FLOAT_INTEGRATION_BLOCK < endPattern ?
+                              blockStart + SSE_FLOAT_INTEGRATION_BLOCK : endPattern);
+        memset(stateSums, 0, sizeof(double) * 4 * (blockEnd - blockStart));
+
+        for (int l = 0; l < kCategoryCount; l++) {
+            const __m128d vwt = _mm_set1_pd(wt[l]);
+            int v = (l*kPaddedPatternCount + blockStart)*4;
+            int u = 0;
+            for (int k = blockStart; k < blockEnd; k++) {
+                sseAccumulateFloatAsDouble(stateSums + u, _mm_load_ps(rootPartials + v), vwt);
+                u += 4;
+                v += 4;
+            }
+        }
+
+        sumLogLikelihood += integrateOutStatesByPatternRange(stateSums, freqs, scalingFactors, blockStart, blockEnd);
+    }
+
+    return sumLogLikelihood;
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+double BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::integrateEdgeByPatternRange(const float* cl_r,
+                                                                                   const int childIndex,
+                                                                                   const float* transMatrix,
+                                                                                   const float* wt,
+                                                                                   const float* freqs,
+                                                                                   const float* scalingFactors,
+                                                                                   int startPattern,
+                                                                                   int endPattern) {
+
+    double ALIGN16 stateSums[SSE_FLOAT_INTEGRATION_BLOCK * 4];
+    double sumLogLikelihood = 0.0;
+
+    const TipState* statesChild = (childIndex < kTipCount ? gTipStates[childIndex] : NULL);
+    const float* cl_q = gPartials[childIndex];
+
+    VecUnionFloat vu_m[OFFSET];
+
+    for (int blockStart = startPattern; blockStart < endPattern; blockStart += SSE_FLOAT_INTEGRATION_BLOCK) {
+        const int blockEnd = (blockStart + SSE_FLOAT_INTEGRATION_BLOCK < endPattern ?
+                              blockStart + SSE_FLOAT_INTEGRATION_BLOCK : endPattern);
+        memset(stateSums, 0, sizeof(double) * 4 * (blockEnd - blockStart));
+
+        for (int l = 0; l < kCategoryCount; l++) {
+            SSE_PREFETCH_MATRIX_FLOAT(transMatrix + l*4*OFFSET, vu_m);
+            const __m128d vwt = _mm_set1_pd(wt[l]);
+            int v = (l*kPaddedPatternCount + blockStart)*4;
+            int u = 0;
+            if (statesChild != NULL) { // Integrate against a state at the child
+                for (int k = blockStart; k < blockEnd; k++) {
+                    const __m128 edge = _mm_mul_ps(vu_m[statesChild[k]].vx, _mm_load_ps(cl_r + v));
+                    sseAccumulateFloatAsDouble(stateSums + u, edge, vwt);
+                    u += 4;
+                    v += 4;
+                }
+            } else { // Integrate against a partial at the child
+                for (int k = blockStart; k < blockEnd; k++) {
+                    const __m128 edge = _mm_mul_ps(sseTransformPartialsFloat(cl_q + v, vu_m), _mm_load_ps(cl_r + v));
+                    sseAccumulateFloatAsDouble(stateSums + u, edge, vwt);
+                    u += 4;
+                    v += 4;
+                }
+            }
+        }
+
+        sumLogLikelihood += integrateOutStatesByPatternRange(stateSums, freqs, scalingFactors, blockStart, blockEnd);
+    }
+
+    return sumLogLikelihood;
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcRootLogLikelihoods(const int bufferIndex,
+                                                                           const int categoryWeightsIndex,
+                                                                           const int stateFrequenciesIndex,
+                                                                           const int scalingFactorsIndex,
+                                                                           double* outSumLogLikelihood) {
+
+    const float* rootPartials = gPartials[bufferIndex];
+    assert(rootPartials);
+
+    const float* scalingFactors = (scalingFactorsIndex != BEAGLE_OP_NONE ? gScaleBuffers[scalingFactorsIndex] : NULL);
+
+    *outSumLogLikelihood = integrateRootByPatternRange(rootPartials, gCategoryWeights[categoryWeightsIndex],
+                                                       gStateFrequencies[stateFrequenciesIndex], scalingFactors,
+                                                       0, kPatternCount);
+
+    if (*outSumLogLikelihood != *outSumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_4_SSE_TEMPLATE
+void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcRootLogLikelihoodsByPartition(
+                                                                    const int* bufferIndices,
+                                                                    const int* categoryWeightsIndices,
+                                                                    const int* stateFrequenciesIndices,
+                                                                    const int* cumulativeScaleIndices,
+                                                                    const int* partitionIndices,
+                                                                    int partitionCount,
+                                                                    double* outSumLogLikelihoodByPartition) {
+
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        const float* rootPartials = gPartials[bufferIndices[p]];
+        assert(rootPartials);
+
+        const int scalingFactorsIndex = cumulativeScaleIndices[p];
+        const float* scalingFactors = (scalingFactorsIndex != BEAGLE_OP_NONE ? gScaleBuffers[scalingFactorsIndex] : NULL);
+
+        outSumLogLikelihoodByPartition[p] = integrateRootByPatternRange(rootPartials,
+                                                                        gCategoryWeights[categoryWeightsIndices[p]],
+                                                                        gStateFrequencies[stateFrequenciesIndices[p]],
+                                                                        scalingFactors,
+                                                                        startPattern, endPattern);
+    }
+}
+
 BEAGLE_CPU_4_SSE_TEMPLATE
 void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartialsAutoScaling(float* destP,
                                                          const float*  partials_q,
@@ -482,20 +812,26 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartialsAutoSc
     
 BEAGLE_CPU_4_SSE_TEMPLATE
 int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcEdgeLogLikelihoods(const int parIndex,
-                                                          const int childIndex,
-                                                          const int probIndex,
-                                                          const int categoryWeightsIndex,
-                                                          const int stateFrequenciesIndex,
-                                                          const int scalingFactorsIndex,
-                                                          double* outSumLogLikelihood) {
-    return BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcEdgeLogLikelihoods(
-                                                              parIndex,
-                                                              childIndex,
-                                                              probIndex,
-                                                              categoryWeightsIndex,
-                                                              stateFrequenciesIndex,
-                                                              scalingFactorsIndex,
-                                                              outSumLogLikelihood);
+                                                                           const int childIndex,
+                                                                           const int probIndex,
+                                                                           const int categoryWeightsIndex,
+                                                                           const int stateFrequenciesIndex,
+                                                                           const int scalingFactorsIndex,
+                                                                           double* outSumLogLikelihood) {
+
+    assert(parIndex >= kTipCount);
+
+    const float* scalingFactors = (scalingFactorsIndex != BEAGLE_OP_NONE ? gScaleBuffers[scalingFactorsIndex] : NULL);
+
+    *outSumLogLikelihood = integrateEdgeByPatternRange(gPartials[parIndex], childIndex, gTransitionMatrices[probIndex],
+                                                       gCategoryWeights[categoryWeightsIndex],
+                                                       gStateFrequencies[stateFrequenciesIndex], scalingFactors,
+                                                       0, kPatternCount);
+
+    if (*outSumLogLikelihood != *outSumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
@@ -522,7 +858,7 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
 
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-        const int* statesChild = gTipStates[childIndex];
+        const TipState* statesChild = gTipStates[childIndex];
 
         int w = 0;
         V_Real *vcl_r = (V_Real *)cl_r;
@@ -615,10 +951,7 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -638,16 +971,25 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcEdgeLogLikelihoodsByPar
                                                   int partitionCount,
                                                   double* outSumLogLikelihoodByPartition) {
 
-    BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcEdgeLogLikelihoodsByPartition(
-                                                  parentBufferIndices,
-                                                  childBufferIndices,
-                                                  probabilityIndices,
-                                                  categoryWeightsIndices,
-                                                  stateFrequenciesIndices,
-                                                  cumulativeScaleIndices,
-                                                  partitionIndices,
-                                                  partitionCount,
-                                                  outSumLogLikelihoodByPartition);
+    for (int p = 0; p < partitionCount; p++) {
+        int pIndex = partitionIndices[p];
+
+        int startPattern = gPatternPartitionsStartPatterns[pIndex];
+        int endPattern = gPatternPartitionsStartPatterns[pIndex + 1];
+
+        const int parIndex = parentBufferIndices[p];
+        assert(parIndex >= kTipCount);
+
+        const int scalingFactorsIndex = cumulativeScaleIndices[p];
+        const float* scalingFactors = (scalingFactorsIndex != BEAGLE_OP_NONE ? gScaleBuffers[scalingFactorsIndex] : NULL);
+
+        outSumLogLikelihoodByPartition[p] = integrateEdgeByPatternRange(gPartials[parIndex], childBufferIndices[p],
+                                                                        gTransitionMatrices[probabilityIndices[p]],
+                                                                        gCategoryWeights[categoryWeightsIndices[p]],
+                                                                        gStateFrequencies[stateFrequenciesIndices[p]],
+                                                                        scalingFactors,
+                                                                        startPattern, endPattern);
+    }
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
@@ -691,7 +1033,7 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoodsByPa
 
         if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-            const int* statesChild = gTipStates[childIndex];
+            const TipState* statesChild = gTipStates[childIndex];
 
             int w = 0;
             V_Real *vcl_r = (V_Real *) (cl_r + startPattern * 4);
@@ -788,10 +1130,7 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoodsByPa
                 outLogLikelihoodsTmp[k] += scalingFactors[k];
         }
 
-        outSumLogLikelihoodByPartition[p] = 0.0;
-        for (int i = startPattern; i < endPattern; i++) {
-            outSumLogLikelihoodByPartition[p] += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-        }
+        outSumLogLikelihoodByPartition[p] = sumOverPatterns(outLogLikelihoodsTmp, startPattern, endPattern);
 
     }
 }
@@ -821,7 +1160,7 @@ const char* BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getName() {
 
     
 BEAGLE_CPU_4_SSE_TEMPLATE
-const long BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::getFlags() {
+const long long BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::getFlags() {
 	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_PROCESSOR_CPU |
             BEAGLE_FLAG_PRECISION_SINGLE |
@@ -830,7 +1169,7 @@ const long BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::getFlags() {
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
-const long BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getFlags() {
+const long long BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getFlags() {
     return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_PROCESSOR_CPU |
             BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -855,8 +1194,8 @@ BeagleImpl* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     if (stateCount != 4) {
@@ -891,16 +1230,47 @@ BeagleImpl* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                                  int partialsBufferCount,
+                                                                                  int compactBufferCount,
+                                                                                  int stateCount,
+                                                                                  int patternCount,
+                                                                                  int eigenBufferCount,
+                                                                                  int matrixBufferCount,
+                                                                                  int categoryCount,
+                                                                                  int scaleBufferCount,
+                                                                                  int resourceNumber,
+                                                                                  int pluginResourceNumber,
+                                                                                  long long preferenceFlags,
+                                                                                  long long requirementFlags,
+                                                                                  size_t* outBytes) {
+    if (stateCount != 4)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsSSE())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPU4StateSSEImpl<REALTYPE, T_PAD_4_SSE_DEFAULT, P_PAD_4_SSE_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPU4StateSSEName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 template <>
-const long BeagleCPU4StateSSEImplFactory<double>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPU4StateSSEImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
-           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
            BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -911,10 +1281,12 @@ const long BeagleCPU4StateSSEImplFactory<double>::getFlags() {
 }
 
 template <>
-const long BeagleCPU4StateSSEImplFactory<float>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPU4StateSSEImplFactory<float>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
-           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
            BEAGLE_FLAG_PRECISION_SINGLE |
@@ -0,0 +1,186 @@
+/*
+ *  BeagleCPUAVX512Impl.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BeagleCPUAVX512Impl__
+#define __BeagleCPUAVX512Impl__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include "libhmsbeagle/CPU/BeagleCPUImpl.h"
+
+#include <vector>
+
+#define T_PAD_AVX512_DEFAULT    1   // Pad transition matrix rows with an extra 1.0 for ambiguous characters
+#define P_PAD_AVX512_DEFAULT    0   // Partials padding not needed, tails use masked loads and stores
+
+// Largest state count whose transposed matrices are kept on the stack; larger
+// models fall back to the scalar kernels
+#define BEAGLE_CPU_AVX512_MAX_STATE_COUNT   64
+
+// Patterns computed together by the register-blocked kernels, and the smallest state
+// count for which blocking pays (below it a single pattern already fills the FMA units)
+#define BEAGLE_CPU_AVX512_PATTERN_BLOCK             4
+#define BEAGLE_CPU_AVX512_MIN_BLOCKED_STATE_COUNT   16
+
+#define BEAGLE_CPU_AVX512_DOUBLE    double, T_PAD, P_PAD
+#define BEAGLE_CPU_AVX512_TEMPLATE  template <int T_PAD, int P_PAD>
+
+namespace beagle {
+namespace cpu {
+
+BEAGLE_CPU_TEMPLATE
+class BeagleCPUAVX512Impl : public BeagleCPUImpl<BEAGLE_CPU_GENERIC> {};
+
+/*
+ * Double-precision kernels for any state count. Transition matrices are transposed
+ * per rate category so that eight destination states are updated by each fused
+ * multiply-add, with a masked store for the last block of states. For larger
+ * state counts (amino acids, codons) patterns are processed in blocks of four so
+ * that each loaded matrix row feeds several patterns, as in a register-tiled GEMM.
+ */
+BEAGLE_CPU_AVX512_TEMPLATE
+class BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE> : public BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE> {
+
+protected:
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kTipCount;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gPartials;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::integrationTmp;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gTransitionMatrices;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kPatternCount;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kPaddedPatternCount;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kExtraPatterns;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kStateCount;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gTipStates;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gScaleBuffers;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gCategoryWeights;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::gStateFrequencies;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::realtypeMin;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kMatrixSize;
+	using BeagleCPUImpl<BEAGLE_CPU_AVX512_DOUBLE>::kPartialsPaddedStateCount;
+
+public:
+    virtual const char* getName();
+
+    virtual const long long getFlags();
+
+protected:
+    virtual int getPaddedPatternsModulus();
+
+private:
+    virtual void calcStatesPartials(double* destP,
+                                    const TipState* states1,
+                                    const double* matrices1,
+                                    const double* partials2,
+                                    const double* matrices2,
+                                    int startPattern,
+                                    int endPattern);
+
+    virtual void calcStatesPartialsFixedScaling(double* destP,
+                                                const TipState* states1,
+                                                const double* matrices1,
+                                                const double* partials2,
+                                                const double* matrices2,
+                                                const double* scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
+
+    virtual void calcPartialsPartials(double* __restrict destP,
+                                      const double* __restrict partials1,
+                                      const double* __restrict matrices1,
+                                      const double* __restrict partials2,
+                                      const double* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
+
+    virtual void calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                  const double* __restrict partials1,
+                                                  const double* __restrict matrices1,
+                                                  const double* __restrict partials2,
+                                                  const double* __restrict matrices2,
+                                                  const double* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
+
+    // Shared body of the four kernels above; states1 is NULL when child 1 has partials
+    // and scaleFactors is NULL when the result is not rescaled
+    void calcProductByPatternRange(double* __restrict destP,
+                                   const TipState* states1,
+                                   const double* __restrict partials1,
+                                   const double* __restrict matrices1,
+                                   const double* __restrict partials2,
+                                   const double* __restrict matrices2,
+                                   const double* __restrict scaleFactors,
+                                   int startPattern,
+                                   int endPattern);
+
+};
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+class BeagleCPUAVX512ImplFactory : public BeagleImplFactory {
+public:
+    virtual BeagleImpl* createImpl(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   int* errorCode);
+
+    virtual const char* getName();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
+};
+
+}	// namespace cpu
+}	// namespace beagle
+
+// now include the file containing template function implementations
+#include "libhmsbeagle/CPU/BeagleCPUAVX512Impl.hpp"
+
+
+#endif // __BeagleCPUAVX512Impl__
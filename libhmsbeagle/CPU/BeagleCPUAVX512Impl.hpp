@@ -0,0 +1,421 @@
+/*
+ *  BeagleCPUAVX512Impl.hpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BEAGLE_CPU_AVX512_IMPL_HPP
+#define BEAGLE_CPU_AVX512_IMPL_HPP
+
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/CPU/BeagleCPUImpl.h"
+#include "libhmsbeagle/CPU/BeagleCPUAVX512Impl.h"
+#include "libhmsbeagle/CPU/AVX512Definitions.h"
+
+namespace beagle {
+namespace cpu {
+
+/* Transposes a stateCount x columnCount transition matrix so that row j holds
+   P(i -> j) for all i, each row zero-filled to a multiple of the vector width */
+static inline void avx512TransposeMatrix(const double* matrix,
+                                         double* transposed,
+                                         int stateCount,
+                                         int columnCount,
+                                         int stride) {
+    for (int j = 0; j < columnCount; j++) {
+        int i = 0;
+        for (; i < stateCount; i++)
+            transposed[j * stride + i] = matrix[i * columnCount + j];
+        for (; i < stride; i++)
+            transposed[j * stride + i] = 0.0;
+    }
+}
+
+/* out[i] = sum_j P(i -> j) partials[j]; eight states per vector, two accumulation chains */
+static inline void avx512MatrixTimesPartials(double* out,
+                                             const double* transposed,
+                                             const double* partials,
+                                             int stateCount,
+                                             int stride) {
+    for (int b = 0; b < stride; b += AVX512_DOUBLES_PER_VEC) {
+        __m512d sumA = _mm512_setzero_pd();
+        __m512d sumB = _mm512_setzero_pd();
+        int j = 0;
+        for (; j < stateCount - 1; j += 2) {
+            sumA = _mm512_fmadd_pd(_mm512_set1_pd(partials[j]),
+                                   _mm512_load_pd(transposed + j * stride + b), sumA);
+            sumB = _mm512_fmadd_pd(_mm512_set1_pd(partials[j + 1]),
+                                   _mm512_load_pd(transposed + (j + 1) * stride + b), sumB);
+        }
+        if (j < stateCount) {
+            sumA = _mm512_fmadd_pd(_mm512_set1_pd(partials[j]),
+                                   _mm512_load_pd(transposed + j * stride + b), sumA);
+        }
+        _mm512_store_pd(out + b, _mm512_add_pd(sumA, sumB));
+    }
+}
+
+/* Register-blocked form of avx512MatrixTimesPartials for BEAGLE_CPU_AVX512_PATTERN_BLOCK
+   consecutive patterns, out[p * stride + i] for pattern p. Each transposed row is loaded
+   once per tile of two vectors and reused for all four patterns, so the matrix traffic of
+   large state-count models is amortized over the block much like a small GEMM */
+static inline void avx512MatrixTimesPartialsBlock(double* out,
+                                                  const double* transposed,
+                                                  const double* partials,
+                                                  int partialsStride,
+                                                  int stateCount,
+                                                  int stride) {
+    const double* p0 = partials;
+    const double* p1 = p0 + partialsStride;
+    const double* p2 = p1 + partialsStride;
+    const double* p3 = p2 + partialsStride;
+
+    int b = 0;
+    for (; b + 2 * AVX512_DOUBLES_PER_VEC <= stride; b += 2 * AVX512_DOUBLES_PER_VEC) {
+        __m512d s0a = _mm512_setzero_pd(), s0b = _mm512_setzero_pd();
+        __m512d s1a = _mm512_setzero_pd(), s1b = _mm512_setzero_pd();
+        __m512d s2a = _mm512_setzero_pd(), s2b = _mm512_setzero_pd();
+        __m512d s3a = _mm512_setzero_pd(), s3b = _mm512_setzero_pd();
+        for (int j = 0; j < stateCount; j++) {
+            const __m512d ma = _mm512_load_pd(transposed + j * stride + b);
+            const __m512d mb = _mm512_load_pd(transposed + j * stride + b + AVX512_DOUBLES_PER_VEC);
+            __m512d x = _mm512_set1_pd(p0[j]);
+            s0a = _mm512_fmadd_pd(x, ma, s0a);
+            s0b = _mm512_fmadd_pd(x, mb, s0b);
+            x = _mm512_set1_pd(p1[j]);
+            s1a = _mm512_fmadd_pd(x, ma, s1a);
+            s1b = _mm512_fmadd_pd(x, mb, s1b);
+            x = _mm512_set1_pd(p2[j]);
+            s2a = _mm512_fmadd_pd(x, ma, s2a);
+            s2b = _mm512_fmadd_pd(x, mb, s2b);
+            x = _mm512_set1_pd(p3[j]);
+            s3a = _mm512_fmadd_pd(x, ma, s3a);
+            s3b = _mm512_fmadd_pd(x, mb, s3b);
+        }
+        _mm512_store_pd(out + 0 * stride + b, s0a);
+        _mm512_store_pd(out + 0 * stride + b + AVX512_DOUBLES_PER_VEC, s0b);
+        _mm512_store_pd(out + 1 * stride + b, s1a);
+        _mm512_store_pd(out + 1 * stride + b + AVX512_DOUBLES_PER_VEC, s1b);
+        _mm512_store_pd(out + 2 * stride + b, s2a);
+        _mm512_store_pd(out + 2 * stride + b + AVX512_DOUBLES_PER_VEC, s2b);
+        _mm512_store_pd(out + 3 * stride + b, s3a);
+        _mm512_store_pd(out + 3 * stride + b + AVX512_DOUBLES_PER_VEC, s3b);
+    }
+    if (b < stride) {
+        __m512d s0 = _mm512_setzero_pd();
+        __m512d s1 = _mm512_setzero_pd();
+        __m512d s2 = _mm512_setzero_pd();
+        __m512d s3 = _mm512_setzero_pd();
+        for (int j = 0; j < stateCount; j++) {
+            const __m512d m = _mm512_load_pd(transposed + j * stride + b);
+            s0 = _mm512_fmadd_pd(_mm512_set1_pd(p0[j]), m, s0);
+            s1 = _mm512_fmadd_pd(_mm512_set1_pd(p1[j]), m, s1);
+            s2 = _mm512_fmadd_pd(_mm512_set1_pd(p2[j]), m, s2);
+            s3 = _mm512_fmadd_pd(_mm512_set1_pd(p3[j]), m, s3);
+        }
+        _mm512_store_pd(out + 0 * stride + b, s0);
+        _mm512_store_pd(out + 1 * stride + b, s1);
+        _mm512_store_pd(out + 2 * stride + b, s2);
+        _mm512_store_pd(out + 3 * stride + b, s3);
+    }
+}
+
+/* destP[i] = child1[i] * child2[i] * oneOverScaleFactor, with a masked store for the last block */
+static inline void avx512StoreProduct(double* destP,
+                                      const double* child1,
+                                      const double* child2,
+                                      const __m512d oneOverScaleFactor,
+                                      int lastBlock,
+                                      __mmask8 lastBlockMask) {
+    int b = 0;
+    for (; b < lastBlock; b += AVX512_DOUBLES_PER_VEC) {
+        _mm512_storeu_pd(destP + b,
+                         _mm512_mul_pd(_mm512_mul_pd(_mm512_load_pd(child1 + b), _mm512_load_pd(child2 + b)),
+                                       oneOverScaleFactor));
+    }
+    _mm512_mask_storeu_pd(destP + b, lastBlockMask,
+                          _mm512_mul_pd(_mm512_mul_pd(_mm512_load_pd(child1 + b), _mm512_load_pd(child2 + b)),
+                                        oneOverScaleFactor));
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+inline const char* getBeagleCPUAVX512Name(){ return "CPU-AVX512-Unknown"; };
+
+template<>
+inline const char* getBeagleCPUAVX512Name<double>(){ return "CPU-AVX512-Double"; };
+
+BEAGLE_CPU_AVX512_TEMPLATE
+void BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::calcProductByPatternRange(double* __restrict destP,
+                                                                              const TipState* states1,
+                                                                              const double* __restrict partials1,
+                                                                              const double* __restrict matrices1,
+                                                                              const double* __restrict partials2,
+                                                                              const double* __restrict matrices2,
+                                                                              const double* __restrict scaleFactors,
+                                                                              int startPattern,
+                                                                              int endPattern) {
+
+    const int matrixIncr = kStateCount + T_PAD;
+    const int stride = ((kStateCount + AVX512_DOUBLES_PER_VEC - 1) / AVX512_DOUBLES_PER_VEC) * AVX512_DOUBLES_PER_VEC;
+    const int lastBlock = stride - AVX512_DOUBLES_PER_VEC;
+    const __mmask8 lastBlockMask = (__mmask8) ((1 << (kStateCount - lastBlock)) - 1);
+
+    // Kept on the stack since several partition threads may run kernels on one instance
+    double ALIGN64 transposed1[(BEAGLE_CPU_AVX512_MAX_STATE_COUNT + T_PAD) * BEAGLE_CPU_AVX512_MAX_STATE_COUNT];
+    double ALIGN64 transposed2[(BEAGLE_CPU_AVX512_MAX_STATE_COUNT + T_PAD) * BEAGLE_CPU_AVX512_MAX_STATE_COUNT];
+    double ALIGN64 sum1[BEAGLE_CPU_AVX512_PATTERN_BLOCK * BEAGLE_CPU_AVX512_MAX_STATE_COUNT];
+    double ALIGN64 sum2[BEAGLE_CPU_AVX512_PATTERN_BLOCK * BEAGLE_CPU_AVX512_MAX_STATE_COUNT];
+
+    const bool blocked = (kStateCount >= BEAGLE_CPU_AVX512_MIN_BLOCKED_STATE_COUNT);
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        avx512TransposeMatrix(matrices1 + l*kMatrixSize, transposed1, kStateCount, matrixIncr, stride);
+        avx512TransposeMatrix(matrices2 + l*kMatrixSize, transposed2, kStateCount, matrixIncr, stride);
+
+        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
+        int k = startPattern;
+
+        if (blocked) {
+            for (; k + BEAGLE_CPU_AVX512_PATTERN_BLOCK <= endPattern; k += BEAGLE_CPU_AVX512_PATTERN_BLOCK) {
+                if (states1 == NULL)
+                    avx512MatrixTimesPartialsBlock(sum1, transposed1, partials1 + v, kPartialsPaddedStateCount,
+                                                   kStateCount, stride);
+                avx512MatrixTimesPartialsBlock(sum2, transposed2, partials2 + v, kPartialsPaddedStateCount,
+                                               kStateCount, stride);
+
+                for (int p = 0; p < BEAGLE_CPU_AVX512_PATTERN_BLOCK; p++) {
+                    // the transposed row of a state is P(i -> state), including the ambiguous column
+                    const double* child1 = (states1 != NULL ? transposed1 + states1[k + p] * stride : sum1 + p * stride);
+                    const __m512d oneOverScaleFactor = _mm512_set1_pd(scaleFactors != NULL ? 1.0 / scaleFactors[k + p] : 1.0);
+                    avx512StoreProduct(destP + v, child1, sum2 + p * stride, oneOverScaleFactor,
+                                       lastBlock, lastBlockMask);
+                    v += kPartialsPaddedStateCount;
+                }
+            }
+        }
+
+        for (; k < endPattern; k++) {
+            const double* child1;
+            if (states1 != NULL) {
+                child1 = transposed1 + states1[k] * stride;
+            } else {
+                avx512MatrixTimesPartials(sum1, transposed1, partials1 + v, kStateCount, stride);
+                child1 = sum1;
+            }
+            avx512MatrixTimesPartials(sum2, transposed2, partials2 + v, kStateCount, stride);
+
+            const __m512d oneOverScaleFactor = _mm512_set1_pd(scaleFactors != NULL ? 1.0 / scaleFactors[k] : 1.0);
+            avx512StoreProduct(destP + v, child1, sum2, oneOverScaleFactor, lastBlock, lastBlockMask);
+            v += kPartialsPaddedStateCount;
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has states and one has partials.
+ */
+BEAGLE_CPU_AVX512_TEMPLATE
+void BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::calcStatesPartials(double* destP,
+                                                                       const TipState* states1,
+                                                                       const double* matrices1,
+                                                                       const double* partials2,
+                                                                       const double* matrices2,
+                                                                       int startPattern,
+                                                                       int endPattern) {
+    calcProductByPatternRange(destP, states1, NULL, matrices1, partials2, matrices2, NULL,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_AVX512_TEMPLATE
+void BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
+                                                                                   const TipState* states1,
+                                                                                   const double* matrices1,
+                                                                                   const double* partials2,
+                                                                                   const double* matrices2,
+                                                                                   const double* scaleFactors,
+                                                                                   int startPattern,
+                                                                                   int endPattern) {
+    calcProductByPatternRange(destP, states1, NULL, matrices1, partials2, matrices2, scaleFactors,
+                              startPattern, endPattern);
+}
+
+/*
+ * Calculates partial likelihoods at a node when both children have partials.
+ */
+BEAGLE_CPU_AVX512_TEMPLATE
+void BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::calcPartialsPartials(double* __restrict destP,
+                                                                         const double* __restrict partials1,
+                                                                         const double* __restrict matrices1,
+                                                                         const double* __restrict partials2,
+                                                                         const double* __restrict matrices2,
+                                                                         int startPattern,
+                                                                         int endPattern) {
+    calcProductByPatternRange(destP, NULL, partials1, matrices1, partials2, matrices2, NULL,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_AVX512_TEMPLATE
+void BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                                                     const double* __restrict partials1,
+                                                                                     const double* __restrict matrices1,
+                                                                                     const double* __restrict partials2,
+                                                                                     const double* __restrict matrices2,
+                                                                                     const double* __restrict scaleFactors,
+                                                                                     int startPattern,
+                                                                                     int endPattern) {
+    calcProductByPatternRange(destP, NULL, partials1, matrices1, partials2, matrices2, scaleFactors,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_AVX512_TEMPLATE
+int BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::getPaddedPatternsModulus() {
+	return 1;  // We vectorize across states, not patterns
+}
+
+BEAGLE_CPU_AVX512_TEMPLATE
+const char* BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::getName() {
+	return getBeagleCPUAVX512Name<double>();
+}
+
+BEAGLE_CPU_AVX512_TEMPLATE
+const long long BeagleCPUAVX512Impl<BEAGLE_CPU_AVX512_DOUBLE>::getFlags() {
+	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
+            BEAGLE_FLAG_PROCESSOR_CPU |
+            BEAGLE_FLAG_PRECISION_DOUBLE |
+            BEAGLE_FLAG_VECTOR_AVX512 |
+            BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeagleImplFactory public methods
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+BeagleImpl* BeagleCPUAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             int resourceNumber,
+                                             int pluginResourceNumber,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
+                                             int* errorCode) {
+
+    if (stateCount > BEAGLE_CPU_AVX512_MAX_STATE_COUNT)
+        return NULL;
+
+    if (!CPUSupportsAVX512())
+        return NULL;
+
+    BeagleCPUAVX512Impl<REALTYPE, T_PAD_AVX512_DEFAULT, P_PAD_AVX512_DEFAULT>* impl =
+            new BeagleCPUAVX512Impl<REALTYPE, T_PAD_AVX512_DEFAULT, P_PAD_AVX512_DEFAULT>();
+
+    try {
+        if (impl->createInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                 patternCount, eigenBufferCount, matrixBufferCount,
+                                 categoryCount,scaleBufferCount, resourceNumber,
+                                 pluginResourceNumber,
+                                 preferenceFlags, requirementFlags) == 0)
+            return impl;
+    }
+    catch(...) {
+        if (DEBUGGING_OUTPUT)
+            std::cerr << "exception in initialize\n";
+        delete impl;
+        throw;
+    }
+
+    delete impl;
+
+    return NULL;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                               int partialsBufferCount,
+                                                                               int compactBufferCount,
+                                                                               int stateCount,
+                                                                               int patternCount,
+                                                                               int eigenBufferCount,
+                                                                               int matrixBufferCount,
+                                                                               int categoryCount,
+                                                                               int scaleBufferCount,
+                                                                               int resourceNumber,
+                                                                               int pluginResourceNumber,
+                                                                               long long preferenceFlags,
+                                                                               long long requirementFlags,
+                                                                               size_t* outBytes) {
+    if (stateCount > BEAGLE_CPU_AVX512_MAX_STATE_COUNT)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsAVX512())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPUAVX512Impl<REALTYPE, T_PAD_AVX512_DEFAULT, P_PAD_AVX512_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+const char* BeagleCPUAVX512ImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
+	return getBeagleCPUAVX512Name<BEAGLE_CPU_FACTORY_GENERIC>();
+}
+
+template <>
+const long long BeagleCPUAVX512ImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
+           BEAGLE_FLAG_PROCESSOR_CPU |
+           BEAGLE_FLAG_VECTOR_AVX512 |
+           BEAGLE_FLAG_PRECISION_DOUBLE |
+           BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
+           BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
+           BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+}
+}
+
+#endif //BEAGLE_CPU_AVX512_IMPL_HPP
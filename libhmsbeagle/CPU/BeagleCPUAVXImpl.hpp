@@ -61,9 +61,9 @@ inline const char* getBeagleCPUAVXName<float>(){ return "CPU-AVX-Single"; };
 
 BEAGLE_CPU_AVX_TEMPLATE
 void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(double* destP,
-                                     const int* states_q,
+                                     const TipState* states_q,
                                      const double* matrices_q,
-                                     const int* states_r,
+                                     const TipState* states_r,
                                      const double* matrices_r) {
 
 	BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(destP,
@@ -76,9 +76,9 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(double* destP,
 
 //template <>
 //void BeagleCPUAVXImpl<double>::calcStatesStates(double* destP,
-//                                     const int* states_q,
+//                                     const TipState* states_q,
 //                                     const double* matrices_q,
-//                                     const int* states_r,
+//                                     const TipState* states_r,
 //                                     const double* matrices_r) {
 //
 //	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
@@ -112,7 +112,7 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(double* destP,
  */
 BEAGLE_CPU_AVX_TEMPLATE
 void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesPartials(double* destP,
-                                       const int* states_q,
+                                       const TipState* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
                                        const double* matrices_r) {
@@ -128,7 +128,7 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesPartials(double* destP,
 //
 //template <>
 //void BeagleCPUAVXImpl<double>::calcStatesPartials(double* destP,
-//                                       const int* states_q,
+//                                       const TipState* states_q,
 //                                       const double* matrices_q,
 //                                       const double* partials_r,
 //                                       const double* matrices_r) {
@@ -233,7 +233,7 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcPartialsPartials(double* __res
     };
 
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
     	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount;
     	int v = l*kPartialsPaddedStateCount*kPatternCount;
@@ -418,7 +418,7 @@ return BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>::calcEdgeLogLikelihoods(
 //
 //    if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 //
-//        const int* statesChild = gTipStates[childIndex];
+//        const TipState* statesChild = gTipStates[childIndex];
 //
 //		int w = 0;
 //		V_Real *vcl_r = (V_Real *)cl_r;
@@ -534,7 +534,7 @@ const char* BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::getName() {
 }
     
 BEAGLE_CPU_AVX_TEMPLATE
-const long BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>::getFlags() {
+const long long BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>::getFlags() {
 	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_THREADING_NONE |
             BEAGLE_FLAG_PROCESSOR_CPU |
@@ -543,7 +543,7 @@ const long BeagleCPUAVXImpl<BEAGLE_CPU_AVX_FLOAT>::getFlags() {
 }
 
 BEAGLE_CPU_AVX_TEMPLATE
-const long BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::getFlags() {
+const long long BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::getFlags() {
     return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_THREADING_NONE |
             BEAGLE_FLAG_PROCESSOR_CPU |
@@ -567,8 +567,8 @@ BeagleImpl* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,                                             
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     if (!CPUSupportsAVX())
@@ -617,16 +617,50 @@ BeagleImpl* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                            int partialsBufferCount,
+                                                                            int compactBufferCount,
+                                                                            int stateCount,
+                                                                            int patternCount,
+                                                                            int eigenBufferCount,
+                                                                            int matrixBufferCount,
+                                                                            int categoryCount,
+                                                                            int scaleBufferCount,
+                                                                            int resourceNumber,
+                                                                            int pluginResourceNumber,
+                                                                            long long preferenceFlags,
+                                                                            long long requirementFlags,
+                                                                            size_t* outBytes) {
+    if (!CPUSupportsAVX())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (stateCount & 1) // is odd
+        *outBytes = BeagleCPUAVXImpl<REALTYPE, T_PAD_AVX_ODD, P_PAD_AVX_ODD>::getMemoryFootprint(
+                tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+                eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+                preferenceFlags, requirementFlags);
+    else
+        *outBytes = BeagleCPUAVXImpl<REALTYPE, T_PAD_AVX_EVEN, P_PAD_AVX_EVEN>::getMemoryFootprint(
+                tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+                eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+                preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPUAVXName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 template <>
-const long BeagleCPUAVXImplFactory<double>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPUAVXImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
            BEAGLE_FLAG_THREADING_NONE |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
            BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -637,10 +671,12 @@ const long BeagleCPUAVXImplFactory<double>::getFlags() {
 }
 
 template <>
-const long BeagleCPUAVXImplFactory<float>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPUAVXImplFactory<float>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
            BEAGLE_FLAG_THREADING_NONE |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
            BEAGLE_FLAG_PRECISION_SINGLE |
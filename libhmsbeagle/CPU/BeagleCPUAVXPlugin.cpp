@@ -26,9 +26,11 @@ Plugin("CPU-AVX", "CPU-AVX")
 	BeagleResource resource;
         resource.name = (char*) "CPU";
         resource.description = (char*) "";
-        resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH |
+        resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
                                          BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
                                          BEAGLE_FLAG_THREADING_NONE |
+                                         BEAGLE_CPU_ARENA_FLAGS |
+                                         BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
                                          BEAGLE_FLAG_PROCESSOR_CPU |
                                          BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE |
                                          BEAGLE_FLAG_VECTOR_NONE |
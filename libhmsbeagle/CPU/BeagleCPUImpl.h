@@ -35,6 +35,7 @@
 #include "libhmsbeagle/BeagleImpl.h"
 #include "libhmsbeagle/CPU/Precision.h"
 #include "libhmsbeagle/CPU/EigenDecomposition.h"
+#include "libhmsbeagle/CPU/BeagleCPUThreadPool.h"
 
 #include <vector>
 #include <thread>
@@ -43,6 +44,9 @@
 #include <condition_variable>
 #include <mutex>
 #include <functional>
+#include <atomic>
+#include <list>
+#include <map>
 
 #define BEAGLE_CPU_GENERIC	REALTYPE, T_PAD, P_PAD
 #define BEAGLE_CPU_TEMPLATE	template <typename REALTYPE, int T_PAD, int P_PAD>
@@ -55,10 +59,33 @@
 #define P_PAD_DEFAULT   0   // No partials padding necessary for non-SSE implementations
 
 #define BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT 256 // do not use CPU auto-threading for problems with fewer patterns
+#define BEAGLE_CPU_ASYNC_DISPATCH_RATIO 16 // a thread's share of a call must cost this many thread dispatches
+#define BEAGLE_CPU_ASYNC_MIN_PARTITION_PATTERN_COUNT 32 // never auto-partition into fewer patterns than this
+#define BEAGLE_CPU_ASYNC_MIN_MATRIX_WORK 65536 // multiply-adds a thread's share of a transition matrix update must hold
+
+#define BEAGLE_CPU_L2_CACHE_SIZE 262144 // assumed L2 cache size where the host does not report one
+#define BEAGLE_CPU_BLOCK_BUFFER_COUNT 4 // partials buffers whose share of one block of patterns should fit in L2
+#define BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT 16 // never run operations over smaller blocks of patterns
+#define BEAGLE_CPU_PAIRWISE_SUM_PATTERN_COUNT 128 // patterns summed directly before pairwise summation splits
+
+#define BEAGLE_CPU_ARENA_ALIGNMENT 64 // alignment of each buffer carved from an instance arena
+
+#ifdef BEAGLE_CPU_ARENA
+#define BEAGLE_CPU_ARENA_FLAGS BEAGLE_FLAG_MEMORY_ARENA // offered where the slab can be mapped
+#else
+#define BEAGLE_CPU_ARENA_FLAGS 0
+#endif
+#define BEAGLE_CPU_HUGE_PAGE_SIZE 2097152 // arenas at least this large are rounded to and backed by huge pages
+#define BEAGLE_CPU_BACKED_WINDOW_OP_COUNT 32 // operations run between paging hints for a file-backed arena
 
 namespace beagle {
 namespace cpu {
 
+// Compact tips hold one byte per pattern; larger state spaces are stored as tip partials
+typedef unsigned char TipState;
+#define BEAGLE_CPU_TIP_STATE_MAX 255 // largest state code a TipState holds, the missing state included
+#define BEAGLE_CPU_STATE_SET_MAX_STATE_COUNT 8 // state-set tips of larger state spaces are stored as tip partials
+
 BEAGLE_CPU_TEMPLATE
 class BeagleCPUImpl : public BeagleImpl {
 
@@ -80,15 +107,18 @@ protected:
 
     int kPartialsSize;  /// stored for convenience. kPartialsSize = kStateCount*kPatternCount
     int kMatrixSize; /// stored for convenience. kMatrixSize = kStateCount*(kStateCount + 1)
+    int kStateSetCount; /// 2^kStateCount when tips can be stored as state sets, otherwise 0
     
     int kInternalPartialsBufferCount; 
 
+    int kPatternBlockSize; // patterns per block when operations are run block by block
+    int kOpenMPThreadCount; // OpenMP threads splitting the patterns of each operation list
     int kPartitionCount;
     int kMaxPartitionCount;
     bool kPartitionsInitialised;
     bool kPatternsReordered;
 
-    long kFlags;
+    long long kFlags;
     
     REALTYPE realtypeMin;
     int scalingExponentThreshhold;
@@ -109,7 +139,14 @@ protected:
     //      tipStates field should be switched to vectors of vectors (to make
     //      memory management less error prone
     REALTYPE** gPartials;
-    int** gTipStates;
+    TipState** gTipStates;
+    TipState** gTipStateSets; // bitmask of the possible states at each pattern of a tip
+
+    // per pattern, the previous pattern at which every tip shows the same single state, or -1;
+    // empty unless every tip is held as states and no internal partials were set by the client
+    std::vector<int> gConstantPatternSources;
+    bool kConstantPatternsStale; // the tips changed since gConstantPatternSources was built
+    bool kPartialsFromClient; // an internal partials buffer was set rather than computed
     REALTYPE** gScaleBuffers;
     
     signed short** gAutoScaleBuffers;
@@ -121,6 +158,142 @@ protected:
     //  into a single array
     REALTYPE** gTransitionMatrices;
 
+    // Single slab holding the internal partials, transition matrices and scale buffers
+    // of a MEMORY_ARENA instance; NULL otherwise
+    char* gArena;
+    size_t kArenaSize;
+    size_t kArenaUsed;
+
+    // Unlinked file the arena is mapped from once setPartialsBackingDirectory names a
+    // directory for it, so buffers that do not fit in memory are paged to that disk; -1 otherwise
+    int kArenaFile;
+
+    // Inputs a transition matrix was computed from; versions change with each
+    // setEigenDecomposition and setCategoryRates call for the index
+    struct MatrixCacheKey {
+        int eigenIndex;
+        int eigenVersion;
+        int categoryRatesIndex;
+        int categoryRatesVersion;
+        double edgeLength;
+
+        bool operator<(const MatrixCacheKey& other) const {
+            if (eigenIndex != other.eigenIndex)
+                return eigenIndex < other.eigenIndex;
+            if (eigenVersion != other.eigenVersion)
+                return eigenVersion < other.eigenVersion;
+            if (categoryRatesIndex != other.categoryRatesIndex)
+                return categoryRatesIndex < other.categoryRatesIndex;
+            if (categoryRatesVersion != other.categoryRatesVersion)
+                return categoryRatesVersion < other.categoryRatesVersion;
+            return edgeLength < other.edgeLength;
+        }
+    };
+    typedef std::list<std::pair<MatrixCacheKey, REALTYPE*> > MatrixCacheList;
+
+    int kMatrixCacheSize; // 0 when the transition matrix cache is off
+    std::vector<int> gEigenVersions;
+    std::vector<int> gCategoryRatesVersions;
+    std::vector<MatrixCacheKey> gMatrixKeys; // per matrix buffer, what it holds if gMatrixKeyValid
+    std::vector<bool> gMatrixKeyValid;
+    MatrixCacheList gMatrixCache; // most recently used first
+    std::map<MatrixCacheKey, typename MatrixCacheList::iterator> gMatrixCacheIndex;
+    std::vector<int> gMatrixCacheMissIndices; // matrices a call still has to compute
+    std::vector<double> gMatrixCacheMissLengths;
+
+    // A run of edges sharing an eigen decomposition and category rates, computed by one call
+    struct MatrixUpdateRun {
+        int eigenIndex;
+        int categoryRatesIndex;
+        int offset; // into the edge arrays the runs were built for
+        int count;
+    };
+    std::vector<MatrixUpdateRun> gMatrixUpdateRuns;
+    std::vector<int> gMatrixUpdateOrder; // edges of a multiple model update grouped by model
+    std::vector<int> gMatrixUpdateIndices; // the edges' matrix indices in that order, three rows
+    std::vector<double> gMatrixUpdateLengths;
+
+    // The buffers and versions a partials buffer was last computed from by updatePartials
+    struct PartialsSource {
+        bool valid;
+        int child1Index;
+        int matrix1Index;
+        int child2Index;
+        int matrix2Index;
+        int readScaleIndex; // BEAGLE_OP_NONE if no scale factors were read or written
+        int writeScaleIndex;
+        unsigned long long child1Version;
+        unsigned long long matrix1Version;
+        unsigned long long child2Version;
+        unsigned long long matrix2Version;
+        unsigned long long readScaleVersion;
+        unsigned long long writeScaleVersion;
+    };
+
+    bool kIncrementalEnabled; // updatePartials skips operations whose destination is current
+
+    bool kExponentScaling; // rescalePartials scales by powers of two
+
+    bool kAdaptiveRescaling; // rescalePartials leaves patterns far from underflow as they are
+
+    // The classes of the patterns of a buffer, equal for patterns whose subtree shows the same
+    // states at every tip, and the children and versions they were built from
+    struct SiteRepeats {
+        bool valid;
+        int classCount;
+        std::vector<int> classes;
+        unsigned long long version; // bumped every time the classes are built
+        int child1Index;
+        int child2Index;
+        unsigned long long child1Version;
+        unsigned long long child2Version;
+    };
+    bool kSiteRepeatsEnabled; // upPartials computes each class of a destination once
+    std::vector<SiteRepeats> gSiteRepeats; // per buffer, while site repeats are on
+    std::vector<int> gSiteRepeatWriters; // per buffer, the operation of a list writing it
+    std::vector<int> gSiteRepeatWriteCounts; // per buffer, how many operations of a list write it
+    std::vector<int> gSiteRepeatStarts; // scratch of buildSiteRepeats
+    std::vector<int> gSiteRepeatOrder;
+    std::vector<int> gSiteRepeatPairs;
+
+    // counts of one rescaling pass, added to gScalingStatistics when the pass ends
+    struct ScalingTally {
+        long long patternCount;
+        long long rescaledPatternCount;
+        long long nearUnderflowPatternCount;
+        int minExponent;
+        int maxExponent;
+        double exponentSum;
+
+        ScalingTally() : patternCount(0), rescaledPatternCount(0), nearUnderflowPatternCount(0),
+                         minExponent(0), maxExponent(0), exponentSum(0.0) {}
+    };
+
+    BeagleScalingStatistics gScalingStatistics;
+    std::mutex gScalingStatisticsMutex; // passes over pattern ranges end on several threads
+    std::vector<unsigned long long> gPartialsVersions; // bumped on every write while enabled
+    std::vector<unsigned long long> gMatrixVersions;
+    std::vector<unsigned long long> gScaleBufferVersions;
+    std::vector<PartialsSource> gPartialsSources;
+    std::vector<int> gIncrementalOperations; // the operations of a call that are not skipped
+
+    // What a buffer array held at the last saveState, for the buffers written since
+    struct BufferCheckpoint {
+        std::vector<void*> saved; // per buffer, its storage at the checkpoint if written since
+        std::vector<bool> written;
+        std::vector<int> writtenIndices;
+        std::vector<void*> spares; // storage of the array's buffer size, free for reuse
+    };
+
+    bool kCheckpointActive; // first writes to partials and scale buffers go to fresh storage
+    BufferCheckpoint gPartialsCheckpoint;
+    BufferCheckpoint gScaleBuffersCheckpoint; // of gAutoScaleBuffers under BEAGLE_FLAG_SCALING_AUTO
+    std::vector<int> gActiveScalingFactorsCheckpoint;
+
+    std::vector<double> gLogLikelihoodResults; // slots of calculateRootLogLikelihoodsAsync
+    std::vector<bool> gLogLikelihoodResultsValid; // false where the sum was NaN
+    std::vector<bool> gLogLikelihoodResultsWritten; // slots holding a sum that can be fetched
+
     REALTYPE* integrationTmp;
     REALTYPE* firstDerivTmp;
     REALTYPE* secondDerivTmp;
@@ -132,28 +305,51 @@ protected:
     REALTYPE* ones;
     REALTYPE* zeros;
 
-    struct threadData
-    {
-        std::thread t; // The thread object
-        std::queue<std::packaged_task<void()>> jobs; // The job queue
-        std::condition_variable cv; // The condition variable to wait for threads
-        std::mutex m; // Mutex used for avoiding data races
-        bool stop = false; // When set, this flag tells the thread that it should exit
-    };
-
-    int kNumThreads;
-    bool kThreadingEnabled;
+    int kMaxThreadCount; // threads an instance may use, the calling thread included
+    int kNumThreads; // concurrent workers per call, the calling thread plus kNumThreads-1 jobs on the pool
+    BeagleCPUThreadPool* gNodePool; // workers bound to NUMA nodes, owned by a THREADING_NUMA instance
+    bool kThreadingEnabled; // partitions are large enough to be updated asynchronously
+    bool kTraversalThreadingEnabled; // independent operations may be updated concurrently
     bool kAutoPartitioningEnabled;
     bool kAutoRootPartitioningEnabled;
-
-    threadData* gThreads;
-    int** gThreadOperations;
-    int* gThreadOpCounts;
+    bool kPartialsPlaced; // pages are placed on NUMA nodes once and never moved
+
+    int* gPartitionOperations; // operations grouped by partition, gPartitionOpOffsets[p] into this list
+    int* gPartitionOpCounts;
+    int* gPartitionOpOffsets;
+    long* gThreadWorkCosts; // estimated cost of each work item, larger items are claimed first
+    int* gThreadWorkOrder;
+    int* gThreadWorkPartitions; // pattern partition of each work item, for NUMA placement
+    std::atomic<int>* gThreadWorkClaims;
+    std::atomic<int> gThreadWorkIndex; // next unclaimed position in gThreadWorkOrder
+    int kThreadWorkCapacity;
+    std::vector<int> gDependencyWriteLevels; // per buffer, level of the last operation writing it
+    std::vector<int> gDependencyReadLevels; // per buffer, highest level reading it since the last write
+    std::vector<int> gOperationLevels;
+    std::vector<int> gLevelOffsets;
+    std::vector<int> gLevelOperations; // operation indices sorted by level
     int* gAutoPartitionOperations;
     int* gAutoPartitionIndices;
     double* gAutoPartitionOutSumLogLikelihoods;
     std::shared_future<void>* gFutures;
 
+    // An updatePartials call queued under BEAGLE_FLAG_COMPUTATION_ASYNCH
+    struct AsynchUpdate {
+        std::vector<int> operations;
+        int cumulativeScaleIndex;
+    };
+
+    bool kAsynchEnabled; // updatePartials queues its operations for gAsynchThread and returns
+    std::thread gAsynchThread; // runs the queued updates in order, started by the first one
+    std::mutex gAsynchMutex;
+    std::condition_variable gAsynchCondition;
+    std::queue<AsynchUpdate> gAsynchQueue;
+    bool kAsynchStopping;
+    unsigned long long kAsynchQueuedCount; // updates queued since creation
+    unsigned long long kAsynchFinishedCount;
+    std::vector<unsigned long long> gAsynchWriteTickets; // per buffer, the queued update last writing it
+    int kAsynchReturnCode; // first error of a queued update, returned by the next waitForPartials
+
 public:
     virtual ~BeagleCPUImpl();
 
@@ -169,8 +365,21 @@ public:
                        int scaleBufferCount,
                        int resourceNumber,
                        int pluginResourceNumber,
-                       long preferenceFlags,
-                       long requirementFlags);
+                       long long preferenceFlags,
+                       long long requirementFlags);
+
+    // bytes an instance created with these arguments holds once all of its buffers are written
+    static size_t getMemoryFootprint(int tipCount,
+                                     int partialsBufferCount,
+                                     int compactBufferCount,
+                                     int stateCount,
+                                     int patternCount,
+                                     int eigenDecompositionCount,
+                                     int matrixCount,
+                                     int categoryCount,
+                                     int scaleBufferCount,
+                                     long long preferenceFlags,
+                                     long long requirementFlags);
 
     // initialization of instance,  returnInfo can be null
     int getInstanceDetails(BeagleInstanceDetails* returnInfo);
@@ -189,6 +398,22 @@ public:
     int setTipPartials(int tipIndex,
                        const double* inPartials);
 
+    // set the possible states for a given tip
+    //
+    // tipIndex the index of the tip
+    // inStateSets the array of state bitmasks, bit s for state s, 0 = missing
+    int setTipStateSets(int tipIndex,
+                        const int* inStateSets);
+
+    // set the states or partials of several tips, laid out one tip after another
+    int setTipStatesBatch(const int* tipIndices,
+                          const int* inStates,
+                          int count);
+
+    int setTipPartialsBatch(const int* tipIndices,
+                            const double* inPartials,
+                            int count);
+
 
     int setPartials(int bufferIndex,
                     const double* inPartials);
@@ -197,6 +422,30 @@ public:
 					int scaleBuffer,
                     double* outPartials);
 
+    // releases the memory of a partials buffer; it is allocated again when next written
+    int releasePartials(int bufferIndex);
+
+    // partials and matrices already in REALTYPE and the padded layout, copied whole
+    int getBufferLayout(BeagleBufferLayout* outLayout);
+
+    int setTipPartialsNative(int tipIndex,
+                             const void* inPartials);
+
+    int setPartialsNative(int bufferIndex,
+                          const void* inPartials);
+
+    int getPartialsView(int bufferIndex,
+                        const void** outPartials);
+
+    int setTransitionMatrixNative(int matrixIndex,
+                                  const void* inMatrix);
+
+    // checkpoints the partials and scale buffers; buffers written afterwards get fresh storage
+    int saveState();
+
+    // points the buffers written since saveState back at their checkpointed storage
+    int restoreState();
+
     // sets the Eigen decomposition for a given matrix
     //
     // matrixIndex the matrix index to update
@@ -218,6 +467,24 @@ public:
 
     int setPatternPartitions(int partitionCount,
                              const int* inPatternPartitions);
+
+    int setCPUThreadCount(int threadCount);
+
+    int setTransitionMatrixCacheSize(int cacheSize);
+
+    int setIncrementalUpdates(int enabled);
+
+    int setExponentScaling(int enabled);
+
+    int setAdaptiveRescaling(int enabled);
+
+    int setSiteRepeats(int enabled);
+
+    int setPartialsBackingDirectory(const char* directory);
+
+    int getScalingStatistics(BeagleScalingStatistics* outStatistics);
+
+    int resetScalingStatistics();
     
     // set the vector of category rates
     //
@@ -282,6 +549,13 @@ public:
     int updatePartialsByPartition(const int* operations,
                                   int operationCount);
 
+    int setRootPrePartials(const int* bufferIndices,
+                           const int* stateFrequenciesIndices,
+                           int count);
+
+    int updatePrePartials(const int* operations,
+                          int operationCount);
+
     // Block until all calculations that write to the specified partials have completed.
     //
     // This function is optional and only has to be called by clients that "recycle" partials.
@@ -338,6 +612,18 @@ public:
                                     int count,
                                     double* outSumLogLikelihood);
 
+    // the sum is computed immediately and held until getLogLikelihoodResults
+    int calculateRootLogLikelihoodsAsync(const int* bufferIndices,
+                                         const int* categoryWeightsIndices,
+                                         const int* stateFrequenciesIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         int resultIndex);
+
+    int getLogLikelihoodResults(const int* resultIndices,
+                                int count,
+                                double* outSumLogLikelihoods);
+
     int calculateRootLogLikelihoodsByPartition(const int* bufferIndices,
                                                const int* categoryWeightsIndices,
                                                const int* stateFrequenciesIndices,
@@ -380,23 +666,114 @@ public:
                                                double* outSumFirstDerivative,
                                                double* outSumSecondDerivativeByPartition,
                                                double* outSumSecondDerivative);
+
+    int calculateMultiEdgeLogLikelihoods(const int* parentBufferIndices,
+                                         const int* childBufferIndices,
+                                         const int* probabilityIndices,
+                                         const int* firstDerivativeIndices,
+                                         const int* secondDerivativeIndices,
+                                         const int* categoryWeightsIndices,
+                                         const int* stateFrequenciesIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         double* outLogLikelihoods,
+                                         double* outFirstDerivatives,
+                                         double* outSecondDerivatives);
     
     int getSiteLogLikelihoods(double* outLogLikelihoods);
+
+    int getSiteLogLikelihoodsView(const void** outLogLikelihoods);
     
     int getSiteDerivatives(double* outFirstDerivatives,
                            double* outSecondDerivatives);
 
+    int calculateEdgeDerivatives(const int* postBufferIndices,
+                                 const int* preBufferIndices,
+                                 const int* probabilityIndices,
+                                 const int* derivativeMatrixIndices,
+                                 const int* categoryWeightsIndices,
+                                 int count,
+                                 double* outDerivatives,
+                                 double* outSumDerivatives);
+
     int block(void);
 
 	virtual const char* getName();
 
-	virtual const long getFlags();
+	virtual const long long getFlags();
 
 protected:
+    // updatePartials once allocateDestinationPartials has checked the operations
+    int upPartialsAllocated(const int* operations,
+                            int count,
+                            int cumulativeScaleIndex);
+
+    // runs the operations through whichever of the paths below applies
+    int upPartialsDispatched(const int* operations,
+                             int count,
+                             int cumulativeScaleIndex);
+
+    // runs the operations in windows over a file-backed arena, reading the buffers of
+    // each window ahead and writing back those the next window does not use
+    int upPartialsBackedWindows(const int* operations,
+                                int count,
+                                int cumulativeScaleIndex);
+
+    // builds gConstantPatternSources again if the tips have changed since
+    void updateConstantPatterns();
+
+    // builds the site repeats of the destinations of an operation list before it runs
+    void updateSiteRepeats(const int* operations,
+                           int count,
+                           int numOps);
+
+    void buildTipSiteRepeats(int tipIndex);
+
+    // complete is whether the operations write every pattern of the destination; the classes
+    // are only built again from new children when they do
+    void buildSiteRepeats(int destIndex,
+                          int child1Index,
+                          int child2Index,
+                          bool complete);
+
+    // points each pattern of [startPattern, endPattern) at the first of its class in the range,
+    // or -1 for that first one; returns false if the destination has no site repeats
+    bool findSiteRepeatSources(std::vector<int>& sources,
+                               std::vector<int>& firstOfClass,
+                               int destIndex,
+                               int startPattern,
+                               int endPattern);
+
+    // the runs of [startPattern, endPattern) to compute, as start and end pairs, leaving out
+    // the patterns whose source is an earlier pattern of the range; returns how many are left out
+    int findComputedPatternRuns(std::vector<int>& runs,
+                                const int* sources,
+                                int startPattern,
+                                int endPattern);
+
+    void copyRepeatedPatterns(REALTYPE* destP,
+                              const int* sources,
+                              int startPattern,
+                              int endPattern);
+
     virtual int upPartials(bool byPartition,
                            const int* operations,
                            int operationCount,
-                           int cumulativeScalingIndex);
+                           int cumulativeScalingIndex,
+                           int startPattern,
+                           int endPattern);
+
+    virtual int upPartialsByPatternBlock(const int* operations,
+                                         int operationCount,
+                                         int cumulativeScalingIndex);
+
+    void upPartialsOverPatternBlocks(const int* operations,
+                                     int operationCount,
+                                     int cumulativeScalingIndex,
+                                     int rangeStartPattern,
+                                     int rangeEndPattern);
+
+    int getOpenMPThreadCount(int threadCount);
 
     virtual void autoPartitionPartialsOperations(const int* operations,
                                                  int* partitionOperations,
@@ -406,19 +783,23 @@ protected:
     virtual int upPartialsByPartitionAsync(const int* operations,
                                            int operationCount);
 
+    virtual int upPartialsByDependencyAsync(const int* operations,
+                                            int operationCount,
+                                            int cumulativeScaleIndex);
+
     virtual int reorderPatternsByPartition();
 
     virtual void calcStatesStates(REALTYPE* destP,
-                                  const int* states1,
+                                  const TipState* states1,
                                   const REALTYPE* matrices1,
-                                  const int* states2,
+                                  const TipState* states2,
                                   const REALTYPE* matrices2,
                                   int startPattern,
                                   int endPattern);
 
 
     virtual void calcStatesPartials(REALTYPE* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const REALTYPE* matrices1,
                                     const REALTYPE* partials2,
                                     const REALTYPE* matrices2,
@@ -433,6 +814,28 @@ protected:
                                       int startPattern,
                                       int endPattern);
 
+    void calcStateSetMatrices(REALTYPE* stateSetMatrices,
+                              const REALTYPE* matrices);
+
+    void calcStateSetsStates(REALTYPE* destP,
+                             const TipState* stateSets1,
+                             const REALTYPE* stateSetMatrices1,
+                             const TipState* states2,
+                             const REALTYPE* matrices2,
+                             int rowSize2,
+                             const REALTYPE* scaleFactors,
+                             int startPattern,
+                             int endPattern);
+
+    void calcStateSetsPartials(REALTYPE* destP,
+                               const TipState* stateSets1,
+                               const REALTYPE* stateSetMatrices1,
+                               const REALTYPE* partials2,
+                               const REALTYPE* matrices2,
+                               const REALTYPE* scaleFactors,
+                               int startPattern,
+                               int endPattern);
+
     virtual int calcRootLogLikelihoods(const int bufferIndex,
                                         const int categoryWeightsIndex,
                                         const int stateFrequenciesIndex,
@@ -552,17 +955,31 @@ protected:
                                                    double* outSumFirstDerivative,
                                                    double* outSumSecondDerivative);
 
+    // one edge of calculateMultiEdgeLogLikelihoods; keeps nothing in the instance's scratch
+    // buffers, so several edges can run at once. Derivative indices may be BEAGLE_OP_NONE
+    int calcEdgeLogLikelihoodsOfEdge(const int parentBufferIndex,
+                                     const int childBufferIndex,
+                                     const int probabilityIndex,
+                                     const int firstDerivativeIndex,
+                                     const int secondDerivativeIndex,
+                                     const int categoryWeightsIndex,
+                                     const int stateFrequenciesIndex,
+                                     const int scalingFactorsIndex,
+                                     double* outLogLikelihood,
+                                     double* outFirstDerivative,
+                                     double* outSecondDerivative);
+
     virtual void calcStatesStatesFixedScaling(REALTYPE *destP,
-                                              const int *child0States,
+                                              const TipState *child0States,
                                               const REALTYPE *child0TransMat,
-                                              const int *child1States,
+                                              const TipState *child1States,
                                               const REALTYPE *child1TransMat,
                                               const REALTYPE *scaleFactors,
                                               int startPattern,
                                               int endPattern);
 
     virtual void calcStatesPartialsFixedScaling(REALTYPE *destP,
-                                                const int *child0States,
+                                                const TipState *child0States,
                                                 const REALTYPE *child0TransMat,
                                                 const REALTYPE *child1Partials,
                                                 const REALTYPE *child1TransMat,
@@ -586,25 +1003,170 @@ protected:
                                                   const REALTYPE* matrices2,
                                                   int* activateScaling);
 
+    // bodies of calcStatesPartials and calcPartialsPartials and their FixedScaling variants,
+    // instantiated for common state counts; a STATE_COUNT of 0 means kStateCount
+    template <int STATE_COUNT, bool SCALING>
+    void calcStatesPartialsForStateCount(REALTYPE* destP,
+                                         const TipState* states1,
+                                         const REALTYPE* matrices1,
+                                         const REALTYPE* partials2,
+                                         const REALTYPE* matrices2,
+                                         const REALTYPE* scaleFactors,
+                                         int startPattern,
+                                         int endPattern);
+
+    template <int STATE_COUNT, bool SCALING>
+    void calcPartialsPartialsForStateCount(REALTYPE* destP,
+                                           const REALTYPE* partials1,
+                                           const REALTYPE* matrices1,
+                                           const REALTYPE* partials2,
+                                           const REALTYPE* matrices2,
+                                           const REALTYPE* scaleFactors,
+                                           int startPattern,
+                                           int endPattern);
+
     virtual void rescalePartials(REALTYPE *destP,
     		                     REALTYPE *scaleFactors,
                                  REALTYPE *cumulativeScaleFactors,
                                  const int  fillWithOnes);
 
-    virtual void rescalePartialsByPartition(REALTYPE *destP,
-                                            REALTYPE *scaleFactors,
-                                            REALTYPE *cumulativeScaleFactors,
-                                            const int fillWithOnes,
-                                            const int partitionIndex);
+    virtual void rescalePartialsByPatternRange(REALTYPE *destP,
+                                               REALTYPE *scaleFactors,
+                                               REALTYPE *cumulativeScaleFactors,
+                                               const int fillWithOnes,
+                                               int startPattern,
+                                               int endPattern);
     
     virtual void autoRescalePartials(REALTYPE *destP,
     		                     signed short *scaleFactors);
 
+    // stores the scale factor of pattern k, given its largest partial, counts it in
+    // tally and returns the multiplier that rescales that pattern's partials
+    inline REALTYPE storeScaleFactor(REALTYPE max,
+                                     REALTYPE *scaleFactors,
+                                     REALTYPE *cumulativeScaleFactors,
+                                     int k,
+                                     ScalingTally& tally);
+
+    void addScalingTally(const ScalingTally& tally);
+
+    // log of a stored scale factor
+    inline REALTYPE logScaleFactor(REALTYPE scaleFactor);
+
+    // sum of siteValues[k] * gPatternWeights[k] over the patterns, summed pairwise
+    double sumOverPatterns(const REALTYPE* siteValues,
+                           int startPattern,
+                           int endPattern);
+
     virtual int getPaddedPatternsModulus();
 
     void* mallocAligned(size_t size);
 
-    void threadWaiting(threadData* tData);
+    void createArena(size_t size);
+
+    void* allocateBuffer(size_t size); // from the arena if there is one, else mallocAligned
+
+    void freeBuffer(void* ptr); // a no-op for buffers in the arena
+
+    // paging hints for a partials buffer of a file-backed arena; no-ops for other buffers
+    void prefetchBackedPartials(int bufferIndex);
+    void writeBackBackedPartials(int bufferIndex);
+
+    // allocates the destination buffers of operations that have not been written yet and
+    // checks that every child buffer holds partials or states
+    int allocateDestinationPartials(const int* operations, int count, int numOps);
+
+    // computes the matrices not already held by their buffer or in the transition matrix cache
+    void updateTransitionMatricesCached(int eigenIndex,
+                                        int categoryRatesIndex,
+                                        const int* probabilityIndices,
+                                        const double* edgeLengths,
+                                        int count);
+
+    // computes the runs in gMatrixUpdateRuns, split across the thread pool when it is worth it
+    void updateTransitionMatrixRuns(const int* probabilityIndices,
+                                    const int* firstDerivativeIndices,
+                                    const int* secondDerivativeIndices,
+                                    const double* edgeLengths);
+
+    // C = A * B for every rate category
+    template <int STATE_COUNT>
+    void convolveTransitionMatrixPair(const REALTYPE* A,
+                                      const REALTYPE* B,
+                                      REALTYPE* C);
+
+    void clearTransitionMatrixCache();
+
+    void invalidateTransitionMatrix(int matrixIndex); // its buffer was written outside the cache
+
+    void invalidatePartials(int bufferIndex); // written by something other than updatePartials
+
+    void invalidateScaleBuffer(int scaleIndex);
+
+    // hands a buffer's storage to the checkpoint, leaving replacement in its place
+    void checkpointBuffer(BufferCheckpoint& checkpoint, void** buffers, int index, void* replacement);
+
+    // on the first write to a buffer since saveState, moves it to fresh storage of the given
+    // size; keepContents copies the old contents over for writes that update only part of it
+    int preserveBuffer(BufferCheckpoint& checkpoint, void** buffers, int index, size_t size,
+                       bool keepContents);
+
+    int preservePartials(int bufferIndex, bool keepContents);
+
+    int preserveScaleBuffer(int scaleIndex); // a no-op under BEAGLE_FLAG_SCALING_AUTO
+
+    // preserves the partials and scale buffers a list of operations writes
+    int preserveDestinations(const int* operations, int count, int numOps, int cumulativeScaleIndex);
+
+    void retireCheckpoint(BufferCheckpoint& checkpoint); // checkpointed storage becomes spare
+
+    void freeCheckpoint(BufferCheckpoint& checkpoint);
+
+    // copies the operations whose destination is not current into gIncrementalOperations and
+    // records what their destinations are computed from; returns how many were copied
+    int removeCurrentOperations(const int* operations, int count, int cumulativeScaleIndex);
+
+    void startAutoPartitioning();
+
+    void stopAutoPartitioning();
+
+    void startPartitionThreading(int partitionCount);
+
+    void calibrateAutoPartitioning(int threadCount,
+                                   int* outPartitionCount,
+                                   bool* outRootPartitioning);
+
+    void startThreading(int threadCount,
+                        int partitionCount);
+
+    void stopThreading();
+
+    void dispatchThreadWork(int itemCount,
+                            bool partitionItems,
+                            const std::function<void(int)>& work);
+
+    void dispatchThreadWorkByOwner(int itemCount,
+                                   const std::function<void(int)>& work);
+
+    int queueAsynchUpdate(const int* operations,
+                          int count,
+                          int cumulativeScaleIndex);
+
+    void runAsynchUpdates();
+
+    void waitForAsynchUpdates(unsigned long long ticket);
+
+    // every call but updatePartials and waitForPartials first waits for the queued updates
+    void finishAsynchUpdates();
+
+    void stopAsynchUpdates();
+
+    // the instance's own pool under THREADING_NUMA, the shared one otherwise
+    BeagleCPUThreadPool& getThreadPool();
+
+    int getPartitionOwnerCount();
+
+    void placePartialsByPartition();
 
 };
 
@@ -622,12 +1184,27 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 //typedef BeagleCPUImplGeneral<double> BeagleCPUImpl;
@@ -80,8 +80,27 @@
 #include <cassert>
 #include <vector>
 #include <cfloat>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef BEAGLE_CPU_ARENA
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/BeagleTrace.h"
 #include "libhmsbeagle/CPU/Precision.h"
 #include "libhmsbeagle/CPU/BeagleCPUImpl.h"
 #include "libhmsbeagle/CPU/EigenDecompositionCube.h"
@@ -106,17 +125,17 @@ template<>
 inline const char* getBeagleCPUName<float>(){ return "CPU-Single"; };
 
 BEAGLE_CPU_FACTORY_TEMPLATE
-inline const long getBeagleCPUFlags(){ return BEAGLE_FLAG_COMPUTATION_SYNCH; };
+inline const long long getBeagleCPUFlags(){ return BEAGLE_FLAG_COMPUTATION_SYNCH; };
 
 template<>
-inline const long getBeagleCPUFlags<double>(){ return BEAGLE_FLAG_COMPUTATION_SYNCH |
+inline const long long getBeagleCPUFlags<double>(){ return BEAGLE_FLAG_COMPUTATION_SYNCH |
                                                       BEAGLE_FLAG_PROCESSOR_CPU |
                                                       BEAGLE_FLAG_PRECISION_DOUBLE |
                                                       BEAGLE_FLAG_VECTOR_NONE |
                                                       BEAGLE_FLAG_FRAMEWORK_CPU; };
 
 template<>
-inline const long getBeagleCPUFlags<float>(){ return BEAGLE_FLAG_COMPUTATION_SYNCH |
+inline const long long getBeagleCPUFlags<float>(){ return BEAGLE_FLAG_COMPUTATION_SYNCH |
                                                      BEAGLE_FLAG_PROCESSOR_CPU |
                                                      BEAGLE_FLAG_PRECISION_SINGLE |
                                                      BEAGLE_FLAG_VECTOR_NONE |
@@ -130,6 +149,9 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     // If you delete partials, make sure not to delete the last element
     // which is TEMP_SCRATCH_PARTIAL twice.
 
+    if (kAsynchEnabled)
+        stopAsynchUpdates();
+
     for(unsigned int i=0; i<kEigenDecompCount; i++) {
         if (gCategoryWeights[i] != NULL)
             free(gCategoryWeights[i]);
@@ -139,18 +161,24 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
 
     for(unsigned int i=0; i<kMatrixCount; i++) {
         if (gTransitionMatrices[i] != NULL)
-            free(gTransitionMatrices[i]);
+            freeBuffer(gTransitionMatrices[i]);
     }
     free(gTransitionMatrices);
 
+    freeCheckpoint(gPartialsCheckpoint);
+    freeCheckpoint(gScaleBuffersCheckpoint);
+
     for(unsigned int i=0; i<kBufferCount; i++) {
         if (gPartials[i] != NULL)
-            free(gPartials[i]);
+            freeBuffer(gPartials[i]);
         if (gTipStates[i] != NULL)
             free(gTipStates[i]);
+        if (gTipStateSets[i] != NULL)
+            free(gTipStateSets[i]);
     }
     free(gPartials);
     free(gTipStates);
+    free(gTipStateSets);
     
     if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
         for(unsigned int i=0; i<kScaleBufferCount; i++) {
@@ -165,7 +193,7 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     } else {
         for(unsigned int i=0; i<kScaleBufferCount; i++) {
             if (gScaleBuffers[i] != NULL)
-                free(gScaleBuffers[i]);
+                freeBuffer(gScaleBuffers[i]);
         }        
     }
     
@@ -196,38 +224,24 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
 
     delete gEigenDecomposition;
 
-    if (kThreadingEnabled) {
-        // Send stop signal to all threads and join them...
-        for (int i = 0; i < kNumThreads; i++) {
-            threadData* td = &gThreads[i];
-            std::unique_lock<std::mutex> l(td->m);
-            td->stop = true;
-            td->cv.notify_one();
-        }
-
-        // Join all the threads
-        for (int i = 0; i < kNumThreads; i++) {
-            threadData* td = &gThreads[i];
-            td->t.join();
-        }
-
-        delete[] gThreads;
-        delete[] gFutures;
+    clearTransitionMatrixCache();
 
-        for (int i=0; i<kNumThreads; i++) {
-            free(gThreadOperations[i]);
-        }
-        free(gThreadOperations);
-        free(gThreadOpCounts);
+    if (kTraversalThreadingEnabled) {
+        stopThreading();
     }
 
     if (kAutoPartitioningEnabled) {
-        free(gAutoPartitionOperations);
-        if (kAutoRootPartitioningEnabled) {
-            free(gAutoPartitionIndices);
-            free(gAutoPartitionOutSumLogLikelihoods);
-        }
+        stopAutoPartitioning();
     }
+
+    delete gNodePool;
+
+#ifdef BEAGLE_CPU_ARENA
+    if (gArena != NULL)
+        munmap(gArena, kArenaSize);
+    if (kArenaFile >= 0)
+        close(kArenaFile);
+#endif
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -242,8 +256,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
                                   int scaleBufferCount,
                                   int resourceNumber,
                                   int pluginResourceNumber,
-                                  long preferenceFlags,
-                                  long requirementFlags) {
+                                  long long preferenceFlags,
+                                  long long requirementFlags) {
     if (DEBUGGING_OUTPUT)
         std::cerr << "in BeagleCPUImpl::initialize\n" ;
 
@@ -265,6 +279,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     kMaxPartitionCount = kPartitionCount;
     kPartitionsInitialised = false;
     kPatternsReordered = false;
+    kConstantPatternsStale = true;
+    kPartialsFromClient = false;
     
     kInternalPartialsBufferCount = kBufferCount - kTipCount;
 
@@ -286,8 +302,35 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     kScaleBufferCount = scaleBufferCount;
 
     kMatrixSize = (T_PAD + kStateCount) * kStateCount;
+    kStateSetCount = (kStateCount <= BEAGLE_CPU_STATE_SET_MAX_STATE_COUNT ? 1 << kStateCount : 0);
 
     int scaleBufferSize = kPaddedPatternCount;
+
+    gArena = NULL;
+    kArenaSize = 0;
+    kArenaUsed = 0;
+    kArenaFile = -1;
+
+    kMatrixCacheSize = 0;
+    gEigenVersions.assign(kEigenDecompCount, 0);
+    gCategoryRatesVersions.assign(kEigenDecompCount, 0);
+
+    kIncrementalEnabled = false;
+
+    kExponentScaling = false;
+
+    kAdaptiveRescaling = false;
+
+    kSiteRepeatsEnabled = false;
+    gScalingStatistics = BeagleScalingStatistics();
+
+    kCheckpointActive = false;
+
+    kAsynchEnabled = false;
+    kAsynchStopping = false;
+    kAsynchQueuedCount = 0;
+    kAsynchFinishedCount = 0;
+    kAsynchReturnCode = BEAGLE_SUCCESS;
     
     kFlags = 0;
 
@@ -324,6 +367,28 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
         kFlags |= BEAGLE_FLAG_THREADING_NONE;
     else
         kFlags |= BEAGLE_FLAG_THREADING_CPP;
+
+    if ((kFlags & BEAGLE_FLAG_THREADING_CPP) &&
+        (requirementFlags & BEAGLE_FLAG_THREADING_NUMA || preferenceFlags & BEAGLE_FLAG_THREADING_NUMA))
+        kFlags |= BEAGLE_FLAG_THREADING_NUMA;
+
+#ifdef BEAGLE_CPU_ARENA
+    if (requirementFlags & BEAGLE_FLAG_MEMORY_ARENA || preferenceFlags & BEAGLE_FLAG_MEMORY_ARENA)
+        kFlags |= BEAGLE_FLAG_MEMORY_ARENA;
+#endif
+
+    kFlags |= BEAGLE_FLAG_PREORDER;
+    // auto and always-scaling evaluate multiple edges one call at a time
+    if (!(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS)))
+        kFlags |= BEAGLE_FLAG_MULTI_EDGE;
+
+    // the queued updates run on a thread of their own, so not without threading
+    if ((kFlags & BEAGLE_FLAG_THREADING_CPP) &&
+        (requirementFlags & BEAGLE_FLAG_COMPUTATION_ASYNCH || preferenceFlags & BEAGLE_FLAG_COMPUTATION_ASYNCH)) {
+        kFlags |= BEAGLE_FLAG_COMPUTATION_ASYNCH;
+        kAsynchEnabled = true;
+        gAsynchWriteTickets.assign(kBufferCount, 0);
+    }
     
     if (kFlags & BEAGLE_FLAG_EIGEN_COMPLEX)
         gEigenDecomposition = new EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>(kEigenDecompCount,
@@ -336,11 +401,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     if (gCategoryRates == NULL)
         throw std::bad_alloc();
 
-    gPatternWeights = (double*) malloc(sizeof(double) * kPatternCount);
+    // padded patterns carry zero weight so vectorized integration loops may run
+    // over the full kPaddedPatternCount without masking the tail
+    gPatternWeights = (double*) calloc(sizeof(double), kPaddedPatternCount);
     if (gPatternWeights == NULL)
         throw std::bad_alloc();
 
-    // TODO: if pattern padding is implemented this will create problems with setTipPartials
+    // tip and internal partials are stored with padded states and patterns; the
+    // set/get functions below translate to and from the unpadded user layout
     kPartialsSize = kPaddedPatternCount * kPartialsPaddedStateCount * kCategoryCount;
 
     gPartials = (REALTYPE**) malloc(sizeof(REALTYPE*) * kBufferCount);
@@ -357,20 +425,40 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
 
     // assigning kBufferCount to this array so that we can just check if a tipStateBuffer is
     // allocated
-    gTipStates = (int**) malloc(sizeof(int*) * kBufferCount);
+    gTipStates = (TipState**) malloc(sizeof(TipState*) * kBufferCount);
     if (gTipStates == NULL)
         throw std::bad_alloc();
 
+    gTipStateSets = (TipState**) malloc(sizeof(TipState*) * kBufferCount);
+    if (gTipStateSets == NULL)
+        throw std::bad_alloc();
+
     for (int i = 0; i < kBufferCount; i++) {
         gPartials[i] = NULL;
         gTipStates[i] = NULL;
+        gTipStateSets[i] = NULL;
     }
 
-    for (int i = kTipCount; i < kBufferCount; i++) {
-        gPartials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
-        if (gPartials[i] == NULL)
-            throw std::bad_alloc();
+#ifdef BEAGLE_CPU_ARENA
+    if (kFlags & BEAGLE_FLAG_MEMORY_ARENA) {
+        const size_t align = BEAGLE_CPU_ARENA_ALIGNMENT;
+        size_t partialsBytes = (sizeof(REALTYPE) * kPartialsSize + align - 1) / align * align;
+        size_t matrixBytes = (sizeof(REALTYPE) * kMatrixSize * kCategoryCount + align - 1) / align * align;
+        size_t scaleBytes = (sizeof(REALTYPE) * scaleBufferSize + align - 1) / align * align;
+        size_t arenaSize = partialsBytes * kInternalPartialsBufferCount + matrixBytes * kMatrixCount;
+        if (!(kFlags & BEAGLE_FLAG_SCALING_AUTO))
+            arenaSize += scaleBytes * kScaleBufferCount;
+        createArena(arenaSize);
+
+        // the arena keeps a slot for every internal buffer; its pages are only backed once written
+        for (int i = kTipCount; i < kBufferCount; i++) {
+            gPartials[i] = (REALTYPE*) allocateBuffer(sizeof(REALTYPE) * kPartialsSize);
+            if (gPartials[i] == NULL)
+                throw std::bad_alloc();
+        }
     }
+#endif
+    // otherwise internal partials buffers are allocated when first written
 
     gScaleBuffers = NULL;
 
@@ -394,7 +482,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
             throw std::bad_alloc();
         
         for (int i = 0; i < kScaleBufferCount; i++) {
-            gScaleBuffers[i] = (REALTYPE*) malloc(sizeof(REALTYPE) * scaleBufferSize);
+            gScaleBuffers[i] = (REALTYPE*) allocateBuffer(sizeof(REALTYPE) * scaleBufferSize);
             
             if (gScaleBuffers[i] == 0L)
                 throw std::bad_alloc();
@@ -413,7 +501,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     if (gTransitionMatrices == NULL)
         throw std::bad_alloc();
     for (int i = 0; i < kMatrixCount; i++) {
-        gTransitionMatrices[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
+        gTransitionMatrices[i] = (REALTYPE*) allocateBuffer(sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
         if (gTransitionMatrices[i] == 0L)
             throw std::bad_alloc();
     }
@@ -433,51 +521,117 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
         ones[i] = 1.0;
     }
 
+    // Fixed scaling works one pattern at a time, so operations can be run over blocks
+    // of patterns small enough for a few partials buffers to share the L2 cache
+    kPatternBlockSize = kPatternCount;
+    if (!(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))) {
+        long cacheSize = BEAGLE_CPU_L2_CACHE_SIZE;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        if (sysconf(_SC_LEVEL2_CACHE_SIZE) > 0)
+            cacheSize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        long patternSize = sizeof(REALTYPE) * kPartialsPaddedStateCount * kCategoryCount;
+        long blockSize = cacheSize / (BEAGLE_CPU_BLOCK_BUFFER_COUNT * patternSize);
+        blockSize -= blockSize % BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+        if (blockSize < BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT)
+            blockSize = BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+        if (blockSize < kPatternCount)
+            kPatternBlockSize = (int) blockSize;
+    }
+
+    // OpenMP builds split the patterns of each operation list between threads, which
+    // like blocking needs scaling that works one pattern at a time
+    kOpenMPThreadCount = 1;
+#ifdef _OPENMP
+    if (!(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC)))
+        kOpenMPThreadCount = getOpenMPThreadCount(omp_get_max_threads());
+#endif
+
     kThreadingEnabled = false;
+    kTraversalThreadingEnabled = false;
     kAutoPartitioningEnabled = false;
-    if (kFlags & BEAGLE_FLAG_THREADING_CPP) {
-        int hardwareThreads = std::thread::hardware_concurrency();
-        if (kPatternCount >= BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT && hardwareThreads > 1) {
-            int partitionCount = kPatternCount/(BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT/2);
-            if (partitionCount > hardwareThreads/2) {
-                partitionCount = hardwareThreads/2;
-            } 
-
-            int* patternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
-            int partitionSize = kPatternCount/partitionCount;
-            for (int i=0; i<kPatternCount; i++) {
-                int sitePartition = i/partitionSize;
-                if (sitePartition > partitionCount - 1)
-                    sitePartition = partitionCount - 1;
-                patternPartitions[i] = sitePartition;
-            }
-            setPatternPartitions(partitionCount, patternPartitions);
-
-            gAutoPartitionOperations = (int*) malloc(sizeof(int) * kBufferCount * kPartitionCount * BEAGLE_PARTITION_OP_COUNT);
-
-            if (kPatternCount >= BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT*4) {
-                gAutoPartitionIndices = (int*) malloc(sizeof(int) * partitionCount);
-                for (int i=0; i<partitionCount; i++) {
-                    gAutoPartitionIndices[i] = i;
-                }
-                gAutoPartitionOutSumLogLikelihoods = (double*) malloc(sizeof(double) * partitionCount);
-                kAutoRootPartitioningEnabled = true;
-            }
-
-            kAutoPartitioningEnabled = true;
-        }
+    kAutoRootPartitioningEnabled = false;
+    kPartialsPlaced = false;
+    gNodePool = NULL;
+    kMaxThreadCount = std::thread::hardware_concurrency();
+    if ((kFlags & BEAGLE_FLAG_THREADING_CPP) && kOpenMPThreadCount == 1) {
+        startAutoPartitioning();
     }
 
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getOpenMPThreadCount(int threadCount) {
+    // every thread gets at least one whole minimum block of patterns
+    int maxThreadCount = (kPatternCount + BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT - 1) /
+                         BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+    if (threadCount > maxThreadCount)
+        threadCount = maxThreadCount;
+    return (threadCount < 1 ? 1 : threadCount);
+}
+
+BEAGLE_CPU_TEMPLATE
+size_t BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getMemoryFootprint(int tipCount,
+                                  int partialsBufferCount,
+                                  int compactBufferCount,
+                                  int stateCount,
+                                  int patternCount,
+                                  int eigenDecompositionCount,
+                                  int matrixCount,
+                                  int categoryCount,
+                                  int scaleBufferCount,
+                                  long long preferenceFlags,
+                                  long long requirementFlags) {
+    // mirrors the allocations of createInstance, counting every partials buffer as written,
+    // every tip as set and every eigen index as given its rates, weights and frequencies;
+    // the pointer arrays and thread bookkeeping are left out
+    const long long flags = preferenceFlags | requirementFlags;
+    const size_t realSize = sizeof(REALTYPE);
+    const size_t paddedPatternCount = patternCount; // the CPU implementations do not pad patterns
+    const size_t partialsSize = paddedPatternCount * (stateCount + P_PAD) * categoryCount;
+    const size_t matrixSize = (size_t) (T_PAD + stateCount) * stateCount;
+    const int internalPartialsBufferCount = partialsBufferCount + compactBufferCount - tipCount;
+
+    size_t bytes = realSize * partialsSize * partialsBufferCount;
+    if (stateCount > BEAGLE_CPU_TIP_STATE_MAX) // compact tips are kept as partials
+        bytes += realSize * partialsSize * compactBufferCount;
+    else
+        bytes += sizeof(TipState) * paddedPatternCount * compactBufferCount;
+
+    if (flags & BEAGLE_FLAG_SCALING_AUTO) {
+        bytes += sizeof(signed short) * paddedPatternCount * internalPartialsBufferCount;
+        bytes += sizeof(int) * internalPartialsBufferCount + realSize * paddedPatternCount;
+    } else {
+        if (flags & BEAGLE_FLAG_SCALING_ALWAYS)
+            scaleBufferCount = internalPartialsBufferCount + 1;
+        bytes += realSize * paddedPatternCount * scaleBufferCount;
+    }
+
+    bytes += realSize * matrixSize * categoryCount * matrixCount;
+
+    // integrationTmp, the two derivative temporaries and the three output temporaries
+    bytes += 6 * realSize * patternCount * stateCount;
+    bytes += 2 * realSize * paddedPatternCount + sizeof(double) * paddedPatternCount; // zeros, ones and pattern weights
+
+    if (flags & BEAGLE_FLAG_EIGEN_COMPLEX)
+        bytes += realSize * ((2 * (size_t) stateCount * stateCount + 2 * stateCount) * eigenDecompositionCount +
+                             (size_t) stateCount * stateCount);
+    else
+        bytes += realSize * (((size_t) stateCount * stateCount * stateCount + stateCount) * eigenDecompositionCount +
+                             3 * (size_t) stateCount * BEAGLE_EIGEN_CUBE_BLOCK_SIZE);
+    bytes += (sizeof(double) * categoryCount + realSize * (categoryCount + stateCount)) * eigenDecompositionCount;
+
+    return bytes;
+}
+
 BEAGLE_CPU_TEMPLATE
 const char* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getName() {
     return getBeagleCPUName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 BEAGLE_CPU_TEMPLATE
-const long BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getFlags() {
+const long long BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getFlags() {
     return getBeagleCPUFlags<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
@@ -487,6 +641,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getInstanceDetails(BeagleInstanceDetails*
         returnInfo->resourceNumber = 0;
         returnInfo->flags = getFlags();
         returnInfo->flags |= kFlags;
+        if (kFlags & BEAGLE_FLAG_COMPUTATION_ASYNCH)
+            returnInfo->flags &= ~BEAGLE_FLAG_COMPUTATION_SYNCH;
 
         returnInfo->implName = (char*) getName();
     }
@@ -497,16 +653,39 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getInstanceDetails(BeagleInstanceDetails*
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStates(int tipIndex,
                                 const int* inStates) {
+    finishAsynchUpdates();
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
-    gTipStates[tipIndex] = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+    kConstantPatternsStale = true;
+
+    if (kStateCount > BEAGLE_CPU_TIP_STATE_MAX) {
+        // the missing state would not fit in a TipState, so keep the tip as partials
+        std::vector<double> tipPartials((size_t) kPatternCount * kStateCount, 0.0);
+        for (int j = 0; j < kPatternCount; j++) {
+            double* tipPartialsOffset = &tipPartials[(size_t) j * kStateCount];
+            if (inStates[j] >= 0 && inStates[j] < kStateCount)
+                tipPartialsOffset[inStates[j]] = 1.0;
+            else
+                std::fill(tipPartialsOffset, tipPartialsOffset + kStateCount, 1.0);
+        }
+        return setTipPartials(tipIndex, &tipPartials[0]);
+    }
+
+    if (gTipStateSets[tipIndex] != NULL) {
+        free(gTipStateSets[tipIndex]);
+        gTipStateSets[tipIndex] = NULL;
+    }
+
+    if (gTipStates[tipIndex] == NULL)
+        gTipStates[tipIndex] = (TipState*) mallocAligned(sizeof(TipState) * kPaddedPatternCount);
     // TODO: What if this throws a memory full error?
     for (int j = 0; j < kPatternCount; j++) {
-        gTipStates[tipIndex][j] = (inStates[j] < kStateCount ? inStates[j] : kStateCount);
+        gTipStates[tipIndex][j] = (inStates[j] >= 0 && inStates[j] < kStateCount ? inStates[j] : kStateCount);
     }
     for (int j = kPatternCount; j < kPaddedPatternCount; j++) {
         gTipStates[tipIndex][j] = kStateCount;
     }
+    invalidatePartials(tipIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -514,8 +693,15 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStates(int tipIndex,
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
                                   const double* inPartials) {
+    finishAsynchUpdates();
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+    kConstantPatternsStale = true;
+    if (kCheckpointActive) {
+        int returnCode = preservePartials(tipIndex, false);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
     if(gPartials[tipIndex] == NULL) {
         gPartials[tipIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
         // TODO: What if this throws a memory full error?
@@ -529,6 +715,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
         inPartialsOffset = inPartials;
         for (int i = 0; i < kPatternCount; i++) {
             beagleMemCpy(tmpRealPartialsOffset, inPartialsOffset, kStateCount);
+            for (int j = kStateCount; j < kPartialsPaddedStateCount; j++)
+                tmpRealPartialsOffset[j] = 0;
             tmpRealPartialsOffset += kPartialsPaddedStateCount;
             inPartialsOffset += kStateCount;
         }
@@ -538,16 +726,105 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
         }
     }
 
+    // the partials replace any states or sets the tip held, which would be read first
+    if (gTipStates[tipIndex] != NULL) {
+        free(gTipStates[tipIndex]);
+        gTipStates[tipIndex] = NULL;
+    }
+    if (gTipStateSets[tipIndex] != NULL) {
+        free(gTipStateSets[tipIndex]);
+        gTipStateSets[tipIndex] = NULL;
+    }
+
+    invalidatePartials(tipIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStateSets(int tipIndex,
+                                                       const int* inStateSets) {
+    finishAsynchUpdates();
+    if (tipIndex < 0 || tipIndex >= kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    kConstantPatternsStale = true;
+
+    // a set with no states of this model is missing data, so every state is possible
+    const int allStates = (kStateCount < 31 ? (1 << kStateCount) - 1 : 0x7fffffff);
+
+    // the tip is always held as partials too: state spaces too large to look up every set use
+    // them for everything, and edge likelihoods, their derivatives and pre-order partials read
+    // them in place of the sets
+    std::vector<double> tipPartials((size_t) kPatternCount * kStateCount, 0.0);
+    for (int j = 0; j < kPatternCount; j++) {
+        double* tipPartialsOffset = &tipPartials[(size_t) j * kStateCount];
+        int stateSet = inStateSets[j] & allStates;
+        if (stateSet == 0)
+            stateSet = allStates;
+        for (int s = 0; s < kStateCount && s < 31; s++)
+            tipPartialsOffset[s] = ((stateSet >> s) & 1 ? 1.0 : 0.0);
+    }
+    int returnCode = setTipPartials(tipIndex, &tipPartials[0]);
+    if (returnCode != BEAGLE_SUCCESS || kStateSetCount == 0)
+        return returnCode;
+
+    if (gTipStateSets[tipIndex] == NULL)
+        gTipStateSets[tipIndex] = (TipState*) mallocAligned(sizeof(TipState) * kPaddedPatternCount);
+    for (int j = 0; j < kPatternCount; j++) {
+        int stateSet = inStateSets[j] & allStates;
+        gTipStateSets[tipIndex][j] = (stateSet == 0 ? allStates : stateSet);
+    }
+    for (int j = kPatternCount; j < kPaddedPatternCount; j++) {
+        gTipStateSets[tipIndex][j] = allStates;
+    }
+    invalidatePartials(tipIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStatesBatch(const int* tipIndices,
+                                                         const int* inStates,
+                                                         int count) {
+    finishAsynchUpdates();
+    for (int i = 0; i < count; i++) {
+        int returnCode = setTipStates(tipIndices[i], inStates + (size_t) i * kPatternCount);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartialsBatch(const int* tipIndices,
+                                                           const double* inPartials,
+                                                           int count) {
+    finishAsynchUpdates();
+    for (int i = 0; i < count; i++) {
+        int returnCode = setTipPartials(tipIndices[i], inPartials + (size_t) i * kPatternCount * kStateCount);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
+    finishAsynchUpdates();
     if (bufferIndex < 0 || bufferIndex >= kBufferCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (bufferIndex >= kTipCount) {
+        kPartialsFromClient = true;
+        kConstantPatternsStale = true;
+    }
+    if (kCheckpointActive) {
+        int returnCode = preservePartials(bufferIndex, false);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
     if (gPartials[bufferIndex] == NULL) {
-        gPartials[bufferIndex] = (REALTYPE*) malloc(sizeof(REALTYPE) * kPartialsSize);
+        gPartials[bufferIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
         if (gPartials[bufferIndex] == 0L)
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
@@ -557,6 +834,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartials(int bufferIndex,
     for (int l = 0; l < kCategoryCount; l++) {
         for (int i = 0; i < kPatternCount; i++) {
             beagleMemCpy(tmpRealPartialsOffset, inPartialsOffset, kStateCount);
+            for (int j = kStateCount; j < kPartialsPaddedStateCount; j++)
+                tmpRealPartialsOffset[j] = 0;
             tmpRealPartialsOffset += kPartialsPaddedStateCount;
             inPartialsOffset += kStateCount;
         }
@@ -566,6 +845,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartials(int bufferIndex,
         }
     }
 
+    invalidatePartials(bufferIndex);
+
     return BEAGLE_SUCCESS;
 }
 
@@ -573,22 +854,22 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPartials(int bufferIndex,
                                int cumulativeScaleIndex,
                                double* outPartials) {
-    // TODO: Make this work with partials padding
-    
-    // TODO: Test with and without padding
-    if (bufferIndex < 0 || bufferIndex >= kBufferCount)
+    finishAsynchUpdates();
+    if (bufferIndex < 0 || bufferIndex >= kBufferCount || gPartials[bufferIndex] == NULL)
         return BEAGLE_ERROR_OUT_OF_RANGE;
 
-    if (kPatternCount == kPaddedPatternCount) {
+    if (kPatternCount == kPaddedPatternCount && kStateCount == kPartialsPaddedStateCount) {
         beagleMemCpy(outPartials, gPartials[bufferIndex], kPartialsSize);
     } else { // Need to remove padding
-        double *offsetOutPartials;
-        REALTYPE* offsetBeaglePartials = gPartials[bufferIndex];
-        for(int i = 0; i < kCategoryCount; i++) {
-            beagleMemCpy(offsetOutPartials,offsetBeaglePartials,
-                    kPatternCount * kStateCount);
-            offsetOutPartials += kPatternCount * kStateCount;
-            offsetBeaglePartials += kPaddedPatternCount * kStateCount;
+        double* offsetOutPartials = outPartials;
+        const REALTYPE* offsetBeaglePartials = gPartials[bufferIndex];
+        for(int l = 0; l < kCategoryCount; l++) {
+            for(int k = 0; k < kPatternCount; k++) {
+                beagleMemCpy(offsetOutPartials, offsetBeaglePartials, kStateCount);
+                offsetOutPartials += kStateCount;
+                offsetBeaglePartials += kPartialsPaddedStateCount;
+            }
+            offsetBeaglePartials += kExtraPatterns * kPartialsPaddedStateCount;
         }
     }
 
@@ -608,18 +889,308 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPartials(int bufferIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getBufferLayout(BeagleBufferLayout* outLayout) {
+    outLayout->realSize = sizeof(REALTYPE);
+    outLayout->partialsStateCount = kPartialsPaddedStateCount;
+    outLayout->partialsPatternCount = kPaddedPatternCount;
+    outLayout->matrixRowSize = kTransPaddedStateCount;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartialsNative(int tipIndex,
+                                                            const void* inPartials) {
+    finishAsynchUpdates();
+    if (tipIndex < 0 || tipIndex >= kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    kConstantPatternsStale = true;
+    if (kCheckpointActive) {
+        int returnCode = preservePartials(tipIndex, false);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+    if (gPartials[tipIndex] == NULL) {
+        gPartials[tipIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+        if (gPartials[tipIndex] == 0L)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+
+    // one category, repeated for each as by setTipPartials
+    const size_t categorySize = (size_t) kPaddedPatternCount * kPartialsPaddedStateCount;
+    for (int l = 0; l < kCategoryCount; l++)
+        memcpy(gPartials[tipIndex] + l * categorySize, inPartials, sizeof(REALTYPE) * categorySize);
+
+    // the partials replace any states or sets the tip held, which would be read first
+    if (gTipStates[tipIndex] != NULL) {
+        free(gTipStates[tipIndex]);
+        gTipStates[tipIndex] = NULL;
+    }
+    if (gTipStateSets[tipIndex] != NULL) {
+        free(gTipStateSets[tipIndex]);
+        gTipStateSets[tipIndex] = NULL;
+    }
+
+    invalidatePartials(tipIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartialsNative(int bufferIndex,
+                                                         const void* inPartials) {
+    finishAsynchUpdates();
+    if (bufferIndex < 0 || bufferIndex >= kBufferCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (bufferIndex >= kTipCount) {
+        kPartialsFromClient = true;
+        kConstantPatternsStale = true;
+    }
+    if (kCheckpointActive) {
+        int returnCode = preservePartials(bufferIndex, false);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+    if (gPartials[bufferIndex] == NULL) {
+        gPartials[bufferIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+        if (gPartials[bufferIndex] == 0L)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(gPartials[bufferIndex], inPartials, sizeof(REALTYPE) * kPartialsSize);
+
+    invalidatePartials(bufferIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPartialsView(int bufferIndex,
+                                                       const void** outPartials) {
+    finishAsynchUpdates();
+    if (bufferIndex < 0 || bufferIndex >= kBufferCount || gPartials[bufferIndex] == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    *outPartials = gPartials[bufferIndex];
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::releasePartials(int bufferIndex) {
+    finishAsynchUpdates();
+    if (bufferIndex < 0 || bufferIndex >= kBufferCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    REALTYPE* partials = gPartials[bufferIndex];
+    if (partials == NULL)
+        return BEAGLE_SUCCESS;
+
+    if (kCheckpointActive && !gPartialsCheckpoint.written[bufferIndex]) {
+        // the checkpoint keeps the storage for restoreState
+        checkpointBuffer(gPartialsCheckpoint, (void**) gPartials, bufferIndex, NULL);
+        invalidatePartials(bufferIndex);
+        return BEAGLE_SUCCESS;
+    }
+
+#ifdef BEAGLE_CPU_ARENA
+    if (gArena != NULL && (char*) partials >= gArena && (char*) partials < gArena + kArenaSize) {
+        // hand the whole pages of the arena slot back to the system; the buffer is
+        // allocated outside the arena if it is written again
+        const size_t pageSize = 4096;
+        size_t start = ((size_t) partials + pageSize - 1) / pageSize * pageSize;
+        size_t end = ((size_t) partials + sizeof(REALTYPE) * kPartialsSize) / pageSize * pageSize;
+        if (end > start)
+            madvise((void*) start, end - start, MADV_DONTNEED);
+    }
+#endif
+
+    freeBuffer(partials);
+    gPartials[bufferIndex] = NULL;
+    invalidatePartials(bufferIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::saveState() {
+    finishAsynchUpdates();
+    retireCheckpoint(gPartialsCheckpoint);
+    retireCheckpoint(gScaleBuffersCheckpoint);
+
+    gPartialsCheckpoint.saved.resize(kBufferCount, NULL);
+    gPartialsCheckpoint.written.resize(kBufferCount, false);
+    gScaleBuffersCheckpoint.saved.resize(kScaleBufferCount, NULL);
+    gScaleBuffersCheckpoint.written.resize(kScaleBufferCount, false);
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
+        gActiveScalingFactorsCheckpoint.assign(gActiveScalingFactors,
+                                               gActiveScalingFactors + kInternalPartialsBufferCount);
+
+    kCheckpointActive = true;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::restoreState() {
+    finishAsynchUpdates();
+    if (!kCheckpointActive)
+        return BEAGLE_ERROR_GENERAL;
+
+    void** scaleBuffers = (kFlags & BEAGLE_FLAG_SCALING_AUTO ? (void**) gAutoScaleBuffers : (void**) gScaleBuffers);
+    BufferCheckpoint* checkpoints[2] = { &gPartialsCheckpoint, &gScaleBuffersCheckpoint };
+    void** buffers[2] = { (void**) gPartials, scaleBuffers };
+
+    for (int c = 0; c < 2; c++) {
+        BufferCheckpoint& checkpoint = *checkpoints[c];
+        for (size_t i = 0; i < checkpoint.writtenIndices.size(); i++) {
+            const int index = checkpoint.writtenIndices[i];
+            if (buffers[c][index] != NULL)
+                checkpoint.spares.push_back(buffers[c][index]);
+            buffers[c][index] = checkpoint.saved[index];
+            checkpoint.saved[index] = NULL;
+            checkpoint.written[index] = false;
+            if (c == 0)
+                invalidatePartials(index);
+            else
+                invalidateScaleBuffer(index);
+        }
+        checkpoint.writtenIndices.clear();
+    }
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
+        memcpy(gActiveScalingFactors, &gActiveScalingFactorsCheckpoint[0],
+               sizeof(int) * kInternalPartialsBufferCount);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::checkpointBuffer(BufferCheckpoint& checkpoint,
+                                                         void** buffers,
+                                                         int index,
+                                                         void* replacement) {
+    checkpoint.saved[index] = buffers[index];
+    checkpoint.written[index] = true;
+    checkpoint.writtenIndices.push_back(index);
+    buffers[index] = replacement;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::preserveBuffer(BufferCheckpoint& checkpoint,
+                                                      void** buffers,
+                                                      int index,
+                                                      size_t size,
+                                                      bool keepContents) {
+    if (checkpoint.written[index])
+        return BEAGLE_SUCCESS;
+
+    // a buffer without storage is allocated by whichever call writes it
+    void* fresh = NULL;
+    if (buffers[index] != NULL) {
+        if (!checkpoint.spares.empty()) {
+            fresh = checkpoint.spares.back();
+            checkpoint.spares.pop_back();
+        } else {
+            fresh = mallocAligned(size);
+            if (fresh == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+        if (keepContents)
+            memcpy(fresh, buffers[index], size);
+    }
+
+    checkpointBuffer(checkpoint, buffers, index, fresh);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::preservePartials(int bufferIndex,
+                                                        bool keepContents) {
+    return preserveBuffer(gPartialsCheckpoint, (void**) gPartials, bufferIndex,
+                          sizeof(REALTYPE) * kPartialsSize, keepContents);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::preserveScaleBuffer(int scaleIndex) {
+    // auto-scaling accumulates into a scratch buffer only, see accumulateScaleFactors
+    if (scaleIndex < 0 || scaleIndex >= kScaleBufferCount || (kFlags & BEAGLE_FLAG_SCALING_AUTO))
+        return BEAGLE_SUCCESS;
+    return preserveBuffer(gScaleBuffersCheckpoint, (void**) gScaleBuffers, scaleIndex,
+                          sizeof(REALTYPE) * kPaddedPatternCount, true);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::preserveDestinations(const int* operations,
+                                                            int count,
+                                                            int numOps,
+                                                            int cumulativeScaleIndex) {
+    // an operation of one partition leaves the other patterns of its buffers as they are
+    const bool keepContents = (numOps == BEAGLE_PARTITION_OP_COUNT);
+
+    int returnCode = preserveScaleBuffer(cumulativeScaleIndex);
+
+    for (int op = 0; op < count && returnCode == BEAGLE_SUCCESS; op++) {
+        const int* o = &operations[op * numOps];
+        returnCode = preservePartials(o[0], keepContents);
+        if (returnCode != BEAGLE_SUCCESS)
+            break;
+
+        if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+            returnCode = preserveBuffer(gScaleBuffersCheckpoint, (void**) gAutoScaleBuffers, o[0] - kTipCount,
+                                        sizeof(signed short) * kPaddedPatternCount, keepContents);
+        } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+            returnCode = preserveScaleBuffer(o[0] - kTipCount);
+        } else {
+            returnCode = preserveScaleBuffer(o[1]);
+        }
+
+        if (returnCode == BEAGLE_SUCCESS && numOps == BEAGLE_PARTITION_OP_COUNT)
+            returnCode = preserveScaleBuffer(o[8]);
+    }
+
+    return returnCode;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::retireCheckpoint(BufferCheckpoint& checkpoint) {
+    for (size_t i = 0; i < checkpoint.writtenIndices.size(); i++) {
+        const int index = checkpoint.writtenIndices[i];
+        if (checkpoint.saved[index] != NULL)
+            checkpoint.spares.push_back(checkpoint.saved[index]);
+        checkpoint.saved[index] = NULL;
+        checkpoint.written[index] = false;
+    }
+    checkpoint.writtenIndices.clear();
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::freeCheckpoint(BufferCheckpoint& checkpoint) {
+    retireCheckpoint(checkpoint);
+    for (size_t i = 0; i < checkpoint.spares.size(); i++)
+        freeBuffer(checkpoint.spares[i]);
+    checkpoint.spares.clear();
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setEigenDecomposition(int eigenIndex,
                                          const double* inEigenVectors,
                                          const double* inInverseEigenVectors,
                                          const double* inEigenValues) {
+    finishAsynchUpdates();
 
     gEigenDecomposition->setEigenDecomposition(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
+    if (eigenIndex >= 0 && eigenIndex < kEigenDecompCount)
+        gEigenVersions[eigenIndex]++;
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRates(const double* inCategoryRates) {
+    finishAsynchUpdates();
     int categoryRatesIndex=0;
     if (gCategoryRates[categoryRatesIndex] == NULL) {
         gCategoryRates[categoryRatesIndex] = (double*) malloc(sizeof(double) * kCategoryCount);
@@ -627,12 +1198,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRates(const double* inCategory
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     memcpy(gCategoryRates[categoryRatesIndex], inCategoryRates, sizeof(double) * kCategoryCount);
+    gCategoryRatesVersions[categoryRatesIndex]++;
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRatesWithIndex(int categoryRatesIndex,
                                                                  const double* inCategoryRates) {
+    finishAsynchUpdates();
     if (categoryRatesIndex < 0 || categoryRatesIndex >= kEigenDecompCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
     if (gCategoryRates[categoryRatesIndex] == NULL) {
@@ -641,11 +1214,13 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRatesWithIndex(int categoryRat
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     memcpy(gCategoryRates[categoryRatesIndex], inCategoryRates, sizeof(double) * kCategoryCount);
+    gCategoryRatesVersions[categoryRatesIndex]++;
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternWeights(const double* inPatternWeights) {
+    finishAsynchUpdates();
     assert(inPatternWeights != 0L);
     memcpy(gPatternWeights, inPatternWeights, sizeof(double) * kPatternCount);
     return BEAGLE_SUCCESS;
@@ -654,6 +1229,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternWeights(const double* inPattern
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
                                                             const int* inPatternPartitions) {
+    finishAsynchUpdates();
     
     int returnCode = BEAGLE_SUCCESS;
 
@@ -662,20 +1238,16 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
 
     kPartitionCount = partitionCount;
 
+    // partitions set by the caller replace the automatic ones
+    bool restartThreading = kAutoPartitioningEnabled;
+    if (kAutoPartitioningEnabled) {
+        stopAutoPartitioning();
+    }
+
     if (!kPartitionsInitialised) {
         gPatternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
         if (gPatternPartitions == NULL)
             throw std::bad_alloc();
-
-        if (kAutoPartitioningEnabled) {
-            free(gAutoPartitionOperations);
-            if (kAutoRootPartitioningEnabled) {
-                free(gAutoPartitionIndices);
-                free(gAutoPartitionOutSumLogLikelihoods);
-                kAutoRootPartitioningEnabled = false;
-            }
-            kAutoPartitioningEnabled = false;
-        }
     }
     if (!kPartitionsInitialised || partitionCount > kMaxPartitionCount) {
         if (kPartitionsInitialised) {
@@ -685,69 +1257,21 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
         if (gPatternPartitionsStartPatterns == NULL)
             throw std::bad_alloc();
 
-        if (kThreadingEnabled) {
-            // Send stop signal to all threads and join them...
-            for (int i = 0; i < kNumThreads; i++) {
-                threadData* td = &gThreads[i];
-                std::unique_lock<std::mutex> l(td->m);
-                td->stop = true;
-                td->cv.notify_one();
-            }
-
-            // Join all the threads
-            for (int i = 0; i < kNumThreads; i++) {
-                threadData* td = &gThreads[i];
-                td->t.join();
-            }
+        kMaxPartitionCount = partitionCount;
+        restartThreading = true;
+    }
 
-            delete[] gThreads;
-            delete[] gFutures;
+    if (restartThreading) {
+        startPartitionThreading(partitionCount);
+    }
 
-            for (int i=0; i<kNumThreads; i++) {
-                free(gThreadOperations[i]);
-            }
-            free(gThreadOperations);
-            free(gThreadOpCounts);
+    memcpy(gPatternPartitions, inPatternPartitions, sizeof(int) * kPatternCount);
 
-            kThreadingEnabled = false;
-        }
-
-        if (kFlags & BEAGLE_FLAG_THREADING_CPP) {
-            kNumThreads = std::thread::hardware_concurrency();
-            if (kNumThreads > 1 && partitionCount > 1 && kPatternCount >= BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT) {
-                if (partitionCount < kNumThreads)
-                    kNumThreads = partitionCount;
-
-                gThreads = new threadData[kNumThreads];
-                for (int i = 0; i < kNumThreads; i++) {
-                    gThreads[i].t = std::thread(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::threadWaiting, this, &gThreads[i]);
-                }
-
-                gFutures = new std::shared_future<void>[kNumThreads];
-                if (gFutures == NULL)
-                    throw std::bad_alloc();
-
-                gThreadOperations = (int**) malloc(sizeof(int*) * kNumThreads);
-                for (int i=0; i<kNumThreads; i++) {
-                    gThreadOperations[i] = (int*) malloc(sizeof(int) * BEAGLE_PARTITION_OP_COUNT * kBufferCount * partitionCount);
-                }
-
-                gThreadOpCounts = (int*) malloc(sizeof(int) * kNumThreads);
-
-                kThreadingEnabled = true;
-            }
-        }
-
-        kMaxPartitionCount = partitionCount;
-    }
-
-    memcpy(gPatternPartitions, inPatternPartitions, sizeof(int) * kPatternCount);
-
-    bool reorderPatterns = false;
-    int contiguousPartitions = 0;
-    for (int i=0; i<kPatternCount; i++) {
-        if (i > 0 && (gPatternPartitions[i] != gPatternPartitions[i-1])) {
-            contiguousPartitions++;
+    bool reorderPatterns = false;
+    int contiguousPartitions = 0;
+    for (int i=0; i<kPatternCount; i++) {
+        if (i > 0 && (gPatternPartitions[i] != gPatternPartitions[i-1])) {
+            contiguousPartitions++;
         }
         if (contiguousPartitions != gPatternPartitions[i]) {
             reorderPatterns = true;
@@ -769,14 +1293,61 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternPartitions(int partitionCount,
         gPatternPartitionsStartPatterns[currentPartition+1] = kPatternCount;
     }
 
+    if (kThreadingEnabled && (kFlags & BEAGLE_FLAG_THREADING_NUMA) && !kPartialsPlaced) {
+        placePartialsByPartition();
+        kPartialsPlaced = true;
+    }
+
     kPartitionsInitialised = true;
 
     return returnCode;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCPUThreadCount(int threadCount) {
+    finishAsynchUpdates();
+    if (threadCount < 1)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+#ifdef _OPENMP
+    if (kOpenMPThreadCount > 1) {
+        // the OpenMP threads stand in for the C++ threads
+        kOpenMPThreadCount = getOpenMPThreadCount(threadCount);
+        return BEAGLE_SUCCESS;
+    }
+#endif
+
+    if (!(kFlags & BEAGLE_FLAG_THREADING_CPP))
+        return (threadCount == 1 ? BEAGLE_SUCCESS : BEAGLE_ERROR_NO_IMPLEMENTATION);
+
+    kMaxThreadCount = threadCount;
+
+    if (kPartitionsInitialised && !kAutoPartitioningEnabled) {
+        // keep the caller's partitions and spread them over the new number of threads
+        startPartitionThreading(kPartitionCount);
+    } else {
+        // choose the automatic partitions again for the new number of threads
+        if (kAutoPartitioningEnabled) {
+            stopAutoPartitioning();
+            free(gPatternPartitions);
+            free(gPatternPartitionsStartPatterns);
+            kPartitionCount = 1;
+            kMaxPartitionCount = kPartitionCount;
+            kPartitionsInitialised = false;
+        }
+        if (kTraversalThreadingEnabled) {
+            stopThreading();
+        }
+        startAutoPartitioning();
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
     int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setStateFrequencies(int stateFrequenciesIndex,
                                                      const double* inStateFrequencies) {
+    finishAsynchUpdates();
     if (stateFrequenciesIndex < 0 || stateFrequenciesIndex >= kEigenDecompCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
     if (gStateFrequencies[stateFrequenciesIndex] == NULL) {
@@ -792,6 +1363,7 @@ BEAGLE_CPU_TEMPLATE
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryWeights(int categoryWeightsIndex,
                                                  const double* inCategoryWeights) {
+    finishAsynchUpdates();
     if (categoryWeightsIndex < 0 || categoryWeightsIndex >= kEigenDecompCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
     if (gCategoryWeights[categoryWeightsIndex] == NULL) {
@@ -807,6 +1379,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryWeights(int categoryWeightsInd
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getTransitionMatrix(int matrixIndex,
                                                  double* outMatrix) {
+    finishAsynchUpdates();
     // TODO Test with multiple rate categories
 if (T_PAD != 0) {
     double* offsetOutMatrix = outMatrix;
@@ -827,6 +1400,7 @@ if (T_PAD != 0) {
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteLogLikelihoods(double* outLogLikelihoods) {
+    finishAsynchUpdates();
     if (kPatternsReordered) {
         REALTYPE* outLogLikelihoodsOriginalOrder = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount);
         for (int i=0; i < kPatternCount; i++) {
@@ -841,9 +1415,21 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteLogLikelihoods(double* outLogLikel
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteLogLikelihoodsView(const void** outLogLikelihoods) {
+    finishAsynchUpdates();
+    if (kPatternsReordered)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outLogLikelihoods = outLogLikelihoodsTmp;
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteDerivatives(double* outFirstDerivatives,
                                                 double* outSecondDerivatives) {
+    finishAsynchUpdates();
     beagleMemCpy(outFirstDerivatives, outFirstDerivativesTmp, kPatternCount);
     if (outSecondDerivatives != NULL)
         beagleMemCpy(outSecondDerivatives, outSecondDerivativesTmp, kPatternCount);
@@ -851,11 +1437,98 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteDerivatives(double* outFirstDeriva
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateEdgeDerivatives(const int* postBufferIndices,
+                                                                const int* preBufferIndices,
+                                                                const int* probabilityIndices,
+                                                                const int* derivativeMatrixIndices,
+                                                                const int* categoryWeightsIndices,
+                                                                int count,
+                                                                double* outDerivatives,
+                                                                double* outSumDerivatives) {
+    finishAsynchUpdates();
+    for (int n = 0; n < count; n++) {
+        const int postIndex = postBufferIndices[n];
+        const int preIndex = preBufferIndices[n];
+        if (postIndex < 0 || postIndex >= kBufferCount || preIndex < kTipCount || preIndex >= kBufferCount ||
+            probabilityIndices[n] < 0 || probabilityIndices[n] >= kMatrixCount ||
+            derivativeMatrixIndices[n] < 0 || derivativeMatrixIndices[n] >= kMatrixCount ||
+            categoryWeightsIndices[n] < 0 || categoryWeightsIndices[n] >= kEigenDecompCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[preIndex] == NULL || (gPartials[postIndex] == NULL && gTipStates[postIndex] == NULL) ||
+            gCategoryWeights[categoryWeightsIndices[n]] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    int returnCode = BEAGLE_SUCCESS;
+
+    std::vector<double> siteLikelihoods(kPatternCount);
+    std::vector<double> siteDerivatives(kPatternCount);
+
+    for (int n = 0; n < count; n++) {
+        const REALTYPE* partialsPre = gPartials[preBufferIndices[n]];
+        const REALTYPE* partialsPost = gPartials[postBufferIndices[n]];
+        const TipState* statesPost = gTipStates[postBufferIndices[n]];
+        const REALTYPE* transMatrix = gTransitionMatrices[probabilityIndices[n]];
+        const REALTYPE* derivMatrix = gTransitionMatrices[derivativeMatrixIndices[n]];
+        const REALTYPE* wt = gCategoryWeights[categoryWeightsIndices[n]];
+
+        std::fill(siteLikelihoods.begin(), siteLikelihoods.end(), 0.0);
+        std::fill(siteDerivatives.begin(), siteDerivatives.end(), 0.0);
+
+        // the scale factors of both buffers are common to numerator and denominator, so they cancel
+        for (int l = 0; l < kCategoryCount; l++) {
+            const REALTYPE weight = wt[l];
+            for (int k = 0; k < kPatternCount; k++) {
+                const int v = l * kPaddedPatternCount * kPartialsPaddedStateCount + k * kPartialsPaddedStateCount;
+                int w = l * kMatrixSize;
+                double sumOverI = 0.0;
+                double sumOverID1 = 0.0;
+                for (int i = 0; i < kStateCount; i++) {
+                    double sumOverJ;
+                    double sumOverJD1;
+                    if (statesPost != NULL) {
+                        sumOverJ = transMatrix[w + statesPost[k]];
+                        sumOverJD1 = derivMatrix[w + statesPost[k]];
+                    } else {
+                        sumOverJ = 0.0;
+                        sumOverJD1 = 0.0;
+                        for (int j = 0; j < kStateCount; j++) {
+                            sumOverJ += transMatrix[w + j] * partialsPost[v + j];
+                            sumOverJD1 += derivMatrix[w + j] * partialsPost[v + j];
+                        }
+                    }
+                    sumOverI += partialsPre[v + i] * sumOverJ;
+                    sumOverID1 += partialsPre[v + i] * sumOverJD1;
+                    w += kTransPaddedStateCount;
+                }
+                siteLikelihoods[k] += sumOverI * weight;
+                siteDerivatives[k] += sumOverID1 * weight;
+            }
+        }
+
+        double sumDerivative = 0.0;
+        for (int k = 0; k < kPatternCount; k++) {
+            const double derivative = siteDerivatives[k] / siteLikelihoods[k];
+            if (outDerivatives != NULL)
+                outDerivatives[n * kPatternCount + k] = derivative;
+            sumDerivative += derivative * gPatternWeights[k];
+        }
+        outSumDerivatives[n] = sumDerivative;
+
+        if (sumDerivative != sumDerivative)
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
+    }
+
+    return returnCode;
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrix(int matrixIndex,
                                        const double* inMatrix,
                                        double paddedValue) {
+    finishAsynchUpdates();
 
 if (T_PAD != 0) {
     const double* offsetInMatrix = inMatrix;
@@ -872,6 +1545,20 @@ if (T_PAD != 0) {
     beagleMemCpy(gTransitionMatrices[matrixIndex], inMatrix,
                  kMatrixSize * kCategoryCount);
 }
+    invalidateTransitionMatrix(matrixIndex);
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrixNative(int matrixIndex,
+                                                                 const void* inMatrix) {
+    finishAsynchUpdates();
+    if (matrixIndex < 0 || matrixIndex >= kMatrixCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    memcpy(gTransitionMatrices[matrixIndex], inMatrix, sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
+
+    invalidateTransitionMatrix(matrixIndex);
     return BEAGLE_SUCCESS;
 }
     
@@ -880,6 +1567,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrices(const int* matrixIn
                                                              const double* inMatrices,
                                                              const double* paddedValues,
                                                              int count) {
+    finishAsynchUpdates();
     for (int k = 0; k < count; k++) {
         const double* inMatrix = inMatrices + k*kStateCount*kStateCount*kCategoryCount;
         int matrixIndex = matrixIndices[k];
@@ -899,6 +1587,7 @@ if (T_PAD != 0) {
         beagleMemCpy(gTransitionMatrices[matrixIndex], inMatrix,
                      kMatrixSize * kCategoryCount);
 }
+        invalidateTransitionMatrix(matrixIndex);
     }
     
     return BEAGLE_SUCCESS;
@@ -908,13 +1597,12 @@ if (T_PAD != 0) {
 //---TODO: Epoch model---//
 ///////////////////////////
 
-//TODO: move to EigenDecompositionSquare
-
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* firstIndices,
         const int* secondIndices,
         const int* resultIndices,
         int matrixCount) {
+    finishAsynchUpdates();
 
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t Entering BeagleCPUImpl::convolveTransitionMatrices \n");
@@ -922,9 +1610,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* fir
 
     int returnCode = BEAGLE_SUCCESS;
 
-    for (int u = 0; u < matrixCount; u++) {
-
-        if(firstIndices[u] == resultIndices[u] || secondIndices[u] == resultIndices[u]) {
+    // the pairs before an in-place one are still convolved
+    int count = 0;
+    while (count < matrixCount) {
+        if (firstIndices[count] == resultIndices[count] || secondIndices[count] == resultIndices[count]) {
 
 #ifdef BEAGLE_DEBUG_FLOW
             fprintf(stderr, "In-place convolution is not allowed \n");
@@ -934,77 +1623,63 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* fir
             break;
 
         }//END: overwrite check
+        count++;
+    }
 
-        REALTYPE* C = gTransitionMatrices[resultIndices[u]];
-        REALTYPE* A = gTransitionMatrices[firstIndices[u]];
-        REALTYPE* B = gTransitionMatrices[secondIndices[u]];
-
-        int n = 0;
-        for (int l = 0; l < kCategoryCount; l++) {
+    for (int u = 0; u < count; u++)
+        invalidateTransitionMatrix(resultIndices[u]);
 
-            for (int i = 0; i < kStateCount; i++) {
-                for (int j = 0; j < kStateCount; j++) {
+    auto convolvePair = [&] (int u) {
+        const REALTYPE* A = gTransitionMatrices[firstIndices[u]];
+        const REALTYPE* B = gTransitionMatrices[secondIndices[u]];
+        REALTYPE* C = gTransitionMatrices[resultIndices[u]];
+        switch (kStateCount) {
+            case 4:  convolveTransitionMatrixPair<4>(A, B, C);  break;
+            case 20: convolveTransitionMatrixPair<20>(A, B, C); break;
+            case 61: convolveTransitionMatrixPair<61>(A, B, C); break;
+            default: convolveTransitionMatrixPair<0>(A, B, C);  break;
+        }
+    };
+
+    // pairs may only run concurrently when none writes a matrix another pair reads or writes
+    int chunkSize = count;
+    if (kTraversalThreadingEnabled && count > 1) {
+        const long pairWork = (long) kCategoryCount * kStateCount * kStateCount * kStateCount;
+        const int minChunkSize = (int) ((BEAGLE_CPU_ASYNC_MIN_MATRIX_WORK + pairWork - 1) / pairWork);
+        chunkSize = (count + kNumThreads - 1) / kNumThreads;
+        if (chunkSize < minChunkSize)
+            chunkSize = minChunkSize;
+
+        if (chunkSize < count) {
+            std::vector<int> written(resultIndices, resultIndices + count);
+            std::sort(written.begin(), written.end());
+            bool independent = (std::adjacent_find(written.begin(), written.end()) == written.end());
+            for (int u = 0; u < count && independent; u++) {
+                independent = !std::binary_search(written.begin(), written.end(), firstIndices[u]) &&
+                              !std::binary_search(written.begin(), written.end(), secondIndices[u]);
+            }
+            if (!independent)
+                chunkSize = count;
+        }
+    }
 
-                    REALTYPE sum = 0.0;
-                    for (int k = 0; k < kStateCount; k++) {
-                        sum += A[k + kTransPaddedStateCount * i] * B[j + kTransPaddedStateCount * k];
-                    }
-//                  printf("%.30f %.30f %d: \n", C[n], sum, l);
-                    C[n] = sum;
-                    n++;
-
-                }//END: j loop
-
-                if (T_PAD != 0) {
-
-                    //                      A[n] = 1.0;
-                    //                      B[n] = 1.0;
-                    C[n] = 1.0;
-
-                    n += T_PAD;
-
-                }//END: padding check
-
-            }//END: i loop
-
-            A += kStateCount * kTransPaddedStateCount;
-            B += kStateCount * kTransPaddedStateCount;
-
-
-            ///////////////
-            //      printf("rate category: %d \n", l);
-            //
-            //      printf("A:");
-            //      for (int i = 0; i < kStateCount; i++) {
-            //          printf("| ");
-            //          for (int j = 0; j < kStateCount; j++)
-            //          printf("%f ", A[j + i * kTransPaddedStateCount]);
-            //          printf("|\n");
-            //      }
-            //      printf("\n");
-            //
-            //      printf("A:");
-            //      for (int i = 0; i < kStateCount; i++) {
-            //          printf("| ");
-            //          for (int j = 0; j < kStateCount; j++)
-            //          printf("%f ", B[j + i * kTransPaddedStateCount]);
-            //          printf("|\n");
-            //      }
-            //      printf("\n");
-            //
-//                      printf("C: \n");
-//                      for (int i = 0; i < kStateCount; i++) {
-//                          printf("| ");
-//                          for (int j = 0; j < kTransPaddedStateCount; j++)
-//                          printf("%.20f ", C[j + i * kTransPaddedStateCount]);
-//                          printf("|\n");
-//                      }
-//                      printf("\n");
-            ////////////////
-
-        }//END: rates loop
-
-    }//END: u loop
+    if (chunkSize >= count) {
+        for (int u = 0; u < count; u++)
+            convolvePair(u);
+    } else {
+        const int chunkCount = (count + chunkSize - 1) / chunkSize;
+        for (int start = 0; start < chunkCount; start += kThreadWorkCapacity) {
+            const int batchSize = (chunkCount - start < kThreadWorkCapacity ? chunkCount - start : kThreadWorkCapacity);
+            for (int i = 0; i < batchSize; i++)
+                gThreadWorkCosts[i] = 1;
+            dispatchThreadWork(batchSize, false, [&] (int i) {
+                const int first = (start + i) * chunkSize;
+                const int last = (first + chunkSize < count ? first + chunkSize : count);
+                for (int u = first; u < last; u++)
+                    convolvePair(u);
+            });
+        }
+    }
 
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t Leaving BeagleCPUImpl::convolveTransitionMatrices \n");
@@ -1013,6 +1688,40 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* fir
     return returnCode;
 }//END: convolveTransitionMatrices
 
+BEAGLE_CPU_TEMPLATE template <int STATE_COUNT>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrixPair(const REALTYPE* A,
+                                                                     const REALTYPE* B,
+                                                                     REALTYPE* C) {
+    // A STATE_COUNT of 0 means kStateCount. Each row of C gathers scaled rows of B in k order,
+    // so its inner loop runs over contiguous entries and the sums match the i-j-k order.
+    const int stateCount = (STATE_COUNT > 0 ? STATE_COUNT : kStateCount);
+    const int rowSize = kTransPaddedStateCount;
+    const int categorySize = stateCount * rowSize;
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int i = 0; i < stateCount; i++) {
+            const REALTYPE* a = A + i * rowSize;
+            REALTYPE* __restrict c = C + i * rowSize;
+
+            for (int j = 0; j < stateCount; j++)
+                c[j] = 0.0;
+            for (int k = 0; k < stateCount; k++) {
+                const REALTYPE aik = a[k];
+                const REALTYPE* __restrict b = B + k * rowSize;
+                for (int j = 0; j < stateCount; j++)
+                    c[j] += aik * b[j];
+            }
+
+            if (T_PAD != 0)
+                c[stateCount] = 1.0;
+        }
+
+        A += categorySize;
+        B += categorySize;
+        C += categorySize;
+    }
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
@@ -1021,12 +1730,28 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
                                             const int* secondDerivativeIndices,
                                             const double* edgeLengths,
                                             int count) {
+    finishAsynchUpdates();
     // for (int i = 0; i < count; i++) {
     //     printf("uTM %d %d %f %d\n", eigenIndex, probabilityIndices[i], edgeLengths[i], 0);
     // }
 
-    gEigenDecomposition->updateTransitionMatrices(eigenIndex,probabilityIndices,firstDerivativeIndices,secondDerivativeIndices,
-                                                  edgeLengths,gCategoryRates[0],gTransitionMatrices,count);
+    if (kMatrixCacheSize > 0 && firstDerivativeIndices == NULL && secondDerivativeIndices == NULL) {
+        updateTransitionMatricesCached(eigenIndex, 0, probabilityIndices, edgeLengths, count);
+        return BEAGLE_SUCCESS;
+    }
+
+    MatrixUpdateRun run = {eigenIndex, 0, 0, count};
+    gMatrixUpdateRuns.assign(1, run);
+    updateTransitionMatrixRuns(probabilityIndices, firstDerivativeIndices, secondDerivativeIndices, edgeLengths);
+    if (kMatrixCacheSize > 0 || kIncrementalEnabled) {
+        for (int i = 0; i < count; i++) {
+            invalidateTransitionMatrix(probabilityIndices[i]);
+            if (firstDerivativeIndices != NULL)
+                invalidateTransitionMatrix(firstDerivativeIndices[i]);
+            if (secondDerivativeIndices != NULL)
+                invalidateTransitionMatrix(secondDerivativeIndices[i]);
+        }
+    }
     return BEAGLE_SUCCESS;
 }
 
@@ -1038,41 +1763,491 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatricesWithMultipleModel
                                                                                   const int* secondDerivativeIndices,
                                                                                   const double* edgeLengths,
                                                                                   int count) {
+    finishAsynchUpdates();
+
+    if (count <= 0)
+        return BEAGLE_SUCCESS;
+
+    const int* firstDerivs = firstDerivativeIndices;
+    const int* secondDerivs = (firstDerivs != NULL ? secondDerivativeIndices : NULL);
+
+    // Edges sharing a model are computed by one call, which reads each slab of gCMatrices
+    // once per run of edges rather than once per edge. A matrix written twice must end
+    // with its last value, so then the edges keep their order and only neighbours group.
+    gMatrixUpdateIndices.assign(probabilityIndices, probabilityIndices + count);
+    if (firstDerivs != NULL)
+        gMatrixUpdateIndices.insert(gMatrixUpdateIndices.end(), firstDerivs, firstDerivs + count);
+    if (secondDerivs != NULL)
+        gMatrixUpdateIndices.insert(gMatrixUpdateIndices.end(), secondDerivs, secondDerivs + count);
+    std::sort(gMatrixUpdateIndices.begin(), gMatrixUpdateIndices.end());
+    bool distinctMatrices = (std::adjacent_find(gMatrixUpdateIndices.begin(),
+                                                gMatrixUpdateIndices.end()) == gMatrixUpdateIndices.end());
+
+    gMatrixUpdateOrder.resize(count);
+    for (int i = 0; i < count; i++)
+        gMatrixUpdateOrder[i] = i;
+    if (distinctMatrices) {
+        std::stable_sort(gMatrixUpdateOrder.begin(), gMatrixUpdateOrder.end(), [&] (int a, int b) {
+            if (eigenIndices[a] != eigenIndices[b])
+                return eigenIndices[a] < eigenIndices[b];
+            return categoryRateIndices[a] < categoryRateIndices[b];
+        });
+    }
 
-    // TODO: move loop to within gEigenDecomposition
+    gMatrixUpdateIndices.resize(3 * count);
+    gMatrixUpdateLengths.resize(count);
+    int* probabilities = &gMatrixUpdateIndices[0];
+    int* firsts = probabilities + count;
+    int* seconds = firsts + count;
+    gMatrixUpdateRuns.clear();
+    for (int k = 0; k < count; k++) {
+        const int i = gMatrixUpdateOrder[k];
+        probabilities[k] = probabilityIndices[i];
+        firsts[k] = (firstDerivs != NULL ? firstDerivs[i] : BEAGLE_OP_NONE);
+        seconds[k] = (secondDerivs != NULL ? secondDerivs[i] : BEAGLE_OP_NONE);
+        gMatrixUpdateLengths[k] = edgeLengths[i];
+
+        if (gMatrixUpdateRuns.empty() ||
+            gMatrixUpdateRuns.back().eigenIndex != eigenIndices[i] ||
+            gMatrixUpdateRuns.back().categoryRatesIndex != categoryRateIndices[i]) {
+            MatrixUpdateRun run = {eigenIndices[i], categoryRateIndices[i], k, 0};
+            gMatrixUpdateRuns.push_back(run);
+        }
+        gMatrixUpdateRuns.back().count++;
+    }
 
-    for (int i = 0; i < count; i++) {
-        // printf("uTMWMM %d %d %f %d\n", eigenIndices[i], probabilityIndices[i], edgeLengths[i], categoryRateIndices[i]);
-
-        const int* firstDeriv  = NULL;
-        const int* secondDeriv = NULL;
-        if (firstDerivativeIndices != NULL && secondDerivativeIndices == NULL) {
-            firstDeriv = &firstDerivativeIndices[i];
-        } else if (firstDerivativeIndices != NULL && secondDerivativeIndices != NULL) {
-            firstDeriv  = &firstDerivativeIndices[i];
-            secondDeriv = &secondDerivativeIndices[i];
-        }
-
-        gEigenDecomposition->updateTransitionMatrices(eigenIndices[i],
-                                                      &probabilityIndices[i],
-                                                      firstDeriv,
-                                                      secondDeriv,
-                                                      &edgeLengths[i],
-                                                      gCategoryRates[categoryRateIndices[i]],
+    if (kMatrixCacheSize > 0 && firstDerivs == NULL) {
+        for (size_t r = 0; r < gMatrixUpdateRuns.size(); r++) {
+            const MatrixUpdateRun& run = gMatrixUpdateRuns[r];
+            updateTransitionMatricesCached(run.eigenIndex, run.categoryRatesIndex,
+                                           probabilities + run.offset,
+                                           &gMatrixUpdateLengths[run.offset], run.count);
+        }
+        return BEAGLE_SUCCESS;
+    }
+
+    if (kMatrixCacheSize > 0 || kIncrementalEnabled) {
+        for (int k = 0; k < count; k++) {
+            invalidateTransitionMatrix(probabilities[k]);
+            if (firstDerivs != NULL)
+                invalidateTransitionMatrix(firsts[k]);
+            if (secondDerivs != NULL)
+                invalidateTransitionMatrix(seconds[k]);
+        }
+    }
+
+    updateTransitionMatrixRuns(probabilities,
+                               (firstDerivs != NULL ? firsts : NULL),
+                               (secondDerivs != NULL ? seconds : NULL),
+                               &gMatrixUpdateLengths[0]);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatrixRuns(const int* probabilityIndices,
+                                                                   const int* firstDerivativeIndices,
+                                                                   const int* secondDerivativeIndices,
+                                                                   const double* edgeLengths) {
+    auto updateRun = [&] (const MatrixUpdateRun& run) {
+        gEigenDecomposition->updateTransitionMatrices(run.eigenIndex,
+                                                      probabilityIndices + run.offset,
+                                                      (firstDerivativeIndices != NULL ?
+                                                       firstDerivativeIndices + run.offset : NULL),
+                                                      (secondDerivativeIndices != NULL ?
+                                                       secondDerivativeIndices + run.offset : NULL),
+                                                      edgeLengths + run.offset,
+                                                      gCategoryRates[run.categoryRatesIndex],
                                                       gTransitionMatrices,
-                                                      1);
+                                                      run.count);
+    };
+
+    int edgeCount = 0;
+    for (size_t r = 0; r < gMatrixUpdateRuns.size(); r++)
+        edgeCount += gMatrixUpdateRuns[r].count;
+
+    // each thread's share of the edges, in whole edges but never too small to pay for its dispatch
+    int chunkSize = edgeCount;
+    if (kTraversalThreadingEnabled) {
+        const long matrixWork = (long) kCategoryCount * kStateCount * kStateCount * kStateCount;
+        const int minChunkSize = (int) ((BEAGLE_CPU_ASYNC_MIN_MATRIX_WORK + matrixWork - 1) / matrixWork);
+        chunkSize = (edgeCount + kNumThreads - 1) / kNumThreads;
+        if (chunkSize < minChunkSize)
+            chunkSize = minChunkSize;
+    }
+
+    if (chunkSize < edgeCount) {
+        // chunks are independent only when no matrix is written twice
+        std::vector<int> written;
+        for (size_t r = 0; r < gMatrixUpdateRuns.size(); r++) {
+            const MatrixUpdateRun& run = gMatrixUpdateRuns[r];
+            written.insert(written.end(), probabilityIndices + run.offset,
+                           probabilityIndices + run.offset + run.count);
+            if (firstDerivativeIndices != NULL)
+                written.insert(written.end(), firstDerivativeIndices + run.offset,
+                               firstDerivativeIndices + run.offset + run.count);
+            if (secondDerivativeIndices != NULL)
+                written.insert(written.end(), secondDerivativeIndices + run.offset,
+                               secondDerivativeIndices + run.offset + run.count);
+        }
+        std::sort(written.begin(), written.end());
+        if (std::adjacent_find(written.begin(), written.end()) != written.end())
+            chunkSize = edgeCount;
+    }
+
+    if (chunkSize >= edgeCount) {
+        for (size_t r = 0; r < gMatrixUpdateRuns.size(); r++)
+            updateRun(gMatrixUpdateRuns[r]);
+        return;
+    }
+
+    // the eigen decomposition keeps no scratch between calls, so the chunks may run concurrently
+    std::vector<MatrixUpdateRun> chunks;
+    for (size_t r = 0; r < gMatrixUpdateRuns.size(); r++) {
+        const MatrixUpdateRun& run = gMatrixUpdateRuns[r];
+        for (int offset = 0; offset < run.count; offset += chunkSize) {
+            MatrixUpdateRun chunk = run;
+            chunk.offset = run.offset + offset;
+            chunk.count = (run.count - offset < chunkSize ? run.count - offset : chunkSize);
+            chunks.push_back(chunk);
+        }
+    }
+
+    const int chunkCount = (int) chunks.size();
+    for (int start = 0; start < chunkCount; start += kThreadWorkCapacity) {
+        const int batchSize = (chunkCount - start < kThreadWorkCapacity ? chunkCount - start : kThreadWorkCapacity);
+        for (int i = 0; i < batchSize; i++)
+            gThreadWorkCosts[i] = chunks[start + i].count;
+        dispatchThreadWork(batchSize, false, [&] (int i) {
+            updateRun(chunks[start + i]);
+        });
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrixCacheSize(int cacheSize) {
+    finishAsynchUpdates();
+    if (cacheSize < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    clearTransitionMatrixCache();
+    kMatrixCacheSize = cacheSize;
+    gMatrixKeys.resize(kMatrixCount);
+    gMatrixKeyValid.assign(kMatrixCount, false);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatricesCached(int eigenIndex,
+                                                                      int categoryRatesIndex,
+                                                                      const int* probabilityIndices,
+                                                                      const double* edgeLengths,
+                                                                      int count) {
+    const size_t matrixBytes = sizeof(REALTYPE) * kMatrixSize * kCategoryCount;
+
+    MatrixCacheKey key;
+    key.eigenIndex = eigenIndex;
+    key.eigenVersion = gEigenVersions[eigenIndex];
+    key.categoryRatesIndex = categoryRatesIndex;
+    key.categoryRatesVersion = gCategoryRatesVersions[categoryRatesIndex];
+
+    gMatrixCacheMissIndices.clear();
+    gMatrixCacheMissLengths.clear();
+
+    for (int i = 0; i < count; i++) {
+        const int matrixIndex = probabilityIndices[i];
+        key.edgeLength = edgeLengths[i];
+
+        if (edgeLengths[i] != edgeLengths[i]) { // NaN has no place in the ordering
+            invalidateTransitionMatrix(matrixIndex);
+            gMatrixCacheMissIndices.push_back(matrixIndex);
+            gMatrixCacheMissLengths.push_back(edgeLengths[i]);
+            continue;
+        }
+
+        if (gMatrixKeyValid[matrixIndex] &&
+            !(gMatrixKeys[matrixIndex] < key) && !(key < gMatrixKeys[matrixIndex]))
+            continue; // the buffer already holds this matrix
+
+        // a copy must not land before a computation this call still owes the same buffer
+        bool pending = (std::find(gMatrixCacheMissIndices.begin(), gMatrixCacheMissIndices.end(),
+                                  matrixIndex) != gMatrixCacheMissIndices.end());
+
+        typename std::map<MatrixCacheKey, typename MatrixCacheList::iterator>::iterator found =
+            gMatrixCacheIndex.find(key);
+        if (found != gMatrixCacheIndex.end() && !pending) {
+            gMatrixCache.splice(gMatrixCache.begin(), gMatrixCache, found->second);
+            memcpy(gTransitionMatrices[matrixIndex], found->second->second, matrixBytes);
+        } else {
+            gMatrixCacheMissIndices.push_back(matrixIndex);
+            gMatrixCacheMissLengths.push_back(edgeLengths[i]);
+        }
+        gMatrixKeys[matrixIndex] = key;
+        gMatrixKeyValid[matrixIndex] = true;
+        if (kIncrementalEnabled)
+            gMatrixVersions[matrixIndex]++;
     }
 
+    const int missCount = (int) gMatrixCacheMissIndices.size();
+    if (missCount == 0)
+        return;
+
+    gEigenDecomposition->updateTransitionMatrices(eigenIndex, &gMatrixCacheMissIndices[0], NULL, NULL,
+                                                  &gMatrixCacheMissLengths[0],
+                                                  gCategoryRates[categoryRatesIndex],
+                                                  gTransitionMatrices, missCount);
+
+    for (int i = 0; i < missCount; i++) {
+        const int matrixIndex = gMatrixCacheMissIndices[i];
+        if (!gMatrixKeyValid[matrixIndex] || gMatrixCacheIndex.count(gMatrixKeys[matrixIndex]))
+            continue;
+
+        REALTYPE* cached;
+        if ((int) gMatrixCache.size() < kMatrixCacheSize) {
+            cached = (REALTYPE*) mallocAligned(matrixBytes);
+            if (cached == NULL)
+                return; // the matrices are computed, they just will not be cached
+        } else { // reuse the least recently used entry
+            cached = gMatrixCache.back().second;
+            gMatrixCacheIndex.erase(gMatrixCache.back().first);
+            gMatrixCache.pop_back();
+        }
+        memcpy(cached, gTransitionMatrices[matrixIndex], matrixBytes);
+        gMatrixCache.push_front(std::make_pair(gMatrixKeys[matrixIndex], cached));
+        gMatrixCacheIndex[gMatrixKeys[matrixIndex]] = gMatrixCache.begin();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::clearTransitionMatrixCache() {
+    for (typename MatrixCacheList::iterator it = gMatrixCache.begin(); it != gMatrixCache.end(); ++it)
+        free(it->second);
+    gMatrixCache.clear();
+    gMatrixCacheIndex.clear();
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::invalidateTransitionMatrix(int matrixIndex) {
+    if (kMatrixCacheSize > 0)
+        gMatrixKeyValid[matrixIndex] = false;
+    if (kIncrementalEnabled)
+        gMatrixVersions[matrixIndex]++;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setIncrementalUpdates(int enabled) {
+    finishAsynchUpdates();
+    kIncrementalEnabled = (enabled != 0);
+    gPartialsVersions.assign(kIncrementalEnabled ? kBufferCount : 0, 0);
+    gMatrixVersions.assign(kIncrementalEnabled ? kMatrixCount : 0, 0);
+    gScaleBufferVersions.assign(kIncrementalEnabled ? kScaleBufferCount : 0, 0);
+    PartialsSource unknown;
+    memset(&unknown, 0, sizeof(PartialsSource));
+    unknown.valid = false;
+    gPartialsSources.assign(kIncrementalEnabled ? kBufferCount : 0, unknown);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setExponentScaling(int enabled) {
+    finishAsynchUpdates();
+    kExponentScaling = (enabled != 0);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setAdaptiveRescaling(int enabled) {
+    finishAsynchUpdates();
+    // dynamic scaling rescales when partials leave its own thresholds
+    kAdaptiveRescaling = (enabled != 0) && !(kFlags & BEAGLE_FLAG_SCALING_DYNAMIC);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setSiteRepeats(int enabled) {
+    finishAsynchUpdates();
+    kSiteRepeatsEnabled = (enabled != 0);
+    SiteRepeats unknown;
+    unknown.valid = false;
+    unknown.classCount = 0;
+    unknown.version = 0;
+    unknown.child1Index = unknown.child2Index = -1;
+    unknown.child1Version = unknown.child2Version = 0;
+    gSiteRepeats.assign(kSiteRepeatsEnabled ? kBufferCount : 0, unknown);
+    gSiteRepeatWriters.assign(kSiteRepeatsEnabled ? kBufferCount : 0, -1);
+    gSiteRepeatWriteCounts.assign(kSiteRepeatsEnabled ? kBufferCount : 0, 0);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getScalingStatistics(BeagleScalingStatistics* outStatistics) {
+    finishAsynchUpdates();
+    std::lock_guard<std::mutex> lock(gScalingStatisticsMutex);
+    *outStatistics = gScalingStatistics;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScalingStatistics() {
+    finishAsynchUpdates();
+    std::lock_guard<std::mutex> lock(gScalingStatisticsMutex);
+    gScalingStatistics = BeagleScalingStatistics();
+
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::invalidatePartials(int bufferIndex) {
+    if (kIncrementalEnabled) {
+        gPartialsVersions[bufferIndex]++;
+        gPartialsSources[bufferIndex].valid = false;
+    }
+    if (kSiteRepeatsEnabled)
+        gSiteRepeats[bufferIndex].valid = false;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::invalidateScaleBuffer(int scaleIndex) {
+    if (kIncrementalEnabled && scaleIndex >= 0 && scaleIndex < kScaleBufferCount)
+        gScaleBufferVersions[scaleIndex]++;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeCurrentOperations(const int* operations,
+                                                               int count,
+                                                               int cumulativeScaleIndex) {
+    const int numOps = BEAGLE_OP_COUNT;
+
+    // dynamic and always-scaling also edit scale buffers the operation does not name
+    const bool skippable = !(kFlags & (BEAGLE_FLAG_SCALING_DYNAMIC | BEAGLE_FLAG_SCALING_ALWAYS));
+    const bool manualScaling = !(kFlags & BEAGLE_FLAG_SCALING_AUTO);
+
+    gIncrementalOperations.clear();
+
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        const int parIndex = o[0];
+        const int child1Index = o[3];
+        const int child2Index = o[5];
+        const int matrix1Index = o[4];
+        const int matrix2Index = o[6];
+
+        // the same choice of scale buffers as upPartials makes
+        const int writeScaleIndex = (manualScaling && o[1] >= 0 ? o[1] : BEAGLE_OP_NONE);
+        const int readScaleIndex = (manualScaling && o[1] < 0 && o[2] >= 0 ? o[2] : BEAGLE_OP_NONE);
+
+        PartialsSource& source = gPartialsSources[parIndex];
+
+        bool current = skippable && source.valid &&
+            source.child1Index == child1Index &&
+            source.child1Version == gPartialsVersions[child1Index] &&
+            source.matrix1Index == matrix1Index &&
+            source.matrix1Version == gMatrixVersions[matrix1Index] &&
+            source.child2Index == child2Index &&
+            source.child2Version == gPartialsVersions[child2Index] &&
+            source.matrix2Index == matrix2Index &&
+            source.matrix2Version == gMatrixVersions[matrix2Index] &&
+            source.readScaleIndex == readScaleIndex &&
+            (readScaleIndex == BEAGLE_OP_NONE ||
+             source.readScaleVersion == gScaleBufferVersions[readScaleIndex]) &&
+            source.writeScaleIndex == writeScaleIndex &&
+            (writeScaleIndex == BEAGLE_OP_NONE ||
+             (source.writeScaleVersion == gScaleBufferVersions[writeScaleIndex] &&
+              cumulativeScaleIndex == BEAGLE_OP_NONE));
+
+        if (current)
+            continue;
+
+        gIncrementalOperations.insert(gIncrementalOperations.end(), o, o + numOps);
+
+        invalidateScaleBuffer(writeScaleIndex);
+        if (writeScaleIndex != BEAGLE_OP_NONE)
+            invalidateScaleBuffer(cumulativeScaleIndex);
+        gPartialsVersions[parIndex]++;
+
+        source.valid = true;
+        source.child1Index = child1Index;
+        source.child1Version = gPartialsVersions[child1Index];
+        source.matrix1Index = matrix1Index;
+        source.matrix1Version = gMatrixVersions[matrix1Index];
+        source.child2Index = child2Index;
+        source.child2Version = gPartialsVersions[child2Index];
+        source.matrix2Index = matrix2Index;
+        source.matrix2Version = gMatrixVersions[matrix2Index];
+        source.readScaleIndex = readScaleIndex;
+        source.readScaleVersion = (readScaleIndex != BEAGLE_OP_NONE ?
+                                   gScaleBufferVersions[readScaleIndex] : 0);
+        source.writeScaleIndex = writeScaleIndex;
+        source.writeScaleVersion = (writeScaleIndex != BEAGLE_OP_NONE ?
+                                    gScaleBufferVersions[writeScaleIndex] : 0);
+    }
+
+    return (int) gIncrementalOperations.size() / numOps;
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                                                       int count,
                                                       int cumulativeScaleIndex) {
 
-    int returnCode = BEAGLE_ERROR_GENERAL;
+    if (kAsynchEnabled) {
+        // a checkpoint moves destination buffers, which allocation on this thread would race
+        if (!kCheckpointActive)
+            return queueAsynchUpdate(operations, count, cumulativeScaleIndex);
+        finishAsynchUpdates();
+    }
+
+    int returnCode = allocateDestinationPartials(operations, count, BEAGLE_OP_COUNT);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    return upPartialsAllocated(operations, count, cumulativeScaleIndex);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsAllocated(const int* operations,
+                                                           int count,
+                                                           int cumulativeScaleIndex) {
+
+    int returnCode = BEAGLE_SUCCESS;
+
+    updateConstantPatterns();
+
+    if (kIncrementalEnabled) {
+        count = removeCurrentOperations(operations, count, cumulativeScaleIndex);
+        if (count == 0)
+            return BEAGLE_SUCCESS;
+        operations = &gIncrementalOperations[0];
+    }
+
+    if (kCheckpointActive) {
+        returnCode = preserveDestinations(operations, count, BEAGLE_OP_COUNT, cumulativeScaleIndex);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+
+    if (kSiteRepeatsEnabled)
+        updateSiteRepeats(operations, count, BEAGLE_OP_COUNT);
+
+    if (kArenaFile >= 0)
+        return upPartialsBackedWindows(operations, count, cumulativeScaleIndex);
+
+    return upPartialsDispatched(operations, count, cumulativeScaleIndex);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsDispatched(const int* operations,
+                                                            int count,
+                                                            int cumulativeScaleIndex) {
+
+    int returnCode = BEAGLE_SUCCESS;
 
     if (kAutoPartitioningEnabled) {
         autoPartitionPartialsOperations(operations,
@@ -1082,23 +2257,103 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
         count *= kPartitionCount;
         returnCode = upPartialsByPartitionAsync((const int*) gAutoPartitionOperations,
                                                 count); 
+    } else if (kTraversalThreadingEnabled && count > 1) {
+        returnCode = upPartialsByDependencyAsync(operations,
+                                                 count,
+                                                 cumulativeScaleIndex);
+    } else if (kPatternBlockSize < kPatternCount || kOpenMPThreadCount > 1) {
+        returnCode = upPartialsByPatternBlock(operations,
+                                              count,
+                                              cumulativeScaleIndex);
     } else {
         bool byPartition = false;
         returnCode = upPartials(byPartition,
                                 operations,
                                 count,
-                                cumulativeScaleIndex);
+                                cumulativeScaleIndex,
+                                0, kPatternCount);
     }
 
     return returnCode;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsBackedWindows(const int* operations,
+                                                               int count,
+                                                               int cumulativeScaleIndex) {
+    const int numOps = BEAGLE_OP_COUNT;
+    const int window = BEAGLE_CPU_BACKED_WINDOW_OP_COUNT;
+
+    // operations only read buffers written before them, so the windows run in order
+    for (int op = 0; op < count && op < window; op++) {
+        prefetchBackedPartials(operations[op * numOps + 3]);
+        prefetchBackedPartials(operations[op * numOps + 5]);
+    }
+
+    for (int first = 0; first < count; first += window) {
+        const int last = std::min(first + window, count);
+        const int next = std::min(last + window, count);
+
+        // the disk reads the next window's children while this window runs
+        for (int op = last; op < next; op++) {
+            prefetchBackedPartials(operations[op * numOps + 3]);
+            prefetchBackedPartials(operations[op * numOps + 5]);
+        }
+
+        int returnCode = upPartialsDispatched(operations + first * numOps,
+                                              last - first,
+                                              cumulativeScaleIndex);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+
+        // children the next window does not touch are written back and paged out first
+        for (int op = first; op < last; op++) {
+            for (int child = 3; child <= 5; child += 2) {
+                const int childIndex = operations[op * numOps + child];
+                bool used = false;
+                for (int nextOp = last; nextOp < next && !used; nextOp++) {
+                    const int* o = &operations[nextOp * numOps];
+                    used = (o[0] == childIndex || o[3] == childIndex || o[5] == childIndex);
+                }
+                if (!used)
+                    writeBackBackedPartials(childIndex);
+            }
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartialsByPartition(const int* operations,
                                                                  int count) {
+    finishAsynchUpdates();
+    updateConstantPatterns();
     
-    int returnCode = BEAGLE_ERROR_GENERAL;
+    int returnCode = allocateDestinationPartials(operations, count, BEAGLE_PARTITION_OP_COUNT);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    if (kIncrementalEnabled) {
+        // a partition's operation writes only part of its buffers, so nothing is skipped here
+        for (int op = 0; op < count; op++) {
+            const int* o = &operations[op * BEAGLE_PARTITION_OP_COUNT];
+            invalidatePartials(o[0]);
+            if (!(kFlags & BEAGLE_FLAG_SCALING_AUTO))
+                invalidateScaleBuffer(o[1]);
+            invalidateScaleBuffer(o[8]);
+        }
+    }
+
+    if (kCheckpointActive) {
+        returnCode = preserveDestinations(operations, count, BEAGLE_PARTITION_OP_COUNT, BEAGLE_OP_NONE);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+
+    if (kSiteRepeatsEnabled)
+        updateSiteRepeats(operations, count, BEAGLE_PARTITION_OP_COUNT);
 
     if (kThreadingEnabled) {
         returnCode = upPartialsByPartitionAsync(operations,
@@ -1108,7 +2363,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartialsByPartition(const int* oper
         returnCode = upPartials(byPartition,
                                 operations,
                                 count,
-                                BEAGLE_OP_NONE);
+                                BEAGLE_OP_NONE,
+                                0, kPatternCount);
     }
 
     return returnCode;
@@ -1140,51 +2396,406 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsByPartitionAsync(const int* ope
 
     int numOps = BEAGLE_PARTITION_OP_COUNT;
 
-    memset(gThreadOpCounts, 0, sizeof(int) * kNumThreads);
+    // Operations within a partition must run in the given order, but partitions are
+    // independent. Group the operations by partition and let idle threads claim whole
+    // partitions, largest first, so a single large partition does not stall the others.
+    memset(gPartitionOpCounts, 0, sizeof(int) * kPartitionCount);
 
     for (int i=0; i<count; i++) {
-        int t = operations[i * numOps + 7] % kNumThreads;
-        for (int j=0; j<numOps; j++) {
-            gThreadOperations[t][gThreadOpCounts[t]*numOps + j] = operations[i*numOps + j];
-        }
-        gThreadOpCounts[t]++;
+        gPartitionOpCounts[operations[i * numOps + 7]]++;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials, this,
-                      true,
-                      (const int*) gThreadOperations[i],
-                      gThreadOpCounts[i],
-                      BEAGLE_OP_NONE));
-
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
-
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
+    int offset = 0;
+    for (int p=0; p<kPartitionCount; p++) {
+        gPartitionOpOffsets[p] = offset;
+        offset += gPartitionOpCounts[p];
+        gThreadWorkCosts[p] = (long) gPartitionOpCounts[p] *
+            (gPatternPartitionsStartPatterns[p+1] - gPatternPartitionsStartPatterns[p]);
+        gThreadWorkPartitions[p] = p;
+    }
 
-        gThreads[i].cv.notify_one();
+    for (int i=0; i<count; i++) {
+        int p = operations[i * numOps + 7];
+        memcpy(&gPartitionOperations[gPartitionOpOffsets[p] * numOps], &operations[i * numOps],
+               sizeof(int) * numOps);
+        gPartitionOpOffsets[p]++;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
+    for (int p=0; p<kPartitionCount; p++) {
+        gPartitionOpOffsets[p] -= gPartitionOpCounts[p];
+    }
+
+    dispatchThreadWork(kPartitionCount, true, [this, numOps] (int p) {
+        if (gPartitionOpCounts[p] > 0) {
+            TraceRange trace("upPartialsByPartitionAsync", instanceNumber, gPartitionOpCounts[p], p);
+            upPartials(true,
+                       (const int*) &gPartitionOperations[gPartitionOpOffsets[p] * numOps],
+                       gPartitionOpCounts[p],
+                       BEAGLE_OP_NONE,
+                       0, kPatternCount);
+        }
+    });
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsByDependencyAsync(const int* operations,
+                                                                   int count,
+                                                                   int cumulativeScaleIndex) {
+
+    // Dynamic scaling edits the cumulative buffer while traversing and always-scaling
+    // accumulates into it from every operation; keep the serial order for both
+    if ((kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) ||
+        ((kFlags & BEAGLE_FLAG_SCALING_ALWAYS) && cumulativeScaleIndex != BEAGLE_OP_NONE)) {
+        return upPartials(false, operations, count, cumulativeScaleIndex, 0, kPatternCount);
+    }
+
+    int numOps = BEAGLE_OP_COUNT;
+
+    // Assign each operation to the earliest level at which everything it reads has been
+    // written and nothing it overwrites is still needed by an earlier operation. Partials
+    // buffers and scale buffers are tracked together, scale buffers after kBufferCount.
+    int resourceCount = kBufferCount + kScaleBufferCount;
+    gDependencyWriteLevels.assign(resourceCount, -1);
+    gDependencyReadLevels.assign(resourceCount, -1);
+    gOperationLevels.resize(count);
+
+    int levelCount = 0;
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        int reads[3] = {o[3], o[5], -1};
+        int writes[2] = {o[0], -1};
+        if (o[2] >= 0 && o[2] < kScaleBufferCount)
+            reads[2] = kBufferCount + o[2];
+        if (o[1] >= 0 && o[1] < kScaleBufferCount)
+            writes[1] = kBufferCount + o[1];
+
+        int level = 0;
+        for (int r = 0; r < 3; r++) {
+            if (reads[r] >= 0 && gDependencyWriteLevels[reads[r]] + 1 > level)
+                level = gDependencyWriteLevels[reads[r]] + 1;
+        }
+        for (int w = 0; w < 2; w++) {
+            if (writes[w] >= 0) {
+                if (gDependencyWriteLevels[writes[w]] + 1 > level)
+                    level = gDependencyWriteLevels[writes[w]] + 1;
+                if (gDependencyReadLevels[writes[w]] + 1 > level)
+                    level = gDependencyReadLevels[writes[w]] + 1;
+            }
+        }
+
+        for (int r = 0; r < 3; r++) {
+            if (reads[r] >= 0 && level > gDependencyReadLevels[reads[r]])
+                gDependencyReadLevels[reads[r]] = level;
+        }
+        for (int w = 0; w < 2; w++) {
+            if (writes[w] >= 0) {
+                gDependencyWriteLevels[writes[w]] = level;
+                gDependencyReadLevels[writes[w]] = -1;
+            }
+        }
+
+        gOperationLevels[op] = level;
+        if (level + 1 > levelCount)
+            levelCount = level + 1;
+    }
+
+    if (levelCount == count) {
+        // a chain of dependent operations, nothing to gain from the threads
+        return upPartials(false, operations, count, cumulativeScaleIndex, 0, kPatternCount);
+    }
+
+    gLevelOffsets.assign(levelCount + 1, 0);
+    for (int op = 0; op < count; op++) {
+        gLevelOffsets[gOperationLevels[op] + 1]++;
+    }
+    for (int l = 0; l < levelCount; l++) {
+        gLevelOffsets[l + 1] += gLevelOffsets[l];
+    }
+    gLevelOperations.resize(count);
+    for (int op = 0; op < count; op++) {
+        gLevelOperations[gLevelOffsets[gOperationLevels[op]]++] = op;
+    }
+    for (int l = levelCount; l > 0; l--) {
+        gLevelOffsets[l] = gLevelOffsets[l - 1];
+    }
+    gLevelOffsets[0] = 0;
+
+    for (int l = 0; l < levelCount; l++) {
+        const int* levelOperations = &gLevelOperations[gLevelOffsets[l]];
+        int levelSize = gLevelOffsets[l + 1] - gLevelOffsets[l];
+
+        if (levelSize == 1) {
+            upPartials(false, &operations[levelOperations[0] * numOps], 1, BEAGLE_OP_NONE, 0, kPatternCount);
+        } else {
+            for (int i = 0; i < levelSize; i++) {
+                const int* o = &operations[levelOperations[i] * numOps];
+                gThreadWorkCosts[i] = 1 + (gTipStates[o[3]] == NULL) + (gTipStates[o[5]] == NULL);
+            }
+
+            dispatchThreadWork(levelSize, false, [&] (int i) {
+                upPartials(false, &operations[levelOperations[i] * numOps], 1, BEAGLE_OP_NONE, 0, kPatternCount);
+            });
+        }
+    }
+
+    // The per-operation updates above left the cumulative buffer alone, add the new
+    // scale factors in operation order as the serial traversal would have
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE &&
+        !(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))) {
+        std::vector<int> scalingIndices;
+        for (int op = 0; op < count; op++) {
+            if (operations[op * numOps + 1] >= 0)
+                scalingIndices.push_back(operations[op * numOps + 1]);
+        }
+        if (!scalingIndices.empty())
+            accumulateScaleFactors(&scalingIndices[0], scalingIndices.size(), cumulativeScaleIndex);
     }
 
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateConstantPatterns() {
+    if (!kConstantPatternsStale)
+        return;
+    kConstantPatternsStale = false;
+    gConstantPatternSources.clear();
+
+    // partials set by the client need not repeat where the tips do
+    if (kPartialsFromClient)
+        return;
+    for (int i = 0; i < kTipCount; i++) {
+        if (gTipStates[i] == NULL || gTipStateSets[i] != NULL)
+            return;
+    }
+
+    std::vector<int> sources(kPatternCount, -1);
+    std::vector<int> lastPatternOfState(kStateCount, -1);
+    bool repeated = false;
+    for (int k = 0; k < kPatternCount; k++) {
+        const TipState state = gTipStates[0][k];
+        if (state >= kStateCount)
+            continue;
+        int i = 1;
+        while (i < kTipCount && gTipStates[i][k] == state)
+            i++;
+        if (i < kTipCount)
+            continue;
+        sources[k] = lastPatternOfState[state];
+        lastPatternOfState[state] = k;
+        repeated = repeated || (sources[k] >= 0);
+    }
+
+    if (repeated)
+        gConstantPatternSources.swap(sources);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateSiteRepeats(const int* operations,
+                                                          int count,
+                                                          int numOps) {
+    // the classes are built before any operation runs, so a destination written twice in the
+    // list, as the partitions of one node are, must be written from the same children each time
+    const int conflicting = -2;
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        int& writer = gSiteRepeatWriters[o[0]];
+        gSiteRepeatWriteCounts[o[0]]++;
+        if (writer == -1) {
+            writer = op;
+        } else if (writer >= 0) {
+            const int* w = &operations[writer * numOps];
+            if (w[3] != o[3] || w[5] != o[5])
+                writer = conflicting;
+        }
+    }
+    for (int op = 0; op < count; op++) {
+        const int destIndex = operations[op * numOps];
+        if (gSiteRepeatWriters[destIndex] == conflicting)
+            gSiteRepeats[destIndex].valid = false;
+    }
+
+    // an operation of a partition writes its patterns only, so a list leaving a partition of a
+    // destination out cannot give it new children
+    const bool byPartition = (numOps == BEAGLE_PARTITION_OP_COUNT);
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        if (gSiteRepeatWriters[o[0]] == op)
+            buildSiteRepeats(o[0], o[3], o[5],
+                             !byPartition || gSiteRepeatWriteCounts[o[0]] >= kPartitionCount);
+    }
+
+    for (int op = 0; op < count; op++) {
+        gSiteRepeatWriters[operations[op * numOps]] = -1;
+        gSiteRepeatWriteCounts[operations[op * numOps]] = 0;
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::buildTipSiteRepeats(int tipIndex) {
+    SiteRepeats& repeats = gSiteRepeats[tipIndex];
+    if (repeats.valid || gTipStates[tipIndex] == NULL || gTipStateSets[tipIndex] != NULL)
+        return;
+
+    // a tip's classes are its states, the missing state included
+    repeats.classes.assign(gTipStates[tipIndex], gTipStates[tipIndex] + kPatternCount);
+    repeats.classCount = kStateCount + 1;
+    repeats.valid = true;
+    repeats.version++;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::buildSiteRepeats(int destIndex,
+                                                         int child1Index,
+                                                         int child2Index,
+                                                         bool complete) {
+    if (child1Index < kTipCount)
+        buildTipSiteRepeats(child1Index);
+    if (child2Index < kTipCount)
+        buildTipSiteRepeats(child2Index);
+
+    const SiteRepeats& repeats1 = gSiteRepeats[child1Index];
+    const SiteRepeats& repeats2 = gSiteRepeats[child2Index];
+    SiteRepeats& repeats = gSiteRepeats[destIndex];
+    if (!repeats1.valid || !repeats2.valid) {
+        repeats.valid = false;
+        return;
+    }
+    if (repeats.valid && repeats.child1Index == child1Index && repeats.child2Index == child2Index &&
+        repeats.child1Version == repeats1.version && repeats.child2Version == repeats2.version)
+        return;
+    if (!complete) {
+        repeats.valid = false;
+        return;
+    }
+
+    // a class of the destination is a pair of classes of its children; the patterns are
+    // bucketed by their first class, and each bucket numbers the second classes it meets
+    const int* classes1 = &repeats1.classes[0];
+    const int* classes2 = &repeats2.classes[0];
+    gSiteRepeatStarts.assign(repeats1.classCount + 1, 0);
+    for (int k = 0; k < kPatternCount; k++)
+        gSiteRepeatStarts[classes1[k] + 1]++;
+    for (int c = 0; c < repeats1.classCount; c++)
+        gSiteRepeatStarts[c + 1] += gSiteRepeatStarts[c];
+    gSiteRepeatOrder.resize(kPatternCount);
+    for (int k = 0; k < kPatternCount; k++)
+        gSiteRepeatOrder[gSiteRepeatStarts[classes1[k]]++] = k;
+
+    repeats.classes.resize(kPatternCount);
+    gSiteRepeatPairs.assign(repeats2.classCount, -1);
+    int classCount = 0;
+    int begin = 0;
+    for (int c = 0; c < repeats1.classCount; c++) {
+        const int end = gSiteRepeatStarts[c];
+        for (int i = begin; i < end; i++) {
+            const int k = gSiteRepeatOrder[i];
+            int& pairClass = gSiteRepeatPairs[classes2[k]];
+            if (pairClass < 0)
+                pairClass = classCount++;
+            repeats.classes[k] = pairClass;
+        }
+        for (int i = begin; i < end; i++)
+            gSiteRepeatPairs[classes2[gSiteRepeatOrder[i]]] = -1;
+        begin = end;
+    }
+
+    repeats.classCount = classCount;
+    repeats.valid = true;
+    repeats.version++;
+    repeats.child1Index = child1Index;
+    repeats.child2Index = child2Index;
+    repeats.child1Version = repeats1.version;
+    repeats.child2Version = repeats2.version;
+}
+
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::findSiteRepeatSources(std::vector<int>& sources,
+                                                              std::vector<int>& firstOfClass,
+                                                              int destIndex,
+                                                              int startPattern,
+                                                              int endPattern) {
+    const SiteRepeats& repeats = gSiteRepeats[destIndex];
+    if (!repeats.valid || repeats.classCount == kPatternCount)
+        return false;
+
+    sources.resize(kPatternCount);
+    firstOfClass.assign(repeats.classCount, -1);
+    for (int k = startPattern; k < endPattern; k++) {
+        int& first = firstOfClass[repeats.classes[k]];
+        sources[k] = first;
+        if (first < 0)
+            first = k;
+    }
+    return true;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::findComputedPatternRuns(std::vector<int>& runs,
+                                                               const int* sources,
+                                                               int startPattern,
+                                                               int endPattern) {
+    runs.clear();
+    int copied = 0;
+    int runStart = startPattern;
+    for (int k = startPattern; k < endPattern; k++) {
+        // a source before the range may belong to another partition or thread
+        if (sources[k] >= startPattern) {
+            if (k > runStart) {
+                runs.push_back(runStart);
+                runs.push_back(k);
+            }
+            runStart = k + 1;
+            copied++;
+        }
+    }
+    if (endPattern > runStart) {
+        runs.push_back(runStart);
+        runs.push_back(endPattern);
+    }
+    return copied;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyRepeatedPatterns(REALTYPE* destP,
+                                                             const int* sources,
+                                                             int startPattern,
+                                                             int endPattern) {
+    // in pattern order, so that a source copied from another is already filled in
+    for (int l = 0; l < kCategoryCount; l++) {
+        REALTYPE* destOffset = destP + (size_t) l * kPaddedPatternCount * kPartialsPaddedStateCount;
+        for (int k = startPattern; k < endPattern; k++) {
+            const int source = sources[k];
+            if (source >= startPattern)
+                memcpy(destOffset + (size_t) k * kPartialsPaddedStateCount,
+                       destOffset + (size_t) source * kPartialsPaddedStateCount,
+                       sizeof(REALTYPE) * kPartialsPaddedStateCount);
+        }
+    }
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
                                                   const int* operations,
                                                   int count,
-                                                  int cumulativeScaleIndex) {
+                                                  int cumulativeScaleIndex,
+                                                  int rangeStartPattern,
+                                                  int rangeEndPattern) {
 
     REALTYPE* cumulativeScaleBuffer = NULL;
     if (cumulativeScaleIndex != BEAGLE_OP_NONE)
         cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
 
+    // matrix rows summed over every state set, for children with state-set tips
+    std::vector<REALTYPE> stateSetMatrices;
+    // the runs of patterns each operation computes, as start and end pairs, and the patterns
+    // the others are copied from
+    std::vector<int> patternRuns;
+    std::vector<int> patternSources;
+    std::vector<int> firstOfClass;
+
     for (int op = 0; op < count; op++) {
 
         int numOps = BEAGLE_OP_COUNT;
@@ -1219,33 +2830,39 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
         const REALTYPE* partials1 = gPartials[child1Index];
         const REALTYPE* partials2 = gPartials[child2Index];
 
-        const int* tipStates1 = gTipStates[child1Index];
-        const int* tipStates2 = gTipStates[child2Index];
+        const TipState* tipStates1 = gTipStates[child1Index];
+        const TipState* tipStates2 = gTipStates[child2Index];
+
+        const TipState* stateSets1 = gTipStateSets[child1Index];
+        const TipState* stateSets2 = gTipStateSets[child2Index];
+        const bool tipChild = (tipStates1 != NULL || tipStates2 != NULL ||
+                               stateSets1 != NULL || stateSets2 != NULL);
 
         const REALTYPE* matrices1 = gTransitionMatrices[child1TransMatIndex];
         const REALTYPE* matrices2 = gTransitionMatrices[child2TransMatIndex];
 
         REALTYPE* destPartials = gPartials[parIndex];
 
-        int startPattern = 0;
-        int endPattern = kPatternCount;
+        int startPattern = rangeStartPattern;
+        int endPattern = rangeEndPattern;
         if (byPartition) {
             startPattern = gPatternPartitionsStartPatterns[currentPartition];
             endPattern = gPatternPartitionsStartPatterns[currentPartition + 1];
         }
+        bool patternRange = (startPattern > 0 || endPattern < kPatternCount);
 
         int rescale = BEAGLE_OP_NONE;
         REALTYPE* scalingFactors = NULL;
         
         if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
             gActiveScalingFactors[parIndex - kTipCount] = 0;
-            if (tipStates1 == 0 && tipStates2 == 0)
+            if (!tipChild)
                 rescale = 2;
         } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
             rescale = 1;
             scalingFactors = gScaleBuffers[parIndex - kTipCount];
         } else if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) { // TODO: this is a quick and dirty implementation just so it returns correct results
-            if (tipStates1 == 0 && tipStates2 == 0) {
+            if (!tipChild) {
                 rescale = 1;
                 removeScaleFactors(&readScalingIndex, 1, cumulativeScaleIndex);
                 scalingFactors = gScaleBuffers[writeScalingIndex];
@@ -1263,79 +2880,123 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
                      << " readIndex = " << readScalingIndex << "\n";
         }
 
-        if (tipStates1 != NULL) {
-            if (tipStates2 != NULL ) {
-                if (rescale == 0) { // Use fixed scaleFactors
-                    calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2,
-                                                 matrices2, scalingFactors, startPattern, endPattern);
+        // patterns repeating an earlier pattern of the range, constant ones or with site repeats
+        // any showing the same states below the destination, are copied from it once its
+        // partials are computed, unless the runs left to compute are too short to be worth it
+        const int* sources = NULL;
+        if (rescale != 2) {
+            if (kSiteRepeatsEnabled) {
+                if (findSiteRepeatSources(patternSources, firstOfClass, parIndex, startPattern, endPattern))
+                    sources = &patternSources[0];
+            } else if (!gConstantPatternSources.empty()) {
+                sources = &gConstantPatternSources[0];
+            }
+        }
+        bool copyRepeats = false;
+        if (sources != NULL) {
+            const int copied = findComputedPatternRuns(patternRuns, sources, startPattern, endPattern);
+            copyRepeats = (copied > 0 && copied >= (int) patternRuns.size() / 2);
+        }
+        if (!copyRepeats) {
+            patternRuns.resize(2);
+            patternRuns[0] = startPattern;
+            patternRuns[1] = endPattern;
+        }
+
+        REALTYPE* stateSetMatrices1 = NULL;
+        REALTYPE* stateSetMatrices2 = NULL;
+        if (stateSets1 != NULL || stateSets2 != NULL) {
+            if (stateSets1 == NULL) {
+                std::swap(stateSets1, stateSets2);
+                std::swap(tipStates1, tipStates2);
+                std::swap(partials1, partials2);
+                std::swap(matrices1, matrices2);
+            }
+            const int stateSetMatrixSize = kCategoryCount * kStateCount * kStateSetCount;
+            if (stateSetMatrices.empty())
+                stateSetMatrices.resize(2 * stateSetMatrixSize);
+            stateSetMatrices1 = &stateSetMatrices[0];
+            stateSetMatrices2 = &stateSetMatrices[stateSetMatrixSize];
+            calcStateSetMatrices(stateSetMatrices1, matrices1);
+            if (stateSets2 != NULL)
+                calcStateSetMatrices(stateSetMatrices2, matrices2);
+        }
+
+        for (size_t run = 0; run < patternRuns.size(); run += 2) {
+            const int runStart = patternRuns[run];
+            const int runEnd = patternRuns[run + 1];
+
+            if (stateSets1 != NULL) {
+                const REALTYPE* scaleFactors = (rescale == 0 ? scalingFactors : NULL);
+                if (stateSets2 != NULL) {
+                    calcStateSetsStates(destPartials, stateSets1, stateSetMatrices1, stateSets2,
+                                        stateSetMatrices2, kStateSetCount, scaleFactors,
+                                        runStart, runEnd);
+                } else if (tipStates2 != NULL) {
+                    calcStateSetsStates(destPartials, stateSets1, stateSetMatrices1, tipStates2,
+                                        matrices2, kTransPaddedStateCount, scaleFactors,
+                                        runStart, runEnd);
                 } else {
-                    // First compute without any scaling
-                    calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2,
-                                     startPattern, endPattern);
-                    if (rescale == 1) { // Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
-                    }
+                    calcStateSetsPartials(destPartials, stateSets1, stateSetMatrices1, partials2,
+                                          matrices2, scaleFactors, runStart, runEnd);
                 }
-            } else {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2,
-                                                   matrices2, scalingFactors, startPattern, endPattern);
-                } else {
-                    calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2,
-                                       startPattern, endPattern);
-                    if (rescale == 1) { // Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+            } else if (tipStates1 != NULL) {
+                if (tipStates2 != NULL ) {
+                    if (rescale == 0) { // Use fixed scaleFactors
+                        calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2,
+                                                     matrices2, scalingFactors, runStart, runEnd);
+                    } else {
+                        // First compute without any scaling
+                        calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2,
+                                         runStart, runEnd);
                     }
-                }
-            }
-        } else {
-            if (tipStates2 != NULL) {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
-                                                   scalingFactors, startPattern, endPattern);
                 } else {
-                    calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1,
-                                       startPattern, endPattern);
-                    if (rescale == 1) {// Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+                    if (rescale == 0) {
+                        calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2,
+                                                       matrices2, scalingFactors, runStart, runEnd);
+                    } else {
+                        calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2,
+                                           runStart, runEnd);
                     }
                 }
             } else {
-                if (rescale == 2) {
-                    int sIndex = parIndex - kTipCount;
-                    calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
-                                                     &gActiveScalingFactors[sIndex]);
-                    if (gActiveScalingFactors[sIndex])
-                        autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
-
-                } else if (rescale == 0) {
-                    calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,
-                                                     matrices2,scalingFactors,startPattern,endPattern);
+                if (tipStates2 != NULL) {
+                    if (rescale == 0) {
+                        calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
+                                                       scalingFactors, runStart, runEnd);
+                    } else {
+                        calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1,
+                                           runStart, runEnd);
+                    }
                 } else {
-                    calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2,
-                                         startPattern, endPattern);
-                    if (rescale == 1) {// Recompute scaleFactors
-                        if (byPartition) {
-                            rescalePartialsByPartition(destPartials,scalingFactors,cumulativeScaleBuffer,0, currentPartition);
-                        } else {
-                            rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                        }
+                    if (rescale == 2) {
+                        int sIndex = parIndex - kTipCount;
+                        calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
+                                                         &gActiveScalingFactors[sIndex]);
+                        if (gActiveScalingFactors[sIndex])
+                            autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
+
+                    } else if (rescale == 0) {
+                        calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,
+                                                         matrices2,scalingFactors,runStart,runEnd);
+                    } else {
+                        calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2,
+                                             runStart, runEnd);
                     }
                 }
             }
         }
+
+        if (copyRepeats)
+            copyRepeatedPatterns(destPartials, sources, startPattern, endPattern);
+
+        if (rescale == 1) { // Recompute scaleFactors
+            if (patternRange) {
+                rescalePartialsByPatternRange(destPartials,scalingFactors,cumulativeScaleBuffer,0, startPattern, endPattern);
+            } else {
+                rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
+            }
+        }
         
         if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
             int parScalingIndex = parIndex - kTipCount;
@@ -1368,10 +3029,212 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartials(bool byPartition,
 }
 
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsByPatternBlock(const int* operations,
+                                                                int count,
+                                                                int cumulativeScaleIndex) {
+
+#ifdef _OPENMP
+    if (kOpenMPThreadCount > 1) {
+        // One parallel region for the whole operation list: each thread runs every
+        // operation over its own fixed range of patterns. Ranges start on whole minimum
+        // blocks so that no two threads write to the same cache line of a buffer.
+        int minBlockCount = (kPatternCount + BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT - 1) /
+                            BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+#pragma omp parallel num_threads(kOpenMPThreadCount)
+        {
+            int thread = omp_get_thread_num();
+            int threadCount = omp_get_num_threads();
+            int startPattern = (int) ((long) minBlockCount * thread / threadCount) *
+                               BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+            int endPattern = (int) ((long) minBlockCount * (thread + 1) / threadCount) *
+                             BEAGLE_CPU_BLOCK_MIN_PATTERN_COUNT;
+            if (endPattern > kPatternCount)
+                endPattern = kPatternCount;
+
+            upPartialsOverPatternBlocks(operations, count, cumulativeScaleIndex,
+                                        startPattern, endPattern);
+        }
+        return BEAGLE_SUCCESS;
+    }
+#endif
+
+    upPartialsOverPatternBlocks(operations, count, cumulativeScaleIndex, 0, kPatternCount);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::upPartialsOverPatternBlocks(const int* operations,
+                                                                    int count,
+                                                                    int cumulativeScaleIndex,
+                                                                    int rangeStartPattern,
+                                                                    int rangeEndPattern) {
+
+    // Run the whole operation list over one block of patterns at a time, so that the
+    // partials a parent reads are still in cache from when its children wrote them
+    for (int startPattern = rangeStartPattern; startPattern < rangeEndPattern; startPattern += kPatternBlockSize) {
+        int endPattern = startPattern + kPatternBlockSize;
+        if (endPattern > rangeEndPattern)
+            endPattern = rangeEndPattern;
+
+        upPartials(false, operations, count, cumulativeScaleIndex, startPattern, endPattern);
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setRootPrePartials(const int* bufferIndices,
+                                                          const int* stateFrequenciesIndices,
+                                                          int count) {
+    finishAsynchUpdates();
+    for (int n = 0; n < count; n++) {
+        const int bufferIndex = bufferIndices[n];
+        if (bufferIndex < kTipCount || bufferIndex >= kBufferCount ||
+            stateFrequenciesIndices[n] < 0 || stateFrequenciesIndices[n] >= kEigenDecompCount ||
+            gStateFrequencies[stateFrequenciesIndices[n]] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        if (gPartials[bufferIndex] == NULL) {
+            gPartials[bufferIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (gPartials[bufferIndex] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        } else if (kCheckpointActive) {
+            int returnCode = preservePartials(bufferIndex, false);
+            if (returnCode != BEAGLE_SUCCESS)
+                return returnCode;
+        }
+        invalidatePartials(bufferIndex);
+
+        const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndices[n]];
+        REALTYPE* destP = gPartials[bufferIndex];
+        memset(destP, 0, sizeof(REALTYPE) * kPartialsSize);
+        for (int l = 0; l < kCategoryCount; l++) {
+            for (int k = 0; k < kPatternCount; k++) {
+                memcpy(destP, freqs, sizeof(REALTYPE) * kStateCount);
+                destP += kPartialsPaddedStateCount;
+            }
+            destP += (kPaddedPatternCount - kPatternCount) * kPartialsPaddedStateCount;
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePrePartials(const int* operations,
+                                                         int count) {
+    finishAsynchUpdates();
+    const int numOps = BEAGLE_OP_COUNT;
+
+    int returnCode = allocateDestinationPartials(operations, count, numOps);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    // the parent's pre-order partials come first and are never tip states
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        if (o[0] < kTipCount || gPartials[o[3]] == NULL || o[1] >= kScaleBufferCount ||
+            (o[4] != BEAGLE_OP_NONE && (o[4] < 0 || o[4] >= kMatrixCount)) ||
+            o[6] < 0 || o[6] >= kMatrixCount ||
+            (gPartials[o[5]] == NULL && gTipStates[o[5]] == NULL))
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    // auto-scaling keeps no scale buffers of its own to write to
+    const bool manualScaling = !(kFlags & BEAGLE_FLAG_SCALING_AUTO);
+
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        invalidatePartials(o[0]);
+        if (manualScaling)
+            invalidateScaleBuffer(o[1]);
+        if (kCheckpointActive) {
+            returnCode = preservePartials(o[0], false);
+            if (returnCode == BEAGLE_SUCCESS && manualScaling)
+                returnCode = preserveScaleBuffer(o[1]);
+            if (returnCode != BEAGLE_SUCCESS)
+                return returnCode;
+        }
+    }
+
+    std::vector<REALTYPE> fromAbove(kStateCount);
+
+    for (int op = 0; op < count; op++) {
+        const int* o = &operations[op * numOps];
+        const int writeScalingIndex = o[1];
+        const REALTYPE* preParent = gPartials[o[3]];
+        const REALTYPE* matrixParent = (o[4] == BEAGLE_OP_NONE ? NULL : gTransitionMatrices[o[4]]);
+        const REALTYPE* partialsSibling = gPartials[o[5]];
+        const TipState* statesSibling = gTipStates[o[5]];
+        const REALTYPE* matrixSibling = gTransitionMatrices[o[6]];
+        REALTYPE* destP = gPartials[o[0]];
+
+        // q(i) = (sum_k pre_parent(k) P_parent(k,i)) * (sum_j P_sibling(i,j) post_sibling(j))
+        for (int l = 0; l < kCategoryCount; l++) {
+            for (int k = 0; k < kPatternCount; k++) {
+                const int v = l * kPaddedPatternCount * kPartialsPaddedStateCount + k * kPartialsPaddedStateCount;
+
+                if (matrixParent == NULL) {
+                    for (int i = 0; i < kStateCount; i++)
+                        fromAbove[i] = preParent[v + i];
+                } else {
+                    for (int i = 0; i < kStateCount; i++)
+                        fromAbove[i] = 0.0;
+                    int w = l * kMatrixSize;
+                    for (int j = 0; j < kStateCount; j++) {
+                        const REALTYPE preJ = preParent[v + j];
+                        for (int i = 0; i < kStateCount; i++)
+                            fromAbove[i] += preJ * matrixParent[w + i];
+                        w += kTransPaddedStateCount;
+                    }
+                }
+
+                int w = l * kMatrixSize;
+                for (int i = 0; i < kStateCount; i++) {
+                    REALTYPE sum;
+                    if (statesSibling != NULL) {
+                        sum = matrixSibling[w + statesSibling[k]];
+                    } else {
+                        sum = 0.0;
+                        for (int j = 0; j < kStateCount; j++)
+                            sum += matrixSibling[w + j] * partialsSibling[v + j];
+                    }
+                    destP[v + i] = fromAbove[i] * sum;
+                    w += kTransPaddedStateCount;
+                }
+                for (int i = kStateCount; i < kPartialsPaddedStateCount; i++)
+                    destP[v + i] = 0.0;
+            }
+        }
+
+        if (writeScalingIndex >= 0 && manualScaling)
+            rescalePartials(destP, gScaleBuffers[writeScalingIndex], NULL, 0);
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForPartials(const int* destinationPartials,
                                    int destinationPartialsCount) {
-    return BEAGLE_SUCCESS;
+    if (!kAsynchEnabled)
+        return BEAGLE_SUCCESS;
+
+    // only as far as the last queued update writing one of the buffers
+    unsigned long long ticket = 0;
+    for (int i = 0; i < destinationPartialsCount; i++) {
+        const int bufferIndex = destinationPartials[i];
+        if (bufferIndex < 0 || bufferIndex >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gAsynchWriteTickets[bufferIndex] > ticket)
+            ticket = gAsynchWriteTickets[bufferIndex];
+    }
+    waitForAsynchUpdates(ticket);
+
+    std::lock_guard<std::mutex> l(gAsynchMutex);
+    int returnCode = kAsynchReturnCode;
+    kAsynchReturnCode = BEAGLE_SUCCESS;
+    return returnCode;
 }
 
 
@@ -1382,6 +3245,12 @@ BEAGLE_CPU_TEMPLATE
                                                              const int* cumulativeScaleIndices,
                                                              int count,
                                                              double* outSumLogLikelihood) {
+    finishAsynchUpdates();
+
+    for (int i = 0; i < count; i++) {
+        if (gPartials[bufferIndices[i]] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
 
     if (count == 1) {
         // We treat this as a special case so that we don't have convoluted logic
@@ -1426,6 +3295,59 @@ BEAGLE_CPU_TEMPLATE
     }
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsAsync(const int* bufferIndices,
+                                                                       const int* categoryWeightsIndices,
+                                                                       const int* stateFrequenciesIndices,
+                                                                       const int* cumulativeScaleIndices,
+                                                                       int count,
+                                                                       int resultIndex) {
+    finishAsynchUpdates();
+    if (resultIndex < 0 || resultIndex >= BEAGLE_RESULT_SLOT_COUNT)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    if (gLogLikelihoodResults.empty()) {
+        gLogLikelihoodResults.assign(BEAGLE_RESULT_SLOT_COUNT, 0.0);
+        gLogLikelihoodResultsValid.assign(BEAGLE_RESULT_SLOT_COUNT, true);
+        gLogLikelihoodResultsWritten.assign(BEAGLE_RESULT_SLOT_COUNT, false);
+    }
+
+    double sumLogLikelihood;
+    int returnCode = calculateRootLogLikelihoods(bufferIndices, categoryWeightsIndices,
+                                                 stateFrequenciesIndices, cumulativeScaleIndices,
+                                                 count, &sumLogLikelihood);
+
+    // as on devices, a NaN sum is only reported when the result is fetched
+    if (returnCode != BEAGLE_SUCCESS && returnCode != BEAGLE_ERROR_FLOATING_POINT)
+        return returnCode;
+
+    gLogLikelihoodResults[resultIndex] = sumLogLikelihood;
+    gLogLikelihoodResultsValid[resultIndex] = (returnCode == BEAGLE_SUCCESS);
+    gLogLikelihoodResultsWritten[resultIndex] = true;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getLogLikelihoodResults(const int* resultIndices,
+                                                              int count,
+                                                              double* outSumLogLikelihoods) {
+    finishAsynchUpdates();
+    int returnCode = BEAGLE_SUCCESS;
+
+    for (int n = 0; n < count; n++) {
+        if (resultIndices[n] < 0 || resultIndices[n] >= (int) gLogLikelihoodResults.size() ||
+            !gLogLikelihoodResultsWritten[resultIndices[n]])
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+
+        outSumLogLikelihoods[n] = gLogLikelihoodResults[resultIndices[n]];
+        if (!gLogLikelihoodResultsValid[resultIndices[n]])
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
+    }
+
+    return returnCode;
+}
+
 BEAGLE_CPU_TEMPLATE
     int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
                                                                   const int* bufferIndices,
@@ -1437,6 +3359,7 @@ BEAGLE_CPU_TEMPLATE
                                                                   int count,
                                                                   double* outSumLogLikelihoodByPartition,
                                                                   double* outSumLogLikelihood) {
+    finishAsynchUpdates();
 
     int returnCode = BEAGLE_SUCCESS;
 
@@ -1478,38 +3401,18 @@ BEAGLE_CPU_TEMPLATE
                                                         int partitionCount,
                                                         double* outSumLogLikelihoodByPartition) {
 
-    int partitionsPerThreadFloor = partitionCount / kNumThreads;
-    int partitionsRemainder = partitionCount % kNumThreads;
-    int currentPartitionIndex = 0;
-    for (int i=0; i<kNumThreads; i++) {
-        int partitionCountThread = partitionsPerThreadFloor;
-        if (partitionsRemainder) {
-            partitionCountThread++;
-            partitionsRemainder--;
-        }
-
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
-                      &bufferIndices[currentPartitionIndex], &categoryWeightsIndices[currentPartitionIndex],
-                      &stateFrequenciesIndices[currentPartitionIndex], &cumulativeScaleIndices[currentPartitionIndex],
-                      &partitionIndices[currentPartitionIndex], partitionCountThread,
-                      &outSumLogLikelihoodByPartition[currentPartitionIndex]));
-
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
-
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
-
-        gThreads[i].cv.notify_one();
-
-        currentPartitionIndex += partitionCountThread;
+    for (int i=0; i<partitionCount; i++) {
+        int p = partitionIndices[i];
+        gThreadWorkCosts[i] = gPatternPartitionsStartPatterns[p+1] - gPatternPartitionsStartPatterns[p];
+        gThreadWorkPartitions[i] = p;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
-    }
+    dispatchThreadWork(partitionCount, true, [&] (int i) {
+        calcRootLogLikelihoodsByPartition(&bufferIndices[i], &categoryWeightsIndices[i],
+                                          &stateFrequenciesIndices[i], &cumulativeScaleIndices[i],
+                                          &partitionIndices[i], 1,
+                                          &outSumLogLikelihoodByPartition[i]);
+    });
 
 }
 
@@ -1522,29 +3425,18 @@ BEAGLE_CPU_TEMPLATE
                                                         const int* partitionIndices,
                                                         double* outSumLogLikelihoodByPartition) {
 
-    for (int i=0; i<kNumThreads; i++) {
-
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition, this,
-                      bufferIndices, categoryWeightsIndices,
-                      stateFrequenciesIndices, cumulativeScaleIndices,
-                      &partitionIndices[i], 1,
-                      &outSumLogLikelihoodByPartition[i]));
-
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
-
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
-
-        gThreads[i].cv.notify_one();
-
+    for (int i=0; i<kPartitionCount; i++) {
+        int p = partitionIndices[i];
+        gThreadWorkCosts[i] = gPatternPartitionsStartPatterns[p+1] - gPatternPartitionsStartPatterns[p];
+        gThreadWorkPartitions[i] = p;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
-    }
+    dispatchThreadWork(kPartitionCount, true, [&] (int i) {
+        calcRootLogLikelihoodsByPartition(bufferIndices, categoryWeightsIndices,
+                                          stateFrequenciesIndices, cumulativeScaleIndices,
+                                          &partitionIndices[i], 1,
+                                          &outSumLogLikelihoodByPartition[i]);
+    });
 
 }
 
@@ -1652,10 +3544,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bu
             outLogLikelihoodsTmp[i] += maxScaleFactor[i];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1715,10 +3604,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoods(const int bufferIn
         }
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1788,10 +3674,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsByPartition(
             }
         }
 
-        outSumLogLikelihoodByPartition[p] = 0.0;
-        for (int i = startPattern; i < endPattern; i++) {
-            outSumLogLikelihoodByPartition[p] += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-        }
+        outSumLogLikelihoodByPartition[p] = sumOverPatterns(outLogLikelihoodsTmp, startPattern, endPattern);
 
     }
 
@@ -1801,6 +3684,10 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactors(const int* scalingIndices,
                                                 int  count,
                                                 int  cumulativeScalingIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
         REALTYPE* cumulativeScaleBuffer = gScaleBuffers[0];
         for(int j=0; j<kPatternCount; j++)
@@ -1820,10 +3707,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactors(const int* scaling
         for(int i=0; i<count; i++) {
             const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
             for(int j=0; j<kPatternCount; j++) {
-                if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
-                    cumulativeScaleBuffer[j] += scaleBuffer[j];
-                else
-                    cumulativeScaleBuffer[j] += log(scaleBuffer[j]);
+                cumulativeScaleBuffer[j] += logScaleFactor(scaleBuffer[j]);
             }
         }
 
@@ -1843,6 +3727,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactorsByPartition(const i
                                                                          int count,
                                                                          int cumulativeScalingIndex,
                                                                          int partitionIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
         return BEAGLE_ERROR_NO_IMPLEMENTATION;        
     } else {
@@ -1854,10 +3742,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactorsByPartition(const i
         for(int i=0; i<count; i++) {
             const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
             for(int j=startPattern; j<endPattern; j++) {
-                if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
-                    cumulativeScaleBuffer[j] += scaleBuffer[j];
-                else
-                    cumulativeScaleBuffer[j] += log(scaleBuffer[j]);
+                cumulativeScaleBuffer[j] += logScaleFactor(scaleBuffer[j]);
             }
         }
 
@@ -1870,14 +3755,15 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactors(const int* scalingIndices,
                                             int  count,
                                             int  cumulativeScalingIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
     for(int i=0; i<count; i++) {
         const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
         for(int j=0; j<kPatternCount; j++) {
-            if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
-                cumulativeScaleBuffer[j] -= scaleBuffer[j];
-            else
-                cumulativeScaleBuffer[j] -= log(scaleBuffer[j]);
+            cumulativeScaleBuffer[j] -= logScaleFactor(scaleBuffer[j]);
         }
     }
 
@@ -1889,6 +3775,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactorsByPartition(const int*
                                                                      int count,
                                                                      int cumulativeScalingIndex,
                                                                      int partitionIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     
     int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
     int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
@@ -1897,10 +3787,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactorsByPartition(const int*
     for(int i=0; i<count; i++) {
         const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
         for(int j=startPattern; j<endPattern; j++) {
-            if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
-                cumulativeScaleBuffer[j] -= scaleBuffer[j];
-            else
-                cumulativeScaleBuffer[j] -= log(scaleBuffer[j]);
+            cumulativeScaleBuffer[j] -= logScaleFactor(scaleBuffer[j]);
         }
     }
 
@@ -1910,6 +3797,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactorsByPartition(const int*
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactors(int cumulativeScalingIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     //memcpy(gScaleBuffers[cumulativeScalingIndex],zeros,sizeof(double) * kPatternCount);
     
      if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
@@ -1923,6 +3814,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactors(int cumulativeScalingIn
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactorsByPartition(int cumulativeScalingIndex,
                                                                     int partitionIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(cumulativeScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(cumulativeScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     
      if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
         return BEAGLE_ERROR_NO_IMPLEMENTATION;
@@ -1940,6 +3835,10 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactorsByPartition(int cumulati
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyScaleFactors(int destScalingIndex,
                                                         int srcScalingIndex) {
+    finishAsynchUpdates();
+    invalidateScaleBuffer(destScalingIndex);
+    if (kCheckpointActive && preserveScaleBuffer(destScalingIndex) != BEAGLE_SUCCESS)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
     memcpy(gScaleBuffers[destScalingIndex],gScaleBuffers[srcScalingIndex],sizeof(REALTYPE) * kPatternCount);
 
     return BEAGLE_SUCCESS;
@@ -1948,6 +3847,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyScaleFactors(int destScalingIndex,
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getScaleFactors(int srcScalingIndex,
                                                        double* scaleFactors) {
+    finishAsynchUpdates();
     // Do nothing                                                      
     return BEAGLE_SUCCESS;                                                     
 }                                                      
@@ -1965,8 +3865,15 @@ BEAGLE_CPU_TEMPLATE
                                                              double* outSumLogLikelihood,
                                                              double* outSumFirstDerivative,
                                                              double* outSumSecondDerivative) {
+    finishAsynchUpdates();
     // TODO: implement for count > 1
 
+    for (int i = 0; i < count; i++) {
+        if (gPartials[parentBufferIndices[i]] == NULL ||
+            (gPartials[childBufferIndices[i]] == NULL && gTipStates[childBufferIndices[i]] == NULL))
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
     if (count == 1) {
         int cumulativeScalingFactorIndex;
         if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
@@ -2061,6 +3968,7 @@ BEAGLE_CPU_TEMPLATE
                                                     double* outSumFirstDerivative,
                                                     double* outSumSecondDerivativeByPartition,
                                                     double* outSumSecondDerivative) {
+    finishAsynchUpdates();
 
     int returnCode = BEAGLE_SUCCESS;
 
@@ -2159,43 +4067,23 @@ BEAGLE_CPU_TEMPLATE
                                                         int partitionCount,
                                                         double* outSumLogLikelihoodByPartition) {
 
-    int partitionsPerThreadFloor = kPartitionCount / kNumThreads;
-    int partitionsRemainder = kPartitionCount % kNumThreads;
-    int currentPartitionIndex = 0;
-    for (int i=0; i<kNumThreads; i++) {
-        int partitionCountThread = partitionsPerThreadFloor;
-        if (partitionsRemainder) {
-            partitionCountThread++;
-            partitionsRemainder--;
-        }
-
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition, this,
-                      &parentBufferIndices[currentPartitionIndex],
-                      &childBufferIndices[currentPartitionIndex],
-                      &probabilityIndices[currentPartitionIndex],
-                      &categoryWeightsIndices[currentPartitionIndex],
-                      &stateFrequenciesIndices[currentPartitionIndex],
-                      &cumulativeScaleIndices[currentPartitionIndex],
-                      &partitionIndices[currentPartitionIndex],
-                      partitionCountThread,
-                      &outSumLogLikelihoodByPartition[currentPartitionIndex]));
-
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
-
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
-
-        gThreads[i].cv.notify_one();
-
-        currentPartitionIndex += partitionCountThread;
+    for (int i=0; i<partitionCount; i++) {
+        int p = partitionIndices[i];
+        gThreadWorkCosts[i] = gPatternPartitionsStartPatterns[p+1] - gPatternPartitionsStartPatterns[p];
+        gThreadWorkPartitions[i] = p;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
-    }
+    dispatchThreadWork(partitionCount, true, [&] (int i) {
+        calcEdgeLogLikelihoodsByPartition(&parentBufferIndices[i],
+                                          &childBufferIndices[i],
+                                          &probabilityIndices[i],
+                                          &categoryWeightsIndices[i],
+                                          &stateFrequenciesIndices[i],
+                                          &cumulativeScaleIndices[i],
+                                          &partitionIndices[i],
+                                          1,
+                                          &outSumLogLikelihoodByPartition[i]);
+    });
 
 }
 
@@ -2210,33 +4098,23 @@ BEAGLE_CPU_TEMPLATE
                                                         const int* partitionIndices,
                                                         double* outSumLogLikelihoodByPartition) {
 
-    for (int i=0; i<kNumThreads; i++) {
-
-        std::packaged_task<void()> threadTask(
-            std::bind(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition, this,
-                      parentBufferIndices,
-                      childBufferIndices,
-                      probabilityIndices,
-                      categoryWeightsIndices,
-                      stateFrequenciesIndices,
-                      cumulativeScaleIndices,
-                      &partitionIndices[i],
-                      1,
-                      &outSumLogLikelihoodByPartition[i]));
-
-        gFutures[i] = threadTask.get_future();
-        threadData* td = &gThreads[i];
-
-        std::unique_lock<std::mutex> l(td->m);
-        td->jobs.push(std::move(threadTask));
-        l.unlock();
-
-        gThreads[i].cv.notify_one();
+    for (int i=0; i<kPartitionCount; i++) {
+        int p = partitionIndices[i];
+        gThreadWorkCosts[i] = gPatternPartitionsStartPatterns[p+1] - gPatternPartitionsStartPatterns[p];
+        gThreadWorkPartitions[i] = p;
     }
 
-    for (int i=0; i<kNumThreads; i++) {
-        gFutures[i].wait();
-    }
+    dispatchThreadWork(kPartitionCount, true, [&] (int i) {
+        calcEdgeLogLikelihoodsByPartition(parentBufferIndices,
+                                          childBufferIndices,
+                                          probabilityIndices,
+                                          categoryWeightsIndices,
+                                          stateFrequenciesIndices,
+                                          cumulativeScaleIndices,
+                                          &partitionIndices[i],
+                                          1,
+                                          &outSumLogLikelihoodByPartition[i]);
+    });
 
 }
 
@@ -2265,7 +4143,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
     
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-        const int* statesChild = gTipStates[childIndex];
+        const TipState* statesChild = gTipStates[childIndex];
         int v = 0; // Index for parent partials
 
         for(int l = 0; l < kCategoryCount; l++) {
@@ -2347,10 +4225,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -2394,7 +4269,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition(
         const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
 
         if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
-            const int* statesChild = gTipStates[childIndex];
+            const TipState* statesChild = gTipStates[childIndex];
             int v = startPattern * kPartialsPaddedStateCount; // Index for parent partials
 
             for(int l = 0; l < kCategoryCount; l++) {
@@ -2477,10 +4352,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsByPartition(
                 outLogLikelihoodsTmp[k] += scalingFactors[k];
         }
 
-        outSumLogLikelihoodByPartition[p] = 0.0;
-        for (int i = startPattern; i < endPattern; i++) {
-            outSumLogLikelihoodByPartition[p] += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-        }
+        outSumLogLikelihoodByPartition[p] = sumOverPatterns(outLogLikelihoodsTmp, startPattern, endPattern);
 
     }
 }
@@ -2532,7 +4404,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDerivByParti
 
         if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-            const int* statesChild = gTipStates[childIndex];
+            const TipState* statesChild = gTipStates[childIndex];
             int v = startPattern * kPartialsPaddedStateCount; // Index for parent partials
 
             for(int l = 0; l < kCategoryCount; l++) {
@@ -2616,14 +4488,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDerivByParti
         }
 
 
-        outSumLogLikelihoodByPartition[p] = 0.0;
-        outSumFirstDerivativeByPartition[p] = 0.0;
-        outSumSecondDerivativeByPartition[p] = 0.0;
-        for (int i = startPattern; i < endPattern; i++) {
-            outSumLogLikelihoodByPartition[p]    += outLogLikelihoodsTmp[i]    * gPatternWeights[i];
-            outSumFirstDerivativeByPartition[p]  += outFirstDerivativesTmp[i]  * gPatternWeights[i];
-            outSumSecondDerivativeByPartition[p] += outSecondDerivativesTmp[i] * gPatternWeights[i];
-        }
+        outSumLogLikelihoodByPartition[p] = sumOverPatterns(outLogLikelihoodsTmp, startPattern, endPattern);
+        outSumFirstDerivativeByPartition[p] = sumOverPatterns(outFirstDerivativesTmp, startPattern, endPattern);
+        outSumSecondDerivativeByPartition[p] = sumOverPatterns(outSecondDerivativesTmp, startPattern, endPattern);
 
     }
 }
@@ -2656,7 +4523,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
         
         if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
             
-            const int* statesChild = gTipStates[childIndex];
+            const TipState* statesChild = gTipStates[childIndex];
             int v = 0; // Index for parent partials
             
             for(int l = 0; l < kCategoryCount; l++) {
@@ -2772,10 +4639,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
     }
     
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -2811,7 +4675,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-        const int* statesChild = gTipStates[childIndex];
+        const TipState* statesChild = gTipStates[childIndex];
         int v = 0; // Index for parent partials
 
         for(int l = 0; l < kCategoryCount; l++) {
@@ -2885,13 +4749,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    *outSumFirstDerivative = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-
-        *outSumFirstDerivative += outFirstDerivativesTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
+    *outSumFirstDerivative = sumOverPatterns(outFirstDerivativesTmp, 0, kPatternCount);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -2930,7 +4789,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 
-        const int* statesChild = gTipStates[childIndex];
+        const TipState* statesChild = gTipStates[childIndex];
         int v = 0; // Index for parent partials
 
         for(int l = 0; l < kCategoryCount; l++) {
@@ -3011,16 +4870,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    *outSumFirstDerivative = 0.0;
-    *outSumSecondDerivative = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-
-        *outSumFirstDerivative += outFirstDerivativesTmp[i] * gPatternWeights[i];
-
-        *outSumSecondDerivative += outSecondDerivativesTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumOverPatterns(outLogLikelihoodsTmp, 0, kPatternCount);
+    *outSumFirstDerivative = sumOverPatterns(outFirstDerivativesTmp, 0, kPatternCount);
+    *outSumSecondDerivative = sumOverPatterns(outSecondDerivativesTmp, 0, kPatternCount);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -3030,8 +4882,171 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 
 
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateMultiEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                                        const int* childBufferIndices,
+                                                                        const int* probabilityIndices,
+                                                                        const int* firstDerivativeIndices,
+                                                                        const int* secondDerivativeIndices,
+                                                                        const int* categoryWeightsIndices,
+                                                                        const int* stateFrequenciesIndices,
+                                                                        const int* cumulativeScaleIndices,
+                                                                        int count,
+                                                                        double* outLogLikelihoods,
+                                                                        double* outFirstDerivatives,
+                                                                        double* outSecondDerivatives) {
+    finishAsynchUpdates();
+    // auto and always-scaling gather an edge's factors into the instance's scratch buffers
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+        return BeagleImpl::calculateMultiEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
+                                                            probabilityIndices, firstDerivativeIndices,
+                                                            secondDerivativeIndices, categoryWeightsIndices,
+                                                            stateFrequenciesIndices, cumulativeScaleIndices,
+                                                            count, outLogLikelihoods, outFirstDerivatives,
+                                                            outSecondDerivatives);
+
+    const bool firstDerivatives = (firstDerivativeIndices != NULL && outFirstDerivatives != NULL);
+    const bool secondDerivatives = (firstDerivatives && secondDerivativeIndices != NULL &&
+                                    outSecondDerivatives != NULL);
+
+    for (int e = 0; e < count; e++) {
+        const int parIndex = parentBufferIndices[e];
+        const int childIndex = childBufferIndices[e];
+        if (parIndex < 0 || parIndex >= kBufferCount || childIndex < 0 || childIndex >= kBufferCount ||
+            gPartials[parIndex] == NULL || (gPartials[childIndex] == NULL && gTipStates[childIndex] == NULL))
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (cumulativeScaleIndices[e] != BEAGLE_OP_NONE &&
+            (cumulativeScaleIndices[e] < 0 || cumulativeScaleIndices[e] >= kScaleBufferCount))
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    std::vector<int> returnCodes(count, BEAGLE_SUCCESS);
+    auto edgeWork = [&] (int e) {
+        returnCodes[e] = calcEdgeLogLikelihoodsOfEdge(parentBufferIndices[e], childBufferIndices[e],
+                                                      probabilityIndices[e],
+                                                      (firstDerivatives ? firstDerivativeIndices[e] : BEAGLE_OP_NONE),
+                                                      (secondDerivatives ? secondDerivativeIndices[e] : BEAGLE_OP_NONE),
+                                                      categoryWeightsIndices[e], stateFrequenciesIndices[e],
+                                                      cumulativeScaleIndices[e], &outLogLikelihoods[e],
+                                                      (firstDerivatives ? &outFirstDerivatives[e] : NULL),
+                                                      (secondDerivatives ? &outSecondDerivatives[e] : NULL));
+    };
+
+    if (kTraversalThreadingEnabled && count > 1) {
+        // the edges are independent, spread over the pool in batches of at most one work item per buffer
+        for (int start = 0; start < count; start += kThreadWorkCapacity) {
+            const int batchSize = (count - start < kThreadWorkCapacity ? count - start : kThreadWorkCapacity);
+            for (int i = 0; i < batchSize; i++)
+                gThreadWorkCosts[i] = 1 + (gTipStates[childBufferIndices[start + i]] == NULL);
+            dispatchThreadWork(batchSize, false, [&] (int i) {
+                edgeWork(start + i);
+            });
+        }
+    } else {
+        for (int e = 0; e < count; e++)
+            edgeWork(e);
+    }
+
+    int returnCode = BEAGLE_SUCCESS;
+    for (int e = 0; e < count && returnCode == BEAGLE_SUCCESS; e++)
+        returnCode = returnCodes[e];
+    return returnCode;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsOfEdge(const int parIndex,
+                                                                    const int childIndex,
+                                                                    const int probIndex,
+                                                                    const int firstDerivativeIndex,
+                                                                    const int secondDerivativeIndex,
+                                                                    const int categoryWeightsIndex,
+                                                                    const int stateFrequenciesIndex,
+                                                                    const int scalingFactorsIndex,
+                                                                    double* outLogLikelihood,
+                                                                    double* outFirstDerivative,
+                                                                    double* outSecondDerivative) {
+    const REALTYPE* partialsParent = gPartials[parIndex];
+    const REALTYPE* partialsChild = gPartials[childIndex];
+    const TipState* statesChild = gTipStates[childIndex];
+    const REALTYPE* transMatrix = gTransitionMatrices[probIndex];
+    const REALTYPE* firstDerivMatrix = (firstDerivativeIndex != BEAGLE_OP_NONE ?
+                                        gTransitionMatrices[firstDerivativeIndex] : NULL);
+    const REALTYPE* secondDerivMatrix = (secondDerivativeIndex != BEAGLE_OP_NONE ?
+                                         gTransitionMatrices[secondDerivativeIndex] : NULL);
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+    const REALTYPE* scalingFactors = (scalingFactorsIndex != BEAGLE_OP_NONE ?
+                                      gScaleBuffers[scalingFactorsIndex] : NULL);
+
+    double sumLogLikelihood = 0.0;
+    double sumFirstDerivative = 0.0;
+    double sumSecondDerivative = 0.0;
+
+    for (int k = 0; k < kPatternCount; k++) {
+        double sumOverI = 0.0;
+        double sumOverID1 = 0.0;
+        double sumOverID2 = 0.0;
+        for (int l = 0; l < kCategoryCount; l++) {
+            const int v = l * kPaddedPatternCount * kPartialsPaddedStateCount + k * kPartialsPaddedStateCount;
+            int w = l * kMatrixSize;
+            double sumOverCategory = 0.0;
+            double sumOverCategoryD1 = 0.0;
+            double sumOverCategoryD2 = 0.0;
+            for (int i = 0; i < kStateCount; i++) {
+                double sumOverJ = 0.0;
+                double sumOverJD1 = 0.0;
+                double sumOverJD2 = 0.0;
+                if (statesChild != NULL) {
+                    const int stateChild = statesChild[k];
+                    sumOverJ = transMatrix[w + stateChild];
+                    if (firstDerivMatrix != NULL)
+                        sumOverJD1 = firstDerivMatrix[w + stateChild];
+                    if (secondDerivMatrix != NULL)
+                        sumOverJD2 = secondDerivMatrix[w + stateChild];
+                } else {
+                    for (int j = 0; j < kStateCount; j++) {
+                        sumOverJ += transMatrix[w + j] * partialsChild[v + j];
+                        if (firstDerivMatrix != NULL)
+                            sumOverJD1 += firstDerivMatrix[w + j] * partialsChild[v + j];
+                        if (secondDerivMatrix != NULL)
+                            sumOverJD2 += secondDerivMatrix[w + j] * partialsChild[v + j];
+                    }
+                }
+                const double parentFreq = freqs[i] * partialsParent[v + i];
+                sumOverCategory += parentFreq * sumOverJ;
+                sumOverCategoryD1 += parentFreq * sumOverJD1;
+                sumOverCategoryD2 += parentFreq * sumOverJD2;
+                w += kTransPaddedStateCount;
+            }
+            sumOverI += sumOverCategory * wt[l];
+            sumOverID1 += sumOverCategoryD1 * wt[l];
+            sumOverID2 += sumOverCategoryD2 * wt[l];
+        }
+
+        double siteLogLikelihood = log(sumOverI);
+        if (scalingFactors != NULL)
+            siteLogLikelihood += scalingFactors[k];
+        const double siteFirstDerivative = sumOverID1 / sumOverI;
+        sumLogLikelihood += siteLogLikelihood * gPatternWeights[k];
+        sumFirstDerivative += siteFirstDerivative * gPatternWeights[k];
+        sumSecondDerivative += (sumOverID2 / sumOverI - siteFirstDerivative * siteFirstDerivative) *
+                               gPatternWeights[k];
+    }
+
+    *outLogLikelihood = sumLogLikelihood;
+    if (outFirstDerivative != NULL)
+        *outFirstDerivative = sumFirstDerivative;
+    if (outSecondDerivative != NULL)
+        *outSecondDerivative = sumSecondDerivative;
+
+    if (sumLogLikelihood != sumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::block(void) {
+    finishAsynchUpdates();
     // Do nothing.
     return BEAGLE_SUCCESS;
 }
@@ -3051,6 +5066,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
     }
 
     // TODO None of the code below has been optimized.
+    ScalingTally tally;
     for (int k = 0; k < kPatternCount; k++) {
         REALTYPE max = 0;
         const int patternOffset = k * kPartialsPaddedStateCount;
@@ -3066,24 +5082,16 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
         if (max == 0)
             max = 1.0;
             
-        REALTYPE oneOverMax = REALTYPE(1.0) / max;
+        REALTYPE oneOverMax = storeScaleFactor(max, scaleFactors, cumulativeScaleFactors, k, tally);
+        if (oneOverMax == REALTYPE(1.0))
+            continue;
         for (int l = 0; l < kCategoryCount; l++) {
             int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
             for (int i = 0; i < kStateCount; i++)
                 destP[offset++] *= oneOverMax;
         }
-
-        if (kFlags & BEAGLE_FLAG_SCALERS_LOG) {
-            REALTYPE logMax = log(max);
-            scaleFactors[k] = logMax;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += logMax;
-        } else {
-            scaleFactors[k] = max;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += log(max);
-        }
     }
+    addScalingTally(tally);
     if (DEBUGGING_OUTPUT) {
         for(int i=0; i<kPatternCount; i++)
             fprintf(stderr,"new scaleFactor[%d] = %.5f\n",i,scaleFactors[i]);
@@ -3091,16 +5099,15 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
 }
     
 BEAGLE_CPU_TEMPLATE
-void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPartition(REALTYPE* destP,
-                                                                   REALTYPE* scaleFactors,
-                                                                   REALTYPE* cumulativeScaleFactors,
-                                                                   const int fillWithOnes,
-                                                                   const int partitionIndex) {
-
-    int startPattern = gPatternPartitionsStartPatterns[partitionIndex];
-    int endPattern = gPatternPartitionsStartPatterns[partitionIndex + 1];
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPatternRange(REALTYPE* destP,
+                                                                      REALTYPE* scaleFactors,
+                                                                      REALTYPE* cumulativeScaleFactors,
+                                                                      const int fillWithOnes,
+                                                                      int startPattern,
+                                                                      int endPattern) {
 
     // TODO None of the code below has been optimized.
+    ScalingTally tally;
     for (int k = startPattern; k < endPattern; k++) {
         REALTYPE max = 0;
         const int patternOffset = k * kPartialsPaddedStateCount;
@@ -3116,24 +5123,121 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartialsByPartition(REALTYPE* des
         if (max == 0)
             max = 1.0;
             
-        REALTYPE oneOverMax = REALTYPE(1.0) / max;
+        REALTYPE oneOverMax = storeScaleFactor(max, scaleFactors, cumulativeScaleFactors, k, tally);
+        if (oneOverMax == REALTYPE(1.0))
+            continue;
         for (int l = 0; l < kCategoryCount; l++) {
             int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
             for (int i = 0; i < kStateCount; i++)
                 destP[offset++] *= oneOverMax;
         }
+    }
+    addScalingTally(tally);
+}
 
-        if (kFlags & BEAGLE_FLAG_SCALERS_LOG) {
-            REALTYPE logMax = log(max);
-            scaleFactors[k] = logMax;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += logMax;
-        } else {
-            scaleFactors[k] = max;
-            if( cumulativeScaleFactors != NULL )
-                cumulativeScaleFactors[k] += log(max);
-        }
+BEAGLE_CPU_TEMPLATE
+inline REALTYPE BeagleCPUImpl<BEAGLE_CPU_GENERIC>::storeScaleFactor(REALTYPE max,
+                                                                    REALTYPE* scaleFactors,
+                                                                    REALTYPE* cumulativeScaleFactors,
+                                                                    int k,
+                                                                    ScalingTally& tally) {
+    // max = m * 2^exponent with m in [0.5, 1)
+    int exponent = beagleExponent(max);
+    if (tally.patternCount == 0 || exponent < tally.minExponent)
+        tally.minExponent = exponent;
+    if (tally.patternCount == 0 || exponent > tally.maxExponent)
+        tally.maxExponent = exponent;
+    tally.patternCount++;
+    tally.exponentSum += exponent;
+    if (exponent < std::numeric_limits<REALTYPE>::min_exponent / 2)
+        tally.nearUnderflowPatternCount++;
+
+    if (kAdaptiveRescaling && exponent >= std::numeric_limits<REALTYPE>::min_exponent / 4) {
+        scaleFactors[k] = ((kFlags & BEAGLE_FLAG_SCALERS_LOG) ? REALTYPE(0.0) : REALTYPE(1.0));
+        return REALTYPE(1.0);
+    }
+    if (max != REALTYPE(1.0))
+        tally.rescaledPatternCount++;
+
+    if (kExponentScaling) {
+        // multiplying by 2^-exponent is exact and the log scaler is a multiple of
+        // log(2), so no division or log is needed
+        REALTYPE logScale = exponent * REALTYPE(M_LN2);
+        if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
+            scaleFactors[k] = logScale;
+        else
+            scaleFactors[k] = beaglePowerOfTwo<REALTYPE>(exponent);
+        if (cumulativeScaleFactors != NULL)
+            cumulativeScaleFactors[k] += logScale;
+        return beaglePowerOfTwo<REALTYPE>(-exponent);
+    }
+
+    if (kFlags & BEAGLE_FLAG_SCALERS_LOG) {
+        REALTYPE logMax = log(max);
+        scaleFactors[k] = logMax;
+        if( cumulativeScaleFactors != NULL )
+            cumulativeScaleFactors[k] += logMax;
+    } else {
+        scaleFactors[k] = max;
+        if( cumulativeScaleFactors != NULL )
+            cumulativeScaleFactors[k] += log(max);
+    }
+    return REALTYPE(1.0) / max;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::addScalingTally(const ScalingTally& tally) {
+    std::lock_guard<std::mutex> lock(gScalingStatisticsMutex);
+    BeagleScalingStatistics& statistics = gScalingStatistics;
+    if (tally.patternCount > 0) {
+        bool first = (statistics.patternCount == 0);
+        statistics.minExponent = (first ? tally.minExponent : std::min(statistics.minExponent, tally.minExponent));
+        statistics.maxExponent = (first ? tally.maxExponent : std::max(statistics.maxExponent, tally.maxExponent));
+    }
+    statistics.passCount++;
+    if (tally.rescaledPatternCount == 0)
+        statistics.unchangedPassCount++;
+    statistics.patternCount += tally.patternCount;
+    statistics.rescaledPatternCount += tally.rescaledPatternCount;
+    statistics.nearUnderflowPatternCount += tally.nearUnderflowPatternCount;
+    statistics.exponentSum += tally.exponentSum;
+}
+
+BEAGLE_CPU_TEMPLATE
+inline REALTYPE BeagleCPUImpl<BEAGLE_CPU_GENERIC>::logScaleFactor(REALTYPE scaleFactor) {
+    if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
+        return scaleFactor;
+    if (kExponentScaling) // raw scale factors are exact powers of two
+        return (beagleExponent(scaleFactor) - 1) * REALTYPE(M_LN2);
+    return log(scaleFactor);
+}
+
+BEAGLE_CPU_TEMPLATE
+double BeagleCPUImpl<BEAGLE_CPU_GENERIC>::sumOverPatterns(const REALTYPE* siteValues,
+                                                          int startPattern,
+                                                          int endPattern) {
+    // Halves are summed separately until they are short, so the rounding error grows with the
+    // log of the pattern count rather than with the count. Short runs are summed in eight
+    // independent lanes, which vectorizes without reassociating one long chain.
+    const int count = endPattern - startPattern;
+    if (count > BEAGLE_CPU_PAIRWISE_SUM_PATTERN_COUNT) {
+        int half = count / 2;
+        half -= half % 8;
+        return sumOverPatterns(siteValues, startPattern, startPattern + half) +
+               sumOverPatterns(siteValues, startPattern + half, endPattern);
     }
+
+    double lanes[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    int k = startPattern;
+    for (; k + 8 <= endPattern; k += 8) {
+        for (int j = 0; j < 8; j++)
+            lanes[j] += siteValues[k + j] * gPatternWeights[k + j];
+    }
+    double sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+                 ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    for (; k < endPattern; k++)
+        sum += siteValues[k] * gPatternWeights[k];
+    return sum;
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -3180,8 +5284,13 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
         return BEAGLE_ERROR_NO_IMPLEMENTATION;
     }
 
+    // checkpointed buffers stay in the old pattern order, so the checkpoint is dropped
+    retireCheckpoint(gPartialsCheckpoint);
+    retireCheckpoint(gScaleBuffersCheckpoint);
+    kCheckpointActive = false;
+
     int* partitionSizes = (int*) malloc(kPartitionCount * sizeof(int));
-    double* sortedPatternWeights = (double*) malloc(sizeof(double) * kPatternCount);
+    double* sortedPatternWeights = (double*) calloc(sizeof(double), kPaddedPatternCount);
 
     for (int i=0; i < kPartitionCount; i++) {
         gPatternPartitionsStartPatterns[i] = 0;
@@ -3217,29 +5326,44 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
     gPatternWeights = sortedPatternWeights;
 
     REALTYPE* sortedPartials = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
-    int* sortedTips = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+    TipState* sortedTips = (TipState*) mallocAligned(sizeof(TipState) * kPaddedPatternCount);
 
     for (int tip=0; tip < kTipCount; tip++) {
-        if (gTipStates[tip] == NULL) {
+        if (gTipStateSets[tip] != NULL) {
+            TipState* unsortedSets = gTipStateSets[tip];
+            for (int i=0; i < kPatternCount; i++)
+                sortedTips[gPatternsNewOrder[i]] = unsortedSets[i];
+            for (int i = kPatternCount; i < kPaddedPatternCount; i++)
+                sortedTips[i] = kStateSetCount - 1;
+            gTipStateSets[tip] = sortedTips;
+            sortedTips = unsortedSets;
+        }
+        if (gTipStates[tip] == NULL && gPartials[tip] != NULL) {
             REALTYPE* unsortedPartials = gPartials[tip];
             for (int l=0; l < kCategoryCount; l++) {
                 for (int i=0; i < kPatternCount; i++) {
-                    for (int j=0; j < kStateCount; j++) {
-                        int sortIndex = l*kStateCount*kPatternCount + gPatternsNewOrder[i]*kStateCount + j;
-                        int pIndex = l*kStateCount*kPatternCount + i*kStateCount + j;
+                    for (int j=0; j < kPartialsPaddedStateCount; j++) {
+                        int sortIndex = (l*kPaddedPatternCount + gPatternsNewOrder[i])*kPartialsPaddedStateCount + j;
+                        int pIndex = (l*kPaddedPatternCount + i)*kPartialsPaddedStateCount + j;
                         sortedPartials[sortIndex] = unsortedPartials[pIndex];
                     }
                 }
+                for (int i = kPatternCount; i < kPaddedPatternCount; i++) {
+                    for (int j=0; j < kPartialsPaddedStateCount; j++)
+                        sortedPartials[(l*kPaddedPatternCount + i)*kPartialsPaddedStateCount + j] = 0.0;
+                }
             }
             gPartials[tip] = sortedPartials;
             sortedPartials = unsortedPartials;
-        } else {
-            int* unsortedTips = gTipStates[tip];
+        } else if (gTipStates[tip] != NULL) {
+            TipState* unsortedTips = gTipStates[tip];
             for (int i=0; i < kPatternCount; i++) {
                 int sortIndex = gPatternsNewOrder[i];
                 int pIndex = i;
                 sortedTips[sortIndex] = unsortedTips[pIndex];
             }
+            for (int i = kPatternCount; i < kPaddedPatternCount; i++)
+                sortedTips[i] = kStateCount;
             gTipStates[tip] = sortedTips;
             sortedTips = unsortedTips;
         }        
@@ -3248,7 +5372,12 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
     free(sortedPartials);
     free(sortedTips);
 
+    // partials computed in the old pattern order no longer match their children
+    for (int i = 0; i < kBufferCount; i++)
+        invalidatePartials(i);
+
     kPatternsReordered = true;
+    kConstantPatternsStale = true;
 
     return BEAGLE_SUCCESS;
 }
@@ -3259,14 +5388,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reorderPatternsByPartition() {
  */
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
-                                                         const int* states1,
+                                                         const TipState* states1,
                                                          const REALTYPE* matrices1,
-                                                         const int* states2,
+                                                         const TipState* states2,
                                                          const REALTYPE* matrices2,
                                                          int startPattern,
                                                          int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
         int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
         for (int k = startPattern; k < endPattern; k++) {
@@ -3283,22 +5412,23 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
 
                 w += kTransPaddedStateCount;
             }
-            v += P_PAD;
+            for (int i = 0; i < P_PAD; i++)
+                destP[v++] = 0.0;
         }
     }
 }
 
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALTYPE* destP,
-                                                                     const int* child1States,
+                                                                     const TipState* child1States,
                                                                      const REALTYPE* child1TransMat,
-                                                                     const int* child2States,
+                                                                     const TipState* child2States,
                                                                      const REALTYPE* child2TransMat,
                                                                      const REALTYPE* scaleFactors,
                                                                      int startPattern,
                                                                      int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
     int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
         for (int k = startPattern; k < endPattern; k++) {
@@ -3313,117 +5443,108 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALTYPE* d
 
                 w += kTransPaddedStateCount;
             }
-            v += P_PAD;
+            for (int i = 0; i < P_PAD; i++)
+                destP[v++] = 0.0;
         }
     }
 }
 
+// Amino acid and codon models get their own instantiations of the partials kernels, so the
+// strides and inner loop bounds are constants the compiler can unroll and vectorize.
+#define BEAGLE_CPU_DISPATCH_STATE_COUNT(kernel, scaling, ...) \
+    switch (kStateCount) { \
+        case 20: kernel<20, scaling>(__VA_ARGS__); break; \
+        case 61: kernel<61, scaling>(__VA_ARGS__); break; \
+        default: kernel<0, scaling>(__VA_ARGS__);  break; \
+    }
+
 /*
  * Calculates partial likelihoods at a node when one child has states and one has partials.
  */
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP,
-                                                           const int* states1,
+                                                           const TipState* states1,
                                                            const REALTYPE* matrices1,
                                                            const REALTYPE* partials2,
                                                            const REALTYPE* matrices2,
                                                            int startPattern,
                                                            int endPattern) {
-
-    int matrixIncr = kStateCount;
-
-    // increment for the extra column at the end
-    matrixIncr += T_PAD;
-
-
-    int stateCountModFour = (kStateCount / 4) * 4;
-
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
-        int matrixOffset = l*kMatrixSize;
-        const REALTYPE* partials2Ptr = &partials2[v];
-        REALTYPE* destPtr = &destP[v];
-        for (int k = startPattern; k < endPattern; k++) {
-            int w = l * kMatrixSize;
-            int state1 = states1[k];
-            for (int i = 0; i < kStateCount; i++) {
-                const REALTYPE* matrices2Ptr = matrices2 + matrixOffset + i * matrixIncr;
-                REALTYPE tmp = matrices1[w + state1];
-                REALTYPE sumA = 0.0;
-                REALTYPE sumB = 0.0;                
-                int j = 0;
-                for (; j < stateCountModFour; j += 4) {
-                    sumA += matrices2Ptr[j + 0] * partials2Ptr[j + 0];                  
-                    sumB += matrices2Ptr[j + 1] * partials2Ptr[j + 1];
-                    sumA += matrices2Ptr[j + 2] * partials2Ptr[j + 2];                  
-                    sumB += matrices2Ptr[j + 3] * partials2Ptr[j + 3];                  
-                }
-                for (; j < kStateCount; j++) {
-                    sumA += matrices2Ptr[j] * partials2Ptr[j];                  
-                }               
-                
-                w += matrixIncr;
-                
-                *(destPtr++) = tmp * (sumA + sumB);
-            }
-            destPtr += P_PAD;
-            partials2Ptr += kPartialsPaddedStateCount;
-        }
-    }
+    BEAGLE_CPU_DISPATCH_STATE_COUNT(calcStatesPartialsForStateCount, false,
+                                    destP, states1, matrices1, partials2, matrices2, NULL,
+                                    startPattern, endPattern);
 }
 
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REALTYPE* destP,
-                                                                       const int* states1,
+                                                                       const TipState* states1,
                                                                        const REALTYPE* matrices1,
                                                                        const REALTYPE* partials2,
                                                                        const REALTYPE* matrices2,
                                                                        const REALTYPE* scaleFactors,
                                                                        int startPattern,
                                                                        int endPattern) {
+    BEAGLE_CPU_DISPATCH_STATE_COUNT(calcStatesPartialsForStateCount, true,
+                                    destP, states1, matrices1, partials2, matrices2, scaleFactors,
+                                    startPattern, endPattern);
+}
+
+BEAGLE_CPU_TEMPLATE template <int STATE_COUNT, bool SCALING>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsForStateCount(REALTYPE* destP,
+                                                                        const TipState* states1,
+                                                                        const REALTYPE* matrices1,
+                                                                        const REALTYPE* partials2,
+                                                                        const REALTYPE* matrices2,
+                                                                        const REALTYPE* scaleFactors,
+                                                                        int startPattern,
+                                                                        int endPattern) {
 
-    int matrixIncr = kStateCount;
+    const int stateCount = (STATE_COUNT > 0 ? STATE_COUNT : kStateCount);
+    const int partialsStateCount = stateCount + P_PAD;
 
     // increment for the extra column at the end
-    matrixIncr += T_PAD;
+    const int matrixIncr = stateCount + T_PAD;
+    const int matrixSize = matrixIncr * stateCount;
 
-    int stateCountModFour = (kStateCount / 4) * 4;
+    const int stateCountModFour = (stateCount / 4) * 4;
 
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
-        int matrixOffset = l*kMatrixSize;
+        int v = l*partialsStateCount*kPatternCount + partialsStateCount*startPattern;
+        int matrixOffset = l*matrixSize;
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
         for (int k = startPattern; k < endPattern; k++) {
-            int w = l * kMatrixSize;
+            int w = l * matrixSize;
             int state1 = states1[k];
-            REALTYPE oneOverScaleFactor = REALTYPE(1.0) / scaleFactors[k];
-            for (int i = 0; i < kStateCount; i++) {
+            const REALTYPE oneOverScaleFactor = (SCALING ? REALTYPE(1.0) / scaleFactors[k] : REALTYPE(1.0));
+            for (int i = 0; i < stateCount; i++) {
                 const REALTYPE* matrices2Ptr = matrices2 + matrixOffset + i * matrixIncr;
                 REALTYPE tmp = matrices1[w + state1];
                 REALTYPE sumA = 0.0;
-                REALTYPE sumB = 0.0;                
+                REALTYPE sumB = 0.0;
                 int j = 0;
                 for (; j < stateCountModFour; j += 4) {
-                    sumA += matrices2Ptr[j + 0] * partials2Ptr[j + 0];                  
+                    sumA += matrices2Ptr[j + 0] * partials2Ptr[j + 0];
                     sumB += matrices2Ptr[j + 1] * partials2Ptr[j + 1];
-                    sumA += matrices2Ptr[j + 2] * partials2Ptr[j + 2];                  
-                    sumB += matrices2Ptr[j + 3] * partials2Ptr[j + 3];                  
+                    sumA += matrices2Ptr[j + 2] * partials2Ptr[j + 2];
+                    sumB += matrices2Ptr[j + 3] * partials2Ptr[j + 3];
                 }
-                for (; j < kStateCount; j++) {
-                    sumA += matrices2Ptr[j] * partials2Ptr[j];                  
-                }               
-                
+                for (; j < stateCount; j++) {
+                    sumA += matrices2Ptr[j] * partials2Ptr[j];
+                }
+
                 w += matrixIncr;
-                
-                *(destPtr++) = tmp * (sumA + sumB) * oneOverScaleFactor;
+
+                if (SCALING)
+                    *(destPtr++) = tmp * (sumA + sumB) * oneOverScaleFactor;
+                else
+                    *(destPtr++) = tmp * (sumA + sumB);
             }
-            destPtr += P_PAD;
-            partials2Ptr += kPartialsPaddedStateCount;
+            for (int i = 0; i < P_PAD; i++)
+                *(destPtr++) = 0.0;
+            partials2Ptr += partialsStateCount;
         }
-    }                                            
+    }
 }
 
 /*
@@ -3437,54 +5558,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* destP,
                                                              const REALTYPE* matrices2,
                                                              int startPattern,
                                                              int endPattern) {
-    int matrixIncr = kStateCount;
-
-    // increment for the extra column at the end
-    matrixIncr += T_PAD;
-
-    int stateCountModFour = (kStateCount / 4) * 4;
-
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
-        int matrixOffset = l*kMatrixSize;
-        const REALTYPE* partials1Ptr = &partials1[v];
-        const REALTYPE* partials2Ptr = &partials2[v];
-        REALTYPE* destPtr = &destP[v];
-        for (int k = startPattern; k < endPattern; k++) {
-
-            for (int i = 0; i < kStateCount; i++) {
-                const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + i * matrixIncr;
-                const REALTYPE* matrices2Ptr = matrices2 + matrixOffset + i * matrixIncr;
-                REALTYPE sum1A = 0.0, sum2A = 0.0;
-                REALTYPE sum1B = 0.0, sum2B = 0.0;
-                int j = 0;
-                for (; j < stateCountModFour; j += 4) {
-                    sum1A += matrices1Ptr[j + 0] * partials1Ptr[j + 0];
-                    sum2A += matrices2Ptr[j + 0] * partials2Ptr[j + 0];
-                    
-                    sum1B += matrices1Ptr[j + 1] * partials1Ptr[j + 1];
-                    sum2B += matrices2Ptr[j + 1] * partials2Ptr[j + 1];
-
-                    sum1A += matrices1Ptr[j + 2] * partials1Ptr[j + 2];
-                    sum2A += matrices2Ptr[j + 2] * partials2Ptr[j + 2];
-                    
-                    sum1B += matrices1Ptr[j + 3] * partials1Ptr[j + 3];
-                    sum2B += matrices2Ptr[j + 3] * partials2Ptr[j + 3];                                     
-                }               
-                
-                for (; j < kStateCount; j++) {
-                    sum1A += matrices1Ptr[j] * partials1Ptr[j];
-                    sum2A += matrices2Ptr[j] * partials2Ptr[j];
-                }
-
-                *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B);
-            }
-            destPtr += P_PAD;
-            partials1Ptr += kPartialsPaddedStateCount;
-            partials2Ptr += kPartialsPaddedStateCount;
-        }
-    }
+    BEAGLE_CPU_DISPATCH_STATE_COUNT(calcPartialsPartialsForStateCount, false,
+                                    destP, partials1, matrices1, partials2, matrices2, NULL,
+                                    startPattern, endPattern);
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -3496,24 +5572,40 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYP
                                                                          const REALTYPE* scaleFactors,
                                                                          int startPattern,
                                                                          int endPattern) {
+    BEAGLE_CPU_DISPATCH_STATE_COUNT(calcPartialsPartialsForStateCount, true,
+                                    destP, partials1, matrices1, partials2, matrices2, scaleFactors,
+                                    startPattern, endPattern);
+}
+
+BEAGLE_CPU_TEMPLATE template <int STATE_COUNT, bool SCALING>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsForStateCount(REALTYPE* destP,
+                                                                          const REALTYPE* partials1,
+                                                                          const REALTYPE* matrices1,
+                                                                          const REALTYPE* partials2,
+                                                                          const REALTYPE* matrices2,
+                                                                          const REALTYPE* scaleFactors,
+                                                                          int startPattern,
+                                                                          int endPattern) {
 
-    int matrixIncr = kStateCount;
+    const int stateCount = (STATE_COUNT > 0 ? STATE_COUNT : kStateCount);
+    const int partialsStateCount = stateCount + P_PAD;
 
     // increment for the extra column at the end
-    matrixIncr += T_PAD;
+    const int matrixIncr = stateCount + T_PAD;
+    const int matrixSize = matrixIncr * stateCount;
 
-    int stateCountModFour = (kStateCount / 4) * 4;
-    
-#pragma omp parallel for num_threads(kCategoryCount)
+    const int stateCountModFour = (stateCount / 4) * 4;
+
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
-        int matrixOffset = l*kMatrixSize;
+        int v = l*partialsStateCount*kPatternCount + partialsStateCount*startPattern;
+        int matrixOffset = l*matrixSize;
         const REALTYPE* partials1Ptr = &partials1[v];
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
         for (int k = startPattern; k < endPattern; k++) {
-            REALTYPE oneOverScaleFactor = REALTYPE(1.0) / scaleFactors[k];
-            for (int i = 0; i < kStateCount; i++) {
+            const REALTYPE oneOverScaleFactor = (SCALING ? REALTYPE(1.0) / scaleFactors[k] : REALTYPE(1.0));
+            for (int i = 0; i < stateCount; i++) {
                 const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + i * matrixIncr;
                 const REALTYPE* matrices2Ptr = matrices2 + matrixOffset + i * matrixIncr;
                 REALTYPE sum1A = 0.0, sum2A = 0.0;
@@ -3522,31 +5614,35 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYP
                 for (; j < stateCountModFour; j += 4) {
                     sum1A += matrices1Ptr[j + 0] * partials1Ptr[j + 0];
                     sum2A += matrices2Ptr[j + 0] * partials2Ptr[j + 0];
-                    
+
                     sum1B += matrices1Ptr[j + 1] * partials1Ptr[j + 1];
                     sum2B += matrices2Ptr[j + 1] * partials2Ptr[j + 1];
 
                     sum1A += matrices1Ptr[j + 2] * partials1Ptr[j + 2];
                     sum2A += matrices2Ptr[j + 2] * partials2Ptr[j + 2];
-                    
+
                     sum1B += matrices1Ptr[j + 3] * partials1Ptr[j + 3];
-                    sum2B += matrices2Ptr[j + 3] * partials2Ptr[j + 3];                                     
-                }               
-                
-                for (; j < kStateCount; j++) {
+                    sum2B += matrices2Ptr[j + 3] * partials2Ptr[j + 3];
+                }
+
+                for (; j < stateCount; j++) {
                     sum1A += matrices1Ptr[j] * partials1Ptr[j];
                     sum2A += matrices2Ptr[j] * partials2Ptr[j];
                 }
 
-                *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B) * oneOverScaleFactor;
+                if (SCALING)
+                    *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B) * oneOverScaleFactor;
+                else
+                    *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B);
             }
-            destPtr += P_PAD;
-            partials1Ptr += kPartialsPaddedStateCount;
-            partials2Ptr += kPartialsPaddedStateCount;
+            for (int i = 0; i < P_PAD; i++)
+                *(destPtr++) = 0.0;
+            partials1Ptr += partialsStateCount;
+            partials2Ptr += partialsStateCount;
         }
     }
 }
-    
+
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(REALTYPE* destP,
                                                                const REALTYPE* partials1,
@@ -3589,6 +5685,101 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(REALTYPE
     }
 }
 
+/*
+ * Sums each row of each category's transition matrix over every set of states,
+ * indexed by the bitmask of the set.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStateSetMatrices(REALTYPE* stateSetMatrices,
+                                                             const REALTYPE* matrices) {
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int i = 0; i < kStateCount; i++) {
+            const REALTYPE* row = matrices + l * kMatrixSize + i * kTransPaddedStateCount;
+            REALTYPE* sums = stateSetMatrices + (l * kStateCount + i) * kStateSetCount;
+            sums[0] = 0.0;
+            // the sets whose highest state is s are those below it with s added
+            for (int s = 0; s < kStateCount; s++) {
+                const int highest = 1 << s;
+                for (int stateSet = highest; stateSet < 2 * highest; stateSet++)
+                    sums[stateSet] = sums[stateSet - highest] + row[s];
+            }
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has state sets and the
+ * other has states or state sets, looked up in rows of rowSize2 values. Partials
+ * are divided by scaleFactors where given.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStateSetsStates(REALTYPE* destP,
+                                                            const TipState* stateSets1,
+                                                            const REALTYPE* stateSetMatrices1,
+                                                            const TipState* states2,
+                                                            const REALTYPE* matrices2,
+                                                            int rowSize2,
+                                                            const REALTYPE* scaleFactors,
+                                                            int startPattern,
+                                                            int endPattern) {
+
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+        const REALTYPE* lookup1 = stateSetMatrices1 + l*kStateCount*kStateSetCount;
+        const REALTYPE* lookup2 = matrices2 + l*kStateCount*rowSize2;
+        for (int k = startPattern; k < endPattern; k++) {
+            const int stateSet1 = stateSets1[k];
+            const int state2 = states2[k];
+            const REALTYPE scaleFactor = (scaleFactors != NULL ? scaleFactors[k] : 1.0);
+            for (int i = 0; i < kStateCount; i++) {
+                destP[v++] = lookup1[i*kStateSetCount + stateSet1] *
+                             lookup2[i*rowSize2 + state2] / scaleFactor;
+            }
+            for (int i = 0; i < P_PAD; i++)
+                destP[v++] = 0.0;
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has state sets and one has
+ * partials. Partials are divided by scaleFactors where given.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStateSetsPartials(REALTYPE* destP,
+                                                              const TipState* stateSets1,
+                                                              const REALTYPE* stateSetMatrices1,
+                                                              const REALTYPE* partials2,
+                                                              const REALTYPE* matrices2,
+                                                              const REALTYPE* scaleFactors,
+                                                              int startPattern,
+                                                              int endPattern) {
+
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
+    for (int l = 0; l < kCategoryCount; l++) {
+        int v = (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+        const REALTYPE* lookup1 = stateSetMatrices1 + l*kStateCount*kStateSetCount;
+        for (int k = startPattern; k < endPattern; k++) {
+            const int stateSet1 = stateSets1[k];
+            const REALTYPE* partials2Ptr = &partials2[v];
+            const REALTYPE scaleFactor = (scaleFactors != NULL ? scaleFactors[k] : 1.0);
+            int w = l * kMatrixSize;
+            for (int i = 0; i < kStateCount; i++) {
+                REALTYPE sum = 0.0;
+                for (int j = 0; j < kStateCount; j++)
+                    sum += matrices2[w + j] * partials2Ptr[j];
+                w += kTransPaddedStateCount;
+
+                destP[v++] = lookup1[i*kStateSetCount + stateSet1] * sum / scaleFactor;
+            }
+            for (int i = 0; i < P_PAD; i++)
+                destP[v++] = 0.0;
+        }
+    }
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPaddedPatternsModulus() {
     // Padding only necessary for SSE implementations that vectorize across patterns
@@ -3627,29 +5818,650 @@ void* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::mallocAligned(size_t size) {
 }
 
 BEAGLE_CPU_TEMPLATE
-void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::threadWaiting(threadData* tData)
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createArena(size_t size) {
+#ifdef BEAGLE_CPU_ARENA
+    if (size == 0)
+        return;
+
+    const size_t pageSize = (size >= BEAGLE_CPU_HUGE_PAGE_SIZE ? BEAGLE_CPU_HUGE_PAGE_SIZE : 4096);
+    kArenaSize = (size + pageSize - 1) / pageSize * pageSize;
+    kArenaUsed = 0;
+
+    void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // explicit huge pages only exist if the administrator has reserved some
+    if (pageSize == BEAGLE_CPU_HUGE_PAGE_SIZE)
+        ptr = mmap(NULL, kArenaSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(NULL, kArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (pageSize == BEAGLE_CPU_HUGE_PAGE_SIZE)
+            madvise(ptr, kArenaSize, MADV_HUGEPAGE); // transparent huge pages, where enabled
+#endif
+    }
+    gArena = (char*) ptr;
+#endif
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartialsBackingDirectory(const char* directory) {
+    finishAsynchUpdates();
+#ifdef BEAGLE_CPU_ARENA
+    if (gArena == NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION; // only a MEMORY_ARENA instance has its buffers in one mapping
+    if (directory == NULL || directory[0] == '\0')
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    std::string path = std::string(directory) + "/beagle-partials-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+        return BEAGLE_ERROR_GENERAL;
+    unlink(path.c_str()); // removed by the system once the instance closes it
+
+    // the file starts as a hole; only the chunks of the arena holding data are written to it
+    bool copied = (ftruncate(fd, (off_t) kArenaSize) == 0);
+    const size_t chunkSize = 1 << 20;
+    for (size_t offset = 0; copied && offset < kArenaSize; offset += chunkSize) {
+        const size_t length = std::min(chunkSize, kArenaSize - offset);
+        const char* chunk = gArena + offset;
+        if (chunk[0] == 0 && memcmp(chunk, chunk + 1, length - 1) == 0)
+            continue;
+        for (size_t written = 0; copied && written < length; ) {
+            ssize_t count = pwrite(fd, chunk + written, length - written, (off_t) (offset + written));
+            if (count <= 0)
+                copied = false;
+            else
+                written += count;
+        }
+    }
+
+    // mapped over the arena in place, so every buffer carved from it stays where it is
+    if (!copied ||
+        mmap(gArena, kArenaSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        close(fd);
+        return BEAGLE_ERROR_GENERAL;
+    }
+    if (kArenaFile >= 0)
+        close(kArenaFile);
+    kArenaFile = fd;
+
+    return BEAGLE_SUCCESS;
+#else
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+#endif
+}
+
+BEAGLE_CPU_TEMPLATE
+void* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::allocateBuffer(size_t size) {
+    if (gArena != NULL) {
+        size_t bytes = (size + BEAGLE_CPU_ARENA_ALIGNMENT - 1) / BEAGLE_CPU_ARENA_ALIGNMENT * BEAGLE_CPU_ARENA_ALIGNMENT;
+        assert(kArenaUsed + bytes <= kArenaSize);
+        void* ptr = gArena + kArenaUsed;
+        kArenaUsed += bytes;
+        return ptr;
+    }
+    return mallocAligned(size);
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::allocateDestinationPartials(const int* operations,
+                                                                   int count,
+                                                                   int numOps) {
+    // done on the calling thread so the kernels, which may run on several, only see allocated buffers
+    for (int op = 0; op < count; op++) {
+        const int parIndex = operations[op * numOps];
+        if (parIndex < 0 || parIndex >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[parIndex] == NULL) {
+            gPartials[parIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (gPartials[parIndex] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    for (int op = 0; op < count; op++) {
+        const int child1Index = operations[op * numOps + 3];
+        const int child2Index = operations[op * numOps + 5];
+        if (child1Index < 0 || child1Index >= kBufferCount || child2Index < 0 || child2Index >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[child1Index] == NULL && gTipStates[child1Index] == NULL &&
+            gTipStateSets[child1Index] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (gPartials[child2Index] == NULL && gTipStates[child2Index] == NULL &&
+            gTipStateSets[child2Index] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::freeBuffer(void* ptr) {
+    if (gArena != NULL && (char*) ptr >= gArena && (char*) ptr < gArena + kArenaSize)
+        return; // released with the arena
+    free(ptr);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::prefetchBackedPartials(int bufferIndex) {
+#ifdef BEAGLE_CPU_ARENA
+    const char* partials = (const char*) gPartials[bufferIndex];
+    if (kArenaFile < 0 || partials < gArena || partials >= gArena + kArenaSize)
+        return; // tips and buffers reallocated outside the arena stay in memory
+
+    // every page the buffer touches is read ahead
+    const size_t pageSize = 4096;
+    size_t start = (size_t) (partials - gArena) / pageSize * pageSize;
+    size_t end = std::min(((size_t) (partials - gArena) + sizeof(REALTYPE) * kPartialsSize + pageSize - 1)
+                          / pageSize * pageSize, kArenaSize);
+    madvise(gArena + start, end - start, MADV_WILLNEED);
+#endif
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::writeBackBackedPartials(int bufferIndex) {
+#ifdef BEAGLE_CPU_ARENA
+    const char* partials = (const char*) gPartials[bufferIndex];
+    if (kArenaFile < 0 || partials < gArena || partials >= gArena + kArenaSize)
+        return;
+
+    // only whole pages, so neighbouring buffers keep theirs
+    const size_t pageSize = 4096;
+    size_t start = ((size_t) (partials - gArena) + pageSize - 1) / pageSize * pageSize;
+    size_t end = ((size_t) (partials - gArena) + sizeof(REALTYPE) * kPartialsSize) / pageSize * pageSize;
+    if (end <= start)
+        return;
+#ifdef SYNC_FILE_RANGE_WRITE
+    // starts writing the dirty pages without waiting, so reclaiming them later needs no write
+    sync_file_range(kArenaFile, (off_t) start, (off_t) (end - start), SYNC_FILE_RANGE_WRITE);
+#endif
+#ifdef MADV_COLD
+    madvise(gArena + start, end - start, MADV_COLD); // reclaimed before buffers still in use
+#endif
+#endif
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::startAutoPartitioning()
 {
-    std::unique_lock<std::mutex> l(tData->m, std::defer_lock);
-    while (true)
-    {
-        l.lock();
+    int hardwareThreads = kMaxThreadCount;
+    int partitionCount = 1;
+    bool rootPartitioning = false;
+    // auto, always and dynamic scaling update the scale factors of all patterns at once,
+    // so only fixed scaling can be split into pattern partitions
+    bool partitionedScaling = !(kFlags & (BEAGLE_FLAG_SCALING_AUTO |
+                                          BEAGLE_FLAG_SCALING_ALWAYS |
+                                          BEAGLE_FLAG_SCALING_DYNAMIC));
+    if (hardwareThreads > 1 && partitionedScaling)
+        calibrateAutoPartitioning(hardwareThreads, &partitionCount, &rootPartitioning);
+
+    if (partitionCount > 1) {
+        int* patternPartitions = (int*) malloc(sizeof(int) * kPatternCount);
+        int partitionSize = kPatternCount/partitionCount;
+        for (int i=0; i<kPatternCount; i++) {
+            int sitePartition = i/partitionSize;
+            if (sitePartition > partitionCount - 1)
+                sitePartition = partitionCount - 1;
+            patternPartitions[i] = sitePartition;
+        }
+        setPatternPartitions(partitionCount, patternPartitions);
+        free(patternPartitions);
 
-        // Wait until the queue won't be empty or stop is signaled
-        tData->cv.wait(l, [tData] () {
-            return (tData->stop || !tData->jobs.empty()); 
-            });
+        gAutoPartitionOperations = (int*) malloc(sizeof(int) * kBufferCount * kPartitionCount * BEAGLE_PARTITION_OP_COUNT);
+
+        if (rootPartitioning) {
+            gAutoPartitionIndices = (int*) malloc(sizeof(int) * partitionCount);
+            for (int i=0; i<partitionCount; i++) {
+                gAutoPartitionIndices[i] = i;
+            }
+            gAutoPartitionOutSumLogLikelihoods = (double*) malloc(sizeof(double) * partitionCount);
+            kAutoRootPartitioningEnabled = true;
+        }
+
+        kAutoPartitioningEnabled = true;
+    } else if (hardwareThreads > 1) {
+        // too few patterns to split, but independent subtrees can still be updated concurrently
+        startThreading(hardwareThreads, 1);
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::stopAutoPartitioning()
+{
+    free(gAutoPartitionOperations);
+    if (kAutoRootPartitioningEnabled) {
+        free(gAutoPartitionIndices);
+        free(gAutoPartitionOutSumLogLikelihoods);
+        kAutoRootPartitioningEnabled = false;
+    }
+    kAutoPartitioningEnabled = false;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::startPartitionThreading(int partitionCount)
+{
+    if (kTraversalThreadingEnabled) {
+        stopThreading();
+    }
+
+    if (kFlags & BEAGLE_FLAG_THREADING_CPP) {
+        int hardwareThreads = kMaxThreadCount;
+        if (hardwareThreads > 1 && partitionCount > 1 && kPatternCount >= BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT) {
+            int threadCount = hardwareThreads;
+            if (partitionCount < threadCount)
+                threadCount = partitionCount;
+
+            startThreading(threadCount, kMaxPartitionCount);
+
+            kThreadingEnabled = true;
+        } else if (hardwareThreads > 1) {
+            startThreading(hardwareThreads, kMaxPartitionCount);
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calibrateAutoPartitioning(int threadCount,
+                                                                  int* outPartitionCount,
+                                                                  bool* outRootPartitioning)
+{
+    // Splitting patterns only pays where each thread's share of a call outweighs the cost
+    // of handing it to the pool, and both depend on the host. Time one partials operation
+    // and one pool round trip the first time a kernel is used with this shape, and keep
+    // the results for the rest of the process.
+    typedef std::chrono::steady_clock Clock;
+
+    static std::mutex calibrationMutex;
+    static std::map<std::string, std::pair<double, double> > calibrations;
+
+    BeagleCPUThreadPool& pool = getThreadPool();
+    if (threadCount > pool.getThreadCount() + 1)
+        threadCount = pool.getThreadCount() + 1;
+
+    *outPartitionCount = 1;
+    *outRootPartitioning = false;
+    if (threadCount < 2 || kPatternCount < 2 * BEAGLE_CPU_ASYNC_MIN_PARTITION_PATTERN_COUNT)
+        return;
+
+    std::string key = std::string(getName()) + ":" + std::to_string(kStateCount) + ":" +
+                      std::to_string(kCategoryCount) + ":" + std::to_string(threadCount);
+
+    std::unique_lock<std::mutex> lock(calibrationMutex);
+    if (calibrations.find(key) == calibrations.end()) {
+        int patternCount = (kPatternCount < BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT ?
+                            kPatternCount : BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT);
+
+        // only the calibrated pattern range of each category is ever touched
+        REALTYPE* partials[3];
+        for (int i = 0; i < 3; i++) {
+            partials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (partials[i] == NULL)
+                throw std::bad_alloc();
+            for (int l = 0; l < kCategoryCount; l++) {
+                REALTYPE* p = partials[i] + l * kPaddedPatternCount * kPartialsPaddedStateCount;
+                for (int j = 0; j < patternCount * kPartialsPaddedStateCount; j++)
+                    p[j] = (REALTYPE) (0.25 + 0.5 * ((j * 7 + i) % 11) / 11.0);
+            }
+        }
+        REALTYPE* matrix = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
+        if (matrix == NULL)
+            throw std::bad_alloc();
+        for (int j = 0; j < kMatrixSize * kCategoryCount; j++)
+            matrix[j] = (REALTYPE) (1.0 / kStateCount);
+
+        double operationTime = 0;
+        for (int rep = 0; rep < 8; rep++) {
+            Clock::time_point start = Clock::now();
+            calcPartialsPartials(partials[0], partials[1], matrix, partials[2], matrix, 0, patternCount);
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            if (rep == 1 || (rep > 1 && elapsed < operationTime))
+                operationTime = elapsed; // the first repetition only warms the caches
+        }
+
+        for (int i = 0; i < 3; i++)
+            free(partials[i]);
+        free(matrix);
+
+        std::vector<std::shared_future<void> > futures(threadCount - 1);
+        double dispatchTime = 0;
+        for (int rep = 0; rep < 16; rep++) {
+            Clock::time_point start = Clock::now();
+            for (int t = 0; t < threadCount - 1; t++)
+                futures[t] = pool.submit([] () {});
+            for (int t = 0; t < threadCount - 1; t++)
+                futures[t].wait();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            if (rep == 1 || (rep > 1 && elapsed < dispatchTime))
+                dispatchTime = elapsed;
+        }
+
+        calibrations[key] = std::make_pair(operationTime / patternCount, dispatchTime);
+    }
+    double patternTime = calibrations[key].first;
+    double dispatchTime = calibrations[key].second;
+    lock.unlock();
+
+    int minPartitionPatterns = BEAGLE_CPU_ASYNC_MIN_PARTITION_PATTERN_COUNT;
+    if (patternTime > 0 && dispatchTime > 0) {
+        // a full traversal updates one partials buffer per internal node
+        int operationCount = (kTipCount > 2 ? kTipCount - 1 : 1);
+        double patterns = BEAGLE_CPU_ASYNC_DISPATCH_RATIO * dispatchTime / (operationCount * patternTime);
+        if (patterns > kPatternCount)
+            return;
+        if (patterns > minPartitionPatterns)
+            minPartitionPatterns = (int) patterns;
+    } else {
+        // the clock was too coarse to tell, so fall back on a fixed threshold
+        if (kPatternCount < BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT)
+            return;
+        minPartitionPatterns = BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT / 2;
+    }
+
+    int partitionCount = kPatternCount / minPartitionPatterns;
+    if (partitionCount > threadCount)
+        partitionCount = threadCount;
+    if (partitionCount < 2)
+        return;
+
+    *outPartitionCount = partitionCount;
+
+    // root and edge integration is a single pass over the patterns, costing about
+    // as much as one partials operation
+    int partitionPatterns = kPatternCount / partitionCount;
+    if (patternTime > 0 && dispatchTime > 0)
+        *outRootPartitioning = (partitionPatterns * patternTime >= BEAGLE_CPU_ASYNC_DISPATCH_RATIO * dispatchTime);
+    else
+        *outRootPartitioning = (kPatternCount >= BEAGLE_CPU_ASYNC_MIN_PATTERN_COUNT * 4);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::startThreading(int threadCount,
+                                                       int partitionCount)
+{
+    // The worker threads belong to the shared pool; an instance only decides how
+    // many jobs it spreads a call over. A THREADING_NUMA instance binds its workers to
+    // nodes, so it has a pool of its own, sized for the threads it may use.
+    if ((kFlags & BEAGLE_FLAG_THREADING_NUMA) &&
+        (gNodePool == NULL || gNodePool->getThreadCount() != threadCount)) {
+        delete gNodePool;
+        gNodePool = new BeagleCPUThreadPool(threadCount);
+        gNodePool->bindThreadsToNodes();
+    }
+
+    int poolThreadCount = getThreadPool().getThreadCount();
+    kNumThreads = threadCount;
+    if (kNumThreads > poolThreadCount + 1)
+        kNumThreads = poolThreadCount + 1;
+
+    gFutures = new std::shared_future<void>[kNumThreads];
+    if (gFutures == NULL)
+        throw std::bad_alloc();
+
+    // work items are either partitions or the operations at one level of the traversal
+    kThreadWorkCapacity = (partitionCount > kBufferCount ? partitionCount : kBufferCount);
+
+    gPartitionOperations = (int*) malloc(sizeof(int) * BEAGLE_PARTITION_OP_COUNT * kBufferCount * partitionCount);
+    gPartitionOpCounts = (int*) malloc(sizeof(int) * partitionCount);
+    gPartitionOpOffsets = (int*) malloc(sizeof(int) * partitionCount);
+    gThreadWorkCosts = (long*) malloc(sizeof(long) * kThreadWorkCapacity);
+    gThreadWorkOrder = (int*) malloc(sizeof(int) * kThreadWorkCapacity);
+    gThreadWorkPartitions = (int*) malloc(sizeof(int) * kThreadWorkCapacity);
+    if (gPartitionOperations == NULL || gPartitionOpCounts == NULL || gPartitionOpOffsets == NULL ||
+        gThreadWorkCosts == NULL || gThreadWorkOrder == NULL || gThreadWorkPartitions == NULL)
+        throw std::bad_alloc();
+    gThreadWorkClaims = new std::atomic<int>[kThreadWorkCapacity];
+
+    kTraversalThreadingEnabled = true;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::stopThreading()
+{
+    delete[] gFutures;
+
+    free(gPartitionOperations);
+    free(gPartitionOpCounts);
+    free(gPartitionOpOffsets);
+    free(gThreadWorkCosts);
+    free(gThreadWorkOrder);
+    free(gThreadWorkPartitions);
+    delete[] gThreadWorkClaims;
+
+    kThreadingEnabled = false;
+    kTraversalThreadingEnabled = false;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::dispatchThreadWork(int itemCount,
+                                                           bool partitionItems,
+                                                           const std::function<void(int)>& work)
+{
+    // Items are claimed dynamically from a shared counter rather than being assigned to
+    // a fixed thread, so threads that finish early pick up the remaining work.
+    // gThreadWorkCosts[i] must hold an estimate of the cost of item i, and for
+    // partitionItems gThreadWorkPartitions[i] the pattern partition item i works on.
+    for (int i=0; i<itemCount; i++) {
+        gThreadWorkOrder[i] = i;
+    }
+    std::stable_sort(gThreadWorkOrder, gThreadWorkOrder + itemCount, [this] (int a, int b) {
+        return gThreadWorkCosts[a] > gThreadWorkCosts[b];
+    });
+
+    if (partitionItems && (kFlags & BEAGLE_FLAG_THREADING_NUMA)) {
+        dispatchThreadWorkByOwner(itemCount, work);
+        return;
+    }
 
-        // Stop was signaled, let's exit the thread
-        if (tData->stop) { return; }
+    gThreadWorkIndex.store(0);
 
-        // Pop one task from the queue...
-        std::packaged_task<void()> j = std::move(tData->jobs.front());
-        tData->jobs.pop();
+    std::function<void()> worker = [this, itemCount, &work] () {
+        int w;
+        while ((w = gThreadWorkIndex.fetch_add(1)) < itemCount) {
+            work(gThreadWorkOrder[w]);
+        }
+    };
+
+    int jobCount = (itemCount < kNumThreads ? itemCount : kNumThreads) - 1;
+
+    BeagleCPUThreadPool& pool = getThreadPool();
+    for (int i=0; i<jobCount; i++) {
+        gFutures[i] = pool.submit(worker);
+    }
+
+    // the calling thread takes part too, so the call makes progress even when the
+    // pool is busy with work from other instances
+    worker();
+
+    for (int i=0; i<jobCount; i++) {
+        gFutures[i].wait();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::dispatchThreadWorkByOwner(int itemCount,
+                                                                  const std::function<void(int)>& work)
+{
+    // Each partition belongs to the node-bound pool worker that first touched its slice of
+    // the partials (see placePartialsByPartition); owners run their own partitions first
+    // and then help with whatever is left unclaimed. The calling thread is not bound
+    // and only waits.
+    int ownerCount = getPartitionOwnerCount();
+
+    for (int i=0; i<itemCount; i++) {
+        gThreadWorkClaims[i].store(0);
+    }
 
+    std::function<void(int)> worker = [this, itemCount, ownerCount, &work] (int owner) {
+        for (int pass = 0; pass < 2; pass++) {
+            for (int w = 0; w < itemCount; w++) {
+                int item = gThreadWorkOrder[w];
+                if (pass == 0 && gThreadWorkPartitions[item] % ownerCount != owner)
+                    continue;
+                if (gThreadWorkClaims[item].exchange(1) == 0)
+                    work(item);
+            }
+        }
+    };
+
+    int jobCount = (itemCount < ownerCount ? itemCount : ownerCount);
+
+    BeagleCPUThreadPool& pool = getThreadPool();
+    for (int i=0; i<jobCount; i++) {
+        gFutures[i] = pool.submitTo(i, std::bind(worker, i));
+    }
+
+    for (int i=0; i<jobCount; i++) {
+        gFutures[i].wait();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::queueAsynchUpdate(const int* operations,
+                                                         int count,
+                                                         int cumulativeScaleIndex)
+{
+    // Checked and allocated here so errors in the operations are returned at once. A queued
+    // update only reads buffers allocated before it, so allocating another is safe meanwhile.
+    int returnCode = allocateDestinationPartials(operations, count, BEAGLE_OP_COUNT);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    AsynchUpdate update;
+    update.operations.assign(operations, operations + count * BEAGLE_OP_COUNT);
+    update.cumulativeScaleIndex = cumulativeScaleIndex;
+
+    kAsynchQueuedCount++;
+    for (int op = 0; op < count; op++)
+        gAsynchWriteTickets[operations[op * BEAGLE_OP_COUNT]] = kAsynchQueuedCount;
+
+    std::unique_lock<std::mutex> l(gAsynchMutex);
+    gAsynchQueue.push(std::move(update));
+    // started under the lock, which the thread takes first, so it finds itself in gAsynchThread
+    if (!gAsynchThread.joinable())
+        gAsynchThread = std::thread(&BeagleCPUImpl<BEAGLE_CPU_GENERIC>::runAsynchUpdates, this);
+    l.unlock();
+
+    gAsynchCondition.notify_all();
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::runAsynchUpdates()
+{
+    // This thread stands in for the caller, so an update is threaded as it would be
+    // synchronously and never waits on pool workers busy with its own kind of job
+    std::unique_lock<std::mutex> l(gAsynchMutex);
+    while (true) {
+        gAsynchCondition.wait(l, [this] () {
+            return kAsynchStopping || !gAsynchQueue.empty();
+        });
+        if (gAsynchQueue.empty())
+            return;
+
+        AsynchUpdate& update = gAsynchQueue.front();
         l.unlock();
 
-        // Execute the task!
-        j();
+        int returnCode = upPartialsAllocated(update.operations.data(),
+                                             (int) (update.operations.size() / BEAGLE_OP_COUNT),
+                                             update.cumulativeScaleIndex);
+
+        l.lock();
+        if (returnCode != BEAGLE_SUCCESS && kAsynchReturnCode == BEAGLE_SUCCESS)
+            kAsynchReturnCode = returnCode;
+        gAsynchQueue.pop();
+        kAsynchFinishedCount++;
+        gAsynchCondition.notify_all();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForAsynchUpdates(unsigned long long ticket)
+{
+    std::unique_lock<std::mutex> l(gAsynchMutex);
+    gAsynchCondition.wait(l, [this, ticket] () {
+        return kAsynchFinishedCount >= ticket;
+    });
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::finishAsynchUpdates()
+{
+    // the queued updates themselves may call back into the instance
+    if (!kAsynchEnabled || std::this_thread::get_id() == gAsynchThread.get_id())
+        return;
+    waitForAsynchUpdates(kAsynchQueuedCount);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::stopAsynchUpdates()
+{
+    std::unique_lock<std::mutex> l(gAsynchMutex);
+    kAsynchStopping = true;
+    l.unlock();
+
+    gAsynchCondition.notify_all();
+
+    // the queue is drained before the thread stops
+    if (gAsynchThread.joinable())
+        gAsynchThread.join();
+}
+
+BEAGLE_CPU_TEMPLATE
+BeagleCPUThreadPool& BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getThreadPool()
+{
+    return (gNodePool != NULL ? *gNodePool : BeagleCPUThreadPool::getInstance());
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPartitionOwnerCount()
+{
+    int poolThreadCount = getThreadPool().getThreadCount();
+    return (kNumThreads < poolThreadCount ? kNumThreads : poolThreadCount);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::placePartialsByPartition()
+{
+    // Linux places a page on the node of the thread that first writes it, so have the
+    // owner of each partition write its pattern range of every internal buffer before
+    // anything else does. Pages that were already touched are not moved.
+    int ownerCount = getPartitionOwnerCount();
+
+    BeagleCPUThreadPool& pool = getThreadPool();
+    std::vector<std::shared_future<void> > placed;
+
+    for (int p = 0; p < kPartitionCount; p++) {
+        placed.push_back(pool.submitTo(p % ownerCount, [this, p] () {
+            int startPattern = gPatternPartitionsStartPatterns[p];
+            int endPattern = gPatternPartitionsStartPatterns[p + 1];
+            if (p == kPartitionCount - 1)
+                endPattern = kPaddedPatternCount;
+
+            size_t partialsLength = sizeof(REALTYPE) * (endPattern - startPattern) * kPartialsPaddedStateCount;
+            for (int i = kTipCount; i < kBufferCount; i++) {
+                if (gPartials[i] == NULL)
+                    continue; // placed by whichever partition owner writes it first
+                for (int l = 0; l < kCategoryCount; l++) {
+                    memset(&gPartials[i][(l * kPaddedPatternCount + startPattern) * kPartialsPaddedStateCount],
+                           0, partialsLength);
+                }
+            }
+
+            if (!(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC))) {
+                for (int i = 0; i < kScaleBufferCount; i++) {
+                    memset(&gScaleBuffers[i][startPattern], 0, sizeof(REALTYPE) * (endPattern - startPattern));
+                }
+            }
+        }));
+    }
+
+    for (size_t i = 0; i < placed.size(); i++) {
+        placed[i].wait();
     }
 }
 
@@ -3667,8 +6479,8 @@ BeagleImpl* BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tip
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     BeagleImpl* impl = new BeagleCPUImpl<REALTYPE, T_PAD_DEFAULT, P_PAD_DEFAULT>();
@@ -3699,16 +6511,41 @@ BeagleImpl* BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tip
 }
 
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                         int partialsBufferCount,
+                                                                         int compactBufferCount,
+                                                                         int stateCount,
+                                                                         int patternCount,
+                                                                         int eigenBufferCount,
+                                                                         int matrixBufferCount,
+                                                                         int categoryCount,
+                                                                         int scaleBufferCount,
+                                                                         int resourceNumber,
+                                                                         int pluginResourceNumber,
+                                                                         long long preferenceFlags,
+                                                                         long long requirementFlags,
+                                                                         size_t* outBytes) {
+    *outBytes = BeagleCPUImpl<REALTYPE, T_PAD_DEFAULT, P_PAD_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
     return getBeagleCPUName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 BEAGLE_CPU_FACTORY_TEMPLATE
-const long BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
-    long flags = BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
+    long long flags = BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
                  BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
-                 BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+                 BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+                 BEAGLE_CPU_ARENA_FLAGS |
+                 BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
                  BEAGLE_FLAG_PROCESSOR_CPU |
                  BEAGLE_FLAG_VECTOR_NONE |
                  BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
@@ -0,0 +1,179 @@
+/*
+ *  BeagleCPUNEONImpl.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BeagleCPUNEONImpl__
+#define __BeagleCPUNEONImpl__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include "libhmsbeagle/CPU/BeagleCPUImpl.h"
+
+#include <vector>
+
+#define T_PAD_NEON_DEFAULT      1   // Pad transition matrix rows with an extra 1.0 for ambiguous characters
+#define P_PAD_NEON_DEFAULT      0   // Partials padding not needed, an odd last state is stored by lane
+
+// Largest state count whose transposed matrices are kept on the stack; larger
+// models fall back to the scalar kernels
+#define BEAGLE_CPU_NEON_MAX_STATE_COUNT     64
+
+#define BEAGLE_CPU_NEON_DOUBLE      double, T_PAD, P_PAD
+#define BEAGLE_CPU_NEON_TEMPLATE    template <int T_PAD, int P_PAD>
+
+namespace beagle {
+namespace cpu {
+
+BEAGLE_CPU_TEMPLATE
+class BeagleCPUNEONImpl : public BeagleCPUImpl<BEAGLE_CPU_GENERIC> {};
+
+/*
+ * Double-precision kernels for any state count. Transition matrices are transposed
+ * per rate category so that two destination states are updated by each fused
+ * multiply-add; an odd state count stores only the low lane of the last vector.
+ */
+BEAGLE_CPU_NEON_TEMPLATE
+class BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE> : public BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE> {
+
+protected:
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kTipCount;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gPartials;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::integrationTmp;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gTransitionMatrices;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kPatternCount;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kPaddedPatternCount;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kExtraPatterns;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kStateCount;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gTipStates;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gScaleBuffers;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gCategoryWeights;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::gStateFrequencies;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::realtypeMin;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kMatrixSize;
+	using BeagleCPUImpl<BEAGLE_CPU_NEON_DOUBLE>::kPartialsPaddedStateCount;
+
+public:
+    virtual const char* getName();
+
+    virtual const long long getFlags();
+
+protected:
+    virtual int getPaddedPatternsModulus();
+
+private:
+    virtual void calcStatesPartials(double* destP,
+                                    const TipState* states1,
+                                    const double* matrices1,
+                                    const double* partials2,
+                                    const double* matrices2,
+                                    int startPattern,
+                                    int endPattern);
+
+    virtual void calcStatesPartialsFixedScaling(double* destP,
+                                                const TipState* states1,
+                                                const double* matrices1,
+                                                const double* partials2,
+                                                const double* matrices2,
+                                                const double* scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
+
+    virtual void calcPartialsPartials(double* __restrict destP,
+                                      const double* __restrict partials1,
+                                      const double* __restrict matrices1,
+                                      const double* __restrict partials2,
+                                      const double* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
+
+    virtual void calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                  const double* __restrict partials1,
+                                                  const double* __restrict matrices1,
+                                                  const double* __restrict partials2,
+                                                  const double* __restrict matrices2,
+                                                  const double* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
+
+    // Shared body of the four kernels above; states1 is NULL when child 1 has partials
+    // and scaleFactors is NULL when the result is not rescaled
+    void calcProductByPatternRange(double* __restrict destP,
+                                   const TipState* states1,
+                                   const double* __restrict partials1,
+                                   const double* __restrict matrices1,
+                                   const double* __restrict partials2,
+                                   const double* __restrict matrices2,
+                                   const double* __restrict scaleFactors,
+                                   int startPattern,
+                                   int endPattern);
+
+};
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+class BeagleCPUNEONImplFactory : public BeagleImplFactory {
+public:
+    virtual BeagleImpl* createImpl(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   int* errorCode);
+
+    virtual const char* getName();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
+};
+
+}	// namespace cpu
+}	// namespace beagle
+
+// now include the file containing template function implementations
+#include "libhmsbeagle/CPU/BeagleCPUNEONImpl.hpp"
+
+
+#endif // __BeagleCPUNEONImpl__
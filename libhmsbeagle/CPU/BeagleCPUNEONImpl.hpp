@@ -0,0 +1,320 @@
+/*
+ *  BeagleCPUNEONImpl.hpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BEAGLE_CPU_NEON_IMPL_HPP
+#define BEAGLE_CPU_NEON_IMPL_HPP
+
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/CPU/BeagleCPUImpl.h"
+#include "libhmsbeagle/CPU/BeagleCPUNEONImpl.h"
+#include "libhmsbeagle/CPU/NEONDefinitions.h"
+
+namespace beagle {
+namespace cpu {
+
+/* Transposes a stateCount x columnCount transition matrix so that row j holds
+   P(i -> j) for all i, each row zero-filled to a multiple of the vector width */
+static inline void neonTransposeMatrix(const double* matrix,
+                                       double* transposed,
+                                       int stateCount,
+                                       int columnCount,
+                                       int stride) {
+    for (int j = 0; j < columnCount; j++) {
+        int i = 0;
+        for (; i < stateCount; i++)
+            transposed[j * stride + i] = matrix[i * columnCount + j];
+        for (; i < stride; i++)
+            transposed[j * stride + i] = 0.0;
+    }
+}
+
+/* out[i] = sum_j P(i -> j) partials[j]; two states per vector, two accumulation chains */
+static inline void neonMatrixTimesPartials(double* out,
+                                           const double* transposed,
+                                           const double* partials,
+                                           int stateCount,
+                                           int stride) {
+    for (int b = 0; b < stride; b += NEON_DOUBLES_PER_VEC) {
+        float64x2_t sumA = vdupq_n_f64(0.0);
+        float64x2_t sumB = vdupq_n_f64(0.0);
+        int j = 0;
+        for (; j < stateCount - 1; j += 2) {
+            const float64x2_t p = vld1q_f64(partials + j);
+            sumA = vfmaq_laneq_f64(sumA, vld1q_f64(transposed + j * stride + b), p, 0);
+            sumB = vfmaq_laneq_f64(sumB, vld1q_f64(transposed + (j + 1) * stride + b), p, 1);
+        }
+        if (j < stateCount) {
+            sumA = vfmaq_n_f64(sumA, vld1q_f64(transposed + j * stride + b), partials[j]);
+        }
+        vst1q_f64(out + b, vaddq_f64(sumA, sumB));
+    }
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+inline const char* getBeagleCPUNEONName(){ return "CPU-NEON-Unknown"; };
+
+template<>
+inline const char* getBeagleCPUNEONName<double>(){ return "CPU-NEON-Double"; };
+
+BEAGLE_CPU_NEON_TEMPLATE
+void BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::calcProductByPatternRange(double* __restrict destP,
+                                                                          const TipState* states1,
+                                                                          const double* __restrict partials1,
+                                                                          const double* __restrict matrices1,
+                                                                          const double* __restrict partials2,
+                                                                          const double* __restrict matrices2,
+                                                                          const double* __restrict scaleFactors,
+                                                                          int startPattern,
+                                                                          int endPattern) {
+
+    const int matrixIncr = kStateCount + T_PAD;
+    const int stride = ((kStateCount + NEON_DOUBLES_PER_VEC - 1) / NEON_DOUBLES_PER_VEC) * NEON_DOUBLES_PER_VEC;
+
+    // Kept on the stack since several partition threads may run kernels on one instance
+    double transposed1[(BEAGLE_CPU_NEON_MAX_STATE_COUNT + T_PAD) * BEAGLE_CPU_NEON_MAX_STATE_COUNT];
+    double transposed2[(BEAGLE_CPU_NEON_MAX_STATE_COUNT + T_PAD) * BEAGLE_CPU_NEON_MAX_STATE_COUNT];
+    double sum1[BEAGLE_CPU_NEON_MAX_STATE_COUNT];
+    double sum2[BEAGLE_CPU_NEON_MAX_STATE_COUNT];
+
+    for (int l = 0; l < kCategoryCount; l++) {
+        neonTransposeMatrix(matrices1 + l*kMatrixSize, transposed1, kStateCount, matrixIncr, stride);
+        neonTransposeMatrix(matrices2 + l*kMatrixSize, transposed2, kStateCount, matrixIncr, stride);
+
+        int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
+        for (int k = startPattern; k < endPattern; k++) {
+            const double* child1;
+            if (states1 != NULL) {
+                // the transposed row of a state is P(i -> state), including the ambiguous column
+                child1 = transposed1 + states1[k] * stride;
+            } else {
+                neonMatrixTimesPartials(sum1, transposed1, partials1 + v, kStateCount, stride);
+                child1 = sum1;
+            }
+            neonMatrixTimesPartials(sum2, transposed2, partials2 + v, kStateCount, stride);
+
+            double* destPtr = destP + v;
+            const float64x2_t oneOverScaleFactor = vdupq_n_f64(scaleFactors != NULL ? 1.0 / scaleFactors[k] : 1.0);
+            int b = 0;
+            for (; b < kStateCount - 1; b += NEON_DOUBLES_PER_VEC) {
+                vst1q_f64(destPtr + b,
+                          vmulq_f64(vmulq_f64(vld1q_f64(child1 + b), vld1q_f64(sum2 + b)), oneOverScaleFactor));
+            }
+            if (b < kStateCount) {
+                destPtr[b] = child1[b] * sum2[b] * vgetq_lane_f64(oneOverScaleFactor, 0);
+            }
+            v += kPartialsPaddedStateCount;
+        }
+    }
+}
+
+/*
+ * Calculates partial likelihoods at a node when one child has states and one has partials.
+ */
+BEAGLE_CPU_NEON_TEMPLATE
+void BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::calcStatesPartials(double* destP,
+                                                                   const TipState* states1,
+                                                                   const double* matrices1,
+                                                                   const double* partials2,
+                                                                   const double* matrices2,
+                                                                   int startPattern,
+                                                                   int endPattern) {
+    calcProductByPatternRange(destP, states1, NULL, matrices1, partials2, matrices2, NULL,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_NEON_TEMPLATE
+void BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::calcStatesPartialsFixedScaling(double* destP,
+                                                                               const TipState* states1,
+                                                                               const double* matrices1,
+                                                                               const double* partials2,
+                                                                               const double* matrices2,
+                                                                               const double* scaleFactors,
+                                                                               int startPattern,
+                                                                               int endPattern) {
+    calcProductByPatternRange(destP, states1, NULL, matrices1, partials2, matrices2, scaleFactors,
+                              startPattern, endPattern);
+}
+
+/*
+ * Calculates partial likelihoods at a node when both children have partials.
+ */
+BEAGLE_CPU_NEON_TEMPLATE
+void BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::calcPartialsPartials(double* __restrict destP,
+                                                                     const double* __restrict partials1,
+                                                                     const double* __restrict matrices1,
+                                                                     const double* __restrict partials2,
+                                                                     const double* __restrict matrices2,
+                                                                     int startPattern,
+                                                                     int endPattern) {
+    calcProductByPatternRange(destP, NULL, partials1, matrices1, partials2, matrices2, NULL,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_NEON_TEMPLATE
+void BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::calcPartialsPartialsFixedScaling(double* __restrict destP,
+                                                                                 const double* __restrict partials1,
+                                                                                 const double* __restrict matrices1,
+                                                                                 const double* __restrict partials2,
+                                                                                 const double* __restrict matrices2,
+                                                                                 const double* __restrict scaleFactors,
+                                                                                 int startPattern,
+                                                                                 int endPattern) {
+    calcProductByPatternRange(destP, NULL, partials1, matrices1, partials2, matrices2, scaleFactors,
+                              startPattern, endPattern);
+}
+
+BEAGLE_CPU_NEON_TEMPLATE
+int BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::getPaddedPatternsModulus() {
+	return 1;  // We vectorize across states, not patterns
+}
+
+BEAGLE_CPU_NEON_TEMPLATE
+const char* BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::getName() {
+	return getBeagleCPUNEONName<double>();
+}
+
+BEAGLE_CPU_NEON_TEMPLATE
+const long long BeagleCPUNEONImpl<BEAGLE_CPU_NEON_DOUBLE>::getFlags() {
+	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
+            BEAGLE_FLAG_PROCESSOR_CPU |
+            BEAGLE_FLAG_PRECISION_DOUBLE |
+            BEAGLE_FLAG_VECTOR_NEON |
+            BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeagleImplFactory public methods
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+BeagleImpl* BeagleCPUNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int tipCount,
+                                             int partialsBufferCount,
+                                             int compactBufferCount,
+                                             int stateCount,
+                                             int patternCount,
+                                             int eigenBufferCount,
+                                             int matrixBufferCount,
+                                             int categoryCount,
+                                             int scaleBufferCount,
+                                             int resourceNumber,
+                                             int pluginResourceNumber,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
+                                             int* errorCode) {
+
+    if (stateCount > BEAGLE_CPU_NEON_MAX_STATE_COUNT)
+        return NULL;
+
+    if (!CPUSupportsNEON())
+        return NULL;
+
+    BeagleCPUNEONImpl<REALTYPE, T_PAD_NEON_DEFAULT, P_PAD_NEON_DEFAULT>* impl =
+            new BeagleCPUNEONImpl<REALTYPE, T_PAD_NEON_DEFAULT, P_PAD_NEON_DEFAULT>();
+
+    try {
+        if (impl->createInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                 patternCount, eigenBufferCount, matrixBufferCount,
+                                 categoryCount,scaleBufferCount, resourceNumber,
+                                 pluginResourceNumber,
+                                 preferenceFlags, requirementFlags) == 0)
+            return impl;
+    }
+    catch(...) {
+        if (DEBUGGING_OUTPUT)
+            std::cerr << "exception in initialize\n";
+        delete impl;
+        throw;
+    }
+
+    delete impl;
+
+    return NULL;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                             int partialsBufferCount,
+                                                                             int compactBufferCount,
+                                                                             int stateCount,
+                                                                             int patternCount,
+                                                                             int eigenBufferCount,
+                                                                             int matrixBufferCount,
+                                                                             int categoryCount,
+                                                                             int scaleBufferCount,
+                                                                             int resourceNumber,
+                                                                             int pluginResourceNumber,
+                                                                             long long preferenceFlags,
+                                                                             long long requirementFlags,
+                                                                             size_t* outBytes) {
+    if (stateCount > BEAGLE_CPU_NEON_MAX_STATE_COUNT)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (!CPUSupportsNEON())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    *outBytes = BeagleCPUNEONImpl<REALTYPE, T_PAD_NEON_DEFAULT, P_PAD_NEON_DEFAULT>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_FACTORY_TEMPLATE
+const char* BeagleCPUNEONImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
+	return getBeagleCPUNEONName<BEAGLE_CPU_FACTORY_GENERIC>();
+}
+
+template <>
+const long long BeagleCPUNEONImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
+           BEAGLE_FLAG_PROCESSOR_CPU |
+           BEAGLE_FLAG_VECTOR_NEON |
+           BEAGLE_FLAG_PRECISION_DOUBLE |
+           BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
+           BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
+           BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_FRAMEWORK_CPU;
+}
+
+}
+}
+
+#endif //BEAGLE_CPU_NEON_IMPL_HPP
@@ -0,0 +1,56 @@
+/**
+ * libhmsbeagle plugin system
+ * @author Aaron E. Darling
+ * Based on code found in "Dynamic Plugins for C++" by Arthur J. Musgrove
+ * and published in Dr. Dobbs Journal, July 1, 2004.
+ */
+
+#include "libhmsbeagle/CPU/BeagleCPUNEONPlugin.h"
+#include "libhmsbeagle/CPU/BeagleCPU4StateNEONImpl.h"
+#include "libhmsbeagle/CPU/BeagleCPUNEONImpl.h"
+#include <iostream>
+
+namespace beagle {
+namespace cpu {
+
+
+BeagleCPUNEONPlugin::BeagleCPUNEONPlugin() :
+Plugin("CPU-NEON", "CPU-NEON")
+{
+	BeagleResource resource;
+        resource.name = (char*) "CPU";
+        resource.description = (char*) "";
+        resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
+                                         BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+                                         BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+                                         BEAGLE_CPU_ARENA_FLAGS |
+                                         BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
+                                         BEAGLE_FLAG_PROCESSOR_CPU |
+                                         BEAGLE_FLAG_PRECISION_DOUBLE |
+                                         BEAGLE_FLAG_VECTOR_NONE |
+                                         BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
+                                         BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
+                                         BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                                         BEAGLE_FLAG_FRAMEWORK_CPU;
+        resource.supportFlags |= BEAGLE_FLAG_VECTOR_NEON;
+        resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_CPU;
+	beagleResources.push_back(resource);
+
+	beagleFactories.push_back(new beagle::cpu::BeagleCPU4StateNEONImplFactory<double>());
+	beagleFactories.push_back(new beagle::cpu::BeagleCPUNEONImplFactory<double>());
+}
+
+}	// namespace cpu
+}	// namespace beagle
+
+
+extern "C" {
+
+void* plugin_init(void){
+	if(!CPUSupportsNEON()){
+		return NULL;	// the library was built with NEON but this host lacks it
+	}
+	return new beagle::cpu::BeagleCPUNEONPlugin();
+}
+}
+
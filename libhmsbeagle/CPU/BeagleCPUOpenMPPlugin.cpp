@@ -22,9 +22,10 @@ Plugin("CPU-SSE-OpenMP", "CPU-SSE-OpenMP")
 	BeagleResource resource;
         resource.name = (char*) "CPU";
         resource.description = (char*) "";
-        resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH |
+        resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
                                          BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
                                          BEAGLE_FLAG_THREADING_NONE |
+                                         BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
                                          BEAGLE_FLAG_PROCESSOR_CPU |
                                          BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE |
                                          BEAGLE_FLAG_VECTOR_NONE |
@@ -46,7 +47,7 @@ Plugin("CPU-SSE-OpenMP", "CPU-SSE-OpenMP")
 
 	// FIXME: the SSE plugin currently assumes all hardware is compatible
 	beagleFactories.push_back(new beagle::cpu::BeagleCPU4StateSSEImplFactory<double>());
-//	implFactory->push_back(new beagle::cpu::BeagleCPU4StateSSEImplFactory<float>()); // TODO Not yet written
+	beagleFactories.push_back(new beagle::cpu::BeagleCPU4StateSSEImplFactory<float>());
 	beagleFactories.push_back(new beagle::cpu::BeagleCPUSSEImplFactory<double>()); // TODO In process of writing
 
 }
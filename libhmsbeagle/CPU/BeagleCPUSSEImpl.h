@@ -92,20 +92,20 @@ protected:
 public:
     virtual const char* getName();
     
-    virtual const long getFlags();
+    virtual const long long getFlags();
 
 protected:
     virtual int getPaddedPatternsModulus();
 
 private:
 	virtual void calcStatesStates(float* destP,
-                                     const int* states1,
+                                     const TipState* states1,
                                      const float* matrices1,
-                                     const int* states2,
+                                     const TipState* states2,
                                      const float* matrices2);
 
     virtual void calcStatesPartials(float* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const float* matrices1,
                                     const float* partials2,
                                     const float* matrices2);
@@ -156,6 +156,7 @@ protected:
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kStateCount;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gTipStates;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kOpenMPThreadCount;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gScaleBuffers;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gCategoryWeights;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gStateFrequencies;
@@ -166,22 +167,22 @@ protected:
 public:
     virtual const char* getName();
     
-    virtual const long getFlags();
+    virtual const long long getFlags();
 
 protected:
     virtual int getPaddedPatternsModulus();
 
 private:
 	virtual void calcStatesStates(double* destP,
-                                const int* states1,
+                                const TipState* states1,
                                 const double* matrices1,
-                                const int* states2,
+                                const TipState* states2,
                                 const double* matrices2,
                                 int startPattern,
                                 int endPattern);
 
     virtual void calcStatesPartials(double* destP,
-                                    const int* states1,
+                                    const TipState* states1,
                                     const double* matrices1,
                                     const double* partials2,
                                     const double* matrices2,
@@ -236,12 +237,27 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 }	// namespace cpu
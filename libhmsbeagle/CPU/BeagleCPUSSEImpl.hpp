@@ -62,9 +62,9 @@ inline const char* getBeagleCPUSSEName<float>(){ return "CPU-SSE-Single"; };
 
 BEAGLE_CPU_SSE_TEMPLATE
 void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesStates(double* destP,
-                                                               const int* states_q,
+                                                               const TipState* states_q,
                                                                const double* matrices_q,
-                                                               const int* states_r,
+                                                               const TipState* states_r,
                                                                const double* matrices_r,
                                                                int startPattern,
                                                                int endPattern) {
@@ -81,9 +81,9 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesStates(double* destP,
 
 //template <>
 //void BeagleCPUSSEImpl<double>::calcStatesStates(double* destP,
-//                                     const int* states_q,
+//                                     const TipState* states_q,
 //                                     const double* matrices_q,
-//                                     const int* states_r,
+//                                     const TipState* states_r,
 //                                     const double* matrices_r) {
 //
 //	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
@@ -117,7 +117,7 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesStates(double* destP,
  */
 BEAGLE_CPU_SSE_TEMPLATE
 void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesPartials(double* destP,
-                                                                 const int* states_q,
+                                                                 const TipState* states_q,
                                                                  const double* matrices_q,
                                                                  const double* partials_r,
                                                                  const double* matrices_r,
@@ -136,7 +136,7 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesPartials(double* destP,
 //
 //template <>
 //void BeagleCPUSSEImpl<double>::calcStatesPartials(double* destP,
-//                                       const int* states_q,
+//                                       const TipState* states_q,
 //                                       const double* matrices_q,
 //                                       const double* partials_r,
 //                                       const double* matrices_r) {
@@ -222,7 +222,7 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartials(double* __res
                                                                    int startPattern,
                                                                    int endPattern) {
     int stateCountMinusOne = kPartialsPaddedStateCount - 1;
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
     	int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
     	double* destPu = destP + v;
@@ -290,7 +290,8 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartials(double* __res
 #endif
 
             }
-            destPu += P_PAD;
+            for (int i = 0; i < P_PAD; i++)
+                *(destPu++) = 0.0;
             v += kPartialsPaddedStateCount;
         }
     }
@@ -307,10 +308,10 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartialsFixedScaling(d
                                                                                int endPattern) {
 
     int stateCountMinusOne = kPartialsPaddedStateCount - 1;
-#pragma omp parallel for num_threads(kCategoryCount)
+#pragma omp parallel for num_threads(kCategoryCount) if(kOpenMPThreadCount == 1)
     for (int l = 0; l < kCategoryCount; l++) {
     	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
-    	int v = l*kPartialsPaddedStateCount*kPatternCount;
+    	int v = l*kPartialsPaddedStateCount*kPatternCount + kPartialsPaddedStateCount*startPattern;
         for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             const V_Real scalar = VEC_SPLAT(scaleFactors[k]);
@@ -344,7 +345,8 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartialsFixedScaling(d
 
                 destPu++;
             }
-            destPu += P_PAD;
+            for (int i = 0; i < P_PAD; i++)
+                *(destPu++) = 0.0;
             v += kPartialsPaddedStateCount;
         }
     }
@@ -424,7 +426,7 @@ return BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::calcEdgeLogLikelihoods(
 //
 //    if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
 //
-//        const int* statesChild = gTipStates[childIndex];
+//        const TipState* statesChild = gTipStates[childIndex];
 //
 //		int w = 0;
 //		V_Real *vcl_r = (V_Real *)cl_r;
@@ -540,7 +542,7 @@ const char* BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::getName() {
 }
     
 BEAGLE_CPU_SSE_TEMPLATE
-const long BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>::getFlags() {
+const long long BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>::getFlags() {
 	return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_PROCESSOR_CPU |
             BEAGLE_FLAG_PRECISION_SINGLE |
@@ -549,7 +551,7 @@ const long BeagleCPUSSEImpl<BEAGLE_CPU_SSE_FLOAT>::getFlags() {
 }
 
 BEAGLE_CPU_SSE_TEMPLATE
-const long BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::getFlags() {
+const long long BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::getFlags() {
     return  BEAGLE_FLAG_COMPUTATION_SYNCH |
             BEAGLE_FLAG_PROCESSOR_CPU |
             BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -573,8 +575,8 @@ BeagleImpl* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
                                              int scaleBufferCount,
                                              int resourceNumber,
                                              int pluginResourceNumber,
-                                             long preferenceFlags,
-                                             long requirementFlags,
+                                             long long preferenceFlags,
+                                             long long requirementFlags,
                                              int* errorCode) {
 
     if (!CPUSupportsSSE())
@@ -627,16 +629,50 @@ BeagleImpl* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
     return NULL;
 }
 
+BEAGLE_CPU_FACTORY_TEMPLATE
+int BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                            int partialsBufferCount,
+                                                                            int compactBufferCount,
+                                                                            int stateCount,
+                                                                            int patternCount,
+                                                                            int eigenBufferCount,
+                                                                            int matrixBufferCount,
+                                                                            int categoryCount,
+                                                                            int scaleBufferCount,
+                                                                            int resourceNumber,
+                                                                            int pluginResourceNumber,
+                                                                            long long preferenceFlags,
+                                                                            long long requirementFlags,
+                                                                            size_t* outBytes) {
+    if (!CPUSupportsSSE())
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (stateCount & 1) // is odd
+        *outBytes = BeagleCPUSSEImpl<REALTYPE, T_PAD_SSE_ODD, P_PAD_SSE_ODD>::getMemoryFootprint(
+                tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+                eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+                preferenceFlags, requirementFlags);
+    else
+        *outBytes = BeagleCPUSSEImpl<REALTYPE, T_PAD_SSE_EVEN, P_PAD_SSE_EVEN>::getMemoryFootprint(
+                tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+                eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+                preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_FACTORY_TEMPLATE
 const char* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 	return getBeagleCPUSSEName<BEAGLE_CPU_FACTORY_GENERIC>();
 }
 
 template <>
-const long BeagleCPUSSEImplFactory<double>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPUSSEImplFactory<double>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
-           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
            BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -647,10 +683,12 @@ const long BeagleCPUSSEImplFactory<double>::getFlags() {
 }
 
 template <>
-const long BeagleCPUSSEImplFactory<float>::getFlags() {
-    return BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleCPUSSEImplFactory<float>::getFlags() {
+    return BEAGLE_FLAG_COMPUTATION_SYNCH | BEAGLE_FLAG_COMPUTATION_ASYNCH |
            BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
-           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP |
+           BEAGLE_FLAG_THREADING_NONE | BEAGLE_FLAG_THREADING_CPP | BEAGLE_FLAG_THREADING_NUMA |
+           BEAGLE_CPU_ARENA_FLAGS |
+           BEAGLE_FLAG_PREORDER | BEAGLE_FLAG_MULTI_EDGE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
            BEAGLE_FLAG_PRECISION_SINGLE |
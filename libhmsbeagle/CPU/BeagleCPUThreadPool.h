@@ -0,0 +1,212 @@
+/*
+ *  BeagleCPUThreadPool.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BeagleCPUThreadPool__
+#define __BeagleCPUThreadPool__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <vector>
+#include <thread>
+#include <future>
+#include <queue>
+#include <condition_variable>
+#include <mutex>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace beagle {
+namespace cpu {
+
+// Worker threads shared by all CPU instances of a plugin. The pool is started on first
+// use with one thread per hardware thread, which bounds the number of threads running
+// BEAGLE work no matter how many instances are created. Jobs go either to a shared
+// queue or to the queue of one particular worker, for work that should stay on the
+// NUMA node that first touched its memory. An instance that binds its workers to nodes
+// owns a pool of its own, so the shared workers are never bound.
+class BeagleCPUThreadPool {
+
+public:
+    static BeagleCPUThreadPool& getInstance() {
+        static BeagleCPUThreadPool pool(std::thread::hardware_concurrency());
+        return pool;
+    }
+
+    explicit BeagleCPUThreadPool(int threadCount) : stop(false) {
+        kThreadCount = (threadCount > 1 ? threadCount : 1);
+        workerJobs = new std::queue<std::packaged_task<void()>>[kThreadCount];
+        for (int i = 0; i < kThreadCount; i++) {
+            gThreads.push_back(std::thread(&BeagleCPUThreadPool::threadWaiting, this, i));
+        }
+    }
+
+    int getThreadCount() const {
+        return kThreadCount;
+    }
+
+    // Queue a job for the next idle thread; jobs from all instances share one queue
+    std::shared_future<void> submit(const std::function<void()>& job) {
+        std::packaged_task<void()> task(job);
+        std::shared_future<void> future = task.get_future();
+
+        std::unique_lock<std::mutex> l(m);
+        jobs.push(std::move(task));
+        l.unlock();
+
+        cv.notify_one();
+
+        return future;
+    }
+
+    // Queue a job for one worker, which runs it ahead of the shared queue
+    std::shared_future<void> submitTo(int worker,
+                                      const std::function<void()>& job) {
+        std::packaged_task<void()> task(job);
+        std::shared_future<void> future = task.get_future();
+
+        std::unique_lock<std::mutex> l(m);
+        workerJobs[worker % kThreadCount].push(std::move(task));
+        l.unlock();
+
+        // all workers wait on the same condition variable
+        cv.notify_all();
+
+        return future;
+    }
+
+    // Bind worker i to the cores of the (i % nodes)-th NUMA node, keeping to the cores
+    // available to the process. A worker may run on any core of its node, so processes
+    // sharing a node are spread over its cores by the scheduler rather than stacked on
+    // the same ones. Only for pools owned by one instance; returns false where there is
+    // a single node or threads cannot be bound, leaving the workers unbound.
+    bool bindThreadsToNodes() {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+        cpu_set_t available;
+        CPU_ZERO(&available);
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &available) != 0)
+            return false;
+
+        std::vector<cpu_set_t> nodes;
+        for (int n = 0; ; n++) {
+            std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            if (!cpuList)
+                break;
+            cpu_set_t node;
+            CPU_ZERO(&node);
+            std::string range;
+            while (std::getline(cpuList, range, ',')) {
+                int first, last;
+                char dash;
+                std::istringstream in(range);
+                if (!(in >> first))
+                    continue;
+                if (!(in >> dash >> last))
+                    last = first;
+                for (int c = first; c <= last && c < CPU_SETSIZE; c++) {
+                    if (CPU_ISSET(c, &available))
+                        CPU_SET(c, &node);
+                }
+            }
+            if (CPU_COUNT(&node) > 0)
+                nodes.push_back(node);
+        }
+        if (nodes.size() < 2)
+            return false;
+
+        for (int i = 0; i < kThreadCount; i++) {
+            pthread_setaffinity_np(gThreads[i].native_handle(), sizeof(cpu_set_t),
+                                   &nodes[i % nodes.size()]);
+        }
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    ~BeagleCPUThreadPool() {
+        // Send stop signal to all threads and join them...
+        std::unique_lock<std::mutex> l(m);
+        stop = true;
+        l.unlock();
+        cv.notify_all();
+
+        for (size_t i = 0; i < gThreads.size(); i++) {
+            gThreads[i].join();
+        }
+
+        delete[] workerJobs;
+    }
+
+private:
+    BeagleCPUThreadPool(const BeagleCPUThreadPool&);	// disallow copy by defining this private
+
+    void threadWaiting(int worker) {
+        std::queue<std::packaged_task<void()>>& ownJobs = workerJobs[worker];
+        std::unique_lock<std::mutex> l(m, std::defer_lock);
+        while (true) {
+            l.lock();
+
+            // Wait until a queue won't be empty or stop is signaled
+            cv.wait(l, [this, &ownJobs] () {
+                return (stop || !ownJobs.empty() || !jobs.empty());
+                });
+
+            // Stop was signaled, let's exit the thread
+            if (stop) { return; }
+
+            // Pop one task, from this worker's own queue first...
+            std::queue<std::packaged_task<void()>>& queue = (ownJobs.empty() ? jobs : ownJobs);
+            std::packaged_task<void()> j = std::move(queue.front());
+            queue.pop();
+
+            l.unlock();
+
+            // Execute the task!
+            j();
+        }
+    }
+
+    int kThreadCount;
+    std::vector<std::thread> gThreads;
+    std::queue<std::packaged_task<void()>> jobs; // The shared job queue
+    std::queue<std::packaged_task<void()>>* workerJobs; // Jobs for one particular worker
+    std::condition_variable cv; // The condition variable to wait for threads
+    std::mutex m; // Mutex used for avoiding data races
+    bool stop; // When set, this flag tells the threads that they should exit
+};
+
+}	// namespace cpu
+}	// namespace beagle
+
+#endif // __BeagleCPUThreadPool__
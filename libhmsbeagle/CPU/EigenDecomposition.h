@@ -30,16 +30,13 @@ protected:
     int kStateCount;
     int kEigenDecompCount;
     int kCategoryCount;
-	long kFlags;
-    REALTYPE* matrixTmp;
-    REALTYPE* firstDerivTmp;
-    REALTYPE* secondDerivTmp;
+	long long kFlags;
     
 public:
 	EigenDecomposition(int decompositionCount,
 					   int stateCount,
 					   int categoryCount,
-                       long flags)
+                       long long flags)
 					   {
 
 					   		kEigenDecompCount = decompositionCount;
@@ -67,6 +64,8 @@ public:
     // nodeIndices an array of node indices that require transition probability matrices
     // edgeLengths an array of expected lengths in substitutions per site
     // count the number of elements in the above arrays
+    //
+    // Keeps no scratch state between calls, so calls writing distinct matrices may run concurrently.
     virtual void updateTransitionMatrices(int eigenIndex,
                                  const int* probabilityIndices,
                                  const int* firstDerivativeIndices,
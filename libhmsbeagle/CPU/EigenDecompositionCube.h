@@ -10,6 +10,8 @@
 
 #include "libhmsbeagle/CPU/EigenDecomposition.h"
 
+#define BEAGLE_EIGEN_CUBE_BLOCK_SIZE 8 // edge and category pairs built from one cached slab of gCMatrices
+
 namespace beagle {
 namespace cpu {
 
@@ -20,9 +22,6 @@ class EigenDecompositionCube : public EigenDecomposition<BEAGLE_CPU_EIGEN_GENERI
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kStateCount;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kEigenDecompCount;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kCategoryCount;
-	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::matrixTmp;
-	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::firstDerivTmp;
-	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::secondDerivTmp;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kFlags;
 
 protected:
@@ -32,7 +31,7 @@ public:
 	EigenDecompositionCube(int decompositionCount, 
 						   int stateCount, 
 						   int categoryCount,
-                           long flags);
+                           long long flags);
 	
 	virtual ~EigenDecompositionCube();
 	
@@ -49,6 +48,29 @@ public:
                                  const double* categoryRates,
                                  REALTYPE** transitionMatrices,
                                  int count);
+
+private:
+    // Builds P and its first DERIVATIVES derivatives for a run of (edge, category) pairs,
+    // BEAGLE_EIGEN_CUBE_BLOCK_SIZE pairs at a time; a STATE_COUNT of 0 means kStateCount
+    template <int STATE_COUNT, int DERIVATIVES>
+    void updateTransitionMatricesBlocked(int eigenIndex,
+                                         const int* probabilityIndices,
+                                         const int* firstDerivativeIndices,
+                                         const int* secondDerivativeIndices,
+                                         const double* edgeLengths,
+                                         const double* categoryRates,
+                                         REALTYPE** transitionMatrices,
+                                         int count);
+
+    template <int STATE_COUNT>
+    void updateTransitionMatricesForStateCount(int eigenIndex,
+                                               const int* probabilityIndices,
+                                               const int* firstDerivativeIndices,
+                                               const int* secondDerivativeIndices,
+                                               const double* edgeLengths,
+                                               const double* categoryRates,
+                                               REALTYPE** transitionMatrices,
+                                               int count);
 	
 };
 
@@ -7,6 +7,8 @@
 #ifndef _EigenDecompositionCube_hpp_
 #define _EigenDecompositionCube_hpp_
 
+#include <vector>
+
 #include "libhmsbeagle/CPU/EigenDecompositionCube.h"
 
 
@@ -23,7 +25,7 @@ BEAGLE_CPU_EIGEN_TEMPLATE
 EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::EigenDecompositionCube(int decompositionCount,
 											         int stateCount,
 											         int categoryCount,
-                                                     long flags)
+                                                     long long flags)
 											         : EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>(decompositionCount,
 																				stateCount,
 																				categoryCount,
@@ -45,10 +47,6 @@ EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::EigenDecompositionCube(int dec
     	if (gEigenValues[i] == NULL)
     		throw std::bad_alloc();
     }
-    
-    matrixTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kStateCount);
-    firstDerivTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kStateCount);
-    secondDerivTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kStateCount);
 }
 
 BEAGLE_CPU_EIGEN_TEMPLATE
@@ -60,9 +58,6 @@ EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::~EigenDecompositionCube() {
 	}
 	free(gCMatrices);
 	free(gEigenValues);
-	free(matrixTmp);
-	free(firstDerivTmp);
-	free(secondDerivTmp);
 }
 
 BEAGLE_CPU_EIGEN_TEMPLATE
@@ -71,12 +66,14 @@ void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(int
                                                    const double* inInverseEigenVectors,
                                                    const double* inEigenValues) {
 
+    // C[i][k][j] = U[i][k] * V[k][j], stored with j innermost so that building a row of P
+    // is a run of contiguous multiply-adds
     if (kFlags & BEAGLE_FLAG_INVEVEC_STANDARD) {
         int l = 0;
         for (int i = 0; i < kStateCount; i++) {
             gEigenValues[eigenIndex][i] = inEigenValues[i];
-            for (int j = 0; j < kStateCount; j++) {
-                for (int k = 0; k < kStateCount; k++) {
+            for (int k = 0; k < kStateCount; k++) {
+                for (int j = 0; j < kStateCount; j++) {
                     gCMatrices[eigenIndex][l] = inEigenVectors[(i * kStateCount) + k]
                             * inInverseEigenVectors[(k * kStateCount) + j];
                     l++;
@@ -87,8 +84,8 @@ void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(int
         int l = 0;
         for (int i = 0; i < kStateCount; i++) {
             gEigenValues[eigenIndex][i] = inEigenValues[i];
-            for (int j = 0; j < kStateCount; j++) {
-                for (int k = 0; k < kStateCount; k++) {
+            for (int k = 0; k < kStateCount; k++) {
+                for (int j = 0; j < kStateCount; j++) {
                     gCMatrices[eigenIndex][l] = inEigenVectors[(i * kStateCount) + k]
                     * inInverseEigenVectors[k + (j*kStateCount)];
                     l++;
@@ -99,8 +96,6 @@ void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(int
 
 }
     
-#define UNROLL
-
 BEAGLE_CPU_EIGEN_TEMPLATE
 void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatrices(int eigenIndex,
                                                       const int* probabilityIndices,
@@ -110,146 +105,181 @@ void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatrices(
                                                       const double* categoryRates,
                                                       REALTYPE** transitionMatrices,
                                                       int count) {
-#ifdef UNROLL													  
-	int stateCountModFour = (kStateCount / 4) * 4;
-#endif
-													  
-	if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL) {
-		for (int u = 0; u < count; u++) {
-			REALTYPE* transitionMat = transitionMatrices[probabilityIndices[u]];
-			int n = 0;
-			for (int l = 0; l < kCategoryCount; l++) {
-				
-                for (int i = 0; i < kStateCount; i++) {
-					matrixTmp[i] = exp(gEigenValues[eigenIndex][i] * ((REALTYPE)edgeLengths[u] * categoryRates[l]));
-                }
-				
-                REALTYPE* tmpCMatrices = gCMatrices[eigenIndex];
-				for (int i = 0; i < kStateCount; i++) {
-					for (int j = 0; j < kStateCount; j++) {
-						REALTYPE sum = 0.0;
-#ifdef UNROLL						
-						int k = 0;
-						for (; k < stateCountModFour; k += 4) {
-							sum += tmpCMatrices[k + 0] * matrixTmp[k + 0];
-							sum += tmpCMatrices[k + 1] * matrixTmp[k + 1];
-							sum += tmpCMatrices[k + 2] * matrixTmp[k + 2];
-							sum += tmpCMatrices[k + 3] * matrixTmp[k + 3];
-						}
-						for (; k < kStateCount; k++) {
-							sum += tmpCMatrices[k] * matrixTmp[k];
-						}
-						tmpCMatrices += kStateCount;
-#else
-						for (int k = 0; k < kStateCount; k++) {
-							sum += *tmpCMatrices++ * matrixTmp[k];
-						}
-#endif						
-						if (sum > 0)
-							transitionMat[n] = sum;
-						else
-							transitionMat[n] = 0;
-						n++;
-					}
-if (T_PAD != 0) {
-					transitionMat[n] = 1.0;
-					n += T_PAD;
-}
-				}
-			}
-			
-			if (DEBUGGING_OUTPUT) {
-                int kMatrixSize = kStateCount * kStateCount;
-				fprintf(stderr,"transitionMat index=%d brlen=%.5f\n", probabilityIndices[u], edgeLengths[u]);
-				for ( int w = 0; w < (20 > kMatrixSize ? 20 : kMatrixSize); ++w)
-					fprintf(stderr,"transitionMat[%d] = %.5f\n", w, transitionMat[w]);
-			}
-		}
-        
+    switch (kStateCount) {
+        case 4:
+            updateTransitionMatricesForStateCount<4>(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                                     secondDerivativeIndices, edgeLengths, categoryRates,
+                                                     transitionMatrices, count);
+            break;
+        case 20:
+            updateTransitionMatricesForStateCount<20>(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                                      secondDerivativeIndices, edgeLengths, categoryRates,
+                                                      transitionMatrices, count);
+            break;
+        case 61:
+            updateTransitionMatricesForStateCount<61>(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                                      secondDerivativeIndices, edgeLengths, categoryRates,
+                                                      transitionMatrices, count);
+            break;
+        default:
+            updateTransitionMatricesForStateCount<0>(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                                     secondDerivativeIndices, edgeLengths, categoryRates,
+                                                     transitionMatrices, count);
+    }
 
-	} else if (secondDerivativeIndices == NULL) {
-		for (int u = 0; u < count; u++) {
-			REALTYPE* transitionMat = transitionMatrices[probabilityIndices[u]];
-			REALTYPE* firstDerivMat = transitionMatrices[firstDerivativeIndices[u]];
-			int n = 0;
-			for (int l = 0; l < kCategoryCount; l++) {
-				
-				for (int i = 0; i < kStateCount; i++) {
-					REALTYPE scaledEigenValue = gEigenValues[eigenIndex][i] * ((REALTYPE)categoryRates[l]);
-					matrixTmp[i] = exp(scaledEigenValue * ((REALTYPE)edgeLengths[u]));
-					firstDerivTmp[i] = scaledEigenValue * matrixTmp[i];
-				}
-				
-				int m = 0;
-				for (int i = 0; i < kStateCount; i++) {
-					for (int j = 0; j < kStateCount; j++) {
-						REALTYPE sum = 0.0;
-						REALTYPE sumD1 = 0.0;
-						for (int k = 0; k < kStateCount; k++) {
-							sum += gCMatrices[eigenIndex][m] * matrixTmp[k];
-							sumD1 += gCMatrices[eigenIndex][m] * firstDerivTmp[k];
-							m++;
-						}
-						if (sum > 0)
-							transitionMat[n] = sum;
-						else
-							transitionMat[n] = 0;
-						firstDerivMat[n] = sumD1;
-						n++;
-					}
-if (T_PAD != 0) {
-					transitionMat[n] = 1.0;
-                    firstDerivMat[n] = 0.0;
-					n += T_PAD;
+    if (DEBUGGING_OUTPUT) {
+        int kMatrixSize = kStateCount * kStateCount;
+        for (int u = 0; u < count; u++) {
+            REALTYPE* transitionMat = transitionMatrices[probabilityIndices[u]];
+            fprintf(stderr,"transitionMat index=%d brlen=%.5f\n", probabilityIndices[u], edgeLengths[u]);
+            for ( int w = 0; w < (20 > kMatrixSize ? 20 : kMatrixSize); ++w)
+                fprintf(stderr,"transitionMat[%d] = %.5f\n", w, transitionMat[w]);
+        }
+    }
 }
-				}
-			}
-		}
-	} else {		
-		for (int u = 0; u < count; u++) {
-			REALTYPE* transitionMat = transitionMatrices[probabilityIndices[u]];
-			REALTYPE* firstDerivMat = transitionMatrices[firstDerivativeIndices[u]];
-			REALTYPE* secondDerivMat = transitionMatrices[secondDerivativeIndices[u]];
-			int n = 0;
-			for (int l = 0; l < kCategoryCount; l++) {
-				
-				for (int i = 0; i < kStateCount; i++) {
-					REALTYPE scaledEigenValue = gEigenValues[eigenIndex][i] * ((REALTYPE)categoryRates[l]);
-					matrixTmp[i] = exp(scaledEigenValue * ((REALTYPE)edgeLengths[u]));
-					firstDerivTmp[i] = scaledEigenValue * matrixTmp[i];
-					secondDerivTmp[i] = scaledEigenValue * firstDerivTmp[i];
-				}
-				
-				int m = 0;
-				for (int i = 0; i < kStateCount; i++) {
-					for (int j = 0; j < kStateCount; j++) {
-						REALTYPE sum = 0.0;
-						REALTYPE sumD1 = 0.0;
-						REALTYPE sumD2 = 0.0;
-						for (int k = 0; k < kStateCount; k++) {
-							sum += gCMatrices[eigenIndex][m] * matrixTmp[k];
-							sumD1 += gCMatrices[eigenIndex][m] * firstDerivTmp[k];
-							sumD2 += gCMatrices[eigenIndex][m] * secondDerivTmp[k];
-							m++;
-						}
-						if (sum > 0)
-							transitionMat[n] = sum;
-						else
-							transitionMat[n] = 0;
-						firstDerivMat[n] = sumD1;
-						secondDerivMat[n] = sumD2;
-						n++;
-					}
-if (T_PAD != 0) {
-					transitionMat[n] = 1.0;
-                    firstDerivMat[n] = 0.0;
-                    secondDerivMat[n] = 0.0;
-					n += T_PAD;
+
+BEAGLE_CPU_EIGEN_TEMPLATE template <int STATE_COUNT>
+void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatricesForStateCount(int eigenIndex,
+                                                      const int* probabilityIndices,
+                                                      const int* firstDerivativeIndices,
+                                                      const int* secondDerivativeIndices,
+                                                      const double* edgeLengths,
+                                                      const double* categoryRates,
+                                                      REALTYPE** transitionMatrices,
+                                                      int count) {
+    if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL)
+        updateTransitionMatricesBlocked<STATE_COUNT, 0>(eigenIndex, probabilityIndices, NULL, NULL,
+                                                        edgeLengths, categoryRates, transitionMatrices, count);
+    else if (secondDerivativeIndices == NULL)
+        updateTransitionMatricesBlocked<STATE_COUNT, 1>(eigenIndex, probabilityIndices, firstDerivativeIndices, NULL,
+                                                        edgeLengths, categoryRates, transitionMatrices, count);
+    else
+        updateTransitionMatricesBlocked<STATE_COUNT, 2>(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                                        secondDerivativeIndices, edgeLengths, categoryRates,
+                                                        transitionMatrices, count);
 }
-				}
-			}
-		}
-	}
+
+/*
+ * P[i][j] = sum_k C[i][k][j] * exp(lambda_k * t * r) for each (edge, category) pair. Each row
+ * C[i][k][.] is read once per block of pairs and accumulated into every pair's row i, so the
+ * inner loop runs over contiguous j and every sum still runs over k in order.
+ */
+BEAGLE_CPU_EIGEN_TEMPLATE template <int STATE_COUNT, int DERIVATIVES>
+void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatricesBlocked(int eigenIndex,
+                                                      const int* probabilityIndices,
+                                                      const int* firstDerivativeIndices,
+                                                      const int* secondDerivativeIndices,
+                                                      const double* edgeLengths,
+                                                      const double* categoryRates,
+                                                      REALTYPE** transitionMatrices,
+                                                      int count) {
+    const int B = BEAGLE_EIGEN_CUBE_BLOCK_SIZE;
+    const int stateCount = (STATE_COUNT > 0 ? STATE_COUNT : kStateCount);
+    const int rowSize = stateCount + T_PAD;
+    const int categoryMatrixSize = stateCount * rowSize;
+    const int pairCount = count * kCategoryCount;
+    const REALTYPE* eigenValues = gEigenValues[eigenIndex];
+
+    REALTYPE* transitionMat[B];
+    REALTYPE* firstDerivMat[B];
+    REALTYPE* secondDerivMat[B];
+
+    // one row of exponentials per pair in a block, local to the call so calls may run concurrently
+    std::vector<REALTYPE> expRows(stateCount * B * 3);
+    REALTYPE* matrixTmp = &expRows[0];
+    REALTYPE* firstDerivTmp = matrixTmp + stateCount * B;
+    REALTYPE* secondDerivTmp = firstDerivTmp + stateCount * B;
+
+    for (int start = 0; start < pairCount; start += B) {
+        const int blockCount = (pairCount - start < B ? pairCount - start : B);
+
+        for (int b = 0; b < blockCount; b++) {
+            const int u = (start + b) / kCategoryCount;
+            const int l = (start + b) % kCategoryCount;
+
+            transitionMat[b] = transitionMatrices[probabilityIndices[u]] + l * categoryMatrixSize;
+            if (DERIVATIVES > 0)
+                firstDerivMat[b] = transitionMatrices[firstDerivativeIndices[u]] + l * categoryMatrixSize;
+            if (DERIVATIVES > 1)
+                secondDerivMat[b] = transitionMatrices[secondDerivativeIndices[u]] + l * categoryMatrixSize;
+
+            REALTYPE* expTmp = matrixTmp + b * stateCount;
+            REALTYPE* firstTmp = firstDerivTmp + b * stateCount;
+            REALTYPE* secondTmp = secondDerivTmp + b * stateCount;
+            for (int k = 0; k < stateCount; k++) {
+                if (DERIVATIVES == 0) {
+                    expTmp[k] = exp(eigenValues[k] * ((REALTYPE)edgeLengths[u] * categoryRates[l]));
+                } else {
+                    REALTYPE scaledEigenValue = eigenValues[k] * ((REALTYPE)categoryRates[l]);
+                    expTmp[k] = exp(scaledEigenValue * ((REALTYPE)edgeLengths[u]));
+                    firstTmp[k] = scaledEigenValue * expTmp[k];
+                    if (DERIVATIVES > 1)
+                        secondTmp[k] = scaledEigenValue * firstTmp[k];
+                }
+            }
+        }
+
+        for (int i = 0; i < stateCount; i++) {
+            const int n = i * rowSize;
+            const REALTYPE* tmpCMatrices = gCMatrices[eigenIndex] + i * stateCount * stateCount;
+
+            for (int b = 0; b < blockCount; b++) {
+                // with a fixed state count the row sums live in local arrays, otherwise in place
+                REALTYPE sumRow[STATE_COUNT > 0 ? STATE_COUNT : 1];
+                REALTYPE sumD1Row[STATE_COUNT > 0 ? STATE_COUNT : 1];
+                REALTYPE sumD2Row[STATE_COUNT > 0 ? STATE_COUNT : 1];
+                REALTYPE* __restrict sum = (STATE_COUNT > 0 ? sumRow : transitionMat[b] + n);
+                REALTYPE* __restrict sumD1 = (STATE_COUNT > 0 ? sumD1Row :
+                                              (DERIVATIVES > 0 ? firstDerivMat[b] + n : NULL));
+                REALTYPE* __restrict sumD2 = (STATE_COUNT > 0 ? sumD2Row :
+                                              (DERIVATIVES > 1 ? secondDerivMat[b] + n : NULL));
+
+                for (int j = 0; j < stateCount; j++) {
+                    sum[j] = 0.0;
+                    if (DERIVATIVES > 0)
+                        sumD1[j] = 0.0;
+                    if (DERIVATIVES > 1)
+                        sumD2[j] = 0.0;
+                }
+
+                const REALTYPE* expTmp = matrixTmp + b * stateCount;
+                const REALTYPE* firstTmp = firstDerivTmp + b * stateCount;
+                const REALTYPE* secondTmp = secondDerivTmp + b * stateCount;
+                for (int k = 0; k < stateCount; k++) {
+                    const REALTYPE* __restrict c = tmpCMatrices + k * stateCount;
+                    const REALTYPE e = expTmp[k];
+                    for (int j = 0; j < stateCount; j++)
+                        sum[j] += c[j] * e;
+                    if (DERIVATIVES > 0) {
+                        const REALTYPE e1 = firstTmp[k];
+                        for (int j = 0; j < stateCount; j++)
+                            sumD1[j] += c[j] * e1;
+                    }
+                    if (DERIVATIVES > 1) {
+                        const REALTYPE e2 = secondTmp[k];
+                        for (int j = 0; j < stateCount; j++)
+                            sumD2[j] += c[j] * e2;
+                    }
+                }
+
+                REALTYPE* __restrict p = transitionMat[b] + n;
+                for (int j = 0; j < stateCount; j++) {
+                    p[j] = (sum[j] > 0 ? sum[j] : 0);
+                    if (STATE_COUNT > 0 && DERIVATIVES > 0)
+                        firstDerivMat[b][n + j] = sumD1[j];
+                    if (STATE_COUNT > 0 && DERIVATIVES > 1)
+                        secondDerivMat[b][n + j] = sumD2[j];
+                }
+                if (T_PAD != 0) {
+                    p[stateCount] = 1.0;
+                    if (DERIVATIVES > 0)
+                        firstDerivMat[b][n + stateCount] = 0.0;
+                    if (DERIVATIVES > 1)
+                        secondDerivMat[b][n + stateCount] = 0.0;
+                }
+            }
+        }
+    }
 }
 
 } // cpu
@@ -20,7 +20,6 @@ class EigenDecompositionSquare: public EigenDecomposition<BEAGLE_CPU_EIGEN_GENER
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kStateCount;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kEigenDecompCount;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kCategoryCount;
-	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::matrixTmp;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kFlags;
 
 protected:
@@ -33,7 +32,7 @@ public:
 	EigenDecompositionSquare(int decompositionCount,
 						     int stateCount,
 						     int categoryCount,
-						     long flags);
+						     long long flags);
 
 	virtual ~EigenDecompositionSquare();
 
@@ -6,6 +6,8 @@
  */
 #ifndef _EigenDecompositionSquare_hpp_
 #define _EigenDecompositionSquare_hpp_
+#include <vector>
+
 #include "EigenDecompositionSquare.h"
 #include "libhmsbeagle/beagle.h"
 
@@ -24,7 +26,7 @@ BEAGLE_CPU_EIGEN_TEMPLATE
 EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::EigenDecompositionSquare(int decompositionCount,
 											       int stateCount,
 											       int categoryCount,
-											       long flags)
+											       long long flags)
 	: EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>(decompositionCount,stateCount,categoryCount, flags) {
 
 	isComplex = kFlags & BEAGLE_FLAG_EIGEN_COMPLEX;
@@ -59,8 +61,6 @@ EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::EigenDecompositionSquare(int
     	if (gEigenValues[i] == NULL)
     		throw std::bad_alloc();
     }
-
-    matrixTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kStateCount * kStateCount);
 }
 
 BEAGLE_CPU_EIGEN_TEMPLATE
@@ -74,7 +74,6 @@ EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::~EigenDecompositionSquare()
 	free(gEMatrices);
 	free(gIMatrices);
 	free(gEigenValues);
-	free(matrixTmp);
 }
     
 /**
@@ -120,6 +119,8 @@ void EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatrice
 	const REALTYPE* Evec = gEMatrices[eigenIndex];
 	const REALTYPE* Eval = gEigenValues[eigenIndex];
 	const REALTYPE* EvalImag = Eval + kStateCount;
+	std::vector<REALTYPE> scaledIevc(kStateCount * kStateCount); // local so calls may run concurrently
+	REALTYPE* matrixTmp = &scaledIevc[0];
     for (int u = 0; u < count; u++) {
         REALTYPE* transitionMat = transitionMatrices[probabilityIndices[u]];
         const double edgeLength = edgeLengths[u];
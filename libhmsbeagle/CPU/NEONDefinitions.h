@@ -0,0 +1,51 @@
+/*
+ *  NEONDefinitions.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __NEONDefinitions__
+#define __NEONDefinitions__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <arm_neon.h>
+
+#define NEON_DOUBLES_PER_VEC    2   /* number of doubles in a 128-bit vector */
+
+typedef union 			/* for copying individual elements to and from vectors */
+	{
+	double      x[NEON_DOUBLES_PER_VEC];
+	float64x2_t vx;
+	}
+	NEONVecUnion;
+
+inline int CPUSupportsNEON() {
+#if defined(__aarch64__)
+    return 1;   // Advanced SIMD with double-precision lanes is mandatory on AArch64
+#else
+    return 0;
+#endif
+}
+
+#endif // __NEONDefinitions__
@@ -9,6 +9,7 @@
 #define PRECISION_H_
 
 #include <cstring>
+#include <stdint.h>
 
 #define DOUBLE_PRECISION (sizeof(REALTYPE) == 8)
 
@@ -25,6 +26,50 @@ inline void beagleMemCpy( F* to, const F* from, unsigned int length )
 	memcpy( to, from, length*sizeof(F) );
 }
 
+/*
+ * Exponent e such that x = m * 2^e with m in [0.5, 1) for positive normal x, read from the
+ * bits of x. It is clamped so that 2^e and 2^-e are both normal numbers.
+ */
+inline int beagleExponent(double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(double));
+	int e = (int) ((bits >> 52) & 0x7FF) - 1022;
+	return (e < -1021 ? -1021 : (e > 1022 ? 1022 : e));
+}
+
+inline int beagleExponent(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(float));
+	int e = (int) ((bits >> 23) & 0xFF) - 126;
+	return (e < -125 ? -125 : (e > 126 ? 126 : e));
+}
+
+/*
+ * 2^e for an exponent returned by beagleExponent (or its negation)
+ */
+template<typename F>
+inline F beaglePowerOfTwo(int e);
+
+template<>
+inline double beaglePowerOfTwo<double>(int e)
+{
+	uint64_t bits = ((uint64_t) (e + 1023)) << 52;
+	double x;
+	memcpy(&x, &bits, sizeof(double));
+	return x;
+}
+
+template<>
+inline float beaglePowerOfTwo<float>(int e)
+{
+	uint32_t bits = ((uint32_t) (e + 127)) << 23;
+	float x;
+	memcpy(&x, &bits, sizeof(float));
+	return x;
+}
+
 /*#define MEMCNV(to, from, length, toType)    { \
                                                 int m; \
                                                 for(m = 0; m < length; m++) { \
@@ -81,6 +81,13 @@ typedef union 			/* for copying individual elements to and from vector floats */
 	}
 	VecUnion;
 
+typedef union 			/* for copying individual elements to and from single-precision vectors */
+	{
+	float		x[4];
+	__m128		vx;
+	}
+	VecUnionFloat;
+
 #ifdef __GNUC__
     #define cpuid(func,ax,bx,cx,dx)\
             __asm__ __volatile__ ("cpuid":\
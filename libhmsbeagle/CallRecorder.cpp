@@ -0,0 +1,202 @@
+/*
+ *  CallRecorder.cpp
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+#include "libhmsbeagle/CallRecorder.h"
+
+namespace beagle {
+
+namespace {
+
+// (type, length, hash) of an array's contents
+struct ArrayKey {
+    char type;
+    int64_t length;
+    uint64_t hash;
+
+    bool operator<(const ArrayKey& other) const {
+        if (type != other.type)
+            return type < other.type;
+        if (length != other.length)
+            return length < other.length;
+        return hash < other.hash;
+    }
+};
+
+class CallRecorder {
+public:
+    FILE* file;
+    std::mutex mutex;
+
+    CallRecorder() : file(NULL), arrayCount(0) {
+        const char* path = getenv("BEAGLE_RECORD");
+        if (path == NULL || path[0] == '\0')
+            return;
+        file = fopen(path, "wb");
+        if (file == NULL) {
+            fprintf(stderr, "BEAGLE: unable to open call record file %s\n", path);
+            return;
+        }
+        fwrite(BEAGLE_RECORD_MAGIC, 1, strlen(BEAGLE_RECORD_MAGIC), file);
+    }
+
+    ~CallRecorder() {
+        if (file != NULL)
+            fclose(file);
+    }
+
+    // Returns the number of an array with these contents, writing it first if it is new
+    int32_t getArrayId(char type, const void* values, int64_t length, size_t size) {
+        if (values == NULL)
+            return -1;
+
+        const unsigned char* bytes = (const unsigned char*) values;
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        size_t byteCount = (size_t) length * size;
+        for (size_t i = 0; i < byteCount; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        ArrayKey key = {type, length, hash};
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<ArrayKey, int32_t>::const_iterator found = arrays.find(key);
+        if (found != arrays.end())
+            return found->second;
+
+        int32_t id = arrayCount++;
+        arrays[key] = id;
+        uint8_t typeCode = type;
+        fputc('A', file);
+        fwrite(&id, sizeof(id), 1, file);
+        fwrite(&typeCode, sizeof(typeCode), 1, file);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(values, size, length, file);
+        return id;
+    }
+
+private:
+    std::map<ArrayKey, int32_t> arrays;
+    int32_t arrayCount;
+};
+
+CallRecorder& getCallRecorder() {
+    static CallRecorder recorder;
+    return recorder;
+}
+
+thread_local int pauseDepth = 0;
+
+}   // namespace
+
+CallRecord::CallRecord(int call, int instance)
+    : call(call),
+      instance(instance),
+      recording(pauseDepth == 0 && getCallRecorder().file != NULL),
+      fieldCount(0) {
+    if (recording)
+        start = std::chrono::steady_clock::now();
+}
+
+void CallRecord::addField(char tag, const void* value, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) value;
+    fields.push_back((unsigned char) tag);
+    fields.insert(fields.end(), bytes, bytes + size);
+    fieldCount++;
+}
+
+CallRecord& CallRecord::addInt(int value) {
+    if (recording) {
+        int32_t field = value;
+        addField('i', &field, sizeof(field));
+    }
+    return *this;
+}
+
+CallRecord& CallRecord::addLong(long long value) {
+    if (recording) {
+        int64_t field = value;
+        addField('l', &field, sizeof(field));
+    }
+    return *this;
+}
+
+CallRecord& CallRecord::addDouble(double value) {
+    if (recording)
+        addField('d', &value, sizeof(value));
+    return *this;
+}
+
+CallRecord& CallRecord::addInts(const int* values, long count) {
+    if (recording) {
+        int32_t field = getCallRecorder().getArrayId('i', values, count, sizeof(int));
+        addField('a', &field, sizeof(field));
+    }
+    return *this;
+}
+
+CallRecord& CallRecord::addDoubles(const double* values, long count) {
+    if (recording) {
+        int32_t field = getCallRecorder().getArrayId('d', values, count, sizeof(double));
+        addField('a', &field, sizeof(field));
+    }
+    return *this;
+}
+
+void CallRecord::write(int returnValue) {
+    if (!recording)
+        return;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int32_t header[3] = {call, instance, returnValue};
+    int32_t count = fieldCount;
+
+    CallRecorder& recorder = getCallRecorder();
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    fputc('C', recorder.file);
+    fwrite(header, sizeof(int32_t), 3, recorder.file);
+    fwrite(&seconds, sizeof(seconds), 1, recorder.file);
+    fwrite(&count, sizeof(count), 1, recorder.file);
+    if (!fields.empty())
+        fwrite(&fields[0], 1, fields.size(), recorder.file);
+    recording = false;
+}
+
+CallRecordingPause::CallRecordingPause() {
+    pauseDepth++;
+}
+
+CallRecordingPause::~CallRecordingPause() {
+    pauseDepth--;
+}
+
+}   // namespace beagle
@@ -0,0 +1,204 @@
+/*
+ *  CallRecorder.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @brief Records the API calls of a client to a binary trace for replay
+ *
+ * Recording is off unless the BEAGLE_RECORD environment variable names the
+ * trace file when the first instance is created. Every recorded call is
+ * written when it returns, with its return value, its duration and its
+ * arguments in declaration order, followed by its scalar results. Arrays are
+ * written once, before the first call passing them, and are afterwards
+ * referred to by number; identical contents (by type, length and 64-bit hash)
+ * share a number. Values are in host byte order.
+ *
+ *   file    "BGLTRC01" record*
+ *   array   'A' int32 id, uint8 type ('i' or 'd'), int64 length, values
+ *   call    'C' int32 call, int32 instance, int32 returnValue, double seconds,
+ *               int32 fieldCount, field*
+ *   field   'i' int32 | 'l' int64 | 'd' double | 'a' int32 array id (-1 for NULL)
+ *
+ * Instance creation is recorded with the shape, the resource and the flags of
+ * the instance it returned, once the instance exists, so its recorded time
+ * leaves the creation out. Calls that read results back are recorded without
+ * the data they return. Calls not listed in RecordedCall are not recorded.
+ */
+
+#ifndef __beagle_call_recorder__
+#define __beagle_call_recorder__
+
+#ifdef HAVE_CONFIG_H
+#include "libhmsbeagle/config.h"
+#endif
+
+#include <chrono>
+#include <vector>
+
+#define BEAGLE_RECORD_MAGIC "BGLTRC01"
+
+namespace beagle {
+
+enum RecordedCall {
+    RECORD_CREATE_INSTANCE = 0,
+    RECORD_FINALIZE_INSTANCE,
+    RECORD_SET_TIP_STATES,
+    RECORD_SET_TIP_PARTIALS,
+    RECORD_SET_TIP_STATES_BATCH,
+    RECORD_SET_TIP_PARTIALS_BATCH,
+    RECORD_SET_PARTIALS,
+    RECORD_SET_EIGEN_DECOMPOSITION,
+    RECORD_SET_STATE_FREQUENCIES,
+    RECORD_SET_CATEGORY_WEIGHTS,
+    RECORD_SET_CATEGORY_RATES,
+    RECORD_SET_CATEGORY_RATES_WITH_INDEX,
+    RECORD_SET_PATTERN_WEIGHTS,
+    RECORD_SET_PATTERN_PARTITIONS,
+    RECORD_SET_TRANSITION_MATRIX,
+    RECORD_SET_TRANSITION_MATRICES,
+    RECORD_SET_CPU_THREAD_COUNT,
+    RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE,
+    RECORD_SET_INCREMENTAL_UPDATES,
+    RECORD_SET_EXPONENT_SCALING,
+    RECORD_SET_OPERATION_GRAPHS,
+    RECORD_UPDATE_TRANSITION_MATRICES,
+    RECORD_UPDATE_TRANSITION_MATRICES_WITH_MULTIPLE_MODELS,
+    RECORD_UPDATE_PARTIALS,
+    RECORD_UPDATE_PARTIALS_BY_PARTITION,
+    RECORD_WAIT_FOR_PARTIALS,
+    RECORD_ACCUMULATE_SCALE_FACTORS,
+    RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION,
+    RECORD_REMOVE_SCALE_FACTORS,
+    RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION,
+    RECORD_RESET_SCALE_FACTORS,
+    RECORD_RESET_SCALE_FACTORS_BY_PARTITION,
+    RECORD_COPY_SCALE_FACTORS,
+    RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS,
+    RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION,
+    RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS,
+    RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION,
+    RECORD_GET_PARTIALS,
+    RECORD_GET_TRANSITION_MATRIX,
+    RECORD_GET_SITE_LOG_LIKELIHOODS,
+    RECORD_GET_SITE_DERIVATIVES,
+    RECORD_GET_SCALE_FACTORS,
+    RECORD_SET_ADAPTIVE_RESCALING,
+    RECORD_SET_TIP_STATE_SETS,
+    RECORD_SET_SITE_REPEATS,
+    RECORD_CALL_COUNT
+};
+
+inline const char* getRecordedCallName(int call) {
+    static const char* names[RECORD_CALL_COUNT] = {
+        "createInstance",
+        "finalizeInstance",
+        "setTipStates",
+        "setTipPartials",
+        "setTipStatesBatch",
+        "setTipPartialsBatch",
+        "setPartials",
+        "setEigenDecomposition",
+        "setStateFrequencies",
+        "setCategoryWeights",
+        "setCategoryRates",
+        "setCategoryRatesWithIndex",
+        "setPatternWeights",
+        "setPatternPartitions",
+        "setTransitionMatrix",
+        "setTransitionMatrices",
+        "setCPUThreadCount",
+        "setTransitionMatrixCacheSize",
+        "setIncrementalUpdates",
+        "setExponentScaling",
+        "setOperationGraphs",
+        "updateTransitionMatrices",
+        "updateTransitionMatricesWithMultipleModels",
+        "updatePartials",
+        "updatePartialsByPartition",
+        "waitForPartials",
+        "accumulateScaleFactors",
+        "accumulateScaleFactorsByPartition",
+        "removeScaleFactors",
+        "removeScaleFactorsByPartition",
+        "resetScaleFactors",
+        "resetScaleFactorsByPartition",
+        "copyScaleFactors",
+        "calculateRootLogLikelihoods",
+        "calculateRootLogLikelihoodsByPartition",
+        "calculateEdgeLogLikelihoods",
+        "calculateEdgeLogLikelihoodsByPartition",
+        "getPartials",
+        "getTransitionMatrix",
+        "getSiteLogLikelihoods",
+        "getSiteDerivatives",
+        "getScaleFactors",
+        "setAdaptiveRescaling",
+        "setTipStateSets",
+        "setSiteRepeats"
+    };
+    return (call >= 0 && call < RECORD_CALL_COUNT ? names[call] : "unknown");
+}
+
+/**
+ * @brief One recorded call, collected while its wrapper runs
+ *
+ * The duration runs from construction to write(). When recording is off, or
+ * paused on this thread, the record is inactive and its methods do nothing.
+ */
+class CallRecord {
+public:
+    CallRecord(int call, int instance);
+
+    bool active() const { return recording; }
+
+    CallRecord& addInt(int value);
+    CallRecord& addLong(long long value);
+    CallRecord& addDouble(double value);
+    CallRecord& addInts(const int* values, long count);
+    CallRecord& addDoubles(const double* values, long count);
+
+    void write(int returnValue);
+
+private:
+    int call;
+    int instance;
+    bool recording;
+    int fieldCount;
+    std::vector<unsigned char> fields;
+    std::chrono::steady_clock::time_point start;
+
+    void addField(char tag, const void* value, size_t size);
+};
+
+/**
+ * @brief Stops recording on this thread while in scope
+ *
+ * For calls the library makes to itself, such as creating the shards of a
+ * sharded instance, which the enclosing call is recorded in place of.
+ */
+class CallRecordingPause {
+public:
+    CallRecordingPause();
+    ~CallRecordingPause();
+};
+
+}   // namespace beagle
+
+#endif // __beagle_call_recorder__
@@ -34,6 +34,8 @@
 #include "libhmsbeagle/config.h"
 #endif
 
+#include <vector>
+
 #include "libhmsbeagle/BeagleImpl.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
 #include "libhmsbeagle/GPU/GPUInterface.h"
@@ -67,7 +69,7 @@ private:
     
     int kInitialized;
     
-    long kFlags;
+    long long kFlags;
     
     int kTipCount;
     int kPartialsBufferCount;
@@ -89,6 +91,8 @@ private:
     int kSumSitesBlockCount;
     
     int kPartialsSize;
+    bool kHalfPartials;         // partials buffers hold half precision values
+    size_t kPartialsRealSize;   // bytes per partial in device buffers
     int kMatrixSize;
     int kEigenValuesSize;
     int kScaleBufferSize;
@@ -104,6 +108,9 @@ private:
     GPUPtr dSecondDerivTmp;
     
     GPUPtr dSumLogLikelihood;
+    GPUPtr dLogLikelihoodResultsOrigin;
+    GPUPtr* dLogLikelihoodResults; // per-slot block sums of asynchronous root integrations
+    size_t kLogLikelihoodResultSize;
     GPUPtr dSumFirstDeriv;
     GPUPtr dSumSecondDeriv;
     
@@ -138,6 +145,7 @@ private:
     GPUPtr* dTipPartialsBuffers;
     
     bool kUsingMultiGrid;
+    bool kUsingTraversalKernel;
     int kNumPatternBlocks;
     int kSitesPerBlock;
     int kSitesPerIntegrateBlock;
@@ -161,12 +169,15 @@ private:
     GPUPtr  dPatternWeightsSort;
     GPUPtr* dStatesSort;
     unsigned int* hPartialsPtrs;
+    unsigned int* hPartialsPtrsDevice;
+    int kPartialsPtrsUploaded;
     unsigned int* hPartitionOffsets;
     unsigned int* hIntegratePartitionOffsets;
     unsigned int* hPartialsOffsets;
     unsigned int* hStatesOffsets;
     int* hTipOffsets;
     BeagleDeviceImplementationCodes kDeviceCode;
+    bool kZeroCopy;             // partials, matrices and site likelihoods live in mapped host memory
     long kDeviceType;
     int kPartitionCount;
     int kMaxPartitionCount;
@@ -194,17 +205,32 @@ private:
     Real* hWeightsCache;
     Real* hFrequenciesCache;
     Real* hLogLikelihoodsCache;
+    Real* hLogLikelihoodResultsCache;
+    std::vector<bool> hLogLikelihoodResultsWritten; // slots holding a sum that can be fetched
     Real* hPartialsCache;
     int* hStatesCache;
     Real* hMatrixCache;
+
+    Real* hMatrixStaging[BEAGLE_TRANSFER_BUFFER_COUNT]; // alternated between asynchronous uploads
+    void* hTipStaging[BEAGLE_TRANSFER_BUFFER_COUNT];    // packed tips, in the same rotation
+    size_t kTipStagingSize[BEAGLE_TRANSFER_BUFFER_COUNT];
+    int kTransferIndex;
     
-    int* hRescalingTrigger;
-    GPUPtr dRescalingTrigger;
+    GPUPtr dRescalingTrigger;   // raised by pruning when partials leave the scaling thresholds
+
+    BeagleScalingStatistics hScalingStatistics; // passes and patterns only
     
     GPUPtr* dScalingFactorsMaster;
     
     int* hStreamIndices;
 
+#ifdef CUDA
+    int* hMatrixStreams;   // stream still computing each transition matrix, 0 if none
+    bool kMatricesPending; // transition matrices not yet behind a device barrier
+    bool kOperationGraphs;
+    std::vector<GPUPtr> hGraphKey; // operations and buffers the captured graph was built from
+#endif
+
 public:    
     BeagleGPUImpl();
     
@@ -221,8 +247,21 @@ public:
                        int scaleBufferCount,
                        int resourceNumber,
                        int pluginResourceNumber,
-                       long preferenceFlags,
-                       long requirementFlags);
+                       long long preferenceFlags,
+                       long long requirementFlags);
+
+    // device bytes an instance created with these arguments reserves on a discrete GPU
+    static size_t getMemoryFootprint(int tipCount,
+                                     int partialsBufferCount,
+                                     int compactBufferCount,
+                                     int stateCount,
+                                     int patternCount,
+                                     int eigenDecompositionCount,
+                                     int matrixCount,
+                                     int categoryCount,
+                                     int scaleBufferCount,
+                                     long long preferenceFlags,
+                                     long long requirementFlags);
     
     int getInstanceDetails(BeagleInstanceDetails* retunInfo);
 
@@ -231,6 +270,14 @@ public:
 
     int setTipPartials(int tipIndex,
                        const double* inPartials);
+
+    int setTipStatesBatch(const int* tipIndices,
+                          const int* inStates,
+                          int count);
+
+    int setTipPartialsBatch(const int* tipIndices,
+                            const double* inPartials,
+                            int count);
     
     int setPartials(int bufferIndex,
                     const double* inPartials);
@@ -254,6 +301,12 @@ public:
 
     int setPatternPartitions(int partitionCount,
                              const int* inPatternPartitions);
+
+    int setOperationGraphs(int enabled);
+
+    int getScalingStatistics(BeagleScalingStatistics* outStatistics);
+
+    int resetScalingStatistics();
     
     int setCategoryRates(const double* inCategoryRates);
 
@@ -341,6 +394,17 @@ public:
                                     int count,
                                     double* outSumLogLikelihood);
 
+    int calculateRootLogLikelihoodsAsync(const int* bufferIndices,
+                                         const int* categoryWeightsIndices,
+                                         const int* stateFrequenciesIndices,
+                                         const int* cumulativeScaleIndices,
+                                         int count,
+                                         int resultIndex);
+
+    int getLogLikelihoodResults(const int* resultIndices,
+                                int count,
+                                double* outSumLogLikelihoods);
+
     int calculateRootLogLikelihoodsByPartition(const int* bufferIndices,
                                                const int* categoryWeightsIndices,
                                                const int* stateFrequenciesIndices,
@@ -391,8 +455,37 @@ private:
 
     char* getInstanceName();
 
+    static int getPaddedStateCount(int stateCount);
+
+    static size_t getDeviceMemorySize(int paddedStateCount,
+                                      int paddedPatternCount,
+                                      int eigenValuesSize,
+                                      int partialsBufferCount,
+                                      int compactBufferCount,
+                                      int internalPartialsBufferCount,
+                                      int eigenDecompCount,
+                                      int matrixCount,
+                                      int categoryCount,
+                                      int scaleBufferCount,
+                                      size_t partialsRealSize);
+
     void  allocateMultiGridBuffers();
 
+    void writeTransitionMatrices(Real* hDestination,
+                                 const double* inMatrices,
+                                 int count);
+
+    void uploadPartialsPtrs(size_t transferSize);
+
+    void* getTipStaging(size_t size);
+
+    void appendGridTail(unsigned int* tailPtrs,
+                        int tailCount,
+                        int& gridOpIndex);
+
+    void prepareDynamicScalingBuffer(int scalingIndex,
+                                     bool keepValues);
+
     int  reorderPatternsByPartition();
 
     int upPartials(bool byPartition,
@@ -400,6 +493,16 @@ private:
                    int operationCount,
                    int cumulativeScalingIndex);
 
+    bool upPartialsTraversal(const int* operations,
+                             int operationCount);
+
+    void integrateRootLogLikelihoods(const int* bufferIndices,
+                                     const int* categoryWeightsIndices,
+                                     const int* stateFrequenciesIndices,
+                                     const int* cumulativeScaleIndices,
+                                     int count,
+                                     GPUPtr dResult);
+
 };
 
 BEAGLE_GPU_TEMPLATE
@@ -416,16 +519,31 @@ public:
                                    int scaleBufferCount,
                                    int resourceNumber,
                                    int pluginResourceNumber,
-                                   long preferenceFlags,
-                                   long requirementFlags,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
                                    int* errorCode);
 
     virtual const char* getName();
-    virtual const long getFlags();
+    virtual const long long getFlags();
+
+    virtual int getMemoryFootprint(int tipCount,
+                                   int partialsBufferCount,
+                                   int compactBufferCount,
+                                   int stateCount,
+                                   int patternCount,
+                                   int eigenBufferCount,
+                                   int matrixBufferCount,
+                                   int categoryCount,
+                                   int scaleBufferCount,
+                                   int resourceNumber,
+                                   int pluginResourceNumber,
+                                   long long preferenceFlags,
+                                   long long requirementFlags,
+                                   size_t* outBytes);
 };
 
 template <typename Real>
-void modifyFlagsForPrecision(long* flags, Real r);
+void modifyFlagsForPrecision(long long* flags, Real r);
 
 } // namspace device
 }	// namespace gpu
@@ -58,6 +58,7 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::BeagleGPUImpl() {
     
     gpu = NULL;
     kernels = NULL;
+    kZeroCopy = false;
     
     dIntegrationTmp = (GPUPtr)NULL;
     dOutFirstDeriv = (GPUPtr)NULL;
@@ -67,6 +68,8 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::BeagleGPUImpl() {
     dSecondDerivTmp = (GPUPtr)NULL;
     
     dSumLogLikelihood = (GPUPtr)NULL;
+    dLogLikelihoodResultsOrigin = (GPUPtr)NULL;
+    dLogLikelihoodResults = NULL;
     dSumFirstDeriv = (GPUPtr)NULL;
     dSumSecondDeriv = (GPUPtr)NULL;
     
@@ -80,6 +83,8 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::BeagleGPUImpl() {
     
     dMaxScalingFactors = (GPUPtr)NULL;
     dIndexMaxScalingFactors = (GPUPtr)NULL;
+
+    hScalingStatistics = BeagleScalingStatistics();
     
     dEigenValues = NULL;
     dEvec = NULL;
@@ -109,13 +114,26 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::BeagleGPUImpl() {
     hWeightsCache = NULL;
     hFrequenciesCache = NULL;
     hLogLikelihoodsCache = NULL;
+    hLogLikelihoodResultsCache = NULL;
     hPartialsCache = NULL;
     hStatesCache = NULL;
     hMatrixCache = NULL;
+
+    for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++) {
+        hMatrixStaging[i] = NULL;
+        hTipStaging[i] = NULL;
+        kTipStagingSize[i] = 0;
+    }
+    kTransferIndex = 0;
     
-    hRescalingTrigger = NULL;
     dRescalingTrigger = (GPUPtr)NULL;
     dScalingFactorsMaster = NULL;
+
+#ifdef CUDA
+    hMatrixStreams = NULL;
+    kMatricesPending = false;
+    kOperationGraphs = false;
+#endif
     
 }
 
@@ -139,7 +157,7 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
 
         
         if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
-            gpu->FreePinnedHostMemory(hRescalingTrigger);
+            gpu->FreeMemory(dRescalingTrigger);
             for (int i = 0; i < kScaleBufferCount; i++) {
                 if (dScalingFactorsMaster[i] != 0)
                     gpu->FreeMemory(dScalingFactorsMaster[i]);
@@ -177,6 +195,7 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         #else
             // gpu->FreeHostMemory(hPartialsPtrs);
             gpu->FreePinnedHostMemory(hPartialsPtrs);
+            free(hPartialsPtrsDevice);
         #endif
             gpu->FreeMemory(dPartialsPtrs);
             // gpu->FreeMemory(dPartitionOffsets);
@@ -197,6 +216,11 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         gpu->FreeMemory(dSecondDerivTmp);
         
         gpu->FreeMemory(dSumLogLikelihood);
+        if (dLogLikelihoodResultsOrigin != (GPUPtr)NULL) {
+            gpu->FreeMemory(dLogLikelihoodResultsOrigin);
+            free(dLogLikelihoodResults);
+            gpu->FreeTransferMemory(hLogLikelihoodResultsCache);
+        }
         gpu->FreeMemory(dSumFirstDeriv);
         gpu->FreeMemory(dSumSecondDeriv);
         
@@ -235,6 +259,9 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         free(dTipPartialsBuffers);
 
         free(hStreamIndices);
+#ifdef CUDA
+        free(hMatrixStreams);
+#endif
 
         free(hPartialsOffsets);
         free(hStatesOffsets);
@@ -250,8 +277,15 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         gpu->FreeHostMemory(hPartialsCache);
         gpu->FreeHostMemory(hStatesCache);
                 
-        gpu->FreeHostMemory(hLogLikelihoodsCache);
+        gpu->FreeTransferMemory(hLogLikelihoodsCache);
         gpu->FreeHostMemory(hMatrixCache);
+
+        for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++) {
+            gpu->WaitForTransfer(i);
+            gpu->FreeTransferMemory(hMatrixStaging[i]);
+            if (hTipStaging[i] != NULL)
+                gpu->FreeTransferMemory(hTipStaging[i]);
+        }
         
     }
     
@@ -274,8 +308,8 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
                                   int scaleBufferCount,
                                   int globalResourceNumber,
                                   int pluginResourceNumber,
-                                  long preferenceFlags,
-                                  long requirementFlags) {
+                                  long long preferenceFlags,
+                                  long long requirementFlags) {
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tEntering BeagleGPUImpl::createInstance\n");
@@ -305,25 +339,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
 
     kInternalPartialsBufferCount = kBufferCount - kTipCount;
     
-    if (kStateCount <= 4) {
-        kPaddedStateCount = 4;
-    } else if (kStateCount <= 16) {
-        kPaddedStateCount = 16;
-    } else if (kStateCount <= 32) {
-        kPaddedStateCount = 32;
-    } else if (kStateCount <= 48) {
-        kPaddedStateCount = 48;  
-    } else if (kStateCount <= 64) {
-        kPaddedStateCount = 64;
-    } else if (kStateCount <= 80) {
-        kPaddedStateCount = 80;
-    } else if (kStateCount <= 128) {
-        kPaddedStateCount = 128;
-    } else if (kStateCount <= 192){ 
-        kPaddedStateCount = 192;
-    } else {
-        kPaddedStateCount = kStateCount + kStateCount % 16;
-    }
+    kPaddedStateCount = getPaddedStateCount(kStateCount);
 
     gpu = new GPUInterface();
     
@@ -373,6 +389,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     if (kDeviceCode == BEAGLE_OPENCL_DEVICE_INTEL_CPU ||
         kDeviceCode == BEAGLE_OPENCL_DEVICE_INTEL_MIC ||
         kDeviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU ||
+        kDeviceCode == BEAGLE_OPENCL_DEVICE_GENERIC_CPU ||
         kDeviceCode == BEAGLE_OPENCL_DEVICE_APPLE_CPU) {
         
         CPUImpl = true;
@@ -398,6 +415,14 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
             case   80: patternBlockSize = PATTERN_BLOCK_SIZE_SP_80;    break;
             case  128: patternBlockSize = PATTERN_BLOCK_SIZE_SP_128;   break;
             case  192: patternBlockSize = PATTERN_BLOCK_SIZE_SP_192;   break;
+#ifdef BEAGLE_RUNTIME_KERNELS
+            default: {
+                KernelResource* runtimeResource = createRuntimeKernelResource(kPaddedStateCount,
+                                                      kFlags & BEAGLE_FLAG_PRECISION_DOUBLE);
+                patternBlockSize = runtimeResource->patternBlockSize;
+                delete runtimeResource;
+            }
+#endif
         }
     
         // pad patterns for CPU/MIC implementation
@@ -422,29 +447,20 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
 #endif
 
     kScaleBufferSize = kPaddedPatternCount;
+
+#ifdef BEAGLE_HALF_PARTIALS
+    // half precision partials stay in range only when every node is rescaled,
+    // so they are not tried for clients that ask for another scaling scheme
+    kHalfPartials = (sizeof(Real) == sizeof(float) && kPaddedStateCount != 4 && !CPUImpl &&
+                     !((preferenceFlags | requirementFlags) &
+                       (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC)) &&
+                     !(requirementFlags & BEAGLE_FLAG_SCALING_MANUAL));
+#else
+    kHalfPartials = false;
+#endif
     
     kFlags = 0;
     
-    if (preferenceFlags & BEAGLE_FLAG_SCALING_AUTO || requirementFlags & BEAGLE_FLAG_SCALING_AUTO) {
-        kFlags |= BEAGLE_FLAG_SCALING_AUTO;
-        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
-        kScaleBufferCount = kInternalPartialsBufferCount;
-        kScaleBufferSize *= kCategoryCount;
-    } else if (preferenceFlags & BEAGLE_FLAG_SCALING_ALWAYS || requirementFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
-        kFlags |= BEAGLE_FLAG_SCALING_ALWAYS;
-        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
-        kScaleBufferCount = kInternalPartialsBufferCount + 1; // +1 for temp buffer used by edgelikelihood
-    } else if (preferenceFlags & BEAGLE_FLAG_SCALING_DYNAMIC || requirementFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
-        kFlags |= BEAGLE_FLAG_SCALING_DYNAMIC;
-        kFlags |= BEAGLE_FLAG_SCALERS_RAW;
-    } else if (preferenceFlags & BEAGLE_FLAG_SCALERS_LOG || requirementFlags & BEAGLE_FLAG_SCALERS_LOG) {
-        kFlags |= BEAGLE_FLAG_SCALING_MANUAL;
-        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
-    } else {
-        kFlags |= BEAGLE_FLAG_SCALING_MANUAL;
-        kFlags |= BEAGLE_FLAG_SCALERS_RAW;
-    }
-    
     if (preferenceFlags & BEAGLE_FLAG_EIGEN_COMPLEX || requirementFlags & BEAGLE_FLAG_EIGEN_COMPLEX) {
         kFlags |= BEAGLE_FLAG_EIGEN_COMPLEX;
     } else {
@@ -463,6 +479,11 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     else if (requirementFlags & BEAGLE_FLAG_PARALLELOPS_GRID || preferenceFlags & BEAGLE_FLAG_PARALLELOPS_GRID)
         kFlags |= BEAGLE_FLAG_PARALLELOPS_GRID;
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+    if (requirementFlags & BEAGLE_FLAG_KERNEL_TUNING || preferenceFlags & BEAGLE_FLAG_KERNEL_TUNING)
+        kFlags |= BEAGLE_FLAG_KERNEL_TUNING;
+#endif
+
     Real r = 0;
     modifyFlagsForPrecision(&kFlags, r);
     
@@ -484,7 +505,38 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     
     // TODO: recompiling kernels for every instance, probably not ideal
     gpu->SetDevice(pluginResourceNumber, kPaddedStateCount, kCategoryCount, 
-                   kPaddedPatternCount, kPatternCount, kTipCount, kFlags);
+                   kPaddedPatternCount, kPatternCount, kTipCount, kFlags, kHalfPartials);
+
+    // the kernels that were built decide how partials are stored
+    kHalfPartials = (gpu->kernelResource->halfPartials != 0);
+    kPartialsRealSize = (kHalfPartials ? sizeof(unsigned short) : sizeof(Real));
+
+    // scaling is chosen only now, so a failed half precision build leaves the
+    // client's own scaling choice and scale buffer count in place
+    if (preferenceFlags & BEAGLE_FLAG_SCALING_AUTO || requirementFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        kFlags |= BEAGLE_FLAG_SCALING_AUTO;
+        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
+        kScaleBufferCount = kInternalPartialsBufferCount;
+        kScaleBufferSize *= kCategoryCount;
+    } else if (kHalfPartials || preferenceFlags & BEAGLE_FLAG_SCALING_ALWAYS || requirementFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+        kFlags |= BEAGLE_FLAG_SCALING_ALWAYS;
+        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
+        kScaleBufferCount = kInternalPartialsBufferCount + 1; // +1 for temp buffer used by edgelikelihood
+    } else if ((preferenceFlags & BEAGLE_FLAG_SCALING_DYNAMIC || requirementFlags & BEAGLE_FLAG_SCALING_DYNAMIC) &&
+               kPaddedStateCount == 4) { // checking kernels exist for nucleotides only
+        kFlags |= BEAGLE_FLAG_SCALING_DYNAMIC;
+        kFlags |= BEAGLE_FLAG_SCALERS_RAW;
+    } else if (preferenceFlags & BEAGLE_FLAG_SCALERS_LOG || requirementFlags & BEAGLE_FLAG_SCALERS_LOG) {
+        kFlags |= BEAGLE_FLAG_SCALING_MANUAL;
+        kFlags |= BEAGLE_FLAG_SCALERS_LOG;
+    } else {
+        kFlags |= BEAGLE_FLAG_SCALING_MANUAL;
+        kFlags |= BEAGLE_FLAG_SCALERS_RAW;
+    }
+
+    // where device and host share memory, inputs and outputs are read and
+    // written in place instead of copied
+    kZeroCopy = gpu->GetSupportsZeroCopy(pluginResourceNumber);
 
 #ifdef FW_OPENCL
     kFlags |= gpu->GetDeviceTypeFlag(pluginResourceNumber);
@@ -494,29 +546,19 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     if (kInternalPartialsBufferCount > ptrQueueLength)
         ptrQueueLength = kInternalPartialsBufferCount;
     
-    unsigned int neededMemory = sizeof(Real) * (kMatrixSize * kEigenDecompCount + // dEvec
-                                             kMatrixSize * kEigenDecompCount + // dIevc
-                                             kEigenValuesSize * kEigenDecompCount + // dEigenValues
-                                             kCategoryCount * kPartialsBufferCount + // dWeights
-                                             kPaddedStateCount * kPartialsBufferCount + // dFrequencies
-                                             kPaddedPatternCount + // dIntegrationTmp
-                                             kPaddedPatternCount + // dOutFirstDeriv
-                                             kPaddedPatternCount + // dOutSecondDeriv
-                                             kPartialsSize + // dPartialsTmp
-                                             kPartialsSize + // dFirstDerivTmp
-                                             kPartialsSize + // dSecondDerivTmp
-                                             kScaleBufferCount * kPaddedPatternCount + // dScalingFactors
-                                             kPartialsBufferCount * kPartialsSize + // dTipPartialsBuffers + dPartials
-                                             kMatrixCount * kMatrixSize * kCategoryCount + // dMatrices
-                                             kBufferCount + // dBranchLengths
-                                             kMatrixCount * kCategoryCount * 2) + // dDistanceQueue
-    sizeof(int) * kCompactBufferCount * kPaddedPatternCount + // dCompactBuffers
-    sizeof(GPUPtr) * ptrQueueLength;  // dPtrQueue
+    size_t neededMemory = getDeviceMemorySize(kPaddedStateCount, kPaddedPatternCount, kEigenValuesSize,
+                                              kPartialsBufferCount, kCompactBufferCount,
+                                              kInternalPartialsBufferCount, kEigenDecompCount, kMatrixCount,
+                                              kCategoryCount, kScaleBufferCount, kPartialsRealSize);
+
+    if (kZeroCopy) // mapped, so not taken from the pool
+        neededMemory -= sizeof(Real) * (kPaddedPatternCount + kMatrixCount * kMatrixSize * kCategoryCount) +
+                        kPartialsRealSize * kPartialsBufferCount * kPartialsSize;
     
     #ifdef CUDA
         unsigned int availableMem = gpu->GetAvailableMemory();
     #ifdef BEAGLE_DEBUG_VALUES
-        fprintf(stderr, "     needed memory: %d\n", neededMemory);
+        fprintf(stderr, "     needed memory: %lu\n", (unsigned long) neededMemory);
         fprintf(stderr, "  available memory: %d\n", availableMem);
     #endif     
         // TODO: fix memory check on CUDA and implement for OpenCL
@@ -524,6 +566,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
         //     return BEAGLE_ERROR_OUT_OF_MEMORY;
     #endif
 
+    // one region for all device buffers below, with room for the alignment
+    // of each; anything that does not fit is allocated on its own
+    gpu->ReserveMemoryPool((size_t) neededMemory + 64 * BEAGLE_MEMORY_POOL_ALIGNMENT);
+
     kernels = new KernelLauncher(gpu);
     
     // TODO: only allocate if necessary on the fly
@@ -536,8 +582,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     if ((2 * kMatrixSize + kEigenValuesSize) > hMatrixCacheSize)
         hMatrixCacheSize = 2 * kMatrixSize + kEigenValuesSize;
     
-    hLogLikelihoodsCache = (Real*) gpu->MallocHost(kPatternCount * sizeof(Real));
+    hLogLikelihoodsCache = (Real*) gpu->AllocateTransferMemory(kPatternCount * sizeof(Real));
     hMatrixCache = (Real*) gpu->CallocHost(hMatrixCacheSize, sizeof(Real));
+
+    for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++) {
+        hMatrixStaging[i] = (Real*) gpu->AllocateTransferMemory(hMatrixCacheSize * sizeof(Real));
+        memset(hMatrixStaging[i], 0, hMatrixCacheSize * sizeof(Real));
+    }
     
     dEvec = (GPUPtr*) calloc(sizeof(GPUPtr),kEigenDecompCount);
     dIevc = (GPUPtr*) calloc(sizeof(GPUPtr),kEigenDecompCount);
@@ -549,7 +600,8 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
 
     size_t ptrIncrement = gpu->AlignMemOffset(kMatrixSize * kCategoryCount * sizeof(Real));
     kIndexOffsetMat = ptrIncrement/sizeof(Real);
-    GPUPtr dMatricesOrigin = gpu->AllocateMemory(kMatrixCount * ptrIncrement);
+    GPUPtr dMatricesOrigin = (kZeroCopy ? gpu->AllocateMappedMemory(kMatrixCount * ptrIncrement) :
+                                          gpu->AllocateMemory(kMatrixCount * ptrIncrement));
     for (int i = 0; i < kMatrixCount; i++) {
         dMatrices[i] = gpu->CreateSubPointer(dMatricesOrigin, ptrIncrement*i, ptrIncrement);
     }
@@ -565,8 +617,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
 #ifdef CUDA
             dScalingFactors = (GPUPtr*) calloc(sizeof(GPUPtr), kScaleBufferCount);
             dScalingFactorsMaster = (GPUPtr*) calloc(sizeof(GPUPtr), kScaleBufferCount);
-            hRescalingTrigger = (int*) gpu->AllocatePinnedHostMemory(sizeof(int), false, true);
-            dRescalingTrigger = gpu->GetDeviceHostPointer((void*) hRescalingTrigger);
+            dRescalingTrigger = gpu->AllocateMemory(sizeof(int));
 #else
             return BEAGLE_ERROR_NO_IMPLEMENTATION;
 #endif
@@ -612,7 +663,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     }
 
     
-    dIntegrationTmp = gpu->AllocateMemory((kPaddedPatternCount + resultPaddedPatterns) * sizeof(Real));
+    if (kZeroCopy)
+        dIntegrationTmp = gpu->AllocateMappedMemory((kPaddedPatternCount + resultPaddedPatterns) * sizeof(Real));
+    else
+        dIntegrationTmp = gpu->AllocateMemory((kPaddedPatternCount + resultPaddedPatterns) * sizeof(Real));
     dOutFirstDeriv = gpu->AllocateMemory((kPaddedPatternCount + resultPaddedPatterns) * sizeof(Real));
     dOutSecondDeriv = gpu->AllocateMemory((kPaddedPatternCount + resultPaddedPatterns) * sizeof(Real));
 
@@ -622,7 +676,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     dSumFirstDeriv = gpu->AllocateMemory(kSumSitesBlockCount * sizeof(Real));
     dSumSecondDeriv = gpu->AllocateMemory(kSumSitesBlockCount * sizeof(Real));
     
-    dPartialsTmp = gpu->AllocateMemory(kPartialsSize * sizeof(Real));
+    dPartialsTmp = gpu->AllocateMemory(kPartialsSize * kPartialsRealSize);
     dFirstDerivTmp = gpu->AllocateMemory(kPartialsSize * sizeof(Real));
     dSecondDerivTmp = gpu->AllocateMemory(kPartialsSize * sizeof(Real));
     
@@ -633,12 +687,15 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     // Fill with 0s so 'free' does not choke if unallocated
     dPartials = (GPUPtr*) calloc(sizeof(GPUPtr), bufferCountTotal);
 
-    ptrIncrement = gpu->AlignMemOffset(kPartialsSize * sizeof(Real));
-    GPUPtr dPartialsTmpOrigin = gpu->AllocateMemory(bufferCountTotal * ptrIncrement); 
+    ptrIncrement = gpu->AlignMemOffset(kPartialsSize * kPartialsRealSize);
+    GPUPtr dPartialsTmpOrigin = (kZeroCopy ? gpu->AllocateMappedMemory(bufferCountTotal * ptrIncrement) :
+                                             gpu->AllocateMemory(bufferCountTotal * ptrIncrement));
     dPartialsOrigin = gpu->CreateSubPointer(dPartialsTmpOrigin, 0, ptrIncrement);
     hPartialsOffsets = (unsigned int*) calloc(sizeof(unsigned int), bufferCountTotal);
-    kIndexOffsetPat = gpu->AlignMemOffset(kPartialsSize * sizeof(Real)) / sizeof(Real);
+    kIndexOffsetPat = ptrIncrement / kPartialsRealSize;
 
+    // compact states stay one int per pattern, unlike the CPU's one byte; the kernels take them
+    // as ints and kIndexOffsetStates / hStatesOffsets count ints
     size_t ptrIncrementStates = gpu->AlignMemOffset(kPaddedPatternCount * sizeof(int));
     GPUPtr dStatesTmpOrigin;
     if (kCompactBufferCount > 0) {
@@ -656,6 +713,9 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     dTipPartialsBuffers = (GPUPtr*) malloc(sizeof(GPUPtr) * kTipPartialsBufferCount);
     
     hStreamIndices = (int*) malloc(sizeof(int) * kBufferCount);
+#ifdef CUDA
+    hMatrixStreams = (int*) calloc(sizeof(int), kMatrixCount);
+#endif
 
     for (int i = 0; i < bufferCountTotal; i++) {
         if (i < kTipCount) { // For the tips
@@ -701,7 +761,8 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     kUsingMultiGrid = false;
 
 
-    if (kPaddedStateCount == 4 && (kDeviceType==BEAGLE_FLAG_PROCESSOR_CPU || kPaddedPatternCount < BEAGLE_MULTI_GRID_MAX || kFlags & BEAGLE_FLAG_PARALLELOPS_GRID) && !(kFlags & BEAGLE_FLAG_PARALLELOPS_STREAMS)) {
+    // dynamic scaling checks partials with its own per-operation kernels
+    if (kPaddedStateCount == 4 && (kDeviceType==BEAGLE_FLAG_PROCESSOR_CPU || kPaddedPatternCount < BEAGLE_MULTI_GRID_MAX || kFlags & BEAGLE_FLAG_PARALLELOPS_GRID) && !(kFlags & (BEAGLE_FLAG_PARALLELOPS_STREAMS | BEAGLE_FLAG_SCALING_DYNAMIC))) {
         kUsingMultiGrid = true;
         allocateMultiGridBuffers();
 
@@ -717,6 +778,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
         // gpu->MemcpyHostToDevice(dPartitionOffsets, hPartitionOffsets, transferSize);
     }
 
+    // too few sites to fill the device: launch latency dominates
+    kUsingTraversalKernel = (kUsingMultiGrid && kDeviceType == BEAGLE_FLAG_PROCESSOR_GPU &&
+                             kPaddedPatternCount < BEAGLE_TRAVERSAL_KERNEL_MAX);
+
     hCategoryRates = (double**) calloc(sizeof(double*),kEigenDecompCount); // Keep in double-precision
     hCategoryRates[0] = (double*) gpu->MallocHost(sizeof(double) * kCategoryCount);
     checkHostMemory(hCategoryRates[0]);
@@ -742,7 +807,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     gpu->SynchronizeHost();
     int usedMemory = availableMem - gpu->GetAvailableMemory();
     fprintf(stderr, "actual used memory: %d\n", usedMemory);
-    fprintf(stderr, "        difference: %d\n\n", usedMemory-neededMemory);
+    fprintf(stderr, "        difference: %ld\n\n", (long) usedMemory - (long) neededMemory);
 #endif
 #endif
 
@@ -761,6 +826,9 @@ void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::allocateMultiGridBuffers() {
     dPartialsPtrs = gpu->AllocateMemory(kOpOffsetsSize);
     // hPartialsPtrs = (unsigned int*) gpu->MallocHost(kOpOffsetsSize);
     hPartialsPtrs = (unsigned int*) gpu->AllocatePinnedHostMemory(kOpOffsetsSize, true, false);
+    hPartialsPtrsDevice = (unsigned int*) malloc(kOpOffsetsSize);
+    checkHostMemory(hPartialsPtrsDevice);
+    kPartialsPtrsUploaded = 0;
     #endif
     checkHostMemory(hPartialsPtrs);
 
@@ -794,6 +862,119 @@ char* BeagleGPUImpl<float>::getInstanceName() {
 }
 #endif
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getPaddedStateCount(int stateCount) {
+    int paddedStateCount;
+    if (stateCount <= 4) {
+        paddedStateCount = 4;
+    } else if (stateCount <= 16) {
+        paddedStateCount = 16;
+    } else if (stateCount <= 32) {
+        paddedStateCount = 32;
+    } else if (stateCount <= 48) {
+        paddedStateCount = 48;
+    } else if (stateCount <= 64) {
+        paddedStateCount = 64;
+    } else if (stateCount <= 80) {
+        paddedStateCount = 80;
+    } else if (stateCount <= 128) {
+        paddedStateCount = 128;
+    } else if (stateCount <= 192){
+        paddedStateCount = 192;
+    } else {
+        paddedStateCount = stateCount + stateCount % 16;
+    }
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+    // kernels are built at runtime for counts without precompiled kernels,
+    // so pad only to a multiple of 4 (e.g. 20 amino acids stay at 20)
+    if (stateCount > 4 && ((stateCount + 3) & ~3) < paddedStateCount)
+        paddedStateCount = (stateCount + 3) & ~3;
+#endif
+
+    return paddedStateCount;
+}
+
+BEAGLE_GPU_TEMPLATE
+size_t BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getDeviceMemorySize(int paddedStateCount,
+                                                              int paddedPatternCount,
+                                                              int eigenValuesSize,
+                                                              int partialsBufferCount,
+                                                              int compactBufferCount,
+                                                              int internalPartialsBufferCount,
+                                                              int eigenDecompCount,
+                                                              int matrixCount,
+                                                              int categoryCount,
+                                                              int scaleBufferCount,
+                                                              size_t partialsRealSize) {
+    const size_t partialsSize = (size_t) paddedPatternCount * paddedStateCount * categoryCount;
+    const size_t matrixSize = (size_t) paddedStateCount * paddedStateCount;
+
+    size_t ptrQueueLength = (size_t) matrixCount * categoryCount * 3 * 3; // first '3' for derivatives, last '3' is for 3 ops for uTMWMM
+    if ((size_t) internalPartialsBufferCount > ptrQueueLength)
+        ptrQueueLength = internalPartialsBufferCount;
+
+    return sizeof(Real) * (matrixSize * eigenDecompCount + // dEvec
+                           matrixSize * eigenDecompCount + // dIevc
+                           (size_t) eigenValuesSize * eigenDecompCount + // dEigenValues
+                           (size_t) categoryCount * partialsBufferCount + // dWeights
+                           (size_t) paddedStateCount * partialsBufferCount + // dFrequencies
+                           paddedPatternCount + // dIntegrationTmp
+                           paddedPatternCount + // dOutFirstDeriv
+                           paddedPatternCount + // dOutSecondDeriv
+                           partialsSize + // dFirstDerivTmp
+                           partialsSize + // dSecondDerivTmp
+                           (size_t) scaleBufferCount * paddedPatternCount + // dScalingFactors
+                           matrixCount * matrixSize * categoryCount + // dMatrices
+                           partialsBufferCount + compactBufferCount + // dBranchLengths
+                           (size_t) matrixCount * categoryCount * 2) + // dDistanceQueue
+           partialsRealSize * partialsSize + // dPartialsTmp
+           partialsRealSize * partialsBufferCount * partialsSize + // dTipPartialsBuffers + dPartials
+           sizeof(int) * compactBufferCount * paddedPatternCount + // dCompactBuffers
+           sizeof(GPUPtr) * ptrQueueLength;  // dPtrQueue
+}
+
+BEAGLE_GPU_TEMPLATE
+size_t BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getMemoryFootprint(int tipCount,
+                                                             int partialsBufferCount,
+                                                             int compactBufferCount,
+                                                             int stateCount,
+                                                             int patternCount,
+                                                             int eigenDecompositionCount,
+                                                             int matrixCount,
+                                                             int categoryCount,
+                                                             int scaleBufferCount,
+                                                             long long preferenceFlags,
+                                                             long long requirementFlags) {
+    // the padding and scaling choices of createInstance for a discrete GPU, where
+    // nothing is mapped from the host and patterns are padded for nucleotides only
+    const long long flags = preferenceFlags | requirementFlags;
+    const int paddedStateCount = getPaddedStateCount(stateCount);
+    int paddedPatternCount = patternCount;
+    if (paddedStateCount == 4 && patternCount % 4 != 0)
+        paddedPatternCount += 4 - patternCount % 4;
+    const int internalPartialsBufferCount = partialsBufferCount + compactBufferCount - tipCount;
+
+    bool halfPartials = false;
+#ifdef BEAGLE_HALF_PARTIALS
+    halfPartials = (sizeof(Real) == sizeof(float) && paddedStateCount != 4 &&
+                    !(flags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC)) &&
+                    !(requirementFlags & BEAGLE_FLAG_SCALING_MANUAL));
+#endif
+
+    if (flags & BEAGLE_FLAG_SCALING_AUTO)
+        scaleBufferCount = internalPartialsBufferCount;
+    else if (halfPartials || flags & BEAGLE_FLAG_SCALING_ALWAYS)
+        scaleBufferCount = internalPartialsBufferCount + 1;
+
+    const int eigenValuesSize = (flags & BEAGLE_FLAG_EIGEN_COMPLEX ? 2 : 1) * paddedStateCount;
+
+    return getDeviceMemorySize(paddedStateCount, paddedPatternCount, eigenValuesSize,
+                               partialsBufferCount, compactBufferCount, internalPartialsBufferCount,
+                               eigenDecompositionCount, matrixCount, categoryCount, scaleBufferCount,
+                               (halfPartials ? sizeof(unsigned short) : sizeof(Real)));
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getInstanceDetails(BeagleInstanceDetails* returnInfo) {
     if (returnInfo != NULL) {
@@ -862,8 +1043,26 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
 
+    if (tipIndex < kTipCount) {
+        if (dPartials[tipIndex] == 0) {
+            assert(kLastTipPartialsBufferIndex >= 0 && kLastTipPartialsBufferIndex <
+                   kTipPartialsBufferCount);
+            dPartials[tipIndex] = dTipPartialsBuffers[kLastTipPartialsBufferIndex];
+            hPartialsOffsets[tipIndex] = kIndexOffsetPat*kLastTipPartialsBufferIndex;
+            kLastTipPartialsBufferIndex--;
+        }
+    }
+
+    // zero-copy partials are written in place, unless stored as half
+    bool inPlace = kZeroCopy && !kHalfPartials;
+    Real* hTipPartials = hPartialsCache;
+    if (inPlace) {
+        hTipPartials = (Real*) gpu->MapMemory(dPartials[tipIndex], sizeof(Real) * kPartialsSize);
+        memset(hTipPartials, 0, sizeof(Real) * kPartialsSize);
+    }
+
     const double* inPartialsOffset = inPartials;
-    Real* tmpRealPartialsOffset = hPartialsCache;
+    Real* tmpRealPartialsOffset = hTipPartials;
     for (int i = 0; i < kPatternCount; i++) {
 //#ifdef DOUBLE_PRECISION
 //        memcpy(tmpRealPartialsOffset, inPartialsOffset, sizeof(Real) * kStateCount);
@@ -877,20 +1076,23 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     
     int partialsLength = kPaddedPatternCount * kPaddedStateCount;
     for (int i = 1; i < kCategoryCount; i++) {
-        memcpy(hPartialsCache + i * partialsLength, hPartialsCache, partialsLength * sizeof(Real));
+        memcpy(hTipPartials + i * partialsLength, hTipPartials, partialsLength * sizeof(Real));
     }    
     
-    if (tipIndex < kTipCount) {
-        if (dPartials[tipIndex] == 0) {
-            assert(kLastTipPartialsBufferIndex >= 0 && kLastTipPartialsBufferIndex <
-                   kTipPartialsBufferCount);
-            dPartials[tipIndex] = dTipPartialsBuffers[kLastTipPartialsBufferIndex];
-            hPartialsOffsets[tipIndex] = kIndexOffsetPat*kLastTipPartialsBufferIndex;
-            kLastTipPartialsBufferIndex--;
-        }
+    if (inPlace) {
+        gpu->UnmapMemory(dPartials[tipIndex], hTipPartials);
+    } else {
+        // Copy to GPU device
+#ifdef BEAGLE_HALF_PARTIALS
+        if (kHalfPartials)
+            convertToHalf(hPartialsCache, kPartialsSize);
+#endif
+        gpu->MemcpyHostToDevice(dPartials[tipIndex], hPartialsCache, kPartialsRealSize * kPartialsSize);
+#ifdef BEAGLE_HALF_PARTIALS
+        if (kHalfPartials) // padding must read back as zeros next time
+            convertFromHalf(hPartialsCache, kPartialsSize);
+#endif
     }
-    // Copy to GPU device
-    gpu->MemcpyHostToDevice(dPartials[tipIndex], hPartialsCache, sizeof(Real) * kPartialsSize);
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTipPartials\n");
@@ -899,6 +1101,129 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipStatesBatch(const int* tipIndices,
+                                                         const int* inStates,
+                                                         int count) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setTipStatesBatch\n");
+#endif
+
+    for (int t = 0; t < count; t++) {
+        if (tipIndices[t] < 0 || tipIndices[t] >= kTipCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    // tips are packed into a staging buffer and queued without waiting, while
+    // the next chunk is packed into the other buffer
+    size_t tipSize = sizeof(int) * kPaddedPatternCount;
+    int chunkTips = (tipSize < BEAGLE_TIP_STAGING_SIZE ? BEAGLE_TIP_STAGING_SIZE / tipSize : 1);
+    for (int start = 0; start < count; start += chunkTips) {
+        int end = (start + chunkTips < count ? start + chunkTips : count);
+        int* hStaging = (int*) getTipStaging(tipSize * (end - start));
+
+        for (int t = start; t < end; t++) {
+            int tipIndex = tipIndices[t];
+            const int* tipStates = inStates + (size_t) t * kPatternCount;
+            int* hTipStates = hStaging + (size_t) (t - start) * kPaddedPatternCount;
+            for (int i = 0; i < kPatternCount; i++)
+                hTipStates[i] = (tipStates[i] < kStateCount ? tipStates[i] : kPaddedStateCount);
+            for (int i = kPatternCount; i < kPaddedPatternCount; i++)
+                hTipStates[i] = kPaddedStateCount;
+
+            if (dStates[tipIndex] == 0) {
+                assert(kLastCompactBufferIndex >= 0 && kLastCompactBufferIndex < kCompactBufferCount);
+                dStates[tipIndex] = dCompactBuffers[kLastCompactBufferIndex];
+                hStatesOffsets[tipIndex] = kIndexOffsetStates * kLastCompactBufferIndex;
+                kLastCompactBufferIndex--;
+            }
+            gpu->MemcpyHostToDeviceAsync(dStates[tipIndex], hTipStates, tipSize, kTransferIndex);
+        }
+        kTransferIndex = (kTransferIndex + 1) % BEAGLE_TRANSFER_BUFFER_COUNT;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTipStatesBatch\n");
+#endif
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartialsBatch(const int* tipIndices,
+                                                           const double* inPartials,
+                                                           int count) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setTipPartialsBatch\n");
+#endif
+
+    for (int t = 0; t < count; t++) {
+        if (tipIndices[t] < 0 || tipIndices[t] >= kTipCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    // zero-copy and half partials have no plain staging layout to pack into
+    if (kZeroCopy || kHalfPartials) {
+        for (int t = 0; t < count; t++)
+            setTipPartials(tipIndices[t], inPartials + (size_t) t * kPatternCount * kStateCount);
+        return BEAGLE_SUCCESS;
+    }
+
+    size_t tipSize = sizeof(Real) * kPartialsSize;
+    int partialsLength = kPaddedPatternCount * kPaddedStateCount;
+    int chunkTips = (tipSize < BEAGLE_TIP_STAGING_SIZE ? BEAGLE_TIP_STAGING_SIZE / tipSize : 1);
+    for (int start = 0; start < count; start += chunkTips) {
+        int end = (start + chunkTips < count ? start + chunkTips : count);
+        Real* hStaging = (Real*) getTipStaging(tipSize * (end - start));
+        memset(hStaging, 0, tipSize * (end - start));
+
+        for (int t = start; t < end; t++) {
+            int tipIndex = tipIndices[t];
+            if (dPartials[tipIndex] == 0) {
+                assert(kLastTipPartialsBufferIndex >= 0 && kLastTipPartialsBufferIndex <
+                       kTipPartialsBufferCount);
+                dPartials[tipIndex] = dTipPartialsBuffers[kLastTipPartialsBufferIndex];
+                hPartialsOffsets[tipIndex] = kIndexOffsetPat*kLastTipPartialsBufferIndex;
+                kLastTipPartialsBufferIndex--;
+            }
+
+            const double* inPartialsOffset = inPartials + (size_t) t * kPatternCount * kStateCount;
+            Real* hTipPartials = hStaging + (size_t) (t - start) * kPartialsSize;
+            Real* tmpRealPartialsOffset = hTipPartials;
+            for (int i = 0; i < kPatternCount; i++) {
+                beagleMemCpy(tmpRealPartialsOffset, inPartialsOffset, kStateCount);
+                tmpRealPartialsOffset += kPaddedStateCount;
+                inPartialsOffset += kStateCount;
+            }
+            for (int i = 1; i < kCategoryCount; i++) {
+                memcpy(hTipPartials + i * partialsLength, hTipPartials, partialsLength * sizeof(Real));
+            }
+
+            gpu->MemcpyHostToDeviceAsync(dPartials[tipIndex], hTipPartials, tipSize, kTransferIndex);
+        }
+        kTransferIndex = (kTransferIndex + 1) % BEAGLE_TRANSFER_BUFFER_COUNT;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTipPartialsBatch\n");
+#endif
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+void* BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getTipStaging(size_t size) {
+    // the buffer may still be feeding the uploads of an earlier chunk
+    gpu->WaitForTransfer(kTransferIndex);
+    if (kTipStagingSize[kTransferIndex] < size) {
+        if (hTipStaging[kTransferIndex] != NULL)
+            gpu->FreeTransferMemory(hTipStaging[kTransferIndex]);
+        hTipStaging[kTransferIndex] = gpu->AllocateTransferMemory(size);
+        kTipStagingSize[kTransferIndex] = size;
+    }
+    return hTipStaging[kTransferIndex];
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
@@ -935,7 +1260,15 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPartials(int bufferIndex,
         }
     }
     // Copy to GPU device
-    gpu->MemcpyHostToDevice(dPartials[bufferIndex], hPartialsCache, sizeof(Real) * kPartialsSize);
+#ifdef BEAGLE_HALF_PARTIALS
+    if (kHalfPartials)
+        convertToHalf(hPartialsCache, kPartialsSize);
+#endif
+    gpu->MemcpyHostToDevice(dPartials[bufferIndex], hPartialsCache, kPartialsRealSize * kPartialsSize);
+#ifdef BEAGLE_HALF_PARTIALS
+    if (kHalfPartials) // padding must read back as zeros next time
+        convertFromHalf(hPartialsCache, kPartialsSize);
+#endif
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::setPartials\n");
@@ -952,7 +1285,11 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getPartials(int bufferIndex,
     fprintf(stderr, "\tEntering BeagleGPUImpl::getPartials\n");
 #endif
 
-    gpu->MemcpyDeviceToHost(hPartialsCache, dPartials[bufferIndex], sizeof(Real) * kPartialsSize);
+    gpu->MemcpyDeviceToHost(hPartialsCache, dPartials[bufferIndex], kPartialsRealSize * kPartialsSize);
+#ifdef BEAGLE_HALF_PARTIALS
+    if (kHalfPartials)
+        convertFromHalf(hPartialsCache, kPartialsSize);
+#endif
     
     double* outPartialsOffset = outPartials;
     Real* tmpRealPartialsOffset = hPartialsCache;
@@ -1264,7 +1601,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternPartitions(int partitionCount,
     }
 
     bool useMultiGrid = true;
-    if (!kUsingMultiGrid && ((kPaddedPatternCount/kPartitionCount >= BEAGLE_MULTI_GRID_MAX && kDeviceCode == BEAGLE_CUDA_DEVICE_NVIDIA_GPU) || kFlags & BEAGLE_FLAG_PARALLELOPS_STREAMS) && !(kFlags & BEAGLE_FLAG_PARALLELOPS_GRID)) {
+    if (!kUsingMultiGrid && ((kPaddedPatternCount/kPartitionCount >= BEAGLE_MULTI_GRID_MAX && kDeviceCode == BEAGLE_CUDA_DEVICE_NVIDIA_GPU) || kFlags & (BEAGLE_FLAG_PARALLELOPS_STREAMS | BEAGLE_FLAG_SCALING_DYNAMIC)) && !(kFlags & BEAGLE_FLAG_PARALLELOPS_GRID)) {
         useMultiGrid = false; // use streams for larger partitions on CUDA
     }
 
@@ -1284,6 +1621,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternPartitions(int partitionCount,
             gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
             #else
             gpu->FreePinnedHostMemory(hPartialsPtrs);
+            free(hPartialsPtrsDevice);
             #endif
             gpu->FreeMemory(dPartialsPtrs);
             // gpu->FreeMemory(dPartitionOffsets);
@@ -1384,6 +1722,11 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternPartitions(int partitionCount,
         kMaxPaddedPartitionIntegrateBlocks = kPaddedPartitionIntegrateBlocks;
     }
     kPartitionsInitialised = true;
+
+#ifdef CUDA
+    // captured launches are bound to the old partition blocks
+    gpu->ReleaseGraph();
+#endif
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::setPatternPartitions\n");
@@ -1392,6 +1735,42 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternPartitions(int partitionCount,
     return returnCode;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setOperationGraphs(int enabled) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setOperationGraphs\n");
+#endif
+
+#ifdef CUDA
+    kOperationGraphs = (enabled != 0);
+
+    if (!kOperationGraphs) {
+        gpu->ReleaseGraph();
+        hGraphKey.clear();
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setOperationGraphs\n");
+#endif
+
+    return BEAGLE_SUCCESS;
+#else
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+#endif
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getScalingStatistics(BeagleScalingStatistics* outStatistics) {
+    *outStatistics = hScalingStatistics;
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::resetScalingStatistics() {
+    hScalingStatistics = BeagleScalingStatistics();
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::reorderPatternsByPartition() {    
 #ifdef BEAGLE_DEBUG_FLOW
@@ -1570,18 +1949,14 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getTransitionMatrix(int matrixIndex,
 }
 
 BEAGLE_GPU_TEMPLATE
-int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrix(int matrixIndex,
-                                       const double* inMatrix,
-                                       double paddedValue) {
-    
-#ifdef BEAGLE_DEBUG_FLOW
-    fprintf(stderr, "\tEntering BeagleGPUImpl::setTransitionMatrix\n");
-#endif
-    
-    const double* inMatrixOffset = inMatrix;
-    Real* tmpRealMatrixOffset = hMatrixCache;
-    
-    for (int l = 0; l < kCategoryCount; l++) {
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::writeTransitionMatrices(Real* hDestination,
+                                                                const double* inMatrices,
+                                                                int count) {
+    // padded and transposed as the kernels read them; padding is left as is
+    const double* inMatrixOffset = inMatrices;
+    Real* tmpRealMatrixOffset = hDestination;
+    
+    for (int l = 0; l < kCategoryCount * count; l++) {
         Real* transposeOffset = tmpRealMatrixOffset;
         
         for (int i = 0; i < kStateCount; i++) {
@@ -1598,10 +1973,36 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrix(int matrixIndex,
         transposeSquareMatrix(transposeOffset, kPaddedStateCount);
         tmpRealMatrixOffset += (kPaddedStateCount - kStateCount) * kPaddedStateCount;
     }
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrix(int matrixIndex,
+                                       const double* inMatrix,
+                                       double paddedValue) {
+    
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setTransitionMatrix\n");
+#endif
+    
+    if (kZeroCopy) {
+        size_t matrixBytes = sizeof(Real) * kMatrixSize * kCategoryCount;
+        Real* hMatrices = (Real*) gpu->MapMemory(dMatrices[matrixIndex], matrixBytes);
+        memset(hMatrices, 0, matrixBytes);
+        writeTransitionMatrices(hMatrices, inMatrix, 1);
+        gpu->UnmapMemory(dMatrices[matrixIndex], hMatrices);
+    } else {
+        // the staging buffer may still be feeding an earlier upload
+        gpu->WaitForTransfer(kTransferIndex);
+        Real* hStaging = hMatrixStaging[kTransferIndex];
+
+        writeTransitionMatrices(hStaging, inMatrix, 1);
         
-    // Copy to GPU device
-    gpu->MemcpyHostToDevice(dMatrices[matrixIndex], hMatrixCache,
-                            sizeof(Real) * kMatrixSize * kCategoryCount);
+        // Copy to GPU device, filling the other staging buffer meanwhile
+        gpu->MemcpyHostToDeviceAsync(dMatrices[matrixIndex], hStaging,
+                                     sizeof(Real) * kMatrixSize * kCategoryCount,
+                                     kTransferIndex);
+        kTransferIndex = (kTransferIndex + 1) % BEAGLE_TRANSFER_BUFFER_COUNT;
+    }
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTransitionMatrix\n");
@@ -1620,39 +2021,39 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrices(const int* matrixIn
     fprintf(stderr, "\tEntering BeagleGPUImpl::setTransitionMatrices\n");
 #endif
     
+    if (kZeroCopy) {
+        // written in place, one mapped matrix buffer at a time
+        size_t matrixBytes = sizeof(Real) * kMatrixSize * kCategoryCount;
+        for (int k = 0; k < count; k++) {
+            Real* hMatrices = (Real*) gpu->MapMemory(dMatrices[matrixIndices[k]], matrixBytes);
+            memset(hMatrices, 0, matrixBytes);
+            writeTransitionMatrices(hMatrices, inMatrices + k*kStateCount*kStateCount*kCategoryCount, 1);
+            gpu->UnmapMemory(dMatrices[matrixIndices[k]], hMatrices);
+        }
+        return BEAGLE_SUCCESS;
+    }
+
     int k = 0;
     while (k < count) {
+        gpu->WaitForTransfer(kTransferIndex);
+        Real* hStaging = hMatrixStaging[kTransferIndex];
+
         const double* inMatrixOffset = inMatrices + k*kStateCount*kStateCount*kCategoryCount;
-        Real* tmpRealMatrixOffset = hMatrixCache;
         int lumpedMatricesCount = 0;
         int matrixIndex = matrixIndices[k];
                 
         do {
-            for (int l = 0; l < kCategoryCount; l++) {
-                Real* transposeOffset = tmpRealMatrixOffset;
-                
-                for (int i = 0; i < kStateCount; i++) {
-//        #ifdef DOUBLE_PRECISION
-//                    memcpy(tmpRealMatrixOffset, inMatrixOffset, sizeof(Real) * kStateCount);
-//        #else
-//                    MEMCNV(tmpRealMatrixOffset, inMatrixOffset, kStateCount, Real);
-//        #endif
-                    beagleMemCpy(tmpRealMatrixOffset, inMatrixOffset, kStateCount);
-                    tmpRealMatrixOffset += kPaddedStateCount;
-                    inMatrixOffset += kStateCount;
-                }
-                
-                transposeSquareMatrix(transposeOffset, kPaddedStateCount);
-                tmpRealMatrixOffset += (kPaddedStateCount - kStateCount) * kPaddedStateCount;
-            } 
-                    
             lumpedMatricesCount++;
             k++;
         } while ((k < count) && (matrixIndices[k] == matrixIndices[k-1] + 1) && (lumpedMatricesCount < BEAGLE_CACHED_MATRICES_COUNT));
+
+        writeTransitionMatrices(hStaging, inMatrixOffset, lumpedMatricesCount);
         
-        // Copy to GPU device
-        gpu->MemcpyHostToDevice(dMatrices[matrixIndex], hMatrixCache,
-                                sizeof(Real) * kMatrixSize * kCategoryCount * lumpedMatricesCount);
+        // Copy to GPU device while the next lump is transposed
+        gpu->MemcpyHostToDeviceAsync(dMatrices[matrixIndex], hStaging,
+                                     sizeof(Real) * kMatrixSize * kCategoryCount * lumpedMatricesCount,
+                                     kTransferIndex);
+        kTransferIndex = (kTransferIndex + 1) % BEAGLE_TRANSFER_BUFFER_COUNT;
         
     }   
     
@@ -1679,21 +2080,24 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::convolveTransitionMatrices(const int* fir
 
     int returnCode = BEAGLE_SUCCESS;
 
-    if (matrixCount > 0) {
-
-        for(int u = 0; u < matrixCount; u++) {
-            if(firstIndices[u] == resultIndices[u] || secondIndices[u] == resultIndices[u]) {
+    // as on the CPU, the pairs before an in-place one are still convolved
+    for(int u = 0; u < matrixCount; u++) {
+        if(firstIndices[u] == resultIndices[u] || secondIndices[u] == resultIndices[u]) {
 
 #ifdef BEAGLE_DEBUG_FLOW
-                fprintf(stderr, "In-place convolution is not allowed \n");
+            fprintf(stderr, "In-place convolution is not allowed \n");
 #endif
 
-                returnCode = BEAGLE_ERROR_GENERAL;
-                break;
+            returnCode = BEAGLE_ERROR_GENERAL;
+            matrixCount = u;
+            break;
+
+        }//END: overwrite check
+    }//END: u loop
 
-            }//END: overwrite check
-        }//END: u loop
+    if (matrixCount > 0) {
 
+        // every pair and rate category in one launch
         int totalMatrixCount = matrixCount * kCategoryCount;
 
         int ptrIndex = 0;
@@ -1757,6 +2161,32 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
             gpu->MemcpyHostToDevice(dPtrQueue, hPtrQueue, sizeof(unsigned int) * totalCount);
             gpu->MemcpyHostToDevice(dDistanceQueue, hDistanceQueue, sizeof(Real) * totalCount);
             
+#ifdef CUDA
+            int streamCount = gpu->GetStreamCount();
+            if ((kFlags & BEAGLE_FLAG_PARALLELOPS_STREAMS) && !kUsingMultiGrid && streamCount > 1 && count > 1) {
+                // edges in groups on their own streams, so that pruning
+                // can start on each node once its two matrices are done
+                int groupCount = (count < streamCount - 1 ? count : streamCount - 1);
+                for (int g = 0; g < groupCount; g++) {
+                    int startEdge = g * count / groupCount;
+                    int endEdge = (g + 1) * count / groupCount;
+                    int queueOffset = startEdge * kCategoryCount;
+                    int streamIndex = g + 1;
+                    kernels->GetTransitionProbabilitiesSquareConcurrent(dMatrices[0],
+                                                                        dPtrQueue + sizeof(unsigned int) * queueOffset,
+                                                                        dEvec[eigenIndex], dIevc[eigenIndex],
+                                                                        dEigenValues[eigenIndex],
+                                                                        dDistanceQueue + sizeof(Real) * queueOffset,
+                                                                        (endEdge - startEdge) * kCategoryCount,
+                                                                        streamIndex);
+                    gpu->RecordStreamDependency(streamIndex);
+                    for (int i = startEdge; i < endEdge; i++) {
+                        hMatrixStreams[probabilityIndices[i]] = streamIndex;
+                    }
+                }
+                kMatricesPending = true;
+            } else
+#endif
             // Set-up and call GPU kernel
             kernels->GetTransitionProbabilitiesSquare(dMatrices[0], dPtrQueue, dEvec[eigenIndex], dIevc[eigenIndex],
                                                       dEigenValues[eigenIndex], dDistanceQueue, totalCount);
@@ -1941,10 +2371,85 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
         numOps = BEAGLE_PARTITION_OP_COUNT;
     }
 
+    // the scale factors stay on the device, so only passes and patterns are counted
+    if (kFlags & (BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS)) {
+        for (int op = 0; op < operationCount; op++) {
+            if ((kFlags & BEAGLE_FLAG_SCALING_ALWAYS) || operations[op * numOps + 1] >= 0) {
+                hScalingStatistics.passCount++;
+                if (byPartition) {
+                    int partition = operations[op * numOps + 7];
+                    hScalingStatistics.patternCount += hPatternPartitionsStartPatterns[partition + 1] -
+                                                       hPatternPartitionsStartPatterns[partition];
+                } else {
+                    hScalingStatistics.patternCount += kPatternCount;
+                }
+            }
+        }
+    }
+
+#ifdef CUDA
+    // Replay the launches of an identical operation list from a CUDA graph.
+    // Scaling modes that decide on the host between launches are not
+    // captured. The key holds the device buffers as well as the indices, as
+    // tip and scaling buffers can be reassigned between calls.
+    bool graphCapture = false;
+    if (kOperationGraphs && !(kFlags & (BEAGLE_FLAG_SCALING_DYNAMIC | BEAGLE_FLAG_SCALING_ALWAYS))) {
+        std::vector<GPUPtr> graphKey;
+        graphKey.reserve(operationCount * (numOps + 7) + 2);
+        graphKey.push_back((GPUPtr) byPartition);
+        graphKey.push_back(cumulativeScalingBuffer);
+        for (int op = 0; op < operationCount; op++) {
+            const int* operation = operations + op * numOps;
+            for (int j = 0; j < numOps; j++) {
+                graphKey.push_back((GPUPtr) operation[j]);
+            }
+            graphKey.push_back(dPartials[operation[0]]);
+            graphKey.push_back(dPartials[operation[3]]);
+            graphKey.push_back(dStates[operation[3]]);
+            graphKey.push_back(dPartials[operation[5]]);
+            graphKey.push_back(dStates[operation[5]]);
+            graphKey.push_back(operation[1] >= 0 ? dScalingFactors[operation[1]] : 0);
+            graphKey.push_back(operation[2] >= 0 ? dScalingFactors[operation[2]] : 0);
+            if (byPartition && operation[8] >= 0) {
+                graphKey.push_back(dScalingFactors[operation[8]]);
+            }
+        }
+
+        if (gpu->HasGraph() && graphKey == hGraphKey) {
+            gpu->LaunchGraph();
+
+#ifdef BEAGLE_DEBUG_FLOW
+            fprintf(stderr, "\tLeaving  BeagleGPUImpl::upPartials\n");
+#endif
+            return BEAGLE_SUCCESS;
+        }
+
+        hGraphKey.swap(graphKey);
+        graphCapture = gpu->BeginGraphCapture();
+    }
+#endif
+
+    if (kUsingTraversalKernel && kUsingMultiGrid && !byPartition &&
+        cumulativeScalingIndex == BEAGLE_OP_NONE &&
+        upPartialsTraversal(operations, operationCount)) {
+#ifdef CUDA
+        if (graphCapture) {
+            gpu->EndGraphCapture();
+        }
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+        fprintf(stderr, "\tLeaving  BeagleGPUImpl::upPartials\n");
+#endif
+        return BEAGLE_SUCCESS;
+    }
+
     int gridLaunches = 0;
     int* gridStartOp;
     int* gridOpType;
     int* gridOpBlocks;
+    unsigned int* gridTailPtrs;
+    int gridTailCount = 0;
     int parentMinIndex = 0;
     int lastStreamIndex = 0;
     int gridOpIndex = 0;
@@ -1953,6 +2458,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
         gridStartOp  = (int*) malloc(sizeof(int) * (operationCount + 1));
         gridOpType   = (int*) malloc(sizeof(int) * (operationCount + 1));
         gridOpBlocks = (int*) malloc(sizeof(int) * (operationCount + 1));
+        gridTailPtrs = (unsigned int*) malloc(sizeof(unsigned int) * 8 * (operationCount + 1));
     }
 
     int anyRescale = BEAGLE_OP_NONE;
@@ -1971,8 +2477,21 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
 
     int streamIndex = -1;
     int waitIndex = -1;
+    bool matricesPending = false;
+#ifdef CUDA
+    matricesPending = kMatricesPending && (!kUsingMultiGrid || anyRescale == 1);
+    if (matricesPending) {
+        // earlier work was fenced when the pending matrices were launched,
+        // so streams only catch up with what followed on the first one
+        int streamCount = gpu->GetStreamCount();
+        for (int i = 1; i < streamCount && i <= operationCount; i++) {
+            gpu->SynchronizeDeviceWithIndex(0, i);
+        }
+    }
+#endif
     if (!kUsingMultiGrid || anyRescale == 1) {
-        gpu->SynchronizeDevice();
+        if (!matricesPending)
+            gpu->SynchronizeDevice();
         for (int i = 0; i < kBufferCount * kPartitionCount; i++) {
             hStreamIndices[i] = -1;
         }
@@ -2008,6 +2527,15 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
                 hStreamIndices[parIndex + pOffset] = lastStreamIndex++;
             }
             streamIndex = hStreamIndices[parIndex + pOffset];
+
+#ifdef CUDA
+            if (matricesPending) {
+                if (hMatrixStreams[child1TransMatIndex] != 0)
+                    gpu->WaitForStreamDependency(streamIndex, hMatrixStreams[child1TransMatIndex]);
+                if (hMatrixStreams[child2TransMatIndex] != 0)
+                    gpu->WaitForStreamDependency(streamIndex, hMatrixStreams[child2TransMatIndex]);
+            }
+#endif
         }
         
         GPUPtr matrices1 = dMatrices[child1TransMatIndex];
@@ -2106,6 +2634,9 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
             }
 
             if (newLaunch) {
+                appendGridTail(gridTailPtrs, gridTailCount, gridOpIndex);
+                gridTailCount = 0;
+
                 gridStartOp[gridLaunches] = op;
                 gridOpBlocks[gridLaunches] = opBlockCount;
                 gridOpType[gridLaunches] = opType;
@@ -2157,14 +2688,22 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
 
 
             for (int i=startBlock; i < endBlock; i++) {
-                hPartialsPtrs[gridOpIndex++] = hPartitionOffsets[i*2];
-                hPartialsPtrs[gridOpIndex++] = hPartitionOffsets[i*2+1];
-                hPartialsPtrs[gridOpIndex++] = c1Off;
-                hPartialsPtrs[gridOpIndex++] = c2Off;
-                hPartialsPtrs[gridOpIndex++] = paOff;
-                hPartialsPtrs[gridOpIndex++] = c1MOff;
-                hPartialsPtrs[gridOpIndex++] = c2MOff;
-                hPartialsPtrs[gridOpIndex++] = scaleOff;
+                // under-full blocks are held back to the end of the launch
+                unsigned int* blockPtrs = hPartialsPtrs + gridOpIndex;
+                if (hPartitionOffsets[i*2+1] - hPartitionOffsets[i*2] < (unsigned int) kSitesPerBlock) {
+                    blockPtrs = gridTailPtrs + gridTailCount * 8;
+                    gridTailCount++;
+                } else {
+                    gridOpIndex += 8;
+                }
+                blockPtrs[0] = hPartitionOffsets[i*2];
+                blockPtrs[1] = hPartitionOffsets[i*2+1];
+                blockPtrs[2] = c1Off;
+                blockPtrs[3] = c2Off;
+                blockPtrs[4] = paOff;
+                blockPtrs[5] = c1MOff;
+                blockPtrs[6] = c2MOff;
+                blockPtrs[7] = scaleOff;
 
 // printf("block %d, hPP = %d %d %d %d %d %d %d %d\n", i,
 //        hPartialsPtrs[gridOpIndex-8],
@@ -2212,12 +2751,19 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
                                                                  rescale,
                                                                  streamIndex, waitIndex);
                 } else {
-                    if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
+                    if ((kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) && writeScalingIndex >= 0 &&
+                        cumulativeScalingIndex != BEAGLE_OP_NONE) {
+                        // read before the write buffer stops sharing another's factors
+                        GPUPtr readScalingFactors = (readScalingIndex >= 0 ? dScalingFactors[readScalingIndex] : (GPUPtr)NULL);
+                        prepareDynamicScalingBuffer(writeScalingIndex, false);
+                        prepareDynamicScalingBuffer(cumulativeScalingIndex, true);
                         kernels->PartialsPartialsPruningDynamicCheckScaling(partials1, partials2, partials3,
-                                                                       matrices1, matrices2, writeScalingIndex, readScalingIndex,
-                                                                       cumulativeScalingIndex, dScalingFactors, dScalingFactorsMaster,
-                                                                       kPaddedPatternCount, kCategoryCount,
-                                                                       rescale, hRescalingTrigger, dRescalingTrigger, sizeof(Real));
+                                                                            matrices1, matrices2,
+                                                                            dScalingFactors[writeScalingIndex],
+                                                                            readScalingFactors,
+                                                                            dScalingFactors[cumulativeScalingIndex],
+                                                                            dRescalingTrigger,
+                                                                            kPaddedPatternCount, kCategoryCount);
                     } else {
                         kernels->PartialsPartialsPruningDynamicScaling(partials1, partials2, partials3,
                                                                        matrices1, matrices2, scalingFactors,
@@ -2265,11 +2811,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
 
     if (kUsingMultiGrid && (anyRescale != 1)) {
 // printf("USING MULTIGRID!\n");
+        appendGridTail(gridTailPtrs, gridTailCount, gridOpIndex);
+
         size_t transferSize = sizeof(unsigned int) * gridOpIndex;
         #ifdef FW_OPENCL
         gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
         #else
-        gpu->MemcpyHostToDevice(dPartialsPtrs, hPartialsPtrs, transferSize);
+        uploadPartialsPtrs(transferSize);
         #endif
 // int statesStatesCount = 0;
         gridStartOp[gridLaunches] = operationCount;
@@ -2386,10 +2934,22 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
         gpu->SynchronizeDevice();
     }
 
+#ifdef CUDA
+    if (kMatricesPending) {
+        kMatricesPending = false;
+        memset(hMatrixStreams, 0, sizeof(int) * kMatrixCount);
+    }
+
+    if (graphCapture) {
+        gpu->EndGraphCapture();
+    }
+#endif
+
     if (kUsingMultiGrid) {
         free(gridStartOp);
         free(gridOpType);
         free(gridOpBlocks);
+        free(gridTailPtrs);
     }
 
 #ifdef BEAGLE_DEBUG_SYNCH    
@@ -2403,6 +2963,74 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartials(bool byPartition,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+bool BeagleGPUImpl<BEAGLE_GPU_GENERIC>::upPartialsTraversal(const int* operations,
+                                                           int operationCount) {
+    // Only unscaled lists qualify, since rescaling needs every parent
+    // complete across all rate categories before the next one is started.
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))
+        return false;
+
+    const int ptrsPerOp = 6;
+    if (operationCount * ptrsPerOp * sizeof(unsigned int) > kOpOffsetsSize)
+        return false;
+
+    for (int op = 0; op < operationCount; op++) {
+        const int* operation = operations + op * BEAGLE_OP_COUNT;
+        if ((kFlags & BEAGLE_FLAG_SCALING_MANUAL) && (operation[1] >= 0 || operation[2] >= 0))
+            return false;
+    }
+
+    for (int op = 0; op < operationCount; op++) {
+        const int parIndex = operations[op * BEAGLE_OP_COUNT];
+        const int child1Index = operations[op * BEAGLE_OP_COUNT + 3];
+        const int child1TransMatIndex = operations[op * BEAGLE_OP_COUNT + 4];
+        const int child2Index = operations[op * BEAGLE_OP_COUNT + 5];
+        const int child2TransMatIndex = operations[op * BEAGLE_OP_COUNT + 6];
+
+        unsigned int* opPtrs = hPartialsPtrs + op * ptrsPerOp;
+        unsigned int c1MOff = child1TransMatIndex * kIndexOffsetMat;
+        unsigned int c2MOff = child2TransMatIndex * kIndexOffsetMat;
+
+        if (dStates[child1Index] != 0 && dStates[child2Index] != 0) {
+            opPtrs[0] = 3;
+            opPtrs[1] = hStatesOffsets[child1Index];
+            opPtrs[2] = hStatesOffsets[child2Index];
+        } else if (dStates[child1Index] != 0) {
+            opPtrs[0] = 2;
+            opPtrs[1] = hStatesOffsets[child1Index];
+            opPtrs[2] = hPartialsOffsets[child2Index];
+        } else if (dStates[child2Index] != 0) {
+            opPtrs[0] = 2;
+            opPtrs[1] = hStatesOffsets[child2Index];
+            opPtrs[2] = hPartialsOffsets[child1Index];
+            unsigned int tmpOff = c1MOff; c1MOff = c2MOff; c2MOff = tmpOff;
+        } else {
+            opPtrs[0] = 1;
+            opPtrs[1] = hPartialsOffsets[child1Index];
+            opPtrs[2] = hPartialsOffsets[child2Index];
+        }
+        opPtrs[3] = hPartialsOffsets[parIndex];
+        opPtrs[4] = c1MOff;
+        opPtrs[5] = c2MOff;
+    }
+
+    #ifdef FW_OPENCL
+    gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
+    #else
+    uploadPartialsPtrs(sizeof(unsigned int) * operationCount * ptrsPerOp);
+    #endif
+
+    kernels->PartialsTraversal(dPartialsOrigin, dStatesOrigin, dMatrices[0], dPartialsPtrs,
+                               operationCount, kPaddedPatternCount);
+
+    #ifdef FW_OPENCL
+    hPartialsPtrs = (unsigned int*)gpu->MapMemory(dPartialsPtrs, kOpOffsetsSize);
+    #endif
+
+    return true;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::waitForPartials(const int* /*destinationPartials*/,
                                    int /*destinationPartialsCount*/) {
@@ -2417,6 +3045,71 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::waitForPartials(const int* /*destinationP
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::uploadPartialsPtrs(size_t transferSize) {
+#ifndef FW_OPENCL
+    // the device table persists between calls, so a repeated traversal only
+    // sends the span of entries that changed since the last upload
+    int count = transferSize / sizeof(unsigned int);
+    int uploaded = (count < kPartialsPtrsUploaded ? count : kPartialsPtrsUploaded);
+
+    int first = 0;
+    while (first < uploaded && hPartialsPtrs[first] == hPartialsPtrsDevice[first])
+        first++;
+    int last = count;
+    if (last == uploaded) {
+        while (last > first && hPartialsPtrs[last-1] == hPartialsPtrsDevice[last-1])
+            last--;
+    }
+
+    if (last > first) {
+        size_t offset = sizeof(unsigned int) * first;
+        size_t length = sizeof(unsigned int) * (last - first);
+        gpu->MemcpyHostToDevice(dPartialsPtrs + offset, hPartialsPtrs + first, length);
+        memcpy(hPartialsPtrsDevice + first, hPartialsPtrs + first, length);
+    }
+    if (count > kPartialsPtrsUploaded)
+        kPartialsPtrsUploaded = count;
+#endif
+}
+
+BEAGLE_GPU_TEMPLATE
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::appendGridTail(unsigned int* tailPtrs,
+                                                       int tailCount,
+                                                       int& gridOpIndex) {
+    // blocks are scheduled in launch order, so the partial blocks of small
+    // partitions go last and largest first, filling in behind the full ones
+    for (int i = 0; i < tailCount; i++) {
+        int largest = i;
+        for (int j = i + 1; j < tailCount; j++) {
+            if (tailPtrs[j*8+1] - tailPtrs[j*8] > tailPtrs[largest*8+1] - tailPtrs[largest*8])
+                largest = j;
+        }
+        memcpy(hPartialsPtrs + gridOpIndex, tailPtrs + largest * 8, sizeof(unsigned int) * 8);
+        if (largest != i)
+            memcpy(tailPtrs + largest * 8, tailPtrs + i * 8, sizeof(unsigned int) * 8);
+        gridOpIndex += 8;
+    }
+}
+
+BEAGLE_GPU_TEMPLATE
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::prepareDynamicScalingBuffer(int scalingIndex,
+                                                                    bool keepValues) {
+    if (dScalingFactorsMaster[scalingIndex] == 0) {
+        dScalingFactorsMaster[scalingIndex] = gpu->AllocateMemory(kScaleBufferSize * sizeof(Real));
+        gpu->MemsetShort(dScalingFactorsMaster[scalingIndex], 0,
+                         kScaleBufferSize * sizeof(Real) / sizeof(unsigned short));
+    }
+
+    // a buffer still sharing another's factors gets its own storage back
+    if (dScalingFactors[scalingIndex] != dScalingFactorsMaster[scalingIndex]) {
+        if (keepValues && dScalingFactors[scalingIndex] != 0)
+            gpu->MemcpyDeviceToDevice(dScalingFactorsMaster[scalingIndex], dScalingFactors[scalingIndex],
+                                      sizeof(Real) * kScaleBufferSize);
+        dScalingFactors[scalingIndex] = dScalingFactorsMaster[scalingIndex];
+    }
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::accumulateScaleFactors(const int* scalingIndices,
                                           int count,
@@ -2607,13 +3300,9 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::resetScaleFactors(int cumulativeScalingIn
         }
     }
     
-    Real* zeroes = (Real*) gpu->CallocHost(sizeof(Real), kPaddedPatternCount);
-    
-    // Fill with zeroes
-    gpu->MemcpyHostToDevice(dScalingFactors[cumulativeScalingIndex], zeroes,
-                            sizeof(Real) * kPaddedPatternCount);
-    
-    gpu->FreeHostMemory(zeroes);
+    // cleared on the device, in order with the pruning still queued ahead of it
+    gpu->MemsetShort(dScalingFactors[cumulativeScalingIndex], 0,
+                     sizeof(Real) * kPaddedPatternCount / sizeof(unsigned short));
     
 #ifdef BEAGLE_DEBUG_SYNCH    
     gpu->SynchronizeHost();
@@ -2738,19 +3427,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getScaleFactors(int srcScalingIndex,
 }   
 
 BEAGLE_GPU_TEMPLATE
-int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
-                                               const int* categoryWeightsIndices,
-                                               const int* stateFrequenciesIndices,
-                                               const int* cumulativeScaleIndices,
-                                               int count,
-                                               double* outSumLogLikelihood) {
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::integrateRootLogLikelihoods(const int* bufferIndices,
+                                                                   const int* categoryWeightsIndices,
+                                                                   const int* stateFrequenciesIndices,
+                                                                   const int* cumulativeScaleIndices,
+                                                                   int count,
+                                                                   GPUPtr dResult) {
     
-#ifdef BEAGLE_DEBUG_FLOW
-    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateRootLogLikelihoods\n");
-#endif
-    
-    int returnCode = BEAGLE_SUCCESS;
-        
     if (count == 1) {         
         const int rootNodeIndex = bufferIndices[0];
         const int categoryWeightsIndex = categoryWeightsIndices[0];
@@ -2781,6 +3464,14 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
                                                         dCumulativeScalingFactor,
                                                         kPaddedPatternCount,
                                                         kCategoryCount);
+        } else if (kUsingTraversalKernel) {
+            kernels->IntegrateLikelihoodsSumSites(dIntegrationTmp, dResult,
+                                                  dPartials[rootNodeIndex],
+                                                  dWeights[categoryWeightsIndex],
+                                                  dFrequencies[stateFrequenciesIndex],
+                                                  dPatternWeights,
+                                                  kPaddedPatternCount, kCategoryCount,
+                                                  kPatternCount);
         } else {
             kernels->IntegrateLikelihoods(dIntegrationTmp, dPartials[rootNodeIndex],
                                           dWeights[categoryWeightsIndex],
@@ -2793,18 +3484,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
         gpu->PrintfDeviceVector(dIntegrationTmp, kPaddedPatternCount, r);
 #endif
 
-        kernels->SumSites1(dIntegrationTmp, dSumLogLikelihood, dPatternWeights,
-                                    kPatternCount);
-
-        gpu->MemcpyDeviceToHost(hLogLikelihoodsCache, dSumLogLikelihood, sizeof(Real) * kSumSitesBlockCount);
-
-        *outSumLogLikelihood = 0.0;
-        for (int i = 0; i < kSumSitesBlockCount; i++) {
-            if (hLogLikelihoodsCache[i] != hLogLikelihoodsCache[i])
-                returnCode = BEAGLE_ERROR_FLOATING_POINT;
-            
-            *outSumLogLikelihood += hLogLikelihoodsCache[i];
-        }    
+        if (scale || !kUsingTraversalKernel) {
+            kernels->SumSites1(dIntegrationTmp, dResult, dPatternWeights,
+                                        kPatternCount);
+        }
         
     } else {
         // TODO: evaluate performance, maybe break up kernels below for each subsetIndex case
@@ -2848,21 +3531,11 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
                                                        kPaddedPatternCount, kCategoryCount, 2);
                 }
             }
-            
-
-            kernels->SumSites1(dIntegrationTmp, dSumLogLikelihood, dPatternWeights,
-                                        kPatternCount);
-                        
-            gpu->MemcpyDeviceToHost(hLogLikelihoodsCache, dSumLogLikelihood, sizeof(Real) * kSumSitesBlockCount);
-            
-            *outSumLogLikelihood = 0.0;
-            for (int i = 0; i < kSumSitesBlockCount; i++) {
-                if (hLogLikelihoodsCache[i] != hLogLikelihoodsCache[i])
-                    returnCode = BEAGLE_ERROR_FLOATING_POINT;
-                
-                *outSumLogLikelihood += hLogLikelihoodsCache[i];
-            }    
         }
+
+        // only the site log likelihoods of the last subset are complete
+        kernels->SumSites1(dIntegrationTmp, dResult, dPatternWeights,
+                                    kPatternCount);
     }
     
 #ifdef BEAGLE_DEBUG_VALUES
@@ -2870,7 +3543,34 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
     fprintf(stderr, "parent = \n");
     gpu->PrintfDeviceVector(dIntegrationTmp, kPatternCount, r);
 #endif
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
+                                               const int* categoryWeightsIndices,
+                                               const int* stateFrequenciesIndices,
+                                               const int* cumulativeScaleIndices,
+                                               int count,
+                                               double* outSumLogLikelihood) {
     
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateRootLogLikelihoods\n");
+#endif
+    
+    int returnCode = BEAGLE_SUCCESS;
+
+    integrateRootLogLikelihoods(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
+                                cumulativeScaleIndices, count, dSumLogLikelihood);
+
+    gpu->MemcpyDeviceToHost(hLogLikelihoodsCache, dSumLogLikelihood, sizeof(Real) * kSumSitesBlockCount);
+
+    *outSumLogLikelihood = 0.0;
+    for (int i = 0; i < kSumSitesBlockCount; i++) {
+        if (hLogLikelihoodsCache[i] != hLogLikelihoodsCache[i])
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
+        
+        *outSumLogLikelihood += hLogLikelihoodsCache[i];
+    }    
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateRootLogLikelihoods\n");
@@ -2879,6 +3579,91 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
     return returnCode;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsAsync(const int* bufferIndices,
+                                                                       const int* categoryWeightsIndices,
+                                                                       const int* stateFrequenciesIndices,
+                                                                       const int* cumulativeScaleIndices,
+                                                                       int count,
+                                                                       int resultIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateRootLogLikelihoodsAsync\n");
+#endif
+
+    if (resultIndex < 0 || resultIndex >= BEAGLE_RESULT_SLOT_COUNT)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // slots are spaced so that OpenCL can cut each into its own sub-buffer
+    if (dLogLikelihoodResultsOrigin == (GPUPtr)NULL) {
+        kLogLikelihoodResultSize = gpu->AlignMemOffset(kSumSitesBlockCount * sizeof(Real));
+        dLogLikelihoodResultsOrigin = gpu->AllocateMemory(kLogLikelihoodResultSize * BEAGLE_RESULT_SLOT_COUNT);
+        dLogLikelihoodResults = (GPUPtr*) malloc(sizeof(GPUPtr) * BEAGLE_RESULT_SLOT_COUNT);
+        for (int i = 0; i < BEAGLE_RESULT_SLOT_COUNT; i++) {
+            dLogLikelihoodResults[i] = gpu->CreateSubPointer(dLogLikelihoodResultsOrigin,
+                                                             kLogLikelihoodResultSize * i,
+                                                             kLogLikelihoodResultSize);
+        }
+        hLogLikelihoodResultsCache = (Real*) gpu->AllocateTransferMemory(kLogLikelihoodResultSize *
+                                                                        BEAGLE_RESULT_SLOT_COUNT);
+        hLogLikelihoodResultsWritten.assign(BEAGLE_RESULT_SLOT_COUNT, false);
+    }
+
+    integrateRootLogLikelihoods(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
+                                cumulativeScaleIndices, count, dLogLikelihoodResults[resultIndex]);
+    hLogLikelihoodResultsWritten[resultIndex] = true;
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateRootLogLikelihoodsAsync\n");
+#endif
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getLogLikelihoodResults(const int* resultIndices,
+                                                              int count,
+                                                              double* outSumLogLikelihoods) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::getLogLikelihoodResults\n");
+#endif
+
+    if (dLogLikelihoodResultsOrigin == (GPUPtr)NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    int lastIndex = 0;
+    for (int n = 0; n < count; n++) {
+        if (resultIndices[n] < 0 || resultIndices[n] >= BEAGLE_RESULT_SLOT_COUNT ||
+            !hLogLikelihoodResultsWritten[resultIndices[n]])
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (resultIndices[n] > lastIndex)
+            lastIndex = resultIndices[n];
+    }
+
+    // one transfer, and one wait on pending integrations, for the whole batch
+    gpu->MemcpyDeviceToHost(hLogLikelihoodResultsCache, dLogLikelihoodResultsOrigin,
+                            kLogLikelihoodResultSize * (lastIndex + 1));
+
+    int returnCode = BEAGLE_SUCCESS;
+
+    for (int n = 0; n < count; n++) {
+        const Real* blockSums = (const Real*) ((const char*) hLogLikelihoodResultsCache +
+                                               kLogLikelihoodResultSize * resultIndices[n]);
+        outSumLogLikelihoods[n] = 0.0;
+        for (int i = 0; i < kSumSitesBlockCount; i++) {
+            if (blockSums[i] != blockSums[i])
+                returnCode = BEAGLE_ERROR_FLOATING_POINT;
+
+            outSumLogLikelihoods[n] += blockSums[i];
+        }
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::getLogLikelihoodResults\n");
+#endif
+
+    return returnCode;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
                                                                 const int* bufferIndices,
@@ -2964,7 +3749,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsByPartition(
     #ifdef FW_OPENCL
     gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
     #else
-    gpu->MemcpyHostToDevice(dPartialsPtrs, hPartialsPtrs, transferSize);
+    uploadPartialsPtrs(transferSize);
     #endif
 
     if (scale == 1) {
@@ -3426,7 +4211,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeLogLikelihoodsByPartition(
     #ifdef FW_OPENCL
     gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
     #else
-    gpu->MemcpyHostToDevice(dPartialsPtrs, hPartialsPtrs, transferSize);
+    uploadPartialsPtrs(transferSize);
     #endif
 
     if (statesChild != 0) {
@@ -3497,7 +4282,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeLogLikelihoodsByPartition(
     #ifdef FW_OPENCL
     gpu->UnmapMemory(dPartialsPtrs, hPartialsPtrs);
     #else
-    gpu->MemcpyHostToDevice(dPartialsPtrs, hPartialsPtrs, transferSize);
+    uploadPartialsPtrs(transferSize);
     #endif
 
     if (scale == 1) {
@@ -3571,21 +4356,30 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getSiteLogLikelihoods(double* outLogLikel
     fprintf(stderr, "\tEntering BeagleGPUImpl::getSiteLogLikelihoods\n");
 #endif
 
+    // zero-copy site likelihoods are read in place
+    const Real* hSiteLogLikelihoods = hLogLikelihoodsCache;
+    if (kZeroCopy) {
+        hSiteLogLikelihoods = (const Real*) gpu->MapMemoryForRead(dIntegrationTmp, sizeof(Real) * kPatternCount);
+    } else {
 // TODO: copy directly to outLogLikelihoods when GPU is running in double precision
-    gpu->MemcpyDeviceToHost(hLogLikelihoodsCache, dIntegrationTmp, sizeof(Real) * kPatternCount);
+        gpu->MemcpyDeviceToHost(hLogLikelihoodsCache, dIntegrationTmp, sizeof(Real) * kPatternCount);
+    }
 
     if (kPatternsReordered) {
         Real* outLogLikelihoodsOriginalOrder = (Real*) malloc(sizeof(Real) * kPatternCount);
 
         for (int i=0; i < kPatternCount; i++) {
-            outLogLikelihoodsOriginalOrder[i] = hLogLikelihoodsCache[hPatternsNewOrder[i]];
+            outLogLikelihoodsOriginalOrder[i] = hSiteLogLikelihoods[hPatternsNewOrder[i]];
         }
         beagleMemCpy(outLogLikelihoods, outLogLikelihoodsOriginalOrder, kPatternCount);
         free(outLogLikelihoodsOriginalOrder);
     } else {
-        beagleMemCpy(outLogLikelihoods, hLogLikelihoodsCache, kPatternCount);
+        beagleMemCpy(outLogLikelihoods, hSiteLogLikelihoods, kPatternCount);
     }
 
+    if (kZeroCopy)
+        gpu->UnmapMemory(dIntegrationTmp, (void*) hSiteLogLikelihoods);
+
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::getSiteLogLikelihoods\n");
 #endif
@@ -3632,8 +4426,8 @@ BeagleImpl*  BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::createImpl(int tipCount,
                                               int scaleBufferCount,
                                               int resourceNumber,
                                               int pluginResourceNumber,
-                                              long preferenceFlags,
-                                              long requirementFlags,
+                                              long long preferenceFlags,
+                                              long long requirementFlags,
                                               int* errorCode) {
     BeagleImpl* impl = new BeagleGPUImpl<BEAGLE_GPU_GENERIC>();
     try {
@@ -3658,6 +4452,29 @@ BeagleImpl*  BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::createImpl(int tipCount,
     return NULL;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::getMemoryFootprint(int tipCount,
+                                                                 int partialsBufferCount,
+                                                                 int compactBufferCount,
+                                                                 int stateCount,
+                                                                 int patternCount,
+                                                                 int eigenBufferCount,
+                                                                 int matrixBufferCount,
+                                                                 int categoryCount,
+                                                                 int scaleBufferCount,
+                                                                 int resourceNumber,
+                                                                 int pluginResourceNumber,
+                                                                 long long preferenceFlags,
+                                                                 long long requirementFlags,
+                                                                 size_t* outBytes) {
+    *outBytes = BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getMemoryFootprint(
+            tipCount, partialsBufferCount, compactBufferCount, stateCount, patternCount,
+            eigenBufferCount, matrixBufferCount, categoryCount, scaleBufferCount,
+            preferenceFlags, requirementFlags);
+
+    return BEAGLE_SUCCESS;
+}
+
 #ifdef CUDA
 template<>
 const char* BeagleGPUImplFactory<double>::getName() {
@@ -3681,18 +4498,18 @@ const char* BeagleGPUImplFactory<float>::getName() {
 #endif
 
 template<>
-void modifyFlagsForPrecision(long *flags, double r) {
+void modifyFlagsForPrecision(long long *flags, double r) {
     *flags |= BEAGLE_FLAG_PRECISION_DOUBLE;
 }
 
 template<>
-void modifyFlagsForPrecision(long *flags, float r) {
+void modifyFlagsForPrecision(long long *flags, float r) {
     *flags |= BEAGLE_FLAG_PRECISION_SINGLE;
 }
 
 BEAGLE_GPU_TEMPLATE
-const long BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::getFlags() {
-    long flags = BEAGLE_FLAG_COMPUTATION_SYNCH |
+const long long BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::getFlags() {
+    long long flags = BEAGLE_FLAG_COMPUTATION_SYNCH |
           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
           BEAGLE_FLAG_THREADING_NONE |
           BEAGLE_FLAG_VECTOR_NONE |
@@ -3709,6 +4526,10 @@ const long BeagleGPUImplFactory<BEAGLE_GPU_GENERIC>::getFlags() {
              BEAGLE_FLAG_PROCESSOR_CPU | BEAGLE_FLAG_PROCESSOR_GPU | BEAGLE_FLAG_PROCESSOR_OTHER;
 #endif
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+    flags |= BEAGLE_FLAG_KERNEL_TUNING;
+#endif
+
     Real r = 0;
     modifyFlagsForPrecision(&flags, r);
     return flags;
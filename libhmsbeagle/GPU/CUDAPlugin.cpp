@@ -47,6 +47,9 @@ Plugin("GPU-CUDA", "GPU-CUDA")
                 	resource.supportFlags |= BEAGLE_FLAG_PRECISION_DOUBLE;
                 	anyGPUSupportsDP = true;
                 }
+#ifdef BEAGLE_RUNTIME_KERNELS
+                resource.supportFlags |= BEAGLE_FLAG_KERNEL_TUNING;
+#endif
                 
                 resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_CUDA;
                 
@@ -25,7 +25,7 @@
 #ifndef __GPUImplDefs__
 #define __GPUImplDefs__
 
-#ifndef OPENCL_KERNEL_BUILD
+#if !defined(OPENCL_KERNEL_BUILD) && !defined(RUNTIME_KERNEL_BUILD)
     #ifdef HAVE_CONFIG_H
     #include "libhmsbeagle/config.h"
     #endif
@@ -34,7 +34,7 @@
     #include <cfloat>
 #elif !defined(M_LN2)
     #define M_LN2   0.693147180559945309417232121458176568  /* log_e 2 */
-#endif // OPENCL_KERNEL_BUILD
+#endif // OPENCL_KERNEL_BUILD, RUNTIME_KERNEL_BUILD
 
 //#define FW_OPENCL_BINARY
 //#define FW_OPENCL_TESTING
@@ -61,9 +61,17 @@ enum BeagleDeviceImplementationCodes {
     BEAGLE_OPENCL_DEVICE_APPLE_AMD_GPU   = 7,
     BEAGLE_OPENCL_DEVICE_APPLE_INTEL_GPU = 8,
     BEAGLE_CUDA_DEVICE_NVIDIA_GPU        = 9,
+    BEAGLE_OPENCL_DEVICE_GENERIC_CPU     = 10,
 };
 
 #define BEAGLE_CACHED_MATRICES_COUNT 3 // max number of matrices that can be cached for a single memcpy to device operation
+#define BEAGLE_TRANSFER_BUFFER_COUNT 2 // number of staging buffers alternated between asynchronous host-to-device copies
+#define BEAGLE_TIP_STAGING_SIZE (1 << 24) // bytes of packed tips uploaded from one staging buffer in a batch
+#define BEAGLE_MEMORY_POOL_ALIGNMENT 256 // byte alignment of sub-buffers handed out from the device memory pool
+#define BEAGLE_TRAVERSAL_KERNEL_MAX 1024 // walk the operation list in a single launch for fewer than this many sites
+#define BEAGLE_TUNING_PATTERN_COUNT 8192 // sites in the pruning benchmark that tunes runtime kernel block sizes
+#define BEAGLE_TUNING_CATEGORY_COUNT 4 // rate categories in the tuning benchmark
+#define BEAGLE_TUNING_REPEAT_COUNT 10 // timed launches per tuning candidate
 
 /* Definition of REAL can be switched between 'double' and 'float' */
 #ifdef DOUBLE_PRECISION
@@ -160,8 +168,13 @@ enum BeagleDeviceImplementationCodes {
  *    
  * SLOW_REWEIGHING    - 1 if requires the slow reweighing algorithm, otherwise 0                    
  *    
+ * Kernels built at runtime (RUNTIME_KERNEL_BUILD) take any STATE_COUNT and
+ * define the values above, and MULTIPLY_BLOCK_SIZE, ahead of this file in
+ * place of the table below.
  */
 
+#ifndef RUNTIME_KERNEL_BUILD
+
 /* Table of pre-optimized compiler definitions
  */
 
@@ -334,8 +347,10 @@ enum BeagleDeviceImplementationCodes {
 #define SMALLEST_POWER_OF_TWO_DP_192     256
 #define SLOW_REWEIGHING_DP_192           1
 
+#endif // RUNTIME_KERNEL_BUILD
+
 #ifdef STATE_COUNT
-#if (STATE_COUNT == 4 || STATE_COUNT == 16 || STATE_COUNT == 32 || STATE_COUNT == 48 || STATE_COUNT == 64 || STATE_COUNT == 80 || STATE_COUNT == 128 || STATE_COUNT == 192)
+#if (STATE_COUNT == 4 || STATE_COUNT == 16 || STATE_COUNT == 32 || STATE_COUNT == 48 || STATE_COUNT == 64 || STATE_COUNT == 80 || STATE_COUNT == 128 || STATE_COUNT == 192) || defined(RUNTIME_KERNEL_BUILD)
 	#define PADDED_STATE_COUNT	STATE_COUNT
 #else
 	#error *** Precompiler directive state count not defined ***
@@ -356,7 +371,9 @@ enum BeagleDeviceImplementationCodes {
 	#define	PREC	SP
 #endif
 
-#if defined(FW_OPENCL_APPLECPU) && (STATE_COUNT == 4)
+#if defined(RUNTIME_KERNEL_BUILD)
+    // block sizes and state count properties come with the kernel source
+#elif defined(FW_OPENCL_APPLECPU) && (STATE_COUNT == 4)
     #define PATTERN_BLOCK_SIZE     GET4_VALUE(PATTERN_BLOCK_SIZE, PREC, PADDED_STATE_COUNT, APPLECPU)
 #elif defined(FW_OPENCL_CPU) && (STATE_COUNT == 4)
     #define PATTERN_BLOCK_SIZE     GET4_VALUE(PATTERN_BLOCK_SIZE, PREC, PADDED_STATE_COUNT, CPU)
@@ -366,7 +383,8 @@ enum BeagleDeviceImplementationCodes {
     #define PATTERN_BLOCK_SIZE     GET3_VALUE(PATTERN_BLOCK_SIZE, PREC, PADDED_STATE_COUNT)
 #endif
 
-#if (defined(FW_OPENCL_AMDGPU) || defined(FW_OPENCL_INTELGPU)) && (STATE_COUNT > 32)
+#if defined(RUNTIME_KERNEL_BUILD)
+#elif (defined(FW_OPENCL_AMDGPU) || defined(FW_OPENCL_INTELGPU)) && (STATE_COUNT > 32)
     #define MATRIX_BLOCK_SIZE       GET4_VALUE(MATRIX_BLOCK_SIZE, PREC, PADDED_STATE_COUNT, AMDGPU)
     #define BLOCK_PEELING_SIZE      GET4_VALUE(BLOCK_PEELING_SIZE, PREC, PADDED_STATE_COUNT, AMDGPU)
 #else
@@ -374,6 +392,7 @@ enum BeagleDeviceImplementationCodes {
     #define BLOCK_PEELING_SIZE      GET3_VALUE(BLOCK_PEELING_SIZE, PREC, PADDED_STATE_COUNT)
 #endif
 
+#ifndef RUNTIME_KERNEL_BUILD
 #define CHECK_IS_POWER_OF_TWO	GET3_VALUE(IS_POWER_OF_TWO, PREC, PADDED_STATE_COUNT)
 #if (CHECK_IS_POWER_OF_TWO == 1)
 	#define IS_POWER_OF_TWO
@@ -383,6 +402,7 @@ enum BeagleDeviceImplementationCodes {
 #if (CHECK_SLOW_REWEIGHING == 1)
 	#define SLOW_REWEIGHING
 #endif
+#endif
 
 // State count independent
 #define SUM_SITES_BLOCK_SIZE_DP	128
@@ -394,9 +414,12 @@ enum BeagleDeviceImplementationCodes {
 #define REORDER_BLOCK_SIZE           32
 #define REORDER_BLOCK_SIZE_CPU      256
 #define REORDER_BLOCK_SIZE_APPLECPU 128
+#define PRUNING_MMA_PATTERN_BLOCK_SIZE 16 // patterns per tensor core pruning block, the mma tile height
+#define PRUNING_MMA_WARP_COUNT          4 // warps per tensor core pruning block
 
 #define SUM_SITES_BLOCK_SIZE    GET2_VALUE(SUM_SITES_BLOCK_SIZE, PREC)
-#if defined(FW_OPENCL_APPLECPU)
+#if defined(RUNTIME_KERNEL_BUILD)
+#elif defined(FW_OPENCL_APPLECPU)
     #define MULTIPLY_BLOCK_SIZE     GET3_VALUE(MULTIPLY_BLOCK_SIZE, PREC, APPLECPU)
 #else
     #define MULTIPLY_BLOCK_SIZE     GET2_VALUE(MULTIPLY_BLOCK_SIZE, PREC)
@@ -30,7 +30,17 @@
 #include <iostream>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
+#ifdef _WIN32
+#include <process.h>
+#include <direct.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
+#include "libhmsbeagle/GPU/GPUImplHelper.h"
 
 void checkHostMemory(void* ptr) {
     if (ptr == NULL) {
@@ -39,6 +49,73 @@ void checkHostMemory(void* ptr) {
     }
 }
 
+DeviceMemoryPool::DeviceMemoryPool() {
+    kPoolSize = 0;
+    kAlignment = 1;
+}
+
+void DeviceMemoryPool::reset(size_t poolSize,
+                             size_t alignment) {
+    kPoolSize = poolSize;
+    kAlignment = (alignment > 0 ? alignment : 1);
+    freeRanges.clear();
+    usedRanges.clear();
+    if (poolSize > 0)
+        freeRanges[0] = poolSize;
+}
+
+size_t DeviceMemoryPool::size() const {
+    return kPoolSize;
+}
+
+bool DeviceMemoryPool::take(size_t memSize,
+                            size_t* outOffset) {
+    size_t length = ((memSize + kAlignment - 1) / kAlignment) * kAlignment;
+    if (length == 0)
+        length = kAlignment;
+
+    for (std::map<size_t, size_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        if (it->second >= length) {
+            size_t offset = it->first;
+            size_t remaining = it->second - length;
+            freeRanges.erase(it);
+            if (remaining > 0)
+                freeRanges[offset + length] = remaining;
+            usedRanges[offset] = length;
+            *outOffset = offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool DeviceMemoryPool::give(size_t offset) {
+    std::map<size_t, size_t>::iterator used = usedRanges.find(offset);
+    if (used == usedRanges.end())
+        return false;
+
+    size_t length = used->second;
+    usedRanges.erase(used);
+
+    std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + length == next->first) {
+        length += next->second;
+        freeRanges.erase(next++);
+    }
+    if (next != freeRanges.begin()) {
+        std::map<size_t, size_t>::iterator prev = next;
+        --prev;
+        if (prev->first + prev->second == offset) {
+            prev->second += length;
+            return true;
+        }
+    }
+    freeRanges[offset] = length;
+
+    return true;
+}
+
 void printfInt(int* ptr,
                int length) {
     fprintf(stderr, "[ %d", ptr[0]);
@@ -47,3 +124,410 @@ void printfInt(int* ptr,
         fprintf(stderr, " %d", ptr[i]);
     fprintf(stderr, " ]\n");
 }
+
+// 64-bit FNV-1a, to name cache files and fingerprint kernel sources
+static unsigned long long hashKernelString(const char* string,
+                                           unsigned long long hash = 14695981039346656037ULL) {
+    for (const unsigned char* c = (const unsigned char*) string; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+const char* getKernelBinaryCachePath() {
+    const char* path = getenv("BEAGLE_KERNEL_BINARY_CACHE");
+    if (path == NULL || path[0] == '\0')
+        return NULL;
+    return path;
+}
+
+std::string getKernelBinaryKey(const char* framework,
+                               const char* deviceName,
+                               const char* driverVersion,
+                               int paddedStateCount,
+                               bool doublePrecision,
+                               const char* source,
+                               const char* buildOptions) {
+    // fields are tab separated on the first line of the cache file
+    std::string key = std::string(framework) + "\t" + deviceName + "\t" + driverVersion;
+    for (size_t i = 0; i < key.size(); i++) {
+        if (key[i] == '\n' || key[i] == '\r')
+            key[i] = ' ';
+    }
+
+    char fields[96];
+    snprintf(fields, sizeof(fields), "\t%d\t%s\t%016llx", paddedStateCount, (doublePrecision ? "DP" : "SP"),
+             hashKernelString(buildOptions, hashKernelString(source)));
+
+    return key + fields;
+}
+
+static std::string getKernelBinaryFileName(const char* cachePath,
+                                           const std::string& key) {
+    char name[64];
+    snprintf(name, sizeof(name), "/beagle-kernels-%016llx.bin", hashKernelString(key.c_str()));
+    return std::string(cachePath) + name;
+}
+
+bool readKernelBinary(const char* cachePath,
+                      const std::string& key,
+                      std::vector<unsigned char>* binary) {
+    FILE* file = fopen(getKernelBinaryFileName(cachePath, key).c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    // the key heads the file, so a hash collision reads as a miss
+    std::vector<char> fileKey(key.size() + 1);
+    bool found = (fread(&fileKey[0], 1, fileKey.size(), file) == fileKey.size() &&
+                  memcmp(&fileKey[0], key.c_str(), key.size()) == 0 && fileKey[key.size()] == '\n');
+
+    if (found) {
+        binary->clear();
+        unsigned char buffer[65536];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            binary->insert(binary->end(), buffer, buffer + length);
+        found = (ferror(file) == 0 && !binary->empty());
+    }
+    fclose(file);
+
+    return found;
+}
+
+// Distinguishes temporary files of concurrent writers in this process
+static std::mutex kernelBinaryCacheMutex;
+static unsigned int kernelBinaryWriteCount = 0;
+
+void writeKernelBinary(const char* cachePath,
+                       const std::string& key,
+                       const std::vector<unsigned char>& binary) {
+    std::string fileName = getKernelBinaryFileName(cachePath, key);
+
+    char suffix[64];
+    {
+        std::lock_guard<std::mutex> lock(kernelBinaryCacheMutex);
+#ifdef _WIN32
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", _getpid(), kernelBinaryWriteCount++);
+#else
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int) getpid(), kernelBinaryWriteCount++);
+#endif
+    }
+    std::string tmpName = fileName + suffix;
+
+    FILE* file = fopen(tmpName.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to write kernel binary cache %s\n", cachePath);
+        return;
+    }
+    bool written = (fprintf(file, "%s\n", key.c_str()) > 0 &&
+                    fwrite(&binary[0], 1, binary.size(), file) == binary.size());
+    written = (fclose(file) == 0 && written);
+
+    // another process may have won the race; its binary is as good as ours
+    if (!written || rename(tmpName.c_str(), fileName.c_str()) != 0)
+        remove(tmpName.c_str());
+}
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+KernelResource* createRuntimeKernelResource(int paddedStateCount,
+                                            bool doublePrecision) {
+    int patternBlockSize = 8;
+    while (patternBlockSize > 1 && patternBlockSize * paddedStateCount > 512)
+        patternBlockSize >>= 1;
+
+    // must divide the state count and not exceed the pattern block
+    int blockPeelingSize = (doublePrecision && paddedStateCount > 48 ? 4 : 8);
+    while (blockPeelingSize > patternBlockSize || paddedStateCount % blockPeelingSize != 0)
+        blockPeelingSize >>= 1;
+
+    int multiplyBlockSize = 16;
+    if ((paddedStateCount + 7) / 8 * 8 < (paddedStateCount + 15) / 16 * 16)
+        multiplyBlockSize = 8;
+
+    return new KernelResource(paddedStateCount,
+                              NULL,
+                              patternBlockSize,
+                              8,
+                              blockPeelingSize,
+                              (paddedStateCount > 64 ? 1 : 0),
+                              multiplyBlockSize,
+                              0,0,0,0);
+}
+
+std::string getRuntimeKernelDefinitions(const KernelResource& resource,
+                                        bool doublePrecision) {
+    const int stateCount = resource.paddedStateCount;
+
+    int smallestPowerOfTwo = 1;
+    while (smallestPowerOfTwo < stateCount)
+        smallestPowerOfTwo <<= 1;
+
+    char line[128];
+    std::string definitions;
+
+    snprintf(line, sizeof(line), "#define STATE_COUNT %d\n", stateCount);
+    definitions += line;
+    if (doublePrecision)
+        definitions += "#define DOUBLE_PRECISION\n";
+    definitions += "#define RUNTIME_KERNEL_BUILD\n";
+    if (resource.halfPartials)
+        definitions += "#define PARTIALS_HALF\n";
+    if (resource.pruningMMA)
+        definitions += "#define PRUNING_MMA\n";
+
+    snprintf(line, sizeof(line), "#define PATTERN_BLOCK_SIZE %d\n", resource.patternBlockSize);
+    definitions += line;
+    snprintf(line, sizeof(line), "#define MATRIX_BLOCK_SIZE %d\n", resource.matrixBlockSize);
+    definitions += line;
+    snprintf(line, sizeof(line), "#define BLOCK_PEELING_SIZE %d\n", resource.blockPeelingSize);
+    definitions += line;
+    if (smallestPowerOfTwo == stateCount)
+        definitions += "#define IS_POWER_OF_TWO\n";
+    snprintf(line, sizeof(line), "#define SMALLEST_POWER_OF_TWO %d\n", smallestPowerOfTwo);
+    definitions += line;
+    if (resource.slowReweighing)
+        definitions += "#define SLOW_REWEIGHING\n";
+    snprintf(line, sizeof(line), "#define MULTIPLY_BLOCK_SIZE %d\n", resource.multiplyBlockSize);
+    definitions += line;
+
+    return definitions;
+}
+
+// Serializes access to the tuning cache between instances in this process
+static std::mutex kernelTuningCacheMutex;
+
+std::string getKernelTuningCachePath() {
+    // the per-user cache directory, shared by every process of the user
+#ifdef _WIN32
+    const char* base = getenv("LOCALAPPDATA");
+    if (base == NULL || base[0] == '\0')
+        return std::string();
+    std::string directory = std::string(base) + "\\hmsbeagle";
+    _mkdir(directory.c_str());
+    return directory + "\\kernel-tuning";
+#else
+    std::string base;
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cacheHome != NULL && cacheHome[0] != '\0')
+        base = cacheHome;
+    else if (home != NULL && home[0] != '\0')
+        base = std::string(home) + "/.cache";
+    else
+        return std::string();
+    mkdir(base.c_str(), 0755);
+    std::string directory = base + "/hmsbeagle";
+    mkdir(directory.c_str(), 0755);
+    return directory + "/kernel-tuning";
+#endif
+}
+
+std::string getKernelTuningKey(const char* framework,
+                               const char* deviceName,
+                               int paddedStateCount,
+                               bool doublePrecision) {
+    // fields are tab separated, one entry per line
+    std::string name(deviceName);
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == '\t' || name[i] == '\n' || name[i] == '\r')
+            name[i] = ' ';
+    }
+
+    char fields[64];
+    snprintf(fields, sizeof(fields), "\t%d\t%s", paddedStateCount, (doublePrecision ? "DP" : "SP"));
+
+    return std::string(framework) + "\t" + name + fields;
+}
+
+bool readKernelTuning(const char* cachePath,
+                      const std::string& key,
+                      KernelResource* resource) {
+    if (cachePath[0] == '\0')
+        return false;
+
+    std::lock_guard<std::mutex> lock(kernelTuningCacheMutex);
+
+    FILE* file = fopen(cachePath, "r");
+    if (file == NULL)
+        return false;
+
+    bool found = false;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int patternBlockSize;
+        int blockPeelingSize;
+        if (strncmp(line, key.c_str(), key.size()) == 0 &&
+            sscanf(line + key.size(), "\t%d\t%d", &patternBlockSize, &blockPeelingSize) == 2 &&
+            patternBlockSize > 0 && blockPeelingSize > 0 && blockPeelingSize <= patternBlockSize &&
+            resource->paddedStateCount % blockPeelingSize == 0) {
+            resource->patternBlockSize = patternBlockSize;
+            resource->blockPeelingSize = blockPeelingSize;
+            found = true;
+        }
+    }
+    fclose(file);
+
+    return found;
+}
+
+void writeKernelTuning(const char* cachePath,
+                       const std::string& key,
+                       const KernelResource& resource) {
+    if (cachePath[0] == '\0')
+        return; // tuned again by the next instance
+
+    std::lock_guard<std::mutex> lock(kernelTuningCacheMutex);
+
+    FILE* file = fopen(cachePath, "a");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to write kernel tuning cache %s\n", cachePath);
+        return;
+    }
+    fprintf(file, "%s\t%d\t%d\n", key.c_str(), resource.patternBlockSize, resource.blockPeelingSize);
+    fclose(file);
+}
+
+void tuneRuntimeKernelResource(KernelResource* resource,
+                               bool doublePrecision,
+                               int maxThreadsPerBlock,
+                               size_t maxLocalMemory,
+                               const std::function<double(const KernelResource&)>& timeKernels) {
+    const int stateCount = resource->paddedStateCount;
+    const size_t realSize = (doublePrecision ? sizeof(double) : sizeof(float));
+
+    KernelResource candidate(*resource, resource->kernelCode);
+    double bestTime = timeKernels(candidate);
+
+    const int defaultBlockSize = resource->patternBlockSize;
+    const int defaultPeelingSize = resource->blockPeelingSize;
+
+    // pattern block sizes, keeping the peeling size within the block
+    for (int patternBlockSize = 1; patternBlockSize <= 32; patternBlockSize <<= 1) {
+        candidate.patternBlockSize = patternBlockSize;
+        candidate.blockPeelingSize = defaultPeelingSize;
+        while (candidate.blockPeelingSize > patternBlockSize)
+            candidate.blockPeelingSize >>= 1;
+
+        // pruning stages both partials and matrices in local memory
+        size_t localMemory = realSize * stateCount * 2 * (patternBlockSize + candidate.blockPeelingSize);
+        if (patternBlockSize == defaultBlockSize ||
+            patternBlockSize * stateCount > maxThreadsPerBlock ||
+            localMemory > maxLocalMemory)
+            continue;
+
+        double time = timeKernels(candidate);
+        if (time >= 0 && (bestTime < 0 || time < bestTime)) {
+            bestTime = time;
+            resource->patternBlockSize = candidate.patternBlockSize;
+            resource->blockPeelingSize = candidate.blockPeelingSize;
+        }
+    }
+
+    // block peeling sizes for the winning pattern block
+    const int tunedPeelingSize = resource->blockPeelingSize;
+    candidate.patternBlockSize = resource->patternBlockSize;
+    for (int blockPeelingSize = 1; blockPeelingSize <= resource->patternBlockSize; blockPeelingSize <<= 1) {
+        candidate.blockPeelingSize = blockPeelingSize;
+
+        size_t localMemory = realSize * stateCount * 2 * (resource->patternBlockSize + blockPeelingSize);
+        if (blockPeelingSize == tunedPeelingSize ||
+            stateCount % blockPeelingSize != 0 ||
+            localMemory > maxLocalMemory)
+            continue;
+
+        double time = timeKernels(candidate);
+        if (time >= 0 && (bestTime < 0 || time < bestTime)) {
+            bestTime = time;
+            resource->blockPeelingSize = blockPeelingSize;
+        }
+    }
+}
+#endif
+
+#ifdef BEAGLE_HALF_PARTIALS
+static unsigned short floatToHalf(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    unsigned short sign = (unsigned short) ((bits >> 16) & 0x8000);
+    int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) // inf or nan
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31) // overflow
+        return sign | 0x7c00;
+    if (exponent <= 0) { // subnormal or zero
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | (unsigned short) half;
+    }
+
+    // round to nearest even, carrying into the exponent when needed
+    unsigned int half = ((unsigned int) exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | (unsigned short) half;
+}
+
+static float halfToFloat(unsigned short value) {
+    unsigned int sign = ((unsigned int) value & 0x8000) << 16;
+    int exponent = (value >> 10) & 0x1f;
+    unsigned int mantissa = value & 0x3ff;
+
+    unsigned int bits;
+    if (exponent == 0x1f) { // inf or nan
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else { // subnormal, normalize
+            exponent = 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | ((unsigned int) (exponent - 15 + 127) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else {
+        bits = sign | ((unsigned int) (exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void convertToHalf(void* buffer,
+                   size_t length) {
+    unsigned char* bytes = (unsigned char*) buffer;
+    // forward, each half is written no later than its float is read
+    for (size_t i = 0; i < length; i++) {
+        float value;
+        memcpy(&value, bytes + i * sizeof(float), sizeof(float));
+        unsigned short half = floatToHalf(value);
+        memcpy(bytes + i * sizeof(unsigned short), &half, sizeof(unsigned short));
+    }
+}
+
+void convertFromHalf(void* buffer,
+                     size_t length) {
+    unsigned char* bytes = (unsigned char*) buffer;
+    // backward, so no half is overwritten before it is read
+    for (size_t i = length; i > 0; i--) {
+        unsigned short half;
+        memcpy(&half, bytes + (i - 1) * sizeof(unsigned short), sizeof(unsigned short));
+        float value = halfToFloat(half);
+        memcpy(bytes + (i - 1) * sizeof(float), &value, sizeof(float));
+    }
+}
+#endif
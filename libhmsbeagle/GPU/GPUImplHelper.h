@@ -30,10 +30,49 @@
 #include "libhmsbeagle/config.h"
 #endif
 
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+#include <functional>
+#include "libhmsbeagle/GPU/KernelResource.h"
+#endif
+
 void checkHostMemory(void* ptr);
 
+/**
+ * @brief Offset bookkeeping for a device region handed out as sub-buffers
+ *
+ * Ranges are taken first-fit at aligned offsets and merged with their free
+ * neighbours when returned. Device memory itself is managed by the caller.
+ */
+class DeviceMemoryPool {
+private:
+    size_t kPoolSize;
+    size_t kAlignment;
+    std::map<size_t, size_t> freeRanges; // offset -> length
+    std::map<size_t, size_t> usedRanges; // offset -> length
+
+public:
+    DeviceMemoryPool();
+
+    void reset(size_t poolSize,
+               size_t alignment);
+
+    size_t size() const;
+
+    // returns false when no free range is large enough
+    bool take(size_t memSize,
+              size_t* outOffset);
+
+    // returns false when offset was not handed out by this pool
+    bool give(size_t offset);
+};
+
 /**
  * @brief Transposes a square matrix in place
  */
@@ -62,4 +101,117 @@ void printfVector(Real* ptr,
 void printfInt(int* ptr,
                int length);
 
+/**
+ * @brief Directory named by the BEAGLE_KERNEL_BINARY_CACHE environment variable,
+ * or NULL when compiled kernels are not cached on disk
+ */
+const char* getKernelBinaryCachePath();
+
+/**
+ * @brief Binary cache key for a framework, device, driver, padded state count and
+ * precision, qualified by a hash of the kernel source and build options
+ */
+std::string getKernelBinaryKey(const char* framework,
+                               const char* deviceName,
+                               const char* driverVersion,
+                               int paddedStateCount,
+                               bool doublePrecision,
+                               const char* source,
+                               const char* buildOptions);
+
+/**
+ * @brief Reads the program binary cached under key; returns false if there is none
+ */
+bool readKernelBinary(const char* cachePath,
+                      const std::string& key,
+                      std::vector<unsigned char>* binary);
+
+/**
+ * @brief Caches a program binary under key
+ *
+ * The file is written under a temporary name and renamed into place, so other
+ * processes sharing the cache never read a partial binary.
+ */
+void writeKernelBinary(const char* cachePath,
+                       const std::string& key,
+                       const std::vector<unsigned char>& binary);
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+/**
+ * @brief Block sizes for a padded state count without precompiled kernels
+ *
+ * Pruning blocks keep to at most 512 threads, as in the precompiled table.
+ * The matrix multiply tile is the one that wastes fewer padded rows. kernelCode is left
+ * NULL for the caller to fill in once the kernels are built.
+ */
+KernelResource* createRuntimeKernelResource(int paddedStateCount,
+                                            bool doublePrecision);
+
+/**
+ * @brief Preprocessor definitions that select a resource's state count and
+ * block sizes, to be placed ahead of the generic kernel source
+ */
+std::string getRuntimeKernelDefinitions(const KernelResource& resource,
+                                        bool doublePrecision);
+
+/**
+ * @brief Kernel tuning cache in the user's cache directory, which is created
+ * if needed; empty when the user has none, so tunings are not kept
+ */
+std::string getKernelTuningCachePath();
+
+/**
+ * @brief Tuning cache key for a framework, device, padded state count and precision
+ */
+std::string getKernelTuningKey(const char* framework,
+                               const char* deviceName,
+                               int paddedStateCount,
+                               bool doublePrecision);
+
+/**
+ * @brief Sets the resource's pattern block and block peeling sizes from the
+ * last valid cache entry for key; returns false if there is none
+ */
+bool readKernelTuning(const char* cachePath,
+                      const std::string& key,
+                      KernelResource* resource);
+
+/**
+ * @brief Appends the resource's pattern block and block peeling sizes to the cache
+ */
+void writeKernelTuning(const char* cachePath,
+                       const std::string& key,
+                       const KernelResource& resource);
+
+/**
+ * @brief Benchmarks candidate block sizes and keeps the fastest in the resource
+ *
+ * Pattern block sizes are timed first, then block peeling sizes for the winning
+ * pattern block. Candidates that exceed the device's threads per block or local
+ * memory are skipped; timeKernels returns a negative time for any that fail to
+ * build or launch.
+ */
+void tuneRuntimeKernelResource(KernelResource* resource,
+                               bool doublePrecision,
+                               int maxThreadsPerBlock,
+                               size_t maxLocalMemory,
+                               const std::function<double(const KernelResource&)>& timeKernels);
+#endif
+
+#ifdef BEAGLE_HALF_PARTIALS
+/**
+ * @brief Rounds length floats to IEEE half precision, packed in place at the
+ * start of the buffer
+ */
+void convertToHalf(void* buffer,
+                   size_t length);
+
+/**
+ * @brief Widens length half precision values packed at the start of the
+ * buffer to floats in place
+ */
+void convertFromHalf(void* buffer,
+                     size_t length);
+#endif
+
 #endif // __GPUImplHelper__
@@ -33,6 +33,8 @@
 #endif
 
 #include <map>
+#include <set>
+#include <string>
 
 #include "libhmsbeagle/GPU/GPUImplHelper.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
@@ -40,11 +42,6 @@
 
 #ifdef CUDA
     #include <cuda.h>
-#   ifdef BEAGLE_XCODE
-        #include "libhmsbeagle/GPU/kernels/BeagleCUDA_kernels_xcode.h"
-#   else
-        #include "libhmsbeagle/GPU/kernels/BeagleCUDA_kernels.h"
-#   endif
     typedef CUdeviceptr GPUPtr;
     typedef CUfunction GPUFunction;
 
@@ -80,7 +77,19 @@ private:
     CUmodule cudaModule;
     CUstream* cudaStreams;
     CUevent* cudaEvents;
+    CUevent* cudaDependencyEvents;           // last work recorded per stream for other streams
+    bool cudaDependenciesPending;            // recorded work not yet behind a device barrier
+#if CUDA_VERSION >= 10000
+    CUgraphExec cudaGraphExec;               // last captured operation graph
+#endif
+    bool cudaCapturing;
+    CUevent cudaTransferEvents[BEAGLE_TRANSFER_BUFFER_COUNT];
+    std::set<GPUPtr> cudaAllocations;        // released with the instance, not the shared context
+    std::set<void*> cudaHostAllocations;
+    std::map<GPUPtr, void*> cudaMappedAllocations; // device addresses of mapped host memory
     const char* GetCUDAErrorDescription(int errorCode);
+    void CreateStreams(int streamCount);
+    void ReleaseStreams();
 #elif defined(FW_OPENCL)
     cl_device_id openClDeviceId;             // compute device id 
     cl_context openClContext;                // compute context
@@ -88,8 +97,37 @@ private:
     cl_event* openClEvents;                  // compute events
     cl_program openClProgram;                // compute program
     std::map<int, cl_device_id> openClDeviceMap;
+    cl_event openClTransferEvents[BEAGLE_TRANSFER_BUFFER_COUNT];
+    std::map<GPUPtr, size_t> openClPoolBuffers; // sub-buffers of the pool and their offsets
+#ifdef BEAGLE_RUNTIME_KERNELS
+    std::string runtimeKernelSource;         // generic kernel source behind its definitions
+    std::string runtimeKernelKey;            // device and definitions of a cached program binary
+#endif
     const char* GetCLErrorDescription(int errorCode);
 #endif
+    GPUPtr dMemoryPool;                      // single region sub-allocated by AllocateMemory
+    DeviceMemoryPool memoryPool;
+    std::map<GPUFunction, std::string> functionNames; // labels launches in trace ranges
+    const char* GetTraceName(GPUFunction deviceFunction);
+
+    // When the BEAGLE_GPU_REPORT environment variable is set, the launches of each kernel
+    // and the device memory held by the instance are counted, and printed to stderr with the
+    // registers, shared memory and theoretical occupancy of each kernel when it is released.
+    // Launches replayed from a captured graph are counted once, when captured
+    struct LaunchShape {
+        Dim3Int grid;
+        Dim3Int block;
+        bool operator<(const LaunchShape& other) const;
+    };
+    bool reportLaunches;
+    std::map<GPUFunction, std::map<LaunchShape, long long> > launchCounts;
+    std::map<GPUPtr, size_t> deviceAllocations; // bytes of each buffer allocated on the device
+    size_t deviceMemoryBytes;
+    size_t deviceMemoryPeak;
+    void CountLaunch(GPUFunction deviceFunction, Dim3Int block, Dim3Int grid);
+    void CountAllocation(GPUPtr dPtr, size_t memSize);
+    void CountFree(GPUPtr dPtr);
+    void PrintLaunchReport();
 
 public:
     GPUInterface();
@@ -106,7 +144,8 @@ public:
                    int patternCount,
                    int unpaddedPatternCount,
                    int tipCount,
-                   long flags);
+                   long long flags,
+                   bool halfPartials);
     
     void ResizeStreamCount(int newStreamCount);
 
@@ -133,6 +172,25 @@ public:
                                int totalParameterCount,
                                ...); // parameters
 
+#ifdef CUDA
+    bool BeginGraphCapture();
+
+    void EndGraphCapture();
+
+    bool HasGraph();
+
+    void LaunchGraph();
+
+    void ReleaseGraph();
+
+    int GetStreamCount();
+
+    void RecordStreamDependency(int streamIndex);
+
+    void WaitForStreamDependency(int streamIndex,
+                                 int dependencyStreamIndex);
+#endif
+
     void* MallocHost(size_t memSize);
     
     void* CallocHost(size_t size, size_t length);
@@ -140,14 +198,21 @@ public:
     void* AllocatePinnedHostMemory(size_t memSize,
                                    bool writeCombined,
                                    bool mapped);
+
+    void* AllocateTransferMemory(size_t memSize);
     
-#ifdef FW_OPENCL
+    GPUPtr AllocateMappedMemory(size_t memSize);
+
     void* MapMemory(GPUPtr dPtr,
                     size_t memSize);
 
+    const void* MapMemoryForRead(GPUPtr dPtr,
+                                 size_t memSize);
+
     void UnmapMemory(GPUPtr dPtr,
                        void* hPtr);
-#endif
+
+    void ReserveMemoryPool(size_t memSize);
 
     GPUPtr AllocateMemory(size_t memSize);
     
@@ -167,6 +232,13 @@ public:
                             const void* src,
                             size_t memSize);
 
+    void MemcpyHostToDeviceAsync(GPUPtr dest,
+                                 const void* src,
+                                 size_t memSize,
+                                 int transferIndex);
+
+    void WaitForTransfer(int transferIndex);
+
     void MemcpyDeviceToHost(void* dest,
                             const GPUPtr src,
                             size_t memSize);
@@ -178,6 +250,8 @@ public:
     void FreeHostMemory(void* hPtr);
     
     void FreePinnedHostMemory(void* hPtr);
+
+    void FreeTransferMemory(void* hPtr);
     
     void FreeMemory(GPUPtr dPtr);
 
@@ -192,12 +266,14 @@ public:
     void GetDeviceDescription(int deviceNumber,
                               char* deviceDescription);
     
-    long GetDeviceTypeFlag(int deviceNumber);
+    long long GetDeviceTypeFlag(int deviceNumber);
 
     BeagleDeviceImplementationCodes GetDeviceImplementationCode(int deviceNumber);
 
     bool GetSupportsDoublePrecision(int deviceNumber);
 
+    bool GetSupportsZeroCopy(int deviceNumber);
+
     template<typename Real>
     void PrintfDeviceVector(GPUPtr dPtr, int length, Real r) {
     	PrintfDeviceVector(dPtr,length,-1, 0, r);
@@ -256,7 +332,23 @@ public:
     
 protected:
 	void InitializeKernelResource(int paddedStateCount,
-                                  bool doublePrecision);
+                                  bool doublePrecision,
+                                  bool halfPartials,
+                                  bool tuneKernels);
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+# ifdef CUDA
+    bool BuildRuntimeKernels(KernelResource* resource,
+                             bool doublePrecision);
+# endif
+
+    KernelResource* TuneRuntimeKernelResource(int paddedStateCount,
+                                              bool doublePrecision,
+                                              const char* cachePath);
+
+    double TimeRuntimeKernels(const KernelResource& resource,
+                              bool doublePrecision);
+#endif
     
     std::map<int, int>* resourceMap;
 
@@ -31,16 +31,32 @@
 #include <cstring>
 #include <cassert>
 #include <cstdarg>
+#include <algorithm>
 #include <map>
+#include <mutex>
+#include <vector>
 
 #include <cuda.h>
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+#include <string>
+#include <nvrtc.h>
+#endif
+
 #include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/BeagleTrace.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
 #include "libhmsbeagle/GPU/GPUImplHelper.h"
 #include "libhmsbeagle/GPU/GPUInterface.h"
 #include "libhmsbeagle/GPU/KernelResource.h"
 
+// kernel images are only referenced here, so other units do not embed them
+#ifdef BEAGLE_XCODE
+    #include "libhmsbeagle/GPU/kernels/BeagleCUDA_kernels_xcode.h"
+#else
+    #include "libhmsbeagle/GPU/kernels/BeagleCUDA_kernels.h"
+#endif
+
 #include <cmath>
 
 #define LOAD_KERNEL_INTO_RESOURCE(state, prec, id) \
@@ -56,6 +72,70 @@
 
 namespace cuda_device {
 
+// instances on a device share its primary context, and the non-blocking
+// streams released by earlier instances are handed to later ones
+struct SharedDeviceContext {
+    CUcontext context;
+    int instanceCount;
+    std::vector<CUstream> freeStreams;
+};
+static std::map<CUdevice, SharedDeviceContext> sharedDeviceContexts;
+static std::mutex sharedDeviceContextMutex;
+
+static CUresult retainSharedContext(CUdevice device,
+                                    CUcontext* context) {
+    std::lock_guard<std::mutex> lock(sharedDeviceContextMutex);
+    SharedDeviceContext& shared = sharedDeviceContexts[device];
+    if (shared.instanceCount == 0) {
+        // only takes effect if nothing else in the process activated it yet
+        cuDevicePrimaryCtxSetFlags(device, CU_CTX_SCHED_AUTO | CU_CTX_MAP_HOST);
+        CUresult error = cuDevicePrimaryCtxRetain(&shared.context, device);
+        if (error != CUDA_SUCCESS)
+            return error;
+    }
+    shared.instanceCount++;
+    *context = shared.context;
+    return CUDA_SUCCESS;
+}
+
+static void releaseSharedContext(CUdevice device) {
+    std::lock_guard<std::mutex> lock(sharedDeviceContextMutex);
+    SharedDeviceContext& shared = sharedDeviceContexts[device];
+    if (--shared.instanceCount == 0) {
+        cuCtxPushCurrent(shared.context);
+        for (size_t i = 0; i < shared.freeStreams.size(); i++)
+            cuStreamDestroy(shared.freeStreams[i]);
+        shared.freeStreams.clear();
+        cuCtxPopCurrent(NULL);
+        cuDevicePrimaryCtxRelease(device);
+    }
+}
+
+// the shared context must be current
+static CUresult acquireSharedStream(CUdevice device,
+                                    CUstream* stream) {
+    std::lock_guard<std::mutex> lock(sharedDeviceContextMutex);
+    SharedDeviceContext& shared = sharedDeviceContexts[device];
+    if (shared.freeStreams.empty())
+        return cuStreamCreate(stream, CU_STREAM_NON_BLOCKING);
+    *stream = shared.freeStreams.back();
+    shared.freeStreams.pop_back();
+    return CUDA_SUCCESS;
+}
+
+static void releaseSharedStream(CUdevice device,
+                                CUstream stream) {
+    std::lock_guard<std::mutex> lock(sharedDeviceContextMutex);
+    sharedDeviceContexts[device].freeStreams.push_back(stream);
+}
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+// PTX of kernels built at runtime, keyed by target architecture and
+// definitions; entries are never erased, so resources may point into them
+static std::map<std::string, std::string> runtimeKernelCache;
+static std::mutex runtimeKernelCacheMutex;
+#endif
+
 //static int nGpuArchCoresPerSM[] = { -1, 8, 32 };
 
 namespace util {
@@ -130,8 +210,22 @@ GPUInterface::GPUInterface() {
     cudaModule = NULL;
     cudaStreams = NULL;
     cudaEvents = NULL;
+    cudaDependencyEvents = NULL;
+    cudaDependenciesPending = false;
+#if CUDA_VERSION >= 10000
+    cudaGraphExec = NULL;
+#endif
+    cudaCapturing = false;
+    for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++)
+        cudaTransferEvents[i] = NULL;
+    dMemoryPool = (GPUPtr) NULL;
     kernelResource = NULL;
     supportDoublePrecision = true;
+
+    const char* report = getenv("BEAGLE_GPU_REPORT");
+    reportLaunches = (report != NULL && report[0] != '\0');
+    deviceMemoryBytes = 0;
+    deviceMemoryPeak = 0;
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::GPUInterface\n");
@@ -143,25 +237,42 @@ GPUInterface::~GPUInterface() {
     fprintf(stderr,"\t\t\tEntering GPUInterface::~GPUInterface\n");
 #endif    
 
-    if (cudaStreams != NULL) {
-        for(int i=0; i<numStreams; i++) {
-            if (cudaStreams[i] != NULL)
-                SAFE_CUDA(cuStreamDestroy(cudaStreams[i]));
-        }
-        free(cudaStreams);
-    }
+    if (cudaContext != NULL) {
+        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+        if (reportLaunches)
+            PrintLaunchReport();
 
-    if (cudaEvents != NULL) {
-        for(int i=0; i<numStreams; i++) {
-            if (cudaEvents[i] != NULL)
-                SAFE_CUDA(cuEventDestroy(cudaEvents[i]));
+        if (cudaStreams != NULL)
+            ReleaseStreams();
+
+        for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++) {
+            if (cudaTransferEvents[i] != NULL)
+                SAFE_CUDA(cuEventDestroy(cudaTransferEvents[i]));
         }
-        free(cudaEvents);
-    }
 
-    if (cudaContext != NULL) {
-        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
-        SAFE_CUDA(cuCtxDestroy(cudaContext));
+#if CUDA_VERSION >= 10000
+        if (cudaGraphExec != NULL)
+            SAFE_CUDA(cuGraphExecDestroy(cudaGraphExec));
+#endif
+
+        // the context outlives this instance, so everything it still
+        // holds there is released explicitly
+        for (std::set<GPUPtr>::iterator it = cudaAllocations.begin(); it != cudaAllocations.end(); ++it)
+            SAFE_CUDA(cuMemFree(*it));
+
+        for (std::set<void*>::iterator it = cudaHostAllocations.begin(); it != cudaHostAllocations.end(); ++it)
+            SAFE_CUDA(cuMemFreeHost(*it));
+
+        if (dMemoryPool != (GPUPtr) NULL)
+            SAFE_CUDA(cuMemFree(dMemoryPool));
+
+        if (cudaModule != NULL)
+            SAFE_CUDA(cuModuleUnload(cudaModule));
+
+        SAFE_CUDA(cuCtxPopCurrent(NULL));
+
+        releaseSharedContext(cudaDevice);
     }
     
     if (kernelResource != NULL) {
@@ -228,7 +339,9 @@ int GPUInterface::GetDeviceCount() {
 }
 
 void GPUInterface::InitializeKernelResource(int paddedStateCount,
-                                            bool doublePrecision) {
+                                            bool doublePrecision,
+                                            bool halfPartials,
+                                            bool tuneKernels) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLoading kernel information for CUDA!\n");
 #endif
@@ -254,23 +367,247 @@ void GPUInterface::InitializeKernelResource(int paddedStateCount,
         case  128: LOAD_KERNEL_INTO_RESOURCE(128, SP, 128); break;
         case  192: LOAD_KERNEL_INTO_RESOURCE(192, SP, 192); break;
     }
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+    if (abs(paddedStateCount) != 4) {
+        KernelResource* runtimeResource = NULL;
+        if (tuneKernels)
+            runtimeResource = TuneRuntimeKernelResource(abs(paddedStateCount), doublePrecision,
+                                                        getKernelTuningCachePath().c_str());
+        else if (kernelResource == NULL)
+            runtimeResource = createRuntimeKernelResource(abs(paddedStateCount), doublePrecision);
+
+#ifdef BEAGLE_HALF_PARTIALS
+        // only kernels built here store partials as half
+        if (halfPartials) {
+            if (runtimeResource == NULL && kernelResource != NULL)
+                runtimeResource = new KernelResource(*kernelResource, NULL);
+            if (runtimeResource != NULL)
+                runtimeResource->halfPartials = 1;
+        }
+#endif
+
+        // tensor core pruning needs TF32 mma, sm_80 and later
+        int computeCapabilityMajor = 0;
+        SAFE_CUDA(cuDeviceGetAttribute(&computeCapabilityMajor,
+                                       CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR,
+                                       cudaDevice));
+        if (!doublePrecision && computeCapabilityMajor >= 8) {
+            if (runtimeResource == NULL && kernelResource != NULL)
+                runtimeResource = new KernelResource(*kernelResource, NULL);
+            if (runtimeResource != NULL)
+                runtimeResource->pruningMMA = 1;
+        }
+
+        if (runtimeResource != NULL) {
+            if (BuildRuntimeKernels(runtimeResource, doublePrecision)) {
+                delete kernelResource;
+                kernelResource = runtimeResource;
+            } else {
+                delete runtimeResource;
+            }
+        }
+    }
+#endif
 }
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+bool GPUInterface::BuildRuntimeKernels(KernelResource* resource,
+                                       bool doublePrecision) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::BuildRuntimeKernels\n");
+#endif
+
+    const int paddedStateCount = resource->paddedStateCount;
+    std::string definitions = getRuntimeKernelDefinitions(*resource, doublePrecision);
+
+    int capabilityMajor;
+    int capabilityMinor;
+    SAFE_CUDA(cuDeviceGetAttribute(&capabilityMajor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, cudaDevice));
+    SAFE_CUDA(cuDeviceGetAttribute(&capabilityMinor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, cudaDevice));
+    char archOption[64];
+    snprintf(archOption, sizeof(archOption), "--gpu-architecture=compute_%d%d", capabilityMajor, capabilityMinor);
+
+    std::string key = std::string(archOption) + "\n" + definitions;
+
+    std::lock_guard<std::mutex> lock(runtimeKernelCacheMutex);
+
+    std::map<std::string, std::string>::iterator cached = runtimeKernelCache.find(key);
+    if (cached == runtimeKernelCache.end()) {
+        std::string source = definitions + KERNELS_SOURCE_X;
+        const char* headers[] = { KERNELS_SOURCE_DEFS, KERNELS_SOURCE_ALL };
+        const char* headerNames[] = { "libhmsbeagle/GPU/GPUImplDefs.h",
+                                      "libhmsbeagle/GPU/kernels/kernelsAll.cu" };
+        const char* options[] = { archOption, "-DCUDA" };
+
+        nvrtcProgram program;
+        if (nvrtcCreateProgram(&program, source.c_str(), "kernelsX.cu",
+                               2, headers, headerNames) != NVRTC_SUCCESS) {
+            fprintf(stderr, "NVRTC error: Failed to create kernels for %d states\n", paddedStateCount);
+            return false;
+        }
+
+        if (nvrtcCompileProgram(program, 2, options) != NVRTC_SUCCESS) {
+            size_t logSize;
+            nvrtcGetProgramLogSize(program, &logSize);
+            std::string log(logSize, '\0');
+            nvrtcGetProgramLog(program, &log[0]);
+
+            fprintf(stderr, "NVRTC error: Failed to build kernels for %d states\n%s\n",
+                    paddedStateCount, log.c_str());
+
+            nvrtcDestroyProgram(&program);
+            return false;
+        }
+
+        size_t ptxSize;
+        nvrtcGetPTXSize(program, &ptxSize);
+        std::string ptx(ptxSize, '\0');
+        nvrtcGetPTX(program, &ptx[0]);
+        nvrtcDestroyProgram(&program);
+
+        cached = runtimeKernelCache.insert(std::make_pair(key, ptx)).first;
+    }
+
+    resource->kernelCode = (char*) cached->second.c_str();
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::BuildRuntimeKernels\n");
+#endif
+
+    return true;
+}
+
+KernelResource* GPUInterface::TuneRuntimeKernelResource(int paddedStateCount,
+                                                        bool doublePrecision,
+                                                        const char* cachePath) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::TuneRuntimeKernelResource\n");
+#endif
+
+    char deviceName[256];
+    SAFE_CUDA(cuDeviceGetName(deviceName, sizeof(deviceName), cudaDevice));
+    std::string key = getKernelTuningKey("CUDA", deviceName, paddedStateCount, doublePrecision);
+
+    // start from the precompiled sizes where there are any
+    KernelResource* resource;
+    if (kernelResource != NULL)
+        resource = new KernelResource(*kernelResource, NULL);
+    else
+        resource = createRuntimeKernelResource(paddedStateCount, doublePrecision);
+
+    if (!readKernelTuning(cachePath, key, resource)) {
+        int maxThreadsPerBlock;
+        int maxSharedMemory;
+        SAFE_CUDA(cuDeviceGetAttribute(&maxThreadsPerBlock, CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK, cudaDevice));
+        SAFE_CUDA(cuDeviceGetAttribute(&maxSharedMemory, CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK, cudaDevice));
+
+        tuneRuntimeKernelResource(resource, doublePrecision, maxThreadsPerBlock, maxSharedMemory,
+                                  [this, doublePrecision](const KernelResource& candidate) {
+                                      return TimeRuntimeKernels(candidate, doublePrecision);
+                                  });
+        writeKernelTuning(cachePath, key, *resource);
+    }
+
+    // precompiled kernels already built with the tuned sizes are kept
+    if (kernelResource != NULL &&
+        kernelResource->patternBlockSize == resource->patternBlockSize &&
+        kernelResource->blockPeelingSize == resource->blockPeelingSize) {
+        delete resource;
+        resource = NULL;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::TuneRuntimeKernelResource\n");
+#endif
+
+    return resource;
+}
+
+double GPUInterface::TimeRuntimeKernels(const KernelResource& resource,
+                                        bool doublePrecision) {
+    KernelResource candidate(resource, NULL);
+    if (!BuildRuntimeKernels(&candidate, doublePrecision))
+        return -1.0;
+
+    CUmodule module;
+    CUfunction function;
+    if (cuModuleLoadData(&module, candidate.kernelCode) != CUDA_SUCCESS)
+        return -1.0;
+    if (cuModuleGetFunction(&function, module, "kernelPartialsPartialsNoScale") != CUDA_SUCCESS) {
+        cuModuleUnload(module);
+        return -1.0;
+    }
+
+    int stateCount = candidate.paddedStateCount;
+    int patternCount = BEAGLE_TUNING_PATTERN_COUNT;
+    int categoryCount = BEAGLE_TUNING_CATEGORY_COUNT;
+    size_t realSize = (doublePrecision ? sizeof(double) : sizeof(float));
+    size_t partialsSize = realSize * stateCount * patternCount * categoryCount;
+    size_t matricesSize = realSize * stateCount * stateCount * categoryCount;
+
+    CUdeviceptr buffers[5] = { 0, 0, 0, 0, 0 };
+    bool allocated = true;
+    for (int i = 0; i < 5 && allocated; i++) {
+        size_t size = (i < 3 ? partialsSize : matricesSize);
+        allocated = (cuMemAlloc(&buffers[i], size) == CUDA_SUCCESS &&
+                     cuMemsetD8(buffers[i], 0, size) == CUDA_SUCCESS);
+    }
+
+    double time = -1.0;
+    if (allocated) {
+        void* parameters[] = { &buffers[0], &buffers[1], &buffers[2], &buffers[3], &buffers[4],
+                               &patternCount };
+        unsigned int gridX = (patternCount + candidate.patternBlockSize - 1) / candidate.patternBlockSize;
+
+        CUevent start;
+        CUevent stop;
+        SAFE_CUDA(cuEventCreate(&start, CU_EVENT_DEFAULT));
+        SAFE_CUDA(cuEventCreate(&stop, CU_EVENT_DEFAULT));
+
+        // first launch warms up the module
+        CUresult result = cuLaunchKernel(function, gridX, categoryCount, 1,
+                                         stateCount, candidate.patternBlockSize, 1,
+                                         0, NULL, parameters, NULL);
+        SAFE_CUDA(cuEventRecord(start, NULL));
+        for (int i = 0; i < BEAGLE_TUNING_REPEAT_COUNT && result == CUDA_SUCCESS; i++) {
+            result = cuLaunchKernel(function, gridX, categoryCount, 1,
+                                    stateCount, candidate.patternBlockSize, 1,
+                                    0, NULL, parameters, NULL);
+        }
+        SAFE_CUDA(cuEventRecord(stop, NULL));
+
+        float milliseconds;
+        if (result == CUDA_SUCCESS &&
+            cuEventSynchronize(stop) == CUDA_SUCCESS &&
+            cuEventElapsedTime(&milliseconds, start, stop) == CUDA_SUCCESS) {
+            time = milliseconds;
+        }
+
+        SAFE_CUDA(cuEventDestroy(start));
+        SAFE_CUDA(cuEventDestroy(stop));
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (buffers[i] != 0)
+            cuMemFree(buffers[i]);
+    }
+    cuModuleUnload(module);
+
+    return time;
+}
+#endif
+
 void GPUInterface::SetDevice(int deviceNumber, int paddedStateCount, int categoryCount, int paddedPatternCount, int unpaddedPatternCount, int tipCount,
-                             long flags) {
+                             long long flags, bool halfPartials) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::SetDevice\n");
 #endif            
 
     SAFE_CUDA(cuDeviceGet(&cudaDevice, (*resourceMap)[deviceNumber]));
     
-    unsigned int ctxFlags = CU_CTX_SCHED_AUTO;
-
-    if (flags & BEAGLE_FLAG_SCALING_DYNAMIC) {
-        ctxFlags |= CU_CTX_MAP_HOST;
-    }
-
-    CUresult error = cuCtxCreate(&cudaContext, ctxFlags, cudaDevice);
+    // one primary context per device, always able to map host memory
+    CUresult error = retainSharedContext(cudaDevice, &cudaContext);
     if(error != CUDA_SUCCESS) { 
         fprintf(stderr, "CUDA error: \"%s\" from file <%s>, line %i.\n", 
                 GetCUDAErrorDescription(error), __FILE__, __LINE__); 
@@ -279,8 +616,10 @@ void GPUInterface::SetDevice(int deviceNumber, int paddedStateCount, int categor
         }
         exit(-1); 
     } 
+    SAFE_CUDA(cuCtxPushCurrent(cudaContext));
     
-    InitializeKernelResource(paddedStateCount, flags & BEAGLE_FLAG_PRECISION_DOUBLE);
+    InitializeKernelResource(paddedStateCount, flags & BEAGLE_FLAG_PRECISION_DOUBLE, halfPartials,
+                             (flags & BEAGLE_FLAG_KERNEL_TUNING) != 0);
 
     if (!kernelResource) {
         fprintf(stderr,"Critical error: unable to find kernel code for %d states.\n",paddedStateCount);
@@ -294,32 +633,13 @@ void GPUInterface::SetDevice(int deviceNumber, int paddedStateCount, int categor
     SAFE_CUDA(cuModuleLoadData(&cudaModule, kernelResource->kernelCode));
 
     if ((paddedPatternCount < BEAGLE_MULTI_GRID_MAX || flags & BEAGLE_FLAG_PARALLELOPS_GRID) && !(flags & BEAGLE_FLAG_PARALLELOPS_STREAMS)) {
-        numStreams = 1;
-        cudaStreams = (CUstream*) malloc(sizeof(CUstream) * numStreams);
-        cudaEvents = (CUevent*) malloc(sizeof(CUevent) * (numStreams + 1));
-        cudaStreams[0] = NULL;
-        CUevent event;
-        for(int i=0; i<2; i++) {
-            SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-            cudaEvents[i] = event;
-        }
+        CreateStreams(1);
     } else {
-        numStreams = tipCount/2 + 1;
-        if (numStreams > BEAGLE_STREAM_COUNT) {
-            numStreams = BEAGLE_STREAM_COUNT;
+        int streamCount = tipCount/2 + 1;
+        if (streamCount > BEAGLE_STREAM_COUNT) {
+            streamCount = BEAGLE_STREAM_COUNT;
         }
-        cudaStreams = (CUstream*) malloc(sizeof(CUstream) * numStreams);
-        CUstream stream;
-        cudaEvents = (CUevent*) malloc(sizeof(CUevent) * (numStreams + 1));
-        CUevent event;
-        for(int i=0; i<numStreams; i++) {
-            SAFE_CUDA(cuStreamCreate(&stream, CU_STREAM_DEFAULT));
-            cudaStreams[i] = stream;
-            SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-            cudaEvents[i] = event;
-        }
-        SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-        cudaEvents[numStreams] = event;
+        CreateStreams(streamCount);
     }
 
     SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
@@ -336,52 +656,13 @@ void GPUInterface::ResizeStreamCount(int newStreamCount) {
 #endif                
     SAFE_CUDA(cuCtxPushCurrent(cudaContext));
 
-    SAFE_CUDA(cuCtxSynchronize());
+    if (cudaStreams != NULL)
+        ReleaseStreams();
 
-    if (cudaStreams != NULL) {
-        for(int i=0; i<numStreams; i++) {
-            if (cudaStreams[i] != NULL)
-                SAFE_CUDA(cuStreamDestroy(cudaStreams[i]));
-        }
-        free(cudaStreams);
-    }
-
-    if (cudaEvents != NULL) {
-        for(int i=0; i<numStreams; i++) {
-            if (cudaEvents[i] != NULL)
-                SAFE_CUDA(cuEventDestroy(cudaEvents[i]));
-        }
-        free(cudaEvents);
-    }
-
-    if (newStreamCount == 1) {
-        numStreams = 1;
-        cudaStreams = (CUstream*) malloc(sizeof(CUstream) * numStreams);
-        cudaEvents = (CUevent*) malloc(sizeof(CUevent) * (numStreams + 1));
-        cudaStreams[0] = NULL;
-        CUevent event;
-        for(int i=0; i<2; i++) {
-            SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-            cudaEvents[i] = event;
-        }
-    } else {
-        numStreams = newStreamCount;
-        if (numStreams > BEAGLE_STREAM_COUNT) {
-            numStreams = BEAGLE_STREAM_COUNT;
-        }
-        cudaStreams = (CUstream*) malloc(sizeof(CUstream) * numStreams);
-        CUstream stream;
-        cudaEvents = (CUevent*) malloc(sizeof(CUevent) * (numStreams + 1));
-        CUevent event;
-        for(int i=0; i<numStreams; i++) {
-            SAFE_CUDA(cuStreamCreate(&stream, CU_STREAM_DEFAULT));
-            cudaStreams[i] = stream;
-            SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-            cudaEvents[i] = event;
-        }
-        SAFE_CUDA(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
-        cudaEvents[numStreams] = event;
+    if (newStreamCount > BEAGLE_STREAM_COUNT) {
+        newStreamCount = BEAGLE_STREAM_COUNT;
     }
+    CreateStreams(newStreamCount);
 
     SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
 
@@ -390,12 +671,63 @@ void GPUInterface::ResizeStreamCount(int newStreamCount) {
 #endif                
 }
 
+void GPUInterface::CreateStreams(int streamCount) {
+    numStreams = streamCount;
+    cudaStreams = (CUstream*) malloc(sizeof(CUstream) * numStreams);
+    cudaEvents = (CUevent*) malloc(sizeof(CUevent) * (numStreams + 1));
+    cudaDependencyEvents = (CUevent*) malloc(sizeof(CUevent) * numStreams);
+
+    if (numStreams == 1) {
+        // a private non-blocking stream rather than the legacy default
+        // stream, which would serialize instances sharing the context
+        SAFE_CUDA(acquireSharedStream(cudaDevice, &cudaStreams[0]));
+    } else {
+        for(int i=0; i<numStreams; i++)
+            SAFE_CUDA(cuStreamCreate(&cudaStreams[i], CU_STREAM_DEFAULT));
+    }
+
+    for(int i=0; i<=numStreams; i++)
+        SAFE_CUDA(cuEventCreate(&cudaEvents[i], CU_EVENT_DISABLE_TIMING));
+    for(int i=0; i<numStreams; i++)
+        SAFE_CUDA(cuEventCreate(&cudaDependencyEvents[i], CU_EVENT_DISABLE_TIMING));
+}
+
+void GPUInterface::ReleaseStreams() {
+    for(int i=0; i<numStreams; i++)
+        SAFE_CUDA(cuStreamSynchronize(cudaStreams[i]));
+
+    if (numStreams == 1) {
+        releaseSharedStream(cudaDevice, cudaStreams[0]);
+    } else {
+        for(int i=0; i<numStreams; i++)
+            SAFE_CUDA(cuStreamDestroy(cudaStreams[i]));
+    }
+
+    for(int i=0; i<=numStreams; i++)
+        SAFE_CUDA(cuEventDestroy(cudaEvents[i]));
+    for(int i=0; i<numStreams; i++)
+        SAFE_CUDA(cuEventDestroy(cudaDependencyEvents[i]));
+
+    free(cudaStreams);
+    free(cudaEvents);
+    free(cudaDependencyEvents);
+    cudaStreams = NULL;
+    cudaEvents = NULL;
+    cudaDependencyEvents = NULL;
+    cudaDependenciesPending = false;
+}
+
 void GPUInterface::SynchronizeHost() {    
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::SynchronizeHost\n");
 #endif                
     
-    SAFE_CUPP(cuCtxSynchronize());
+    // only this instance's streams; the context is shared with others
+    SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+    for(int i=0; i<numStreams; i++)
+        SAFE_CUDA(cuStreamSynchronize(cudaStreams[i]));
+    SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+    cudaDependenciesPending = false;
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::SynchronizeHost\n");
@@ -407,8 +739,13 @@ void GPUInterface::SynchronizeDevice() {
     fprintf(stderr,"\t\t\tEntering GPUInterface::SynchronizeDevice\n");
 #endif                
 
-    SAFE_CUPP(cuEventRecord(cudaEvents[numStreams], 0));
-    SAFE_CUPP(cuStreamWaitEvent(0, cudaEvents[numStreams], 0));
+    // a single stream is already ordered, and only separate streams
+    // rely on the legacy default stream as a barrier
+    if (numStreams > 1) {
+        SAFE_CUPP(cuEventRecord(cudaEvents[numStreams], 0));
+        SAFE_CUPP(cuStreamWaitEvent(0, cudaEvents[numStreams], 0));
+    }
+    cudaDependenciesPending = false;
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::SynchronizeDevice\n");
@@ -419,15 +756,18 @@ void GPUInterface::SynchronizeDeviceWithIndex(int streamRecordIndex, int streamW
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::SynchronizeDeviceWithIndex\n");
 #endif                
-    CUstream streamRecord  = NULL;
-    CUstream streamWait    = NULL;
-    if (streamRecordIndex >= 0)
-        streamRecord = cudaStreams[streamRecordIndex % numStreams];
-    if (streamWaitIndex >= 0)
-        streamWait   = cudaStreams[streamWaitIndex % numStreams];
-
-    SAFE_CUPP(cuEventRecord(cudaEvents[numStreams], streamRecord));
-    SAFE_CUPP(cuStreamWaitEvent(streamWait, cudaEvents[numStreams], 0));
+    // with a single stream everything is already in order
+    if (numStreams > 1) {
+        CUstream streamRecord  = NULL;
+        CUstream streamWait    = NULL;
+        if (streamRecordIndex >= 0)
+            streamRecord = cudaStreams[streamRecordIndex % numStreams];
+        if (streamWaitIndex >= 0)
+            streamWait   = cudaStreams[streamWaitIndex % numStreams];
+
+        SAFE_CUPP(cuEventRecord(cudaEvents[numStreams], streamRecord));
+        SAFE_CUPP(cuStreamWaitEvent(streamWait, cudaEvents[numStreams], 0));
+    }
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::SynchronizeDeviceWithIndex\n");
@@ -443,6 +783,8 @@ GPUFunction GPUInterface::GetFunction(const char* functionName) {
     
     SAFE_CUPP(cuModuleGetFunction(&cudaFunction, cudaModule, functionName));
     
+    functionNames[cudaFunction] = functionName;
+    
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::GetFunction\n");
 #endif                
@@ -450,6 +792,99 @@ GPUFunction GPUInterface::GetFunction(const char* functionName) {
     return cudaFunction;
 }
 
+const char* GPUInterface::GetTraceName(GPUFunction deviceFunction) {
+    if (!beagle::getTraceSinks().enabled)
+        return NULL;
+    std::map<GPUFunction, std::string>::const_iterator name = functionNames.find(deviceFunction);
+    return (name != functionNames.end() ? name->second.c_str() : "kernel");
+}
+
+bool GPUInterface::LaunchShape::operator<(const LaunchShape& other) const {
+    const unsigned int shape[6] = {grid.x, grid.y, grid.z, block.x, block.y, block.z};
+    const unsigned int otherShape[6] = {other.grid.x, other.grid.y, other.grid.z,
+                                        other.block.x, other.block.y, other.block.z};
+    return std::lexicographical_compare(shape, shape + 6, otherShape, otherShape + 6);
+}
+
+void GPUInterface::CountLaunch(GPUFunction deviceFunction,
+                               Dim3Int block,
+                               Dim3Int grid) {
+    LaunchShape shape;
+    shape.grid = grid;
+    shape.block = block;
+    launchCounts[deviceFunction][shape]++;
+}
+
+void GPUInterface::CountAllocation(GPUPtr dPtr,
+                                   size_t memSize) {
+    deviceAllocations[dPtr] = memSize;
+    deviceMemoryBytes += memSize;
+    deviceMemoryPeak = std::max(deviceMemoryPeak, deviceMemoryBytes);
+}
+
+void GPUInterface::CountFree(GPUPtr dPtr) {
+    std::map<GPUPtr, size_t>::iterator allocation = deviceAllocations.find(dPtr);
+    if (allocation != deviceAllocations.end()) {
+        deviceMemoryBytes -= allocation->second;
+        deviceAllocations.erase(allocation);
+    }
+}
+
+void GPUInterface::PrintLaunchReport() {
+    int multiprocessorCount = 0;
+    int multiprocessorThreads = 0;
+    int warpSize = 0;
+    SAFE_CUDA(cuDeviceGetAttribute(&multiprocessorCount, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, cudaDevice));
+    SAFE_CUDA(cuDeviceGetAttribute(&multiprocessorThreads, CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR, cudaDevice));
+    SAFE_CUDA(cuDeviceGetAttribute(&warpSize, CU_DEVICE_ATTRIBUTE_WARP_SIZE, cudaDevice));
+
+    fprintf(stderr, "BEAGLE GPU report: %d multiprocessors of %d threads\n",
+            multiprocessorCount, multiprocessorThreads);
+    fprintf(stderr, "  %-44s %10s %16s %12s %5s %7s %9s %5s\n", "kernel", "launches", "grid", "block",
+            "regs", "shared", "occupancy", "fill");
+    for (std::map<GPUFunction, std::map<LaunchShape, long long> >::const_iterator function = launchCounts.begin();
+         function != launchCounts.end(); ++function) {
+        int registers = 0;
+        int sharedBytes = 0;
+        SAFE_CUDA(cuFuncGetAttribute(&registers, CU_FUNC_ATTRIBUTE_NUM_REGS, function->first));
+        SAFE_CUDA(cuFuncGetAttribute(&sharedBytes, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, function->first));
+        std::map<GPUFunction, std::string>::const_iterator name = functionNames.find(function->first);
+
+        for (std::map<LaunchShape, long long>::const_iterator shape = function->second.begin();
+             shape != function->second.end(); ++shape) {
+            const Dim3Int& grid = shape->first.grid;
+            const Dim3Int& block = shape->first.block;
+            char gridText[32];
+            char blockText[32];
+            snprintf(gridText, sizeof(gridText), "%ux%ux%u", grid.x, grid.y, grid.z);
+            snprintf(blockText, sizeof(blockText), "%ux%ux%u", block.x, block.y, block.z);
+            fprintf(stderr, "  %-44s %10lld %16s %12s %5d %7d",
+                    (name != functionNames.end() ? name->second.c_str() : "kernel"), shape->second,
+                    gridText, blockText, registers, sharedBytes);
+
+            int blockThreads = block.x * block.y * block.z;
+            int blocksPerMultiprocessor = 0;
+#if CUDA_VERSION >= 6050
+            SAFE_CUDA(cuOccupancyMaxActiveBlocksPerMultiprocessor(&blocksPerMultiprocessor, function->first,
+                                                                  blockThreads, 0));
+#endif
+            if (blocksPerMultiprocessor > 0) {
+                // resident warps over the most a multiprocessor holds, and the share of
+                // the resident block slots of the whole device that one launch fills
+                int blockWarps = (blockThreads + warpSize - 1) / warpSize;
+                double occupancy = (double) blocksPerMultiprocessor * blockWarps * warpSize / multiprocessorThreads;
+                double gridBlocks = (double) grid.x * grid.y * grid.z;
+                double fill = std::min(1.0, gridBlocks / ((double) blocksPerMultiprocessor * multiprocessorCount));
+                fprintf(stderr, " %8.0f%% %4.0f%%\n", 100.0 * occupancy, 100.0 * fill);
+            } else {
+                fprintf(stderr, " %9s %5s\n", "-", "-");
+            }
+        }
+    }
+    fprintf(stderr, "  device memory: peak %.1f MB, %.1f MB held at release\n",
+            deviceMemoryPeak / 1048576.0, deviceMemoryBytes / 1048576.0);
+}
+
 void GPUInterface::LaunchKernel(GPUFunction deviceFunction,
                                          Dim3Int block,
                                          Dim3Int grid,
@@ -459,6 +894,11 @@ void GPUInterface::LaunchKernel(GPUFunction deviceFunction,
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::LaunchKernel\n");
 #endif                
+
+    beagle::TraceRange trace(GetTraceName(deviceFunction));
+
+    if (reportLaunches)
+        CountLaunch(deviceFunction, block, grid);
     
     SAFE_CUDA(cuCtxPushCurrent(cudaContext));
     
@@ -483,6 +923,9 @@ void GPUInterface::LaunchKernel(GPUFunction deviceFunction,
 
     va_end(parameters);
 
+    if (cudaDependenciesPending)
+        SynchronizeDevice();
+
     SAFE_CUDA(cuLaunchKernel(deviceFunction, grid.x, grid.y, grid.z,
                              block.x, block.y, block.z, 0,
                              cudaStreams[0], params, NULL));
@@ -510,6 +953,11 @@ void GPUInterface::LaunchKernelConcurrent(GPUFunction deviceFunction,
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::LaunchKernelConcurrent\n");
 #endif                
+
+    beagle::TraceRange trace(GetTraceName(deviceFunction));
+
+    if (reportLaunches)
+        CountLaunch(deviceFunction, block, grid);
     
     SAFE_CUDA(cuCtxPushCurrent(cudaContext));
     
@@ -548,6 +996,9 @@ void GPUInterface::LaunchKernelConcurrent(GPUFunction deviceFunction,
         
         SAFE_CUDA(cuEventRecord(cudaEvents[streamIndexMod], cudaStreams[streamIndexMod]));
     } else {
+        if (cudaDependenciesPending)
+            SynchronizeDevice();
+
         SAFE_CUDA(cuLaunchKernel(deviceFunction, grid.x, grid.y, grid.z,
                                  block.x, block.y, block.z, 0,
                                  cudaStreams[0], params, NULL));        
@@ -565,6 +1016,159 @@ void GPUInterface::LaunchKernelConcurrent(GPUFunction deviceFunction,
     
 }
 
+bool GPUInterface::BeginGraphCapture() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::BeginGraphCapture\n");
+#endif
+
+    ReleaseGraph();
+
+    bool capturing = false;
+
+#if CUDA_VERSION >= 10000
+    // only single-stream launches are captured, on the instance's own
+    // non-blocking stream
+    if (numStreams == 1) {
+        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+        // synchronous copies issued while capturing run immediately on the
+        // legacy default stream, so they must not overtake earlier work
+        SAFE_CUDA(cuStreamSynchronize(cudaStreams[0]));
+
+        // relaxed mode lets synchronous host-to-device copies issued
+        // while capturing (e.g. the multi-grid offsets) run immediately
+        SAFE_CUDA(cuStreamBeginCapture(cudaStreams[0], CU_STREAM_CAPTURE_MODE_RELAXED));
+
+        cudaCapturing = true;
+        capturing = true;
+
+        SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+    }
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::BeginGraphCapture\n");
+#endif
+
+    return capturing;
+}
+
+void GPUInterface::EndGraphCapture() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::EndGraphCapture\n");
+#endif
+
+#if CUDA_VERSION >= 10000
+    if (cudaCapturing) {
+        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+        CUgraph graph;
+        SAFE_CUDA(cuStreamEndCapture(cudaStreams[0], &graph));
+
+        cudaCapturing = false;
+
+#if CUDA_VERSION >= 11040
+        SAFE_CUDA(cuGraphInstantiateWithFlags(&cudaGraphExec, graph, 0));
+#else
+        SAFE_CUDA(cuGraphInstantiate(&cudaGraphExec, graph, NULL, NULL, 0));
+#endif
+        SAFE_CUDA(cuGraphDestroy(graph));
+
+        // nothing ran while capturing
+        SAFE_CUDA(cuGraphLaunch(cudaGraphExec, cudaStreams[0]));
+
+        SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+    }
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::EndGraphCapture\n");
+#endif
+}
+
+bool GPUInterface::HasGraph() {
+#if CUDA_VERSION >= 10000
+    return (cudaGraphExec != NULL);
+#else
+    return false;
+#endif
+}
+
+void GPUInterface::LaunchGraph() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::LaunchGraph\n");
+#endif
+
+#if CUDA_VERSION >= 10000
+    SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+    SAFE_CUDA(cuGraphLaunch(cudaGraphExec, cudaStreams[0]));
+
+    SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::LaunchGraph\n");
+#endif
+}
+
+void GPUInterface::ReleaseGraph() {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::ReleaseGraph\n");
+#endif
+
+#if CUDA_VERSION >= 10000
+    if (cudaGraphExec != NULL) {
+        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+        SAFE_CUDA(cuGraphExecDestroy(cudaGraphExec));
+        cudaGraphExec = NULL;
+
+        SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+    }
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::ReleaseGraph\n");
+#endif
+}
+
+int GPUInterface::GetStreamCount() {
+    return numStreams;
+}
+
+void GPUInterface::RecordStreamDependency(int streamIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::RecordStreamDependency\n");
+#endif
+
+    int streamIndexMod = streamIndex % numStreams;
+    SAFE_CUPP(cuEventRecord(cudaDependencyEvents[streamIndexMod], cudaStreams[streamIndexMod]));
+
+    // the first stream no longer follows everything launched so far
+    cudaDependenciesPending = true;
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::RecordStreamDependency\n");
+#endif
+}
+
+void GPUInterface::WaitForStreamDependency(int streamIndex,
+                                           int dependencyStreamIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::WaitForStreamDependency\n");
+#endif
+
+    int streamIndexMod = streamIndex % numStreams;
+    int dependencyIndexMod = dependencyStreamIndex % numStreams;
+    if (streamIndexMod != dependencyIndexMod)
+        SAFE_CUPP(cuStreamWaitEvent(cudaStreams[streamIndexMod], cudaDependencyEvents[dependencyIndexMod], 0));
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::WaitForStreamDependency\n");
+#endif
+}
+
 void* GPUInterface::MallocHost(size_t memSize) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::MallocHost\n");
@@ -622,6 +1226,7 @@ void* GPUInterface::AllocatePinnedHostMemory(size_t memSize, bool writeCombined,
         flags |= CU_MEMHOSTALLOC_DEVICEMAP;
 
     SAFE_CUPP(cuMemHostAlloc(&ptr, memSize, flags));
+    cudaHostAllocations.insert(ptr);
     
     
 #ifdef BEAGLE_DEBUG_VALUES
@@ -635,14 +1240,101 @@ void* GPUInterface::AllocatePinnedHostMemory(size_t memSize, bool writeCombined,
     return ptr;
 }
 
+void* GPUInterface::AllocateTransferMemory(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateTransferMemory\n");
+#endif
+
+    // page-locked, so that copies to and from it are truly asynchronous
+    void* ptr = AllocatePinnedHostMemory(memSize, false, false);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::AllocateTransferMemory\n");
+#endif
+
+    return ptr;
+}
+
+GPUPtr GPUInterface::AllocateMappedMemory(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateMappedMemory\n");
+#endif
+
+    void* hPtr = AllocatePinnedHostMemory(memSize, false, true);
+    GPUPtr dPtr = GetDeviceHostPointer(hPtr);
+    cudaMappedAllocations.insert(std::make_pair(dPtr, hPtr));
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateMappedMemory\n");
+#endif
+
+    return dPtr;
+}
+
+void* GPUInterface::MapMemory(GPUPtr dPtr, size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::MapMemory\n");
+#endif
+
+    // kernels still using the memory finish first
+    SynchronizeHost();
+
+    // dPtr may point into a mapped allocation
+    std::map<GPUPtr, void*>::iterator mapped = cudaMappedAllocations.upper_bound(dPtr);
+    assert(mapped != cudaMappedAllocations.begin());
+    --mapped;
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::MapMemory\n");
+#endif
+
+    return (char*) mapped->second + (dPtr - mapped->first);
+}
+
+const void* GPUInterface::MapMemoryForRead(GPUPtr dPtr, size_t memSize) {
+    return MapMemory(dPtr, memSize);
+}
+
+void GPUInterface::UnmapMemory(GPUPtr dPtr, void* hPtr) {
+    // mapped memory stays visible to kernels launched afterwards
+}
+
+void GPUInterface::ReserveMemoryPool(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::ReserveMemoryPool\n");
+#endif
+
+    if (dMemoryPool == (GPUPtr) NULL && memSize > 0) {
+        // not fatal: without a pool every buffer gets its own allocation
+        SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+        if (cuMemAlloc(&dMemoryPool, memSize) == CUDA_SUCCESS) {
+            memoryPool.reset(memSize, BEAGLE_MEMORY_POOL_ALIGNMENT);
+            CountAllocation(dMemoryPool, memSize);
+        } else
+            dMemoryPool = (GPUPtr) NULL;
+        SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::ReserveMemoryPool\n");
+#endif
+}
+
 GPUPtr GPUInterface::AllocateMemory(size_t memSize) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateMemory\n");
 #endif
     
     GPUPtr ptr;
-    
-    SAFE_CUPP(cuMemAlloc(&ptr, memSize));
+    size_t offset;
+
+    if (dMemoryPool != (GPUPtr) NULL && memoryPool.take(memSize, &offset)) {
+        ptr = dMemoryPool + offset;
+    } else {
+        SAFE_CUPP(cuMemAlloc(&ptr, memSize));
+        cudaAllocations.insert(ptr);
+        CountAllocation(ptr, memSize);
+    }
 
 #ifdef BEAGLE_DEBUG_VALUES
     fprintf(stderr, "Allocated GPU memory %llu to %llu.\n", (unsigned long long)ptr, (unsigned long long)(ptr + memSize));
@@ -663,6 +1355,8 @@ GPUPtr GPUInterface::AllocateRealMemory(size_t length) {
     GPUPtr ptr;
 
     SAFE_CUPP(cuMemAlloc(&ptr, SIZE_REAL * length));
+    cudaAllocations.insert(ptr);
+    CountAllocation(ptr, SIZE_REAL * length);
 
 #ifdef BEAGLE_DEBUG_VALUES
     fprintf(stderr, "Allocated GPU memory %llu to %llu.\n", (unsigned long long)ptr, (unsigned long long)(ptr + length));
@@ -683,6 +1377,8 @@ GPUPtr GPUInterface::AllocateIntMemory(size_t length) {
     GPUPtr ptr;
     
     SAFE_CUPP(cuMemAlloc(&ptr, SIZE_INT * length));
+    cudaAllocations.insert(ptr);
+    CountAllocation(ptr, SIZE_INT * length);
 
 #ifdef BEAGLE_DEBUG_VALUES
     fprintf(stderr, "Allocated GPU memory %llu to %llu.\n", (unsigned long long)ptr, (unsigned long long)(ptr + length));
@@ -730,7 +1426,12 @@ void GPUInterface::MemsetShort(GPUPtr dest,
     fprintf(stderr, "\t\t\tEntering GPUInterface::MemsetShort\n");
 #endif    
     
-    SAFE_CUPP(cuMemsetD16(dest, val, count));
+    // in order with the instance's stream, except while it is capturing
+    if (numStreams == 1 && !cudaCapturing) {
+        SAFE_CUPP(cuMemsetD16Async(dest, val, count, cudaStreams[0]));
+    } else {
+        SAFE_CUPP(cuMemsetD16(dest, val, count));
+    }
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemsetShort\n");
@@ -745,8 +1446,14 @@ void GPUInterface::MemcpyHostToDevice(GPUPtr dest,
     fprintf(stderr, "\t\t\tEntering GPUInterface::MemcpyHostToDevice\n");
 #endif    
     
-    // SAFE_CUPP(cuMemcpyHtoDAsync(dest, src, memSize, cudaStreams[0]));
-    SAFE_CUPP(cuMemcpyHtoD(dest, src, memSize));
+    if (numStreams == 1 && !cudaCapturing) {
+        // the legacy default stream does not wait for the non-blocking
+        // instance stream, so the copy is ordered on that stream instead
+        SAFE_CUPP(cuMemcpyHtoDAsync(dest, src, memSize, cudaStreams[0]));
+        SAFE_CUPP(cuStreamSynchronize(cudaStreams[0]));
+    } else {
+        SAFE_CUPP(cuMemcpyHtoD(dest, src, memSize));
+    }
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemcpyHostToDevice\n");
@@ -754,6 +1461,47 @@ void GPUInterface::MemcpyHostToDevice(GPUPtr dest,
     
 }
 
+void GPUInterface::MemcpyHostToDeviceAsync(GPUPtr dest,
+                                           const void* src,
+                                           size_t memSize,
+                                           int transferIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::MemcpyHostToDeviceAsync\n");
+#endif
+
+    SAFE_CUDA(cuCtxPushCurrent(cudaContext));
+
+    if (cudaTransferEvents[transferIndex] == NULL)
+        SAFE_CUDA(cuEventCreate(&cudaTransferEvents[transferIndex], CU_EVENT_DISABLE_TIMING));
+
+    // issued in order with the kernels, so earlier launches still reading
+    // dest are not overtaken; src must stay untouched until WaitForTransfer
+    if (cudaDependenciesPending)
+        SynchronizeDevice();
+
+    SAFE_CUDA(cuMemcpyHtoDAsync(dest, src, memSize, cudaStreams[0]));
+    SAFE_CUDA(cuEventRecord(cudaTransferEvents[transferIndex], cudaStreams[0]));
+
+    SAFE_CUDA(cuCtxPopCurrent(&cudaContext));
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemcpyHostToDeviceAsync\n");
+#endif
+}
+
+void GPUInterface::WaitForTransfer(int transferIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::WaitForTransfer\n");
+#endif
+
+    if (cudaTransferEvents[transferIndex] != NULL)
+        SAFE_CUPP(cuEventSynchronize(cudaTransferEvents[transferIndex]));
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::WaitForTransfer\n");
+#endif
+}
+
 void GPUInterface::MemcpyDeviceToHost(void* dest,
                                       const GPUPtr src,
                                       size_t memSize) {
@@ -761,7 +1509,12 @@ void GPUInterface::MemcpyDeviceToHost(void* dest,
     fprintf(stderr, "\t\t\tEntering GPUInterface::MemcpyDeviceToHost\n");
 #endif        
     
+    if (cudaDependenciesPending)
+        SynchronizeDevice();
+
     SAFE_CUPP(cuMemcpyDtoHAsync(dest, src, memSize, cudaStreams[0]));
+    // only a copy to pageable memory returns with the data in place
+    SAFE_CUPP(cuStreamSynchronize(cudaStreams[0]));
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemcpyDeviceToHost\n");
@@ -776,6 +1529,9 @@ void GPUInterface::MemcpyDeviceToDevice(GPUPtr dest,
     fprintf(stderr, "\t\t\tEntering GPUInterface::MemcpyDeviceToDevice\n");
 #endif    
     
+    if (cudaDependenciesPending)
+        SynchronizeDevice();
+
     SAFE_CUPP(cuMemcpyDtoDAsync(dest, src, memSize, cudaStreams[0]));
     
 #ifdef BEAGLE_DEBUG_FLOW
@@ -806,18 +1562,44 @@ void GPUInterface::FreePinnedHostMemory(void* hPtr) {
 #endif
     
     SAFE_CUPP(cuMemFreeHost(hPtr));
+    cudaHostAllocations.erase(hPtr);
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::FreePinnedHostMemory\n");
 #endif
 }
 
+void GPUInterface::FreeTransferMemory(void* hPtr) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::FreeTransferMemory\n");
+#endif
+
+    FreePinnedHostMemory(hPtr);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::FreeTransferMemory\n");
+#endif
+}
+
 void GPUInterface::FreeMemory(GPUPtr dPtr) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tEntering GPUInterface::FreeMemory\n");
 #endif
     
-    SAFE_CUPP(cuMemFree(dPtr));
+    std::map<GPUPtr, void*>::iterator mapped = cudaMappedAllocations.find(dPtr);
+    if (mapped != cudaMappedAllocations.end()) {
+        FreePinnedHostMemory(mapped->second);
+        cudaMappedAllocations.erase(mapped);
+        return;
+    }
+
+    // pooled sub-buffers go back to the pool, with dPtr below the pool
+    // wrapping around to an offset it never handed out
+    if (dMemoryPool == (GPUPtr) NULL || !memoryPool.give(dPtr - dMemoryPool)) {
+        SAFE_CUPP(cuMemFree(dPtr));
+        cudaAllocations.erase(dPtr);
+        CountFree(dPtr);
+    }
 
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::FreeMemory\n");
@@ -882,6 +1664,23 @@ bool GPUInterface::GetSupportsDoublePrecision(int deviceNumber) {
 	return (major >= 2 || (major >= 1 && minor >= 3));
 }
 
+bool GPUInterface::GetSupportsZeroCopy(int deviceNumber) {
+    CUdevice tmpCudaDevice;
+    SAFE_CUDA(cuDeviceGet(&tmpCudaDevice, (*resourceMap)[deviceNumber]));
+
+    int canMapHostMemory = 0;
+    int integrated = 0;
+    int hostPageTables = 0;
+    SAFE_CUDA(cuDeviceGetAttribute(&canMapHostMemory, CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY, tmpCudaDevice));
+    SAFE_CUDA(cuDeviceGetAttribute(&integrated, CU_DEVICE_ATTRIBUTE_INTEGRATED, tmpCudaDevice));
+#if CUDA_VERSION >= 10000
+    // e.g. Grace Hopper, where the GPU reads host memory coherently
+    SAFE_CUDA(cuDeviceGetAttribute(&hostPageTables, CU_DEVICE_ATTRIBUTE_PAGEABLE_MEMORY_ACCESS_USES_HOST_PAGE_TABLES, tmpCudaDevice));
+#endif
+
+    return (canMapHostMemory && (integrated || hostPageTables));
+}
+
 void GPUInterface::GetDeviceDescription(int deviceNumber,
                                         char* deviceDescription) {    
 #ifdef BEAGLE_DEBUG_FLOW
@@ -930,12 +1729,12 @@ void GPUInterface::PrintfDeviceInt(GPUPtr dPtr,
     free(hPtr);
 }
 
-long GPUInterface::GetDeviceTypeFlag(int deviceNumber) {       
+long long GPUInterface::GetDeviceTypeFlag(int deviceNumber) {       
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tEntering GPUInterface::GetDeviceTypeFlag\n");
 #endif
 
-    long deviceTypeFlag = BEAGLE_FLAG_PROCESSOR_GPU;
+    long long deviceTypeFlag = BEAGLE_FLAG_PROCESSOR_GPU;
 
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::GetDeviceTypeFlag\n");
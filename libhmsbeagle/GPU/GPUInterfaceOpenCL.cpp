@@ -31,9 +31,18 @@
 #include <cassert>
 #include <cstdarg>
 #include <cmath>
+#include <algorithm>
 #include <map>
+#include <vector>
+
+#ifdef BEAGLE_RUNTIME_KERNELS
+#include <chrono>
+#include <mutex>
+#include <string>
+#endif
 
 #include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/BeagleTrace.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
 #include "libhmsbeagle/GPU/GPUImplHelper.h"
 #include "libhmsbeagle/GPU/GPUInterface.h"
@@ -62,6 +71,70 @@
 
 namespace opencl_device {
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+// Program binaries of kernels built at runtime, keyed by device and definitions
+static std::map<std::string, std::vector<unsigned char> > runtimeKernelCache;
+static std::mutex runtimeKernelCacheMutex;
+#endif
+
+static void getProgramBuildOptions(BeagleDeviceImplementationCodes deviceCode,
+                                   char* buildDefs) {
+    strcpy(buildDefs, "-w -D FW_OPENCL -D OPENCL_KERNEL_BUILD ");
+#ifdef DLS_MACOS
+    strcat(buildDefs, "-D DLS_MACOS ");
+#elif defined(FW_OPENCL_PROFILING)
+	strcat(buildDefs, "-profiling -s \"C:\\developer\\beagle-lib\\project\\beagle-vs-2012\\x64\\Release\\kernels.cl\" ");
+#endif
+
+    if (deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_CPU ||
+        deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_MIC ||
+        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU ||
+        deviceCode == BEAGLE_OPENCL_DEVICE_GENERIC_CPU) {
+        strcat(buildDefs, "-D FW_OPENCL_CPU");
+    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_CPU) {
+        strcat(buildDefs, "-D FW_OPENCL_CPU -D FW_OPENCL_APPLECPU");
+    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_AMD_GPU) {
+        strcat(buildDefs, "-D FW_OPENCL_AMDGPU");
+    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_AMD_GPU) {
+        strcat(buildDefs, "-D FW_OPENCL_AMDGPU -D FW_OPENCL_APPLEAMDGPU");
+    }  else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_INTEL_GPU) {
+        strcat(buildDefs, "-D FW_OPENCL_INTELGPU -D FW_OPENCL_APPLEINTELGPU");
+    }
+}
+
+// Binary of a built program, for the runtime and on-disk caches
+static bool getProgramBinary(cl_program program,
+                             std::vector<unsigned char>* binary) {
+    size_t binarySize = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL) != CL_SUCCESS ||
+        binarySize == 0)
+        return false;
+
+    binary->resize(binarySize);
+    unsigned char* binaryPtr = &(*binary)[0];
+    return (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binaryPtr, NULL) == CL_SUCCESS);
+}
+
+// Builds a program from a cached binary, or returns NULL if the device rejects it
+static cl_program buildProgramFromBinary(cl_context context,
+                                         cl_device_id device,
+                                         const std::vector<unsigned char>& binary,
+                                         const char* buildDefs) {
+    int err;
+    size_t binarySize = binary.size();
+    const unsigned char* binaryPtr = &binary[0];
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryPtr, NULL, &err);
+    if (err != CL_SUCCESS)
+        return NULL;
+
+    if (clBuildProgram(program, 0, NULL, buildDefs, NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
 GPUInterface::GPUInterface() {    
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::GPUInterface\n");
@@ -74,7 +147,17 @@ GPUInterface::GPUInterface() {
     openClCommandQueues = NULL;
     openClProgram = NULL;
 
+    for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++)
+        openClTransferEvents[i] = NULL;
+
+    dMemoryPool = NULL;
+
     supportDoublePrecision = true;
+
+    const char* report = getenv("BEAGLE_GPU_REPORT");
+    reportLaunches = (report != NULL && report[0] != '\0');
+    deviceMemoryBytes = 0;
+    deviceMemoryPeak = 0;
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::GPUInterface\n");
@@ -87,10 +170,21 @@ GPUInterface::~GPUInterface() {
 #endif    
     
     // TODO: cleanup mem objects, kernels
+
+    if (reportLaunches && openClDeviceId != NULL)
+        PrintLaunchReport();
+
+    for (int i = 0; i < BEAGLE_TRANSFER_BUFFER_COUNT; i++) {
+        if (openClTransferEvents[i] != NULL)
+            SAFE_CL(clReleaseEvent(openClTransferEvents[i]));
+    }
     
     if (openClProgram != NULL)
         SAFE_CL(clReleaseProgram(openClProgram));
 
+    if (dMemoryPool != NULL)
+        SAFE_CL(clReleaseMemObject(dMemoryPool));
+
     if (openClCommandQueues != NULL) {
         for (int i=0; i < BEAGLE_STREAM_COUNT; i++) {
             SAFE_CL(clReleaseCommandQueue(openClCommandQueues[i]));
@@ -211,7 +305,9 @@ int GPUInterface::GetDeviceCount() {
 }
 
 void GPUInterface::InitializeKernelResource(int paddedStateCount,
-                                            bool doublePrecision) {
+                                            bool doublePrecision,
+                                            bool halfPartials,
+                                            bool tuneKernels) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::InitializeKernelResource\n");
 #endif        
@@ -226,7 +322,8 @@ void GPUInterface::InitializeKernelResource(int paddedStateCount,
     BeagleDeviceImplementationCodes deviceCode = GetDeviceImplementationCode(-1);
     if (deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_CPU || 
         deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_MIC ||
-        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU) {
+        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU ||
+        deviceCode == BEAGLE_OPENCL_DEVICE_GENERIC_CPU) {
         CPUImpl = true;
     } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_CPU) {
         AppleCPUImpl = true;
@@ -294,18 +391,197 @@ void GPUInterface::InitializeKernelResource(int paddedStateCount,
         }
     }
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+    if (paddedStateCount != 4) {
+        KernelResource* runtimeResource = NULL;
+        if (tuneKernels && !CPUImpl && !AppleCPUImpl) {
+            runtimeResource = TuneRuntimeKernelResource(paddedStateCount, doublePrecision,
+                                                        getKernelTuningCachePath().c_str());
+        } else if (kernelResource == NULL) {
+            runtimeResource = createRuntimeKernelResource(paddedStateCount, doublePrecision);
+            if (AppleCPUImpl) {
+                runtimeResource->multiplyBlockSize = (doublePrecision ? MULTIPLY_BLOCK_SIZE_DP_APPLECPU :
+                                                                        MULTIPLY_BLOCK_SIZE_SP_APPLECPU);
+            }
+        }
+
+#ifdef BEAGLE_HALF_PARTIALS
+        // only kernels built here store partials as half
+        if (halfPartials && !CPUImpl && !AppleCPUImpl) {
+            if (runtimeResource == NULL && kernelResource != NULL)
+                runtimeResource = new KernelResource(*kernelResource, NULL);
+            if (runtimeResource != NULL)
+                runtimeResource->halfPartials = 1;
+        }
+#endif
+
+        if (runtimeResource != NULL) {
+            delete kernelResource;
+            kernelResource = runtimeResource;
+
+            std::string definitions = getRuntimeKernelDefinitions(*kernelResource, doublePrecision);
+            char deviceKey[32];
+            snprintf(deviceKey, sizeof(deviceKey), "%p\n", (void*) openClDeviceId);
+            runtimeKernelKey = deviceKey + definitions;
+            runtimeKernelSource = definitions + KERNELS_SOURCE_DEFS + KERNELS_SOURCE_ALL + KERNELS_SOURCE_X;
+            kernelResource->kernelCode = (char*) runtimeKernelSource.c_str();
+        }
+    }
+#endif
+
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::InitializeKernelResource\n");
 #endif            
 }
 
+#ifdef BEAGLE_RUNTIME_KERNELS
+KernelResource* GPUInterface::TuneRuntimeKernelResource(int paddedStateCount,
+                                                        bool doublePrecision,
+                                                        const char* cachePath) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::TuneRuntimeKernelResource\n");
+#endif
+
+    char deviceName[256];
+    SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL));
+    std::string key = getKernelTuningKey("OpenCL", deviceName, paddedStateCount, doublePrecision);
+
+    // start from the precompiled sizes where there are any
+    KernelResource* resource;
+    if (kernelResource != NULL)
+        resource = new KernelResource(*kernelResource, NULL);
+    else
+        resource = createRuntimeKernelResource(paddedStateCount, doublePrecision);
+
+    if (!readKernelTuning(cachePath, key, resource)) {
+        size_t maxWorkGroupSize;
+        cl_ulong localMemorySize;
+        SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE,
+                                sizeof(maxWorkGroupSize), &maxWorkGroupSize, NULL));
+        SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_LOCAL_MEM_SIZE,
+                                sizeof(localMemorySize), &localMemorySize, NULL));
+
+        tuneRuntimeKernelResource(resource, doublePrecision, (int) maxWorkGroupSize, (size_t) localMemorySize,
+                                  [this, doublePrecision](const KernelResource& candidate) {
+                                      return TimeRuntimeKernels(candidate, doublePrecision);
+                                  });
+        writeKernelTuning(cachePath, key, *resource);
+    }
+
+    // precompiled kernels already built with the tuned sizes are kept
+    if (kernelResource != NULL &&
+        kernelResource->patternBlockSize == resource->patternBlockSize &&
+        kernelResource->blockPeelingSize == resource->blockPeelingSize) {
+        delete resource;
+        resource = NULL;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tLeaving  GPUInterface::TuneRuntimeKernelResource\n");
+#endif
+
+    return resource;
+}
+
+double GPUInterface::TimeRuntimeKernels(const KernelResource& resource,
+                                        bool doublePrecision) {
+    int err;
+
+    std::string definitions = getRuntimeKernelDefinitions(resource, doublePrecision);
+    std::string source = definitions + KERNELS_SOURCE_DEFS + KERNELS_SOURCE_ALL + KERNELS_SOURCE_X;
+    const char* sourcePtr = source.c_str();
+
+    cl_program program = clCreateProgramWithSource(openClContext, 1, &sourcePtr, NULL, &err);
+    if (err != CL_SUCCESS)
+        return -1.0;
+
+    char buildDefs[1024];
+    getProgramBuildOptions(GetDeviceImplementationCode(-1), buildDefs);
+
+    cl_kernel kernel = NULL;
+    if (clBuildProgram(program, 0, NULL, buildDefs, NULL, NULL) == CL_SUCCESS)
+        kernel = clCreateKernel(program, "kernelPartialsPartialsNoScale", &err);
+    if (kernel == NULL) {
+        clReleaseProgram(program);
+        return -1.0;
+    }
+
+    // the winning candidate is rebuilt from this binary in SetDevice
+    std::vector<unsigned char> binary;
+    if (getProgramBinary(program, &binary)) {
+        char deviceKey[32];
+        snprintf(deviceKey, sizeof(deviceKey), "%p\n", (void*) openClDeviceId);
+        std::lock_guard<std::mutex> lock(runtimeKernelCacheMutex);
+        runtimeKernelCache.insert(std::make_pair(deviceKey + definitions, binary));
+    }
+
+    unsigned int stateCount = resource.paddedStateCount;
+    unsigned int patternCount = BEAGLE_TUNING_PATTERN_COUNT;
+    unsigned int categoryCount = BEAGLE_TUNING_CATEGORY_COUNT;
+    size_t realSize = (doublePrecision ? sizeof(double) : sizeof(float));
+    size_t partialsSize = realSize * stateCount * patternCount * categoryCount;
+    size_t matricesSize = realSize * stateCount * stateCount * categoryCount;
+    std::vector<unsigned char> zeros(partialsSize, 0);
+
+    cl_mem buffers[5] = { NULL, NULL, NULL, NULL, NULL };
+    bool allocated = true;
+    for (int i = 0; i < 5 && allocated; i++) {
+        size_t size = (i < 3 ? partialsSize : matricesSize);
+        buffers[i] = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, size, NULL, &err);
+        allocated = (err == CL_SUCCESS &&
+                     clEnqueueWriteBuffer(openClCommandQueues[0], buffers[i], CL_TRUE, 0, size,
+                                          &zeros[0], 0, NULL, NULL) == CL_SUCCESS);
+    }
+
+    double time = -1.0;
+    if (allocated) {
+        for (int i = 0; i < 5; i++)
+            clSetKernelArg(kernel, i, sizeof(cl_mem), &buffers[i]);
+        clSetKernelArg(kernel, 5, sizeof(unsigned int), &patternCount);
+
+        size_t localWorkSize[2] = { stateCount, (size_t) resource.patternBlockSize };
+        size_t globalWorkSize[2] = { stateCount * ((patternCount + resource.patternBlockSize - 1) /
+                                                   resource.patternBlockSize),
+                                     (size_t) resource.patternBlockSize * categoryCount };
+
+        // first launch warms up the program
+        err = clEnqueueNDRangeKernel(openClCommandQueues[0], kernel, 2, NULL,
+                                     globalWorkSize, localWorkSize, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = clFinish(openClCommandQueues[0]);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BEAGLE_TUNING_REPEAT_COUNT && err == CL_SUCCESS; i++) {
+            err = clEnqueueNDRangeKernel(openClCommandQueues[0], kernel, 2, NULL,
+                                         globalWorkSize, localWorkSize, 0, NULL, NULL);
+        }
+        if (err == CL_SUCCESS)
+            err = clFinish(openClCommandQueues[0]);
+        std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+        if (err == CL_SUCCESS)
+            time = std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (buffers[i] != NULL)
+            clReleaseMemObject(buffers[i]);
+    }
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+
+    return time;
+}
+#endif
+
 void GPUInterface::SetDevice(int deviceNumber,
                              int paddedStateCount,
                              int categoryCount,
                              int paddedPatternCount,
                              int unpaddedPatternCount,
                              int tipCount,
-                             long flags) {
+                             long long flags,
+                             bool halfPartials) {
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::SetDevice\n");
@@ -334,7 +610,8 @@ void GPUInterface::SetDevice(int deviceNumber,
         SAFE_CL(err);
     }
 
-    InitializeKernelResource(paddedStateCount, flags & BEAGLE_FLAG_PRECISION_DOUBLE);
+    InitializeKernelResource(paddedStateCount, flags & BEAGLE_FLAG_PRECISION_DOUBLE, halfPartials,
+                             (flags & BEAGLE_FLAG_KERNEL_TUNING) != 0);
 
     if (!kernelResource) {
         fprintf(stderr,"Critical error: unable to find kernel code for %d states.\n",paddedStateCount);
@@ -346,6 +623,13 @@ void GPUInterface::SetDevice(int deviceNumber,
     kernelResource->unpaddedPatternCount = unpaddedPatternCount;
     kernelResource->flags = flags;
 
+    char buildDefs[1024];
+    getProgramBuildOptions(GetDeviceImplementationCode(deviceNumber), buildDefs);
+
+    openClProgram = NULL;
+    bool programBuilt = false;
+    err = CL_SUCCESS;
+
 #if defined(FW_OPENCL_BINARY) || defined(FW_OPENCL_PROFILING)
     //=========================================================================================================
     FILE *fp = NULL;
@@ -389,9 +673,43 @@ void GPUInterface::SetDevice(int deviceNumber,
     #endif
 	//=========================================================================================================
 #else
-	openClProgram = clCreateProgramWithSource(openClContext, 1,
-		                                      (const char**) &kernelResource->kernelCode, NULL,
-		                                      &err);
+    std::vector<unsigned char> binary;
+# ifdef BEAGLE_RUNTIME_KERNELS
+    bool runtimeKernelCached = false;
+    if (!runtimeKernelKey.empty()) {
+        std::lock_guard<std::mutex> lock(runtimeKernelCacheMutex);
+        std::map<std::string, std::vector<unsigned char> >::iterator cached =
+            runtimeKernelCache.find(runtimeKernelKey);
+        if (cached != runtimeKernelCache.end()) {
+            binary = cached->second;
+            runtimeKernelCached = true;
+        }
+    }
+    if (runtimeKernelCached)
+        openClProgram = buildProgramFromBinary(openClContext, openClDeviceId, binary, buildDefs);
+# endif
+
+    // compiled programs are shared through the disk cache by later instances and processes
+    std::string binaryCacheKey;
+    const char* binaryCachePath = getKernelBinaryCachePath();
+    if (openClProgram == NULL && binaryCachePath != NULL) {
+        char deviceName[256];
+        char driverVersion[256];
+        SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL));
+        SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL));
+        binaryCacheKey = getKernelBinaryKey("OpenCL", deviceName, driverVersion, kernelResource->paddedStateCount,
+                                            (flags & BEAGLE_FLAG_PRECISION_DOUBLE) != 0,
+                                            kernelResource->kernelCode, buildDefs);
+        if (readKernelBinary(binaryCachePath, binaryCacheKey, &binary))
+            openClProgram = buildProgramFromBinary(openClContext, openClDeviceId, binary, buildDefs);
+    }
+
+    programBuilt = (openClProgram != NULL);
+    if (!programBuilt) {
+	    openClProgram = clCreateProgramWithSource(openClContext, 1,
+		                                          (const char**) &kernelResource->kernelCode, NULL,
+		                                          &err);
+    }
 #endif
 
     SAFE_CL(err);
@@ -400,41 +718,38 @@ void GPUInterface::SetDevice(int deviceNumber,
         exit(-1);
     }
 
-    char buildDefs[1024] = "-w -D FW_OPENCL -D OPENCL_KERNEL_BUILD ";
-#ifdef DLS_MACOS
-    strcat(buildDefs, "-D DLS_MACOS ");
-#elif defined(FW_OPENCL_PROFILING)
-	strcat(buildDefs, "-profiling -s \"C:\\developer\\beagle-lib\\project\\beagle-vs-2012\\x64\\Release\\kernels.cl\" ");
-#endif
-
-    BeagleDeviceImplementationCodes deviceCode = GetDeviceImplementationCode(deviceNumber);
-    if (deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_CPU ||
-        deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_MIC ||
-        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU) {
-        strcat(buildDefs, "-D FW_OPENCL_CPU");
-    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_CPU) {
-        strcat(buildDefs, "-D FW_OPENCL_CPU -D FW_OPENCL_APPLECPU");
-    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_AMD_GPU) {
-        strcat(buildDefs, "-D FW_OPENCL_AMDGPU");
-    } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_AMD_GPU) {
-        strcat(buildDefs, "-D FW_OPENCL_AMDGPU -D FW_OPENCL_APPLEAMDGPU");
-    }  else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_INTEL_GPU) {
-        strcat(buildDefs, "-D FW_OPENCL_INTELGPU -D FW_OPENCL_APPLEINTELGPU");
-    }
+    if (!programBuilt) {
+        err = clBuildProgram(openClProgram, 0, NULL, buildDefs, NULL, NULL);
+        if (err != CL_SUCCESS) {
+            size_t len;
+            char buffer[16384];
+            
+            fprintf(stderr, "OpenCL error: Failed to build kernels\n");
+            
+            clGetProgramBuildInfo(openClProgram, openClDeviceId, CL_PROGRAM_BUILD_LOG,
+                                  sizeof(buffer), buffer, &len);
+            
+            fprintf(stderr, "%s\n", buffer);
+            
+            exit(-1);
+        }
 
-    err = clBuildProgram(openClProgram, 0, NULL, buildDefs, NULL, NULL);
-    if (err != CL_SUCCESS) {
-        size_t len;
-        char buffer[16384];
-        
-        fprintf(stderr, "OpenCL error: Failed to build kernels\n");
-        
-        clGetProgramBuildInfo(openClProgram, openClDeviceId, CL_PROGRAM_BUILD_LOG,
-                              sizeof(buffer), buffer, &len);
-        
-        fprintf(stderr, "%s\n", buffer);
-        
-        exit(-1);
+#if !defined(FW_OPENCL_BINARY) && !defined(FW_OPENCL_PROFILING)
+        bool cacheBinary = !binaryCacheKey.empty();
+# ifdef BEAGLE_RUNTIME_KERNELS
+        cacheBinary = cacheBinary || !runtimeKernelKey.empty();
+# endif
+        if (cacheBinary && getProgramBinary(openClProgram, &binary)) {
+# ifdef BEAGLE_RUNTIME_KERNELS
+            if (!runtimeKernelKey.empty()) {
+                std::lock_guard<std::mutex> lock(runtimeKernelCacheMutex);
+                runtimeKernelCache.insert(std::make_pair(runtimeKernelKey, binary));
+            }
+# endif
+            if (!binaryCacheKey.empty())
+                writeKernelBinary(binaryCachePath, binaryCacheKey, binary);
+        }
+#endif
     }
 
 // TODO unloading compiler to free resources is causing seg fault for Intel and NVIDIA platforms
@@ -523,6 +838,8 @@ GPUFunction GPUInterface::GetFunction(const char* functionName) {
         exit(-1);
     }
     
+    functionNames[openClFunction] = functionName;
+    
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::GetFunction\n");
 #endif                
@@ -530,6 +847,77 @@ GPUFunction GPUInterface::GetFunction(const char* functionName) {
     return openClFunction;
 }
 
+const char* GPUInterface::GetTraceName(GPUFunction deviceFunction) {
+    if (!beagle::getTraceSinks().enabled)
+        return NULL;
+    std::map<GPUFunction, std::string>::const_iterator name = functionNames.find(deviceFunction);
+    return (name != functionNames.end() ? name->second.c_str() : "kernel");
+}
+
+bool GPUInterface::LaunchShape::operator<(const LaunchShape& other) const {
+    const unsigned int shape[6] = {grid.x, grid.y, grid.z, block.x, block.y, block.z};
+    const unsigned int otherShape[6] = {other.grid.x, other.grid.y, other.grid.z,
+                                        other.block.x, other.block.y, other.block.z};
+    return std::lexicographical_compare(shape, shape + 6, otherShape, otherShape + 6);
+}
+
+void GPUInterface::CountLaunch(GPUFunction deviceFunction,
+                               Dim3Int block,
+                               Dim3Int grid) {
+    LaunchShape shape;
+    shape.grid = grid;
+    shape.block = block;
+    launchCounts[deviceFunction][shape]++;
+}
+
+void GPUInterface::CountAllocation(GPUPtr dPtr,
+                                   size_t memSize) {
+    deviceAllocations[dPtr] = memSize;
+    deviceMemoryBytes += memSize;
+    deviceMemoryPeak = std::max(deviceMemoryPeak, deviceMemoryBytes);
+}
+
+void GPUInterface::CountFree(GPUPtr dPtr) {
+    std::map<GPUPtr, size_t>::iterator allocation = deviceAllocations.find(dPtr);
+    if (allocation != deviceAllocations.end()) {
+        deviceMemoryBytes -= allocation->second;
+        deviceAllocations.erase(allocation);
+    }
+}
+
+void GPUInterface::PrintLaunchReport() {
+    // OpenCL reports neither the registers of a kernel nor its resident work-groups
+    // per compute unit, so only the local memory of each kernel is given
+    cl_uint computeUnits = 0;
+    SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL));
+
+    fprintf(stderr, "BEAGLE GPU report: %u compute units\n", computeUnits);
+    fprintf(stderr, "  %-44s %10s %16s %12s %5s %7s %9s %5s\n", "kernel", "launches", "grid", "block",
+            "regs", "shared", "occupancy", "fill");
+    for (std::map<GPUFunction, std::map<LaunchShape, long long> >::const_iterator function = launchCounts.begin();
+         function != launchCounts.end(); ++function) {
+        cl_ulong localBytes = 0;
+        SAFE_CL(clGetKernelWorkGroupInfo(function->first, openClDeviceId, CL_KERNEL_LOCAL_MEM_SIZE,
+                                         sizeof(cl_ulong), &localBytes, NULL));
+        std::map<GPUFunction, std::string>::const_iterator name = functionNames.find(function->first);
+
+        for (std::map<LaunchShape, long long>::const_iterator shape = function->second.begin();
+             shape != function->second.end(); ++shape) {
+            const Dim3Int& grid = shape->first.grid;
+            const Dim3Int& block = shape->first.block;
+            char gridText[32];
+            char blockText[32];
+            snprintf(gridText, sizeof(gridText), "%ux%ux%u", grid.x, grid.y, grid.z);
+            snprintf(blockText, sizeof(blockText), "%ux%ux%u", block.x, block.y, block.z);
+            fprintf(stderr, "  %-44s %10lld %16s %12s %5s %7lu %9s %5s\n",
+                    (name != functionNames.end() ? name->second.c_str() : "kernel"), shape->second,
+                    gridText, blockText, "-", (unsigned long) localBytes, "-", "-");
+        }
+    }
+    fprintf(stderr, "  device memory: peak %.1f MB, %.1f MB held at release\n",
+            deviceMemoryPeak / 1048576.0, deviceMemoryBytes / 1048576.0);
+}
+
 void GPUInterface::LaunchKernel(GPUFunction deviceFunction,
                                 Dim3Int block,
                                 Dim3Int grid,
@@ -539,6 +927,11 @@ void GPUInterface::LaunchKernel(GPUFunction deviceFunction,
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::LaunchKernel\n");
 #endif                
+
+    beagle::TraceRange trace(GetTraceName(deviceFunction));
+
+    if (reportLaunches)
+        CountLaunch(deviceFunction, block, grid);
     
     va_list parameters;
     va_start(parameters, totalParameterCount);  
@@ -602,6 +995,11 @@ void GPUInterface::LaunchKernelConcurrent(GPUFunction deviceFunction,
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::LaunchKernel\n");
 #endif                
+
+    beagle::TraceRange trace(GetTraceName(deviceFunction));
+
+    if (reportLaunches)
+        CountLaunch(deviceFunction, block, grid);
     
     va_list parameters;
     va_start(parameters, totalParameterCount);  
@@ -753,6 +1151,39 @@ void* GPUInterface::AllocatePinnedHostMemory(size_t memSize, bool writeCombined,
    return deviceBuffer;
 }
 
+void* GPUInterface::AllocateTransferMemory(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateTransferMemory\n");
+#endif
+
+    // pinned allocations are buffer objects here, not host pointers
+    void* ptr = malloc(memSize);
+
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateTransferMemory\n");
+#endif
+
+    return ptr;
+}
+
+GPUPtr GPUInterface::AllocateMappedMemory(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateMappedMemory\n");
+#endif
+
+    // host-side storage the device uses in place on unified memory
+    int err;
+    GPUPtr deviceBuffer = clCreateBuffer(openClContext, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                         memSize, NULL, &err);
+    SAFE_CL(err);
+
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateMappedMemory\n");
+#endif
+
+    return deviceBuffer;
+}
+
 void* GPUInterface::MapMemory(GPUPtr dPtr, size_t memSize) {
     int err;
     void* hostPtr = clEnqueueMapBuffer(openClCommandQueues[0], dPtr, CL_TRUE,
@@ -762,6 +1193,15 @@ void* GPUInterface::MapMemory(GPUPtr dPtr, size_t memSize) {
     return hostPtr;
 }
 
+const void* GPUInterface::MapMemoryForRead(GPUPtr dPtr, size_t memSize) {
+    int err;
+    void* hostPtr = clEnqueueMapBuffer(openClCommandQueues[0], dPtr, CL_TRUE,
+                                        CL_MAP_READ, 0, memSize, 0, NULL, NULL, &err);
+    SAFE_CL(err);
+
+    return hostPtr;
+}
+
 void GPUInterface::UnmapMemory(GPUPtr dPtr, void* hPtr) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::UnmapMemory\n");
@@ -774,16 +1214,57 @@ void GPUInterface::UnmapMemory(GPUPtr dPtr, void* hPtr) {
 #endif
 }
 
+void GPUInterface::ReserveMemoryPool(size_t memSize) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\t\tEntering GPUInterface::ReserveMemoryPool\n");
+#endif
+
+#ifndef FW_OPENCL_ALTERA // sub-buffers there alias their parent
+    if (dMemoryPool == NULL && memSize > 0) {
+        cl_uint baseAlign;
+        SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &baseAlign, NULL));
+        size_t alignment = baseAlign / 8; // convert bits to bytes
+        if (alignment < BEAGLE_MEMORY_POOL_ALIGNMENT)
+            alignment = BEAGLE_MEMORY_POOL_ALIGNMENT;
+
+        // not fatal: without a pool every buffer gets its own allocation
+        int err;
+        dMemoryPool = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, memSize, NULL, &err);
+        if (err == CL_SUCCESS) {
+            memoryPool.reset(memSize, alignment);
+            CountAllocation(dMemoryPool, memSize);
+        } else
+            dMemoryPool = NULL;
+    }
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::ReserveMemoryPool\n");
+#endif
+}
+
 GPUPtr GPUInterface::AllocateMemory(size_t memSize) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tEntering GPUInterface::AllocateMemory\n");
 #endif
     
     GPUPtr data;
+    size_t offset;
     
     int err;
-    data = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, memSize, NULL, &err);
-    SAFE_CL(err);
+    if (dMemoryPool != NULL && memoryPool.take(memSize, &offset)) {
+        cl_buffer_region dPtrRegion;
+        dPtrRegion.origin = offset;
+        dPtrRegion.size = memSize;
+
+        data = clCreateSubBuffer(dMemoryPool, 0, CL_BUFFER_CREATE_TYPE_REGION, &dPtrRegion, &err);
+        SAFE_CL(err);
+        openClPoolBuffers[data] = offset;
+    } else {
+        data = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, memSize, NULL, &err);
+        SAFE_CL(err);
+        CountAllocation(data, memSize);
+    }
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateMemory\n");
@@ -803,6 +1284,7 @@ GPUPtr GPUInterface::AllocateRealMemory(size_t length) {
     data = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, SIZE_REAL * length, NULL,
                           &err);
     SAFE_CL(err);
+    CountAllocation(data, SIZE_REAL * length);
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateRealMemory\n");
@@ -822,6 +1304,7 @@ GPUPtr GPUInterface::AllocateIntMemory(size_t length) {
     data = clCreateBuffer(openClContext, CL_MEM_READ_WRITE, SIZE_INT * length, NULL,
                           &err);
     SAFE_CL(err);
+    CountAllocation(data, SIZE_INT * length);
 
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tLeaving  GPUInterface::AllocateIntMemory\n");
@@ -848,7 +1331,20 @@ GPUPtr GPUInterface::CreateSubPointer(GPUPtr dPtr,
     SAFE_CL(clGetDeviceInfo(openClDeviceId, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL));
     SAFE_CL(clGetPlatformInfo(platform, CL_PLATFORM_VENDOR, param_size, param_value, NULL));
 
-    if (strcmp(param_value, "NVIDIA Corporation") != 0 || offset != 0) {    
+    // sub-buffers cannot be nested, so pooled buffers are cut from the pool
+    std::map<GPUPtr, size_t>::iterator pooled = openClPoolBuffers.find(dPtr);
+
+    if (pooled != openClPoolBuffers.end() && offset != 0) {
+        cl_buffer_region dPtrRegion;
+        dPtrRegion.origin = pooled->second + offset;
+        dPtrRegion.size = size;
+
+        int err;
+        subPtr = clCreateSubBuffer(dMemoryPool, 0, CL_BUFFER_CREATE_TYPE_REGION, &dPtrRegion, &err);
+        SAFE_CL(err);
+    } else if (pooled != openClPoolBuffers.end()) {
+        subPtr = dPtr;
+    } else if (strcmp(param_value, "NVIDIA Corporation") != 0 || offset != 0) {    
         cl_buffer_region dPtrRegion;
         dPtrRegion.origin = offset;
         dPtrRegion.size = size;
@@ -898,17 +1394,22 @@ size_t GPUInterface::AlignMemOffset(size_t offset) {
 void GPUInterface::MemsetShort(GPUPtr dest,
                                unsigned short val,
                                size_t count) {
-    assert(0); // TODO: write function
-//#ifdef BEAGLE_DEBUG_FLOW
-//    fprintf(stderr, "\t\t\tEntering GPUInterface::MemsetShort\n");
-//#endif    
-//    
-//    SAFE_CUPP(cuMemsetD16(dest, val, count));
-//    
-//#ifdef BEAGLE_DEBUG_FLOW
-//    fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemsetShort\n");
-//#endif    
-    
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::MemsetShort\n");
+#endif    
+
+#ifdef CL_VERSION_1_2
+    SAFE_CL(clEnqueueFillBuffer(openClCommandQueues[0], dest, &val, sizeof(unsigned short), 0,
+                                sizeof(unsigned short) * count, 0, NULL, NULL));
+#else
+    std::vector<unsigned short> values(count, val);
+    SAFE_CL(clEnqueueWriteBuffer(openClCommandQueues[0], dest, CL_TRUE, 0,
+                                 sizeof(unsigned short) * count, &values[0], 0, NULL, NULL));
+#endif
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemsetShort\n");
+#endif    
 }
 
 
@@ -927,6 +1428,41 @@ void GPUInterface::MemcpyHostToDevice(GPUPtr dest,
 #endif    
 }
 
+void GPUInterface::MemcpyHostToDeviceAsync(GPUPtr dest,
+                                           const void* src,
+                                           size_t memSize,
+                                           int transferIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::MemcpyHostToDeviceAsync\n");
+#endif
+
+    if (openClTransferEvents[transferIndex] != NULL)
+        SAFE_CL(clReleaseEvent(openClTransferEvents[transferIndex]));
+
+    SAFE_CL(clEnqueueWriteBuffer(openClCommandQueues[0], dest, CL_FALSE, 0, memSize, src, 0,
+                                 NULL, &openClTransferEvents[transferIndex]));
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::MemcpyHostToDeviceAsync\n");
+#endif
+}
+
+void GPUInterface::WaitForTransfer(int transferIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tEntering GPUInterface::WaitForTransfer\n");
+#endif
+
+    if (openClTransferEvents[transferIndex] != NULL) {
+        SAFE_CL(clWaitForEvents(1, &openClTransferEvents[transferIndex]));
+        SAFE_CL(clReleaseEvent(openClTransferEvents[transferIndex]));
+        openClTransferEvents[transferIndex] = NULL;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\t\tLeaving  GPUInterface::WaitForTransfer\n");
+#endif
+}
+
 void GPUInterface::MemcpyDeviceToHost(void* dest,
                                       const GPUPtr src,
                                       size_t memSize) {
@@ -989,12 +1525,31 @@ void GPUInterface::FreePinnedHostMemory(void* hPtr) {
 #endif
 }
 
+void GPUInterface::FreeTransferMemory(void* hPtr) {
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr, "\t\t\tEntering GPUInterface::FreeTransferMemory\n");
+#endif
+
+    free(hPtr);
+
+#ifdef BEAGLE_DEBUG_FLOW
+   fprintf(stderr,"\t\t\tLeaving  GPUInterface::FreeTransferMemory\n");
+#endif
+}
+
 void GPUInterface::FreeMemory(GPUPtr dPtr) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tEntering GPUInterface::FreeMemory\n");
 #endif
     
+    std::map<GPUPtr, size_t>::iterator pooled = openClPoolBuffers.find(dPtr);
+    if (pooled != openClPoolBuffers.end()) {
+        memoryPool.give(pooled->second);
+        openClPoolBuffers.erase(pooled);
+    }
+
     SAFE_CL(clReleaseMemObject(dPtr));
+    CountFree(dPtr);
     
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\t\t\tLeaving  GPUInterface::FreeMemory\n");
@@ -1068,6 +1623,15 @@ bool GPUInterface::GetSupportsDoublePrecision(int deviceNumber) {
     return supportsDouble;
 }
 
+bool GPUInterface::GetSupportsZeroCopy(int deviceNumber) {
+
+    cl_bool hostUnifiedMemory = CL_FALSE;
+
+    SAFE_CL(clGetDeviceInfo(openClDeviceMap[deviceNumber], CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &hostUnifiedMemory, NULL));
+
+    return hostUnifiedMemory;
+}
+
 void GPUInterface::GetDeviceDescription(int deviceNumber,
                                         char* deviceDescription) {       
 #ifdef BEAGLE_DEBUG_FLOW
@@ -1107,7 +1671,7 @@ void GPUInterface::PrintfDeviceInt(GPUPtr dPtr,
     free(hPtr);
 }
 
-long GPUInterface::GetDeviceTypeFlag(int deviceNumber) {       
+long long GPUInterface::GetDeviceTypeFlag(int deviceNumber) {       
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\t\tEntering GPUInterface::GetDeviceTypeFlag\n");
 #endif
@@ -1123,7 +1687,7 @@ long GPUInterface::GetDeviceTypeFlag(int deviceNumber) {
     SAFE_CL(clGetDeviceInfo(deviceId, CL_DEVICE_TYPE,
                             sizeof(cl_device_type), &deviceType, NULL));
 
-    long deviceTypeFlag;
+    long long deviceTypeFlag;
     if (deviceType == CL_DEVICE_TYPE_GPU) 
         deviceTypeFlag = BEAGLE_FLAG_PROCESSOR_GPU;
     else if (deviceType == CL_DEVICE_TYPE_CPU)
@@ -1161,7 +1725,7 @@ BeagleDeviceImplementationCodes GPUInterface::GetDeviceImplementationCode(int de
                             sizeof(cl_platform_id), &platform, NULL));
     SAFE_CL(clGetPlatformInfo(platform, CL_PLATFORM_NAME, param_size, platform_string, NULL));
 
-    long deviceTypeFlag = GetDeviceTypeFlag(deviceNumber);
+    long long deviceTypeFlag = GetDeviceTypeFlag(deviceNumber);
 
     if (!strncmp("Intel", platform_string, strlen("Intel"))) {
         if (deviceTypeFlag == BEAGLE_FLAG_PROCESSOR_CPU)
@@ -1186,6 +1750,10 @@ BeagleDeviceImplementationCodes GPUInterface::GetDeviceImplementationCode(int de
             deviceCode = BEAGLE_OPENCL_DEVICE_APPLE_INTEL_GPU;
     }
 
+    // other CPU runtimes (e.g. PoCL) still get the pattern-major CPU kernels
+    if (deviceCode == BEAGLE_OPENCL_DEVICE_GENERIC && deviceTypeFlag == BEAGLE_FLAG_PROCESSOR_CPU)
+        deviceCode = BEAGLE_OPENCL_DEVICE_GENERIC_CPU;
+
 // printf("platform_string %s\n", platform_string);
 // printf("device_string %s\n", device_string);
 // printf("deviceTypeFlag = %d\n", deviceTypeFlag);
@@ -62,7 +62,8 @@ void KernelLauncher::SetupKernelBlocksAndGrids() {
     BeagleDeviceImplementationCodes deviceCode = gpu->GetDeviceImplementationCode(-1);
     if (deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_CPU ||
         deviceCode == BEAGLE_OPENCL_DEVICE_INTEL_MIC ||
-        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU) {
+        deviceCode == BEAGLE_OPENCL_DEVICE_AMD_CPU ||
+        deviceCode == BEAGLE_OPENCL_DEVICE_GENERIC_CPU) {
         kCPUImplementation = true;
     } else if (deviceCode == BEAGLE_OPENCL_DEVICE_APPLE_CPU) {
         kCPUImplementation = true;
@@ -119,6 +120,17 @@ void KernelLauncher::SetupKernelBlocksAndGrids() {
         }
     } 
 
+    // Set up block/grid for tensor core partials-partials pruning
+    kPruningMMA = false;
+#ifdef CUDA
+    kPruningMMA = (gpu->kernelResource->pruningMMA != 0);
+    if (kPruningMMA) {
+        bgPeelingMMABlock = Dim3Int(PRUNING_MMA_WARP_COUNT * 32);
+        bgPeelingMMAGrid  = Dim3Int((kPatternCount + PRUNING_MMA_PATTERN_BLOCK_SIZE - 1) /
+                                    PRUNING_MMA_PATTERN_BLOCK_SIZE, kCategoryCount);
+    }
+#endif
+
     // Set up block/grid for likelihood computation
     if (kPaddedStateCount == 4) {
         int likePatternBlockSize = kPatternBlockSize;
@@ -234,6 +246,16 @@ void KernelLauncher::LoadKernels() {
  
     fPartialsPartialsByPatternBlockFixedScaling = gpu->GetFunction(
             "kernelPartialsPartialsFixedScale");
+
+#ifdef CUDA
+    if (kPruningMMA) {
+        fPartialsPartialsByPatternBlockCoherent = gpu->GetFunction(
+                "kernelPartialsPartialsNoScaleMMA");
+
+        fPartialsPartialsByPatternBlockFixedScaling = gpu->GetFunction(
+                "kernelPartialsPartialsFixedScaleMMA");
+    }
+#endif
     
     fPartialsPartialsByPatternBlockAutoScaling = gpu->GetFunction(
                 "kernelPartialsPartialsAutoScale");
@@ -431,6 +453,10 @@ void KernelLauncher::LoadKernels() {
         fIntegrateLikelihoodsPartition = gpu->GetFunction("kernelIntegrateLikelihoodsPartition");
         
         fSumSites1Partition = gpu->GetFunction("kernelSumSites1Partition");
+
+        fPartialsTraversal = gpu->GetFunction("kernelPartialsTraversalNoScale");
+
+        fIntegrateLikelihoodsSumSites = gpu->GetFunction("kernelIntegrateLikelihoodsSumSites");
     }
 #endif // !FW_OPENCL_TESTING
 }
@@ -570,6 +596,38 @@ void KernelLauncher::GetTransitionProbabilitiesSquare(GPUPtr dMatrices,
 #endif
 }
 
+void KernelLauncher::GetTransitionProbabilitiesSquareConcurrent(GPUPtr dMatrices,
+                                                                GPUPtr dPtrQueue,
+                                                                GPUPtr dEvec,
+                                                                GPUPtr dIevc,
+                                                                GPUPtr dEigenValues,
+                                                                GPUPtr distanceQueue,
+                                                                unsigned int totalMatrix,
+                                                                int streamIndex) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\tEntering KernelLauncher::GetTransitionProbabilitiesSquareConcurrent\n");
+#endif
+
+    bgTransitionProbabilitiesGrid.x *= totalMatrix;
+
+    // Transposed (interchanged Ievc and Evec)    
+    int parameterCountV = 6;
+    int totalParameterCount = 9;
+    gpu->LaunchKernelConcurrent(fMatrixMulADB,
+                                bgTransitionProbabilitiesBlock, bgTransitionProbabilitiesGrid,
+                                streamIndex, -1,
+                                parameterCountV, totalParameterCount,
+                                dMatrices, dPtrQueue, dIevc, dEigenValues, dEvec, distanceQueue,
+                                kPaddedStateCount, kPaddedStateCount,
+                                totalMatrix);
+
+    bgTransitionProbabilitiesGrid.x /= totalMatrix; // Reset value
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\tLeaving  KernelLauncher::GetTransitionProbabilitiesSquareConcurrent\n");
+#endif
+}
+
 void KernelLauncher::GetTransitionProbabilitiesSquareFirstDeriv(GPUPtr dMatrices,
                                                                 GPUPtr dPtrQueue,
                                                                  GPUPtr dEvec,
@@ -638,23 +696,21 @@ void KernelLauncher::PartialsPartialsPruningDynamicCheckScaling(GPUPtr partials1
                                                            GPUPtr partials3,
                                                            GPUPtr matrices1,
                                                            GPUPtr matrices2,
-                                                           int writeScalingIndex,
-                                                           int readScalingIndex,
-                                                           int cumulativeScalingIndex,
-                                                           GPUPtr* dScalingFactors,
-                                                           GPUPtr* dScalingFactorsMaster,
-                                                           unsigned int patternCount,
-                                                           unsigned int categoryCount,
-                                                           int doRescaling,
-                                                           int* hRescalingTrigger,
+                                                           GPUPtr writeScalingFactors,
+                                                           GPUPtr readScalingFactors,
+                                                           GPUPtr cumulativeScaling,
                                                            GPUPtr dRescalingTrigger,
-                                                           int sizeReal) {
+                                                           unsigned int patternCount,
+                                                           unsigned int categoryCount) {
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\t\tEntering KernelLauncher::PartialsPartialsPruningDynamicCheckScaling\n");
 #endif
 
-    if (dScalingFactors[readScalingIndex] == 0) {
-        *hRescalingTrigger = 0;
+    // the pruning kernel raises the trigger and the scaling kernel reads it,
+    // so partials are only rescaled where needed and the host never waits
+    gpu->MemsetShort(dRescalingTrigger, 0, sizeof(int) / sizeof(unsigned short));
+
+    if (readScalingFactors == 0) {
         // Compute partials without any rescaling but check values
         gpu->LaunchKernel(fPartialsPartialsByPatternBlockCheckScaling,
                           bgPeelingBlock, bgPeelingGrid,
@@ -662,64 +718,25 @@ void KernelLauncher::PartialsPartialsPruningDynamicCheckScaling(GPUPtr partials1
                           partials1, partials2, partials3, matrices1, matrices2, dRescalingTrigger,
                           patternCount);            
 
-        gpu->SynchronizeDevice();
-//        printf("hRescalingTrigger (no factors) %d\n", *hRescalingTrigger);
-        if (*hRescalingTrigger) { // check if any partials need rescaling
-            if (dScalingFactors[writeScalingIndex] != dScalingFactorsMaster[writeScalingIndex])
-                dScalingFactors[writeScalingIndex] = dScalingFactorsMaster[writeScalingIndex];
-
-            if (dScalingFactors[writeScalingIndex] == 0) {
-                dScalingFactors[writeScalingIndex] = gpu->AllocateMemory(patternCount * sizeReal);
-                dScalingFactorsMaster[writeScalingIndex] = dScalingFactors[writeScalingIndex];
-            }
-            
-            if (dScalingFactors[cumulativeScalingIndex] != dScalingFactorsMaster[cumulativeScalingIndex]) {
-                gpu->MemcpyDeviceToDevice(dScalingFactorsMaster[cumulativeScalingIndex], dScalingFactors[cumulativeScalingIndex], sizeReal *patternCount);
-                gpu->SynchronizeDevice();
-                dScalingFactors[cumulativeScalingIndex] = dScalingFactorsMaster[cumulativeScalingIndex];
-            }
-            
-            gpu->LaunchKernel(fPartialsDynamicScalingAccumulateReciprocal,
-                              bgScaleBlock, bgScaleGrid,
-                              3, 4,
-                              partials3, dScalingFactors[writeScalingIndex], dScalingFactors[cumulativeScalingIndex],
-                              categoryCount);
-        }
+        gpu->LaunchKernel(fPartialsDynamicScalingAccumulateReciprocal,
+                          bgScaleBlock, bgScaleGrid,
+                          4, 5,
+                          partials3, writeScalingFactors, cumulativeScaling, dRescalingTrigger,
+                          categoryCount);
     } else {
-        *hRescalingTrigger = 0;
         // Compute partials with known rescalings        
         gpu->LaunchKernel(fPartialsPartialsByPatternBlockFixedCheckScaling,
                           bgPeelingBlock, bgPeelingGrid,
                           7, 8,
                           partials1, partials2, partials3, matrices1, matrices2,
-                          dScalingFactors[readScalingIndex], dRescalingTrigger,
+                          readScalingFactors, dRescalingTrigger,
                           patternCount);        
         
-        gpu->SynchronizeDevice();
-//        printf("hRescalingTrigger (existing factors) %d\n", *hRescalingTrigger);
-        if (*hRescalingTrigger) { // check if any partials need rescaling
-            if (dScalingFactors[writeScalingIndex] != dScalingFactorsMaster[writeScalingIndex])
-                dScalingFactors[writeScalingIndex] = dScalingFactorsMaster[writeScalingIndex];
-            
-            if (dScalingFactors[writeScalingIndex] == 0) {
-                dScalingFactors[writeScalingIndex] = gpu->AllocateRealMemory(patternCount);
-                dScalingFactorsMaster[writeScalingIndex] = dScalingFactors[writeScalingIndex];
-            }
-            
-            if (dScalingFactors[cumulativeScalingIndex] != dScalingFactorsMaster[cumulativeScalingIndex]) {
-                gpu->MemcpyDeviceToDevice(dScalingFactorsMaster[cumulativeScalingIndex], dScalingFactors[cumulativeScalingIndex], sizeReal * patternCount);
-                gpu->SynchronizeDevice();
-                dScalingFactors[cumulativeScalingIndex] = dScalingFactorsMaster[cumulativeScalingIndex];
-            }
-            
-            gpu->LaunchKernel(fPartialsDynamicScalingAccumulateDifference,
-                              bgScaleBlock, bgScaleGrid,
-                              4, 5,
-                              partials3, dScalingFactors[writeScalingIndex], dScalingFactors[readScalingIndex], dScalingFactors[cumulativeScalingIndex],
-                              categoryCount);
-        } else if (readScalingIndex != writeScalingIndex) {
-            dScalingFactors[writeScalingIndex] = dScalingFactors[readScalingIndex];
-        }
+        gpu->LaunchKernel(fPartialsDynamicScalingAccumulateDifference,
+                          bgScaleBlock, bgScaleGrid,
+                          5, 6,
+                          partials3, writeScalingFactors, readScalingFactors, cumulativeScaling, dRescalingTrigger,
+                          categoryCount);
     }
     
 #ifdef BEAGLE_DEBUG_FLOW
@@ -764,6 +781,27 @@ void KernelLauncher::PartialsPartialsPruningMulti(GPUPtr partials,
 #endif
 }
 
+void KernelLauncher::PartialsTraversal(GPUPtr partials,
+                                       GPUPtr states,
+                                       GPUPtr matrices,
+                                       GPUPtr ptrOffsets,
+                                       int operationCount,
+                                       unsigned int patternCount) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\tEntering KernelLauncher::PartialsTraversal\n");
+#endif
+
+    gpu->LaunchKernel(fPartialsTraversal,
+                      bgPeelingBlock, bgPeelingGrid,
+                      4, 6,
+                      partials, states, matrices, ptrOffsets,
+                      operationCount, patternCount);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\tLeaving  KernelLauncher::PartialsTraversal\n");
+#endif
+}
+
 void KernelLauncher::PartialsPartialsPruningDynamicScaling(GPUPtr partials1,
                                                            GPUPtr partials2,
                                                            GPUPtr partials3,
@@ -792,6 +830,10 @@ void KernelLauncher::PartialsPartialsPruningDynamicScaling(GPUPtr partials1,
         bgPeelingGrid.x = (launchPatternCount + blockPatternCount - 1) / blockPatternCount;
     }
 
+    // whole-range launches go to the tensor core kernels when loaded
+    Dim3Int pruningBlock = (kPruningMMA ? bgPeelingMMABlock : bgPeelingBlock);
+    Dim3Int pruningGrid  = (kPruningMMA ? bgPeelingMMAGrid  : bgPeelingGrid);
+
     if (doRescaling == 2) { // auto-rescaling
         bgPeelingGrid.x = tmpGridx;
         gpu->LaunchKernel(fPartialsPartialsByPatternBlockAutoScaling,
@@ -812,7 +854,7 @@ void KernelLauncher::PartialsPartialsPruningDynamicScaling(GPUPtr partials1,
 
         } else {
             gpu->LaunchKernelConcurrent(fPartialsPartialsByPatternBlockCoherent,
-                                        bgPeelingBlock, bgPeelingGrid,
+                                        pruningBlock, pruningGrid,
                                         streamIndex, waitIndex,
                                         5, 6,
                                         partials1, partials2, partials3, matrices1, matrices2,
@@ -845,7 +887,7 @@ void KernelLauncher::PartialsPartialsPruningDynamicScaling(GPUPtr partials1,
                                         startPattern, endPattern, patternCount);
         } else {
             gpu->LaunchKernelConcurrent(fPartialsPartialsByPatternBlockFixedScaling,
-                              bgPeelingBlock, bgPeelingGrid,
+                              pruningBlock, pruningGrid,
                               streamIndex, waitIndex,
                               6, 7,
                               partials1, partials2, partials3, matrices1, matrices2,
@@ -1836,6 +1878,33 @@ void KernelLauncher::IntegrateLikelihoods(GPUPtr dResult,
     
 }
 
+void KernelLauncher::IntegrateLikelihoodsSumSites(GPUPtr dResult,
+                                                  GPUPtr dSum,
+                                                  GPUPtr dRootPartials,
+                                                  GPUPtr dWeights,
+                                                  GPUPtr dFrequencies,
+                                                  GPUPtr dPatternWeights,
+                                                  unsigned int patternCount,
+                                                  unsigned int categoryCount,
+                                                  unsigned int unpaddedPatternCount) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr,"\t\tEntering KernelLauncher::IntegrateLikelihoodsSumSites\n");
+#endif
+
+    // one block per site-sum block, each looping over its patterns
+    int parameterCountV = 6;
+    int totalParameterCount = 9;
+    gpu->LaunchKernel(fIntegrateLikelihoodsSumSites,
+                      bgLikelihoodBlock, bgSumSitesGrid,
+                      parameterCountV, totalParameterCount,
+                      dResult, dSum, dRootPartials, dWeights, dFrequencies, dPatternWeights,
+                      categoryCount, patternCount, unpaddedPatternCount);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\t\tLeaving  KernelLauncher::IntegrateLikelihoodsSumSites\n");
+#endif
+}
+
 void KernelLauncher::IntegrateLikelihoodsPartition(GPUPtr dResult,
                                                    GPUPtr dRootPartials,
                                                    GPUPtr dWeights,
@@ -78,6 +78,7 @@ private:
     GPUFunction fStatesPartialsEdgeLikelihoods;
     GPUFunction fStatesPartialsEdgeLikelihoodsByPartition;
     GPUFunction fStatesPartialsEdgeLikelihoodsSecondDeriv;
+    GPUFunction fPartialsTraversal;
         
     GPUFunction fIntegrateLikelihoodsDynamicScaling;
     GPUFunction fIntegrateLikelihoodsDynamicScalingPartition;
@@ -101,6 +102,7 @@ private:
 	  GPUFunction fIntegrateLikelihoodsMulti;
 	  GPUFunction fIntegrateLikelihoodsFixedScaleMulti;
     GPUFunction fIntegrateLikelihoodsAutoScaling;
+    GPUFunction fIntegrateLikelihoodsSumSites;
 
     GPUFunction fSumSites1;
     GPUFunction fSumSites1Partition;
@@ -113,6 +115,8 @@ private:
     Dim3Int bgTransitionProbabilitiesGrid;
     Dim3Int bgPeelingBlock;
     Dim3Int bgPeelingGrid;
+    Dim3Int bgPeelingMMABlock;
+    Dim3Int bgPeelingMMAGrid;
     Dim3Int bgLikelihoodBlock;
     Dim3Int bgLikelihoodGrid;
     Dim3Int bgAccumulateBlock;
@@ -134,9 +138,10 @@ private:
     unsigned int kSlowReweighing;  
     unsigned int kMultiplyBlockSize;
     unsigned int kSumSitesBlockSize;
-    long kFlags;
+    long long kFlags;
     bool kCPUImplementation;
     bool kAppleCPUImplementation;
+    bool kPruningMMA;
 
     
 public:
@@ -180,6 +185,15 @@ public:
                                           GPUPtr distanceQueue,
                                           unsigned int totalMatrix);
 
+    void GetTransitionProbabilitiesSquareConcurrent(GPUPtr dMatrices,
+                                                    GPUPtr dPtrQueue,
+                                                    GPUPtr dEvec,
+                                                    GPUPtr dIevc,
+                                                    GPUPtr dEigenValues,
+                                                    GPUPtr distanceQueue,
+                                                    unsigned int totalMatrix,
+                                                    int streamIndex);
+
     void GetTransitionProbabilitiesSquareFirstDeriv(GPUPtr dMatrices,
                                                     GPUPtr dPtrQueue,
                                                      GPUPtr dEvec,
@@ -201,17 +215,12 @@ public:
                                                     GPUPtr partials3,
                                                     GPUPtr matrices1,
                                                     GPUPtr matrices2,
-                                                    int writeScalingIndex,
-                                                    int readScalingIndex,
-                                                    int cumulativeScalingIndex,
-                                                    GPUPtr* dScalingFactors,
-                                                    GPUPtr* dScalingFactorsMaster,
-                                                    unsigned int patternCount,
-                                                    unsigned int categoryCount,
-                                                    int doRescaling,
-                                                    int* hRescalingTrigger,
+                                                    GPUPtr writeScalingFactors,
+                                                    GPUPtr readScalingFactors,
+                                                    GPUPtr cumulativeScaling,
                                                     GPUPtr dRescalingTrigger,
-                                                    int sizeReal);
+                                                    unsigned int patternCount,
+                                                    unsigned int categoryCount);
 
     void PartialsPartialsPruningMulti(GPUPtr partials,
                                       GPUPtr matrices,
@@ -222,6 +231,13 @@ public:
                                       int gridSize,
                                       int doRescaling);
 
+    void PartialsTraversal(GPUPtr partials,
+                           GPUPtr states,
+                           GPUPtr matrices,
+                           GPUPtr ptrOffsets,
+                           int operationCount,
+                           unsigned int patternCount);
+
     void PartialsPartialsPruningDynamicScaling(GPUPtr partials1,
                                                GPUPtr partials2,
                                                GPUPtr partials3,
@@ -441,6 +457,16 @@ public:
                               unsigned int patternCount,
                               unsigned int categoryCount);
     
+    void IntegrateLikelihoodsSumSites(GPUPtr dResult,
+                                      GPUPtr dSum,
+                                      GPUPtr dRootPartials,
+                                      GPUPtr dWeights,
+                                      GPUPtr dFrequencies,
+                                      GPUPtr dPatternWeights,
+                                      unsigned int patternCount,
+                                      unsigned int categoryCount,
+                                      unsigned int unpaddedPatternCount);
+
     void IntegrateLikelihoodsPartition(GPUPtr dResult,
                                        GPUPtr dRootPartials,
                                        GPUPtr dWeights,
@@ -30,7 +30,7 @@ KernelResource::KernelResource(
         int inCategoryCount,
         int inPatternCount,
         int inUnpaddedPatternCount,
-        long inFlags
+        long long inFlags
         ) {
     paddedStateCount = inPaddedStateCount;
     kernelCode = inKernelString;
@@ -39,6 +39,8 @@ KernelResource::KernelResource(
     blockPeelingSize = inBlockPeelingSize,
     slowReweighing = inSlowReweighing;
     multiplyBlockSize = inMultiplyBlockSize;
+    halfPartials = 0;
+    pruningMMA = 0;
     categoryCount = inCategoryCount;
     patternCount = inPatternCount;
     unpaddedPatternCount = inUnpaddedPatternCount;
@@ -54,6 +56,8 @@ KernelResource::KernelResource(const KernelResource& krIn,
     blockPeelingSize = krIn.blockPeelingSize,
     slowReweighing = krIn.slowReweighing;
     multiplyBlockSize = krIn.multiplyBlockSize;
+    halfPartials = krIn.halfPartials;
+    pruningMMA = krIn.pruningMMA;
     categoryCount = krIn.categoryCount;
     patternCount = krIn.patternCount;
     unpaddedPatternCount = krIn.unpaddedPatternCount;
@@ -64,7 +68,7 @@ KernelResource::~KernelResource() {
 }
 
 KernelResource* KernelResource::copy(void) {
-    return new KernelResource(
+    KernelResource* resource = new KernelResource(
             paddedStateCount,
             kernelCode,
             patternBlockSize,
@@ -76,4 +80,7 @@ KernelResource* KernelResource::copy(void) {
             patternCount,
             unpaddedPatternCount,
             flags);
+    resource->halfPartials = halfPartials;
+    resource->pruningMMA = pruningMMA;
+    return resource;
 }
@@ -41,7 +41,7 @@ public:
         int inCategoryCount,
         int inPatternCount,
         int inUnpaddedPatternCount,
-        long inFlags
+        long long inFlags
         );
     
     KernelResource(const KernelResource& krIn,
@@ -61,7 +61,9 @@ public:
     int smallestPowerOfTwo;
     int slowReweighing;
     int multiplyBlockSize;
-    long flags;
+    int halfPartials;
+    int pruningMMA;
+    long long flags;
     
     KernelResource* copy();
 };
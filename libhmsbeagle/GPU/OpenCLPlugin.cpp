@@ -45,7 +45,7 @@ Plugin("GPU-OpenCL", "GPU-OpenCL")
                                         BEAGLE_FLAG_PARALLELOPS_GRID | BEAGLE_FLAG_PARALLELOPS_STREAMS |
                                         BEAGLE_FLAG_FRAMEWORK_OPENCL;
 
-                long deviceTypeFlag = gpu.GetDeviceTypeFlag(i);
+                long long deviceTypeFlag = gpu.GetDeviceTypeFlag(i);
                 
                 resource.supportFlags |= deviceTypeFlag;
 
@@ -54,6 +54,9 @@ Plugin("GPU-OpenCL", "GPU-OpenCL")
                 	resource.supportFlags |= BEAGLE_FLAG_PRECISION_DOUBLE;
                 	anyGPUSupportsDP = true;
                 }
+#ifdef BEAGLE_RUNTIME_KERNELS
+                resource.supportFlags |= BEAGLE_FLAG_KERNEL_TUNING;
+#endif
                 
                 resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_OPENCL;
                 
@@ -38,6 +38,14 @@
 ///////////////////////////////////////////////////////////////////////////////
 // kernel macros CPU
 
+// one work-item per pattern, with the four states of a pattern and of a
+// matrix row held in a single vector register
+#ifdef DOUBLE_PRECISION
+    #define REAL4 double4
+#else
+    #define REAL4 float4
+#endif
+
 #define DETERMINE_INDICES_4_CPU()\
     int patIdx = KW_LOCAL_ID_0;\
     int matrix = KW_GROUP_ID_1;\
@@ -89,43 +97,36 @@
     REAL sum2[PADDED_STATE_COUNT];\
     const KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = matrices1 + deltaMatrix;\
     const KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix2 = matrices2 + deltaMatrix;\
-    const KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials1 = partials1 + deltaPartials;\
-    const KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
-    for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        sum1[i] = sMatrix1[0 * PADDED_STATE_COUNT + i] * sPartials1[0];\
-        sum2[i] = sMatrix2[0 * PADDED_STATE_COUNT + i] * sPartials2[0];\
-    }\
-    for (int s = 1; s < PADDED_STATE_COUNT; s++) {\
-        for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            FMA(sMatrix1[s * PADDED_STATE_COUNT + i],  sPartials1[s], sum1[i]);\
-            FMA(sMatrix2[s * PADDED_STATE_COUNT + i],  sPartials2[s], sum2[i]);\
-        }\
-    }
+    REAL4 vPartials1 = vload4(0, partials1 + deltaPartials);\
+    REAL4 vPartials2 = vload4(0, partials2 + deltaPartials);\
+    REAL4 vSum1 = vload4(0, sMatrix1) * vPartials1.s0;\
+    REAL4 vSum2 = vload4(0, sMatrix2) * vPartials2.s0;\
+    vSum1 += vload4(1, sMatrix1) * vPartials1.s1;\
+    vSum2 += vload4(1, sMatrix2) * vPartials2.s1;\
+    vSum1 += vload4(2, sMatrix1) * vPartials1.s2;\
+    vSum2 += vload4(2, sMatrix2) * vPartials2.s2;\
+    vSum1 += vload4(3, sMatrix1) * vPartials1.s3;\
+    vSum2 += vload4(3, sMatrix2) * vPartials2.s3;\
+    vstore4(vSum1, 0, sum1);\
+    vstore4(vSum2, 0, sum2);
 
 #define SUM_STATES_PARTIALS_4_CPU()\
     REAL sum1[PADDED_STATE_COUNT];\
     REAL sum2[PADDED_STATE_COUNT];\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = matrices1 + deltaMatrix;\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix2 = matrices2 + deltaMatrix;\
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
     int state1 = states1[pattern];\
+    REAL4 vSum1 = (REAL4) (1.0);\
     if (state1 < PADDED_STATE_COUNT) {\
-        for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            sum1[i] = sMatrix1[state1 * PADDED_STATE_COUNT + i];\
-        }\
-    } else {\
-        for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            sum1[i] = 1.0;\
-        }\
-    }\
-    for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        sum2[i] = sMatrix2[0 * PADDED_STATE_COUNT + i] * sPartials2[0];\
+        vSum1 = vload4(state1, sMatrix1);\
     }\
-    for (int s = 1; s < PADDED_STATE_COUNT; s++) {\
-        for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            FMA(sMatrix2[s * PADDED_STATE_COUNT + i],  sPartials2[s], sum2[i]);\
-        }\
-    }
+    REAL4 vPartials2 = vload4(0, partials2 + deltaPartials);\
+    REAL4 vSum2 = vload4(0, sMatrix2) * vPartials2.s0;\
+    vSum2 += vload4(1, sMatrix2) * vPartials2.s1;\
+    vSum2 += vload4(2, sMatrix2) * vPartials2.s2;\
+    vSum2 += vload4(3, sMatrix2) * vPartials2.s3;\
+    vstore4(vSum1, 0, sum1);\
+    vstore4(vSum2, 0, sum2);
 
 
 #define SUM_STATES_STATES_4_CPU()\
@@ -1323,6 +1324,90 @@ KW_GLOBAL_KERNEL void kernelStatesStatesFixedScale(KW_GLOBAL_VAR int* KW_RESTRIC
 #endif // FW_OPENCL_CPU
 }
 
+// Walks a whole postorder operation list in one launch. Each block owns the
+// same patterns and rate category of every buffer, so a parent computed by an
+// earlier operation is read back by the very thread that wrote it and only a
+// block barrier is needed between operations. ptrOffsets holds six entries
+// per operation: type (1 partials/partials, 2 states/partials, 3 states/states),
+// child1, child2 and parent offsets, then both matrix offsets. States children
+// always come first.
+KW_GLOBAL_KERNEL void kernelPartialsTraversalNoScale(KW_GLOBAL_VAR REAL* KW_RESTRICT partials,
+                                                     KW_GLOBAL_VAR int* KW_RESTRICT states,
+                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT matrices,
+                                                     const KW_GLOBAL_VAR unsigned int* KW_RESTRICT ptrOffsets,
+                                                     int operationCount,
+                                                     int totalPatterns) {
+#ifdef FW_OPENCL_CPU // CPU/MIC implementation
+    int endPattern = totalPatterns;
+    DETERMINE_INDICES_4_CPU();
+    for (int op = 0; op < operationCount; op++) {
+        int opIndexPtr = op * 6;
+        int opType = ptrOffsets[opIndexPtr];
+        KW_GLOBAL_VAR REAL* KW_RESTRICT partials3 = partials + ptrOffsets[opIndexPtr + 3];
+        KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1 = matrices + ptrOffsets[opIndexPtr + 4];
+        KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2 = matrices + ptrOffsets[opIndexPtr + 5];
+        if (opType == 1) {
+            const KW_GLOBAL_VAR REAL* KW_RESTRICT partials1 = partials + ptrOffsets[opIndexPtr + 1];
+            const KW_GLOBAL_VAR REAL* KW_RESTRICT partials2 = partials + ptrOffsets[opIndexPtr + 2];
+            SUM_PARTIALS_PARTIALS_4_CPU();
+            for(int i = 0; i < PADDED_STATE_COUNT; i++) {
+                partials3[deltaPartials + i] = sum1[i] * sum2[i];
+            }
+        } else if (opType == 2) {
+            KW_GLOBAL_VAR int* KW_RESTRICT states1 = states + ptrOffsets[opIndexPtr + 1];
+            KW_GLOBAL_VAR REAL* KW_RESTRICT partials2 = partials + ptrOffsets[opIndexPtr + 2];
+            SUM_STATES_PARTIALS_4_CPU();
+            for(int i = 0; i < PADDED_STATE_COUNT; i++) {
+                partials3[deltaPartials + i] = sum1[i] * sum2[i];
+            }
+        } else {
+            KW_GLOBAL_VAR int* KW_RESTRICT states1 = states + ptrOffsets[opIndexPtr + 1];
+            KW_GLOBAL_VAR int* KW_RESTRICT states2 = states + ptrOffsets[opIndexPtr + 2];
+            SUM_STATES_STATES_4_CPU();
+        }
+    }
+#else // GPU implementation
+    int endPattern = totalPatterns;
+    DETERMINE_INDICES_4_GPU();
+    int y = deltaPartialsByState + deltaPartialsByMatrix;
+    KW_LOCAL_MEM REAL sPartials1[PATTERN_BLOCK_SIZE * 4 * 4];
+    KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE * 4 * 4];
+    KW_LOCAL_MEM REAL sMatrix1[16];
+    KW_LOCAL_MEM REAL sMatrix2[16];
+    for (int op = 0; op < operationCount; op++) {
+        int opIndexPtr = op * 6;
+        int opType = ptrOffsets[opIndexPtr];
+        KW_GLOBAL_VAR REAL* KW_RESTRICT partials3 = partials + ptrOffsets[opIndexPtr + 3];
+        if (patIdx == 0) {
+            sMatrix1[tx] = matrices[ptrOffsets[opIndexPtr + 4] + x2 + tx];
+            sMatrix2[tx] = matrices[ptrOffsets[opIndexPtr + 5] + x2 + tx];
+        }
+        if (opType == 1) {
+            sPartials1[multBy16(patIdx) | tx] = (pattern < endPattern ? partials[ptrOffsets[opIndexPtr + 1] + (y | tx)] : 0);
+        }
+        if (opType <= 2) {
+            sPartials2[multBy16(patIdx) | tx] = (pattern < endPattern ? partials[ptrOffsets[opIndexPtr + 2] + (y | tx)] : 0);
+        }
+        KW_LOCAL_FENCE;
+        if (pattern < endPattern) { // Remove padded threads!
+            if (opType == 1) {
+                SUM_PARTIALS_PARTIALS_4_GPU();
+                partials3[u] = sum1 * sum2;
+            } else if (opType == 2) {
+                KW_GLOBAL_VAR int* KW_RESTRICT states1 = states + ptrOffsets[opIndexPtr + 1];
+                SUM_STATES_PARTIALS_4_GPU();
+                partials3[u] = sum1 * sum2;
+            } else {
+                KW_GLOBAL_VAR int* KW_RESTRICT states1 = states + ptrOffsets[opIndexPtr + 1];
+                KW_GLOBAL_VAR int* KW_RESTRICT states2 = states + ptrOffsets[opIndexPtr + 2];
+                SUM_STATES_STATES_4_GPU();
+            }
+        }
+        KW_LOCAL_FENCE;
+    }
+#endif // FW_OPENCL_CPU
+}
+
 // Find a scaling factor for each pattern
 KW_GLOBAL_KERNEL void kernelPartialsDynamicScaling(KW_GLOBAL_VAR REAL* KW_RESTRICT allPartials,
                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
@@ -1613,6 +1698,86 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoods(KW_GLOBAL_VAR REAL* KW_RESTRICT
 #endif // FW_OPENCL_CPU
 }
 
+// kernelIntegrateLikelihoods and kernelSumSites1 in a single launch, with one
+// block per SUM_SITES_BLOCK_SIZE patterns
+KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsSumSites(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
+                                                         KW_GLOBAL_VAR REAL* KW_RESTRICT dSum,
+                                                         KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                         KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
+                                                         KW_GLOBAL_VAR REAL* KW_RESTRICT dFrequencies,
+                                                         KW_GLOBAL_VAR REAL* KW_RESTRICT dPatternWeights,
+                                                         int matrixCount,
+                                                         int patternCount,
+                                                         int unpaddedPatternCount) {
+    int startPattern = KW_GROUP_ID_0 * SUM_SITES_BLOCK_SIZE;
+    int endPattern = startPattern + SUM_SITES_BLOCK_SIZE;
+    if (endPattern > unpaddedPatternCount)
+        endPattern = unpaddedPatternCount;
+    int delta = patternCount * PADDED_STATE_COUNT;
+#ifdef FW_OPENCL_CPU // CPU/MIC implementation
+    REAL blockSum = 0;
+    for (int pattern = startPattern; pattern < endPattern; pattern++) {
+        REAL sumTotal = 0;
+        for (int i = 0; i < PADDED_STATE_COUNT; i++) {
+            REAL sum = 0;
+            for (int r = 0; r < matrixCount; r++) {
+                FMA(dRootPartials[i + pattern * PADDED_STATE_COUNT + delta * r], dWeights[r], sum);
+            }
+            FMA(sum, dFrequencies[i], sumTotal);
+        }
+        REAL siteLogLikelihood = log(sumTotal);
+        dResult[pattern] = siteLogLikelihood;
+        FMA(siteLogLikelihood, dPatternWeights[pattern], blockSum);
+    }
+    dSum[KW_GROUP_ID_0] = blockSum;
+#else // GPU implementation
+    int state = KW_LOCAL_ID_0;
+    int pat = KW_LOCAL_ID_1;
+    KW_LOCAL_MEM REAL stateFreq[4];
+    /* TODO: Currently assumes MATRIX_BLOCK_SIZE >= matrixCount */
+    KW_LOCAL_MEM REAL matrixProp[MATRIX_BLOCK_SIZE];
+    KW_LOCAL_MEM REAL sum[LIKE_PATTERN_BLOCK_SIZE][4];
+    KW_LOCAL_MEM REAL siteSum[LIKE_PATTERN_BLOCK_SIZE];
+    if (pat == 0) {
+        stateFreq[state] = dFrequencies[state];
+    }
+    /* TODO: Assumes matrixCount < LIKE_PATTERN_BLOCK_SIZE * 4 */
+    if (pat * 4 + state < matrixCount) {
+        matrixProp[pat * 4 + state] = dWeights[pat * 4 + state];
+    }
+    if (state == 0) {
+        siteSum[pat] = 0;
+    }
+    KW_LOCAL_FENCE;
+    for (int blockPattern = startPattern; blockPattern < endPattern; blockPattern += LIKE_PATTERN_BLOCK_SIZE) {
+        int pattern = blockPattern + pat;
+        REAL value = 0;
+        if (pattern < endPattern) {
+            int u = state + pattern * PADDED_STATE_COUNT;
+            for(int r = 0; r < matrixCount; r++) {
+                FMA(dRootPartials[u + delta * r], matrixProp[r], value);
+            }
+            value *= stateFreq[state];
+        }
+        sum[pat][state] = value;
+        KW_LOCAL_FENCE;
+        if (state == 0 && pattern < endPattern) {
+            REAL siteLogLikelihood = log(sum[pat][0] + sum[pat][1] + sum[pat][2] + sum[pat][3]);
+            dResult[pattern] = siteLogLikelihood;
+            FMA(siteLogLikelihood, dPatternWeights[pattern], siteSum[pat]);
+        }
+        KW_LOCAL_FENCE;
+    }
+    if (state == 0 && pat == 0) {
+        REAL blockSum = 0;
+        for (int i = 0; i < LIKE_PATTERN_BLOCK_SIZE; i++) {
+            blockSum += siteSum[i];
+        }
+        dSum[KW_GROUP_ID_0] = blockSum;
+    }
+#endif // FW_OPENCL_CPU
+}
+
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsPartition(
                                         KW_GLOBAL_VAR REAL*         KW_RESTRICT dResult,
                                         KW_GLOBAL_VAR REAL*         KW_RESTRICT dRootPartialsOrigin,
@@ -2058,6 +2223,7 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsCheckScale(KW_GLOBAL_VAR REAL* parti
 
         KW_LOCAL_MEM REAL sPartials1[PATTERN_BLOCK_SIZE * 4 * 4];
         KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE * 4 * 4];
+        KW_LOCAL_MEM REAL sPatternMax[PATTERN_BLOCK_SIZE * 4 * 4];
 
         // copy PADDED_STATE_COUNT * PATTERN_BLOCK_SIZE lengthed partials
         if (pattern < endPattern) {
@@ -2096,19 +2262,21 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsCheckScale(KW_GLOBAL_VAR REAL* parti
             REAL tmpPartial = sum1 * sum2;
             
             partials3[u] = tmpPartial;
+            sPatternMax[multBy16(patIdx) | tx] = tmpPartial;
+        }
+
+        KW_LOCAL_FENCE;
 
-            if (tmpPartial < SCALING_THRESHOLD_LOWER || tmpPartial > SCALING_THRESHOLD_UPPER)
+        // a pattern needs rescaling only when its largest partial leaves the
+        // threshold range; single states legitimately reach zero
+        if (pattern < endPattern && state == 0) {
+            REAL patternMax = sPatternMax[multBy16(patIdx) | tx];
+            for (i = 1; i < 4; i++) {
+                if (sPatternMax[multBy16(patIdx) | (tx + i)] > patternMax)
+                    patternMax = sPatternMax[multBy16(patIdx) | (tx + i)];
+            }
+            if ((patternMax > 0 && patternMax < SCALING_THRESHOLD_LOWER) || patternMax > SCALING_THRESHOLD_UPPER)
                 *dRescalingTrigger = 1;
-            
-//            union {float f; long l;} fl;
-//            fl.f = sum1 * sum2;;
-//
-//          partials3[u] = fl.f;
-//            
-//            int expTmp  = ((fl.l >> 23) & 0x000000ff) - 0x7e;
-//            
-//            if (abs(expTmp) > SCALING_EXPONENT_THRESHOLD)
-//                *dRescalingTrigger = 1;
         }
 
     }
@@ -2143,6 +2311,7 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedCheckScale(KW_GLOBAL_VAR REAL*
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE * 4 * 4];
 
     KW_LOCAL_MEM REAL fixedScalingFactors[PATTERN_BLOCK_SIZE * 4];
+    KW_LOCAL_MEM REAL sPatternMax[PATTERN_BLOCK_SIZE * 4 * 4];
 
     // copy PADDED_STATE_COUNT*PATTERN_BLOCK_SIZE lengthed partials
     if (pattern < endPattern) {
@@ -2185,10 +2354,19 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedCheckScale(KW_GLOBAL_VAR REAL*
         REAL tmpPartial = sum1 * sum2 * fixedScalingFactors[patIdx * 4 + pat];
         
         partials3[u] = tmpPartial;
+        sPatternMax[patIdx * 16 + tx] = tmpPartial;
+    }
 
-        if (tmpPartial < SCALING_THRESHOLD_LOWER || tmpPartial > SCALING_THRESHOLD_UPPER)
-            *dRescalingTrigger = 1;
+    KW_LOCAL_FENCE;
 
+    if (pattern < endPattern && state == 0) {
+        REAL patternMax = sPatternMax[patIdx * 16 + tx];
+        for (i = 1; i < 4; i++) {
+            if (sPatternMax[patIdx * 16 + tx + i] > patternMax)
+                patternMax = sPatternMax[patIdx * 16 + tx + i];
+        }
+        if ((patternMax > 0 && patternMax < SCALING_THRESHOLD_LOWER) || patternMax > SCALING_THRESHOLD_UPPER)
+            *dRescalingTrigger = 1;
     }
 
 }
@@ -2316,6 +2494,7 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsAutoScale(KW_GLOBAL_VAR REAL* partia
 KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateReciprocal(KW_GLOBAL_VAR REAL* allPartials,
                                                        KW_GLOBAL_VAR REAL* scalingFactors,
                                                        KW_GLOBAL_VAR REAL* cumulativeScaling,
+                                                       KW_GLOBAL_VAR int* dRescalingTrigger,
                                                        int matrixCount) {
     int tx = KW_LOCAL_ID_0;
     
@@ -2327,6 +2506,13 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateReciprocal(KW_GLOBAL
     int pattern = (patIdx << 2) + pat;
     int matrix = KW_LOCAL_ID_1;
     // TODO: Assumes matrixCount < MATRIX_BLOCK_SIZ
+
+    // nothing left the threshold range, so the partials stay unscaled
+    if (*dRescalingTrigger == 0) {
+        if (state == 0 && matrix == 0)
+            scalingFactors[pattern] = 1;
+        return;
+    }
     
     // Patterns are always padded, so no reading/writing past end possible
     // Find start of patternBlock for thread-block
@@ -2388,6 +2574,7 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateDifference(KW_GLOBAL
                                                                  KW_GLOBAL_VAR REAL* scalingFactors,
                                                                  KW_GLOBAL_VAR REAL* existingScalingFactors,
                                                                  KW_GLOBAL_VAR REAL* cumulativeScaling,
+                                                                 KW_GLOBAL_VAR int* dRescalingTrigger,
                                                                  int matrixCount) {
     int tx = KW_LOCAL_ID_0;
     
@@ -2399,6 +2586,13 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateDifference(KW_GLOBAL
     int pattern = (patIdx << 2) + pat;
     int matrix = KW_LOCAL_ID_1;
     // TODO: Assumes matrixCount < MATRIX_BLOCK_SIZ
+
+    // nothing left the threshold range, so the existing factors carry over
+    if (*dRescalingTrigger == 0) {
+        if (state == 0 && matrix == 0)
+            scalingFactors[pattern] = existingScalingFactors[pattern];
+        return;
+    }
     
     // Patterns are always padded, so no reading/writing past end possible
     // Find start of patternBlock for thread-block
@@ -24,9 +24,11 @@
 
 #ifdef CUDA
     #include "libhmsbeagle/GPU/GPUImplDefs.h"
+    #ifndef RUNTIME_KERNEL_BUILD // NVRTC has no host headers
     #include <stdlib.h>
     #include <string.h>
     #include <stdio.h>
+    #endif
     extern "C" {    
 #elif defined(FW_OPENCL)    
     #ifdef DOUBLE_PRECISION
@@ -41,9 +43,37 @@
     #define FMA(x, y, z) (z += x * y)
 #endif //FP_FAST_FMA
 
+// Partials buffers of kernels built with PARTIALS_HALF hold IEEE half precision
+// values, widened to REAL on load and rounded back on store
+#ifdef PARTIALS_HALF
+    #ifdef CUDA
+        #define PARTIALS_REAL unsigned short
+        KW_DEVICE_FUNC inline float halfToReal(unsigned short h) {
+            float f;
+            asm("cvt.f32.f16 %0, %1;" : "=f"(f) : "h"(h));
+            return f;
+        }
+        KW_DEVICE_FUNC inline unsigned short realToHalf(float f) {
+            unsigned short h;
+            asm("cvt.rn.f16.f32 %0, %1;" : "=h"(h) : "f"(f));
+            return h;
+        }
+        #define LOAD_PARTIAL(p, i)     halfToReal((p)[i])
+        #define STORE_PARTIAL(p, i, v) ((p)[i] = realToHalf(v))
+    #else
+        #define PARTIALS_REAL half
+        #define LOAD_PARTIAL(p, i)     vload_half(i, p)
+        #define STORE_PARTIAL(p, i, v) vstore_half(v, i, p)
+    #endif
+#else
+    #define PARTIALS_REAL REAL
+    #define LOAD_PARTIAL(p, i)     ((p)[i])
+    #define STORE_PARTIAL(p, i, v) ((p)[i] = (v))
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 
-KW_GLOBAL_KERNEL void kernelReorderPatterns(      KW_GLOBAL_VAR REAL*             dPartials,
+KW_GLOBAL_KERNEL void kernelReorderPatterns(      KW_GLOBAL_VAR PARTIALS_REAL*    dPartials,
                                                   KW_GLOBAL_VAR int*              dStates,
                                                   KW_GLOBAL_VAR int*              dStatesSort,
                                             const KW_GLOBAL_VAR int*  KW_RESTRICT dTipOffsets,
@@ -74,8 +104,8 @@ KW_GLOBAL_KERNEL void kernelReorderPatterns(      KW_GLOBAL_VAR REAL*
             int sortIndex   = categoryOffset + patternSorted * stateCount;
             int originIndex = categoryOffset + pattern       * stateCount;
 
-            const KW_GLOBAL_VAR REAL* KW_RESTRICT partialOriginal = dPartials + dTipOffsets[tip];
-                  KW_GLOBAL_VAR REAL* KW_RESTRICT partialSorted   = dPartials + dTipOffsets[tip+tipCount];
+            const KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partialOriginal = dPartials + dTipOffsets[tip];
+                  KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partialSorted   = dPartials + dTipOffsets[tip+tipCount];
 
 #ifdef FW_OPENCL_CPU 
             for (int i=0; i < stateCount; i++) {
@@ -1689,7 +1719,7 @@ KW_GLOBAL_KERNEL void kernelResetFactorsByPartition(KW_GLOBAL_VAR REAL* dScaling
 }
 
 
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlow(KW_GLOBAL_VAR REAL* allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlow(KW_GLOBAL_VAR PARTIALS_REAL* allPartials,
                                                  KW_GLOBAL_VAR REAL* scalingFactors,
                                                  int matrixCount) {
     int state = KW_LOCAL_ID_0;
@@ -1705,8 +1735,8 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlow(KW_GLOBAL_VAR REAL* allPa
 
     int m;
     for(m = 0; m < matrixCount; m++) {
-        partials[state] = allPartials[m * patternCount * PADDED_STATE_COUNT + pattern *
-                                      PADDED_STATE_COUNT + state];
+        partials[state] = LOAD_PARTIAL(allPartials, m * patternCount * PADDED_STATE_COUNT + pattern *
+                                                    PADDED_STATE_COUNT + state);
         KW_LOCAL_FENCE;
 
 #ifdef IS_POWER_OF_TWO
@@ -1739,13 +1769,14 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlow(KW_GLOBAL_VAR REAL* allPa
 
     KW_LOCAL_FENCE;
 
-    for(m = 0; m < matrixCount; m++)
-        allPartials[m * patternCount * PADDED_STATE_COUNT + pattern * PADDED_STATE_COUNT +
-                    state] /= max;
+    for(m = 0; m < matrixCount; m++) {
+        int offsetPartials = m * patternCount * PADDED_STATE_COUNT + pattern * PADDED_STATE_COUNT + state;
+        STORE_PARTIAL(allPartials, offsetPartials, LOAD_PARTIAL(allPartials, offsetPartials) / max);
+    }
 
 }
 
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlowScalersLog(KW_GLOBAL_VAR REAL* allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlowScalersLog(KW_GLOBAL_VAR PARTIALS_REAL* allPartials,
                                                           KW_GLOBAL_VAR REAL* scalingFactors,
                                                           int matrixCount) {
     int state = KW_LOCAL_ID_0;
@@ -1761,8 +1792,8 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlowScalersLog(KW_GLOBAL_VAR R
 
     int m;
     for(m = 0; m < matrixCount; m++) {
-        partials[state] = allPartials[m * patternCount * PADDED_STATE_COUNT + pattern *
-                                      PADDED_STATE_COUNT + state];
+        partials[state] = LOAD_PARTIAL(allPartials, m * patternCount * PADDED_STATE_COUNT + pattern *
+                                                    PADDED_STATE_COUNT + state);
         KW_LOCAL_FENCE;
 
 #ifdef IS_POWER_OF_TWO
@@ -1798,9 +1829,10 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingSlowScalersLog(KW_GLOBAL_VAR R
 
     KW_LOCAL_FENCE;
 
-    for(m = 0; m < matrixCount; m++)
-        allPartials[m * patternCount * PADDED_STATE_COUNT + pattern * PADDED_STATE_COUNT +
-                    state] /= max;
+    for(m = 0; m < matrixCount; m++) {
+        int offsetPartials = m * patternCount * PADDED_STATE_COUNT + pattern * PADDED_STATE_COUNT + state;
+        STORE_PARTIAL(allPartials, offsetPartials, LOAD_PARTIAL(allPartials, offsetPartials) / max);
+    }
 
 }
 
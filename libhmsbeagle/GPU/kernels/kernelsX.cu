@@ -47,11 +47,11 @@
     int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = matrices1 + deltaMatrix;\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix2 = matrices2 + deltaMatrix;\
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials1 = partials1 + deltaPartials;\
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials1 = partials1 + deltaPartials;\
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
     for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        FMA(sMatrix1[i * PADDED_STATE_COUNT + state],  sPartials1[i], sum1);\
-        FMA(sMatrix2[i * PADDED_STATE_COUNT + state],  sPartials2[i], sum2);\
+        FMA(sMatrix1[i * PADDED_STATE_COUNT + state],  LOAD_PARTIAL(sPartials1, i), sum1);\
+        FMA(sMatrix2[i * PADDED_STATE_COUNT + state],  LOAD_PARTIAL(sPartials2, i), sum2);\
     }
 
 #define SUM_STATES_PARTIALS_X_CPU()\
@@ -59,14 +59,14 @@
     int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = matrices1 + deltaMatrix;\
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix2 = matrices2 + deltaMatrix;\
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = partials2 + deltaPartials;\
     int state1 = states1[pattern];\
     if (state1 < PADDED_STATE_COUNT)\
         sum1 = sMatrix1[state1 * PADDED_STATE_COUNT + state];\
     else\
         sum1 = 1.0;\
     for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        FMA(sMatrix2[i * PADDED_STATE_COUNT + state],  sPartials2[i], sum2);\
+        FMA(sMatrix2[i * PADDED_STATE_COUNT + state],  LOAD_PARTIAL(sPartials2, i), sum2);\
     }
 
 #define FIND_MAX_PARTIALS_X_CPU()\
@@ -78,7 +78,7 @@
         int deltaPartialsByMatrix = m * PADDED_STATE_COUNT * PATTERN_BLOCK_SIZE * KW_NUM_GROUPS_0;\
         int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;\
         for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            REAL iPartial = allPartials[deltaPartials + i];\
+            REAL iPartial = LOAD_PARTIAL(allPartials, deltaPartials + i);\
             if (iPartial > max)\
                 max = iPartial;\
         }\
@@ -89,7 +89,7 @@
         int deltaPartialsByMatrix = m * PADDED_STATE_COUNT * PATTERN_BLOCK_SIZE * KW_NUM_GROUPS_0;\
         int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;\
         for(int i = 0; i < PADDED_STATE_COUNT; i++) {\
-            allPartials[deltaPartials + i] /= max;\
+            STORE_PARTIAL(allPartials, deltaPartials + i, LOAD_PARTIAL(allPartials, deltaPartials + i) / max);\
         }\
     }
 
@@ -99,9 +99,9 @@
     int delta = patternCount * PADDED_STATE_COUNT;\
     REAL sumTotal = 0;\
     for (int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        REAL sumState = dRootPartials[i + u] * dWeights[0];\
+        REAL sumState = LOAD_PARTIAL(dRootPartials, i + u) * dWeights[0];\
         for(int r = 1; r < matrixCount; r++) {\
-            FMA(dRootPartials[i + u + delta * r],  dWeights[r], sumState);\
+            FMA(LOAD_PARTIAL(dRootPartials, i + u + delta * r),  dWeights[r], sumState);\
         }\
         sumState *= dFrequencies[i];\
         sumTotal += sumState;\
@@ -114,11 +114,11 @@
     REAL sumTotal = 0, sumTotalD1 = 0, sumTotalD2 = 0;\
     REAL tmpLogLike, tmpFirstDeriv;\
     for (int i = 0; i < PADDED_STATE_COUNT; i++) {\
-        REAL sumState = dRootPartials[   i + u] * dWeights[0];\
+        REAL sumState = LOAD_PARTIAL(dRootPartials, i + u) * dWeights[0];\
         REAL sumD1    = dRootFirstDeriv[ i + u] * dWeights[0];\
         REAL sumD2    = dRootSecondDeriv[i + u] * dWeights[0];\
         for(int r = 1; r < matrixCount; r++) {\
-            FMA(dRootPartials[   i + u + delta * r],  dWeights[r], sumState);\
+            FMA(LOAD_PARTIAL(dRootPartials, i + u + delta * r),  dWeights[r], sumState);\
             FMA(dRootFirstDeriv[ i + u + delta * r],  dWeights[r], sumD1);\
             FMA(dRootSecondDeriv[i + u + delta * r],  dWeights[r], sumD2);\
         }\
@@ -163,8 +163,8 @@
     /* copy PADDED_STATE_COUNT*PATTERN_BLOCK_SIZE lengthed partials */\
     /* These are all coherent global memory reads; checked in Profiler */\
     if (pattern < totalPatterns) {\
-        sPartials1[patIdx][state] = partials1[y + state];\
-        sPartials2[patIdx][state] = partials2[y + state];\
+        sPartials1[patIdx][state] = LOAD_PARTIAL(partials1, y + state);\
+        sPartials2[patIdx][state] = LOAD_PARTIAL(partials2, y + state);\
     } else {\
         sPartials1[patIdx][state] = 0;\
         sPartials2[patIdx][state] = 0;\
@@ -193,7 +193,7 @@
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];\
     int y = deltaPartialsByState + deltaPartialsByMatrix;\
     if (pattern < totalPatterns) {\
-        sPartials2[patIdx][state] = partials2[y + state];\
+        sPartials2[patIdx][state] = LOAD_PARTIAL(partials2, y + state);\
     } else {\
         sPartials2[patIdx][state] = 0;\
     }\
@@ -231,7 +231,7 @@
     KW_LOCAL_MEM REAL storedPartials[MATRIX_BLOCK_SIZE][PADDED_STATE_COUNT];\
     KW_LOCAL_MEM REAL max;\
     if (matrix < matrixCount)\
-        partials[matrix][state] = allPartials[offsetPartials];\
+        partials[matrix][state] = LOAD_PARTIAL(allPartials, offsetPartials);\
     else\
         partials[matrix][state] = 0;\
     storedPartials[matrix][state] = partials[matrix][state];\
@@ -271,7 +271,7 @@
 #define SCALE_PARTIALS_X_GPU()\
     KW_LOCAL_FENCE;\
     if (matrix < matrixCount)\
-        allPartials[offsetPartials] = storedPartials[matrix][state] / max;
+        STORE_PARTIAL(allPartials, offsetPartials, storedPartials[matrix][state] / max);
 
 #define INTEGRATE_PARTIALS_X_GPU()\
     int state   = KW_LOCAL_ID_0;\
@@ -292,7 +292,7 @@
     int u = state + pattern * PADDED_STATE_COUNT;\
     int delta = patternCount * PADDED_STATE_COUNT;\
     for(int r = 0; r < matrixCount; r++) {\
-        FMA(dRootPartials[u + delta * r], matrixProp[r], sum[state]);\
+        FMA(LOAD_PARTIAL(dRootPartials, u + delta * r), matrixProp[r], sum[state]);\
     }\
     sum[state] *= stateFreq[state];\
     KW_LOCAL_FENCE;
@@ -319,7 +319,7 @@
     int u = state + pattern * PADDED_STATE_COUNT;\
     int delta = patternCount * PADDED_STATE_COUNT;\
     for(int r = 0; r < matrixCount; r++) {\
-        FMA(dRootPartials[   u + delta * r], matrixProp[r], sum[state]  );\
+        FMA(LOAD_PARTIAL(dRootPartials, u + delta * r), matrixProp[r], sum[state]  );\
         FMA(dRootFirstDeriv[ u + delta * r], matrixProp[r], sumD1[state]);\
         FMA(dRootSecondDeriv[u + delta * r], matrixProp[r], sumD2[state]);\
     }\
@@ -368,27 +368,27 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 
-KW_GLOBAL_KERNEL void kernelPartialsPartialsNoScale(KW_GLOBAL_VAR REAL* KW_RESTRICT partials1,
-                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT partials2,
-                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+KW_GLOBAL_KERNEL void kernelPartialsPartialsNoScale(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials1,
+                                                    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                     int totalPatterns) {
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
     DETERMINE_INDICES_X_CPU();
     SUM_PARTIALS_PARTIALS_X_CPU();
-    partials3[u] = sum1 * sum2;
+    STORE_PARTIAL(partials3, u, sum1 * sum2);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     SUM_PARTIALS_PARTIALS_X_GPU();
     if (pattern < totalPatterns)
-        partials3[u] = sum1 * sum2;
+        STORE_PARTIAL(partials3, u, sum1 * sum2);
 #endif // FW_OPENCL_CPU
 }
 
-KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedScale(KW_GLOBAL_VAR REAL* KW_RESTRICT partials1,
-                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT partials2,
-                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedScale(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials1,
+                                                       KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                       KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                        KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                        KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                        KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
@@ -396,37 +396,162 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedScale(KW_GLOBAL_VAR REAL* KW_RE
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
     DETERMINE_INDICES_X_CPU();
     SUM_PARTIALS_PARTIALS_X_CPU();
-    partials3[u] = sum1 * sum2 / scalingFactors[pattern];
+    STORE_PARTIAL(partials3, u, sum1 * sum2 / scalingFactors[pattern]);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     LOAD_SCALING_X_GPU();
     SUM_PARTIALS_PARTIALS_X_GPU();
     if (pattern < totalPatterns)
-        partials3[u] = sum1 * sum2 / fixedScalingFactors[patIdx];
+        STORE_PARTIAL(partials3, u, sum1 * sum2 / fixedScalingFactors[patIdx]);
 #endif // FW_OPENCL_CPU
 }
 
+#ifdef PRUNING_MMA
+///////////////////////////////////////////////////////////////////////////////
+// tensor core pruning, CUDA sm_80 and later only
+//
+// The partials of PRUNING_MMA_PATTERN_BLOCK_SIZE patterns times a transition
+// matrix is a 16 x states x states GEMM, done in m16n8k8 TF32 mma tiles with
+// FP32 accumulation. Each operand is split into a TF32 value and a TF32
+// remainder and three products are summed, which keeps FP32 accuracy.
+
+#define MMA_STATE_COUNT  ((PADDED_STATE_COUNT + 7) / 8 * 8)
+#define MMA_SHARED_PITCH (MMA_STATE_COUNT + 4) // spreads fragment rows over banks
+
+KW_DEVICE_FUNC inline unsigned int toTF32(float x) {
+    unsigned int r;
+    asm("cvt.rna.tf32.f32 %0, %1;" : "=r"(r) : "f"(x));
+    return r;
+}
+
+KW_DEVICE_FUNC inline void splitTF32(float x, unsigned int* hi, unsigned int* lo) {
+    *hi = toTF32(x);
+    *lo = toTF32(x - __uint_as_float(*hi));
+}
+
+KW_DEVICE_FUNC inline void mmaTF32(float* c, const unsigned int* a, const unsigned int* b) {
+    asm volatile("mma.sync.aligned.m16n8k8.row.col.f32.tf32.tf32.f32 "
+                 "{%0, %1, %2, %3}, {%4, %5, %6, %7}, {%8, %9}, {%0, %1, %2, %3};"
+                 : "+f"(c[0]), "+f"(c[1]), "+f"(c[2]), "+f"(c[3])
+                 : "r"(a[0]), "r"(a[1]), "r"(a[2]), "r"(a[3]), "r"(b[0]), "r"(b[1]));
+}
+
+// Accumulates one 16 x 8 output tile of sPartials times matrix
+KW_DEVICE_FUNC inline void sumPartialsTileMMA(float* c,
+                                              KW_LOCAL_MEM REAL* sPartials,
+                                              KW_GLOBAL_VAR REAL* KW_RESTRICT matrix,
+                                              int stateTile,
+                                              int group,
+                                              int thread) {
+    int column = stateTile * 8 + group;
+    for (int k = 0; k < MMA_STATE_COUNT; k += 8) {
+        unsigned int aHi[4], aLo[4], bHi[2], bLo[2];
+        splitTF32(sPartials[ group      * MMA_SHARED_PITCH + k + thread    ], &aHi[0], &aLo[0]);
+        splitTF32(sPartials[(group + 8) * MMA_SHARED_PITCH + k + thread    ], &aHi[1], &aLo[1]);
+        splitTF32(sPartials[ group      * MMA_SHARED_PITCH + k + thread + 4], &aHi[2], &aLo[2]);
+        splitTF32(sPartials[(group + 8) * MMA_SHARED_PITCH + k + thread + 4], &aHi[3], &aLo[3]);
+        int row0 = k + thread;
+        int row1 = k + thread + 4;
+        bool inColumn = (column < PADDED_STATE_COUNT);
+        splitTF32((inColumn && row0 < PADDED_STATE_COUNT) ? matrix[row0 * PADDED_STATE_COUNT + column] : 0,
+                  &bHi[0], &bLo[0]);
+        splitTF32((inColumn && row1 < PADDED_STATE_COUNT) ? matrix[row1 * PADDED_STATE_COUNT + column] : 0,
+                  &bHi[1], &bLo[1]);
+        mmaTF32(c, aLo, bHi);
+        mmaTF32(c, aHi, bLo);
+        mmaTF32(c, aHi, bHi);
+    }
+}
+
+#define SUM_PARTIALS_PARTIALS_MMA_GPU()\
+    int warp = KW_LOCAL_ID_0 / 32;\
+    int group = (KW_LOCAL_ID_0 % 32) / 4;\
+    int thread = KW_LOCAL_ID_0 % 4;\
+    int matrix = KW_GROUP_ID_1;\
+    int firstPattern = KW_GROUP_ID_0 * PRUNING_MMA_PATTERN_BLOCK_SIZE;\
+    int deltaPartialsByMatrix = matrix * PADDED_STATE_COUNT * totalPatterns;\
+    int deltaMatrix = matrix * PADDED_STATE_COUNT * PADDED_STATE_COUNT;\
+    KW_LOCAL_MEM REAL sPartials1[PRUNING_MMA_PATTERN_BLOCK_SIZE * MMA_SHARED_PITCH];\
+    KW_LOCAL_MEM REAL sPartials2[PRUNING_MMA_PATTERN_BLOCK_SIZE * MMA_SHARED_PITCH];\
+    for (int i = KW_LOCAL_ID_0; i < PRUNING_MMA_PATTERN_BLOCK_SIZE * MMA_STATE_COUNT; i += KW_LOCAL_SIZE_0) {\
+        int patIdx = i / MMA_STATE_COUNT;\
+        int state = i % MMA_STATE_COUNT;\
+        int pattern = firstPattern + patIdx;\
+        int y = deltaPartialsByMatrix + pattern * PADDED_STATE_COUNT + state;\
+        bool inBlock = (pattern < totalPatterns && state < PADDED_STATE_COUNT);\
+        sPartials1[patIdx * MMA_SHARED_PITCH + state] = (inBlock ? LOAD_PARTIAL(partials1, y) : 0);\
+        sPartials2[patIdx * MMA_SHARED_PITCH + state] = (inBlock ? LOAD_PARTIAL(partials2, y) : 0);\
+    }\
+    KW_LOCAL_FENCE;
+
+#define STATE_TILE_MMA_GPU()\
+    float sum1[4] = {0, 0, 0, 0};\
+    float sum2[4] = {0, 0, 0, 0};\
+    sumPartialsTileMMA(sum1, sPartials1, matrices1 + deltaMatrix, stateTile, group, thread);\
+    sumPartialsTileMMA(sum2, sPartials2, matrices2 + deltaMatrix, stateTile, group, thread);
+
+#define STATE_TILE_ELEMENT_MMA_GPU()\
+    int pattern = firstPattern + group + (r / 2) * 8;\
+    int state = stateTile * 8 + thread * 2 + (r % 2);\
+    int u = deltaPartialsByMatrix + pattern * PADDED_STATE_COUNT + state;
+
+KW_GLOBAL_KERNEL void kernelPartialsPartialsNoScaleMMA(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials1,
+                                                       KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                       KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
+                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
+                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
+                                                       int totalPatterns) {
+    SUM_PARTIALS_PARTIALS_MMA_GPU();
+    for (int stateTile = warp; stateTile < MMA_STATE_COUNT / 8; stateTile += PRUNING_MMA_WARP_COUNT) {
+        STATE_TILE_MMA_GPU();
+        for (int r = 0; r < 4; r++) {
+            STATE_TILE_ELEMENT_MMA_GPU();
+            if (pattern < totalPatterns && state < PADDED_STATE_COUNT)
+                STORE_PARTIAL(partials3, u, sum1[r] * sum2[r]);
+        }
+    }
+}
+
+KW_GLOBAL_KERNEL void kernelPartialsPartialsFixedScaleMMA(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials1,
+                                                          KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                          KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
+                                                          KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
+                                                          KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
+                                                          KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
+                                                          int totalPatterns) {
+    SUM_PARTIALS_PARTIALS_MMA_GPU();
+    for (int stateTile = warp; stateTile < MMA_STATE_COUNT / 8; stateTile += PRUNING_MMA_WARP_COUNT) {
+        STATE_TILE_MMA_GPU();
+        for (int r = 0; r < 4; r++) {
+            STATE_TILE_ELEMENT_MMA_GPU();
+            if (pattern < totalPatterns && state < PADDED_STATE_COUNT)
+                STORE_PARTIAL(partials3, u, sum1[r] * sum2[r] / scalingFactors[pattern]);
+        }
+    }
+}
+#endif // PRUNING_MMA
+
 KW_GLOBAL_KERNEL void kernelStatesPartialsNoScale(KW_GLOBAL_VAR int* KW_RESTRICT states1,
-                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT partials2,
-                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+                                                  KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                  KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                   KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                   KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                   int totalPatterns) {
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
     DETERMINE_INDICES_X_CPU();
     SUM_STATES_PARTIALS_X_CPU();
-    partials3[u] = sum1 * sum2;
+    STORE_PARTIAL(partials3, u, sum1 * sum2);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     SUM_STATES_PARTIALS_X_GPU();
     if (pattern < totalPatterns)
-        partials3[u] = sum1 * sum2;
+        STORE_PARTIAL(partials3, u, sum1 * sum2);
 #endif // FW_OPENCL_CPU
 }
 
 KW_GLOBAL_KERNEL void kernelStatesPartialsFixedScale(KW_GLOBAL_VAR int* KW_RESTRICT states1,
-                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT partials2,
-                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+                                                     KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials2,
+                                                     KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
@@ -434,19 +559,19 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsFixedScale(KW_GLOBAL_VAR int* KW_RESTR
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
     DETERMINE_INDICES_X_CPU();
     SUM_STATES_PARTIALS_X_CPU();
-    partials3[u] = sum1 * sum2 / scalingFactors[pattern];
+    STORE_PARTIAL(partials3, u, sum1 * sum2 / scalingFactors[pattern]);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     LOAD_SCALING_X_GPU();
     SUM_STATES_PARTIALS_X_GPU();
     if (pattern < totalPatterns)
-        partials3[u] = sum1 * sum2 / fixedScalingFactors[patIdx];
+        STORE_PARTIAL(partials3, u, sum1 * sum2 / fixedScalingFactors[patIdx]);
 #endif // FW_OPENCL_CPU
 }
 
 KW_GLOBAL_KERNEL void kernelStatesStatesNoScale(KW_GLOBAL_VAR int* KW_RESTRICT states1,
                                                 KW_GLOBAL_VAR int* KW_RESTRICT states2,
-                                                KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+                                                KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                 int totalPatterns) {
@@ -457,13 +582,13 @@ KW_GLOBAL_KERNEL void kernelStatesStatesNoScale(KW_GLOBAL_VAR int* KW_RESTRICT s
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix1 = matrices1 + deltaMatrix + state1 * PADDED_STATE_COUNT;
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix2 = matrices2 + deltaMatrix + state2 * PADDED_STATE_COUNT;    
     if (state1 < PADDED_STATE_COUNT && state2 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix1[state] * matrix2[state];
+        STORE_PARTIAL(partials3, u, matrix1[state] * matrix2[state]);
     } else if (state1 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix1[state];
+        STORE_PARTIAL(partials3, u, matrix1[state]);
     } else if (state2 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix2[state];
+        STORE_PARTIAL(partials3, u, matrix2[state]);
     } else {
-        partials3[u] = 1.0;
+        STORE_PARTIAL(partials3, u, 1.0);
     }
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
@@ -473,13 +598,13 @@ KW_GLOBAL_KERNEL void kernelStatesStatesNoScale(KW_GLOBAL_VAR int* KW_RESTRICT s
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix2 = matrices2 + deltaMatrix + state2 * PADDED_STATE_COUNT;    
     if (pattern < totalPatterns) {
         if (state1 < PADDED_STATE_COUNT && state2 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix1[state] * matrix2[state];
+            STORE_PARTIAL(partials3, u, matrix1[state] * matrix2[state]);
         } else if (state1 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix1[state];
+            STORE_PARTIAL(partials3, u, matrix1[state]);
         } else if (state2 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix2[state];
+            STORE_PARTIAL(partials3, u, matrix2[state]);
         } else {
-            partials3[u] = 1.0;
+            STORE_PARTIAL(partials3, u, 1.0);
         }
     }
 #endif // FW_OPENCL_CPU
@@ -487,7 +612,7 @@ KW_GLOBAL_KERNEL void kernelStatesStatesNoScale(KW_GLOBAL_VAR int* KW_RESTRICT s
 
 KW_GLOBAL_KERNEL void kernelStatesStatesFixedScale(KW_GLOBAL_VAR int* KW_RESTRICT states1,
                                                    KW_GLOBAL_VAR int* KW_RESTRICT states2,
-                                                   KW_GLOBAL_VAR REAL* KW_RESTRICT partials3,
+                                                   KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT partials3,
                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT matrices1,
                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT matrices2,
                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
@@ -499,13 +624,13 @@ KW_GLOBAL_KERNEL void kernelStatesStatesFixedScale(KW_GLOBAL_VAR int* KW_RESTRIC
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix1 = matrices1 + deltaMatrix + state1 * PADDED_STATE_COUNT;
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix2 = matrices2 + deltaMatrix + state2 * PADDED_STATE_COUNT;
     if (state1 < PADDED_STATE_COUNT && state2 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix1[state] * matrix2[state] / scalingFactors[pattern];
+        STORE_PARTIAL(partials3, u, matrix1[state] * matrix2[state] / scalingFactors[pattern]);
     } else if (state1 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix1[state] / scalingFactors[pattern];
+        STORE_PARTIAL(partials3, u, matrix1[state] / scalingFactors[pattern]);
     } else if (state2 < PADDED_STATE_COUNT) {
-        partials3[u] = matrix2[state] / scalingFactors[pattern];
+        STORE_PARTIAL(partials3, u, matrix2[state] / scalingFactors[pattern]);
     } else {
-        partials3[u] = 1.0 / scalingFactors[pattern];
+        STORE_PARTIAL(partials3, u, 1.0 / scalingFactors[pattern]);
     }
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
@@ -517,20 +642,20 @@ KW_GLOBAL_KERNEL void kernelStatesStatesFixedScale(KW_GLOBAL_VAR int* KW_RESTRIC
     KW_LOCAL_FENCE;
     if (pattern < totalPatterns) {
         if (state1 < PADDED_STATE_COUNT && state2 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix1[state] * matrix2[state] / fixedScalingFactors[patIdx];
+            STORE_PARTIAL(partials3, u, matrix1[state] * matrix2[state] / fixedScalingFactors[patIdx]);
         } else if (state1 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix1[state] / fixedScalingFactors[patIdx];
+            STORE_PARTIAL(partials3, u, matrix1[state] / fixedScalingFactors[patIdx]);
         } else if (state2 < PADDED_STATE_COUNT) {
-            partials3[u] = matrix2[state] / fixedScalingFactors[patIdx];
+            STORE_PARTIAL(partials3, u, matrix2[state] / fixedScalingFactors[patIdx]);
         } else {
-            partials3[u] = 1.0 / fixedScalingFactors[patIdx];
+            STORE_PARTIAL(partials3, u, 1.0 / fixedScalingFactors[patIdx]);
         }
     }
 #endif // FW_OPENCL_CPU
 }
 
 // Find a scaling factor for each pattern
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScaling(KW_GLOBAL_VAR REAL* KW_RESTRICT allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScaling(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT allPartials,
                                                    KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
                                                    int matrixCount) {
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
@@ -556,7 +681,7 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScaling(KW_GLOBAL_VAR REAL* KW_RESTRI
 #endif // FW_OPENCL_CPU
 }
 
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingScalersLog(KW_GLOBAL_VAR REAL* KW_RESTRICT allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingScalersLog(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT allPartials,
                                                              KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
                                                              int matrixCount) {
 #ifdef FW_OPENCL_CPU // CPU/MIC implementation
@@ -591,7 +716,7 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingScalersLog(KW_GLOBAL_VAR REAL*
 
 
 // Find a scaling factor for each pattern and accumulate into buffer
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulate(KW_GLOBAL_VAR REAL* KW_RESTRICT allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulate(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT allPartials,
                                                              KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
                                                              KW_GLOBAL_VAR REAL* KW_RESTRICT cumulativeScaling,
                                                              int matrixCount) {
@@ -620,7 +745,7 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulate(KW_GLOBAL_VAR REAL*
 #endif // FW_OPENCL_CPU
 }
 
-KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateScalersLog(KW_GLOBAL_VAR REAL* KW_RESTRICT allPartials,
+KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateScalersLog(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT allPartials,
                                                                        KW_GLOBAL_VAR REAL* KW_RESTRICT scalingFactors,
                                                                        KW_GLOBAL_VAR REAL* KW_RESTRICT cumulativeScaling,
                                                                        int matrixCount) {
@@ -658,7 +783,7 @@ KW_GLOBAL_KERNEL void kernelPartialsDynamicScalingAccumulateScalersLog(KW_GLOBAL
 }
 
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoods(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
-                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                 KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dFrequencies,
                                                  int matrixCount,
@@ -679,7 +804,7 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoods(KW_GLOBAL_VAR REAL* KW_RESTRICT
 }
 
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsFixedScale(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
-                                                           KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                           KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dFrequencies,
                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dRootScalingFactors,
@@ -701,7 +826,7 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsFixedScale(KW_GLOBAL_VAR REAL* K
 }
 
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsMulti(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
-                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                      KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dFrequencies,
                                                       int matrixCount,
@@ -734,7 +859,7 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsMulti(KW_GLOBAL_VAR REAL* KW_RES
 }
 
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsFixedScaleMulti(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
-											                    KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+											                    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
                                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dFrequencies,
                                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dScalingFactors,
@@ -812,9 +937,9 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsFixedScaleMulti(KW_GLOBAL_VAR RE
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // edge and deriv kernels
 
-KW_GLOBAL_KERNEL void kernelPartialsPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL* KW_RESTRICT dPartialsTmp,
-                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dParentPartials,
-                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dChildParials,
+KW_GLOBAL_KERNEL void kernelPartialsPartialsEdgeLikelihoods(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dPartialsTmp,
+                                                            KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dParentPartials,
+                                                            KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dChildParials,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dTransMatrix,
                                                             int totalPatterns) {
 
@@ -822,13 +947,13 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL*
     DETERMINE_INDICES_X_CPU();
     int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = dTransMatrix + deltaMatrix;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials1 = dParentPartials + deltaPartials;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = dChildParials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials1 = dParentPartials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = dChildParials + deltaPartials;
     REAL sum1 = 0;
     for(int i = 0; i < PADDED_STATE_COUNT; i++) {
-        FMA(sMatrix1[i * PADDED_STATE_COUNT + state],  sPartials1[i], sum1);
+        FMA(sMatrix1[i * PADDED_STATE_COUNT + state],  LOAD_PARTIAL(sPartials1, i), sum1);
     }
-    dPartialsTmp[u] = sum1 * sPartials2[state];
+    STORE_PARTIAL(dPartialsTmp, u, sum1 * LOAD_PARTIAL(sPartials2, state));
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix1 = dTransMatrix + deltaMatrix;
@@ -837,8 +962,8 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL*
     KW_LOCAL_MEM REAL sPartials1[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     if (pattern < totalPatterns) {
-        sPartials1[patIdx][state] = dParentPartials[y + state];
-        sPartials2[patIdx][state] = dChildParials[y + state];
+        sPartials1[patIdx][state] = LOAD_PARTIAL(dParentPartials, y + state);
+        sPartials2[patIdx][state] = LOAD_PARTIAL(dChildParials, y + state);
     } else {
         sPartials1[patIdx][state] = 0;
         sPartials2[patIdx][state] = 0;
@@ -858,7 +983,7 @@ KW_GLOBAL_KERNEL void kernelPartialsPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL*
         KW_LOCAL_FENCE;
     }
     if (pattern < totalPatterns)
-        dPartialsTmp[u] = sum1 * sPartials2[patIdx][state];
+        STORE_PARTIAL(dPartialsTmp, u, sum1 * sPartials2[patIdx][state]);
 #endif // FW_OPENCL_CPU
 }
 
@@ -867,11 +992,11 @@ KW_GLOBAL_KERNEL void
 #ifdef CUDA
 __launch_bounds__(PATTERN_BLOCK_SIZE * PADDED_STATE_COUNT)
 #endif
-kernelPartialsPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT dPartialsTmp,
+kernelPartialsPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dPartialsTmp,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivTmp,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dSecondDerivTmp,
-                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dParentPartials,
-                                                 KW_GLOBAL_VAR REAL* KW_RESTRICT dChildParials,
+                                                 KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dParentPartials,
+                                                 KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dChildParials,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dTransMatrix,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivMatrix,
                                                  KW_GLOBAL_VAR REAL* KW_RESTRICT dSecondDerivMatrix,
@@ -882,19 +1007,19 @@ kernelPartialsPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = dTransMatrix + deltaMatrix;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrixFirstDeriv = dFirstDerivMatrix + deltaMatrix;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrixSecondDeriv = dSecondDerivMatrix + deltaMatrix;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials1 = dParentPartials + deltaPartials;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = dChildParials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials1 = dParentPartials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = dChildParials + deltaPartials;
     REAL sum1 = 0;
     REAL sumFirstDeriv = 0;
     REAL sumSecondDeriv = 0;
     for(int i = 0; i < PADDED_STATE_COUNT; i++) {
-        FMA(sMatrix1[          i * PADDED_STATE_COUNT + state], sPartials1[i], sum1);
-        FMA(sMatrixFirstDeriv[ i * PADDED_STATE_COUNT + state], sPartials1[i], sumFirstDeriv);
-        FMA(sMatrixSecondDeriv[i * PADDED_STATE_COUNT + state], sPartials1[i], sumSecondDeriv);
+        FMA(sMatrix1[          i * PADDED_STATE_COUNT + state], LOAD_PARTIAL(sPartials1, i), sum1);
+        FMA(sMatrixFirstDeriv[ i * PADDED_STATE_COUNT + state], LOAD_PARTIAL(sPartials1, i), sumFirstDeriv);
+        FMA(sMatrixSecondDeriv[i * PADDED_STATE_COUNT + state], LOAD_PARTIAL(sPartials1, i), sumSecondDeriv);
     }
-    dPartialsTmp[u]    = sum1           * sPartials2[state];
-    dFirstDerivTmp[u]  = sumFirstDeriv  * sPartials2[state];
-    dSecondDerivTmp[u] = sumSecondDeriv * sPartials2[state];
+    STORE_PARTIAL(dPartialsTmp, u, sum1 * LOAD_PARTIAL(sPartials2, state));
+    dFirstDerivTmp[u]  = sumFirstDeriv  * LOAD_PARTIAL(sPartials2, state);
+    dSecondDerivTmp[u] = sumSecondDeriv * LOAD_PARTIAL(sPartials2, state);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     KW_GLOBAL_VAR REAL* KW_RESTRICT matrix1 = dTransMatrix + deltaMatrix; // Points to *this* matrix
@@ -907,8 +1032,8 @@ kernelPartialsPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT
     KW_LOCAL_MEM REAL sPartials1[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     if (pattern < totalPatterns) {
-        sPartials1[patIdx][state] = dParentPartials[y + state];
-        sPartials2[patIdx][state] = dChildParials[y + state];
+        sPartials1[patIdx][state] = LOAD_PARTIAL(dParentPartials, y + state);
+        sPartials2[patIdx][state] = LOAD_PARTIAL(dChildParials, y + state);
     } else {
         sPartials1[patIdx][state] = 0;
         sPartials2[patIdx][state] = 0;
@@ -936,15 +1061,15 @@ kernelPartialsPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT
         KW_LOCAL_FENCE;
     }
     if (pattern < totalPatterns) {
-        dPartialsTmp[u] = sum1 * sPartials2[patIdx][state];
+        STORE_PARTIAL(dPartialsTmp, u, sum1 * sPartials2[patIdx][state]);
         dFirstDerivTmp[u] = sumFirstDeriv * sPartials2[patIdx][state];
         dSecondDerivTmp[u] = sumSecondDeriv * sPartials2[patIdx][state];
     }
 #endif // FW_OPENCL_CPU
 }
 
-KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL* KW_RESTRICT dPartialsTmp,
-                                                          KW_GLOBAL_VAR REAL* KW_RESTRICT dParentPartials,
+KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoods(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dPartialsTmp,
+                                                          KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dParentPartials,
                                                           KW_GLOBAL_VAR int* KW_RESTRICT dChildStates,
                                                           KW_GLOBAL_VAR REAL* KW_RESTRICT dTransMatrix,
                                                           int totalPatterns) {
@@ -952,20 +1077,20 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL* KW
     DETERMINE_INDICES_X_CPU();
     int deltaPartials = deltaPartialsByMatrix + deltaPartialsByState;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = dTransMatrix + deltaMatrix;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = dParentPartials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = dParentPartials + deltaPartials;
     REAL sum1 = 0;
     int state1 = dChildStates[pattern];
     if (state1 < PADDED_STATE_COUNT)
         sum1 = sMatrix1[state1 * PADDED_STATE_COUNT + state];
     else
         sum1 = 1.0;
-    dPartialsTmp[u] = sum1 * sPartials2[state];
+    STORE_PARTIAL(dPartialsTmp, u, sum1 * LOAD_PARTIAL(sPartials2, state));
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     int y = deltaPartialsByState + deltaPartialsByMatrix;
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     if (pattern < totalPatterns) {
-        sPartials2[patIdx][state] = dParentPartials[y + state];
+        sPartials2[patIdx][state] = LOAD_PARTIAL(dParentPartials, y + state);
     } else {
         sPartials2[patIdx][state] = 0;
     }
@@ -979,14 +1104,14 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoods(KW_GLOBAL_VAR REAL* KW
             sum1 = 1.0;
     }
     if (pattern < totalPatterns)
-        dPartialsTmp[u] = sum1 * sPartials2[patIdx][state];
+        STORE_PARTIAL(dPartialsTmp, u, sum1 * sPartials2[patIdx][state]);
 #endif // FW_OPENCL_CPU
 }
 
-KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT dPartialsTmp,
+KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dPartialsTmp,
                                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivTmp,
                                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dSecondDerivTmp,
-                                                                     KW_GLOBAL_VAR REAL* KW_RESTRICT dParentPartials,
+                                                                     KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dParentPartials,
                                                                      KW_GLOBAL_VAR int* KW_RESTRICT dChildStates,
                                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dTransMatrix,
                                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivMatrix,
@@ -998,7 +1123,7 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_V
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrix1 = dTransMatrix + deltaMatrix;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrixFirstDeriv = dFirstDerivMatrix + deltaMatrix;
     KW_GLOBAL_VAR REAL* KW_RESTRICT sMatrixSecondDeriv = dSecondDerivMatrix + deltaMatrix;
-    KW_GLOBAL_VAR REAL* KW_RESTRICT sPartials2 = dParentPartials + deltaPartials;
+    KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT sPartials2 = dParentPartials + deltaPartials;
     REAL sum1 = 0;
     REAL sumFirstDeriv = 0;
     REAL sumSecondDeriv = 0;
@@ -1010,15 +1135,15 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_V
     } else {
         sum1 = 1.0;
     }
-    dPartialsTmp[u]    = sum1           * sPartials2[state];
-    dFirstDerivTmp[u]  = sumFirstDeriv  * sPartials2[state];
-    dSecondDerivTmp[u] = sumSecondDeriv * sPartials2[state];
+    STORE_PARTIAL(dPartialsTmp, u, sum1 * LOAD_PARTIAL(sPartials2, state));
+    dFirstDerivTmp[u]  = sumFirstDeriv  * LOAD_PARTIAL(sPartials2, state);
+    dSecondDerivTmp[u] = sumSecondDeriv * LOAD_PARTIAL(sPartials2, state);
 #else // GPU implementation
     DETERMINE_INDICES_X_GPU();
     int y = deltaPartialsByState + deltaPartialsByMatrix;
     KW_LOCAL_MEM REAL sPartials2[PATTERN_BLOCK_SIZE][PADDED_STATE_COUNT];
     if (pattern < totalPatterns) {
-        sPartials2[patIdx][state] = dParentPartials[y + state];
+        sPartials2[patIdx][state] = LOAD_PARTIAL(dParentPartials, y + state);
     } else {
         sPartials2[patIdx][state] = 0;
     }
@@ -1041,7 +1166,7 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_V
         }
     }
     if (pattern < totalPatterns) {
-        dPartialsTmp[u] = sum1 * sPartials2[patIdx][state];
+        STORE_PARTIAL(dPartialsTmp, u, sum1 * sPartials2[patIdx][state]);
         dFirstDerivTmp[u] = sumFirstDeriv * sPartials2[patIdx][state];
         dSecondDerivTmp[u] = sumSecondDeriv * sPartials2[patIdx][state];   
     }
@@ -1051,7 +1176,7 @@ KW_GLOBAL_KERNEL void kernelStatesPartialsEdgeLikelihoodsSecondDeriv(KW_GLOBAL_V
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivResult,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dSecondDerivResult,
-                                                            KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                            KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dRootFirstDeriv,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dRootSecondDeriv,
                                                             KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
@@ -1085,7 +1210,7 @@ KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsSecondDeriv(KW_GLOBAL_VAR REAL*
 KW_GLOBAL_KERNEL void kernelIntegrateLikelihoodsFixedScaleSecondDeriv(KW_GLOBAL_VAR REAL* KW_RESTRICT dResult,
                                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dFirstDerivResult,
                                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dSecondDerivResult,
-                                                                      KW_GLOBAL_VAR REAL* KW_RESTRICT dRootPartials,
+                                                                      KW_GLOBAL_VAR PARTIALS_REAL* KW_RESTRICT dRootPartials,
                                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dRootFirstDeriv,
                                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dRootSecondDeriv,
                                                                       KW_GLOBAL_VAR REAL* KW_RESTRICT dWeights,
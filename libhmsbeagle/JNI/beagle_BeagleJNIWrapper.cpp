@@ -96,6 +96,48 @@ JNIEXPORT jobjectArray JNICALL Java_beagle_BeagleJNIWrapper_getResourceList
 	return resourceArray;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    compressPatterns
+ * Signature: (II[I[D[I[I[I[D[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_compressPatterns
+  (JNIEnv *env, jobject obj, jint taxonCount, jint siteCount, jintArray inSiteStates,
+   jdoubleArray inSiteWeights, jintArray inSitePartitions, jintArray outPatternCount,
+   jintArray outPatternStates, jdoubleArray outPatternWeights, jintArray outPatternPartitions,
+   jintArray outSitePatterns)
+{
+    jint *siteStates = env->GetIntArrayElements(inSiteStates, NULL);
+    jdouble *siteWeights = (inSiteWeights != NULL ? env->GetDoubleArrayElements(inSiteWeights, NULL) : NULL);
+    jint *sitePartitions = (inSitePartitions != NULL ? env->GetIntArrayElements(inSitePartitions, NULL) : NULL);
+    jint *patternCount = env->GetIntArrayElements(outPatternCount, NULL);
+    jint *patternStates = env->GetIntArrayElements(outPatternStates, NULL);
+    jdouble *patternWeights = env->GetDoubleArrayElements(outPatternWeights, NULL);
+    jint *patternPartitions = (outPatternPartitions != NULL ? env->GetIntArrayElements(outPatternPartitions, NULL) : NULL);
+    jint *sitePatterns = (outSitePatterns != NULL ? env->GetIntArrayElements(outSitePatterns, NULL) : NULL);
+
+    jint errCode = (jint)beagleCompressPatterns(taxonCount, siteCount, (int *)siteStates,
+                                                (double *)siteWeights, (int *)sitePartitions,
+                                                (int *)patternCount, (int *)patternStates,
+                                                (double *)patternWeights, (int *)patternPartitions,
+                                                (int *)sitePatterns);
+
+    env->ReleaseIntArrayElements(inSiteStates, siteStates, JNI_ABORT);
+    if (siteWeights != NULL)
+        env->ReleaseDoubleArrayElements(inSiteWeights, siteWeights, JNI_ABORT);
+    if (sitePartitions != NULL)
+        env->ReleaseIntArrayElements(inSitePartitions, sitePartitions, JNI_ABORT);
+    // not using JNI_ABORT flag here because we want the values to be copied back...
+    env->ReleaseIntArrayElements(outPatternCount, patternCount, 0);
+    env->ReleaseIntArrayElements(outPatternStates, patternStates, 0);
+    env->ReleaseDoubleArrayElements(outPatternWeights, patternWeights, 0);
+    if (patternPartitions != NULL)
+        env->ReleaseIntArrayElements(outPatternPartitions, patternPartitions, 0);
+    if (sitePatterns != NULL)
+        env->ReleaseIntArrayElements(outSitePatterns, sitePatterns, 0);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    createInstance
@@ -202,6 +244,104 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPatternPartitions
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setCPUThreadCount
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setCPUThreadCount
+  (JNIEnv *env, jobject obj, jint instance, jint threadCount)
+{
+	jint errCode = (jint)beagleSetCPUThreadCount(instance, threadCount);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixCacheSize
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixCacheSize
+  (JNIEnv *env, jobject obj, jint instance, jint cacheSize)
+{
+	jint errCode = (jint)beagleSetTransitionMatrixCacheSize(instance, cacheSize);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setIncrementalUpdates
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setIncrementalUpdates
+  (JNIEnv *env, jobject obj, jint instance, jint enabled)
+{
+	jint errCode = (jint)beagleSetIncrementalUpdates(instance, enabled);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setExponentScaling
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setExponentScaling
+  (JNIEnv *env, jobject obj, jint instance, jint enabled)
+{
+	jint errCode = (jint)beagleSetExponentScaling(instance, enabled);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setAdaptiveRescaling
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setAdaptiveRescaling
+  (JNIEnv *env, jobject obj, jint instance, jint enabled)
+{
+	jint errCode = (jint)beagleSetAdaptiveRescaling(instance, enabled);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setSiteRepeats
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setSiteRepeats
+  (JNIEnv *env, jobject obj, jint instance, jint enabled)
+{
+	jint errCode = (jint)beagleSetSiteRepeats(instance, enabled);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setPartialsBackingDirectory
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartialsBackingDirectory
+  (JNIEnv *env, jobject obj, jint instance, jstring inDirectory)
+{
+    const char* directory = env->GetStringUTFChars(inDirectory, NULL);
+	jint errCode = (jint)beagleSetPartialsBackingDirectory(instance, directory);
+    env->ReleaseStringUTFChars(inDirectory, directory);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setOperationGraphs
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setOperationGraphs
+  (JNIEnv *env, jobject obj, jint instance, jint enabled)
+{
+	jint errCode = (jint)beagleSetOperationGraphs(instance, enabled);
+    return errCode;
+}
+
 
 /*
  * Class:     beagle_BeagleJNIWrapper
@@ -219,6 +359,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStates
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStateSets
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStateSets
+(JNIEnv *env, jobject obj, jint instance, jint tipIndex, jintArray inStateSets)
+{
+    jint *stateSets = env->GetIntArrayElements(inStateSets, NULL);
+
+	jint errCode = (jint)beagleSetTipStateSets(instance, tipIndex, (int *)stateSets);
+
+    env->ReleaseIntArrayElements(inStateSets, stateSets, JNI_ABORT);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getTipStates
@@ -254,6 +410,42 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStatesBatch
+ * Signature: (I[I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStatesBatch
+(JNIEnv *env, jobject obj, jint instance, jintArray inTipIndices, jintArray inTipStates, jint count)
+{
+    jint *tipIndices = env->GetIntArrayElements(inTipIndices, NULL);
+    jint *tipStates = env->GetIntArrayElements(inTipStates, NULL);
+
+	jint errCode = (jint)beagleSetTipStatesBatch(instance, (int *)tipIndices, (int *)tipStates, count);
+
+    env->ReleaseIntArrayElements(inTipStates, tipStates, JNI_ABORT);
+    env->ReleaseIntArrayElements(inTipIndices, tipIndices, JNI_ABORT);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipPartialsBatch
+ * Signature: (I[I[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartialsBatch
+(JNIEnv *env, jobject obj, jint instance, jintArray inTipIndices, jdoubleArray inPartials, jint count)
+{
+    jint *tipIndices = env->GetIntArrayElements(inTipIndices, NULL);
+    jdouble *partials = env->GetDoubleArrayElements(inPartials, NULL);
+
+	jint errCode = (jint)beagleSetTipPartialsBatch(instance, (int *)tipIndices, (double *)partials, count);
+
+    env->ReleaseDoubleArrayElements(inPartials, partials, JNI_ABORT);
+    env->ReleaseIntArrayElements(inTipIndices, tipIndices, JNI_ABORT);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setPartials
@@ -270,6 +462,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setPartialsDirect
+ * Signature: (IILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartialsDirect
+  (JNIEnv *env, jobject obj, jint instance, jint bufferIndex, jobject inPartials)
+{
+    double *partials = (double *)env->GetDirectBufferAddress(inPartials);
+    if (partials == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+	jint errCode = (jint)beagleSetPartials(instance, bufferIndex, partials);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getPartials
@@ -287,6 +495,58 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getPartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getPartialsDirect
+ * Signature: (IIILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getPartialsDirect
+  (JNIEnv *env, jobject obj, jint instance, jint bufferIndex, jint scaleIndex, jobject outPartials)
+{
+    double *partials = (double *)env->GetDirectBufferAddress(outPartials);
+    if (partials == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    jint errCode = beagleGetPartials(instance, bufferIndex, scaleIndex, partials);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    releasePartials
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_releasePartials
+  (JNIEnv *env, jobject obj, jint instance, jint bufferIndex)
+{
+	jint errCode = (jint)beagleReleasePartials(instance, bufferIndex);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    saveState
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_saveState
+  (JNIEnv *env, jobject obj, jint instance)
+{
+	jint errCode = (jint)beagleSaveState(instance);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    restoreState
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_restoreState
+  (JNIEnv *env, jobject obj, jint instance)
+{
+	jint errCode = (jint)beagleRestoreState(instance);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getLogScaleFactors
@@ -413,6 +673,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrix
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixDirect
+ * Signature: (IILjava/nio/DoubleBuffer;D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixDirect
+  (JNIEnv *env, jobject obj, jint instance, jint matrixIndex, jobject inMatrix, jdouble paddedValue)
+{
+    double *matrix = (double *)env->GetDirectBufferAddress(inMatrix);
+    if (matrix == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+	jint errCode = (jint)beagleSetTransitionMatrix(instance, matrixIndex, matrix, paddedValue);
+    return errCode;
+}
+
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrix
   (JNIEnv *env, jobject obj, jint instance, jint matrixIndex, jdoubleArray outMatrix)
 {
@@ -425,6 +701,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrix
 	return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getTransitionMatrixDirect
+ * Signature: (IILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrixDirect
+  (JNIEnv *env, jobject obj, jint instance, jint matrixIndex, jobject outMatrix)
+{
+	double *matrix = (double *)env->GetDirectBufferAddress(outMatrix);
+	if (matrix == NULL)
+		return BEAGLE_ERROR_GENERAL;
+
+	jint errCode = (jint)beagleGetTransitionMatrix(instance, matrixIndex, matrix);
+	return errCode;
+}
+
 
 ///////////////////////////
 //---TODO: Epoch model---//
@@ -520,6 +812,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsDirect
+ * Signature: (ILjava/nio/IntBuffer;II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsDirect
+  (JNIEnv *env, jobject obj, jint instance, jobject inOperations, jint operationCount, jint cumulativeScalingIndex)
+{
+    int *operations = (int *)env->GetDirectBufferAddress(inOperations);
+    if (operations == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+	jint errCode = (jint)beagleUpdatePartials(instance, (BeagleOperation*)operations, operationCount, cumulativeScalingIndex);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    updatePartialsByPartition
@@ -537,6 +845,71 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsByPartition
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsForTrees
+ * Signature: (I[I[II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsForTrees
+  (JNIEnv *env, jobject obj, jint instance, jintArray inOperations, jintArray inOperationCounts, jint treeCount,
+   jintArray inCumulativeScaleIndices)
+{
+    jint *operations = env->GetIntArrayElements(inOperations, NULL);
+    jint *operationCounts = env->GetIntArrayElements(inOperationCounts, NULL);
+    jint *cumulativeScaleIndices = NULL;
+    if (inCumulativeScaleIndices != NULL)
+        cumulativeScaleIndices = env->GetIntArrayElements(inCumulativeScaleIndices, NULL);
+
+    jint errCode = (jint)beagleUpdatePartialsForTrees(instance, (BeagleOperation*)operations,
+                                                      (int *)operationCounts, treeCount,
+                                                      (int *)cumulativeScaleIndices);
+
+    if (cumulativeScaleIndices != NULL)
+        env->ReleaseIntArrayElements(inCumulativeScaleIndices, cumulativeScaleIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inOperationCounts, operationCounts, JNI_ABORT);
+    env->ReleaseIntArrayElements(inOperations, operations, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setRootPrePartials
+ * Signature: (I[I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setRootPrePartials
+  (JNIEnv *env, jobject obj, jint instance, jintArray inBufferIndices, jintArray inStateFrequenciesIndices,
+   jint count)
+{
+    jint *bufferIndices = env->GetIntArrayElements(inBufferIndices, NULL);
+    jint *frequenciesIndices = env->GetIntArrayElements(inStateFrequenciesIndices, NULL);
+
+    jint errCode = (jint)beagleSetRootPrePartials(instance, (int *)bufferIndices, (int *)frequenciesIndices,
+                                                  count);
+
+    env->ReleaseIntArrayElements(inStateFrequenciesIndices, frequenciesIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inBufferIndices, bufferIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePrePartials
+ * Signature: (I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePrePartials
+  (JNIEnv *env, jobject obj, jint instance, jintArray inOperations, jint operationCount)
+{
+    jint *operations = env->GetIntArrayElements(inOperations, NULL);
+
+    jint errCode = (jint)beagleUpdatePrePartials(instance, (BeagleOperation*)operations, operationCount);
+
+    env->ReleaseIntArrayElements(inOperations, operations, JNI_ABORT);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    waitForPartials
@@ -687,6 +1060,86 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoods
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsAsync
+ * Signature: (I[I[I[I[III)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsAsync
+  (JNIEnv *env, jobject obj, jint instance, jintArray inBufferIndices, jintArray inCategoryWeightsIndices,
+   jintArray inStateFrequenciesIndices, jintArray inScalingIndices, jint count, jint resultIndex)
+{
+    jint *bufferIndices = env->GetIntArrayElements(inBufferIndices, NULL);
+    jint *weightsIndices = env->GetIntArrayElements(inCategoryWeightsIndices, NULL);
+    jint *frequenciesIndices = env->GetIntArrayElements(inStateFrequenciesIndices, NULL);
+    jint *scalingIndices = env->GetIntArrayElements(inScalingIndices, NULL);
+
+    jint errCode = (jint)beagleCalculateRootLogLikelihoodsAsync(instance, (int *)bufferIndices,
+                                                                (int *)weightsIndices,
+                                                                (int *)frequenciesIndices,
+                                                                (int *)scalingIndices,
+                                                                count, resultIndex);
+
+    env->ReleaseIntArrayElements(inScalingIndices, scalingIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inStateFrequenciesIndices, frequenciesIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inCategoryWeightsIndices, weightsIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inBufferIndices, bufferIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsForTrees
+ * Signature: (I[I[I[I[II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsForTrees
+  (JNIEnv *env, jobject obj, jint instance, jintArray inBufferIndices, jintArray inCategoryWeightsIndices,
+   jintArray inStateFrequenciesIndices, jintArray inScalingIndices, jint treeCount, jdoubleArray outSumLogLikelihoods)
+{
+    jint *bufferIndices = env->GetIntArrayElements(inBufferIndices, NULL);
+    jint *weightsIndices = env->GetIntArrayElements(inCategoryWeightsIndices, NULL);
+    jint *frequenciesIndices = env->GetIntArrayElements(inStateFrequenciesIndices, NULL);
+    jint *scalingIndices = env->GetIntArrayElements(inScalingIndices, NULL);
+
+    jdouble *sumLogLikelihoods = env->GetDoubleArrayElements(outSumLogLikelihoods, NULL);
+
+    jint errCode = (jint)beagleCalculateRootLogLikelihoodsForTrees(instance, (int *)bufferIndices,
+                                                                   (int *)weightsIndices,
+                                                                   (int *)frequenciesIndices,
+                                                                   (int *)scalingIndices,
+                                                                   treeCount, (double *)sumLogLikelihoods);
+
+    env->ReleaseDoubleArrayElements(outSumLogLikelihoods, sumLogLikelihoods, 0);
+
+    env->ReleaseIntArrayElements(inScalingIndices, scalingIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inStateFrequenciesIndices, frequenciesIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inCategoryWeightsIndices, weightsIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inBufferIndices, bufferIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getLogLikelihoodResults
+ * Signature: (I[II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getLogLikelihoodResults
+  (JNIEnv *env, jobject obj, jint instance, jintArray inResultIndices, jint count, jdoubleArray outSumLogLikelihoods)
+{
+    jint *resultIndices = env->GetIntArrayElements(inResultIndices, NULL);
+    jdouble *sumLogLikelihoods = env->GetDoubleArrayElements(outSumLogLikelihoods, NULL);
+
+    jint errCode = (jint)beagleGetLogLikelihoodResults(instance, (int *)resultIndices, count,
+                                                       (double *)sumLogLikelihoods);
+
+    env->ReleaseDoubleArrayElements(outSumLogLikelihoods, sumLogLikelihoods, 0);
+    env->ReleaseIntArrayElements(inResultIndices, resultIndices, JNI_ABORT);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    calculateRootLogLikelihoodsByPartition
@@ -802,6 +1255,203 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoods
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getSiteLogLikelihoodsDirect
+ * Signature: (ILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoodsDirect
+(JNIEnv *env, jobject obj, jint instance, jobject outSiteLogLikelihoods) {
+	double *siteLogLikelihoods = (double *)env->GetDirectBufferAddress(outSiteLogLikelihoods);
+	if (siteLogLikelihoods == NULL)
+		return BEAGLE_ERROR_GENERAL;
+
+	jint errCode = (jint)beagleGetSiteLogLikelihoods(instance, siteLogLikelihoods);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateEdgeDerivatives
+ * Signature: (I[I[I[I[I[II[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateEdgeDerivatives
+  (JNIEnv *env, jobject obj, jint instance, jintArray inPostBufferIndices, jintArray inPreBufferIndices,
+   jintArray inProbabilityIndices, jintArray inDerivativeMatrixIndices, jintArray inCategoryWeightsIndices,
+   jint count, jdoubleArray outDerivatives, jdoubleArray outSumDerivatives)
+{
+    jint *postIndices = env->GetIntArrayElements(inPostBufferIndices, NULL);
+    jint *preIndices = env->GetIntArrayElements(inPreBufferIndices, NULL);
+    jint *probabilityIndices = env->GetIntArrayElements(inProbabilityIndices, NULL);
+    jint *derivativeIndices = env->GetIntArrayElements(inDerivativeMatrixIndices, NULL);
+    jint *weightsIndices = env->GetIntArrayElements(inCategoryWeightsIndices, NULL);
+
+    jdouble *derivatives = NULL;
+    if (outDerivatives != NULL)
+        derivatives = env->GetDoubleArrayElements(outDerivatives, NULL);
+    jdouble *sumDerivatives = env->GetDoubleArrayElements(outSumDerivatives, NULL);
+
+    jint errCode = (jint)beagleCalculateEdgeDerivatives(instance, (int *)postIndices, (int *)preIndices,
+                                                        (int *)probabilityIndices, (int *)derivativeIndices,
+                                                        (int *)weightsIndices, count,
+                                                        (double *)derivatives, (double *)sumDerivatives);
+
+    env->ReleaseDoubleArrayElements(outSumDerivatives, sumDerivatives, 0);
+    if (derivatives != NULL)
+        env->ReleaseDoubleArrayElements(outDerivatives, derivatives, 0);
+
+    env->ReleaseIntArrayElements(inCategoryWeightsIndices, weightsIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inDerivativeMatrixIndices, derivativeIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inProbabilityIndices, probabilityIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inPreBufferIndices, preIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inPostBufferIndices, postIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+// Command codes of executeCommands, as in Beagle.java
+enum JNICommand {
+    JNI_COMMAND_UPDATE_TRANSITION_MATRICES = 0,
+    JNI_COMMAND_UPDATE_PARTIALS,
+    JNI_COMMAND_RESET_SCALE_FACTORS,
+    JNI_COMMAND_ACCUMULATE_SCALE_FACTORS,
+    JNI_COMMAND_REMOVE_SCALE_FACTORS,
+    JNI_COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS
+};
+
+// Runs the packed commands in order and stops at the first error, other than a
+// floating-point error in a root likelihood, which is returned at the end. Each
+// command starts with its code and the position of its instance in instances.
+static jint executeCommands(const jint* instances, jint instanceCount,
+                            const jint* commands, jint commandLength,
+                            const jdouble* values, jint valueCount,
+                            jdouble* results, jint resultCount) {
+    jint c = 0;
+    jint v = 0;
+    jint r = 0;
+    jint returnCode = BEAGLE_SUCCESS;
+    while (c < commandLength) {
+        if (commandLength - c < 2 || commands[c + 1] < 0 || commands[c + 1] >= instanceCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        jint code = commands[c];
+        int instance = instances[commands[c + 1]];
+        const jint* arguments = commands + c + 2;
+        jint available = commandLength - c - 2;
+        jint length;
+        jint errCode;
+
+        switch (code) {
+            case JNI_COMMAND_UPDATE_TRANSITION_MATRICES: {
+                // eigenIndex, count, probabilityIndices[count]; count edge lengths from values
+                if (available < 2 || arguments[1] < 0)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                jint count = arguments[1];
+                length = 2 + count;
+                if (available < length || valueCount - v < count)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                errCode = beagleUpdateTransitionMatrices(instance, arguments[0], (const int*) arguments + 2,
+                                                         NULL, NULL, (const double*) values + v, count);
+                v += count;
+                break;
+            }
+            case JNI_COMMAND_UPDATE_PARTIALS: {
+                // operationCount, cumulativeScaleIndex, operations[operationCount * BEAGLE_OP_COUNT]
+                if (available < 2 || arguments[0] < 0)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                length = 2 + arguments[0] * BEAGLE_OP_COUNT;
+                if (available < length)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                errCode = beagleUpdatePartials(instance, (const BeagleOperation*) (arguments + 2),
+                                               arguments[0], arguments[1]);
+                break;
+            }
+            case JNI_COMMAND_RESET_SCALE_FACTORS: {
+                // cumulativeScaleIndex
+                length = 1;
+                if (available < length)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                errCode = beagleResetScaleFactors(instance, arguments[0]);
+                break;
+            }
+            case JNI_COMMAND_ACCUMULATE_SCALE_FACTORS:
+            case JNI_COMMAND_REMOVE_SCALE_FACTORS: {
+                // count, cumulativeScaleIndex, scaleIndices[count]
+                if (available < 2 || arguments[0] < 0)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                length = 2 + arguments[0];
+                if (available < length)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                if (code == JNI_COMMAND_ACCUMULATE_SCALE_FACTORS)
+                    errCode = beagleAccumulateScaleFactors(instance, (const int*) arguments + 2,
+                                                           arguments[0], arguments[1]);
+                else
+                    errCode = beagleRemoveScaleFactors(instance, (const int*) arguments + 2,
+                                                       arguments[0], arguments[1]);
+                break;
+            }
+            case JNI_COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS: {
+                // count, bufferIndices[count], categoryWeightsIndices[count],
+                // stateFrequenciesIndices[count], cumulativeScaleIndices[count]; one result
+                if (available < 1 || arguments[0] < 0)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                jint count = arguments[0];
+                length = 1 + 4 * count;
+                if (available < length || r >= resultCount)
+                    return BEAGLE_ERROR_OUT_OF_RANGE;
+                const int* indices = (const int*) arguments + 1;
+                errCode = beagleCalculateRootLogLikelihoods(instance, indices, indices + count,
+                                                            indices + 2 * count, indices + 3 * count,
+                                                            count, (double*) results + r);
+                r++;
+                break;
+            }
+            default:
+                return BEAGLE_ERROR_OUT_OF_RANGE;
+        }
+
+        if (errCode == BEAGLE_ERROR_FLOATING_POINT && code == JNI_COMMAND_CALCULATE_ROOT_LOG_LIKELIHOODS)
+            returnCode = errCode;
+        else if (errCode < 0)
+            return errCode;
+        c += 2 + length;
+    }
+    return returnCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    executeCommands
+ * Signature: ([I[II[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_executeCommands
+  (JNIEnv *env, jobject obj, jintArray inInstances, jintArray inCommands, jint commandLength,
+   jdoubleArray inValues, jdoubleArray outResults)
+{
+    jint instanceCount = env->GetArrayLength(inInstances);
+    jint valueCount = (inValues != NULL ? env->GetArrayLength(inValues) : 0);
+    jint resultCount = (outResults != NULL ? env->GetArrayLength(outResults) : 0);
+    if (commandLength < 0 || commandLength > env->GetArrayLength(inCommands))
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    jint *instances = env->GetIntArrayElements(inInstances, NULL);
+    jint *commands = env->GetIntArrayElements(inCommands, NULL);
+    jdouble *values = (inValues != NULL ? env->GetDoubleArrayElements(inValues, NULL) : NULL);
+    jdouble *results = (outResults != NULL ? env->GetDoubleArrayElements(outResults, NULL) : NULL);
+
+    jint errCode = executeCommands(instances, instanceCount, commands, commandLength,
+                                   values, valueCount, results, resultCount);
+
+    // not using JNI_ABORT flag here because we want the results to be copied back...
+    if (results != NULL)
+        env->ReleaseDoubleArrayElements(outResults, results, 0);
+    if (values != NULL)
+        env->ReleaseDoubleArrayElements(inValues, values, JNI_ABORT);
+    env->ReleaseIntArrayElements(inCommands, commands, JNI_ABORT);
+    env->ReleaseIntArrayElements(inInstances, instances, JNI_ABORT);
+
+    return errCode;
+}
+
 //void __attribute__ ((constructor)) beagle_jni_library_initialize(void) {
 //	
 //}
@@ -31,6 +31,14 @@ JNIEXPORT jstring JNICALL Java_beagle_BeagleJNIWrapper_getCitation
 JNIEXPORT jobjectArray JNICALL Java_beagle_BeagleJNIWrapper_getResourceList
   (JNIEnv *, jobject);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    compressPatterns
+ * Signature: (II[I[D[I[I[I[D[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_compressPatterns
+  (JNIEnv *, jobject, jint, jint, jintArray, jdoubleArray, jintArray, jintArray, jintArray, jdoubleArray, jintArray, jintArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    createInstance
@@ -63,6 +71,70 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPatternWeights
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPatternPartitions
   (JNIEnv *, jobject, jint, jint, jintArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setCPUThreadCount
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setCPUThreadCount
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixCacheSize
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixCacheSize
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setIncrementalUpdates
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setIncrementalUpdates
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setExponentScaling
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setExponentScaling
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setAdaptiveRescaling
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setAdaptiveRescaling
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setSiteRepeats
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setSiteRepeats
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setPartialsBackingDirectory
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartialsBackingDirectory
+  (JNIEnv *, jobject, jint, jstring);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setOperationGraphs
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setOperationGraphs
+  (JNIEnv *, jobject, jint, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setTipStates
@@ -71,6 +143,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPatternPartitions
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStates
   (JNIEnv *, jobject, jint, jint, jintArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStateSets
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStateSets
+  (JNIEnv *, jobject, jint, jint, jintArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getTipStates
@@ -87,6 +167,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTipStates
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartials
   (JNIEnv *, jobject, jint, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStatesBatch
+ * Signature: (I[I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStatesBatch
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipPartialsBatch
+ * Signature: (I[I[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartialsBatch
+  (JNIEnv *, jobject, jint, jintArray, jdoubleArray, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setPartials
@@ -95,6 +191,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartials
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartials
   (JNIEnv *, jobject, jint, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setPartialsDirect
+ * Signature: (IILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartialsDirect
+  (JNIEnv *, jobject, jint, jint, jobject);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getPartials
@@ -103,6 +207,38 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPartials
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getPartials
   (JNIEnv *, jobject, jint, jint, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getPartialsDirect
+ * Signature: (IIILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getPartialsDirect
+  (JNIEnv *, jobject, jint, jint, jint, jobject);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    releasePartials
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_releasePartials
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    saveState
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_saveState
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    restoreState
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_restoreState
+  (JNIEnv *, jobject, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getLogScaleFactors
@@ -159,6 +295,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setCategoryRatesWithIndex
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrix
   (JNIEnv *, jobject, jint, jint, jdoubleArray, jdouble);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixDirect
+ * Signature: (IILjava/nio/DoubleBuffer;D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixDirect
+  (JNIEnv *, jobject, jint, jint, jobject, jdouble);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getTransitionMatrix
@@ -167,6 +311,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrix
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrix
   (JNIEnv *, jobject, jint, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getTransitionMatrixDirect
+ * Signature: (IILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrixDirect
+  (JNIEnv *, jobject, jint, jint, jobject);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    convolveTransitionMatrices
@@ -199,6 +351,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateTransitionMatricesWith
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartials
   (JNIEnv *, jobject, jint, jintArray, jint, jint);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsDirect
+ * Signature: (ILjava/nio/IntBuffer;II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsDirect
+  (JNIEnv *, jobject, jint, jobject, jint, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    updatePartialsByPartition
@@ -207,6 +367,30 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartials
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsByPartition
   (JNIEnv *, jobject, jint, jintArray, jint);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsForTrees
+ * Signature: (I[I[II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsForTrees
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jint, jintArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setRootPrePartials
+ * Signature: (I[I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setRootPrePartials
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePrePartials
+ * Signature: (I[II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePrePartials
+  (JNIEnv *, jobject, jint, jintArray, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    waitForPartials
@@ -279,6 +463,30 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_copyScaleFactors
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoods
   (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsAsync
+ * Signature: (I[I[I[I[III)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsAsync
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getLogLikelihoodResults
+ * Signature: (I[II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getLogLikelihoodResults
+  (JNIEnv *, jobject, jint, jintArray, jint, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsForTrees
+ * Signature: (I[I[I[I[II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsForTrees
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    calculateRootLogLikelihoodsByPartition
@@ -295,6 +503,30 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsB
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoods
   (JNIEnv *, jobject, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getSiteLogLikelihoodsDirect
+ * Signature: (ILjava/nio/DoubleBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoodsDirect
+  (JNIEnv *, jobject, jint, jobject);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateEdgeDerivatives
+ * Signature: (I[I[I[I[I[II[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateEdgeDerivatives
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    executeCommands
+ * Signature: ([I[II[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_executeCommands
+  (JNIEnv *, jobject, jintArray, jintArray, jint, jdoubleArray, jdoubleArray);
+
 #ifdef __cplusplus
 }
 #endif
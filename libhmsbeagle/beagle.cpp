@@ -34,18 +34,32 @@
 #include <windows.h>
 #endif
 
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <stdint.h>
 #include <exception>    // for exception, bad_exception
 #include <stdexcept>    // for std exception hierarchy
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <list>
+#include <map>
+#include <numeric>
+#include <mutex>
+#include <sstream>
+#include <string>
 #include <utility>
 #include <vector>
 #include <iostream>
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/BeagleImpl.h"
+#include "libhmsbeagle/BeagleShardedImpl.h"
+#include "libhmsbeagle/BeagleMPIImpl.h"
+#include "libhmsbeagle/BeagleTrace.h"
+#include "libhmsbeagle/CallRecorder.h"
 
 #include "libhmsbeagle/plugin/Plugin.h"
 
@@ -79,8 +93,29 @@ double debugGetTime() {
 #define DEBUG_FINALIZE_TIME()
 #endif
 
-//@CHANGED make this a std::vector<BeagleImpl *> and use at to reference.
-std::vector<beagle::BeagleImpl*> *instances = NULL;
+// Instances live in blocks of slots that never move once allocated, so a lookup reads two
+// atomics and takes no lock while other threads create or finalize instances. Slots are handed
+// out under instanceMutex, those of finalized instances first, so the limit is on instances
+// alive at once rather than on instances ever created. An instance number is its slot plus a
+// multiple of BEAGLE_INSTANCE_SLOT_COUNT that grows each time the slot is reused, so the number
+// of a finalized instance never reaches the one holding its slot now. A slot is retired rather
+// than reused once its numbers would overflow an int.
+#define BEAGLE_INSTANCE_BLOCK_SIZE  256
+#define BEAGLE_INSTANCE_BLOCK_COUNT 4096
+#define BEAGLE_INSTANCE_SLOT_COUNT  (BEAGLE_INSTANCE_BLOCK_SIZE * BEAGLE_INSTANCE_BLOCK_COUNT)
+
+struct InstanceSlot {
+    std::atomic<beagle::BeagleImpl*> instance;
+    std::atomic<int> number; // of the instance in the slot, or of the last one finalized
+};
+
+std::atomic<InstanceSlot*> instanceBlocks[BEAGLE_INSTANCE_BLOCK_COUNT];
+std::atomic<int> instanceCount(0); // slots ever used
+std::vector<int> freeInstances; // slots, not numbers
+std::mutex instanceMutex;
+
+// Serializes plugin loading, the resource and factory lists and instance creation
+std::recursive_mutex libraryMutex;
 
 /// returns an initialized instance or NULL if the index refers to an invalid instance
 namespace beagle {
@@ -88,13 +123,173 @@ BeagleImpl* getBeagleInstance(int instanceIndex);
 
 
 BeagleImpl* getBeagleInstance(int instanceIndex) {
-    if (instanceIndex > instances->size())
+    if (instanceIndex < 0)
         return NULL;
-    return (*instances)[instanceIndex];
+    int slotIndex = instanceIndex % BEAGLE_INSTANCE_SLOT_COUNT;
+    if (slotIndex >= instanceCount.load(std::memory_order_acquire))
+        return NULL;
+    InstanceSlot& slot = instanceBlocks[slotIndex / BEAGLE_INSTANCE_BLOCK_SIZE].load(std::memory_order_acquire)
+                         [slotIndex % BEAGLE_INSTANCE_BLOCK_SIZE];
+    // addInstance stores the number before the instance, so an instance read here comes with a
+    // number at least as new as its own
+    BeagleImpl* beagleInstance = slot.instance.load(std::memory_order_acquire);
+    if (slot.number.load(std::memory_order_acquire) != instanceIndex)
+        return NULL;
+    return beagleInstance;
 }
 
 }	// end namespace beagle
 
+// Registers an instance and returns its number, or an error code if the registry is full
+int addInstance(beagle::BeagleImpl* beagleInstance) {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    InstanceSlot* block;
+    int instance;
+    bool newSlot = freeInstances.empty();
+    if (!newSlot) {
+        int slotIndex = freeInstances.back();
+        freeInstances.pop_back();
+        block = instanceBlocks[slotIndex / BEAGLE_INSTANCE_BLOCK_SIZE].load(std::memory_order_relaxed);
+        instance = block[slotIndex % BEAGLE_INSTANCE_BLOCK_SIZE].number.load(std::memory_order_relaxed) +
+                   BEAGLE_INSTANCE_SLOT_COUNT;
+    } else {
+        instance = instanceCount.load(std::memory_order_relaxed);
+        int blockIndex = instance / BEAGLE_INSTANCE_BLOCK_SIZE;
+        if (blockIndex >= BEAGLE_INSTANCE_BLOCK_COUNT)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        block = instanceBlocks[blockIndex].load(std::memory_order_relaxed);
+        if (block == NULL) {
+            block = new InstanceSlot[BEAGLE_INSTANCE_BLOCK_SIZE];
+            for (int i = 0; i < BEAGLE_INSTANCE_BLOCK_SIZE; i++) {
+                block[i].instance.store(NULL, std::memory_order_relaxed);
+                block[i].number.store(-1, std::memory_order_relaxed);
+            }
+            instanceBlocks[blockIndex].store(block, std::memory_order_release);
+        }
+    }
+    InstanceSlot& slot = block[instance % BEAGLE_INSTANCE_BLOCK_SIZE];
+    beagleInstance->instanceNumber = instance;
+    slot.number.store(instance, std::memory_order_release);
+    slot.instance.store(beagleInstance, std::memory_order_release);
+    if (newSlot)
+        instanceCount.store(instance + 1, std::memory_order_release);
+    return instance;
+}
+
+// Unregisters an instance without deleting it and frees its slot; only one of several
+// concurrent callers gets it, and a number of an earlier instance in the slot gets nothing
+beagle::BeagleImpl* removeInstance(int instance) {
+    if (instance < 0)
+        return NULL;
+    int slotIndex = instance % BEAGLE_INSTANCE_SLOT_COUNT;
+    if (slotIndex >= instanceCount.load(std::memory_order_acquire))
+        return NULL;
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    InstanceSlot& slot = instanceBlocks[slotIndex / BEAGLE_INSTANCE_BLOCK_SIZE].load(std::memory_order_acquire)
+                         [slotIndex % BEAGLE_INSTANCE_BLOCK_SIZE];
+    if (slot.number.load(std::memory_order_relaxed) != instance)
+        return NULL;
+    beagle::BeagleImpl* beagleInstance = slot.instance.exchange(NULL, std::memory_order_acq_rel);
+    if (beagleInstance != NULL && instance <= INT_MAX - BEAGLE_INSTANCE_SLOT_COUNT)
+        freeInstances.push_back(slotIndex);
+    return beagleInstance;
+}
+
+
+// Records the shape the estimates of an instance's statistics are based on, and clears them
+void initializeStatistics(beagle::BeagleImpl* beagleInstance,
+                          int stateCount,
+                          int patternCount,
+                          int categoryCount) {
+    beagle::InstanceStatistics& statistics = beagleInstance->statistics;
+    statistics.stateCount = stateCount;
+    statistics.patternCount = patternCount;
+    statistics.categoryCount = categoryCount;
+    BeagleInstanceDetails details;
+    statistics.realSize = (beagleInstance->getInstanceDetails(&details) == BEAGLE_SUCCESS &&
+                           (details.flags & BEAGLE_FLAG_PRECISION_SINGLE) ? sizeof(float) : sizeof(double));
+    std::fill(statistics.calls, statistics.calls + BEAGLE_STATISTIC_COUNT, BeagleCallStatistics());
+}
+
+// Records the creation of an instance with the shape, resource and flags it was created with
+void recordCreateInstance(int instance,
+                          int tipCount,
+                          int partialsBufferCount,
+                          int compactBufferCount,
+                          int stateCount,
+                          int patternCount,
+                          int eigenBufferCount,
+                          int matrixBufferCount,
+                          int categoryCount,
+                          int scaleBufferCount,
+                          int resource,
+                          long long preferenceFlags,
+                          long long requirementFlags,
+                          long long instanceFlags) {
+    beagle::CallRecord record(beagle::RECORD_CREATE_INSTANCE, instance);
+    if (record.active())
+        record.addInt(tipCount).addInt(partialsBufferCount).addInt(compactBufferCount).addInt(stateCount)
+            .addInt(patternCount).addInt(eigenBufferCount).addInt(matrixBufferCount).addInt(categoryCount)
+            .addInt(scaleBufferCount).addInt(resource).addLong(preferenceFlags).addLong(requirementFlags)
+            .addLong(instanceFlags).write(instance);
+}
+
+// Counts one call against the statistics of its instance, timing it until the end of the
+// enclosing scope. Units are the operations, matrices, scale buffers or root and edge
+// evaluations the call asks for; for transfers they are the values copied. The call is
+// also a trace range carrying the instance and, except for transfers, the units.
+class StatisticsScope {
+public:
+    StatisticsScope(const char* name,
+                    int instance,
+                    beagle::BeagleImpl* beagleInstance,
+                    int statisticClass,
+                    double units)
+        : trace(name, instance, (statisticClass == BEAGLE_STATISTIC_TRANSFER ? -1 : (int) units)),
+          calls(beagleInstance->statistics.calls[statisticClass]),
+          start(std::chrono::steady_clock::now()) {
+        const beagle::InstanceStatistics& statistics = beagleInstance->statistics;
+        const double s = statistics.stateCount;
+        const double p = statistics.patternCount;
+        const double c = statistics.categoryCount;
+        double flops = 0.0;
+        double values = 1.0;
+        switch (statisticClass) {
+            case BEAGLE_STATISTIC_PARTIALS: // two matrix-vector products and their product
+                flops = p * c * s * (4 * s + 1);
+                values = 3 * p * c * s + 2 * c * s * s;
+                break;
+            case BEAGLE_STATISTIC_MATRICES: // exponentiated eigenvalues times the eigenvectors
+                flops = c * s * s * (2 * s + 1);
+                values = c * s * s;
+                break;
+            case BEAGLE_STATISTIC_SCALING:
+                flops = p;
+                values = 2 * p;
+                break;
+            case BEAGLE_STATISTIC_ROOT:
+                flops = 2 * p * c * s + 2 * p * s + 2 * p;
+                values = p * c * s + p;
+                break;
+            case BEAGLE_STATISTIC_EDGE:
+                flops = p * c * s * (2 * s + 2) + 2 * p * s + 2 * p;
+                values = 2 * p * c * s + c * s * s + p;
+                break;
+        }
+        calls.flops += flops * units;
+        calls.bytes += values * statistics.realSize * units;
+    }
+
+    ~StatisticsScope() {
+        calls.callCount++;
+        calls.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    beagle::TraceRange trace;
+    BeagleCallStatistics& calls;
+    std::chrono::steady_clock::time_point start;
+};
 
 // A specialized comparator that only reorders based on score
 bool compareRsrcImpl(const RsrcImpl &left, const RsrcImpl &right) {
@@ -117,51 +312,121 @@ int loaded = 0; // Indicates is the initial library constructors have been run
 /** The list of plugins that provide implementations of likelihood calculators */
 std::list<beagle::plugin::Plugin*>* plugins;
 
-void beagleLoadPlugins(void) {
+// Plugins in trial-order, with the framework each one implements
+struct PluginEntry {
+    const char* name;
+    long framework;
+};
+
+const PluginEntry pluginEntries[] = {
+    {"hmsbeagle-cpu",           BEAGLE_FLAG_FRAMEWORK_CPU},
+    {"hmsbeagle-cuda",          BEAGLE_FLAG_FRAMEWORK_CUDA},
+    {"hmsbeagle-opencl",        BEAGLE_FLAG_FRAMEWORK_OPENCL},
+    {"hmsbeagle-opencl-altera", BEAGLE_FLAG_FRAMEWORK_OPENCL},
+    {"hmsbeagle-cpu-sse",       BEAGLE_FLAG_FRAMEWORK_CPU},
+    {"hmsbeagle-cpu-avx512",    BEAGLE_FLAG_FRAMEWORK_CPU},
+    {"hmsbeagle-cpu-neon",      BEAGLE_FLAG_FRAMEWORK_CPU},
+    {"hmsbeagle-cpu-avx",       BEAGLE_FLAG_FRAMEWORK_CPU},
+    {"hmsbeagle-cpu-openmp",    BEAGLE_FLAG_FRAMEWORK_CPU}
+};
+
+#define BEAGLE_PLUGIN_COUNT (sizeof(pluginEntries) / sizeof(pluginEntries[0]))
+#define BEAGLE_PLUGIN_FRAMEWORKS (BEAGLE_FLAG_FRAMEWORK_CPU | BEAGLE_FLAG_FRAMEWORK_CUDA | \
+                                  BEAGLE_FLAG_FRAMEWORK_OPENCL)
+
+beagle::plugin::Plugin* pluginSlots[BEAGLE_PLUGIN_COUNT];
+long pluginFrameworksLoaded = 0; // Frameworks whose plugins have been looked for
+
+// Startup timings are printed to stderr when BEAGLE_STARTUP_REPORT is set
+bool reportStartup() {
+    static const char* value = getenv("BEAGLE_STARTUP_REPORT");
+    return (value != NULL && value[0] != '\0');
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Loads the plugins of the given frameworks not looked for yet, keeping the
+// plugin list in trial-order. When plugins are added, the factory and resource
+// lists are rebuilt on their next use.
+void beagleLoadPlugins(long frameworks) {
 	if(plugins==NULL){
 		plugins = new std::list<beagle::plugin::Plugin*>();
 	}
 
+	frameworks &= ~pluginFrameworksLoaded;
+	if (frameworks == 0)
+		return;
+	pluginFrameworksLoaded |= frameworks;
+
 	beagle::plugin::PluginManager& pm = beagle::plugin::PluginManager::instance();
 
-	try{
-		beagle::plugin::Plugin* cpuplug = pm.findPlugin("hmsbeagle-cpu");
-		plugins->push_back(cpuplug);
-	}catch(beagle::plugin::SharedLibraryException sle){
-		// this one should always work
-		std::cerr << "Unable to load CPU plugin!\n";
-		std::cerr << "Please check for proper libhmsbeagle installation.\n";
+	bool added = false;
+	for (size_t i = 0; i < BEAGLE_PLUGIN_COUNT; i++) {
+		if ((pluginEntries[i].framework & frameworks) == 0)
+			continue;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		try{
+			pluginSlots[i] = pm.findPlugin(pluginEntries[i].name);
+			added = true;
+		}catch(beagle::plugin::SharedLibraryException sle){
+			if (i == 0) {
+				// this one should always work
+				std::cerr << "Unable to load CPU plugin!\n";
+				std::cerr << "Please check for proper libhmsbeagle installation.\n";
+			}
+		}
+		if (reportStartup())
+			fprintf(stderr, "BEAGLE startup: plugin %-24s %9.6f s%s\n", pluginEntries[i].name,
+			        secondsSince(start), (pluginSlots[i] == NULL ? " (not loaded)" : ""));
 	}
 
-	try{
-		beagle::plugin::Plugin* cudaplug = pm.findPlugin("hmsbeagle-cuda");
-		plugins->push_back(cudaplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}
-
-	try{
-		beagle::plugin::Plugin* openclplug = pm.findPlugin("hmsbeagle-opencl");
-		plugins->push_back(openclplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}
-
-	try{
-		beagle::plugin::Plugin* openclalteraplug = pm.findPlugin("hmsbeagle-opencl-altera");
-		plugins->push_back(openclalteraplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}
-
-	try{
-		beagle::plugin::Plugin* sseplug = pm.findPlugin("hmsbeagle-cpu-sse");
-		plugins->push_back(sseplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}
-	
-	try{
-		beagle::plugin::Plugin* avxplug = pm.findPlugin("hmsbeagle-cpu-avx");
-		plugins->push_back(avxplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}	
-
-	try{
-		beagle::plugin::Plugin* openmpplug = pm.findPlugin("hmsbeagle-cpu-openmp");
-		plugins->push_back(openmpplug);
-	}catch(beagle::plugin::SharedLibraryException sle){}
+	if (!added)
+		return;
+
+	plugins->clear();
+	for (size_t i = 0; i < BEAGLE_PLUGIN_COUNT; i++) {
+		if (pluginSlots[i] != NULL)
+			plugins->push_back(pluginSlots[i]);
+	}
+
+	// The contained factories and resources belong to the plugins
+	delete implFactory;
+	implFactory = NULL;
+	if (rsrcList != NULL) {
+		free(rsrcList->list);
+		free(rsrcList);
+		rsrcList = NULL;
+	}
+	ResourceMap.clear();
+}
+
+void beagleLoadPlugins(void) {
+	beagleLoadPlugins(BEAGLE_PLUGIN_FRAMEWORKS);
+}
+
+// With BEAGLE_FAST_INIT set, an instance created without a resource list only
+// loads the plugins of the frameworks its requirementFlags allow, so that a
+// CPU-only job never initializes the CUDA or OpenCL runtimes. A requirement
+// naming no framework is read from its processor flags, PROCESSOR_CPU alone
+// allowing the CPU framework only. The CPU plugins are always loaded, so that
+// the CPU stays resource 0; GPU resources are numbered in the order their
+// frameworks were first loaded until beagleGetResourceList loads them all.
+long long getStartupFrameworks(long long requirementFlags) {
+    static const char* value = getenv("BEAGLE_FAST_INIT");
+    if (value == NULL || value[0] == '\0')
+        return BEAGLE_PLUGIN_FRAMEWORKS;
+
+    long long frameworks = requirementFlags & BEAGLE_PLUGIN_FRAMEWORKS;
+    if (frameworks == 0) {
+        long long processors = requirementFlags & (BEAGLE_FLAG_PROCESSOR_CPU | BEAGLE_FLAG_PROCESSOR_GPU |
+                                              BEAGLE_FLAG_PROCESSOR_FPGA | BEAGLE_FLAG_PROCESSOR_CELL |
+                                              BEAGLE_FLAG_PROCESSOR_PHI | BEAGLE_FLAG_PROCESSOR_OTHER);
+        if (processors == 0 || (processors & ~BEAGLE_FLAG_PROCESSOR_CPU) != 0)
+            return BEAGLE_PLUGIN_FRAMEWORKS;
+    }
+    return frameworks | BEAGLE_FLAG_FRAMEWORK_CPU;
 }
 
 std::list<beagle::BeagleImplFactory*>* beagleGetFactoryList(void) {
@@ -213,9 +478,13 @@ void beagle_library_finalize(void) {
 		free(rsrcList);
 	}
 
-	// Destroy instances
-	if (instances && loaded) {
-		delete instances;
+	// Destroy the registry; instances not finalized by the client are left alone, as before
+	if (loaded) {
+		for (int b = 0; b < BEAGLE_INSTANCE_BLOCK_COUNT; b++) {
+			delete[] instanceBlocks[b].exchange(NULL);
+		}
+		instanceCount.store(0);
+		freeInstances.clear();
 	}
 	loaded = 0;
 }
@@ -257,12 +526,10 @@ const char* beagleGetCitation() {
     return BEAGLE_CITATION;
 }
 
-BeagleResourceList* beagleGetResourceList() {
-	// plugins must be loaded before resources
-	if (plugins==NULL)
-	    beagleLoadPlugins();
-
+// Merges the resources of the plugins loaded so far into rsrcList
+BeagleResourceList* getLoadedResourceList() {
     if (rsrcList == NULL) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
         // count the total resources across plugins
         rsrcList = (BeagleResourceList*) malloc(sizeof(BeagleResourceList));
         rsrcList->length = 0;
@@ -298,138 +565,470 @@ BeagleResourceList* beagleGetResourceList() {
                 }
             }
         }
+
+        if (reportStartup())
+            fprintf(stderr, "BEAGLE startup: resource list %9.6f s (%d resources)\n",
+                    secondsSince(start), rsrcList->length);
     }
     return rsrcList;
 }
 
-int scoreFlags(long flags1, long flags2) {
+BeagleResourceList* beagleGetResourceList() {
+    std::lock_guard<std::recursive_mutex> lock(libraryMutex);
+
+	// plugins must be loaded before resources
+	beagleLoadPlugins();
+
+    return getLoadedResourceList();
+}
+
+// Number of sites transposed into contiguous columns at a time by beagleCompressPatterns
+#define BEAGLE_COMPRESS_BLOCK_SITES 4096
+
+// FNV-1a over the states of one column and its partition, with a final mix so that
+// sequential probe slots can be taken from the low bits
+uint64_t hashSiteColumn(const int* column, int taxonCount, int partition) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int t = 0; t < taxonCount; t++) {
+        hash ^= (uint32_t) column[t];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= (uint32_t) partition;
+    hash *= 1099511628211ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+int beagleCompressPatterns(int taxonCount,
+                           int siteCount,
+                           const int* inSiteStates,
+                           const double* inSiteWeights,
+                           const int* inSitePartitions,
+                           int* outPatternCount,
+                           int* outPatternStates,
+                           double* outPatternWeights,
+                           int* outPatternPartitions,
+                           int* outSitePatterns) {
+    DEBUG_START_TIME();
+    if (taxonCount < 1 || siteCount < 0 || inSiteStates == NULL || outPatternCount == NULL ||
+        outPatternStates == NULL || outPatternWeights == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    int partitionCount = 1;
+    if (inSitePartitions != NULL) {
+        for (int s = 0; s < siteCount; s++) {
+            if (inSitePartitions[s] < 0)
+                return BEAGLE_ERROR_OUT_OF_RANGE;
+            if (inSitePartitions[s] >= partitionCount)
+                partitionCount = inSitePartitions[s] + 1;
+        }
+    }
+
+    try {
+        // unique columns in order of first occurrence, stored pattern-major
+        std::vector<int> columns;
+        std::vector<uint64_t> hashes;
+        std::vector<int> partitions;
+        std::vector<double> weights;
+        int patternCount = 0;
+
+        // open-addressing table of pattern indices, kept at most half full
+        size_t tableSize = 1024;
+        std::vector<int> table(tableSize, -1);
+
+        const int blockSites = BEAGLE_COMPRESS_BLOCK_SITES;
+        std::vector<int> block((size_t) blockSites * taxonCount);
+
+        for (int start = 0; start < siteCount; start += blockSites) {
+            const int blockCount = (siteCount - start < blockSites ? siteCount - start : blockSites);
+
+            for (int t = 0; t < taxonCount; t++) {
+                const int* row = inSiteStates + (size_t) t * siteCount + start;
+                for (int s = 0; s < blockCount; s++)
+                    block[(size_t) s * taxonCount + t] = row[s];
+            }
+
+            for (int s = 0; s < blockCount; s++) {
+                const int* column = &block[(size_t) s * taxonCount];
+                const int partition = (inSitePartitions != NULL ? inSitePartitions[start + s] : 0);
+                const uint64_t hash = hashSiteColumn(column, taxonCount, partition);
+
+                size_t slot = hash & (tableSize - 1);
+                int pattern;
+                while ((pattern = table[slot]) != -1) {
+                    if (hashes[pattern] == hash && partitions[pattern] == partition &&
+                        memcmp(&columns[(size_t) pattern * taxonCount], column,
+                               sizeof(int) * taxonCount) == 0)
+                        break;
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+
+                if (pattern == -1) {
+                    pattern = patternCount++;
+                    columns.insert(columns.end(), column, column + taxonCount);
+                    hashes.push_back(hash);
+                    partitions.push_back(partition);
+                    weights.push_back(0.0);
+                    table[slot] = pattern;
+
+                    if ((size_t) patternCount * 2 > tableSize) {
+                        tableSize *= 2;
+                        table.assign(tableSize, -1);
+                        for (int p = 0; p < patternCount; p++) {
+                            size_t newSlot = hashes[p] & (tableSize - 1);
+                            while (table[newSlot] != -1)
+                                newSlot = (newSlot + 1) & (tableSize - 1);
+                            table[newSlot] = p;
+                        }
+                    }
+                }
+
+                weights[pattern] += (inSiteWeights != NULL ? inSiteWeights[start + s] : 1.0);
+                if (outSitePatterns != NULL)
+                    outSitePatterns[start + s] = pattern;
+            }
+        }
+
+        // group patterns by partition, keeping first-occurrence order within each
+        std::vector<int> newIndex(patternCount);
+        std::vector<int> partitionStart(partitionCount + 1, 0);
+        for (int p = 0; p < patternCount; p++)
+            partitionStart[partitions[p] + 1]++;
+        for (int i = 0; i < partitionCount; i++)
+            partitionStart[i + 1] += partitionStart[i];
+        for (int p = 0; p < patternCount; p++)
+            newIndex[p] = partitionStart[partitions[p]]++;
+
+        for (int t = 0; t < taxonCount; t++) {
+            int* outStates = outPatternStates + (size_t) t * patternCount;
+            for (int p = 0; p < patternCount; p++)
+                outStates[newIndex[p]] = columns[(size_t) p * taxonCount + t];
+        }
+        for (int p = 0; p < patternCount; p++) {
+            outPatternWeights[newIndex[p]] = weights[p];
+            if (outPatternPartitions != NULL)
+                outPatternPartitions[newIndex[p]] = partitions[p];
+        }
+        if (outSitePatterns != NULL) {
+            for (int s = 0; s < siteCount; s++)
+                outSitePatterns[s] = newIndex[outSitePatterns[s]];
+        }
+
+        *outPatternCount = patternCount;
+        DEBUG_END_TIME();
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int scoreFlags(long long flags1, long long flags2) {
     int score = 0;
-    int trait = 1;
-    for(int bits=0; bits<32; bits++) {
-        if ( (flags1 & trait) &&
-             (flags2 & trait) )
+    const unsigned long long common = (unsigned long long) flags1 & (unsigned long long) flags2;
+    unsigned long long trait = 1;
+    for(int bits=0; bits<(int)(sizeof(unsigned long long)*8); bits++) {
+        if (common & trait)
             score++;
         trait <<= 1;
     }
     return -score;
 }
 
-int beagleCreateInstance(int tipCount,
-                         int partialsBufferCount,
-                         int compactBufferCount,
-                         int stateCount,
-                         int patternCount,
-                         int eigenBufferCount,
-                         int matrixBufferCount,
-                         int categoryCount,
-                         int scaleBufferCount,
-                         int* resourceList,
-                         int resourceCount,
-                         long preferenceFlags,
-                         long requirementFlags,
-                         BeagleInstanceDetails* returnInfo) {
-    DEBUG_CREATE_TIME();
-    try {
-        if (instances == NULL)
-            instances = new std::vector<beagle::BeagleImpl*>;
+// Seconds for one pruning pass and root integration over a caterpillar tree of the given shape,
+// best of a few after a warm-up; negative if the shape leaves no room for the tree or a call fails
+double timeImplementation(beagle::BeagleImpl* beagle,
+                          int tipCount,
+                          int partialsBufferCount,
+                          int stateCount,
+                          int patternCount,
+                          int categoryCount) {
+    typedef std::chrono::steady_clock Clock;
+
+    const int opCount = (std::min)(tipCount - 1, partialsBufferCount - tipCount);
+    if (opCount < 1 || stateCount < 2)
+        return -1.0;
+
+    std::vector<double> tipPartials((size_t) patternCount * stateCount);
+    for (size_t i = 0; i < tipPartials.size(); i++)
+        tipPartials[i] = 0.25 + 0.5 * ((i * 7) % 11) / 11.0;
+    std::vector<double> matrix((size_t) stateCount * stateCount * categoryCount);
+    for (size_t i = 0; i < matrix.size(); i++)
+        matrix[i] = ((i / stateCount) % stateCount == i % stateCount ? 0.5 : 0.5 / (stateCount - 1));
+    std::vector<double> patternWeights(patternCount, 1.0);
+    std::vector<double> categoryWeights(categoryCount, 1.0 / categoryCount);
+    std::vector<double> stateFrequencies(stateCount, 1.0 / stateCount);
+
+    int returnCode = BEAGLE_SUCCESS;
+    for (int t = 0; t < tipCount && returnCode == BEAGLE_SUCCESS; t++)
+        returnCode = beagle->setTipPartials(t, &tipPartials[0]);
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = beagle->setTransitionMatrix(0, &matrix[0], 1.0);
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = beagle->setPatternWeights(&patternWeights[0]);
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = beagle->setCategoryWeights(0, &categoryWeights[0]);
+    if (returnCode == BEAGLE_SUCCESS)
+        returnCode = beagle->setStateFrequencies(0, &stateFrequencies[0]);
+    if (returnCode != BEAGLE_SUCCESS)
+        return -1.0;
+
+    std::vector<int> operations(opCount * BEAGLE_OP_COUNT);
+    for (int op = 0; op < opCount; op++) {
+        int* o = &operations[op * BEAGLE_OP_COUNT];
+        o[0] = tipCount + op;
+        o[1] = BEAGLE_OP_NONE;
+        o[2] = BEAGLE_OP_NONE;
+        o[3] = (op == 0 ? 0 : tipCount + op - 1);
+        o[4] = 0;
+        o[5] = op + 1;
+        o[6] = 0;
+    }
+    const int rootIndex = tipCount + opCount - 1;
+    const int zero = 0;
+    const int none = BEAGLE_OP_NONE;
+
+    double best = -1.0;
+    for (int rep = 0; rep < 4; rep++) {
+        Clock::time_point start = Clock::now();
+        double logL;
+        returnCode = beagle->updatePartials(&operations[0], opCount, BEAGLE_OP_NONE);
+        if (returnCode == BEAGLE_SUCCESS)
+            returnCode = beagle->calculateRootLogLikelihoods(&rootIndex, &zero, &zero, &none, 1, &logL);
+        // deep caterpillars underflow without scaling, which does not matter for timing
+        if (returnCode != BEAGLE_SUCCESS && returnCode != BEAGLE_ERROR_FLOATING_POINT)
+            return -1.0;
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (rep > 0 && (best < 0.0 || elapsed < best))
+            best = elapsed;
+    }
+    return best;
+}
 
-        if (rsrcList == NULL)
-            beagleGetResourceList();
-        
-        if (implFactory == NULL)
-            beagleGetFactoryList();
-        
-        loaded = 1;
-        
-        // First determine a list of possible resources
-        PairedList* possibleResources = new PairedList;
-        if (resourceList == NULL || resourceCount == 0) { // No list given
-            for(int i=0; i<rsrcList->length; i++)
-                possibleResources->push_back(std::make_pair(
-                    scoreFlags(preferenceFlags,rsrcList->list[i].supportFlags), // Score
-                    i)); // ID
-        } else {
-            for(int i=0; i<resourceCount; i++)
-                possibleResources->push_back(std::make_pair(
-                    scoreFlags(preferenceFlags,rsrcList->list[resourceList[i]].supportFlags), // Score
-                    resourceList[i])); // ID
+// Moves the fastest of the candidate resource-implementation pairs to the front, timing each on
+// the requested shape once per process and bucket of similar shapes
+void calibrateImplementations(RsrcImplList* candidates,
+                              int tipCount,
+                              int partialsBufferCount,
+                              int compactBufferCount,
+                              int stateCount,
+                              int patternCount,
+                              int eigenBufferCount,
+                              int matrixBufferCount,
+                              int categoryCount,
+                              int scaleBufferCount,
+                              long long preferenceFlags,
+                              long long requirementFlags) {
+    static std::map<std::string, std::pair<int, std::string> > calibrations;
+
+    if (candidates->size() < 2 || eigenBufferCount < 1 || matrixBufferCount < 1)
+        return;
+
+    // tip and pattern counts within the same power of two share a calibration
+    int tipBucket = 0;
+    while ((1 << tipBucket) < tipCount)
+        tipBucket++;
+    int patternBucket = 0;
+    while ((1 << patternBucket) < patternCount)
+        patternBucket++;
+
+    std::ostringstream key;
+    key << stateCount << ' ' << categoryCount << ' ' << tipBucket << ' ' << patternBucket << ' '
+        << preferenceFlags << ' ' << requirementFlags;
+    for (RsrcImplList::iterator it = candidates->begin(); it != candidates->end(); ++it)
+        key << ' ' << (*it).second.first << ':' << (*it).second.second->getName();
+
+    std::map<std::string, std::pair<int, std::string> >::iterator cached = calibrations.find(key.str());
+    if (cached == calibrations.end()) {
+        std::pair<int, std::string> fastest(-1, "");
+        double fastestTime = -1.0;
+        for (RsrcImplList::iterator it = candidates->begin(); it != candidates->end(); ++it) {
+            int resource = (*it).second.first;
+            beagle::BeagleImplFactory* factory = (*it).second.second;
+            int errorCode;
+            beagle::BeagleImpl* beagle = factory->createImpl(tipCount, partialsBufferCount,
+                                                             compactBufferCount, stateCount,
+                                                             patternCount, eigenBufferCount,
+                                                             matrixBufferCount, categoryCount,
+                                                             scaleBufferCount, resource,
+                                                             ResourceMap[resource],
+                                                             preferenceFlags, requirementFlags,
+                                                             &errorCode);
+            if (beagle == NULL)
+                continue;
+            double time = timeImplementation(beagle, tipCount, partialsBufferCount, stateCount,
+                                             patternCount, categoryCount);
+            delete beagle;
+#ifdef BEAGLE_DEBUG_FLOW
+            fprintf(stderr,"\tCalibrated %s on resource %d: %g s\n", factory->getName(), resource, time);
+#endif
+            if (time >= 0.0 && (fastestTime < 0.0 || time < fastestTime)) {
+                fastestTime = time;
+                fastest = std::make_pair(resource, std::string(factory->getName()));
+            }
+        }
+        cached = calibrations.insert(std::make_pair(key.str(), fastest)).first;
+    }
+
+    for (RsrcImplList::iterator it = candidates->begin(); it != candidates->end(); ++it) {
+        if ((*it).second.first == cached->second.first &&
+            cached->second.second == (*it).second.second->getName()) {
+            candidates->splice(candidates->begin(), *candidates, it);
+            break;
         }
-        if (requirementFlags != 0) { // If requirements given do restriction
-            for(PairedList::iterator it = possibleResources->begin();
-                it != possibleResources->end(); ++it) {
-                int resource = (*it).second;
-                long resourceFlag = rsrcList->list[resource].supportFlags;
-                if ( (resourceFlag & requirementFlags) < requirementFlags) {
+    }
+}
+
+// Lists the resource-implementation pairs that meet requirementFlags, best match to
+// preferenceFlags first; NULL if no resource qualifies
+RsrcImplList* rankImplementations(int* resourceList,
+                                  int resourceCount,
+                                  long long preferenceFlags,
+                                  long long requirementFlags) {
+    // resource numbers given by the client refer to the complete list
+    if (resourceList == NULL || resourceCount == 0)
+        beagleLoadPlugins(getStartupFrameworks(requirementFlags));
+    else
+        beagleLoadPlugins();
+    getLoadedResourceList();
+
+    if (implFactory == NULL)
+        beagleGetFactoryList();
+
+    // First determine a list of possible resources
+    PairedList* possibleResources = new PairedList;
+    if (resourceList == NULL || resourceCount == 0) { // No list given
+        for(int i=0; i<rsrcList->length; i++)
+            possibleResources->push_back(std::make_pair(
+                scoreFlags(preferenceFlags,rsrcList->list[i].supportFlags), // Score
+                i)); // ID
+    } else {
+        for(int i=0; i<resourceCount; i++)
+            possibleResources->push_back(std::make_pair(
+                scoreFlags(preferenceFlags,rsrcList->list[resourceList[i]].supportFlags), // Score
+                resourceList[i])); // ID
+    }
+    if (requirementFlags != 0) { // If requirements given do restriction
+        for(PairedList::iterator it = possibleResources->begin();
+            it != possibleResources->end(); ++it) {
+            int resource = (*it).second;
+            long long resourceFlag = rsrcList->list[resource].supportFlags;
+            if ( (resourceFlag & requirementFlags) < requirementFlags) {
 					if(it==possibleResources->begin()){
 	                    possibleResources->remove(*(it));
 						it=possibleResources->begin();
 					}else
 	                    possibleResources->remove(*(it--));
-                }
+            }
 				if(it==possibleResources->end())
 					break;
-            }
-        }
-        
-        if (possibleResources->size() == 0) {
-            delete possibleResources;
-            return BEAGLE_ERROR_NO_RESOURCE;
         }
-        
-        beagle::BeagleImpl* bestBeagle = NULL;
-
-        possibleResources->sort(compareOnFirst); // Attempt in rank order, lowest score wins
-
-        int errorCode = BEAGLE_ERROR_NO_RESOURCE;
-        
-        // Score each resource-implementation pair given preferences
-        RsrcImplList* possibleResourceImplementations = new RsrcImplList;
-
-        for(PairedList::iterator it = possibleResources->begin();
-            it != possibleResources->end(); ++it) {
-            int resource = (*it).second;
-            long resourceRequiredFlags = rsrcList->list[resource].requiredFlags;
-            long resourceSupportedFlags = rsrcList->list[resource].supportFlags;            
-            int resourceScore = (*it).first;
+    }
+    
+    if (possibleResources->size() == 0) {
+        delete possibleResources;
+        return NULL;
+    }
+    
+    possibleResources->sort(compareOnFirst); // Attempt in rank order, lowest score wins
+
+    // Score each resource-implementation pair given preferences
+    RsrcImplList* possibleResourceImplementations = new RsrcImplList;
+
+    for(PairedList::iterator it = possibleResources->begin();
+        it != possibleResources->end(); ++it) {
+        int resource = (*it).second;
+        long long resourceRequiredFlags = rsrcList->list[resource].requiredFlags;
+        long long resourceSupportedFlags = rsrcList->list[resource].supportFlags;            
+        int resourceScore = (*it).first;
 #ifdef BEAGLE_DEBUG_FLOW
-            fprintf(stderr,"Possible resource: %s (%d)\n",rsrcList->list[resource].name,resourceScore);
+        fprintf(stderr,"Possible resource: %s (%d)\n",rsrcList->list[resource].name,resourceScore);
 #endif
-            
-            for (std::list<beagle::BeagleImplFactory*>::iterator factory =
-                 implFactory->begin(); factory != implFactory->end(); factory++) {
-                long factoryFlags = (*factory)->getFlags();
+        
+        for (std::list<beagle::BeagleImplFactory*>::iterator factory =
+             implFactory->begin(); factory != implFactory->end(); factory++) {
+            long long factoryFlags = (*factory)->getFlags();
 #ifdef BEAGLE_DEBUG_FLOW
-                fprintf(stderr,"\tExamining implementation: %s\n",(*factory)->getName());
+            fprintf(stderr,"\tExamining implementation: %s\n",(*factory)->getName());
 #endif
-                if ( ((requirementFlags & factoryFlags) >= requirementFlags) // Factory meets requirementFlags
-                    && ((resourceRequiredFlags & factoryFlags) >= resourceRequiredFlags) // Factory meets resourceFlags
-                    && ((requirementFlags & resourceSupportedFlags) >= requirementFlags) // Resource meets requirementFlags
-                    ) {
-                    int implementationScore = scoreFlags(preferenceFlags,factoryFlags);
-                    int totalScore = resourceScore + implementationScore;
+            if ( ((requirementFlags & factoryFlags) >= requirementFlags) // Factory meets requirementFlags
+                && ((resourceRequiredFlags & factoryFlags) >= resourceRequiredFlags) // Factory meets resourceFlags
+                && ((requirementFlags & resourceSupportedFlags) >= requirementFlags) // Resource meets requirementFlags
+                ) {
+                int implementationScore = scoreFlags(preferenceFlags,factoryFlags);
+                int totalScore = resourceScore + implementationScore;
 #ifdef BEAGLE_DEBUG_FLOW
-                    fprintf(stderr,"\tPossible implementation: %s (%d)\n",
-                            (*factory)->getName(),totalScore);
+                fprintf(stderr,"\tPossible implementation: %s (%d)\n",
+                        (*factory)->getName(),totalScore);
 #endif
-                    
-                    possibleResourceImplementations->push_back(std::make_pair(totalScore, std::make_pair(resource, (*factory))));
-                    
-                }
+                
+                possibleResourceImplementations->push_back(std::make_pair(totalScore, std::make_pair(resource, (*factory))));
+                
             }
         }
-        
-        delete possibleResources;
-        
+    }
+    
+    delete possibleResources;
+    
 #ifdef BEAGLE_DEBUG_FLOW
-        fprintf(stderr,"\nOriginal list of possible implementations:\n");
-        for (RsrcImplList::iterator it = possibleResourceImplementations->begin(); 
+    fprintf(stderr,"\nOriginal list of possible implementations:\n");
+    for (RsrcImplList::iterator it = possibleResourceImplementations->begin(); 
 				it != possibleResourceImplementations->end(); ++it) {
-        	beagle::BeagleImplFactory* factory = (*it).second.second;
-        	fprintf(stderr,"\t %s (%d)\n", factory->getName(), (*it).first);
-        }
+    	beagle::BeagleImplFactory* factory = (*it).second.second;
+    	fprintf(stderr,"\t %s (%d)\n", factory->getName(), (*it).first);
+    }
 #endif        
-        
-        possibleResourceImplementations->sort(compareRsrcImpl);
+    
+    possibleResourceImplementations->sort(compareRsrcImpl);
+
+    return possibleResourceImplementations;
+}
+
+int createInstanceFromResources(int tipCount,
+                                int partialsBufferCount,
+                                int compactBufferCount,
+                                int stateCount,
+                                int patternCount,
+                                int eigenBufferCount,
+                                int matrixBufferCount,
+                                int categoryCount,
+                                int scaleBufferCount,
+                                int* resourceList,
+                                int resourceCount,
+                                long long preferenceFlags,
+                                long long requirementFlags,
+                                size_t memoryBudget,
+                                BeagleInstanceDetails* returnInfo) {
+    DEBUG_CREATE_TIME();
+    try {
+        std::lock_guard<std::recursive_mutex> lock(libraryMutex);
+
+        static bool created = false;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        loaded = 1;
+
+        // calibration is how the library chooses, not something an implementation offers
+        bool calibrate = ((preferenceFlags | requirementFlags) & BEAGLE_FLAG_CALIBRATE) != 0;
+        preferenceFlags &= ~BEAGLE_FLAG_CALIBRATE;
+        requirementFlags &= ~BEAGLE_FLAG_CALIBRATE;
+
+        RsrcImplList* possibleResourceImplementations = rankImplementations(resourceList, resourceCount,
+                                                                            preferenceFlags, requirementFlags);
+        if (possibleResourceImplementations == NULL)
+            return BEAGLE_ERROR_NO_RESOURCE;
+
+        beagle::BeagleImpl* bestBeagle = NULL;
+
+        int errorCode = BEAGLE_ERROR_NO_RESOURCE;
+
+        if (calibrate)
+            calibrateImplementations(possibleResourceImplementations, tipCount, partialsBufferCount,
+                                     compactBufferCount, stateCount, patternCount, eigenBufferCount,
+                                     matrixBufferCount, categoryCount, scaleBufferCount,
+                                     preferenceFlags, requirementFlags);
         
 #ifdef BEAGLE_DEBUG_FLOW
         fprintf(stderr,"\nSorted list of possible implementations:\n");
@@ -443,7 +1042,20 @@ int beagleCreateInstance(int tipCount,
         for(RsrcImplList::iterator it = possibleResourceImplementations->begin(); it != possibleResourceImplementations->end(); ++it) {
             int resource = (*it).second.first;
             beagle::BeagleImplFactory* factory = (*it).second.second;
-            
+
+            if (memoryBudget > 0) {
+                size_t footprint;
+                if (factory->getMemoryFootprint(tipCount, partialsBufferCount, compactBufferCount,
+                                                stateCount, patternCount, eigenBufferCount,
+                                                matrixBufferCount, categoryCount, scaleBufferCount,
+                                                resource, ResourceMap[resource], preferenceFlags,
+                                                requirementFlags, &footprint) != BEAGLE_SUCCESS ||
+                    footprint > memoryBudget) {
+                    errorCode = BEAGLE_ERROR_OUT_OF_MEMORY;
+                    continue;
+                }
+            }
+
             bestBeagle = factory->createImpl(tipCount, partialsBufferCount,
                                                                 compactBufferCount, stateCount,
                                                                 patternCount, eigenBufferCount,
@@ -462,8 +1074,12 @@ int beagleCreateInstance(int tipCount,
         delete possibleResourceImplementations;
         
         if (bestBeagle != NULL) {
-            int instance = instances->size();
-            instances->push_back(bestBeagle);
+            initializeStatistics(bestBeagle, stateCount, patternCount, categoryCount);
+            int instance = addInstance(bestBeagle);
+            if (instance < 0) {
+                delete bestBeagle;
+                return instance;
+            }
             
             int returnValue = bestBeagle->getInstanceDetails(returnInfo);
             if (returnValue == BEAGLE_SUCCESS) {
@@ -472,6 +1088,14 @@ int beagleCreateInstance(int tipCount,
                 returnInfo->implDescription = (char*) "none";
                 
                 returnValue = instance;
+                if (!created && reportStartup())
+                    fprintf(stderr, "BEAGLE startup: first instance %9.6f s (%s on %s)\n",
+                            secondsSince(start), returnInfo->implName, returnInfo->resourceName);
+                created = true;
+                recordCreateInstance(instance, tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                     patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                     scaleBufferCount, returnInfo->resourceNumber, preferenceFlags,
+                                     requirementFlags, returnInfo->flags);
             }
             return returnValue;
         }   
@@ -492,14 +1116,329 @@ int beagleCreateInstance(int tipCount,
 
 }
 
+#ifdef HAVE_MPI
+// With BEAGLE_MPI set, an instance created by beagleCreateInstance in an MPI job of
+// several processes is spread over them, each holding an equal block of the patterns
+// on the resource it would have chosen for a whole instance. Every process must make
+// the same calls with the same arguments. MPI is initialized here if the client has
+// not initialized it, and finalized when the process exits.
+bool distributeInstances() {
+    static const char* value = getenv("BEAGLE_MPI");
+    return (value != NULL && value[0] != '\0');
+}
+
+void finalizeMPI() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+        MPI_Finalize();
+}
+
+int createDistributedInstance(int tipCount,
+                              int partialsBufferCount,
+                              int compactBufferCount,
+                              int stateCount,
+                              int patternCount,
+                              int eigenBufferCount,
+                              int matrixBufferCount,
+                              int categoryCount,
+                              int scaleBufferCount,
+                              int* resourceList,
+                              int resourceCount,
+                              long long preferenceFlags,
+                              long long requirementFlags,
+                              BeagleInstanceDetails* returnInfo) {
+    int initialized;
+    MPI_Initialized(&initialized);
+    if (!initialized) {
+        int provided;
+        MPI_Init_thread(NULL, NULL, MPI_THREAD_SERIALIZED, &provided);
+        atexit(finalizeMPI);
+    }
+
+    int rank, processCount;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processCount);
+    if (processCount == 1)
+        return createInstanceFromResources(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                           patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                           scaleBufferCount, resourceList, resourceCount, preferenceFlags,
+                                           requirementFlags, 0, returnInfo);
+    if (processCount > patternCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    try {
+        std::vector<int> patternOffsets(processCount + 1);
+        for (int p = 0; p <= processCount; p++)
+            patternOffsets[p] = (int) (((long) patternCount * p) / processCount);
+
+        int localInstance;
+        {
+            // the local blocks are recorded as the one instance they make up
+            beagle::CallRecordingPause recordingPause;
+            localInstance = createInstanceFromResources(tipCount, partialsBufferCount, compactBufferCount,
+                                                        stateCount, patternOffsets[rank + 1] - patternOffsets[rank],
+                                                        eigenBufferCount, matrixBufferCount, categoryCount,
+                                                        scaleBufferCount, resourceList, resourceCount,
+                                                        preferenceFlags, requirementFlags, 0, returnInfo);
+        }
+
+        // the instance exists only if every process created its block
+        int jobResult;
+        MPI_Allreduce(&localInstance, &jobResult, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (jobResult < 0) {
+            if (localInstance >= 0)
+                delete removeInstance(localInstance);
+            return (localInstance < 0 ? localInstance : jobResult);
+        }
+
+        beagle::BeagleImpl* distributedBeagle = new beagle::BeagleMPIImpl(removeInstance(localInstance),
+                                                                          patternOffsets, stateCount,
+                                                                          categoryCount, MPI_COMM_WORLD);
+        initializeStatistics(distributedBeagle, stateCount, patternCount, categoryCount);
+        int instance = addInstance(distributedBeagle);
+        if (instance < 0) {
+            delete distributedBeagle;
+            return instance;
+        }
+
+        recordCreateInstance(instance, tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                             patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                             scaleBufferCount, returnInfo->resourceNumber, preferenceFlags,
+                             requirementFlags, returnInfo->flags);
+        return instance;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+#endif
+
+int beagleCreateInstance(int tipCount,
+                         int partialsBufferCount,
+                         int compactBufferCount,
+                         int stateCount,
+                         int patternCount,
+                         int eigenBufferCount,
+                         int matrixBufferCount,
+                         int categoryCount,
+                         int scaleBufferCount,
+                         int* resourceList,
+                         int resourceCount,
+                         long long preferenceFlags,
+                         long long requirementFlags,
+                         BeagleInstanceDetails* returnInfo) {
+#ifdef HAVE_MPI
+    if (distributeInstances())
+        return createDistributedInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                         patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                         scaleBufferCount, resourceList, resourceCount, preferenceFlags,
+                                         requirementFlags, returnInfo);
+#endif
+    return createInstanceFromResources(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                       patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                       scaleBufferCount, resourceList, resourceCount, preferenceFlags,
+                                       requirementFlags, 0, returnInfo);
+}
+
+int beagleGetInstanceMemoryFootprint(int tipCount,
+                                     int partialsBufferCount,
+                                     int compactBufferCount,
+                                     int stateCount,
+                                     int patternCount,
+                                     int eigenBufferCount,
+                                     int matrixBufferCount,
+                                     int categoryCount,
+                                     int scaleBufferCount,
+                                     int* resourceList,
+                                     int resourceCount,
+                                     long long preferenceFlags,
+                                     long long requirementFlags,
+                                     size_t* outBytes) {
+    try {
+        std::lock_guard<std::recursive_mutex> lock(libraryMutex);
+
+        RsrcImplList* possibleResourceImplementations = rankImplementations(resourceList, resourceCount,
+                                                                            preferenceFlags, requirementFlags);
+        if (possibleResourceImplementations == NULL)
+            return BEAGLE_ERROR_NO_RESOURCE;
+
+        // the footprint of the candidate beagleCreateInstance tries first, among those that report one
+        int returnCode = BEAGLE_ERROR_NO_IMPLEMENTATION;
+        for (RsrcImplList::iterator it = possibleResourceImplementations->begin();
+             it != possibleResourceImplementations->end() && returnCode != BEAGLE_SUCCESS; ++it) {
+            int resource = (*it).second.first;
+            returnCode = (*it).second.second->getMemoryFootprint(tipCount, partialsBufferCount,
+                                                                 compactBufferCount, stateCount,
+                                                                 patternCount, eigenBufferCount,
+                                                                 matrixBufferCount, categoryCount,
+                                                                 scaleBufferCount, resource,
+                                                                 ResourceMap[resource], preferenceFlags,
+                                                                 requirementFlags, outBytes);
+        }
+
+        delete possibleResourceImplementations;
+
+        return returnCode;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCreateInstanceWithMemoryBudget(int tipCount,
+                                         int partialsBufferCount,
+                                         int compactBufferCount,
+                                         int stateCount,
+                                         int patternCount,
+                                         int eigenBufferCount,
+                                         int matrixBufferCount,
+                                         int categoryCount,
+                                         int scaleBufferCount,
+                                         int* resourceList,
+                                         int resourceCount,
+                                         long long preferenceFlags,
+                                         long long requirementFlags,
+                                         size_t memoryBudget,
+                                         BeagleInstanceDetails* returnInfo) {
+    return createInstanceFromResources(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                       patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                       scaleBufferCount, resourceList, resourceCount, preferenceFlags,
+                                       requirementFlags, memoryBudget, returnInfo);
+}
+
+int beagleCreateShardedInstance(int tipCount,
+                                int partialsBufferCount,
+                                int compactBufferCount,
+                                int stateCount,
+                                int patternCount,
+                                int eigenBufferCount,
+                                int matrixBufferCount,
+                                int categoryCount,
+                                int scaleBufferCount,
+                                int* resourceList,
+                                int resourceCount,
+                                long long preferenceFlags,
+                                long long requirementFlags,
+                                BeagleInstanceDetails* returnInfo) {
+    return beagleCreateShardedInstanceWithWeights(tipCount, partialsBufferCount, compactBufferCount,
+                                                  stateCount, patternCount, eigenBufferCount,
+                                                  matrixBufferCount, categoryCount, scaleBufferCount,
+                                                  resourceList, resourceCount, NULL,
+                                                  preferenceFlags, requirementFlags, returnInfo);
+}
+
+int beagleCreateShardedInstanceWithWeights(int tipCount,
+                                           int partialsBufferCount,
+                                           int compactBufferCount,
+                                           int stateCount,
+                                           int patternCount,
+                                           int eigenBufferCount,
+                                           int matrixBufferCount,
+                                           int categoryCount,
+                                           int scaleBufferCount,
+                                           int* resourceList,
+                                           int resourceCount,
+                                           const double* resourceWeights,
+                                           long long preferenceFlags,
+                                           long long requirementFlags,
+                                           BeagleInstanceDetails* returnInfo) {
+    if (resourceList == NULL || resourceCount == 0)
+        return BEAGLE_ERROR_NO_RESOURCE;
+    if (resourceCount > patternCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (resourceWeights != NULL) {
+        for (int s = 0; s < resourceCount; s++) {
+            if (!(resourceWeights[s] > 0.0))
+                return BEAGLE_ERROR_OUT_OF_RANGE;
+        }
+    }
+
+    if (resourceCount == 1)
+        return beagleCreateInstance(tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                                    patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                                    scaleBufferCount, resourceList, resourceCount,
+                                    preferenceFlags, requirementFlags, returnInfo);
+
+    try {
+        // contiguous blocks of patterns of (nearly) equal size, or sized by weight with at least
+        // one pattern each
+        std::vector<int> patternOffsets(resourceCount + 1);
+        if (resourceWeights == NULL) {
+            for (int s = 0; s <= resourceCount; s++)
+                patternOffsets[s] = (int) (((long) patternCount * s) / resourceCount);
+        } else {
+            double totalWeight = 0.0;
+            for (int s = 0; s < resourceCount; s++)
+                totalWeight += resourceWeights[s];
+            double cumulativeWeight = 0.0;
+            patternOffsets[0] = 0;
+            for (int s = 1; s < resourceCount; s++) {
+                cumulativeWeight += resourceWeights[s - 1];
+                int offset = (int) (patternCount * cumulativeWeight / totalWeight + 0.5);
+                offset = (std::max)(offset, patternOffsets[s - 1] + 1);
+                patternOffsets[s] = (std::min)(offset, patternCount - (resourceCount - s));
+            }
+            patternOffsets[resourceCount] = patternCount;
+        }
+
+        std::vector<beagle::BeagleImpl*> shards;
+        for (int s = 0; s < resourceCount; s++) {
+            // the shards are recorded as the one instance they make up
+            beagle::CallRecordingPause recordingPause;
+            BeagleInstanceDetails shardInfo;
+            int shardInstance = createInstanceFromResources(tipCount, partialsBufferCount, compactBufferCount,
+                                                            stateCount, patternOffsets[s + 1] - patternOffsets[s],
+                                                            eigenBufferCount, matrixBufferCount, categoryCount,
+                                                            scaleBufferCount, &resourceList[s], 1,
+                                                            preferenceFlags, requirementFlags, 0,
+                                                            (s == 0 ? returnInfo : &shardInfo));
+            if (shardInstance < 0) {
+                for (size_t i = 0; i < shards.size(); i++)
+                    delete shards[i];
+                return shardInstance;
+            }
+            // the shards are owned by the sharded instance and not addressable on their own
+            shards.push_back(removeInstance(shardInstance));
+        }
+
+        beagle::BeagleImpl* shardedBeagle = new beagle::BeagleShardedImpl(shards, patternOffsets,
+                                                                          stateCount, categoryCount);
+        initializeStatistics(shardedBeagle, stateCount, patternCount, categoryCount);
+        int instance = addInstance(shardedBeagle);
+        if (instance < 0) {
+            delete shardedBeagle;
+            return instance;
+        }
+
+        recordCreateInstance(instance, tipCount, partialsBufferCount, compactBufferCount, stateCount,
+                             patternCount, eigenBufferCount, matrixBufferCount, categoryCount,
+                             scaleBufferCount, -1, preferenceFlags, requirementFlags, returnInfo->flags);
+        return instance;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleFinalizeInstance(int instance) {
     DEBUG_FINALIZE_TIME();
     try {
-        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        beagle::BeagleImpl* beagleInstance = removeInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_FINALIZE_INSTANCE, instance);
         delete beagleInstance;
-        (*instances)[instance] = NULL;
+        record.write(BEAGLE_SUCCESS);
         return BEAGLE_SUCCESS;
     }
     catch (std::bad_alloc &) {
@@ -513,6 +1452,34 @@ int beagleFinalizeInstance(int instance) {
     }
 }
 
+int beagleGetInstanceStatistics(int instance,
+                                BeagleCallStatistics* outStatistics) {
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    std::copy(beagleInstance->statistics.calls, beagleInstance->statistics.calls + BEAGLE_STATISTIC_COUNT,
+              outStatistics);
+    return BEAGLE_SUCCESS;
+}
+
+int beagleResetInstanceStatistics(int instance) {
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    std::fill(beagleInstance->statistics.calls, beagleInstance->statistics.calls + BEAGLE_STATISTIC_COUNT,
+              BeagleCallStatistics());
+    int returnValue = beagleInstance->resetScalingStatistics();
+    return (returnValue == BEAGLE_ERROR_NO_IMPLEMENTATION ? BEAGLE_SUCCESS : returnValue);
+}
+
+int beagleGetScalingStatistics(int instance,
+                               BeagleScalingStatistics* outStatistics) {
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    return beagleInstance->getScalingStatistics(outStatistics);
+}
+
 int beagleSetTipStates(int instance,
                  int tipIndex,
                  const int* inStates) {
@@ -521,7 +1488,11 @@ int beagleSetTipStates(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.patternCount);
+        beagle::CallRecord record(beagle::RECORD_SET_TIP_STATES, instance);
         int returnValue = beagleInstance->setTipStates(tipIndex, inStates);
+        if (record.active())
+            record.addInt(tipIndex).addInts(inStates, beagleInstance->statistics.patternCount).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
     }
@@ -544,7 +1515,94 @@ int beagleSetTipPartials(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.tipPartialsSize());
+        beagle::CallRecord record(beagle::RECORD_SET_TIP_PARTIALS, instance);
         int returnValue = beagleInstance->setTipPartials(tipIndex, inPartials);
+        if (record.active())
+            record.addInt(tipIndex).addDoubles(inPartials, (long) beagleInstance->statistics.tipPartialsSize()).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipStateSets(int instance,
+                          int tipIndex,
+                          const int* inStateSets) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.patternCount);
+        beagle::CallRecord record(beagle::RECORD_SET_TIP_STATE_SETS, instance);
+        int returnValue = beagleInstance->setTipStateSets(tipIndex, inStateSets);
+        if (record.active())
+            record.addInt(tipIndex).addInts(inStateSets, beagleInstance->statistics.patternCount).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipStatesBatch(int instance,
+                            const int* tipIndices,
+                            const int* inStates,
+                            int count) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, (double) count * beagleInstance->statistics.patternCount);
+        beagle::CallRecord record(beagle::RECORD_SET_TIP_STATES_BATCH, instance);
+        int returnValue = beagleInstance->setTipStatesBatch(tipIndices, inStates, count);
+        if (record.active())
+            record.addInts(tipIndices, count).addInts(inStates, (long) count * beagleInstance->statistics.patternCount).addInt(count).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipPartialsBatch(int instance,
+                              const int* tipIndices,
+                              const double* inPartials,
+                              int count) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, count * beagleInstance->statistics.tipPartialsSize());
+        beagle::CallRecord record(beagle::RECORD_SET_TIP_PARTIALS_BATCH, instance);
+        int returnValue = beagleInstance->setTipPartialsBatch(tipIndices, inPartials, count);
+        if (record.active())
+            record.addInts(tipIndices, count).addDoubles(inPartials, (long) (count * beagleInstance->statistics.tipPartialsSize())).addInt(count).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
     }
@@ -567,7 +1625,36 @@ int beagleSetPartials(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.partialsSize());
+        beagle::CallRecord record(beagle::RECORD_SET_PARTIALS, instance);
         int returnValue = beagleInstance->setPartials(bufferIndex, inPartials);
+        if (record.active())
+            record.addInt(bufferIndex).addDoubles(inPartials, (long) beagleInstance->statistics.partialsSize()).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* outPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.partialsSize());
+        beagle::CallRecord record(beagle::RECORD_GET_PARTIALS, instance);
+        int returnValue = beagleInstance->getPartials(bufferIndex, scaleIndex, outPartials);
+        if (record.active())
+            record.addInt(bufferIndex).addInt(scaleIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
     }
@@ -582,25 +1669,110 @@ int beagleSetPartials(int instance,
     }
 }
 
-int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* outPartials) {
+int beagleGetBufferLayout(int instance,
+                          BeagleBufferLayout* outLayout) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getBufferLayout(outLayout);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetTipPartialsNative(int instance,
+                               int tipIndex,
+                               const void* inPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.tipPartialsSize());
+        int returnValue = beagleInstance->setTipPartialsNative(tipIndex, inPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetPartialsNative(int instance,
+                            int bufferIndex,
+                            const void* inPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.partialsSize());
+        int returnValue = beagleInstance->setPartialsNative(bufferIndex, inPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetPartialsView(int instance,
+                          int bufferIndex,
+                          const void** outPartials) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getPartialsView(bufferIndex, outPartials);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleReleasePartials(int instance, int bufferIndex) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->releasePartials(bufferIndex);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSaveState(int instance) {
     DEBUG_START_TIME();
     try {
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
-        int returnValue = beagleInstance->getPartials(bufferIndex, scaleIndex, outPartials);
+        int returnValue = beagleInstance->saveState();
         DEBUG_END_TIME();
         return returnValue;
     }
     catch (std::bad_alloc &) {
         return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
-    catch (std::out_of_range &) {
-        return BEAGLE_ERROR_OUT_OF_RANGE;
-    }
-    catch (...) {
-        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
-    }
+}
+
+int beagleRestoreState(int instance) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->restoreState();
+    DEBUG_END_TIME();
+    return returnValue;
 }
 
 int beagleSetEigenDecomposition(int instance,
@@ -613,8 +1785,18 @@ int beagleSetEigenDecomposition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_EIGEN_DECOMPOSITION, instance);
         int returnValue = beagleInstance->setEigenDecomposition(eigenIndex, inEigenVectors,
                                                      inInverseEigenVectors, inEigenValues);
+        if (record.active()) {
+            BeagleInstanceDetails details;
+            int valueCount = beagleInstance->statistics.stateCount;
+            if (beagleInstance->getInstanceDetails(&details) == BEAGLE_SUCCESS && (details.flags & BEAGLE_FLAG_EIGEN_COMPLEX))
+                valueCount *= 2;
+            long matrixValues = (long) beagleInstance->statistics.stateCount * beagleInstance->statistics.stateCount;
+            record.addInt(eigenIndex).addDoubles(inEigenVectors, matrixValues).addDoubles(inInverseEigenVectors, matrixValues)
+                .addDoubles(inEigenValues, valueCount).write(returnValue);
+        }
         DEBUG_END_TIME();
         return returnValue;
     }
@@ -636,7 +1818,10 @@ int beagleSetStateFrequencies(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_STATE_FREQUENCIES, instance);
     int returnValue = beagleInstance->setStateFrequencies(stateFrequenciesIndex, inStateFrequencies);
+    if (record.active())
+        record.addInt(stateFrequenciesIndex).addDoubles(inStateFrequencies, beagleInstance->statistics.stateCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -648,7 +1833,10 @@ int beagleSetCategoryWeights(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_CATEGORY_WEIGHTS, instance);
     int returnValue = beagleInstance->setCategoryWeights(categoryWeightsIndex, inCategoryWeights);
+    if (record.active())
+        record.addInt(categoryWeightsIndex).addDoubles(inCategoryWeights, beagleInstance->statistics.categoryCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -659,7 +1847,10 @@ int beagleSetPatternWeights(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_PATTERN_WEIGHTS, instance);
     int returnValue = beagleInstance->setPatternWeights(inPatternWeights);
+    if (record.active())
+        record.addDoubles(inPatternWeights, beagleInstance->statistics.patternCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -671,11 +1862,158 @@ int beagleSetPatternPartitions(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_PATTERN_PARTITIONS, instance);
     int returnValue = beagleInstance->setPatternPartitions(partitionCount, inPatternPartitions);
+    if (record.active())
+        record.addInt(partitionCount).addInts(inPatternPartitions, beagleInstance->statistics.patternCount).write(returnValue);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSetCPUThreadCount(int instance,
+                            int threadCount) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_CPU_THREAD_COUNT, instance);
+    int returnValue = beagleInstance->setCPUThreadCount(threadCount);
+    if (record.active())
+        record.addInt(threadCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
 
+int beagleSetTransitionMatrixCacheSize(int instance,
+                                       int cacheSize) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_TRANSITION_MATRIX_CACHE_SIZE, instance);
+        int returnValue = beagleInstance->setTransitionMatrixCacheSize(cacheSize);
+        if (record.active())
+            record.addInt(cacheSize).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetIncrementalUpdates(int instance,
+                                int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_INCREMENTAL_UPDATES, instance);
+        int returnValue = beagleInstance->setIncrementalUpdates(enabled);
+        if (record.active())
+            record.addInt(enabled).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetExponentScaling(int instance,
+                             int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_EXPONENT_SCALING, instance);
+        int returnValue = beagleInstance->setExponentScaling(enabled);
+        if (record.active())
+            record.addInt(enabled).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetAdaptiveRescaling(int instance,
+                               int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_ADAPTIVE_RESCALING, instance);
+        int returnValue = beagleInstance->setAdaptiveRescaling(enabled);
+        if (record.active())
+            record.addInt(enabled).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetSiteRepeats(int instance,
+                         int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_SITE_REPEATS, instance);
+        int returnValue = beagleInstance->setSiteRepeats(enabled);
+        if (record.active())
+            record.addInt(enabled).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetPartialsBackingDirectory(int instance,
+                                      const char* directory) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setPartialsBackingDirectory(directory);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetOperationGraphs(int instance,
+                             int enabled) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_OPERATION_GRAPHS, instance);
+        int returnValue = beagleInstance->setOperationGraphs(enabled);
+        if (record.active())
+            record.addInt(enabled).write(returnValue);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
 int beagleSetCategoryRates(int instance,
                      const double* inCategoryRates) {
     DEBUG_START_TIME();
@@ -683,7 +2021,10 @@ int beagleSetCategoryRates(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_SET_CATEGORY_RATES, instance);
         int returnValue = beagleInstance->setCategoryRates(inCategoryRates);
+        if (record.active())
+            record.addDoubles(inCategoryRates, beagleInstance->statistics.categoryCount).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -705,7 +2046,10 @@ int beagleSetCategoryRatesWithIndex(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    beagle::CallRecord record(beagle::RECORD_SET_CATEGORY_RATES_WITH_INDEX, instance);
     int returnValue = beagleInstance->setCategoryRatesWithIndex(categoryRatesIndex, inCategoryRates);
+    if (record.active())
+        record.addInt(categoryRatesIndex).addDoubles(inCategoryRates, beagleInstance->statistics.categoryCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -719,7 +2063,11 @@ int beagleSetTransitionMatrix(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.matrixSize());
+        beagle::CallRecord record(beagle::RECORD_SET_TRANSITION_MATRIX, instance);
         int returnValue = beagleInstance->setTransitionMatrix(matrixIndex, inMatrix, paddedValue);
+        if (record.active())
+            record.addInt(matrixIndex).addDoubles(inMatrix, (long) beagleInstance->statistics.matrixSize()).addDouble(paddedValue).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -734,6 +2082,30 @@ int beagleSetTransitionMatrix(int instance,
 //    }
 }
 
+int beagleSetTransitionMatrixNative(int instance,
+                                    int matrixIndex,
+                                    const void* inMatrix) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.matrixSize());
+        int returnValue = beagleInstance->setTransitionMatrixNative(matrixIndex, inMatrix);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleSetTransitionMatrices(int instance,
                               const int* matrixIndices,
                               const double* inMatrices,
@@ -744,7 +2116,12 @@ int beagleSetTransitionMatrices(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, count * beagleInstance->statistics.matrixSize());
+    beagle::CallRecord record(beagle::RECORD_SET_TRANSITION_MATRICES, instance);
     int returnValue = beagleInstance->setTransitionMatrices(matrixIndices, inMatrices, paddedValues, count);
+    if (record.active())
+        record.addInts(matrixIndices, count).addDoubles(inMatrices, (long) (count * beagleInstance->statistics.matrixSize()))
+                .addDoubles(paddedValues, count).addInt(count).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
     //    }
@@ -766,7 +2143,11 @@ int beagleGetTransitionMatrix(int instance,
 	beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
 	if (beagleInstance == NULL)
 		return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+	StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.matrixSize());
+    beagle::CallRecord record(beagle::RECORD_GET_TRANSITION_MATRIX, instance);
     int returnValue = beagleInstance->getTransitionMatrix(matrixIndex,outMatrix);
+    if (record.active())
+        record.addInt(matrixIndex).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -786,6 +2167,7 @@ int beagleConvolveTransitionMatrices(int instance,
 	if (beagleInstance == NULL) {
 		return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
 	} else {
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_MATRICES, matrixCount);
         int returnValue = beagleInstance->convolveTransitionMatrices(firstIndices,
                                            secondIndices, resultIndices, matrixCount);
         DEBUG_END_TIME();
@@ -806,9 +2188,14 @@ int beagleUpdateTransitionMatrices(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_MATRICES, count * (1 + (firstDerivativeIndices != NULL) + (secondDerivativeIndices != NULL)));
+        beagle::CallRecord record(beagle::RECORD_UPDATE_TRANSITION_MATRICES, instance);
         int returnValue = beagleInstance->updateTransitionMatrices(eigenIndex, probabilityIndices,
                                                         firstDerivativeIndices,
                                                         secondDerivativeIndices, edgeLengths, count);
+        if (record.active())
+            record.addInt(eigenIndex).addInts(probabilityIndices, count).addInts(firstDerivativeIndices, count)
+                    .addInts(secondDerivativeIndices, count).addDoubles(edgeLengths, count).addInt(count).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -835,9 +2222,15 @@ int beagleUpdateTransitionMatricesWithMultipleModels(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_MATRICES, count * (1 + (firstDerivativeIndices != NULL) + (secondDerivativeIndices != NULL)));
+    beagle::CallRecord record(beagle::RECORD_UPDATE_TRANSITION_MATRICES_WITH_MULTIPLE_MODELS, instance);
     int returnValue = beagleInstance->updateTransitionMatricesWithMultipleModels(eigenIndices, categoryRateIndices,
                                                                                  probabilityIndices, firstDerivativeIndices,
                                                                                  secondDerivativeIndices, edgeLengths, count);
+    if (record.active())
+        record.addInts(eigenIndices, count).addInts(categoryRateIndices, count).addInts(probabilityIndices, count)
+                .addInts(firstDerivativeIndices, count).addInts(secondDerivativeIndices, count).addDoubles(edgeLengths, count)
+                .addInt(count).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -852,7 +2245,12 @@ int beagleUpdatePartials(const int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_PARTIALS, operationCount);
+        beagle::CallRecord record(beagle::RECORD_UPDATE_PARTIALS, instance);
         int returnValue = beagleInstance->updatePartials((const int*)operations, operationCount, cumulativeScalingIndex);
+        if (record.active())
+            record.addInts((const int*) operations, (long) operationCount * BEAGLE_OP_COUNT).addInt(operationCount)
+                    .addInt(cumulativeScalingIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -874,11 +2272,72 @@ int beagleUpdatePartialsByPartition(const int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_PARTIALS, operationCount);
+    beagle::CallRecord record(beagle::RECORD_UPDATE_PARTIALS_BY_PARTITION, instance);
     int returnValue = beagleInstance->updatePartialsByPartition((const int*)operations, operationCount);
+    if (record.active())
+        record.addInts((const int*) operations, (long) operationCount * BEAGLE_PARTITION_OP_COUNT).addInt(operationCount).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
 
+int beagleUpdatePartialsForTrees(const int instance,
+                                 const BeagleOperation* operations,
+                                 const int* operationCounts,
+                                 int treeCount,
+                                 const int* cumulativeScaleIndices) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_PARTIALS, (operationCounts != NULL ? std::accumulate(operationCounts, operationCounts + treeCount, 0) : 0));
+        int returnValue = beagleInstance->updatePartialsForTrees((const int*)operations, operationCounts,
+                                                                 treeCount, cumulativeScaleIndices);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleSetRootPrePartials(const int instance,
+                             const int* bufferIndices,
+                             const int* stateFrequenciesIndices,
+                             int count) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setRootPrePartials(bufferIndices, stateFrequenciesIndices, count);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+int beagleUpdatePrePartials(const int instance,
+                                 const BeagleOperation* operations,
+                                 int operationCount) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_PARTIALS, operationCount);
+        int returnValue = beagleInstance->updatePrePartials((const int*)operations, operationCount);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
 int beagleWaitForPartials(const int instance,
                     const int* destinationPartials,
                     int destinationPartialsCount) {
@@ -887,8 +2346,11 @@ int beagleWaitForPartials(const int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::CallRecord record(beagle::RECORD_WAIT_FOR_PARTIALS, instance);
         int returnValue = beagleInstance->waitForPartials(destinationPartials,
                                                   destinationPartialsCount);
+        if (record.active())
+            record.addInts(destinationPartials, destinationPartialsCount).addInt(destinationPartialsCount).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -912,7 +2374,11 @@ int beagleAccumulateScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
          return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, count);
+        beagle::CallRecord record(beagle::RECORD_ACCUMULATE_SCALE_FACTORS, instance);
         int returnValue = beagleInstance->accumulateScaleFactors(scalingIndices, count, cumulativeScalingIndex);
+        if (record.active())
+            record.addInts(scalingIndices, count).addInt(count).addInt(cumulativeScalingIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -937,7 +2403,11 @@ int beagleAccumulateScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
          return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, count);
+        beagle::CallRecord record(beagle::RECORD_ACCUMULATE_SCALE_FACTORS_BY_PARTITION, instance);
         int returnValue = beagleInstance->accumulateScaleFactorsByPartition(scalingIndices, count, cumulativeScalingIndex, partitionIndex);
+        if (record.active())
+            record.addInts(scalingIndices, count).addInt(count).addInt(cumulativeScalingIndex).addInt(partitionIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -961,7 +2431,11 @@ int beagleRemoveScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, count);
+        beagle::CallRecord record(beagle::RECORD_REMOVE_SCALE_FACTORS, instance);
         int returnValue = beagleInstance->removeScaleFactors(scalingIndices, count, cumulativeScalingIndex);
+        if (record.active())
+            record.addInts(scalingIndices, count).addInt(count).addInt(cumulativeScalingIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -986,7 +2460,11 @@ int beagleRemoveScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, count);
+        beagle::CallRecord record(beagle::RECORD_REMOVE_SCALE_FACTORS_BY_PARTITION, instance);
         int returnValue = beagleInstance->removeScaleFactorsByPartition(scalingIndices, count, cumulativeScalingIndex, partitionIndex);
+        if (record.active())
+            record.addInts(scalingIndices, count).addInt(count).addInt(cumulativeScalingIndex).addInt(partitionIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1008,7 +2486,11 @@ int beagleResetScaleFactors(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, 1);
+        beagle::CallRecord record(beagle::RECORD_RESET_SCALE_FACTORS, instance);
         int returnValue = beagleInstance->resetScaleFactors(cumulativeScalingIndex);
+        if (record.active())
+            record.addInt(cumulativeScalingIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1031,7 +2513,11 @@ int beagleResetScaleFactorsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, 1);
+        beagle::CallRecord record(beagle::RECORD_RESET_SCALE_FACTORS_BY_PARTITION, instance);
         int returnValue = beagleInstance->resetScaleFactorsByPartition(cumulativeScalingIndex, partitionIndex);
+        if (record.active())
+            record.addInt(cumulativeScalingIndex).addInt(partitionIndex).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1054,7 +2540,11 @@ int beagleCopyScaleFactors(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_SCALING, 1);
+    beagle::CallRecord record(beagle::RECORD_COPY_SCALE_FACTORS, instance);
     int returnValue = beagleInstance->copyScaleFactors(destScalingIndex, srcScalingIndex);
+    if (record.active())
+        record.addInt(destScalingIndex).addInt(srcScalingIndex).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
     //    }
@@ -1077,7 +2567,11 @@ int beagleGetScaleFactors(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.patternCount);
+    beagle::CallRecord record(beagle::RECORD_GET_SCALE_FACTORS, instance);
     int returnValue = beagleInstance->getScaleFactors(srcScalingIndex, scaleFactors);
+    if (record.active())
+        record.addInt(srcScalingIndex).write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
     //    }
@@ -1104,11 +2598,17 @@ int beagleCalculateRootLogLikelihoods(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_ROOT, count);
+        beagle::CallRecord record(beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS, instance);
         int returnValue = beagleInstance->calculateRootLogLikelihoods(bufferIndices, categoryWeightsIndices,
                                                            stateFrequenciesIndices,
                                                            cumulativeScaleIndices,
                                                            count,
                                                            outSumLogLikelihood);
+        if (record.active())
+            record.addInts(bufferIndices, count).addInts(categoryWeightsIndices, count)
+                    .addInts(stateFrequenciesIndices, count).addInts(cumulativeScaleIndices, count).addInt(count)
+                    .addDouble(*outSumLogLikelihood).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1125,6 +2625,88 @@ int beagleCalculateRootLogLikelihoods(int instance,
 
 }
 
+int beagleCalculateRootLogLikelihoodsAsync(int instance,
+                                           const int* bufferIndices,
+                                           const int* categoryWeightsIndices,
+                                           const int* stateFrequenciesIndices,
+                                           const int* cumulativeScaleIndices,
+                                           int count,
+                                           int resultIndex) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_ROOT, count);
+    int returnValue = beagleInstance->calculateRootLogLikelihoodsAsync(bufferIndices, categoryWeightsIndices,
+                                                                       stateFrequenciesIndices,
+                                                                       cumulativeScaleIndices,
+                                                                       count,
+                                                                       resultIndex);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleGetLogLikelihoodResults(int instance,
+                                  const int* resultIndices,
+                                  int count,
+                                  double* outSumLogLikelihoods) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getLogLikelihoodResults(resultIndices, count, outSumLogLikelihoods);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleCalculateRootLogLikelihoodsForTrees(int instance,
+                                              const int* bufferIndices,
+                                              const int* categoryWeightsIndices,
+                                              const int* stateFrequenciesIndices,
+                                              const int* cumulativeScaleIndices,
+                                              int treeCount,
+                                              double* outSumLogLikelihoods) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_ROOT, treeCount);
+    int returnValue = beagleInstance->calculateRootLogLikelihoodsForTrees(bufferIndices, categoryWeightsIndices,
+                                                                          stateFrequenciesIndices,
+                                                                          cumulativeScaleIndices, treeCount,
+                                                                          outSumLogLikelihoods);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleEvaluateTree(int instance,
+                       int eigenIndex,
+                       const int* probabilityIndices,
+                       const double* edgeLengths,
+                       int edgeCount,
+                       const BeagleOperation* operations,
+                       int operationCount,
+                       const int* scaleIndices,
+                       int scaleCount,
+                       int cumulativeScaleIndex,
+                       int rootBufferIndex,
+                       int categoryWeightsIndex,
+                       int stateFrequenciesIndex,
+                       double* outSumLogLikelihood) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_PARTIALS, operationCount);
+    int returnValue = beagleInstance->evaluateTree(eigenIndex, probabilityIndices, edgeLengths, edgeCount,
+                                                   (const int*)operations, operationCount,
+                                                   scaleIndices, scaleCount, cumulativeScaleIndex,
+                                                   rootBufferIndex, categoryWeightsIndex,
+                                                   stateFrequenciesIndex, outSumLogLikelihood);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
 int beagleCalculateRootLogLikelihoodsByPartition(int instance,
                                                  const int* bufferIndices,
                                                  const int* categoryWeightsIndices,
@@ -1140,6 +2722,8 @@ int beagleCalculateRootLogLikelihoodsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_ROOT, count);
+        beagle::CallRecord record(beagle::RECORD_CALCULATE_ROOT_LOG_LIKELIHOODS_BY_PARTITION, instance);
         int returnValue = beagleInstance->calculateRootLogLikelihoodsByPartition(bufferIndices,
                                                                                  categoryWeightsIndices,
                                                                                  stateFrequenciesIndices,
@@ -1149,6 +2733,16 @@ int beagleCalculateRootLogLikelihoodsByPartition(int instance,
                                                                                  count,
                                                                                  outSumLogLikelihoodByPartition,
                                                                                  outSumLogLikelihood);
+        if (record.active()) {
+            long indexCount = (long) partitionCount * count;
+            record.addInts(bufferIndices, indexCount).addInts(categoryWeightsIndices, indexCount)
+                .addInts(stateFrequenciesIndices, indexCount).addInts(cumulativeScaleIndices, indexCount)
+                .addInts(partitionIndices, indexCount).addInt(partitionCount).addInt(count)
+                .addDouble(*outSumLogLikelihood);
+            for (int i = 0; i < partitionCount; i++)
+                record.addDouble(outSumLogLikelihoodByPartition[i]);
+            record.write(returnValue);
+        }
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1183,6 +2777,8 @@ int beagleCalculateEdgeLogLikelihoods(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_EDGE, count);
+        beagle::CallRecord record(beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS, instance);
         int returnValue = beagleInstance->calculateEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
                                                            probabilityIndices,
                                                            firstDerivativeIndices,
@@ -1191,6 +2787,12 @@ int beagleCalculateEdgeLogLikelihoods(int instance,
                                                            count,
                                                            outSumLogLikelihood, outSumFirstDerivative,
                                                            outSumSecondDerivative);
+        if (record.active())
+            record.addInts(parentBufferIndices, count).addInts(childBufferIndices, count)
+                    .addInts(probabilityIndices, count).addInts(firstDerivativeIndices, count)
+                    .addInts(secondDerivativeIndices, count).addInts(categoryWeightsIndices, count)
+                    .addInts(stateFrequenciesIndices, count).addInts(cumulativeScaleIndices, count).addInt(count)
+                    .addDouble(*outSumLogLikelihood).write(returnValue);
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1228,6 +2830,8 @@ int beagleCalculateEdgeLogLikelihoodsByPartition(int instance,
         beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
         if (beagleInstance == NULL)
             return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_EDGE, count);
+        beagle::CallRecord record(beagle::RECORD_CALCULATE_EDGE_LOG_LIKELIHOODS_BY_PARTITION, instance);
         int returnValue = beagleInstance->calculateEdgeLogLikelihoodsByPartition(
                                                         parentBufferIndices,
                                                         childBufferIndices,
@@ -1246,6 +2850,18 @@ int beagleCalculateEdgeLogLikelihoodsByPartition(int instance,
                                                         outSumFirstDerivative,
                                                         outSumSecondDerivativeByPartition,
                                                         outSumSecondDerivative);
+        if (record.active()) {
+            long indexCount = (long) partitionCount * count;
+            record.addInts(parentBufferIndices, indexCount).addInts(childBufferIndices, indexCount)
+                .addInts(probabilityIndices, indexCount).addInts(firstDerivativeIndices, indexCount)
+                .addInts(secondDerivativeIndices, indexCount).addInts(categoryWeightsIndices, indexCount)
+                .addInts(stateFrequenciesIndices, indexCount).addInts(cumulativeScaleIndices, indexCount)
+                .addInts(partitionIndices, indexCount).addInt(partitionCount).addInt(count)
+                .addDouble(*outSumLogLikelihood);
+            for (int i = 0; i < partitionCount; i++)
+                record.addDouble(outSumLogLikelihoodByPartition[i]);
+            record.write(returnValue);
+        }
         DEBUG_END_TIME();
         return returnValue;
 //    }
@@ -1260,13 +2876,64 @@ int beagleCalculateEdgeLogLikelihoodsByPartition(int instance,
 //    }
 }
 
+int beagleCalculateMultiEdgeLogLikelihoods(int instance,
+                                           const int* parentBufferIndices,
+                                           const int* childBufferIndices,
+                                           const int* probabilityIndices,
+                                           const int* firstDerivativeIndices,
+                                           const int* secondDerivativeIndices,
+                                           const int* categoryWeightsIndices,
+                                           const int* stateFrequenciesIndices,
+                                           const int* cumulativeScaleIndices,
+                                           int count,
+                                           double* outLogLikelihoods,
+                                           double* outFirstDerivatives,
+                                           double* outSecondDerivatives) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_EDGE, count);
+        int returnValue = beagleInstance->calculateMultiEdgeLogLikelihoods(parentBufferIndices, childBufferIndices,
+                                                                           probabilityIndices,
+                                                                           firstDerivativeIndices,
+                                                                           secondDerivativeIndices,
+                                                                           categoryWeightsIndices,
+                                                                           stateFrequenciesIndices,
+                                                                           cumulativeScaleIndices, count,
+                                                                           outLogLikelihoods, outFirstDerivatives,
+                                                                           outSecondDerivatives);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
 int beagleGetSiteLogLikelihoods(int instance,
                                 double* outLogLikelihoods) {
     DEBUG_START_TIME();
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, beagleInstance->statistics.patternCount);
+    beagle::CallRecord record(beagle::RECORD_GET_SITE_LOG_LIKELIHOODS, instance);
     int returnValue = beagleInstance->getSiteLogLikelihoods(outLogLikelihoods);
+    if (record.active())
+        record.write(returnValue);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleGetSiteLogLikelihoodsView(int instance,
+                                    const void** outLogLikelihoods) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getSiteLogLikelihoodsView(outLogLikelihoods);
     DEBUG_END_TIME();
     return returnValue;
 }
@@ -1278,8 +2945,39 @@ int beagleGetSiteDerivatives(int instance,
     beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
     if (beagleInstance == NULL)
         return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_TRANSFER, 2.0 * beagleInstance->statistics.patternCount);
+    beagle::CallRecord record(beagle::RECORD_GET_SITE_DERIVATIVES, instance);
     int returnValue = beagleInstance->getSiteDerivatives(outFirstDerivatives, outSecondDerivatives);
+    if (record.active())
+        record.write(returnValue);
     DEBUG_END_TIME();
     return returnValue;
 }
 
+int beagleCalculateEdgeDerivatives(int instance,
+                                   const int* postBufferIndices,
+                                   const int* preBufferIndices,
+                                   const int* probabilityIndices,
+                                   const int* derivativeMatrixIndices,
+                                   const int* categoryWeightsIndices,
+                                   int count,
+                                   double* outDerivatives,
+                                   double* outSumDerivatives) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        StatisticsScope statisticsScope(__func__, instance, beagleInstance, BEAGLE_STATISTIC_EDGE, count);
+        int returnValue = beagleInstance->calculateEdgeDerivatives(postBufferIndices, preBufferIndices,
+                                                                   probabilityIndices, derivativeMatrixIndices,
+                                                                   categoryWeightsIndices, count,
+                                                                   outDerivatives, outSumDerivatives);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
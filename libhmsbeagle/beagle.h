@@ -110,6 +110,8 @@
 
 #include "libhmsbeagle/platform.h"
 
+#include <stddef.h>
+
 /**
  * @anchor BEAGLE_RETURN_CODES
  *
@@ -137,7 +139,8 @@ enum BeagleReturnCodes {
  * @brief Hardware and implementation capability flags
  *
  * This enumerates all possible hardware and implementation capability flags.
- * Each capability is a bit in a 'long'
+ * Each capability is a bit in a 'long long'. An enumerator is an int, so the
+ * flags from bit 31 on are defined as long long constants after the enum.
  */
 enum BeagleFlags {
     BEAGLE_FLAG_PRECISION_SINGLE    = 1 << 0,    /**< Single precision computation */
@@ -183,6 +186,15 @@ enum BeagleFlags {
     BEAGLE_FLAG_PARALLELOPS_GRID    = 1 << 29    /**< Operations in updatePartials may be folded into single kernel launch (necessary for partitions; typically performs better for problems with fewer pattern sites) */
 };
 
+#define BEAGLE_FLAG_THREADING_NUMA      (1LL << 31)  /**< C++11 threading on workers of the instance's own, bound to NUMA nodes, with partials placed on the node of the thread updating them */
+#define BEAGLE_FLAG_VECTOR_AVX512       (1LL << 32)  /**< AVX-512 computation */
+#define BEAGLE_FLAG_VECTOR_NEON         (1LL << 33)  /**< NEON (Advanced SIMD) computation */
+#define BEAGLE_FLAG_MEMORY_ARENA        (1LL << 34)  /**< Allocate the internal buffers of an instance from one huge-page backed slab */
+#define BEAGLE_FLAG_KERNEL_TUNING       (1LL << 35)  /**< Tune the block sizes of runtime-compiled GPU kernels for the device, keeping the results in the user's cache directory */
+#define BEAGLE_FLAG_CALIBRATE           (1LL << 36)  /**< Create the instance on the candidate that meets the requirements and runs a short pruning pass of its shape fastest, remembering the choice for similar shapes */
+#define BEAGLE_FLAG_PREORDER            (1LL << 37)  /**< Pre-order partials and the edge derivatives computed from them (beagleSetRootPrePartials, beagleUpdatePrePartials, beagleCalculateEdgeDerivatives); CPU implementations only */
+#define BEAGLE_FLAG_MULTI_EDGE          (1LL << 38)  /**< beagleCalculateMultiEdgeLogLikelihoods evaluates the edges together rather than making one beagleCalculateEdgeLogLikelihoods call per edge; CPU implementations only, and not under BEAGLE_FLAG_SCALING_AUTO or BEAGLE_FLAG_SCALING_ALWAYS */
+
 /**
  * @anchor BEAGLE_OP_CODES
  *
@@ -193,9 +205,80 @@ enum BeagleFlags {
 enum BeagleOpCodes {
     BEAGLE_OP_COUNT              = 7, /**< Total number of integers per beagleUpdatePartials operation */
     BEAGLE_PARTITION_OP_COUNT    = 9, /**< Total number of integers per beagleUpdatePartialsByPartition operation */
+    BEAGLE_RESULT_SLOT_COUNT     = 256, /**< Number of result slots of beagleCalculateRootLogLikelihoodsAsync */
     BEAGLE_OP_NONE               = -1 /**< Specify no use for indexed buffer */
 };
 
+/**
+ * @anchor BEAGLE_STATISTIC_CLASSES
+ *
+ * @brief Classes of work counted by beagleGetInstanceStatistics
+ *
+ * Each class gathers the API calls that run one kind of kernel.
+ */
+enum BeagleStatisticClasses {
+    BEAGLE_STATISTIC_PARTIALS = 0, /**< Pruning: partials updates, pre-order and by partition, with any
+                                    *   rescaling done within them */
+    BEAGLE_STATISTIC_MATRICES = 1, /**< Matrix exponentiation: transition matrix updates and convolutions */
+    BEAGLE_STATISTIC_SCALING  = 2, /**< Accumulating, removing, resetting and copying scale factors */
+    BEAGLE_STATISTIC_ROOT     = 3, /**< Root log likelihood integration */
+    BEAGLE_STATISTIC_EDGE     = 4, /**< Edge log likelihood and derivative integration */
+    BEAGLE_STATISTIC_TRANSFER = 5, /**< Setting and getting tips, partials, matrices and results */
+    BEAGLE_STATISTIC_COUNT    = 6  /**< Number of statistic classes */
+};
+
+/**
+ * @brief Work done by one class of calls on an instance
+ *
+ * FLOPs and bytes are estimated from the instance's state, pattern and category counts and
+ * the number of buffers each call touches; they ignore padding, compact tips and caching.
+ */
+typedef struct {
+    long long callCount; /**< Number of calls */
+    double seconds;      /**< Cumulative wall time spent in the calls */
+    double flops;        /**< Estimated floating point operations */
+    double bytes;        /**< Estimated bytes read and written by the kernels or copied */
+} BeagleCallStatistics;
+
+/**
+ * @brief Rescaling done by an instance
+ *
+ * A pass rescales the partials an operation writes, over the patterns of its partition or, where
+ * the work is split among threads, of a range of them. The
+ * exponent of a pattern is the binary exponent e of its largest partial, which lies in
+ * [2^(e-1), 2^e), before the partials were rescaled. A pattern is near underflow when e is below
+ * half the smallest normal exponent of the instance's precision (-62 in single, -510 in double).
+ * Instances on GPUs count passes and patterns only, since their scale factors stay on the device.
+ */
+typedef struct {
+    long long passCount;                /**< Rescaling passes */
+    long long unchangedPassCount;       /**< Passes that changed no partials */
+    long long patternCount;             /**< Patterns examined by the passes */
+    long long rescaledPatternCount;     /**< Patterns whose partials were changed */
+    long long nearUnderflowPatternCount;/**< Patterns found near underflow */
+    int minExponent;                    /**< Smallest exponent of a pattern */
+    int maxExponent;                    /**< Largest exponent of a pattern */
+    double exponentSum;                 /**< Sum of the exponents of the patterns, over patternCount
+                                         *   for their mean */
+} BeagleScalingStatistics;
+
+/**
+ * @brief Layout of the buffers of an instance, for the native set and view functions
+ *
+ * A partials buffer holds, for each rate category in turn, partialsPatternCount patterns of
+ * partialsStateCount values each; the values after stateCount and the patterns after
+ * patternCount are padding and hold 0. A transition matrix buffer holds, for each rate category
+ * in turn, stateCount rows of matrixRowSize values each; the values after stateCount are the
+ * padded value of beagleSetTransitionMatrix. Values are float when realSize is 4 and double
+ * when it is 8.
+ */
+typedef struct {
+    int realSize;               /**< Bytes per value */
+    int partialsStateCount;     /**< Values per pattern of a partials buffer */
+    int partialsPatternCount;   /**< Patterns per rate category of a partials buffer */
+    int matrixRowSize;          /**< Values per row of a transition matrix */
+} BeagleBufferLayout;
+
 /**
  * @brief Information about a specific instance
  */
@@ -206,7 +289,7 @@ typedef struct {
     char* implName;     /**< Name of implementation on which this instance is running as a
                          *   NULL-terminated character string */
     char* implDescription; /**< Description of implementation with details such as how auto-scaling is performed */
-    long flags;         /**< Bit-flags that characterize the activate
+    long long flags;         /**< Bit-flags that characterize the activate
                          *   capabilities of the resource and implementation for this instance */
 } BeagleInstanceDetails;
 
@@ -216,8 +299,8 @@ typedef struct {
 typedef struct {
     char* name;         /**< Name of resource as a NULL-terminated character string */
     char* description;  /**< Description of resource as a NULL-terminated character string */
-    long  supportFlags; /**< Bit-flags of supported capabilities on resource */
-    long  requiredFlags;/**< Bit-flags that identify resource type */
+    long long  supportFlags; /**< Bit-flags of supported capabilities on resource */
+    long long  requiredFlags;/**< Bit-flags that identify resource type */
 } BeagleResource;
 
 /**
@@ -264,12 +347,58 @@ BEAGLE_DLLEXPORT const char* beagleGetCitation(void);
  */
 BEAGLE_DLLEXPORT BeagleResourceList* beagleGetResourceList(void);
 
+/**
+ * @brief Compress alignment sites into unique site patterns
+ *
+ * This function collapses identical alignment columns into unique site patterns, whose
+ * tip data and weights can be passed to beagleSetTipStates and beagleSetPatternWeights of
+ * an instance created with patternCount patterns. It does not require an instance.
+ *
+ * When inSitePartitions is given, identical columns in different partitions remain separate
+ * patterns, and the patterns are ordered by partition so that outPatternPartitions can be
+ * passed to beagleSetPatternPartitions. Within a partition, patterns are in the order of
+ * their first site.
+ *
+ * Each output array has room for siteCount patterns; only the first patternCount entries
+ * (per taxon for the states) are written. The states of taxon t for pattern p are written to
+ * outPatternStates[t * patternCount + p], so outPatternStates + t * patternCount can be
+ * passed directly to beagleSetTipStates.
+ *
+ * @param taxonCount            Number of taxa (input)
+ * @param siteCount             Number of alignment sites (input)
+ * @param inSiteStates          Array of taxonCount * siteCount states, taxon-major (input)
+ * @param inSiteWeights         Array of siteCount site weights, NULL for a weight of 1 per
+ *                               site (input)
+ * @param inSitePartitions      Array of siteCount partition indices, NULL for a single
+ *                               partition (input)
+ * @param outPatternCount       Pointer to the number of unique patterns (output)
+ * @param outPatternStates      Array of taxonCount * siteCount states (output)
+ * @param outPatternWeights     Array of siteCount pattern weights (output)
+ * @param outPatternPartitions  Array of siteCount pattern partition indices, may be NULL
+ *                               (output)
+ * @param outSitePatterns       Array of siteCount pattern indices, one per site, may be NULL
+ *                               (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCompressPatterns(int taxonCount,
+                                            int siteCount,
+                                            const int* inSiteStates,
+                                            const double* inSiteWeights,
+                                            const int* inSitePartitions,
+                                            int* outPatternCount,
+                                            int* outPatternStates,
+                                            double* outPatternWeights,
+                                            int* outPatternPartitions,
+                                            int* outSitePatterns);
+
 /**
  * @brief Create a single instance
  *
  * This function creates a single instance of the BEAGLE library and can be called
  * multiple times to create multiple data partition instances each returning a unique
- * identifier.
+ * identifier. Instances may be created, used and finalized from several threads at once;
+ * calls on any one instance must not overlap.
  *
  * @param tipCount              Number of tip data elements (input)
  * @param partialsBufferCount   Number of partials buffers to create (input)
@@ -306,14 +435,206 @@ BEAGLE_DLLEXPORT int beagleCreateInstance(int tipCount,
                          int scaleBufferCount,
                          int* resourceList,
                          int resourceCount,
-                         long preferenceFlags,
-                         long requirementFlags,
+                         long long preferenceFlags,
+                         long long requirementFlags,
                          BeagleInstanceDetails* returnInfo);
 
+/**
+ * @brief Get the memory an instance would use
+ *
+ * This function reports the bytes that the instance beagleCreateInstance would create for the
+ * same arguments holds once every buffer has been written, without creating it. The count
+ * includes the padding of states and patterns, the scale buffers and the temporaries used for
+ * root and edge integration and their derivatives. For GPU resources it is the device memory
+ * reserved on a discrete card; for CPU resources it is host memory. Candidates whose
+ * implementation cannot estimate their footprint are passed over.
+ *
+ * @param tipCount              Number of tip data elements (input)
+ * @param partialsBufferCount   Number of partials buffers to create (input)
+ * @param compactBufferCount    Number of compact state representation buffers to create (input)
+ * @param stateCount            Number of states in the continuous-time Markov chain (input)
+ * @param patternCount          Number of site patterns to be handled by the instance (input)
+ * @param eigenBufferCount      Number of rate matrix eigen-decomposition, category weight,
+ *                               category rates, and state frequency buffers to allocate (input)
+ * @param matrixBufferCount     Number of transition probability matrix buffers (input)
+ * @param categoryCount         Number of rate categories (input)
+ * @param scaleBufferCount      Number of scale buffers to create, ignored for auto scale or always scale (input)
+ * @param resourceList          List of potential resources on which this instance is allowed
+ *                               (input, NULL implies no restriction)
+ * @param resourceCount         Length of resourceList list (input)
+ * @param preferenceFlags       Bit-flags indicating preferred implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param requirementFlags      Bit-flags indicating required implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param outBytes              Pointer to destination for the number of bytes (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetInstanceMemoryFootprint(int tipCount,
+                                                      int partialsBufferCount,
+                                                      int compactBufferCount,
+                                                      int stateCount,
+                                                      int patternCount,
+                                                      int eigenBufferCount,
+                                                      int matrixBufferCount,
+                                                      int categoryCount,
+                                                      int scaleBufferCount,
+                                                      int* resourceList,
+                                                      int resourceCount,
+                                                      long long preferenceFlags,
+                                                      long long requirementFlags,
+                                                      size_t* outBytes);
+
+/**
+ * @brief Create a single instance that fits a memory budget
+ *
+ * This function creates an instance like beagleCreateInstance, but passes over every resource
+ * and implementation whose footprint, as reported by beagleGetInstanceMemoryFootprint, exceeds
+ * memoryBudget. Where precision is only preferred, a single precision implementation is thus
+ * taken when the double precision ones do not fit. Buffer counts are the caller's and are never
+ * reduced. Returns BEAGLE_ERROR_OUT_OF_MEMORY if no candidate fits.
+ *
+ * @param tipCount              Number of tip data elements (input)
+ * @param partialsBufferCount   Number of partials buffers to create (input)
+ * @param compactBufferCount    Number of compact state representation buffers to create (input)
+ * @param stateCount            Number of states in the continuous-time Markov chain (input)
+ * @param patternCount          Number of site patterns to be handled by the instance (input)
+ * @param eigenBufferCount      Number of rate matrix eigen-decomposition, category weight,
+ *                               category rates, and state frequency buffers to allocate (input)
+ * @param matrixBufferCount     Number of transition probability matrix buffers (input)
+ * @param categoryCount         Number of rate categories (input)
+ * @param scaleBufferCount      Number of scale buffers to create, ignored for auto scale or always scale (input)
+ * @param resourceList          List of potential resources on which this instance is allowed
+ *                               (input, NULL implies no restriction)
+ * @param resourceCount         Length of resourceList list (input)
+ * @param preferenceFlags       Bit-flags indicating preferred implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param requirementFlags      Bit-flags indicating required implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param memoryBudget          Largest footprint in bytes the instance may have (input)
+ * @param returnInfo            Pointer to return implementation and resource details
+ *
+ * @return the unique instance identifier (<0 if failed, see @ref BEAGLE_RETURN_CODES
+ * "BeagleReturnCodes")
+ */
+BEAGLE_DLLEXPORT int beagleCreateInstanceWithMemoryBudget(int tipCount,
+                                                          int partialsBufferCount,
+                                                          int compactBufferCount,
+                                                          int stateCount,
+                                                          int patternCount,
+                                                          int eigenBufferCount,
+                                                          int matrixBufferCount,
+                                                          int categoryCount,
+                                                          int scaleBufferCount,
+                                                          int* resourceList,
+                                                          int resourceCount,
+                                                          long long preferenceFlags,
+                                                          long long requirementFlags,
+                                                          size_t memoryBudget,
+                                                          BeagleInstanceDetails* returnInfo);
+
+/**
+ * @brief Create an instance spread over several resources
+ *
+ * This function creates an instance whose patterns are split into contiguous blocks of
+ * (nearly) equal size, one block on each resource in resourceList, for example one per GPU
+ * of a multi-GPU node. The instance is used exactly like one returned by beagleCreateInstance:
+ * pattern-indexed data is sliced between the resources, models, matrices and operations are
+ * replicated on every resource, and log-likelihoods and derivatives are summed across them.
+ * Each resource evaluates its block independently, so work queued on asynchronous resources
+ * overlaps. returnInfo describes the first resource. With a single resource this is the same
+ * as beagleCreateInstance.
+ *
+ * @param tipCount              Number of tip data elements (input)
+ * @param partialsBufferCount   Number of partials buffers to create (input)
+ * @param compactBufferCount    Number of compact state representation buffers to create (input)
+ * @param stateCount            Number of states in the continuous-time Markov chain (input)
+ * @param patternCount          Number of site patterns to be handled by the instance (input)
+ * @param eigenBufferCount      Number of rate matrix eigen-decomposition, category weight,
+ *                               category rates, and state frequency buffers to allocate (input)
+ * @param matrixBufferCount     Number of transition probability matrix buffers (input)
+ * @param categoryCount         Number of rate categories (input)
+ * @param scaleBufferCount      Number of scale buffers to create, ignored for auto scale or always scale (input)
+ * @param resourceList          List of resources, one per block of patterns (input)
+ * @param resourceCount         Length of resourceList list, at most patternCount (input)
+ * @param preferenceFlags       Bit-flags indicating preferred implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param requirementFlags      Bit-flags indicating required implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param returnInfo            Pointer to return implementation and resource details
+ *
+ * @return the unique instance identifier (<0 if failed, see @ref BEAGLE_RETURN_CODES
+ * "BeagleReturnCodes")
+ */
+BEAGLE_DLLEXPORT int beagleCreateShardedInstance(int tipCount,
+                                                 int partialsBufferCount,
+                                                 int compactBufferCount,
+                                                 int stateCount,
+                                                 int patternCount,
+                                                 int eigenBufferCount,
+                                                 int matrixBufferCount,
+                                                 int categoryCount,
+                                                 int scaleBufferCount,
+                                                 int* resourceList,
+                                                 int resourceCount,
+                                                 long long preferenceFlags,
+                                                 long long requirementFlags,
+                                                 BeagleInstanceDetails* returnInfo);
+
+/**
+ * @brief Create an instance spread over several resources in given proportions
+ *
+ * This function creates an instance like beagleCreateShardedInstance, but sizes the block of
+ * patterns on each resource in proportion to its weight instead of equally. Weights are
+ * typically measured throughputs, so that a GPU and the host CPU, or two unequal GPUs, finish
+ * their blocks at about the same time. Every resource receives at least one pattern. The split
+ * is fixed for the life of the instance; to re-balance from newer timings, create a new
+ * instance with updated weights.
+ *
+ * @param tipCount              Number of tip data elements (input)
+ * @param partialsBufferCount   Number of partials buffers to create (input)
+ * @param compactBufferCount    Number of compact state representation buffers to create (input)
+ * @param stateCount            Number of states in the continuous-time Markov chain (input)
+ * @param patternCount          Number of site patterns to be handled by the instance (input)
+ * @param eigenBufferCount      Number of rate matrix eigen-decomposition, category weight,
+ *                               category rates, and state frequency buffers to allocate (input)
+ * @param matrixBufferCount     Number of transition probability matrix buffers (input)
+ * @param categoryCount         Number of rate categories (input)
+ * @param scaleBufferCount      Number of scale buffers to create, ignored for auto scale or always scale (input)
+ * @param resourceList          List of resources, one per block of patterns (input)
+ * @param resourceCount         Length of resourceList list, at most patternCount (input)
+ * @param resourceWeights       Positive relative weight of each resource, NULL for equal blocks (input)
+ * @param preferenceFlags       Bit-flags indicating preferred implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param requirementFlags      Bit-flags indicating required implementation characteristics,
+ *                               see BeagleFlags (input)
+ * @param returnInfo            Pointer to return implementation and resource details
+ *
+ * @return the unique instance identifier (<0 if failed, see @ref BEAGLE_RETURN_CODES
+ * "BeagleReturnCodes")
+ */
+BEAGLE_DLLEXPORT int beagleCreateShardedInstanceWithWeights(int tipCount,
+                                                            int partialsBufferCount,
+                                                            int compactBufferCount,
+                                                            int stateCount,
+                                                            int patternCount,
+                                                            int eigenBufferCount,
+                                                            int matrixBufferCount,
+                                                            int categoryCount,
+                                                            int scaleBufferCount,
+                                                            int* resourceList,
+                                                            int resourceCount,
+                                                            const double* resourceWeights,
+                                                            long long preferenceFlags,
+                                                            long long requirementFlags,
+                                                            BeagleInstanceDetails* returnInfo);
+
 /**
  * @brief Finalize this instance
  *
- * This function finalizes the instance by releasing allocated memory
+ * This function finalizes the instance by releasing allocated memory. Its instance number is
+ * not given to any instance created afterwards, and calls made with it return
+ * BEAGLE_ERROR_UNINITIALIZED_INSTANCE.
  *
  * @param instance  Instance number
  *
@@ -321,6 +642,49 @@ BEAGLE_DLLEXPORT int beagleCreateInstance(int tipCount,
  */
 BEAGLE_DLLEXPORT int beagleFinalizeInstance(int instance);
 
+/**
+ * @brief Get the statistics of an instance
+ *
+ * This function copies, for each of the BEAGLE_STATISTIC_COUNT classes of work in
+ * @ref BEAGLE_STATISTIC_CLASSES "BeagleStatisticClasses", the number of calls, their cumulative
+ * wall time and estimated FLOPs and bytes since the instance was created or its statistics last
+ * reset. Statistics are always gathered; calls on the same instance from several threads at once
+ * may lose counts.
+ *
+ * @param instance          Instance number (input)
+ * @param outStatistics     Pointer to destination for BEAGLE_STATISTIC_COUNT entries, indexed by
+ *                           statistic class (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetInstanceStatistics(int instance,
+                                                 BeagleCallStatistics* outStatistics);
+
+/**
+ * @brief Reset the statistics of an instance
+ *
+ * @param instance          Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleResetInstanceStatistics(int instance);
+
+/**
+ * @brief Get the rescaling statistics of an instance
+ *
+ * This function copies the counters of the rescaling passes run by an instance since it was
+ * created or its statistics last reset by beagleResetInstanceStatistics. They show how far
+ * partials drift between rescalings and how many rescalings changed anything, for choosing how
+ * often to rescale or whether to turn on beagleSetAdaptiveRescaling.
+ *
+ * @param instance          Instance number (input)
+ * @param outStatistics     Pointer to destination for the counters (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetScalingStatistics(int instance,
+                                                BeagleScalingStatistics* outStatistics);
+
 /**
  * @brief Finalize the library
  *
@@ -339,6 +703,11 @@ BEAGLE_DLLEXPORT int beagleFinalize(void);
  * The inStates array should be patternCount in length (replication across categoryCount is not
  * required).
  *
+ * CPU instances store one byte per pattern, and store the tip as partials when stateCount is
+ * above 255. GPU instances store one int per pattern: the states are a small part of device
+ * memory next to the partials, and every kernel that reads them, pattern reordering included,
+ * takes them as ints.
+ *
  * @param instance  Instance number (input)
  * @param tipIndex  Index of destination compactBuffer (input)
  * @param inStates  Pointer to compact states (input)
@@ -367,6 +736,70 @@ BEAGLE_DLLEXPORT int beagleSetTipPartials(int instance,
                          int tipIndex,
                          const double* inPartials);
 
+/**
+ * @brief Set the possible states of each pattern for a tip node
+ *
+ * This function copies a compact state-set representation into an instance buffer, for tips
+ * with ambiguous observations such as IUPAC nucleotide codes. The inStateSets array holds one
+ * bitmask per pattern, with bit s set when state s is possible; a bitmask with no bits below
+ * stateCount marks missing data. The inStateSets array should be patternCount in length.
+ *
+ * CPU instances of up to 8 states keep one byte per pattern and compute partials from a
+ * lookup of each transition matrix row summed over every set of states, as fast as from
+ * compact states. They also store the tip as partials, which edge likelihoods and their
+ * derivatives and pre-order partials read instead. Larger state spaces are stored as tip
+ * partials only. Other implementations return BEAGLE_ERROR_NO_IMPLEMENTATION.
+ *
+ * @param instance      Instance number (input)
+ * @param tipIndex      Index of destination compactBuffer (input)
+ * @param inStateSets   Pointer to state bitmasks (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipStateSets(int instance,
+                                           int tipIndex,
+                                           const int* inStateSets);
+
+/**
+ * @brief Set the compact state representations for several tip nodes
+ *
+ * This function sets the states of count tips as beagleSetTipStates would, in one call. The
+ * inStates array holds the patternCount states of each tip one after another, in the order of
+ * tipIndices. GPU instances pack all tips into pinned host memory and return once the uploads
+ * are queued, so the transfers overlap the rest of instance setup.
+ *
+ * @param instance      Instance number (input)
+ * @param tipIndices    List of indices of destination compactBuffers (input)
+ * @param inStates      Pointer to compact states of all listed tips (input)
+ * @param count         Number of tips (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipStatesBatch(int instance,
+                                             const int* tipIndices,
+                                             const int* inStates,
+                                             int count);
+
+/**
+ * @brief Set partials buffers for several tip nodes
+ *
+ * This function sets the partials of count tips as beagleSetTipPartials would, in one call. The
+ * inPartials array holds the stateCount * patternCount partials of each tip one after another,
+ * in the order of tipIndices. GPU instances pack the tips into pinned host memory and return
+ * once the uploads are queued.
+ *
+ * @param instance      Instance number (input)
+ * @param tipIndices    List of indices of destination partialsBuffers (input)
+ * @param inPartials    Pointer to partials values of all listed tips (input)
+ * @param count         Number of tips (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipPartialsBatch(int instance,
+                                               const int* tipIndices,
+                                               const double* inPartials,
+                                               int count);
+
 /**
  * @brief Set an instance partials buffer
  *
@@ -401,6 +834,121 @@ BEAGLE_DLLEXPORT int beagleGetPartials(int instance,
                       int scaleIndex,
                       double* outPartials);
 
+/**
+ * @brief Get the layout of the buffers of an instance
+ *
+ * This function describes the precision and padding of the instance's buffers, as taken by
+ * beagleSetTipPartialsNative, beagleSetPartialsNative and beagleSetTransitionMatrixNative and
+ * given by beagleGetPartialsView and beagleGetSiteLogLikelihoodsView. Implementations that do
+ * not expose their buffers return BEAGLE_ERROR_NO_IMPLEMENTATION from all of these functions.
+ *
+ * @param instance      Instance number (input)
+ * @param outLayout     Pointer to destination for the layout (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetBufferLayout(int instance,
+                                           BeagleBufferLayout* outLayout);
+
+/**
+ * @brief Set an instance partials buffer for tip node from values in the instance's layout
+ *
+ * This function copies partials already in the instance's precision and padded layout, as given
+ * by beagleGetBufferLayout, into an instance buffer without converting each value. The inPartials
+ * array holds the partials of one rate category, partialsStateCount * partialsPatternCount values,
+ * which are copied categoryCount times as by beagleSetTipPartials.
+ *
+ * @param instance      Instance number (input)
+ * @param tipIndex      Index of destination partialsBuffer (input)
+ * @param inPartials    Pointer to partials values in the instance's layout (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipPartialsNative(int instance,
+                                                int tipIndex,
+                                                const void* inPartials);
+
+/**
+ * @brief Set an instance partials buffer from values in the instance's layout
+ *
+ * This function copies a whole partials buffer already in the instance's precision and padded
+ * layout, as given by beagleGetBufferLayout, into an instance buffer without converting each
+ * value.
+ *
+ * @param instance      Instance number (input)
+ * @param bufferIndex   Index of destination partialsBuffer (input)
+ * @param inPartials    Pointer to partials values in the instance's layout (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetPartialsNative(int instance,
+                                             int bufferIndex,
+                                             const void* inPartials);
+
+/**
+ * @brief Get a read-only view of an instance partials buffer
+ *
+ * This function points outPartials at the partials buffer itself, in the instance's precision
+ * and padded layout as given by beagleGetBufferLayout, without applying scale factors. The view
+ * is valid until the next call on the instance and must not be written through.
+ *
+ * @param instance      Instance number (input)
+ * @param bufferIndex   Index of source partialsBuffer (input)
+ * @param outPartials   Pointer to destination for the address of the partials (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetPartialsView(int instance,
+                                           int bufferIndex,
+                                           const void** outPartials);
+
+/**
+ * @brief Release the memory of an instance buffer
+ *
+ * This function returns the memory held by a partials buffer. CPU implementations allocate a
+ * partials buffer when it is first written by beagleSetTipPartials, beagleSetPartials or as the
+ * destination of beagleUpdatePartials, so buffers that are never used take no memory. A released
+ * buffer must be written again before it is read. Releasing a buffer that holds no memory does
+ * nothing.
+ *
+ * @param instance      Instance number (input)
+ * @param bufferIndex   Index of partialsBuffer to release (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleReleasePartials(int instance,
+                                           int bufferIndex);
+
+/**
+ * @brief Checkpoint the partials and scale buffers of an instance
+ *
+ * This function marks the current contents of every partials and scale buffer as a checkpoint
+ * that beagleRestoreState can return to, replacing any earlier checkpoint. Nothing is copied:
+ * the first write to a buffer after the checkpoint goes to fresh storage and the buffer index is
+ * remapped to it, so only the buffers a proposal actually touches hold a second copy. A host
+ * that rejects moves therefore needs no duplicate set of buffer indices. Tip states, transition
+ * matrices and the other instance inputs are not part of the checkpoint. Reordering patterns with
+ * beagleSetPatternPartitions discards it.
+ *
+ * @param instance      Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSaveState(int instance);
+
+/**
+ * @brief Return the partials and scale buffers of an instance to the last checkpoint
+ *
+ * This function points every partials and scale buffer written since the last beagleSaveState
+ * back at the contents it had then. The checkpoint stays in place, so a host may restore to it
+ * again after further writes.
+ *
+ * @param instance      Instance number (input)
+ *
+ * @return error code; BEAGLE_ERROR_GENERAL if there is no checkpoint
+ */
+BEAGLE_DLLEXPORT int beagleRestoreState(int instance);
+
 /**
  * @brief Set an eigen-decomposition buffer
  *
@@ -508,6 +1056,162 @@ BEAGLE_DLLEXPORT int beagleSetPatternPartitions(int instance,
                                                 int partitionCount,
                                                 const int* inPatternPartitions);
 
+/**
+ * @brief Set the number of CPU threads
+ *
+ * This function sets the number of threads, the calling thread included, that an instance
+ * created with BEAGLE_FLAG_THREADING_CPP may use for each call. By default this is the
+ * number of hardware threads. Automatic pattern partitions are chosen again for the new
+ * number of threads; partitions set with beagleSetPatternPartitions are kept. A count of 1
+ * makes all calls run on the calling thread.
+ *
+ * @param instance      Instance number (input)
+ * @param threadCount   Number of threads (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetCPUThreadCount(int instance,
+                                             int threadCount);
+
+/**
+ * @brief Set the size of the transition matrix cache
+ *
+ * This function makes beagleUpdateTransitionMatrices and
+ * beagleUpdateTransitionMatricesWithMultipleModels reuse transition matrices that were already
+ * computed for the same eigen decomposition, category rates and edge length. A matrix buffer that
+ * still holds the requested matrix is left as it is, and up to cacheSize other matrices are kept,
+ * least recently used first out, to be copied instead of computed again. Matrices computed before
+ * the last beagleSetEigenDecomposition or beagleSetCategoryRates call for their index are never
+ * reused. Derivative matrices are always computed. A size of 0, the default, turns the cache off.
+ *
+ * @param instance      Instance number (input)
+ * @param cacheSize     Number of transition matrices to keep (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTransitionMatrixCacheSize(int instance,
+                                                        int cacheSize);
+
+/**
+ * @brief Turn incremental partials updates on or off
+ *
+ * This function makes an instance track a version for each partials, transition matrix and scale
+ * buffer, bumped every time the buffer is written. beagleUpdatePartials then skips any operation
+ * whose destination already holds the partials computed from the same children, transition
+ * matrices and scale buffers at their current versions, so a host may resubmit a full traversal
+ * after a local change and only the operations downstream of it are computed. An operation that
+ * writes scale factors is never skipped when a cumulative scale index is given, since the
+ * cumulative buffer expects its contribution. Operations are not skipped under
+ * BEAGLE_FLAG_SCALING_DYNAMIC or BEAGLE_FLAG_SCALING_ALWAYS, nor by
+ * beagleUpdatePartialsByPartition. Turning the mode on forgets what every buffer was computed
+ * from; it is off by default.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to skip operations whose destination is current, 0 to compute all (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetIncrementalUpdates(int instance,
+                                                 int enabled);
+
+/**
+ * @brief Turn power-of-two rescaling on or off
+ *
+ * This function makes an instance rescale partials by the power of two nearest above the
+ * largest partial of each pattern instead of by the largest partial itself. The rescaling is
+ * then an exact multiplication, and the stored scale factors are multiples of log(2) (or powers
+ * of two with BEAGLE_FLAG_SCALERS_RAW), so the hot path needs no division or logarithm per
+ * pattern. Log-likelihoods agree with the default rescaling up to rounding. Scale factors
+ * computed under one setting should not be mixed with partials rescaled under the other. It is
+ * off by default.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to rescale by powers of two, 0 to rescale by the largest partial (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetExponentScaling(int instance,
+                                              int enabled);
+
+/**
+ * @brief Turn adaptive rescaling on or off
+ *
+ * This function makes an instance rescale, in each operation that writes scale factors, only the
+ * patterns whose largest partial has fallen below a quarter of the smallest normal exponent of
+ * its precision (2^-31 in single, 2^-255 in double). The other patterns are left as they are and
+ * get a scale factor of one (zero with BEAGLE_FLAG_SCALERS_LOG), so partials drift across several
+ * operations and are rescaled only once they need it, saving the multiplications and logarithms
+ * of needless rescaling.
+ * The bound leaves room for the product of the partials of two children below it. Log-likelihoods agree with the default rescaling up to rounding. It is off by default.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to rescale only patterns near underflow, 0 to rescale every pattern (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetAdaptiveRescaling(int instance,
+                                                int enabled);
+
+/**
+ * @brief Turn site repeats on or off
+ *
+ * This function makes a CPU instance compute, in each operation, the partials of a pattern only
+ * once for all the patterns whose subtree below the destination shows the same states at every
+ * tip, and copy them to the others. The classes of the patterns are built before an operation
+ * list runs, from those of the children, and kept with the buffer until its children or their
+ * classes change, so they are not built again while only branch lengths or the model change.
+ * Only tips set with beagleSetTipStates count; a subtree below a tip set with partials or state
+ * sets, or below a buffer set with beagleSetPartials, is treated as having no repeats. Site
+ * repeats are not used in operations of BEAGLE_FLAG_SCALING_AUTO instances that rescale, nor
+ * where the repeats are too few and scattered to save more than they cost. Log-likelihoods agree
+ * with those computed without site repeats. It is off by default.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to compute repeated patterns once, 0 to compute every pattern (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetSiteRepeats(int instance,
+                                          int enabled);
+
+/**
+ * @brief Page the internal buffers of an instance to a file
+ *
+ * This function moves the slab holding the internal partials, transition matrices and scale
+ * buffers of an instance created with BEAGLE_FLAG_MEMORY_ARENA onto an unlinked file in
+ * directory, so partials that do not fit in memory are paged to that disk instead of failing to
+ * allocate. The buffers keep their contents. From then on updatePartials runs its operations in
+ * windows, reading ahead the children of the next window and writing back those of the last.
+ * Calling it again moves the slab to a new file. Instances created without
+ * BEAGLE_FLAG_MEMORY_ARENA return BEAGLE_ERROR_NO_IMPLEMENTATION.
+ *
+ * @param instance      Instance number (input)
+ * @param directory     Directory in which to create the file (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetPartialsBackingDirectory(int instance,
+                                                       const char* directory);
+
+/**
+ * @brief Turn replay of captured operation lists on or off
+ *
+ * This function makes a CUDA instance capture the kernel launches of beagleUpdatePartials and
+ * beagleUpdatePartialsByPartition into a CUDA graph, and replay that graph when the same
+ * operation list is submitted again, which removes the per-kernel launch overhead for small
+ * and medium pattern counts. Transition matrices may change freely between calls. A changed
+ * operation list is captured anew. Instances using BEAGLE_FLAG_SCALING_DYNAMIC or
+ * BEAGLE_FLAG_SCALING_ALWAYS, or running operations on several streams, launch kernels as usual.
+ * It is off by default.
+ *
+ * @param instance      Instance number (input)
+ * @param enabled       1 to replay captured operation lists, 0 to launch every kernel (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetOperationGraphs(int instance,
+                                              int enabled);
+
 /**
  * @brief Set partitions by pattern weight
  *
@@ -663,6 +1367,24 @@ BEAGLE_DLLEXPORT int beagleSetTransitionMatrices(int instance,
                                                  const double* paddedValues,
                                                  int count);
 
+/**
+ * @brief Set a finite-time transition probability matrix from values in the instance's layout
+ *
+ * This function copies transition matrices already in the instance's precision and padded
+ * layout, as given by beagleGetBufferLayout, into a matrix buffer without converting each value.
+ * The inMatrix array holds stateCount * matrixRowSize * categoryCount values, its padding
+ * included.
+ *
+ * @param instance      Instance number (input)
+ * @param matrixIndex   Index of matrix buffer (input)
+ * @param inMatrix      Pointer to transition matrices in the instance's layout (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTransitionMatrixNative(int instance,
+                                                     int matrixIndex,
+                                                     const void* inMatrix);
+
     
 /**
  * @brief A list of integer indices which specify a partial likelihoods operation.
@@ -684,6 +1406,11 @@ typedef struct {
  * supporting ASYNCH may queue these calculations while other implementations perform these
  * operations immediately and in order.
  *
+ * When every tip is held as compact states, CPU implementations compute a pattern showing one
+ * state at every tip only once per operation and copy its partials to later patterns constant
+ * in the same state. Tips held as partials or state sets, internal partials set by the client
+ * and auto scaling turn this off. GPU implementations compute every pattern.
+ *
  * @param instance                  Instance number (input)
  * @param operations                BeagleOperation list specifying operations (input)
  * @param operationCount            Number of operations (input)
@@ -728,6 +1455,87 @@ BEAGLE_DLLEXPORT int beagleUpdatePartialsByPartition(const int instance,
                                                      const BeagleOperationByPartition* operations,
                                                      int operationCount);
 
+/**
+ * @brief Calculate partials for several independent trees in one call
+ *
+ * This function updates partials for treeCount trees that share the instance's tips, eigen
+ * decompositions and other inputs but use their own partials, transition matrix and scale
+ * buffers, as for several MCMC chains, bootstrap replicates or candidate rearrangements of one
+ * tree. The operations of the trees are given back to back, operationCounts[t] for tree t, each
+ * list in the order beagleUpdatePartials expects. The implementation interleaves the trees by
+ * depth, so the operations of all trees at the same distance from the tips run together and
+ * fill the hardware as one large tree would. Operations of different trees must not write the
+ * same buffers. If cumulativeScaleIndices is not NULL, the scale factors written by the
+ * operations of tree t are added to cumulativeScaleIndices[t] (unless it is BEAGLE_OP_NONE), as
+ * the cumulativeScaleIndex of beagleUpdatePartials would.
+ *
+ * @param instance                  Instance number (input)
+ * @param operations                BeagleOperation list of all trees, tree by tree (input)
+ * @param operationCounts           Number of operations of each tree (input)
+ * @param treeCount                 Number of trees (input)
+ * @param cumulativeScaleIndices    Index of the scaleBuffer accumulating each tree's factors, or
+ *                                   NULL (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleUpdatePartialsForTrees(const int instance,
+                                                  const BeagleOperation* operations,
+                                                  const int* operationCounts,
+                                                  int treeCount,
+                                                  const int* cumulativeScaleIndices);
+
+/**
+ * @brief Set the pre-order partials of the root
+ *
+ * This function starts a pre-order traversal. Each buffer is filled with the state frequencies
+ * in stateFrequenciesIndices, for every category and pattern, and can then serve as the parent's
+ * pre-order partials of the operations for the root's children in beagleUpdatePrePartials.
+ * The buffers must be internal partials buffers, not tips.
+ *
+ * @param instance                  Instance number (input)
+ * @param bufferIndices             List of partialsBuffer indices to fill (input)
+ * @param stateFrequenciesIndices   List of state frequency buffer indices (input)
+ * @param count                     Number of buffers (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetRootPrePartials(const int instance,
+                                              const int* bufferIndices,
+                                              const int* stateFrequenciesIndices,
+                                              int count);
+
+/**
+ * @brief Calculate pre-order partials using a list of operations
+ *
+ * This function computes, root to tips, the pre-order partials of each branch: the probability
+ * of the data outside the subtree below the branch, given the state at the branch's upper end.
+ * They pair with the post-order partials of beagleUpdatePartials in
+ * beagleCalculateEdgeDerivatives. The fields of each BeagleOperation are read as:
+ *
+ *  destinationPartials     pre-order partials of the branch (output)
+ *  destinationScaleWrite   scale buffer to write, or BEAGLE_OP_NONE; ignored under
+ *                           BEAGLE_FLAG_SCALING_AUTO
+ *  destinationScaleRead    ignored
+ *  child1Partials          pre-order partials of the parent's branch, or those set by
+ *                           beagleSetRootPrePartials when the parent is the root
+ *  child1TransitionMatrix  transition matrix of the parent's branch, or BEAGLE_OP_NONE when the
+ *                           parent is the root
+ *  child2Partials          post-order partials or tip states of the sibling
+ *  child2TransitionMatrix  transition matrix of the sibling's branch
+ *
+ * Operations are run in order, so a parent's operation must come before those of its children.
+ * Scale factors only keep the values in range; beagleCalculateEdgeDerivatives does not need them.
+ *
+ * @param instance          Instance number (input)
+ * @param operations        BeagleOperation list specifying operations (input)
+ * @param operationCount    Number of operations (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleUpdatePrePartials(const int instance,
+                                                  const BeagleOperation* operations,
+                                                  int operationCount);
+
 /**
  * @brief Block until all calculations that write to the specified partials have completed.
  *
@@ -737,6 +1545,11 @@ BEAGLE_DLLEXPORT int beagleUpdatePartialsByPartition(const int instance,
  * indices of "destinationPartials" that were used in a previous beagleUpdatePartials
  * call.  The library will block until those partials have been calculated.
  *
+ * CPU instances created with BEAGLE_FLAG_COMPUTATION_ASYNCH queue each beagleUpdatePartials
+ * call and return at once. This function then waits only for the queued calls writing the
+ * listed partials, and returns the first error of any queued call. Every other call on the
+ * instance first waits for all queued calls.
+ *
  * @param instance                  Instance number (input)
  * @param destinationPartials       List of the indices of destinationPartials that must be
  *                                   calculated before the function returns
@@ -901,6 +1714,130 @@ BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoods(int instance,
                                       int count,
                                       double* outSumLogLikelihood);
 
+/**
+ * @brief Calculate the log likelihood at a root node into a result slot
+ *
+ * This function integrates partials like beagleCalculateRootLogLikelihoods, but leaves the log
+ * likelihood sum in a result slot of the instance and returns without waiting for it. Several
+ * sums, for example of alternative trees proposed back to back, can then be collected with one
+ * call to beagleGetLogLikelihoodResults, so a GPU instance copies and synchronizes once per batch
+ * instead of once per likelihood. Writing to a slot replaces its previous sum. Every instance
+ * holds BEAGLE_RESULT_SLOT_COUNT slots, numbered from 0; CPU instances compute the sum
+ * immediately, GPU instances when the device gets to it.
+ *
+ * @param instance                 Instance number (input)
+ * @param bufferIndices            List of partialsBuffer indices to integrate (input)
+ * @param categoryWeightsIndices   List of weights to apply to each partialsBuffer (input)
+ * @param stateFrequenciesIndices  List of state frequencies for each partialsBuffer (input)
+ * @param cumulativeScaleIndices   List of scaleBuffers containing accumulated factors to apply to
+ *                                  each partialsBuffer (input)
+ * @param count                    Number of partialsBuffer to integrate (input)
+ * @param resultIndex              Index of the result slot to write (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoodsAsync(int instance,
+                                                            const int* bufferIndices,
+                                                            const int* categoryWeightsIndices,
+                                                            const int* stateFrequenciesIndices,
+                                                            const int* cumulativeScaleIndices,
+                                                            int count,
+                                                            int resultIndex);
+
+/**
+ * @brief Get log likelihoods left in result slots
+ *
+ * This function waits for the calculations writing the listed result slots and returns their
+ * log likelihood sums. Returns BEAGLE_ERROR_OUT_OF_RANGE if a slot is outside
+ * 0..BEAGLE_RESULT_SLOT_COUNT - 1 or has not been written by beagleCalculateRootLogLikelihoodsAsync,
+ * and BEAGLE_ERROR_FLOATING_POINT if any of the sums is NaN.
+ *
+ * @param instance              Instance number (input)
+ * @param resultIndices         List of result slot indices (input)
+ * @param count                 Number of result slots (input)
+ * @param outSumLogLikelihoods  Pointer to destination for count log likelihoods (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetLogLikelihoodResults(int instance,
+                                                   const int* resultIndices,
+                                                   int count,
+                                                   double* outSumLogLikelihoods);
+
+/**
+ * @brief Calculate the log likelihoods of several independent trees
+ *
+ * This function integrates the root partials of treeCount trees, such as those updated by
+ * beagleUpdatePartialsForTrees, and returns one log likelihood per tree, where
+ * beagleCalculateRootLogLikelihoods would sum its buffers into one. The sums pass through the
+ * result slots of beagleCalculateRootLogLikelihoodsAsync, overwriting their contents, so GPU
+ * instances integrate all roots before copying the sums back once.
+ *
+ * @param instance                 Instance number (input)
+ * @param bufferIndices            Root partialsBuffer index of each tree (input)
+ * @param categoryWeightsIndices   Weights to apply at each root (input)
+ * @param stateFrequenciesIndices  State frequencies at each root (input)
+ * @param cumulativeScaleIndices   ScaleBuffer of accumulated factors of each tree, or
+ *                                  BEAGLE_OP_NONE (input)
+ * @param treeCount                Number of trees (input)
+ * @param outSumLogLikelihoods     Destination for treeCount log likelihoods (output)
+ *
+ * @return error code; BEAGLE_ERROR_FLOATING_POINT if any of the sums is NaN
+ */
+BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoodsForTrees(int instance,
+                                                               const int* bufferIndices,
+                                                               const int* categoryWeightsIndices,
+                                                               const int* stateFrequenciesIndices,
+                                                               const int* cumulativeScaleIndices,
+                                                               int treeCount,
+                                                               double* outSumLogLikelihoods);
+
+/**
+ * @brief Evaluate the log likelihood of a rooted tree in one call
+ *
+ * This function performs a whole likelihood evaluation: it updates the transition matrices of
+ * the listed edges as beagleUpdateTransitionMatrices would, updates partials as
+ * beagleUpdatePartials would, and integrates the root as beagleCalculateRootLogLikelihoods would
+ * with a single partials buffer. If scaleCount is positive, the listed scale buffers are summed
+ * into cumulativeScaleIndex (after resetting it) once the partials are updated, as with
+ * beagleResetScaleFactors and beagleAccumulateScaleFactors; otherwise cumulativeScaleIndex is
+ * passed to the partials update. Setting edgeCount to zero leaves the transition matrices as they
+ * are. The implementation is free to overlap the steps, and the instance is looked up once.
+ *
+ * @param instance                 Instance number (input)
+ * @param eigenIndex               Index of eigen-decomposition buffer (input)
+ * @param probabilityIndices       List of indices of transition probability matrices to update
+ *                                  (input)
+ * @param edgeLengths              List of edge lengths with which to perform calculations (input)
+ * @param edgeCount                Length of lists (input)
+ * @param operations               List of BeagleOperation structs specifying operations (input)
+ * @param operationCount           Number of operations (input)
+ * @param scaleIndices             List of scaleBuffers to add (input)
+ * @param scaleCount               Number of scaleBuffers in list (input)
+ * @param cumulativeScaleIndex     Index number of scaleBuffer holding accumulated factors, or
+ *                                  BEAGLE_OP_NONE (input)
+ * @param rootBufferIndex          Index of the partialsBuffer at the root (input)
+ * @param categoryWeightsIndex     Index of the weights to apply to the root partials (input)
+ * @param stateFrequenciesIndex    Index of the state frequencies at the root (input)
+ * @param outSumLogLikelihood      Pointer to destination for resulting log likelihood (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleEvaluateTree(int instance,
+                                        int eigenIndex,
+                                        const int* probabilityIndices,
+                                        const double* edgeLengths,
+                                        int edgeCount,
+                                        const BeagleOperation* operations,
+                                        int operationCount,
+                                        const int* scaleIndices,
+                                        int scaleCount,
+                                        int cumulativeScaleIndex,
+                                        int rootBufferIndex,
+                                        int categoryWeightsIndex,
+                                        int stateFrequenciesIndex,
+                                        double* outSumLogLikelihood);
+
 /**
  * @brief Calculate site log likelihoods at a root node with per partition buffers
  *
@@ -1034,6 +1971,54 @@ BEAGLE_DLLEXPORT int beagleCalculateEdgeLogLikelihoodsByPartition(
                                                     double* outSumSecondDerivativeByPartition,
                                                     double* outSumSecondDerivative);
 
+/**
+ * @brief Calculate log likelihoods and derivatives along several edges at once
+ *
+ * This function integrates each parent and child pair as its own edge, in the same way as
+ * beagleCalculateEdgeLogLikelihoods with a count of one, and returns one log likelihood and
+ * first and second derivative per edge rather than their sum. Instances whose flags include
+ * BEAGLE_FLAG_MULTI_EDGE evaluate the edges independently, spread over their threads when
+ * threading is enabled; these are CPU instances without BEAGLE_FLAG_SCALING_AUTO or
+ * BEAGLE_FLAG_SCALING_ALWAYS. All others, GPU instances included, make one
+ * beagleCalculateEdgeLogLikelihoods call per edge. On a GPU each of those has its own launches
+ * and copy back, so the call saves nothing over a loop in the client. Site log likelihoods and derivatives are not defined afterwards for
+ * beagleGetSiteLogLikelihoods and beagleGetSiteDerivatives.
+ *
+ * @param instance                  Instance number (input)
+ * @param parentBufferIndices       List of indices of parent partialsBuffers, one per edge (input)
+ * @param childBufferIndices        List of indices of child partialsBuffers, one per edge (input)
+ * @param probabilityIndices        List of indices of transition probability matrices (input)
+ * @param firstDerivativeIndices    List of indices of first derivative matrices, or NULL (input)
+ * @param secondDerivativeIndices   List of indices of second derivative matrices, or NULL (input)
+ * @param categoryWeightsIndices    List of weights to apply to each edge (input)
+ * @param stateFrequenciesIndices   List of state frequencies for each edge (input)
+ * @param cumulativeScaleIndices    List of scaleBuffers containing accumulated factors to apply to
+ *                                   each edge, or BEAGLE_OP_NONE (input)
+ * @param count                     Number of edges (input)
+ * @param outLogLikelihoods         Pointer to destination for the log likelihood of each edge,
+ *                                   count values (output)
+ * @param outFirstDerivatives       Pointer to destination for the first derivative of each edge,
+ *                                   count values, or NULL (output)
+ * @param outSecondDerivatives      Pointer to destination for the second derivative of each edge,
+ *                                   count values, or NULL. Second derivatives are only returned
+ *                                   together with first derivatives (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateMultiEdgeLogLikelihoods(int instance,
+                                                            const int* parentBufferIndices,
+                                                            const int* childBufferIndices,
+                                                            const int* probabilityIndices,
+                                                            const int* firstDerivativeIndices,
+                                                            const int* secondDerivativeIndices,
+                                                            const int* categoryWeightsIndices,
+                                                            const int* stateFrequenciesIndices,
+                                                            const int* cumulativeScaleIndices,
+                                                            int count,
+                                                            double* outLogLikelihoods,
+                                                            double* outFirstDerivatives,
+                                                            double* outSecondDerivatives);
+
 /**
  * @brief Get site log likelihoods for last beagleCalculateRootLogLikelihoods or
  *         beagleCalculateEdgeLogLikelihoods call
@@ -1062,6 +2047,62 @@ BEAGLE_DLLEXPORT int beagleGetSiteLogLikelihoods(int instance,
 BEAGLE_DLLEXPORT int beagleGetSiteDerivatives(int instance,
                                     double* outFirstDerivatives,
                                     double* outSecondDerivatives);    
+
+/**
+ * @brief Get a read-only view of the site log likelihoods of the last likelihood calculation
+ *
+ * This function points outLogLikelihoods at the patternCount site log likelihoods held by the
+ * instance, in its precision as given by beagleGetBufferLayout, rather than copying them as
+ * beagleGetSiteLogLikelihoods does. The view is valid until the next call on the instance and
+ * must not be written through. Instances whose patterns have been reordered by partition return
+ * BEAGLE_ERROR_NO_IMPLEMENTATION, as their likelihoods are not held in the order of the client.
+ *
+ * @param instance               Instance number (input)
+ * @param outLogLikelihoods      Pointer to destination for the address of the log likelihoods (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetSiteLogLikelihoodsView(int instance,
+                                                     const void** outLogLikelihoods);
+
+/**
+ * @brief Calculate the derivatives of the log likelihood with respect to many branches
+ *
+ * This function returns, for each of count branches, the derivative of the log likelihood with
+ * respect to the branch's length. It needs the branch's post-order partials (or tip states) from
+ * beagleUpdatePartials and its pre-order partials from beagleUpdatePrePartials, so one
+ * post-order and one pre-order traversal give the gradient over all branches in time linear in
+ * the size of the tree. The derivative matrices are those of the firstDerivativeIndices of
+ * beagleUpdateTransitionMatrices. A buffer holding the derivative of the transition matrix with
+ * respect to another parameter, set with beagleSetTransitionMatrix, gives that parameter's
+ * contribution through the branch instead, and summing over the branches gives its derivative.
+ * Only implementations offering BEAGLE_FLAG_PREORDER, the CPU ones, provide this function,
+ * beagleSetRootPrePartials and beagleUpdatePrePartials; require the flag to get one. GPU
+ * instances have no pre-order kernels and return BEAGLE_ERROR_NO_IMPLEMENTATION from all three.
+ *
+ * @param instance                  Instance number (input)
+ * @param postBufferIndices         List of post-order partialsBuffer or tip indices (input)
+ * @param preBufferIndices          List of pre-order partialsBuffer indices (input)
+ * @param probabilityIndices        List of transition matrix indices of the branches (input)
+ * @param derivativeMatrixIndices   List of derivative matrix indices of the branches (input)
+ * @param categoryWeightsIndices    List of weights to apply to each partialsBuffer (input)
+ * @param count                     Number of branches (input)
+ * @param outDerivatives            Destination for the per-site derivatives, branch by branch, of
+ *                                   length count times patternCount, or NULL (output)
+ * @param outSumDerivatives         Destination for the derivative of each branch, summed over
+ *                                   sites with the pattern weights, of length count (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateEdgeDerivatives(int instance,
+                                                    const int* postBufferIndices,
+                                                    const int* preBufferIndices,
+                                                    const int* probabilityIndices,
+                                                    const int* derivativeMatrixIndices,
+                                                    const int* categoryWeightsIndices,
+                                                    int count,
+                                                    double* outDerivatives,
+                                                    double* outSumDerivatives);
     
 /* using C calling conventions so that C programs can successfully link the beagle library
  * (closing brace)